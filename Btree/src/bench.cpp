@@ -0,0 +1,661 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+/**
+ * Microbenchmarks of BufMgr, BTreeIndex and FileScan, built by "make bench" into badgerdb_bench.
+ *
+ * Every benchmark prints one CSV line: its name, its parameter, the relation size and pool size it
+ * ran with, the number of operations, the elapsed seconds, operations per second, and the buffer pool
+ * hits and disk reads counted meanwhile. Relations and lookup keys are drawn from a fixed seed, so
+ * runs with the same options do the same work.
+ *
+ * Options, all of the form --name=value:
+ *   records   Number of tuples in the relation (default 100000)
+ *   pool      Number of frames of the buffer pool (default 1000)
+ *   lookups   Number of point lookups (default 10000)
+ *   scans     Number of range scans per selectivity (default 100)
+ *   seed      Seed of the random relation and of the lookup keys (default 1)
+ *   only      Run only the benchmarks whose name starts with this
+ *
+ * The exit status is 1 if a lookup found a different number of entries than it looked for, and 2 on a
+ * bad option.
+ */
+
+#include "btree.h"
+#include "exceptions/end_of_file_exception.h"
+#include "exceptions/file_not_found_exception.h"
+#include "exceptions/index_scan_completed_exception.h"
+#include "exceptions/insufficient_space_exception.h"
+#include "exceptions/no_such_key_found_exception.h"
+#include "file_iterator.h"
+#include "filescan.h"
+#include "page.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+using namespace badgerdb;
+
+namespace {
+
+// -----------------------------------------------------------------------------
+// Options
+// -----------------------------------------------------------------------------
+int numRecords = 100000;
+int poolSize = 1000;
+int numLookups = 10000;
+int numScans = 100;
+unsigned int seed = 1;
+std::string only;
+
+const std::string relationName = "benchRel";
+
+// Number of benchmarks whose lookups found a different number of entries than they looked for
+int numMismatches = 0;
+
+// Tuples of the relation, laid out like those of main.cpp
+typedef struct tuple
+{
+  int i;
+  double d;
+  char s[64];
+} RECORD;
+
+enum Order
+{
+  FORWARD,
+  BACKWARD,
+  RANDOM
+};
+
+typedef std::chrono::steady_clock Clock;
+
+/**
+ * Time and buffer pool counters of one benchmark, printed as a CSV line by finish().
+ */
+struct Measurement
+{
+  std::string name;
+  std::string param;
+  int pool;
+  Clock::time_point start;
+  BufStats before;
+  BufMgr *bufMgr;
+
+  Measurement(const std::string &name, const std::string &param, BufMgr *bufMgr, const int pool)
+    : name(name), param(param), pool(pool), bufMgr(bufMgr)
+  {
+    before = bufMgr->getBufStats();
+    start = Clock::now();
+  }
+
+  void finish(const long ops)
+  {
+    const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    const BufStats after = bufMgr->getBufStats();
+    std::cout << name << ',' << param << ',' << numRecords << ',' << pool << ',' << ops << ','
+              << seconds << ',' << (seconds > 0 ? ops / seconds : 0) << ','
+              << after.hits - before.hits << ',' << after.diskreads - before.diskreads << std::endl;
+  }
+};
+
+bool selected(const std::string &name)
+{
+  return name.compare(0, only.size(), only) == 0;
+}
+
+void removeFile(const std::string &name)
+{
+  try
+  {
+    File::remove(name);
+  }
+  catch (FileNotFoundException e)
+  {
+  }
+}
+
+/**
+ * Create the relation with tuples valued 0 to numRecords - 1, inserted in the given order like
+ * createRelationForward(), createRelationBackward() and createRelationRandom() of main.cpp.
+ */
+void createRelation(const Order order)
+{
+  removeFile(relationName);
+  PageFile file = PageFile::create(relationName);
+
+  std::vector<int> values(numRecords);
+  for (int i = 0; i < numRecords; i++)
+    values[i] = order == BACKWARD ? numRecords - 1 - i : i;
+  if (order == RANDOM)
+  {
+    srandom(seed);
+    for (int i = numRecords - 1; i > 0; i--)
+      std::swap(values[i], values[random() % (i + 1)]);
+  }
+
+  RECORD record;
+  memset(record.s, ' ', sizeof(record.s));
+  PageId pageNo;
+  Page page = file.allocatePage(pageNo);
+  for (int i = 0; i < numRecords; i++)
+  {
+    sprintf(record.s, "%05d string record", values[i]);
+    record.i = values[i];
+    record.d = values[i];
+    std::string data(reinterpret_cast<char *>(&record), sizeof(record));
+    while (1)
+    {
+      try
+      {
+        page.insertRecord(data);
+        break;
+      }
+      catch (InsufficientSpaceException e)
+      {
+        file.writePage(pageNo, page);
+        page = file.allocatePage(pageNo);
+      }
+    }
+  }
+  file.writePage(pageNo, page);
+}
+
+// -----------------------------------------------------------------------------
+// Benchmarks
+// -----------------------------------------------------------------------------
+
+/**
+ * Build an integer index by one insert per tuple, over relations created in each order, and by the
+ * bulk loader, with the sort in memory and spilling.
+ */
+void insertBenchmarks()
+{
+  const char *orders[] = {"forward", "backward", "random"};
+  for (int order = FORWARD; order <= RANDOM; order++)
+  {
+    if (!selected(std::string("insert_") + orders[order]))
+      continue;
+    createRelation((Order) order);
+    std::string indexName;
+    {
+      BufMgr bufMgr(poolSize);
+      Measurement m(std::string("insert_") + orders[order], "", &bufMgr, poolSize);
+      {
+        BTreeIndex index(relationName, indexName, &bufMgr, offsetof(tuple, i), INTEGER, false);
+      }
+      m.finish(numRecords);
+    }
+    removeFile(indexName);
+  }
+
+  if (selected("bulk_load"))
+  {
+    createRelation(RANDOM);
+    std::string indexName;
+    {
+      BufMgr bufMgr(poolSize);
+      Measurement m("bulk_load", "", &bufMgr, poolSize);
+      {
+        BTreeIndex index(relationName, indexName, &bufMgr, offsetof(tuple, i), INTEGER, true);
+      }
+      m.finish(numRecords);
+    }
+    removeFile(indexName);
+  }
+
+  // the same bulk load with a sort given 1MB, which spills runs to a temporary file past it
+  if (selected("bulk_load_spill"))
+  {
+    createRelation(RANDOM);
+    std::string indexName;
+    BTreeIndex::setSortMemory(1 << 20);
+    {
+      BufMgr bufMgr(poolSize);
+      Measurement m("bulk_load_spill", "1MB", &bufMgr, poolSize);
+      {
+        BTreeIndex index(relationName, indexName, &bufMgr, offsetof(tuple, i), INTEGER, true);
+      }
+      m.finish(numRecords);
+    }
+    BTreeIndex::setSortMemory(ExternalSort<int>::DEFAULT_MEMORY);
+    removeFile(indexName);
+  }
+}
+
+/**
+ * Point lookups of random keys, by lookupAll(), in batches and by scans of one key, range scans of several selectivities,
+ * and the greatest 100 keys below random bounds by descending scans, on an integer index.
+ */
+void indexBenchmarks()
+{
+  if (!selected("point_lookup") && !selected("batch_lookup") && !selected("point_scan") && !selected("range_scan")
+      && !selected("top_n_desc"))
+    return;
+  createRelation(RANDOM);
+  std::string indexName;
+  {
+    BufMgr bufMgr(poolSize);
+    BTreeIndex index(relationName, indexName, &bufMgr, offsetof(tuple, i), INTEGER);
+    srandom(seed);
+
+    if (selected("point_lookup"))
+    {
+      Measurement m("point_lookup", "", &bufMgr, poolSize);
+      long found = 0;
+      std::vector<RecordId> rids;
+      for (int n = 0; n < numLookups; n++)
+      {
+        const int key = random() % numRecords;
+        rids.clear();
+        found += index.lookupAll(&key, rids);
+      }
+      m.finish(numLookups);
+      if (found != numLookups)
+      {
+        std::cerr << "point_lookup found " << found << " of " << numLookups << " keys" << std::endl;
+        numMismatches++;
+      }
+    }
+
+    // the same number of lookups, made in batches of 1000 keys
+    if (selected("batch_lookup"))
+    {
+      Measurement m("batch_lookup", "1000", &bufMgr, poolSize);
+      long found = 0;
+      std::vector<int> keys(1000);
+      std::vector<const void *> keyPtrs(keys.size());
+      std::vector<RecordId> rids;
+      std::vector<size_t> offsets;
+      for (int n = 0; n < numLookups; n += keys.size())
+      {
+        const size_t batch = std::min(keys.size(), (size_t)(numLookups - n));
+        for (size_t k = 0; k < batch; k++)
+        {
+          keys[k] = random() % numRecords;
+          keyPtrs[k] = &keys[k];
+        }
+        index.lookupBatch(&keyPtrs[0], batch, rids, offsets);
+        found += rids.size();
+      }
+      m.finish(numLookups);
+      if (found != numLookups)
+      {
+        std::cerr << "batch_lookup found " << found << " of " << numLookups << " keys" << std::endl;
+        numMismatches++;
+      }
+    }
+
+    // the same lookups as a scan over a range of one key
+    if (selected("point_scan"))
+    {
+      Measurement m("point_scan", "", &bufMgr, poolSize);
+      long found = 0;
+      for (int n = 0; n < numLookups; n++)
+      {
+        const int key = random() % numRecords;
+        RecordId rid;
+        index.startScan(&key, GTE, &key, LTE);
+        try
+        {
+          while (1)
+          {
+            index.scanNext(rid);
+            found++;
+          }
+        }
+        catch (IndexScanCompletedException e)
+        {
+        }
+        index.endScan();
+      }
+      m.finish(numLookups);
+      if (found != numLookups)
+      {
+        std::cerr << "point_scan found " << found << " of " << numLookups << " keys" << std::endl;
+        numMismatches++;
+      }
+    }
+
+    if (selected("range_scan"))
+    {
+      const double selectivities[] = {0.0001, 0.001, 0.01, 0.1, 1.0};
+      std::vector<RecordId> rids(4096);
+      for (int s = 0; s < 5; s++)
+      {
+        const int width = std::max(1, (int) (numRecords * selectivities[s]));
+        char param[32];
+        sprintf(param, "%g", selectivities[s]);
+        Measurement m("range_scan", param, &bufMgr, poolSize);
+        long entries = 0;
+        for (int n = 0; n < numScans; n++)
+        {
+          const int low = random() % (numRecords - width + 1);
+          const int high = low + width;
+          try
+          {
+            index.startScan(&low, GTE, &high, LT);
+          }
+          catch (NoSuchKeyFoundException e)
+          {
+            continue;
+          }
+          size_t found;
+          while ((found = index.scanNextBatch(&rids[0], rids.size())) > 0)
+            entries += found;
+          index.endScan();
+        }
+        m.finish(entries);
+      }
+    }
+
+    if (selected("top_n_desc"))
+    {
+      RecordId rids[100];
+      Measurement m("top_n_desc", "100", &bufMgr, poolSize);
+      long entries = 0;
+      for (int n = 0; n < numScans; n++)
+      {
+        const int high = random() % numRecords;
+        try
+        {
+          index.startScan(NULL, GTE, &high, LTE, SCAN_DESCENDING);
+        }
+        catch (NoSuchKeyFoundException e)
+        {
+          continue;
+        }
+        entries += index.scanNextBatch(rids, 100);
+        index.endScan();
+      }
+      m.finish(entries);
+    }
+  }
+  removeFile(indexName);
+}
+
+/**
+ * Full range scans of an integer index built by inserts in random order, whose leaves lie in the order
+ * they were split off, then the rebuild by defragment() and the same scans over leaves in key order.
+ */
+void defragmentBenchmarks()
+{
+  if (!selected("defrag"))
+    return;
+  createRelation(RANDOM);
+  std::string indexName;
+  {
+    BufMgr bufMgr(poolSize);
+    BTreeIndex index(relationName, indexName, &bufMgr, offsetof(tuple, i), INTEGER, false);
+    std::vector<RecordId> rids(4096);
+    const int low = 0, high = numRecords;
+    for (int pass = 0; pass < 2; pass++)
+    {
+      if (pass == 1)
+      {
+        Measurement m("defrag_rebuild", "", &bufMgr, poolSize);
+        index.defragment();
+        m.finish(numRecords);
+      }
+      Measurement m("defrag_scan", pass == 0 ? "inserted" : "defragmented", &bufMgr, poolSize);
+      long entries = 0;
+      for (int n = 0; n < numScans / 10 + 1; n++)
+      {
+        index.startScan(&low, GTE, &high, LT);
+        size_t found;
+        while ((found = index.scanNextBatch(&rids[0], rids.size())) > 0)
+          entries += found;
+        index.endScan();
+      }
+      m.finish(entries);
+    }
+  }
+  removeFile(indexName);
+}
+
+/**
+ * Range scans of 1% of the keys that read the d attribute of every match, from the record and from
+ * the leaves of a covering index.
+ */
+void coveringBenchmarks()
+{
+  if (!selected("covering_scan"))
+    return;
+  createRelation(RANDOM);
+  std::string indexName, coveringName;
+  {
+    BufMgr bufMgr(poolSize);
+    PageFile relation = PageFile::open(relationName);
+    BTreeIndex index(relationName, indexName, &bufMgr, offsetof(tuple, i), INTEGER);
+    std::vector<IncludedAttr> included(1);
+    included[0].offset = offsetof(tuple, d);
+    included[0].length = sizeof(double);
+    BTreeIndex covering(relationName, coveringName, &bufMgr, offsetof(tuple, i), INTEGER, included);
+
+    const int width = std::max(1, numRecords / 100);
+    std::vector<RecordId> rids(4096);
+    std::vector<double> values(rids.size());
+    const char *params[] = {"fetch", "payload"};
+    for (int p = 0; p < 2; p++)
+    {
+      srandom(seed);
+      Measurement m("covering_scan", params[p], &bufMgr, poolSize);
+      long entries = 0;
+      double sum = 0;
+      for (int n = 0; n < numScans; n++)
+      {
+        const int low = random() % (numRecords - width + 1);
+        const int high = low + width;
+        IndexCursor cursor;
+        BTreeIndex &scanned = p == 0 ? index : covering;
+        try
+        {
+          scanned.startScan(cursor, &low, GTE, &high, LT);
+        }
+        catch (NoSuchKeyFoundException e)
+        {
+          continue;
+        }
+        size_t found;
+        while ((found = scanned.scanNextBatch(cursor, &rids[0], rids.size(), p == 0 ? NULL : (char *)&values[0])) > 0)
+        {
+          for (size_t k = 0; k < found; k++)
+          {
+            if (p == 1)
+            {
+              sum += values[k];
+              continue;
+            }
+            Page *page;
+            bufMgr.readPage(&relation, rids[k].page_number, page);
+            sum += reinterpret_cast<const RECORD *>(page->getRecordView(rids[k]).data)->d;
+            bufMgr.unPinPage(&relation, rids[k].page_number, false);
+          }
+          entries += found;
+        }
+        scanned.endScan(cursor);
+      }
+      m.finish(entries);
+      if (sum < 0)
+        std::cerr << "covering_scan read negative values" << std::endl;
+    }
+    bufMgr.flushFile(&relation);
+  }
+  removeFile(indexName);
+  removeFile(coveringName);
+}
+
+/**
+ * Full scans of the relation through FileScan.
+ */
+void fileScanBenchmarks()
+{
+  if (!selected("file_scan"))
+    return;
+  createRelation(FORWARD);
+  BufMgr bufMgr(poolSize);
+  Measurement m("file_scan", "", &bufMgr, poolSize);
+  long records = 0;
+  for (int n = 0; n < 3; n++)
+  {
+    FileScan scan(relationName, &bufMgr);
+    try
+    {
+      RecordId rid;
+      while (1)
+      {
+        scan.scanNext(rid);
+        records++;
+      }
+    }
+    catch (EndOfFileException e)
+    {
+    }
+  }
+  m.finish(records);
+}
+
+/**
+ * Scans of the relation with a filter keeping a tenth of the records, evaluated a record at a time by
+ * scanNext() and a page at a time by scanNextPage().
+ */
+void filterScanBenchmarks()
+{
+  if (!selected("filter_scan"))
+    return;
+  createRelation(RANDOM);
+  BufMgr bufMgr(poolSize);
+  AttrFilter<int> filter(offsetof(tuple, i), 0, GTE, numRecords / 10, LT);
+  {
+    Measurement m("filter_scan", "record", &bufMgr, poolSize);
+    long records = 0;
+    for (int n = 0; n < 3; n++)
+    {
+      FileScan scan(relationName, &bufMgr, &filter);
+      try
+      {
+        RecordId rid;
+        while (1)
+        {
+          scan.scanNext(rid);
+          records++;
+        }
+      }
+      catch (EndOfFileException e)
+      {
+      }
+    }
+    m.finish(records);
+  }
+  {
+    Measurement m("filter_scan", "page", &bufMgr, poolSize);
+    long records = 0;
+    std::vector<RecordId> rids;
+    for (int n = 0; n < 3; n++)
+    {
+      FileScan scan(relationName, &bufMgr, &filter);
+      try
+      {
+        while (1)
+        {
+          records += scan.scanNextPage(rids);
+        }
+      }
+      catch (EndOfFileException e)
+      {
+      }
+    }
+    m.finish(records);
+  }
+}
+
+/**
+ * Hit ratio of random page reads of the relation through pools of a growing fraction of its size.
+ */
+void hitRatioBenchmarks()
+{
+  if (!selected("hit_ratio"))
+    return;
+  createRelation(FORWARD);
+  PageFile file = PageFile::open(relationName);
+  std::vector<PageId> pageNos;
+  for (FileIterator iter = file.begin(); iter != file.end(); ++iter)
+    pageNos.push_back(iter.page_number());
+
+  const double fractions[] = {0.0625, 0.125, 0.25, 0.5, 1.0};
+  for (int f = 0; f < 5; f++)
+  {
+    const int pool = std::max(2, (int) (pageNos.size() * fractions[f]));
+    char param[32];
+    sprintf(param, "%g", fractions[f]);
+    BufMgr bufMgr(pool + 1);
+    srandom(seed);
+    // warm the pool up before measuring
+    const int reads = 10 * (int) pageNos.size();
+    Page *page;
+    for (int n = 0; n < reads; n++)
+    {
+      const PageId pageNo = pageNos[random() % pageNos.size()];
+      bufMgr.readPage(&file, pageNo, page);
+      bufMgr.unPinPage(&file, pageNo, false);
+    }
+    Measurement m("hit_ratio", param, &bufMgr, pool + 1);
+    for (int n = 0; n < reads; n++)
+    {
+      const PageId pageNo = pageNos[random() % pageNos.size()];
+      bufMgr.readPage(&file, pageNo, page);
+      bufMgr.unPinPage(&file, pageNo, false);
+    }
+    m.finish(reads);
+    bufMgr.flushFile(&file);
+  }
+}
+
+}
+
+int main(int argc, char **argv)
+{
+  for (int a = 1; a < argc; a++)
+  {
+    const std::string arg(argv[a]);
+    const size_t eq = arg.find('=');
+    const std::string name = arg.substr(0, eq);
+    const std::string value = eq == std::string::npos ? "" : arg.substr(eq + 1);
+    if (name == "--records")
+      numRecords = std::max(1, atoi(value.c_str()));
+    else if (name == "--pool")
+      poolSize = std::max(2, atoi(value.c_str()));
+    else if (name == "--lookups")
+      numLookups = atoi(value.c_str());
+    else if (name == "--scans")
+      numScans = atoi(value.c_str());
+    else if (name == "--seed")
+      seed = (unsigned int) strtoul(value.c_str(), NULL, 10);
+    else if (name == "--only")
+      only = value;
+    else
+    {
+      std::cerr << "usage: " << argv[0]
+                << " [--records=N] [--pool=N] [--lookups=N] [--scans=N] [--seed=N] [--only=PREFIX]" << std::endl;
+      return 2;
+    }
+  }
+
+  std::cout << "benchmark,param,records,pool,ops,seconds,ops_per_sec,hits,diskreads" << std::endl;
+  insertBenchmarks();
+  indexBenchmarks();
+  defragmentBenchmarks();
+  coveringBenchmarks();
+  fileScanBenchmarks();
+  filterScanBenchmarks();
+  hitRatioBenchmarks();
+  removeFile(relationName);
+  return numMismatches > 0 ? 1 : 0;
+}
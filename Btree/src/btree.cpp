@@ -12,381 +12,4496 @@
 #include "exceptions/end_of_file_exception.h"
 #include "exceptions/file_not_found_exception.h"
 #include "exceptions/index_scan_completed_exception.h"
+#include "exceptions/invalid_page_exception.h"
 #include "exceptions/no_such_key_found_exception.h"
+#include "exceptions/read_only_index_exception.h"
 #include "exceptions/scan_not_initialized_exception.h"
 #include "filescan.h"
 #include <utility>
 #include <vector>
 #include <climits>
-#define getint(X) *((int*)X)
+#include <algorithm>
+#if defined(__AVX2__) || defined(__SSE4_1__)
+#include <immintrin.h>
+#endif
 //#define DEBUG
 
 namespace badgerdb
 {
+
+int compositeAttrSize(const Datatype type)
+{
+    switch(type){
+    case INTEGER:
+        return sizeof(int);
+    case DOUBLE:
+        return sizeof(double);
+    default:
+        return STRINGSIZE;
+    }
+}
+
+/**
+ * Numbers are written most significant byte first. INTEGER values have their sign bit flipped, so
+ * negative values come before positive ones; negative DOUBLE values have all bits flipped, since
+ * their magnitude grows with the bits, and the others only their sign bit.
+ */
+void encodeCompositeAttr(const Datatype type, const void *value, unsigned char *out)
+{
+    std::uint64_t bits;
+    int size;
+    switch(type){
+    case INTEGER:{
+        std::uint32_t u;
+        memcpy(&u, value, sizeof(u));
+        bits = u ^ 0x80000000u;
+        size = sizeof(u);
+        break;
+    }
+    case DOUBLE:
+        memcpy(&bits, value, sizeof(bits));
+        bits = (bits >> 63) ? ~bits : bits ^ (std::uint64_t(1) << 63);
+        size = sizeof(bits);
+        break;
+    default:
+        strncpy((char*) out, (const char*) value, STRINGSIZE);
+        return;
+    }
+    for(int i = size - 1; i >= 0; i--){
+        out[i] = (unsigned char) bits;
+        bits >>= 8;
+    }
+}
+
+/**
+ * Number of keys left in the search range when the binary search in searchKeys() stops halving
+ * and counts the remaining keys instead.
+ */
+static const int SEARCH_WINDOW = 16;
+
+/**
+ * Count the keys of a search window that come before the searched position, one at a time.
+ */
+template <bool UPPER, class T>
+struct WindowCount{
+	static inline int count(const T *base, const int n, const T &key)
+	{
+		int pos = 0;
+		for(int i = 0; i < n; i++){
+			pos += UPPER ? (base[i] <= key) : (base[i] < key);
+		}
+		return pos;
+	}
+};
+
+/**
+ * INTEGER keys are counted with a vectorized compare when the target supports AVX2 or SSE4.1;
+ * the choice is made at compile time.
+ */
+template <bool UPPER>
+struct WindowCount<UPPER, int>{
+	static inline int count(const int *base, const int n, const int &key)
+	{
+		int pos = 0, i = 0;
+#if defined(__AVX2__)
+		const __m256i needle = _mm256_set1_epi32(key);
+		for(; i + 8 <= n; i += 8){
+			const __m256i block = _mm256_loadu_si256((const __m256i*)(base + i));
+			const __m256i cmp = UPPER ? _mm256_cmpgt_epi32(block, needle) : _mm256_cmpgt_epi32(needle, block);
+			const int bits = __builtin_popcount(_mm256_movemask_ps(_mm256_castsi256_ps(cmp)));
+			pos += UPPER ? 8 - bits : bits;
+		}
+#elif defined(__SSE4_1__)
+		const __m128i needle = _mm_set1_epi32(key);
+		for(; i + 4 <= n; i += 4){
+			const __m128i block = _mm_loadu_si128((const __m128i*)(base + i));
+			const __m128i cmp = UPPER ? _mm_cmpgt_epi32(block, needle) : _mm_cmpgt_epi32(needle, block);
+			const int bits = __builtin_popcount(_mm_movemask_ps(_mm_castsi128_ps(cmp)));
+			pos += UPPER ? 4 - bits : bits;
+		}
+#endif
+		for(; i < n; i++){
+			pos += UPPER ? (base[i] <= key) : (base[i] < key);
+		}
+		return pos;
+	}
+};
+
+/**
+ * Find a position in the sorted keys of a node.
+ *
+ * The range is halved with a branchless binary search until at most SEARCH_WINDOW keys are left,
+ * which are then counted by WindowCount.
+ *
+ * @param keys    Sorted keys of the node
+ * @param count   Number of keys in use
+ * @param key     Key to search for
+ * @tparam UPPER  If true return the first position whose key is greater than key (upper bound),
+ *                otherwise the first position whose key is not less than key (lower bound)
+ * @return Position in [0, count]
+ */
+template <bool UPPER, class T>
+static inline int searchKeys(const T *keys, const int count, const T &key)
+{
+    const T *base = keys;
+    int n = count;
+    while(n > SEARCH_WINDOW){
+        const int half = n / 2;
+        base = (UPPER ? base[half] <= key : base[half] < key) ? base + half : base;
+        n -= half;
+    }
+    return (int)(base - keys) + WindowCount<UPPER, T>::count(base, n, key);
+}
+
+/**
+ * Position of the first key greater than key, which is also the child to descend into in a non-leaf node.
+ */
+template <class T>
+static inline int upperBound(const T *keys, const int count, const T &key)
+{
+    return searchKeys<true>(keys, count, key);
+}
+
+/**
+ * Position of the first key not less than key.
+ */
+template <class T>
+static inline int lowerBound(const T *keys, const int count, const T &key)
+{
+    return searchKeys<false>(keys, count, key);
+}
+
+/**
+ * A distinct key of a leaf holding postings and the end of its run of entries: the entries of
+ * group j are those from the end of group j - 1 up to, not including, end.
+ */
+template <class T>
+struct PostingGroup{
+	T key;
+	int end;
+};
+
+/**
+ * Sorted keys packed frame of reference: the first key as a base and the width of the deltas, then
+ * the difference of every key from the base in that many bits, back to back in 32 bit words. Only
+ * INTEGER keys are packed; for the other types bytes() never fits a leaf.
+ */
+template <class T>
+struct PackedKeys{
+	static int bytes(const T &first, const T &last, const int count) { return INT_MAX; }
+
+	static T key(const char *area, const int i) { return KeyTraits<T>::lowest(); }
+
+	template <bool UPPER>
+	static int search(const char *area, const int count, const T &key) { return 0; }
+
+	static void pack(char *area, const T *keys, const int count) {}
+
+	static void unpack(const char *area, const int count, T *keys) {}
+};
+
+template <>
+struct PackedKeys<int>{
+	static const int HEADER_SIZE = 2 * sizeof(int);
+
+	/**
+	 * Widest delta, which keeps every delta a non-negative int.
+	 */
+	static const int MAX_BITS = 31;
+
+	/**
+	 * Bytes taken by count sorted keys from first to last, INT_MAX if they are too far apart.
+	 */
+	static int bytes(const int first, const int last, const int count)
+	{
+		const int bits = width(first, last);
+		if(bits > MAX_BITS){
+			return INT_MAX;
+		}
+		return HEADER_SIZE + (int)(((std::int64_t) count * bits + 31) / 32) * (int)sizeof(std::uint32_t);
+	}
+
+	/**
+	 * Key i. Safe on an area read while a writer changes it as long as i is below the number of
+	 * keys the area has room for.
+	 */
+	static int key(const char *area, const int i)
+	{
+		int base, bits;
+		header(area, base, bits);
+		return (int)((std::uint32_t) base + delta(area + HEADER_SIZE, i, bits));
+	}
+
+	/**
+	 * Position of the first of count keys greater than key if UPPER, otherwise of the first one not
+	 * less than key. The deltas are compared rather than the keys: a binary search over them narrows
+	 * the range to SEARCH_WINDOW keys, which are unpacked and counted by WindowCount.
+	 */
+	template <bool UPPER>
+	static int search(const char *area, const int count, const int &key)
+	{
+		int base, bits;
+		header(area, base, bits);
+		const std::int64_t target = (std::int64_t) key - base;
+		if(target < 0){
+			return 0;
+		}
+		if(target > mask(bits)){
+			return count;
+		}
+		const char *words = area + HEADER_SIZE;
+		const int needle = (int) target;
+		int lo = 0;
+		int n = count;
+		while(n > SEARCH_WINDOW){
+			const int half = n / 2;
+			const int d = (int) delta(words, lo + half, bits);
+			lo = (UPPER ? d <= needle : d < needle) ? lo + half : lo;
+			n -= half;
+		}
+		int window[SEARCH_WINDOW];
+		for(int i = 0; i < n; i++){
+			window[i] = (int) delta(words, lo + i, bits);
+		}
+		return lo + WindowCount<UPPER, int>::count(window, n, needle);
+	}
+
+	/**
+	 * Pack count sorted keys, at least one, into area, which must have bytes() of room.
+	 */
+	static void pack(char *area, const int *keys, const int count)
+	{
+		const int base = keys[0];
+		const int bits = width(keys[0], keys[count - 1]);
+		memcpy(area, &base, sizeof(int));
+		memcpy(area + sizeof(int), &bits, sizeof(int));
+		char *words = area + HEADER_SIZE;
+		std::uint64_t pending = 0;
+		int filled = 0;
+		for(int i = 0; i < count; i++){
+			pending |= (std::uint64_t)((std::uint32_t) keys[i] - (std::uint32_t) base) << filled;
+			filled += bits;
+			if(filled >= 32){
+				const std::uint32_t word = (std::uint32_t) pending;
+				memcpy(words, &word, sizeof(word));
+				words += sizeof(word);
+				pending >>= 32;
+				filled -= 32;
+			}
+		}
+		if(filled > 0){
+			const std::uint32_t word = (std::uint32_t) pending;
+			memcpy(words, &word, sizeof(word));
+		}
+	}
+
+	static void unpack(const char *area, const int count, int *keys)
+	{
+		int base, bits;
+		header(area, base, bits);
+		for(int i = 0; i < count; i++){
+			keys[i] = (int)((std::uint32_t) base + delta(area + HEADER_SIZE, i, bits));
+		}
+	}
+
+private:
+	/**
+	 * Bits needed for the deltas of keys from first to last.
+	 */
+	static int width(const int first, const int last)
+	{
+		const std::uint32_t range = (std::uint32_t) last - (std::uint32_t) first;
+		return range == 0 ? 0 : 32 - __builtin_clz(range);
+	}
+
+	static std::uint32_t mask(const int bits)
+	{
+		return (std::uint32_t)((std::uint64_t(1) << bits) - 1);
+	}
+
+	/**
+	 * Read the base and the width of the deltas, cut to MAX_BITS for an area read while it changes.
+	 */
+	static void header(const char *area, int &base, int &bits)
+	{
+		memcpy(&base, area, sizeof(int));
+		memcpy(&bits, area + sizeof(int), sizeof(int));
+		bits = std::max(0, std::min(bits, (int) MAX_BITS));
+	}
+
+	/**
+	 * Delta i, read with one unaligned load of the eight bytes holding it.
+	 */
+	static std::uint32_t delta(const char *words, const int i, const int bits)
+	{
+		const std::uint64_t bit = (std::uint64_t) i * bits;
+		std::uint64_t pair;
+		memcpy(&pair, words + bit / 32 * sizeof(std::uint32_t), sizeof(pair));
+		return (std::uint32_t)(pair >> (bit % 32)) & mask(bits);
+	}
+};
+
+/**
+ * Number of the total entries of a split leaf that stay in the left one: half of them, or
+ * APPEND_SPLIT_FILL of them if the split was caused by an entry appended to the rightmost leaf.
+ */
+static inline int splitPoint(const int total, const bool append)
+{
+    return append ? std::max(1, std::min(total - 1, (int)(total * APPEND_SPLIT_FILL))) : total / 2;
+}
+
+/**
+ * Operations on the leaf pages of an index with keys of type T.
+ *
+ * The B+Tree algorithms only touch the entries of a node through LeafFormat and NonLeafFormat, so
+ * the layout of a node can depend on the key type. INTEGER and DOUBLE leaves keep plain key arrays
+ * until their keys repeat: a leaf is rewritten into postings, with each distinct key stored once
+ * followed by the end of its run and the record ids packed to six bytes, whenever that takes less
+ * room than the arrays. INTEGER leaves whose entries outgrow the arrays may instead keep their
+ * keys packed as deltas from the first one in just the bits the widest delta needs, ahead of the
+ * same packed record ids, which holds far more dense keys than either. The leaves of a covering
+ * index always hold postings, with the payload of every entry packed after its record id. Entries
+ * keep their positions in every layout, so the callers do not see the difference. STRING nodes are prefix compressed and have their own
+ * specializations below.
+ */
+template <class T>
+struct LeafFormat{
+	typedef PostingGroup<T> Group;
+
+	static const int DATA_SIZE = leafDataSize<T>();
+	static const int PACKED_RID_SIZE = sizeof(PageId) + sizeof(SlotId);
+
+	/**
+	 * Most entries a leaf can hold, all with the same key and without payload.
+	 */
+	static const int MAX_ENTRIES = (DATA_SIZE - (int)sizeof(Group)) / PACKED_RID_SIZE;
+
+	/**
+	 * numGroups of a leaf holding packed keys.
+	 */
+	static const int PACKED = -1;
+
+	/**
+	 * Initialize an empty leaf without siblings, whose fences are the least and greatest key.
+	 *
+	 * @param payloadLen  Bytes of payload stored with each entry, 0 unless the index is covering
+	 */
+	static void init(LeafNode<T> *node, const int payloadLen)
+	{
+		node->numKeys = 0;
+		node->numGroups = 0;
+		node->payloadLen = payloadLen;
+		node->lowFence = KeyTraits<T>::lowest();
+		node->highFence = KeyTraits<T>::highest();
+		node->rightSibPageNo = Page::INVALID_NUMBER;
+		node->leftSibPageNo = Page::INVALID_NUMBER;
+	}
+
+	/**
+	 * Number of entries. Also safe on a node read while a writer changes it.
+	 */
+	static int count(const LeafNode<T> *node)
+	{
+		return std::min(node->numKeys, plain(node) ? leafArraySize<T>() : MAX_ENTRIES);
+	}
+
+	static T key(const LeafNode<T> *node, const int i)
+	{
+		if(packed(node)){
+			return PackedKeys<T>::key(areaOf(node), std::max(0, std::min(i, MAX_ENTRIES - 1)));
+		}
+		const int groups = groupCount(node);
+		if(groups == 0){
+			return node->keyArray[std::min(i, leafArraySize<T>() - 1)];
+		}
+		return groupsOf(node)[groupOf(groupsOf(node), groups, i)].key;
+	}
+
+	static RecordId rid(const LeafNode<T> *node, const int i)
+	{
+		if(plain(node)){
+			return node->ridArray[std::min(i, leafArraySize<T>() - 1)];
+		}
+		return loadRid(packedEntry(node, i));
+	}
+
+	/**
+	 * Copy the record ids of count entries starting at entry first.
+	 */
+	static void copyRids(const LeafNode<T> *node, const int first, const int count, RecordId *out)
+	{
+		if(plain(node)){
+			memcpy(out, &node->ridArray[first], std::max(0, std::min(count, leafArraySize<T>() - first)) * sizeof(RecordId));
+			return;
+		}
+		for(int i = 0; i < count; i++){
+			out[i] = loadRid(packedEntry(node, first + i));
+		}
+	}
+
+	/**
+	 * Copy the payloads of count entries starting at entry first, each payloadLen bytes, to out.
+	 * Nothing is copied from a leaf without payloads.
+	 */
+	static void copyPayloads(const LeafNode<T> *node, const int first, const int count, char *out)
+	{
+		const int payloadLen = payloadOf(node);
+		for(int i = 0; i < count && payloadLen > 0; i++){
+			memcpy(out + i * payloadLen, packedEntry(node, first + i) + PACKED_RID_SIZE, payloadLen);
+		}
+	}
+
+	/**
+	 * Ask the CPU to load the cache lines of entry pos, which a scan is about to read. Never faults,
+	 * so pos may come from a node read while a writer changes it.
+	 */
+	static void prefetch(const LeafNode<T> *node, const int pos)
+	{
+		if(plain(node)){
+			__builtin_prefetch(&node->keyArray[pos]);
+			__builtin_prefetch(&node->ridArray[pos]);
+		}else{
+			__builtin_prefetch(packedEntry(node, pos));
+		}
+	}
+
+	static int lowerBound(const LeafNode<T> *node, const T &key)
+	{
+		if(packed(node)){
+			return PackedKeys<T>::template search<false>(areaOf(node), count(node), key);
+		}
+		const int groups = groupCount(node);
+		if(groups == 0){
+			return badgerdb::lowerBound(node->keyArray, count(node), key);
+		}
+		return runStart(groupsOf(node), searchGroups<false>(groupsOf(node), groups, key));
+	}
+
+	static int upperBound(const LeafNode<T> *node, const T &key)
+	{
+		if(packed(node)){
+			return PackedKeys<T>::template search<true>(areaOf(node), count(node), key);
+		}
+		const int groups = groupCount(node);
+		if(groups == 0){
+			return badgerdb::upperBound(node->keyArray, count(node), key);
+		}
+		return runStart(groupsOf(node), searchGroups<true>(groupsOf(node), groups, key));
+	}
+
+	/**
+	 * Whether key can be inserted without splitting the leaf, possibly after rewriting a full leaf
+	 * with plain arrays into postings or packed keys.
+	 */
+	static bool hasRoom(const LeafNode<T> *node, const T &key)
+	{
+		if(plain(node) && node->numKeys < leafArraySize<T>()){
+			return true;
+		}
+		const int pos = lowerBound(node, key);
+		const bool newKey = pos == node->numKeys || LeafFormat<T>::key(node, pos) != key;
+		if(postingBytes(distinctKeys(node) + newKey, node->numKeys + 1, node->payloadLen) <= DATA_SIZE){
+			return true;
+		}
+		const T first = std::min(key, LeafFormat<T>::key(node, 0));
+		const T last = std::max(key, LeafFormat<T>::key(node, node->numKeys - 1));
+		return node->payloadLen == 0 && packedBytes(first, last, node->numKeys + 1) <= DATA_SIZE;
+	}
+
+	/**
+	 * Insert an entry into a leaf that has room for it, shifting the entries after pos to the right.
+	 *
+	 * @param node     Pinned leaf node
+	 * @param pos      Position of the new entry
+	 * @param key      Key of the new entry
+	 * @param rid      Record id of the new entry
+	 * @param payload  The payloadLen bytes of payload of the new entry, unused if the leaf has none
+	 */
+	static void insert(LeafNode<T> *node, const int pos, const T &key, const RecordId rid, const char *payload)
+	{
+		if(postings(node) && postingFits(node, key)){
+			insertPosting(node, pos, key, rid, payload);
+		}else if(plain(node) && node->numKeys < leafArraySize<T>()){
+			const int tail = node->numKeys - pos;
+			memmove(&node->keyArray[pos + 1], &node->keyArray[pos], tail * sizeof(T));
+			memmove(&node->ridArray[pos + 1], &node->ridArray[pos], tail * sizeof(RecordId));
+			node->keyArray[pos] = key;
+			node->ridArray[pos] = rid;
+			node->numKeys++;
+		}else{
+			// the arrays are full, the keys packed or the postings out of room, but the entries fit as
+			// postings or packed keys
+			T keys[MAX_ENTRIES + 1];
+			RecordId rids[MAX_ENTRIES + 1];
+			const int total = decodeWith(node, pos, key, rid, payload, keys, rids, NULL);
+			encode(node, keys, rids, NULL, total);
+		}
+	}
+
+	/**
+	 * Split a full leaf: the upper part of its entries and the new entry, if it belongs there, go to
+	 * newNode, and each part is written in whichever layout is smaller. Sibling pointers are left to
+	 * the caller.
+	 *
+	 * @param node     Pinned full leaf node
+	 * @param newNode  Newly allocated right sibling
+	 * @param pos      Position of the new entry in node
+	 * @param append   Whether the new entry goes after all entries of the rightmost leaf, see splitPoint()
+	 */
+	static void split(LeafNode<T> *node, LeafNode<T> *newNode, const int pos, const T &key, const RecordId rid,
+	                  const char *payload, const bool append)
+	{
+		T keys[MAX_ENTRIES + 1];
+		RecordId rids[MAX_ENTRIES + 1];
+		char payloads[DATA_SIZE + MAX_PAYLOAD_SIZE];
+		const int total = decodeWith(node, pos, key, rid, payload, keys, rids, payloads);
+		const int half = splitPoint(total, append);
+		newNode->payloadLen = node->payloadLen;
+		encode(node, keys, rids, payloads, half);
+		encode(newNode, keys + half, rids + half, payloads + half * node->payloadLen, total - half);
+	}
+
+	/**
+	 * Remove entry pos, shifting the entries after it to the left.
+	 */
+	static void remove(LeafNode<T> *node, const int pos)
+	{
+		if(postings(node)){
+			removePosting(node, pos);
+			return;
+		}
+		if(packed(node)){
+			T keys[MAX_ENTRIES];
+			RecordId rids[MAX_ENTRIES];
+			decode(node, keys, rids, NULL);
+			memmove(&keys[pos], &keys[pos + 1], (node->numKeys - pos - 1) * sizeof(T));
+			memmove(&rids[pos], &rids[pos + 1], (node->numKeys - pos - 1) * sizeof(RecordId));
+			encode(node, keys, rids, NULL, node->numKeys - 1);
+			return;
+		}
+		const int tail = node->numKeys - pos - 1;
+		memmove(&node->keyArray[pos], &node->keyArray[pos + 1], tail * sizeof(T));
+		memmove(&node->ridArray[pos], &node->ridArray[pos + 1], tail * sizeof(RecordId));
+		node->numKeys--;
+	}
+
+	/**
+	 * Append the entries of right, the leaf following node, to node if they fit.
+	 *
+	 * @return True if the entries were moved
+	 */
+	static bool merge(LeafNode<T> *node, const LeafNode<T> *right)
+	{
+		if(plain(node) && plain(right) && node->numKeys + right->numKeys <= leafArraySize<T>()){
+			memcpy(&node->keyArray[node->numKeys], right->keyArray, right->numKeys * sizeof(T));
+			memcpy(&node->ridArray[node->numKeys], right->ridArray, right->numKeys * sizeof(RecordId));
+			node->numKeys += right->numKeys;
+			return true;
+		}
+		T keys[2 * MAX_ENTRIES];
+		RecordId rids[2 * MAX_ENTRIES];
+		char payloads[2 * DATA_SIZE];
+		const int total = node->numKeys + right->numKeys;
+		decode(node, keys, rids, payloads);
+		decode(right, keys + node->numKeys, rids + node->numKeys, payloads + node->numKeys * node->payloadLen);
+		if((total > leafArraySize<T>() || node->payloadLen > 0)
+		&& postingBytes(distinctKeys(keys, total), total, node->payloadLen) > DATA_SIZE
+		&& (node->payloadLen > 0 || packedBytes(keys[0], keys[total - 1], total) > DATA_SIZE)){
+			return false;
+		}
+		encode(node, keys, rids, payloads, total);
+		return true;
+	}
+
+	/**
+	 * Number of the leading entries, at most count, that a leaf filled to fill of its capacity holds.
+	 * Bulk loaded leaves carry no payload.
+	 */
+	static int fit(const RIDKeyPair<T> *entries, const int count, const double fill)
+	{
+		const int plain = std::min(count, std::max(1, (int)(leafArraySize<T>() * fill)));
+		// as postings, repeated keys take only the room of their record ids
+		const int budget = (int)(DATA_SIZE * fill);
+		int bytes = 0;
+		int n = 0;
+		while(n < count){
+			bytes += PACKED_RID_SIZE + (n == 0 || entries[n].key != entries[n - 1].key ? (int)sizeof(Group) : 0);
+			if(bytes > budget){
+				break;
+			}
+			n++;
+		}
+		// as packed keys, dense keys take a few bits each besides their record ids
+		int m = 0;
+		while(m < std::min(count, (int) MAX_ENTRIES) && packedBytes(entries[0].key, entries[m].key, m + 1) <= budget){
+			m++;
+		}
+		return std::max(plain, std::max(n, m));
+	}
+
+	/**
+	 * Fill an initialized leaf without payloads with count sorted entries.
+	 */
+	static void assign(LeafNode<T> *node, const RIDKeyPair<T> *entries, const int count)
+	{
+		T keys[MAX_ENTRIES];
+		RecordId rids[MAX_ENTRIES];
+		for(int j = 0; j < count; j++){
+			keys[j] = entries[j].key;
+			rids[j] = entries[j].rid;
+		}
+		encode(node, keys, rids, NULL, count);
+	}
+
+private:
+	/**
+	 * Whether the leaf holds postings rather than plain arrays. Leaves with payloads always do,
+	 * even while they are empty.
+	 */
+	static bool postings(const LeafNode<T> *node) { return node->numGroups > 0 || node->payloadLen > 0; }
+
+	static bool packed(const LeafNode<T> *node) { return node->numGroups == PACKED && node->payloadLen == 0; }
+
+	/**
+	 * Whether the leaf holds plain key and rid arrays.
+	 */
+	static bool plain(const LeafNode<T> *node) { return node->numGroups == 0 && node->payloadLen == 0; }
+
+	static const char *areaOf(const LeafNode<T> *node) { return reinterpret_cast<const char*>(node->keyArray); }
+
+	static const Group *groupsOf(const LeafNode<T> *node) { return reinterpret_cast<const Group*>(node->keyArray); }
+
+	static Group *groupsOf(LeafNode<T> *node) { return reinterpret_cast<Group*>(node->keyArray); }
+
+	/**
+	 * Number of distinct keys of a leaf holding postings, 0 for plain arrays. Also safe on a node
+	 * read while a writer changes it.
+	 */
+	static int groupCount(const LeafNode<T> *node)
+	{
+		return std::min(node->numGroups, DATA_SIZE / (int)sizeof(Group));
+	}
+
+	/**
+	 * Bytes of payload of each entry, cut to MAX_PAYLOAD_SIZE for a node read while it is reused.
+	 */
+	static int payloadOf(const LeafNode<T> *node)
+	{
+		return std::min(node->payloadLen, MAX_PAYLOAD_SIZE);
+	}
+
+	/**
+	 * Packed record id and payload of entry i. The entries fill the end of the area, so entry i
+	 * sits numKeys - i places from it.
+	 */
+	static const char *packedEntry(const LeafNode<T> *node, const int i)
+	{
+		const int size = PACKED_RID_SIZE + payloadOf(node);
+		const int offset = DATA_SIZE - (node->numKeys - i) * size;
+		return reinterpret_cast<const char*>(node->keyArray) + std::max(0, std::min(offset, DATA_SIZE - size));
+	}
+
+	/**
+	 * First byte of the packed entries of a leaf being changed, which has numKeys of them.
+	 */
+	static char *packedEntries(LeafNode<T> *node)
+	{
+		return reinterpret_cast<char*>(node->keyArray) + DATA_SIZE - node->numKeys * (PACKED_RID_SIZE + node->payloadLen);
+	}
+
+	static RecordId loadRid(const char *packed)
+	{
+		RecordId rid;
+		memcpy(&rid.page_number, packed, sizeof(PageId));
+		memcpy(&rid.slot_number, packed + sizeof(PageId), sizeof(SlotId));
+		return rid;
+	}
+
+	static void storeEntry(char *packed, const RecordId rid, const char *payload, const int payloadLen)
+	{
+		memcpy(packed, &rid.page_number, sizeof(PageId));
+		memcpy(packed + sizeof(PageId), &rid.slot_number, sizeof(SlotId));
+		if(payloadLen > 0){
+			memcpy(packed + PACKED_RID_SIZE, payload, payloadLen);
+		}
+	}
+
+	/**
+	 * Bytes taken by count entries with groups distinct keys held as postings.
+	 */
+	static int postingBytes(const int groups, const int count, const int payloadLen)
+	{
+		return groups * (int)sizeof(Group) + count * (PACKED_RID_SIZE + payloadLen);
+	}
+
+	/**
+	 * Bytes taken by count sorted entries from first to last without payload held as packed keys.
+	 */
+	static int packedBytes(const T &first, const T &last, const int count)
+	{
+		const int keyBytes = PackedKeys<T>::bytes(first, last, count);
+		return keyBytes == INT_MAX ? INT_MAX : keyBytes + count * PACKED_RID_SIZE;
+	}
+
+	static int distinctKeys(const T *keys, const int count)
+	{
+		int groups = 0;
+		for(int i = 0; i < count; i++){
+			groups += i == 0 || keys[i] != keys[i - 1];
+		}
+		return groups;
+	}
+
+	static int distinctKeys(const LeafNode<T> *node)
+	{
+		if(node->numGroups > 0){
+			return node->numGroups;
+		}
+		if(plain(node)){
+			return distinctKeys(node->keyArray, node->numKeys);
+		}
+		int groups = 0;
+		T prev = T();
+		for(int i = 0; i < node->numKeys; i++){
+			const T k = key(node, i);
+			groups += i == 0 || k != prev;
+			prev = k;
+		}
+		return groups;
+	}
+
+	/**
+	 * Position of the first entry of group j, which is also the number of entries before it.
+	 */
+	static int runStart(const Group *groups, const int j)
+	{
+		return j > 0 ? groups[j - 1].end : 0;
+	}
+
+	/**
+	 * Group holding entry i: the first one whose run ends after i.
+	 */
+	static int groupOf(const Group *groups, const int count, const int i)
+	{
+		int lo = 0;
+		int n = count;
+		while(n > 0){
+			const int half = n / 2;
+			if(groups[lo + half].end <= i){
+				lo += half + 1;
+				n -= half + 1;
+			}else{
+				n = half;
+			}
+		}
+		return std::min(lo, count - 1);
+	}
+
+	/**
+	 * Position of the first group whose key is greater than key if UPPER, otherwise of the first
+	 * group whose key is not less than key.
+	 */
+	template <bool UPPER>
+	static int searchGroups(const Group *groups, const int count, const T &key)
+	{
+		int lo = 0;
+		int n = count;
+		while(n > 0){
+			const int half = n / 2;
+			if(UPPER ? groups[lo + half].key <= key : groups[lo + half].key < key){
+				lo += half + 1;
+				n -= half + 1;
+			}else{
+				n = half;
+			}
+		}
+		return lo;
+	}
+
+	/**
+	 * Copy the entries of a leaf in either layout to keys and rids, and their payloads to payloads
+	 * unless it is NULL.
+	 */
+	static void decode(const LeafNode<T> *node, T *keys, RecordId *rids, char *payloads)
+	{
+		if(plain(node)){
+			memcpy(keys, node->keyArray, node->numKeys * sizeof(T));
+			memcpy(rids, node->ridArray, node->numKeys * sizeof(RecordId));
+			return;
+		}
+		if(packed(node)){
+			PackedKeys<T>::unpack(areaOf(node), node->numKeys, keys);
+			copyRids(node, 0, node->numKeys, rids);
+			return;
+		}
+		const Group *groups = groupsOf(node);
+		for(int j = 0, i = 0; j < node->numGroups; j++){
+			for(; i < groups[j].end; i++){
+				keys[i] = groups[j].key;
+			}
+		}
+		copyRids(node, 0, node->numKeys, rids);
+		if(payloads != NULL){
+			copyPayloads(node, 0, node->numKeys, payloads);
+		}
+	}
+
+	/**
+	 * Copy the entries of a leaf to keys, rids and payloads with a new entry inserted at pos.
+	 *
+	 * @return Number of entries copied
+	 */
+	static int decodeWith(const LeafNode<T> *node, const int pos, const T &key, const RecordId rid, const char *payload,
+	                      T *keys, RecordId *rids, char *payloads)
+	{
+		const int total = node->numKeys + 1;
+		decode(node, keys, rids, payloads);
+		memmove(&keys[pos + 1], &keys[pos], (total - 1 - pos) * sizeof(T));
+		memmove(&rids[pos + 1], &rids[pos], (total - 1 - pos) * sizeof(RecordId));
+		keys[pos] = key;
+		rids[pos] = rid;
+		if(payloads != NULL && node->payloadLen > 0){
+			const int payloadLen = node->payloadLen;
+			memmove(payloads + (pos + 1) * payloadLen, payloads + pos * payloadLen, (total - 1 - pos) * payloadLen);
+			memcpy(payloads + pos * payloadLen, payload, payloadLen);
+		}
+		return total;
+	}
+
+	/**
+	 * Write count sorted entries to a leaf in whichever layout is smaller, plain arrays on a tie,
+	 * or to postings if the leaf has payloads. Keys are only packed once they outgrow the arrays,
+	 * since packed leaves are rewritten whole on every change. The entries must fit.
+	 */
+	static void encode(LeafNode<T> *node, const T *keys, const RecordId *rids, const char *payloads, const int count)
+	{
+		const int payloadLen = node->payloadLen;
+		const int groups = distinctKeys(keys, count);
+		if(payloadLen == 0 && count <= leafArraySize<T>()
+		&& count * (int)(sizeof(T) + sizeof(RecordId)) <= postingBytes(groups, count, 0)){
+			memcpy(node->keyArray, keys, count * sizeof(T));
+			memcpy(node->ridArray, rids, count * sizeof(RecordId));
+			node->numGroups = 0;
+			node->numKeys = count;
+			return;
+		}
+		if(payloadLen == 0 && count > leafArraySize<T>()
+		&& packedBytes(keys[0], keys[count - 1], count) < postingBytes(groups, count, 0)){
+			PackedKeys<T>::pack(reinterpret_cast<char*>(node->keyArray), keys, count);
+			node->numGroups = PACKED;
+			node->numKeys = count;
+			storeEntries(node, rids, NULL, count);
+			return;
+		}
+		Group *out = groupsOf(node);
+		for(int i = 0, j = -1; i < count; i++){
+			if(i == 0 || keys[i] != keys[i - 1]){
+				out[++j].key = keys[i];
+			}
+			out[j].end = i + 1;
+		}
+		node->numGroups = groups;
+		node->numKeys = count;
+		storeEntries(node, rids, payloads, count);
+	}
+
+	/**
+	 * Pack the record ids and payloads of all count entries of a leaf at the end of its area.
+	 */
+	static void storeEntries(LeafNode<T> *node, const RecordId *rids, const char *payloads, const int count)
+	{
+		const int payloadLen = node->payloadLen;
+		char *packed = packedEntries(node);
+		for(int i = 0; i < count; i++){
+			storeEntry(packed + i * (PACKED_RID_SIZE + payloadLen), rids[i], payloads + i * payloadLen, payloadLen);
+		}
+	}
+
+	/**
+	 * Whether a leaf held as postings still fits in them with an entry for key added.
+	 */
+	static bool postingFits(const LeafNode<T> *node, const T &key)
+	{
+		const Group *groups = groupsOf(node);
+		const int j = searchGroups<false>(groups, node->numGroups, key);
+		const bool newKey = j == node->numGroups || groups[j].key != key;
+		return postingBytes(node->numGroups + newKey, node->numKeys + 1, node->payloadLen) <= DATA_SIZE;
+	}
+
+	static void insertPosting(LeafNode<T> *node, const int pos, const T &key, const RecordId rid, const char *payload)
+	{
+		Group *groups = groupsOf(node);
+		const int j = searchGroups<false>(groups, node->numGroups, key);
+		if(j == node->numGroups || groups[j].key != key){
+			memmove(&groups[j + 1], &groups[j], (node->numGroups - j) * sizeof(Group));
+			groups[j].key = key;
+			groups[j].end = runStart(groups, j);
+			node->numGroups++;
+		}
+		for(int k = j; k < node->numGroups; k++){
+			groups[k].end++;
+		}
+		// the entries before pos move one place towards the front
+		const int size = PACKED_RID_SIZE + node->payloadLen;
+		char *packed = packedEntries(node);
+		memmove(packed - size, packed, pos * size);
+		storeEntry(packed + (pos - 1) * size, rid, payload, node->payloadLen);
+		node->numKeys++;
+	}
+
+	static void removePosting(LeafNode<T> *node, const int pos)
+	{
+		Group *groups = groupsOf(node);
+		const int j = groupOf(groups, node->numGroups, pos);
+		const int size = PACKED_RID_SIZE + node->payloadLen;
+		char *packed = packedEntries(node);
+		memmove(packed + size, packed, pos * size);
+		node->numKeys--;
+		for(int k = j; k < node->numGroups; k++){
+			groups[k].end--;
+		}
+		if(groups[j].end == runStart(groups, j)){
+			// the last entry of its key is gone; an empty leaf without payloads is back to plain arrays
+			memmove(&groups[j], &groups[j + 1], (node->numGroups - j - 1) * sizeof(Group));
+			node->numGroups--;
+		}
+	}
+};
+
+/**
+ * Operations on the non-leaf pages of an index with keys of type T. Key i separates child i from
+ * child i + 1.
+ */
+template <class T>
+struct NonLeafFormat{
+	/**
+	 * Initialize a node without keys whose only child is child0.
+	 */
+	static void init(NonLeafNode<T> *node, const int level, const PageId child0)
+	{
+		std::fill(node->pageNoArray, node->pageNoArray + nonLeafArraySize<T>() + 1, (PageId)Page::INVALID_NUMBER);
+		node->level = level;
+		node->numKeys = 0;
+		node->pageNoArray[0] = child0;
+	}
+
+	static T key(const NonLeafNode<T> *node, const int i) { return node->keyArray[i]; }
+
+	static PageId child(const NonLeafNode<T> *node, const int i) { return node->pageNoArray[i]; }
+
+	/**
+	 * Child to descend into for key: the first one whose separator is greater than the key.
+	 */
+	static int upperBound(const NonLeafNode<T> *node, const T &key)
+	{
+		return badgerdb::upperBound(node->keyArray, node->numKeys, key);
+	}
+
+	/**
+	 * First child that can hold key when equal keys span several children.
+	 */
+	static int lowerBound(const NonLeafNode<T> *node, const T &key)
+	{
+		return badgerdb::lowerBound(node->keyArray, node->numKeys, key);
+	}
+
+	/**
+	 * Whether key can be inserted without splitting the node.
+	 */
+	static bool hasRoom(const NonLeafNode<T> *node, const T &key)
+	{
+		return node->numKeys < nonLeafArraySize<T>();
+	}
+
+	/**
+	 * Whether any separator can be inserted without splitting the node.
+	 */
+	static bool hasRoomForAny(const NonLeafNode<T> *node)
+	{
+		return node->numKeys < nonLeafArraySize<T>();
+	}
+
+	/**
+	 * Insert a separator key and the child to its right into a node that has room for them.
+	 *
+	 * @param node   Pinned non-leaf node
+	 * @param pos    Position of the new key; the new child goes to pos + 1
+	 * @param key    Separator key
+	 * @param child  Page number of the child holding keys >= key
+	 */
+	static void insert(NonLeafNode<T> *node, const int pos, const T &key, const PageId child)
+	{
+		const int tail = node->numKeys - pos;
+		memmove(&node->keyArray[pos + 1], &node->keyArray[pos], tail * sizeof(T));
+		memmove(&node->pageNoArray[pos + 2], &node->pageNoArray[pos + 1], tail * sizeof(PageId));
+		node->keyArray[pos] = key;
+		node->pageNoArray[pos + 1] = child;
+		node->numKeys++;
+	}
+
+	/**
+	 * Split a full node by copying the upper half of its keys and children straight into newNode.
+	 * The level of newNode is left to the caller.
+	 *
+	 * @param node     Pinned full non-leaf node
+	 * @param newNode  Newly allocated right node
+	 * @param pos      Position of the new key in node; the new child goes to pos + 1
+	 * @return The key moving up to the parent
+	 */
+	static T split(NonLeafNode<T> *node, NonLeafNode<T> *newNode, const int pos, const T &key, const PageId child)
+	{
+		// With the new key at pos and the new child at pos + 1 there are capacity + 1 keys; the left
+		// node keeps the first half - 1 keys and half children, key half - 1 moves up to the parent
+		// and the right node gets the rest.
+		const int numKeys = node->numKeys;
+		const int half = (numKeys + 2) / 2;
+		T midKey;
+		if (pos < half - 1){ // new key lands in the left node
+			midKey = node->keyArray[half - 2];
+			memcpy(newNode->keyArray, &node->keyArray[half - 1], (numKeys - half + 1) * sizeof(T));
+			memcpy(newNode->pageNoArray, &node->pageNoArray[half - 1], (numKeys - half + 2) * sizeof(PageId));
+			node->numKeys = half - 2;
+			insert(node, pos, key, child);
+		} else if (pos == half - 1){ // new key is the one moving up
+			midKey = key;
+			newNode->pageNoArray[0] = child;
+			memcpy(newNode->keyArray, &node->keyArray[half - 1], (numKeys - half + 1) * sizeof(T));
+			memcpy(&newNode->pageNoArray[1], &node->pageNoArray[half], (numKeys - half + 1) * sizeof(PageId));
+			node->numKeys = half - 1;
+		} else{ // new key lands in the right node
+			midKey = node->keyArray[half - 1];
+			const int before = pos - half;
+			const int after = numKeys - pos;
+			memcpy(newNode->keyArray, &node->keyArray[half], before * sizeof(T));
+			newNode->keyArray[before] = key;
+			memcpy(&newNode->keyArray[before + 1], &node->keyArray[pos], after * sizeof(T));
+			memcpy(newNode->pageNoArray, &node->pageNoArray[half], (before + 1) * sizeof(PageId));
+			newNode->pageNoArray[before + 1] = child;
+			memcpy(&newNode->pageNoArray[before + 2], &node->pageNoArray[pos + 1], after * sizeof(PageId));
+			node->numKeys = half - 1;
+		}
+		newNode->numKeys = numKeys - half + 1;
+		return midKey;
+	}
+
+	/**
+	 * Remove key pos and the child to its right, shifting the keys and children after them to the left.
+	 */
+	static void remove(NonLeafNode<T> *node, const int pos)
+	{
+		const int tail = node->numKeys - pos - 1;
+		memmove(&node->keyArray[pos], &node->keyArray[pos + 1], tail * sizeof(T));
+		memmove(&node->pageNoArray[pos + 1], &node->pageNoArray[pos + 2], tail * sizeof(PageId));
+		node->numKeys--;
+	}
+
+	/**
+	 * Append separator and the keys and children of right, the node following node, to node if they fit.
+	 *
+	 * @param separator  Key separating node from right in their parent
+	 * @return True if the keys were moved
+	 */
+	static bool merge(NonLeafNode<T> *node, const T &separator, const NonLeafNode<T> *right)
+	{
+		const int numKeys = node->numKeys;
+		if(numKeys + 1 + right->numKeys > nonLeafArraySize<T>()){
+			return false;
+		}
+		node->keyArray[numKeys] = separator;
+		memcpy(&node->keyArray[numKeys + 1], right->keyArray, right->numKeys * sizeof(T));
+		memcpy(&node->pageNoArray[numKeys + 1], right->pageNoArray, (right->numKeys + 1) * sizeof(PageId));
+		node->numKeys += right->numKeys + 1;
+		return true;
+	}
+
+	/**
+	 * Number of the leading children, at most count, that a node filled to fill of its capacity holds.
+	 * The key of each child but the first becomes a separator of the node.
+	 */
+	static int fit(const PageKeyPair<T> *children, const int count, const double fill)
+	{
+		return std::min(count, std::max(2, (int)((nonLeafArraySize<T>() + 1) * fill)));
+	}
+
+	/**
+	 * Fill a node with count children, separated by the keys of all children but the first.
+	 */
+	static void assign(NonLeafNode<T> *node, const int level, const PageKeyPair<T> *children, const int count)
+	{
+		init(node, level, children[0].pageNo);
+		for(int j = 1; j < count; j++){
+			node->keyArray[j - 1] = children[j].key;
+			node->pageNoArray[j] = children[j].pageNo;
+		}
+		node->numKeys = count - 1;
+	}
+};
+
+/**
+ * Number of leading bytes a and b have in common.
+ */
+static inline int commonPrefix(const StringKey &a, const StringKey &b)
+{
+	int len = 0;
+	while(len < STRINGSIZE && a.data[len] == b.data[len]){
+		len++;
+	}
+	return len;
+}
+
+/**
+ * Number of bytes of key before its '\0' padding.
+ */
+static inline int significantLength(const StringKey &key)
+{
+	int len = STRINGSIZE;
+	while(len > 0 && key.data[len - 1] == '\0'){
+		len--;
+	}
+	return len;
+}
+
+/**
+ * Prefix and suffix length of a prefix compressed STRING node.
+ */
+struct PackedLayout{
+	int prefixLen;
+	int suffixLen;
+
+	/**
+	 * Layout of count sorted keys. All of them share the prefix of the first and the last one.
+	 */
+	static PackedLayout of(const StringKey *keys, const int count)
+	{
+		PackedLayout layout = {0, 0};
+		if(count == 0){
+			return layout;
+		}
+		layout.prefixLen = commonPrefix(keys[0], keys[count - 1]);
+		int maxLen = 0;
+		for(int i = 0; i < count; i++){
+			maxLen = std::max(maxLen, significantLength(keys[i]));
+		}
+		layout.suffixLen = std::max(0, maxLen - layout.prefixLen);
+		return layout;
+	}
+
+	/**
+	 * Layout of a node with count keys after key is added, without decoding the node. The suffix may
+	 * come out longer than what PackedLayout::of() would compute, never shorter.
+	 */
+	static PackedLayout grow(const int prefixLen, const int suffixLen, const char *prefix, const int count,
+	                         const StringKey &key)
+	{
+		PackedLayout layout;
+		if(count == 0){
+			layout.prefixLen = STRINGSIZE;
+			layout.suffixLen = 0;
+			return layout;
+		}
+		int common = 0;
+		while(common < prefixLen && key.data[common] == prefix[common]){
+			common++;
+		}
+		layout.prefixLen = common;
+		layout.suffixLen = std::max(prefixLen + suffixLen, significantLength(key)) - common;
+		return layout;
+	}
+};
+
+/**
+ * Rebuild a key from the node prefix and a stored suffix.
+ */
+static inline StringKey unpackKey(const char *prefix, int prefixLen, int suffixLen, const char *suffix)
+{
+	// a node read while a writer changes its layout can pair lengths that do not fit a key
+	prefixLen = std::min(prefixLen, STRINGSIZE);
+	suffixLen = std::min(suffixLen, STRINGSIZE - prefixLen);
+	StringKey key;
+	memset(key.data, 0, STRINGSIZE);
+	memcpy(key.data, prefix, prefixLen);
+	memcpy(key.data + prefixLen, suffix, suffixLen);
+	return key;
+}
+
+/**
+ * Binary search over the stored suffixes of a prefix compressed node.
+ *
+ * A key that does not start with the node prefix sorts before or after all keys of the node, so the
+ * prefix is compared once and only the suffixes inside the loop.
+ *
+ * @param base    First stored suffix; each entry is stride bytes long
+ * @param count   Number of entries
+ * @tparam UPPER  Return the first entry greater than key rather than the first not less than key
+ */
+template <bool UPPER>
+static int searchPacked(const char *prefix, int prefixLen, int suffixLen,
+                        const char *base, const int stride, const int count, const StringKey &key)
+{
+	prefixLen = std::min(prefixLen, STRINGSIZE);
+	suffixLen = std::min(suffixLen, STRINGSIZE - prefixLen);
+	const int c = memcmp(key.data, prefix, prefixLen);
+	if(c != 0){
+		return c < 0 ? 0 : count;
+	}
+	// stored keys end in '\0' after the suffix, so any other byte there makes key the greater one
+	int rest = 0;
+	for(int i = prefixLen + suffixLen; i < STRINGSIZE; i++){
+		rest |= key.data[i] != '\0';
+	}
+	int lo = 0, hi = count;
+	while(lo < hi){
+		const int mid = (lo + hi) / 2;
+		int cmp = memcmp(key.data + prefixLen, base + mid * stride, suffixLen);
+		if(cmp == 0){
+			cmp = rest;
+		}
+		if(UPPER ? cmp >= 0 : cmp > 0){
+			lo = mid + 1;
+		}else{
+			hi = mid;
+		}
+	}
+	return lo;
+}
+
+/**
+ * Leaf operations for prefix compressed STRING leaves. An entry is the key suffix followed by the
+ * RecordId; entries only move in place when the layout of the node stays the same, otherwise the
+ * node is decoded and written again.
+ */
+template <>
+struct LeafFormat<StringKey>{
+	typedef LeafNode<StringKey> Node;
+
+	static int stride(const Node *node) { return node->suffixLen + sizeof(RecordId); }
+
+	/**
+	 * Number of entries, cut to what fits in the data area when the node is read while a writer
+	 * changes its layout.
+	 */
+	static int count(const Node *node) { return std::min((int)node->numKeys, STRINGLEAFDATASIZE / stride(node)); }
+
+	/**
+	 * STRING leaves hold no payload, payloadLen is always 0.
+	 */
+	static void init(Node *node, const int payloadLen)
+	{
+		node->numKeys = 0;
+		node->rightSibPageNo = Page::INVALID_NUMBER;
+		node->leftSibPageNo = Page::INVALID_NUMBER;
+		node->prefixLen = 0;
+		node->suffixLen = 0;
+		node->lowFence = KeyTraits<StringKey>::lowest();
+		node->highFence = KeyTraits<StringKey>::highest();
+	}
+
+	static StringKey key(const Node *node, const int i)
+	{
+		return unpackKey(node->prefix, node->prefixLen, node->suffixLen, node->data + i * stride(node));
+	}
+
+	static RecordId rid(const Node *node, const int i)
+	{
+		RecordId rid;
+		memcpy(&rid, node->data + i * stride(node) + node->suffixLen, sizeof(RecordId));
+		return rid;
+	}
+
+	static void copyRids(const Node *node, const int first, const int count, RecordId *out)
+	{
+		const char *entry = node->data + first * stride(node) + node->suffixLen;
+		for(int i = 0; i < count; i++, entry += stride(node)){
+			memcpy(&out[i], entry, sizeof(RecordId));
+		}
+	}
+
+	static void copyPayloads(const Node *node, const int first, const int count, char *out)
+	{
+	}
+
+	static void prefetch(const Node *node, const int pos)
+	{
+		__builtin_prefetch(node->data + pos * stride(node));
+	}
+
+	static int lowerBound(const Node *node, const StringKey &key)
+	{
+		return searchPacked<false>(node->prefix, node->prefixLen, node->suffixLen, node->data,
+		                           stride(node), count(node), key);
+	}
+
+	static int upperBound(const Node *node, const StringKey &key)
+	{
+		return searchPacked<true>(node->prefix, node->prefixLen, node->suffixLen, node->data,
+		                          stride(node), count(node), key);
+	}
+
+	static bool hasRoom(const Node *node, const StringKey &key)
+	{
+		const PackedLayout layout = PackedLayout::grow(node->prefixLen, node->suffixLen, node->prefix, node->numKeys, key);
+		return node->numKeys < STRINGARRAYLEAFSIZE
+		    && (node->numKeys + 1) * (layout.suffixLen + (int)sizeof(RecordId)) <= STRINGLEAFDATASIZE;
+	}
+
+	/**
+	 * Write count sorted entries into a node, which must have room for them.
+	 */
+	static void encode(Node *node, const StringKey *keys, const RecordId *rids, const int count)
+	{
+		const PackedLayout layout = PackedLayout::of(keys, count);
+		node->numKeys = count;
+		node->prefixLen = layout.prefixLen;
+		node->suffixLen = layout.suffixLen;
+		if(count > 0){
+			memcpy(node->prefix, keys[0].data, layout.prefixLen);
+		}
+		char *entry = node->data;
+		for(int i = 0; i < count; i++, entry += stride(node)){
+			memcpy(entry, keys[i].data + layout.prefixLen, layout.suffixLen);
+			memcpy(entry + layout.suffixLen, &rids[i], sizeof(RecordId));
+		}
+	}
+
+	static void insert(Node *node, const int pos, const StringKey &key, const RecordId rid, const char *payload)
+	{
+		const PackedLayout layout = PackedLayout::grow(node->prefixLen, node->suffixLen, node->prefix, node->numKeys, key);
+		if(node->numKeys > 0 && layout.prefixLen == node->prefixLen && layout.suffixLen == node->suffixLen){
+			char *entry = node->data + pos * stride(node);
+			memmove(entry + stride(node), entry, (node->numKeys - pos) * stride(node));
+			memcpy(entry, key.data + node->prefixLen, node->suffixLen);
+			memcpy(entry + node->suffixLen, &rid, sizeof(RecordId));
+			node->numKeys++;
+			return;
+		}
+		StringKey keys[STRINGARRAYLEAFSIZE + 1];
+		RecordId rids[STRINGARRAYLEAFSIZE + 1];
+		decodeWith(node, pos, key, rid, keys, rids);
+		encode(node, keys, rids, node->numKeys + 1);
+	}
+
+	/**
+	 * Split a full leaf at splitPoint(): the entries before it stay in node, the rest go to newNode.
+	 * Each part fits even uncompressed, since a leaf holds at most STRINGARRAYLEAFSIZE entries.
+	 *
+	 * @param append   Whether the new entry goes after all entries of the rightmost leaf, see splitPoint()
+	 */
+	static void split(Node *node, Node *newNode, const int pos, const StringKey &key, const RecordId rid,
+	                  const char *payload, const bool append)
+	{
+		StringKey keys[STRINGARRAYLEAFSIZE + 1];
+		RecordId rids[STRINGARRAYLEAFSIZE + 1];
+		decodeWith(node, pos, key, rid, keys, rids);
+		const int total = node->numKeys + 1;
+		const int half = splitPoint(total, append);
+		encode(node, keys, rids, half);
+		encode(newNode, keys + half, rids + half, total - half);
+	}
+
+	static void remove(Node *node, const int pos)
+	{
+		char *entry = node->data + pos * stride(node);
+		memmove(entry, entry + stride(node), (node->numKeys - pos - 1) * stride(node));
+		node->numKeys--;
+	}
+
+	static bool merge(Node *node, const Node *right)
+	{
+		const int total = node->numKeys + right->numKeys;
+		if(total > STRINGARRAYLEAFSIZE){
+			return false;
+		}
+		StringKey keys[STRINGARRAYLEAFSIZE];
+		RecordId rids[STRINGARRAYLEAFSIZE];
+		decode(node, keys, rids);
+		decode(right, keys + node->numKeys, rids + node->numKeys);
+		const PackedLayout layout = PackedLayout::of(keys, total);
+		if(total * (layout.suffixLen + (int)sizeof(RecordId)) > STRINGLEAFDATASIZE){
+			return false;
+		}
+		encode(node, keys, rids, total);
+		return true;
+	}
+
+	/**
+	 * Number of the leading entries, at most count, that fit in fill of a leaf's entry bytes.
+	 */
+	static int fit(const RIDKeyPair<StringKey> *entries, const int count, const double fill)
+	{
+		const int budget = (int)(STRINGLEAFDATASIZE * fill);
+		const int limit = std::min(count, STRINGARRAYLEAFSIZE);
+		int maxLen = significantLength(entries[0].key);
+		int n = 1;
+		while(n < limit){
+			maxLen = std::max(maxLen, significantLength(entries[n].key));
+			const int suffixLen = std::max(0, maxLen - commonPrefix(entries[0].key, entries[n].key));
+			if((n + 1) * (suffixLen + (int)sizeof(RecordId)) > budget){
+				break;
+			}
+			n++;
+		}
+		return n;
+	}
+
+	static void assign(Node *node, const RIDKeyPair<StringKey> *entries, const int count)
+	{
+		StringKey keys[STRINGARRAYLEAFSIZE];
+		RecordId rids[STRINGARRAYLEAFSIZE];
+		for(int j = 0; j < count; j++){
+			keys[j] = entries[j].key;
+			rids[j] = entries[j].rid;
+		}
+		encode(node, keys, rids, count);
+	}
+
+private:
+	/**
+	 * Copy the entries of a node out into plain arrays.
+	 */
+	static void decode(const Node *node, StringKey *keys, RecordId *rids)
+	{
+		for(int i = 0; i < node->numKeys; i++){
+			keys[i] = LeafFormat<StringKey>::key(node, i);
+			rids[i] = LeafFormat<StringKey>::rid(node, i);
+		}
+	}
+
+	/**
+	 * decode() with an extra entry inserted at pos.
+	 */
+	static void decodeWith(const Node *node, const int pos, const StringKey &key, const RecordId rid,
+	                       StringKey *keys, RecordId *rids)
+	{
+		for(int i = 0, j = 0; i <= node->numKeys; i++){
+			if(i == pos){
+				keys[i] = key;
+				rids[i] = rid;
+			}else{
+				keys[i] = LeafFormat<StringKey>::key(node, j);
+				rids[i] = LeafFormat<StringKey>::rid(node, j);
+				j++;
+			}
+		}
+	}
+};
+
+/**
+ * Non-leaf operations for prefix compressed STRING nodes. The first child page number leads the
+ * data; every key suffix is followed by the page number of the child to its right.
+ */
+template <>
+struct NonLeafFormat<StringKey>{
+	typedef NonLeafNode<StringKey> Node;
+
+	static int stride(const Node *node) { return node->suffixLen + sizeof(PageId); }
+
+	static const char *entries(const Node *node) { return node->data + sizeof(PageId); }
+
+	/**
+	 * Number of keys, cut to what fits in the data area when the node is read while a writer
+	 * changes its layout.
+	 */
+	static int count(const Node *node)
+	{
+		return std::min((int)node->numKeys, (STRINGNODEDATASIZE - (int)sizeof(PageId)) / stride(node));
+	}
+
+	static void init(Node *node, const int level, const PageId child0)
+	{
+		node->level = level;
+		node->numKeys = 0;
+		node->prefixLen = 0;
+		node->suffixLen = 0;
+		memcpy(node->data, &child0, sizeof(PageId));
+	}
+
+	static StringKey key(const Node *node, const int i)
+	{
+		return unpackKey(node->prefix, node->prefixLen, node->suffixLen, entries(node) + i * stride(node));
+	}
+
+	static PageId child(const Node *node, const int i)
+	{
+		PageId pageNo;
+		const char *src = i == 0 ? node->data : entries(node) + (i - 1) * stride(node) + node->suffixLen;
+		memcpy(&pageNo, src, sizeof(PageId));
+		return pageNo;
+	}
+
+	static int upperBound(const Node *node, const StringKey &key)
+	{
+		return searchPacked<true>(node->prefix, node->prefixLen, node->suffixLen, entries(node),
+		                          stride(node), count(node), key);
+	}
+
+	static int lowerBound(const Node *node, const StringKey &key)
+	{
+		return searchPacked<false>(node->prefix, node->prefixLen, node->suffixLen, entries(node),
+		                           stride(node), count(node), key);
+	}
+
+	static bool hasRoom(const Node *node, const StringKey &key)
+	{
+		const PackedLayout layout = PackedLayout::grow(node->prefixLen, node->suffixLen, node->prefix, node->numKeys, key);
+		return node->numKeys < STRINGARRAYNONLEAFSIZE
+		    && (int)sizeof(PageId) + (node->numKeys + 1) * (layout.suffixLen + (int)sizeof(PageId)) <= STRINGNODEDATASIZE;
+	}
+
+	static bool hasRoomForAny(const Node *node)
+	{
+		return node->numKeys < STRINGARRAYNONLEAFSIZE
+		    && (int)sizeof(PageId) + (node->numKeys + 1) * (STRINGSIZE + (int)sizeof(PageId)) <= STRINGNODEDATASIZE;
+	}
+
+	/**
+	 * Write count sorted keys and the count + 1 children around them into a node, which must have
+	 * room for them. The level is left unchanged.
+	 */
+	static void encode(Node *node, const StringKey *keys, const PageId *children, const int count)
+	{
+		const PackedLayout layout = PackedLayout::of(keys, count);
+		node->numKeys = count;
+		node->prefixLen = layout.prefixLen;
+		node->suffixLen = layout.suffixLen;
+		if(count > 0){
+			memcpy(node->prefix, keys[0].data, layout.prefixLen);
+		}
+		memcpy(node->data, &children[0], sizeof(PageId));
+		char *entry = node->data + sizeof(PageId);
+		for(int i = 0; i < count; i++, entry += stride(node)){
+			memcpy(entry, keys[i].data + layout.prefixLen, layout.suffixLen);
+			memcpy(entry + layout.suffixLen, &children[i + 1], sizeof(PageId));
+		}
+	}
+
+	static void insert(Node *node, const int pos, const StringKey &key, const PageId child)
+	{
+		const PackedLayout layout = PackedLayout::grow(node->prefixLen, node->suffixLen, node->prefix, node->numKeys, key);
+		if(node->numKeys > 0 && layout.prefixLen == node->prefixLen && layout.suffixLen == node->suffixLen){
+			char *entry = node->data + sizeof(PageId) + pos * stride(node);
+			memmove(entry + stride(node), entry, (node->numKeys - pos) * stride(node));
+			memcpy(entry, key.data + node->prefixLen, node->suffixLen);
+			memcpy(entry + node->suffixLen, &child, sizeof(PageId));
+			node->numKeys++;
+			return;
+		}
+		StringKey keys[STRINGARRAYNONLEAFSIZE + 1];
+		PageId children[STRINGARRAYNONLEAFSIZE + 2];
+		decodeWith(node, pos, key, child, keys, children);
+		encode(node, keys, children, node->numKeys + 1);
+	}
+
+	/**
+	 * Split a full node around its middle key, which moves up to the parent. Each half fits even
+	 * uncompressed, since a node holds at most STRINGARRAYNONLEAFSIZE keys.
+	 */
+	static StringKey split(Node *node, Node *newNode, const int pos, const StringKey &key, const PageId child)
+	{
+		StringKey keys[STRINGARRAYNONLEAFSIZE + 1];
+		PageId children[STRINGARRAYNONLEAFSIZE + 2];
+		decodeWith(node, pos, key, child, keys, children);
+		const int total = node->numKeys + 1;
+		const int half = total / 2;
+		encode(node, keys, children, half);
+		encode(newNode, keys + half + 1, children + half + 1, total - half - 1);
+		return keys[half];
+	}
+
+	static void remove(Node *node, const int pos)
+	{
+		char *entry = node->data + sizeof(PageId) + pos * stride(node);
+		memmove(entry, entry + stride(node), (node->numKeys - pos - 1) * stride(node));
+		node->numKeys--;
+	}
+
+	static bool merge(Node *node, const StringKey &separator, const Node *right)
+	{
+		const int total = node->numKeys + 1 + right->numKeys;
+		if(total > STRINGARRAYNONLEAFSIZE){
+			return false;
+		}
+		StringKey keys[STRINGARRAYNONLEAFSIZE];
+		PageId children[STRINGARRAYNONLEAFSIZE + 1];
+		decode(node, keys, children);
+		keys[node->numKeys] = separator;
+		decode(right, keys + node->numKeys + 1, children + node->numKeys + 1);
+		const PackedLayout layout = PackedLayout::of(keys, total);
+		if((int)sizeof(PageId) + total * (layout.suffixLen + (int)sizeof(PageId)) > STRINGNODEDATASIZE){
+			return false;
+		}
+		encode(node, keys, children, total);
+		return true;
+	}
+
+	/**
+	 * Number of the leading children, at most count, whose separators fit in fill of a node's entry
+	 * bytes. Two children always fit so that every level of the bulk loader makes progress.
+	 */
+	static int fit(const PageKeyPair<StringKey> *children, const int count, const double fill)
+	{
+		if(count <= 2){
+			return count;
+		}
+		const int budget = (int)(STRINGNODEDATASIZE * fill) - (int)sizeof(PageId);
+		const int limit = std::min(count, STRINGARRAYNONLEAFSIZE + 1);
+		int maxLen = significantLength(children[1].key);
+		int n = 2;
+		while(n < limit){
+			maxLen = std::max(maxLen, significantLength(children[n].key));
+			const int suffixLen = std::max(0, maxLen - commonPrefix(children[1].key, children[n].key));
+			if(n * (suffixLen + (int)sizeof(PageId)) > budget){
+				break;
+			}
+			n++;
+		}
+		return n;
+	}
+
+	static void assign(Node *node, const int level, const PageKeyPair<StringKey> *children, const int count)
+	{
+		StringKey keys[STRINGARRAYNONLEAFSIZE];
+		PageId pageNos[STRINGARRAYNONLEAFSIZE + 1];
+		for(int j = 0; j < count; j++){
+			pageNos[j] = children[j].pageNo;
+			if(j > 0){
+				keys[j - 1] = children[j].key;
+			}
+		}
+		node->level = level;
+		encode(node, keys, pageNos, count - 1);
+	}
+
+private:
+	/**
+	 * Copy the keys and children of a node out into plain arrays.
+	 */
+	static void decode(const Node *node, StringKey *keys, PageId *children)
+	{
+		children[0] = NonLeafFormat<StringKey>::child(node, 0);
+		for(int i = 0; i < node->numKeys; i++){
+			keys[i] = NonLeafFormat<StringKey>::key(node, i);
+			children[i + 1] = NonLeafFormat<StringKey>::child(node, i + 1);
+		}
+	}
+
+	/**
+	 * Decode the keys and children of a node with key inserted at pos and child at pos + 1.
+	 */
+	static void decodeWith(const Node *node, const int pos, const StringKey &key, const PageId child,
+	                       StringKey *keys, PageId *children)
+	{
+		children[0] = NonLeafFormat<StringKey>::child(node, 0);
+		for(int i = 0, j = 0; i <= node->numKeys; i++){
+			if(i == pos){
+				keys[i] = key;
+				children[i + 1] = child;
+			}else{
+				keys[i] = NonLeafFormat<StringKey>::key(node, j);
+				children[i + 1] = NonLeafFormat<StringKey>::child(node, j + 1);
+				j++;
+			}
+		}
+	}
+};
+
+/**
+ * Entries bulkLoad() holds at a time of the stream it reads. A leaf holds fewer entries than its
+ * page has bytes, so half of the window always covers the next leaf.
+ */
+static const int BULK_WINDOW = 2 * Page::SIZE;
+
+/**
+ * Fields of the records holding the key attributes, all that an index build reads of the records of
+ * columnar pages.
+ */
+static std::vector<ScanField> keyFieldsOf(const std::vector<KeyAttr> &keyAttrs)
+{
+	std::vector<ScanField> fields(keyAttrs.size());
+	for(std::size_t i = 0; i < keyAttrs.size(); i++){
+		fields[i].offset = keyAttrs[i].offset;
+		fields[i].length = compositeAttrSize(keyAttrs[i].type);
+	}
+	return fields;
+}
+
+/**
+ * Collects the (rid, key) pairs of the records found by a ParallelFileScan into a run per thread,
+ * which the thread sorts and hands to the external sort once it holds its share of the memory of the
+ * sort, and once it is done scanning.
+ */
+template <class T>
+class EntryCollector : public ScanConsumer{
+public:
+	EntryCollector(const std::vector<KeyAttr> &keyAttrs, const std::uint32_t numThreads,
+		ExternalSort<RIDKeyPair<T> > &sorter, const std::size_t memoryBudget)
+		: keyAttrs(keyAttrs), entries(numThreads), sorter(sorter),
+		  maxRun(std::max((std::size_t) 1, memoryBudget / 2 / numThreads / sizeof(RIDKeyPair<T>)))
+	{
+	}
+
+	void consume(const std::uint32_t worker, const RecordId *rids, const RecordView *records,
+		const std::size_t count)
+	{
+		std::vector<RIDKeyPair<T> > &batch = entries[worker];
+		RIDKeyPair<T> entry;
+		for(std::size_t i = 0; i < count; i++){
+			entry.set(rids[i], KeyTraits<T>::fromRecord(records[i].data, keyAttrs));
+			batch.push_back(entry);
+		}
+		if(batch.size() >= maxRun){
+			done(worker);
+		}
+	}
+
+	void done(const std::uint32_t worker)
+	{
+		std::sort(entries[worker].begin(), entries[worker].end());
+		sorter.addRun(entries[worker]);
+	}
+
+private:
+	const std::vector<KeyAttr> &keyAttrs;
+	std::vector<std::vector<RIDKeyPair<T> > > entries;
+	ExternalSort<RIDKeyPair<T> > &sorter;
+
+	/**
+	 * Entries a thread collects before it sorts them into a run
+	 */
+	const std::size_t maxRun;
+};
+
+/**
+ * Fit the spline with a greedy corridor: from the last knot, the corridor is the range of slopes
+ * that pass within maxError of every point since, narrowed by each point taken. A point outside the
+ * corridor makes the point before it a knot, so the spline between two knots is within maxError of
+ * every point in between. Separators repeated across leaves give one point, at their first leaf.
+ */
+void LeafModel::build(const std::vector<int> &separators, const std::vector<PageId> &leaves, const int maxError)
+{
+    clear();
+    std::vector<Knot> points;
+    for(size_t j = 0; j < separators.size(); j++){
+        if(points.empty() || points.back().key != separators[j]){
+            Knot point = {separators[j], (std::uint32_t) j};
+            points.push_back(point);
+        }
+    }
+    if(!points.empty()){
+        this->spline.push_back(points[0]);
+        Knot base = points[0];
+        double upperSlope = std::numeric_limits<double>::infinity();
+        double lowerSlope = -std::numeric_limits<double>::infinity();
+        for(size_t i = 1; i < points.size(); i++){
+            const double dx = (double) points[i].key - base.key;
+            const double dy = (double) points[i].leaf - base.leaf;
+            if(dy / dx > upperSlope || dy / dx < lowerSlope){
+                base = points[i - 1];
+                this->spline.push_back(base);
+                const double newDx = (double) points[i].key - base.key;
+                const double newDy = (double) points[i].leaf - base.leaf;
+                upperSlope = (newDy + maxError) / newDx;
+                lowerSlope = (newDy - maxError) / newDx;
+            }else{
+                upperSlope = std::min(upperSlope, (dy + maxError) / dx);
+                lowerSlope = std::max(lowerSlope, (dy - maxError) / dx);
+            }
+        }
+        if(this->spline.back().key != points.back().key){
+            this->spline.push_back(points.back());
+        }
+
+        // a table about as long as the spline, over the leading bits of the keys
+        this->minKey = this->spline.front().key;
+        const std::uint64_t range = (std::uint64_t) ((std::int64_t) this->spline.back().key - this->minKey);
+        int rangeBits = 1;
+        while(rangeBits < 64 && (range >> rangeBits) != 0){
+            rangeBits++;
+        }
+        int radixBits = 1;
+        while(radixBits < 20 && ((std::size_t) 1 << radixBits) < this->spline.size()){
+            radixBits++;
+        }
+        this->shift = std::max(0, rangeBits - radixBits);
+        this->radix.assign((size_t) (range >> this->shift) + 2, (std::uint32_t) this->spline.size());
+        for(size_t i = this->spline.size(); i-- > 0;){
+            this->radix[(std::uint64_t) ((std::int64_t) this->spline[i].key - this->minKey) >> this->shift] = (std::uint32_t) i;
+        }
+        for(size_t b = this->radix.size() - 1; b-- > 0;){
+            this->radix[b] = std::min(this->radix[b], this->radix[b + 1]);
+        }
+    }
+
+    this->numLeaves = leaves.size();
+    this->firstLeaf = leaves.front();
+    for(size_t j = 0; j < leaves.size(); j++){
+        if(leaves[j] != this->firstLeaf + (PageId) j){
+            this->leafPages = leaves;
+            break;
+        }
+    }
+}
+
+void LeafModel::clear()
+{
+    this->spline.clear();
+    this->radix.clear();
+    this->leafPages.clear();
+    this->numLeaves = 0;
+    this->firstLeaf = Page::INVALID_NUMBER;
+}
+
+/**
+ * Interpolate between the knots around key. The first knot not less than key is searched between the
+ * first knots of the radix slot of key and of the next slot.
+ */
+std::size_t LeafModel::predict(const int key) const
+{
+    if(this->spline.empty() || key <= this->spline.front().key){
+        return 0;
+    }
+    if(key > this->spline.back().key){
+        return this->numLeaves - 1;
+    }
+    const std::uint64_t slot = (std::uint64_t) ((std::int64_t) key - this->minKey) >> this->shift;
+    const size_t lo = this->radix[slot];
+    const size_t hi = std::min((size_t) this->radix[slot + 1], this->spline.size() - 1);
+    size_t i = lo;
+    size_t count = hi - lo + 1;
+    while(count > 0){
+        const size_t half = count / 2;
+        if(this->spline[i + half].key < key){
+            i += half + 1;
+            count -= half + 1;
+        }else{
+            count = half;
+        }
+    }
+    const Knot &left = this->spline[i - 1];
+    const Knot &right = this->spline[i];
+    const double leaf = left.leaf + ((double) key - left.key) * ((double) right.leaf - left.leaf) / ((double) right.key - left.key);
+    return std::min((size_t) (leaf + 0.5), this->numLeaves - 1);
+}
+
+std::uint32_t BTreeIndex::buildThreads = 0;
+
+void BTreeIndex::setBuildThreads(const std::uint32_t threads)
+{
+    buildThreads = threads;
+}
+
+std::size_t BTreeIndex::sortMemory = ExternalSort<int>::DEFAULT_MEMORY;
+
+void BTreeIndex::setSortMemory(const std::size_t bytes)
+{
+    sortMemory = bytes;
+}
+
+/**
+ * BTreeIndex Constructor. 
+ * Check to see if the corresponding index file exists. If so, open the file.
+ * If not, create it and insert entries for every tuple in the base relation using FileScan class.
+ *
+ * @param relationName        Name of file.
+ * @param outIndexName        Return the name of index file.
+ * @param bufMgrIn			  Buffer Manager Instance
+ * @param attrByteOffset	  Offset of attribute, over which index is to be built, in the record
+ * @param attrType			  Datatype of attribute over which index is built
+ * @param bulk			      Build a new index with bulkLoad() rather than one insertEntry() per tuple
+ * @param fillFactor	      Fraction of each node filled by the bulk loader, in (0, 1]
+ * @throws  BadIndexInfoException     If fillFactor is out of range, or the index file already exists for the
+ * corresponding attribute, but values in metapage(relationName, attribute byte offset, attribute type etc.)
+ * do not match with values received through constructor parameters.
+ */
+BTreeIndex::BTreeIndex(const std::string &relationName,
+                       std::string &outIndexName,
+                       BufMgr *bufMgrIn,
+                       const int attrByteOffset,
+                       const Datatype attrType,
+                       const bool bulk,
+                       const double fillFactor)
+{
+    // update variables
+    this->attributeType = attrType;
+    this->attrByteOffset = attrByteOffset; 
+    this->bufMgr = bufMgrIn;
+    open(relationName, outIndexName, INDEX_READ_WRITE, bulk, fillFactor);
+}
+
+/**
+ * BTreeIndex Constructor opening the index with the given access, see IndexAccess.
+ *
+ * @param access			  How to open the index file
+ * @throws  FileNotFoundException     If access is INDEX_READ_ONLY and the index file does not exist.
+ */
+BTreeIndex::BTreeIndex(const std::string &relationName,
+                       std::string &outIndexName,
+                       BufMgr *bufMgrIn,
+                       const int attrByteOffset,
+                       const Datatype attrType,
+                       const IndexAccess access)
+{
+    this->attributeType = attrType;
+    this->attrByteOffset = attrByteOffset; 
+    this->bufMgr = bufMgrIn;
+    open(relationName, outIndexName, access, true, DEFAULT_FILL_FACTOR);
+}
+
+/**
+ * BTreeIndex Constructor for a covering index.
+ *
+ * @param included  Attributes stored with every entry
+ */
+BTreeIndex::BTreeIndex(const std::string &relationName,
+                       std::string &outIndexName,
+                       BufMgr *bufMgrIn,
+                       const int attrByteOffset,
+                       const Datatype attrType,
+                       const std::vector<IncludedAttr> &included)
+{
+    int payloadLen = 0;
+    for(size_t i = 0; i < included.size(); i++){
+        payloadLen += included[i].length;
+    }
+    if(attrType == STRING){
+        throw BadIndexInfoException("Only INTEGER and DOUBLE indexes can include attributes!");
+    }
+    if(included.size() > (size_t) MAX_INCLUDED_ATTRS || payloadLen > MAX_PAYLOAD_SIZE){
+        throw BadIndexInfoException("Included attributes do not fit in the leaves!");
+    }
+    this->attributeType = attrType;
+    this->attrByteOffset = attrByteOffset; 
+    this->bufMgr = bufMgrIn;
+    this->included = included;
+    open(relationName, outIndexName, INDEX_READ_WRITE, false, DEFAULT_FILL_FACTOR);
+}
+
+/**
+ * BTreeIndex Constructor for a composite index.
+ *
+ * @param keyAttrs  Attributes the key is made of
+ */
+BTreeIndex::BTreeIndex(const std::string &relationName,
+                       std::string &outIndexName,
+                       BufMgr *bufMgrIn,
+                       const std::vector<KeyAttr> &keyAttrs,
+                       const bool bulk,
+                       const double fillFactor)
+{
+    int keySize = 0;
+    for(size_t i = 0; i < keyAttrs.size(); i++){
+        if(keyAttrs[i].type == COMPOSITE){
+            throw BadIndexInfoException("Key attributes must be INTEGER, DOUBLE or STRING!");
+        }
+        keySize += compositeAttrSize(keyAttrs[i].type);
+    }
+    if(keyAttrs.empty() || keyAttrs.size() > (size_t) MAX_KEY_ATTRS || keySize > COMPOSITEKEYSIZE){
+        throw BadIndexInfoException("Key attributes do not fit in a composite key!");
+    }
+    this->attributeType = COMPOSITE;
+    this->attrByteOffset = keyAttrs[0].offset;
+    this->bufMgr = bufMgrIn;
+    this->keyAttrs = keyAttrs;
+    open(relationName, outIndexName, INDEX_READ_WRITE, bulk, fillFactor);
+}
+
+CompositeKey BTreeIndex::compositeKey(const void *const *values, const size_t numValues, const bool upper) const
+{
+    if(this->attributeType != COMPOSITE || numValues > this->keyAttrs.size()){
+        throw BadIndexInfoException("Values do not match the key attributes of a composite index!");
+    }
+    CompositeKey key = upper ? KeyTraits<CompositeKey>::highest() : KeyTraits<CompositeKey>::lowest();
+    unsigned char *out = key.data;
+    for(size_t i = 0; i < numValues; i++){
+        encodeCompositeAttr(this->keyAttrs[i].type, values[i], out);
+        out += compositeAttrSize(this->keyAttrs[i].type);
+    }
+    return key;
+}
+
+void BTreeIndex::open(const std::string &relationName, std::string &outIndexName, const IndexAccess access,
+                      const bool bulk, const double fillFactor)
+{
+    if(!(fillFactor > 0 && fillFactor <= 1)){
+        throw BadIndexInfoException("Fill factor must be in (0, 1]!");
+    }
+    // alignment the pages of a mapped index file need for nodes to be read in place
+    std::size_t nodeAlignment = 1;
+    switch(this->attributeType){
+    case INTEGER:
+        this->leafOccupancy = INTARRAYLEAFSIZE;
+        this->nodeOccupancy = INTARRAYNONLEAFSIZE;
+        nodeAlignment = std::max(alignof(LeafNodeInt), alignof(NonLeafNodeInt));
+        break;
+    case DOUBLE:
+        this->leafOccupancy = DOUBLEARRAYLEAFSIZE;
+        this->nodeOccupancy = DOUBLEARRAYNONLEAFSIZE;
+        nodeAlignment = std::max(alignof(LeafNodeDouble), alignof(NonLeafNodeDouble));
+        break;
+    case STRING:
+        this->leafOccupancy = STRINGARRAYLEAFSIZE;
+        this->nodeOccupancy = STRINGARRAYNONLEAFSIZE;
+        nodeAlignment = std::max(alignof(LeafNodeString), alignof(NonLeafNodeString));
+        break;
+    case COMPOSITE:
+        this->leafOccupancy = COMPOSITEARRAYLEAFSIZE;
+        this->nodeOccupancy = COMPOSITEARRAYNONLEAFSIZE;
+        nodeAlignment = std::max(alignof(LeafNodeComposite), alignof(NonLeafNodeComposite));
+        break;
+    }
+    this->readOnly = access == INDEX_READ_ONLY;
+    this->mapped = false;
+    this->cachedLevels = 0;
+    this->maxCachedNodes = 0;
+    this->scanReadAhead = DEFAULT_SCAN_READ_AHEAD;
+    this->appends = 0;
+    this->rightmostLeaf = Page::INVALID_NUMBER;
+    this->insertBufferCapacity = 0;
+    this->bufferedEntries = 0;
+    this->bufferFlushes = 0;
+    this->keyFilterPageNum = Page::INVALID_NUMBER;
+    if(this->attributeType != COMPOSITE){
+        KeyAttr attr = {this->attrByteOffset, this->attributeType};
+        this->keyAttrs.assign(1, attr);
+    }
+    this->payloadLen = 0;
+    for(size_t i = 0; i < this->included.size(); i++){
+        this->payloadLen += this->included[i].length;
+    }
+
+    Page *hdrPage;
+    std::ostringstream idxStr;
+    idxStr << relationName << '.' << this->attrByteOffset;
+    for(size_t i = 1; i < this->keyAttrs.size(); i++){
+        idxStr << ',' << this->keyAttrs[i].offset;
+    }
+    for(size_t i = 0; i < this->included.size(); i++){
+        idxStr << '+' << this->included[i].offset;
+    }
+    std::string indexName = idxStr.str(); // indexName is the name of the index file 
+    outIndexName = indexName;
+    
+    // If the index file already exists, open the file 
+    try{
+        BlobFile *blobFile = new BlobFile(indexName, false);
+        this->file = blobFile;
+        this->headerPageNum = file->getFirstPageNo();
+        if(this->readOnly && blobFile->map()){
+            // pages are a whole number of machine pages apart, so all of them are aligned like the first
+            const Page *first = blobFile->mappedPage(this->headerPageNum);
+            this->mapped = first != NULL && reinterpret_cast<std::uintptr_t>(first) % nodeAlignment == 0;
+        }
+        // read the first metadata page 
+        readNode(this->headerPageNum, hdrPage);
+
+        // Metadata: throw exception if not match 
+        bool includedMatch = ((IndexMetaInfo*) hdrPage)->numIncluded == (int) this->included.size();
+        for(size_t i = 0; includedMatch && i < this->included.size(); i++){
+            includedMatch = ((IndexMetaInfo*) hdrPage)->included[i].offset == this->included[i].offset
+                         && ((IndexMetaInfo*) hdrPage)->included[i].length == this->included[i].length;
+        }
+        bool keyMatch = ((IndexMetaInfo*) hdrPage)->numKeyAttrs == (int) this->keyAttrs.size();
+        for(size_t i = 0; keyMatch && i < this->keyAttrs.size(); i++){
+            keyMatch = ((IndexMetaInfo*) hdrPage)->keyAttrs[i].offset == this->keyAttrs[i].offset
+                    && ((IndexMetaInfo*) hdrPage)->keyAttrs[i].type == this->keyAttrs[i].type;
+        }
+        if(((IndexMetaInfo*) hdrPage)->attrType != this->attributeType 
+        || ((IndexMetaInfo*) hdrPage)->attrByteOffset != this->attrByteOffset
+        || strcmp(((IndexMetaInfo*) hdrPage)->relationName, relationName.c_str())
+        || !includedMatch || !keyMatch){
+            // close the file again, so that it can be opened or removed after the exception
+            releaseNode(this->headerPageNum);
+            if(!this->mapped){
+                bufMgr->flushFile(this->file);
+            }
+            delete this->file;
+            this->file = NULL;
+            throw BadIndexInfoException("Values in metapage not match with values received!");
+        }
+        this->rootPageNum = ((IndexMetaInfo*) hdrPage)->rootPageNo;
+        this->height = ((IndexMetaInfo*) hdrPage)->height;
+        this->numEntries = ((IndexMetaInfo*) hdrPage)->numEntries;
+        this->numLeaves = ((IndexMetaInfo*) hdrPage)->numLeaves;
+        this->numNonLeaves = ((IndexMetaInfo*) hdrPage)->numNonLeaves;
+        this->leafSplits = ((IndexMetaInfo*) hdrPage)->leafSplits;
+        this->nonLeafSplits = ((IndexMetaInfo*) hdrPage)->nonLeafSplits;
+        this->merges = ((IndexMetaInfo*) hdrPage)->merges;
+        this->freePageNum = ((IndexMetaInfo*) hdrPage)->freePageNo;
+        this->keyFilterPageNum = ((IndexMetaInfo*) hdrPage)->keyFilterPageNo;
+        const int filterBlocks = ((IndexMetaInfo*) hdrPage)->keyFilterBlocks;
+        const int filterHashes = ((IndexMetaInfo*) hdrPage)->keyFilterHashes;
+        const bool filterSaved = ((IndexMetaInfo*) hdrPage)->keyFilterSaved != 0;
+        releaseNode(this->headerPageNum);
+        if(filterSaved && filterBlocks > 0){
+            this->keyFilter.reset(filterBlocks, filterHashes);
+            readKeyFilter();
+            if(!this->readOnly){
+                // the filter on disk goes stale with the first insert, until it is saved again
+                writeMetaInfo();
+            }
+        }
+    }catch (FileNotFoundException){ // otherwise, create a file 
+        if(this->readOnly){
+            throw;
+        }
+        // create an index file with BlobFile
+        this->file = new BlobFile(indexName, true);
+        bufMgr->allocPage(this->file, this->headerPageNum, hdrPage);       
+        // metadata 
+        ((IndexMetaInfo*)(hdrPage))->attrType = this->attributeType;
+        ((IndexMetaInfo*)(hdrPage))->attrByteOffset = this->attrByteOffset;  
+        strcpy(((IndexMetaInfo*)(hdrPage))->relationName, relationName.c_str());
+        ((IndexMetaInfo*)(hdrPage))->numIncluded = (int) this->included.size();
+        std::copy(this->included.begin(), this->included.end(), ((IndexMetaInfo*)(hdrPage))->included);
+        ((IndexMetaInfo*)(hdrPage))->numKeyAttrs = (int) this->keyAttrs.size();
+        std::copy(this->keyAttrs.begin(), this->keyAttrs.end(), ((IndexMetaInfo*)(hdrPage))->keyAttrs);
+        ((IndexMetaInfo*)(hdrPage))->keyFilterPageNo = Page::INVALID_NUMBER;
+        ((IndexMetaInfo*)(hdrPage))->keyFilterBlocks = 0;
+        ((IndexMetaInfo*)(hdrPage))->keyFilterHashes = 0;
+        ((IndexMetaInfo*)(hdrPage))->keyFilterSaved = 0;
+        
+        this->headerPageNum = file->getFirstPageNo();
+        bufMgr->unPinPage(this->file, this->headerPageNum, true);
+        this->freePageNum = Page::INVALID_NUMBER;
+        this->leafSplits = 0;
+        this->nonLeafSplits = 0;
+        this->merges = 0;
+
+        switch(this->attributeType){
+        case INTEGER:
+            buildIndex<int>(relationName, bulk, fillFactor);
+            break;
+        case DOUBLE:
+            buildIndex<double>(relationName, bulk, fillFactor);
+            break;
+        case STRING:
+            buildIndex<StringKey>(relationName, bulk, fillFactor);
+            break;
+        case COMPOSITE:
+            buildIndex<CompositeKey>(relationName, bulk, fillFactor);
+            break;
+        }
+        writeMetaInfo();
+    }
+}
+
+/**
+ * Nodes of a mapped index are returned in place. They are never written, since a mapped index is
+ * read-only.
+ */
+void BTreeIndex::readNode(const PageId pageNum, Page *&page, const bool hot)
+{
+    if(this->mapped){
+        page = const_cast<Page*>(static_cast<BlobFile*>(this->file)->mappedPage(pageNum));
+        if(page == NULL){
+            throw InvalidPageException(pageNum, this->file->filename());
+        }
+        return;
+    }
+    bufMgr->readPage(this->file, pageNum, page, hot);
+}
+
+void BTreeIndex::releaseNode(const PageId pageNum)
+{
+    if(!this->mapped){
+        bufMgr->unPinPage(this->file, pageNum, false);
+    }
+}
+
+bool BTreeIndex::readInnerNode(const PageId pageNum, Page *&page, const int depth)
+{
+    if(this->mapped || depth >= this->cachedLevels.load(std::memory_order_relaxed)){
+        readNode(pageNum, page, true);
+        return true;
+    }
+    page = this->nodeCache.find(pageNum);
+    if(page != NULL){
+        return false;
+    }
+    readNode(pageNum, page, true);
+    if(this->nodeCache.insert(pageNum, page, this->maxCachedNodes.load(std::memory_order_relaxed))){
+        // the pin of the cache, dropped when the index is closed
+        Page *cached;
+        bufMgr->readPage(this->file, pageNum, cached, true);
+    }
+    return true;
+}
+
+void BTreeIndex::cacheUpperLevels(const int levels, const int maxNodes)
+{
+    this->maxCachedNodes = std::min(maxNodes, (int) NodeCache::MAX_NODES);
+    this->cachedLevels = levels;
+}
+
+/**
+ * Fill a newly created index with an entry for every tuple of the base relation.
+ *
+ * With bulk set, every (key, rid) pair of the relation is sorted by an ExternalSort within sortMemory,
+ * and the sorted runs are merged into bulkLoad(). With the buffer manager in concurrent mode, the
+ * relation is scanned by a ParallelFileScan and every thread sorts runs of its own.
+ * Otherwise, and always for a covering index, a root and an empty first leaf are allocated and each
+ * tuple is inserted with insertTyped(). The meta page is written by the caller.
+ *
+ * @param relationName  Name of the base relation
+ * @param bulk          Build with bulkLoad() rather than insertTyped()
+ * @param fillFactor    Fraction of every node's capacity bulkLoad() fills
+ */
+template <class T>
+void BTreeIndex::buildIndex(const std::string &relationName, const bool bulk, const double fillFactor)
+{
+    if(bulk && this->payloadLen == 0){
+        // Collect every (key, rid) pair of the relation, sort them and build the tree bottom-up
+        ExternalSort<RIDKeyPair<T> > entries(bufMgr, this->file->filename(), sortMemory);
+        if(bufMgr->isConcurrent()){
+            // a buffer manager in concurrent mode lets every core scan and sort a part of the relation
+            ParallelFileScan pScan(relationName, bufMgr, buildThreads);
+            pScan.setFields(keyFieldsOf(this->keyAttrs));
+            EntryCollector<T> collector(this->keyAttrs, pScan.threads(), entries, sortMemory);
+            pScan.run(collector);
+        }else{
+            try{
+                FileScan fScan(relationName, bufMgr);
+                fScan.setFields(keyFieldsOf(this->keyAttrs));
+                RecordId rid; 
+                RIDKeyPair<T> entry;
+                while(true){
+                    fScan.scanNext(rid);
+                    const char *record = fScan.getRecordView().data;
+                    entry.set(rid, KeyTraits<T>::fromRecord(record, this->keyAttrs));
+                    entries.add(entry);
+                }
+            }catch(EndOfFileException){
+                
+            }
+        }
+        entries.finish();
+        this->rootPageNum = bulkLoad(entries, fillFactor);
+        return;
+    }
+    
+    // Allocate the first leaf node page and root node(page)
+    Page *rootPage, *leafPage;
+    PageId leafPageNum;
+    allocNode(leafPageNum, leafPage);
+    LeafFormat<T>::init((LeafNode<T>*) leafPage, this->payloadLen);
+    PageId rootPageNum;
+    allocNode(rootPageNum, rootPage);
+    NonLeafFormat<T>::init((NonLeafNode<T>*) rootPage, 1, leafPageNum);
+    this->rootPageNum = rootPageNum;
+
+    this->height = 2;
+    this->numEntries = 0;
+    this->numLeaves = 1;
+    this->numNonLeaves = 1;
+
+    bufMgr->unPinPage(this->file, leafPageNum, true);
+    bufMgr->unPinPage(this->file, this->rootPageNum, true);
+    writeMetaInfo();
+    
+    // Scan the file 
+    try{
+        FileScan fScan(relationName, bufMgr);
+        if(this->payloadLen == 0){
+            // a covering index gathers its payload from the rest of the record
+            fScan.setFields(keyFieldsOf(this->keyAttrs));
+        }
+        RecordId rid; 
+        while(true){
+            fScan.scanNext(rid);
+            const char *record = fScan.getRecordView().data;
+            char payload[MAX_PAYLOAD_SIZE];
+            gatherPayload(record, payload);
+            this->insertTyped(KeyTraits<T>::fromRecord(record, this->keyAttrs), rid, payload);
+        }
+    }catch(EndOfFileException){
+        
+    }
+}
+
+/**
+ * Write the root page number and the tree metadata to the meta page.
+ *
+ * Called whenever the root moves, after a build and when the index is closed, so that reopening
+ * the index only has to read the meta page.
+ */
+void BTreeIndex::writeMetaInfo()
+{
+    PageHandle hdrPage = bufMgr->readPage(this->file, this->headerPageNum);
+    IndexMetaInfo *meta = (IndexMetaInfo*) hdrPage.get();
+    meta->rootPageNo = this->rootPageNum;
+    meta->height = this->height;
+    meta->numEntries = this->numEntries;
+    meta->numLeaves = this->numLeaves;
+    meta->numNonLeaves = this->numNonLeaves;
+    meta->leafSplits = this->leafSplits;
+    meta->nonLeafSplits = this->nonLeafSplits;
+    meta->merges = this->merges;
+    meta->freePageNo = this->freePageNum;
+    meta->keyFilterPageNo = this->keyFilterPageNum;
+    meta->keyFilterBlocks = (int) this->keyFilter.blocks();
+    meta->keyFilterHashes = this->keyFilter.hashes();
+    meta->keyFilterSaved = 0;
+    hdrPage.release(true);
+}
+
+/**
+ * Build the tree bottom-up from entries sorted by key.
+ *
+ * Leaves are filled up to fillFactor of their capacity, with the entries spread evenly so the last
+ * leaf is not left nearly empty, and chained through rightSibPageNo. The separator between two
+ * nodes is KeyTraits<T>::separator() of the last key of the left one and the first key of the right
+ * one, which matches the separators produced by splits in insertToLeafNode/insertToNonLeafNode,
+ * and also the fence between the two leaves. Levels are added until a single non-leaf root remains; the root is always a non-leaf node, even
+ * when all entries fit in one leaf.
+ *
+ * The entries are read from the merge BULK_WINDOW at a time, so that they are never all copied into
+ * one sorted array.
+ *
+ * @param entries     (key, rid) pairs of the base relation, sorted and finished
+ * @param fillFactor  Fraction of every node's capacity to fill, in (0, 1]
+ * @return Page number of the new root
+ */
+template <class T>
+PageId BTreeIndex::bulkLoad(ExternalSort<RIDKeyPair<T> > &entries, const double fillFactor){
+    const int numEntries = (int)entries.size();
+
+    // entries windowStart up to windowEnd of the stream, and the last key put in a leaf
+    std::vector<RIDKeyPair<T> > window(BULK_WINDOW);
+    int windowStart = 0, windowEnd = 0;
+    T lastKey = T();
+
+    // separator and page number of each node on the level being built
+    std::vector<PageKeyPair<T> > level;
+    PageKeyPair<T> child;
+
+    // Write the leaves; an empty relation still gets one empty leaf
+    Page *page, *prevPage = NULL;
+    PageId pageNum, prevPageNum = Page::INVALID_NUMBER;
+    int next = 0;
+    do{
+        allocNode(pageNum, page);
+        LeafNode<T>* leaf = (LeafNode<T>*) page;
+        LeafFormat<T>::init(leaf, this->payloadLen);
+        leaf->leftSibPageNo = prevPageNum;
+        const int remaining = numEntries - next;
+        if(remaining > 0){
+            if(windowEnd - next < BULK_WINDOW / 2 && windowEnd < numEntries){
+                // move the entries not used yet to the front and refill the window behind them
+                std::copy(window.begin() + (next - windowStart), window.begin() + (windowEnd - windowStart),
+                          window.begin());
+                windowStart = next;
+                windowEnd += entries.read(&window[windowEnd - windowStart], BULK_WINDOW - (windowEnd - windowStart));
+            }
+            const RIDKeyPair<T> *first = &window[next - windowStart];
+
+            // spread what is left evenly over the leaves it still needs
+            const int fit = LeafFormat<T>::fit(first, windowEnd - next, fillFactor);
+            const int leavesLeft = (remaining + fit - 1) / fit;
+            const int count = (remaining + leavesLeft - 1) / leavesLeft;
+            LeafFormat<T>::assign(leaf, first, count);
+            child.set(pageNum, next > 0 ? KeyTraits<T>::separator(lastKey, first[0].key) : first[0].key);
+            if(next > 0){
+                leaf->lowFence = child.key;
+            }
+            lastKey = first[count - 1].key;
+            next += count;
+        }else{
+            child.set(pageNum, T());
+        }
+        level.push_back(child);
+
+        if(prevPage != NULL){
+            ((LeafNode<T>*) prevPage)->rightSibPageNo = pageNum;
+            ((LeafNode<T>*) prevPage)->highFence = child.key;
+            bufMgr->unPinPage(this->file, prevPageNum, true);
+        }
+        prevPage = page;
+        prevPageNum = pageNum;
+    }while(next < numEntries);
+    bufMgr->unPinPage(this->file, prevPageNum, true);
+    this->numEntries = numEntries;
+    this->numLeaves = (int)level.size();
+    this->numNonLeaves = 0;
+    this->height = 1;
+
+    // Write non-leaf levels on top until only the root remains
+    int nodeLevel = 1;
+    do{
+        std::vector<PageKeyPair<T> > parents;
+        const int numChildren = (int)level.size();
+        next = 0;
+        while(next < numChildren){
+            allocNode(pageNum, page);
+            const int remaining = numChildren - next;
+            const int fit = NonLeafFormat<T>::fit(&level[next], remaining, fillFactor);
+            const int nodesLeft = (remaining + fit - 1) / fit;
+            const int count = (remaining + nodesLeft - 1) / nodesLeft;
+            NonLeafFormat<T>::assign((NonLeafNode<T>*) page, nodeLevel, &level[next], count);
+            child.set(pageNum, level[next].key);
+            parents.push_back(child);
+            next += count;
+            bufMgr->unPinPage(this->file, pageNum, true);
+        }
+        this->numNonLeaves += (int)parents.size();
+        level.swap(parents);
+        nodeLevel = 0;
+        this->height++;
+    }while(level.size() > 1);
+
+    return level[0].pageNo;
+}
+
+/**
+ * BTreeIndex Destructor. 
+ * End any initialized scan, flush index file, after unpinning any pinned pages, from the buffer manager
+ * and delete file instance thereby closing the index file.
+ * Destructor should not throw any exceptions. All exceptions should be caught in here itself.
+ * 
+ * Perform any cleanup that may be necessary, including clearing up any state variables, 
+ * unpinning any B+ Tree pages that are pinned, and flushing the index ﬁle (by calling bufMgr->flushFile()).
+ * Note that this method does not delete the index file! But, deletion of the file object is required, 
+ * which will call the destructor of File class causing the index file to be closed.  
+ * */
+BTreeIndex::~BTreeIndex()
+{     
+    if(this->scan.scanExecuting){
+        endScan(this->scan); // cleanup if there is any initialized scan
+    }
+    if(!this->readOnly){
+        flushInsertBuffer();
+        writeMetaInfo(); // entry and leaf counts are only kept in memory between root changes
+        if(this->keyFilter.enabled()){
+            writeKeyFilter();
+        }
+    }
+    if(!this->mapped){
+        const std::vector<PageId> cached = this->nodeCache.pageNumbers();
+        for(size_t i = 0; i < cached.size(); i++){
+            this->bufMgr->unPinPage(this->file, cached[i], false);
+        }
+        this->bufMgr->flushFile(file); // flush the index file 
+    }
+    delete this->file;
+    this->file = NULL;
+}
+
+/**
+ * A node on the path of a descent: the page and the version of its latch when it was read. The page
+ * is pinned by the descent unless it came from the node cache.
+ */
+struct PathEntry{
+    PageId pageNum;
+    Page *page;
+    std::uint64_t version;
+    bool pinned;
+};
+
+/**
+ * Sibling pointers of a leaf page, for BufMgr::prefetchPages() to follow the chain of leaves.
+ */
+template <class T>
+static PageId rightSiblingOf(const Page *page)
+{
+    return ((const LeafNode<T>*) page)->rightSibPageNo;
+}
+
+template <class T>
+static PageId leftSiblingOf(const Page *page)
+{
+    return ((const LeafNode<T>*) page)->leftSibPageNo;
+}
+
+/**
+ * Deepest tree a descent can record. With the smallest fan-out, that of COMPOSITE non-leaves, the
+ * index file would need far more pages than a PageId can number.
+ */
+static const int MAX_TREE_HEIGHT = 32;
+
+/**
+ * Keys of the types a LeafModel is fitted to, INTEGER only.
+ */
+template <class T>
+static bool leafModelKey(const T &key, int &out)
+{
+    return false;
+}
+
+static bool leafModelKey(const int &key, int &out)
+{
+    out = key;
+    return true;
+}
+
+/**
+ * Descend optimistically from the root to the leaf for key.
+ *
+ * The version of a child is read before its parent is validated, so a child page number is only
+ * followed while it was still current. The root page number is checked once its version is known,
+ * since a root split moves it while the old root is latched.
+ *
+ * A reader unpins every node as soon as its child is pinned, so only the leaf is left pinned. An
+ * insert keeps the nodes a split could reach: once a node is seen to have room for any separator,
+ * the nodes above it are unpinned. Whether it has room is read before the node is validated, so
+ * the decision never rests on a torn read.
+ *
+ * @param key     The key to look for
+ * @param lower   Follow the first child that can hold key (lowerBound) rather than the child a new key goes to (upperBound)
+ * @param path    Filled with the nodes from the root to the leaf; nodes released on the way have a NULL page
+ * @param insert  Keep the nodes a split of the leaf could propagate to pinned
+ * @return Number of nodes on the path, or 0 if a concurrent change forced a restart
+ */
+template <class T>
+int BTreeIndex::descend(const T &key, const bool lower, PathEntry *path, const bool insert)
+{
+    int modelKey;
+    if(this->leafModel.enabled() && leafModelKey(key, modelKey)){
+        return descendByModel(key, modelKey, lower, path);
+    }
+    PageId pageNum = this->rootPageNum;
+    std::uint64_t version = this->latches.of(pageNum).readLock();
+    Page *page;
+    // inner nodes are read by every descent, tell the buffer pool to keep them
+    bool pinned = readInnerNode(pageNum, page, 0);
+    if(pageNum != this->rootPageNum){
+        if(pinned){
+            releaseNode(pageNum);
+        }
+        Tracer::countRestart();
+        return 0;
+    }
+
+    int depth = 0;
+    while(true){
+        path[depth].pageNum = pageNum;
+        path[depth].page = page;
+        path[depth].version = version;
+        path[depth].pinned = pinned;
+        depth++;
+
+        const NonLeafNode<T> *node = (NonLeafNode<T>*) page;
+        const bool leafChild = node->level == 1;
+        const int i = lower ? NonLeafFormat<T>::lowerBound(node, key) : NonLeafFormat<T>::upperBound(node, key);
+        const PageId childPageNum = NonLeafFormat<T>::child(node, i);
+        const bool stopsSplit = insert && NonLeafFormat<T>::hasRoomForAny(node);
+        const std::uint64_t childVersion = this->latches.of(childPageNum).readLock();
+        if(!this->latches.of(pageNum).validate(version) || depth == MAX_TREE_HEIGHT){
+            releasePath(path, depth);
+            Tracer::countRestart();
+            return 0;
+        }
+        if(stopsSplit){
+            releasePath(path, depth - 1);
+        }
+        pageNum = childPageNum;
+        version = childVersion;
+        if(leafChild){
+            readNode(pageNum, page);
+            pinned = true;
+        }else{
+            pinned = readInnerNode(pageNum, page, depth);
+        }
+        if(!insert){
+            releasePath(path, depth);
+        }
+        if(leafChild){
+            path[depth].pageNum = pageNum;
+            path[depth].page = page;
+            path[depth].version = version;
+            path[depth].pinned = pinned;
+            Tracer::countDescent(depth + 1);
+            return depth + 1;
+        }
+    }
+}
+
+/**
+ * Only reached for INTEGER keys, on a read-only index, so the leaves need no validation: the fences of a
+ * leaf are those of the parent levels, and the leaf descend() would reach is the first one whose high
+ * fence is not less than key (lower) or is greater than key, among those whose low fence allows key.
+ */
+template <class T>
+int BTreeIndex::descendByModel(const T &key, const int modelKey, const bool lower, PathEntry *path)
+{
+    PageId pageNum = this->leafModel.leafPage(this->leafModel.predict(modelKey));
+    Page *page;
+    readNode(pageNum, page);
+    while(true){
+        const LeafNode<T> *leaf = (LeafNode<T>*) page;
+        PageId siblingPageNum = Page::INVALID_NUMBER;
+        if(lower ? !(leaf->lowFence < key) : key < leaf->lowFence){
+            siblingPageNum = leaf->leftSibPageNo;
+        }else if(lower ? leaf->highFence < key : !(key < leaf->highFence)){
+            siblingPageNum = leaf->rightSibPageNo;
+        }
+        if(siblingPageNum == Page::INVALID_NUMBER){
+            break;
+        }
+        releaseNode(pageNum);
+        pageNum = siblingPageNum;
+        readNode(pageNum, page);
+    }
+    path[0].pageNum = pageNum;
+    path[0].page = page;
+    path[0].version = this->latches.of(pageNum).readLock();
+    path[0].pinned = true;
+    Tracer::countDescent(1);
+    return 1;
+}
+
+/**
+ * Walk the subtree in order, so the separators between its children come between the separators of
+ * the children themselves.
+ */
+void BTreeIndex::collectLeaves(const PageId pageNum, std::vector<int> &separators, std::vector<PageId> &leaves)
+{
+    Page *page;
+    readNode(pageNum, page);
+    const NonLeafNodeInt *node = (const NonLeafNodeInt*) page;
+    for(int i = 0; i <= node->numKeys; i++){
+        if(i > 0){
+            separators.push_back(NonLeafFormat<int>::key(node, i - 1));
+        }
+        if(node->level == 1){
+            leaves.push_back(NonLeafFormat<int>::child(node, i));
+        }else{
+            collectLeaves(NonLeafFormat<int>::child(node, i), separators, leaves);
+        }
+    }
+    releaseNode(pageNum);
+}
+
+bool BTreeIndex::setLeafModel(const int maxError)
+{
+    if(!this->readOnly || this->attributeType != INTEGER){
+        return false;
+    }
+    if(maxError < 0){
+        this->leafModel.clear();
+        return true;
+    }
+    std::vector<int> separators;
+    std::vector<PageId> leaves;
+    collectLeaves(this->rootPageNum, separators, leaves);
+    this->leafModel.build(separators, leaves, maxError);
+    return true;
+}
+
+void BTreeIndex::releasePath(PathEntry *path, const int count)
+{
+    for(int i = 0; i < count; i++){
+        if(path[i].page != NULL){
+            if(path[i].pinned){
+                releaseNode(path[i].pageNum);
+            }
+            path[i].page = NULL;
+        }
+    }
+}
+
+/**
+ *  Insert to leaf node
+ *
+ * The entry is shifted into place on the pinned page. If the leaf is full, the upper half of the
+ * entries moves to a newly allocated right sibling and the entry goes to whichever half it belongs to;
+ * only the last tenth moves if the entry is appended to the rightmost leaf.
+ * The new sibling is filled before the leaf links to it, so scans never reach it half written. The
+ * old right sibling is latched to point back at the new one; sibling latches are only ever waited
+ * for from left to right.
+ * 
+ * @param key  The key we want to insert. 
+ * @param rid  The corresponding record id of the tuple in the base relation.
+ * @param payload  Payload of the entry if the index is covering
+ * @param pageNum  Page number of the leaf
+ * @param node  The pinned and latched leaf
+ * @return The separator and page number of the new right sibling if the leaf was split, (T(), INVALID_NUMBER) otherwise
+ */
+template <class T>
+const std::pair<T, PageId> BTreeIndex::insertToLeafNode(const T &key, const RecordId rid, const char *payload,
+                                                        const PageId pageNum, LeafNode<T> *node){
+    // entries with an equal key stay in front of the new one
+    const int insertPos = LeafFormat<T>::upperBound(node, key);
+
+    if(LeafFormat<T>::hasRoom(node, key)) {
+        LeafFormat<T>::insert(node, insertPos, key, rid, payload);
+        return std::make_pair(T(), (PageId)Page::INVALID_NUMBER);
+    }
+
+    // split
+    Page* newPage;
+    PageId newPageNum;
+    allocNode(newPageNum, newPage);
+    LeafNode<T>* newNode = (LeafNode<T>*) newPage;
+    const bool append = node->rightSibPageNo == Page::INVALID_NUMBER && insertPos == node->numKeys;
+    LeafFormat<T>::split(node, newNode, insertPos, key, rid, payload, append);
+    newNode->rightSibPageNo = node->rightSibPageNo;
+    newNode->leftSibPageNo = pageNum;
+    node->rightSibPageNo = newPageNum;        
+    setLeftSibling<T>(newNode->rightSibPageNo, newPageNum);
+    this->numLeaves++;
+    this->leafSplits++;
+    Tracer::countSplit();
+    const T midKey = KeyTraits<T>::separator(LeafFormat<T>::key(node, node->numKeys - 1), LeafFormat<T>::key(newNode, 0));
+    newNode->lowFence = midKey;
+    newNode->highFence = node->highFence;
+    node->highFence = midKey;
+    bufMgr->unPinPage(this->file, newPageNum, true);
+    
+    return std::make_pair(midKey, (PageId)newPageNum);
+}
+
+/**
+ * Point the left sibling pointer of a leaf at a new left neighbour, under the leaf's latch.
+ *
+ * @param pageNum      Page number of the leaf, INVALID_NUMBER if there is none
+ * @param leftPageNum  Page number of its new left neighbour
+ */
+template <class T>
+void BTreeIndex::setLeftSibling(const PageId pageNum, const PageId leftPageNum)
+{
+    if(pageNum == Page::INVALID_NUMBER){
+        return;
+    }
+    this->latches.of(pageNum).lock();
+    PageHandle page = bufMgr->readPage(this->file, pageNum);
+    ((LeafNode<T>*) page.get())->leftSibPageNo = leftPageNum;
+    page.release(true);
+    this->latches.of(pageNum).unlock();
+}
+
+/**
+ * Insert to non-leaf node
+ *
+ * The new right sibling of a split child is shifted into place on the pinned page; if this node
+ * is full as well, it is split by moving the upper half of its keys and children to a newly
+ * allocated node, and the middle key moves up.
+ * 
+ * @param key  The key whose insertion split the child, which picks the child again.
+ * @param child  Separator and page number of the new right sibling of the child
+ * @param node  The pinned and latched non-leaf node
+ * @return The separator key and page number of the new right node if this node was split, (T(), INVALID_NUMBER) otherwise
+ */
+template <class T>
+const std::pair<T, PageId> BTreeIndex::insertToNonLeafNode(const T &key, const std::pair<T, PageId> &child,
+                                                NonLeafNode<T> *node){
+    // Page0 | key0 | Page
+    // Page0 | key0 | Page1 | key1 | Page (last)
+    // The split child is the first one whose separator is greater than the key
+    const int i = NonLeafFormat<T>::upperBound(node, key);
+
+    if (NonLeafFormat<T>::hasRoom(node, child.first)){ // not full, shift into place
+        NonLeafFormat<T>::insert(node, i, child.first, child.second);
+        return std::make_pair(T(), (PageId)Page::INVALID_NUMBER);
+    }
+
+    // if full, split again
+    Page* newPage;
+    PageId newPageNum;
+    allocNode(newPageNum, newPage);
+    NonLeafNode<T>* newNode = (NonLeafNode<T>*) newPage;
+    const T midKey = NonLeafFormat<T>::split(node, newNode, i, child.first, child.second);
+    newNode->level = node->level;
+    this->numNonLeaves++;
+    this->nonLeafSplits++;
+    Tracer::countSplit();
+    bufMgr->unPinPage(this->file, newPageNum, true);                    
+    return std::make_pair(midKey, newPageNum);
+}
+
+/**
+ * Insert a new entry using the pair <key, rid>. 
+ * 
+ * Descend from the root to the leaf to insert the entry in. The insertion may cause splitting 
+ * of leaf node. This splitting will require addition of new leaf page number entry into the parent non-leaf, 
+ * which may in-turn get split. This may continue all the way upto the root causing the root to get split. 
+ * If root gets split, metapage needs to be changed accordingly.
+ * 
+ * Make sure to unpin pages as soon as you can.
+ * @param key	A pointer to the value (integer, double or string) we want to insert. 
+ * @param rid	The corresponding record id of the tuple in the base relation.
+ * @throws BadIndexInfoException If the index is covering and so needs the record.
+ **/
+const void BTreeIndex::insertEntry(const void *key, const RecordId rid)
+{
+    insertEntry(key, rid, NULL);
+}
+
+/**
+ * insertEntry() with the record of the entry, whose included attributes a covering index stores.
+ *
+ * @param record  The record, NULL if the index is not covering
+ **/
+const void BTreeIndex::insertEntry(const void *key, const RecordId rid, const char *record)
+{
+    if(this->readOnly){
+        throw ReadOnlyIndexException(this->file->filename());
+    }
+    if(this->payloadLen > 0 && record == NULL){
+        throw BadIndexInfoException("A covering index needs the record of every entry!");
+    }
+    TraceScope trace(TRACE_INSERT, this->file->filename());
+    char payload[MAX_PAYLOAD_SIZE];
+    if(record != NULL){
+        gatherPayload(record, payload);
+    }
+    if(this->insertBufferCapacity > 0){
+        switch(this->attributeType){
+        case INTEGER:
+            bufferInsert(KeyTraits<int>::fromPtr(key), rid, payload);
+            break;
+        case DOUBLE:
+            bufferInsert(KeyTraits<double>::fromPtr(key), rid, payload);
+            break;
+        case STRING:
+            bufferInsert(KeyTraits<StringKey>::fromPtr(key), rid, payload);
+            break;
+        case COMPOSITE:
+            bufferInsert(KeyTraits<CompositeKey>::fromPtr(key), rid, payload);
+            break;
+        }
+        return;
+    }
+    // the insert and the splits it causes are logged as one action
+    LogAction action(bufMgr->log());
+    switch(this->attributeType){
+    case INTEGER:
+        insertTyped(KeyTraits<int>::fromPtr(key), rid, payload);
+        break;
+    case DOUBLE:
+        insertTyped(KeyTraits<double>::fromPtr(key), rid, payload);
+        break;
+    case STRING:
+        insertTyped(KeyTraits<StringKey>::fromPtr(key), rid, payload);
+        break;
+    case COMPOSITE:
+        insertTyped(KeyTraits<CompositeKey>::fromPtr(key), rid, payload);
+        break;
+    }
+    // the counters on the meta page go with the action, so that a recovered index has them right
+    if(bufMgr->log() != NULL){
+        writeMetaInfo();
+    }
+    action.commit();
+}
+
+void BTreeIndex::gatherPayload(const char *record, char *payload) const
+{
+    for(size_t i = 0; i < this->included.size(); i++){
+        memcpy(payload, record + this->included[i].offset, this->included[i].length);
+        payload += this->included[i].length;
+    }
+}
+
+/**
+ * Add an entry to the insert buffer, and flush the buffer if that fills it.
+ *
+ * @param key	The key we want to insert.
+ * @param rid	The corresponding record id of the tuple in the base relation.
+ * @param payload	Payload of the entry if the index is covering
+ **/
+template <class T>
+void BTreeIndex::bufferInsert(const T &key, const RecordId rid, const char *payload)
+{
+    std::lock_guard<std::mutex> guard(this->insertBufferLatch);
+    if(this->keyFilter.enabled()){
+        this->keyFilter.add(KeyTraits<T>::hash(key));
+    }
+    BufferedInsert entry;
+    memcpy(entry.key, &key, sizeof(T));
+    entry.rid = rid;
+    memcpy(entry.payload, payload, this->payloadLen);
+    this->insertBuffer.push_back(entry);
+    this->bufferedEntries++;
+    if(this->insertBuffer.size() >= this->insertBufferCapacity){
+        flushBufferLocked();
+    }
+}
+
+void BTreeIndex::setInsertBuffer(const size_t entries)
+{
+    std::lock_guard<std::mutex> guard(this->insertBufferLatch);
+    this->insertBufferCapacity = entries;
+    if(this->insertBuffer.size() >= entries){
+        flushBufferLocked();
+    }
+    this->insertBuffer.reserve(entries);
+}
+
+void BTreeIndex::flushInsertBuffer()
+{
+    std::lock_guard<std::mutex> guard(this->insertBufferLatch);
+    flushBufferLocked();
+}
+
+/**
+ * Size the key filter for the keys of the index, or expectedKeys if that is more, and add the keys
+ * of the index to it. With k bits per key, k ln 2 hashes per key give the fewest false positives.
+ */
+void BTreeIndex::setKeyFilter(const int bitsPerKey, const std::size_t expectedKeys)
+{
+    if(bitsPerKey <= 0){
+        this->keyFilter.reset(0, 0);
+        return;
+    }
+    const std::size_t keys = std::max(std::max((std::size_t) (this->numEntries + this->bufferedEntries), expectedKeys),
+                                      (std::size_t) 1);
+    const std::size_t blockBits = KeyFilter::BLOCK_WORDS * 64;
+    const std::size_t blocks = (keys * bitsPerKey + blockBits - 1) / blockBits;
+    const int hashes = std::min(16, std::max(1, (int) (bitsPerKey * 0.69 + 0.5)));
+    this->keyFilter.reset(blocks, hashes);
+    switch(this->attributeType){
+    case INTEGER:
+        fillKeyFilter<int>();
+        break;
+    case DOUBLE:
+        fillKeyFilter<double>();
+        break;
+    case STRING:
+        fillKeyFilter<StringKey>();
+        break;
+    case COMPOSITE:
+        fillKeyFilter<CompositeKey>();
+        break;
+    }
+}
+
+/**
+ * Descend along the first children to the leftmost leaf and add the keys of every leaf from there
+ * to the right, then those of the insert buffer.
+ */
+template <class T>
+void BTreeIndex::fillKeyFilter()
+{
+    PageId pageNum = this->rootPageNum;
+    while(true){
+        Page *page;
+        readNode(pageNum, page);
+        const NonLeafNode<T> *node = (NonLeafNode<T>*) page;
+        const PageId childPageNum = NonLeafFormat<T>::child(node, 0);
+        const bool leafChild = node->level == 1;
+        releaseNode(pageNum);
+        pageNum = childPageNum;
+        if(leafChild){
+            break;
+        }
+    }
+    while(pageNum != Page::INVALID_NUMBER){
+        Page *page;
+        readNode(pageNum, page);
+        const LeafNode<T> *leaf = (LeafNode<T>*) page;
+        const int count = LeafFormat<T>::count(leaf);
+        for(int i = 0; i < count; i++){
+            this->keyFilter.add(KeyTraits<T>::hash(LeafFormat<T>::key(leaf, i)));
+        }
+        const PageId siblingPageNum = leaf->rightSibPageNo;
+        releaseNode(pageNum);
+        pageNum = siblingPageNum;
+    }
+    std::lock_guard<std::mutex> guard(this->insertBufferLatch);
+    for(size_t i = 0; i < this->insertBuffer.size(); i++){
+        this->keyFilter.add(KeyTraits<T>::hash(KeyTraits<T>::fromPtr(this->insertBuffer[i].key)));
+    }
+}
+
+void BTreeIndex::readKeyFilter()
+{
+    std::size_t read = 0;
+    for(PageId pageNum = this->keyFilterPageNum; pageNum != Page::INVALID_NUMBER && read < this->keyFilter.numWords();){
+        Page *page;
+        readNode(pageNum, page);
+        const KeyFilterPage *filterPage = (const KeyFilterPage*) page;
+        const std::size_t n = std::min((std::size_t) KEY_FILTER_PAGE_WORDS, this->keyFilter.numWords() - read);
+        for(std::size_t i = 0; i < n; i++){
+            this->keyFilter.setWord(read + i, filterPage->words[i]);
+        }
+        read += n;
+        const PageId nextPageNum = filterPage->nextPageNo;
+        releaseNode(pageNum);
+        pageNum = nextPageNum;
+    }
+}
+
+/**
+ * The pages of the filter form a list like the free list. A smaller filter leaves the pages past its
+ * end on the list, for a larger one to reuse.
+ */
+void BTreeIndex::writeKeyFilter()
+{
+    PageId prevPageNum = Page::INVALID_NUMBER;
+    Page *prevPage = NULL;
+    PageId pageNum = this->keyFilterPageNum;
+    for(std::size_t written = 0; written < this->keyFilter.numWords();){
+        Page *page;
+        if(pageNum == Page::INVALID_NUMBER){
+            allocNode(pageNum, page);
+            ((KeyFilterPage*) page)->nextPageNo = Page::INVALID_NUMBER;
+            if(prevPage != NULL){
+                ((KeyFilterPage*) prevPage)->nextPageNo = pageNum;
+            }else{
+                this->keyFilterPageNum = pageNum;
+            }
+        }else{
+            bufMgr->readPage(this->file, pageNum, page);
+        }
+        KeyFilterPage *filterPage = (KeyFilterPage*) page;
+        const std::size_t n = std::min((std::size_t) KEY_FILTER_PAGE_WORDS, this->keyFilter.numWords() - written);
+        for(std::size_t i = 0; i < n; i++){
+            filterPage->words[i] = this->keyFilter.word(written + i);
+        }
+        written += n;
+        if(prevPage != NULL){
+            bufMgr->unPinPage(this->file, prevPageNum, true);
+        }
+        prevPageNum = pageNum;
+        prevPage = page;
+        pageNum = filterPage->nextPageNo;
+    }
+    if(prevPage != NULL){
+        bufMgr->unPinPage(this->file, prevPageNum, true);
+    }
+
+    PageHandle hdrPage = bufMgr->readPage(this->file, this->headerPageNum);
+    IndexMetaInfo *meta = (IndexMetaInfo*) hdrPage.get();
+    meta->keyFilterPageNo = this->keyFilterPageNum;
+    meta->keyFilterBlocks = (int) this->keyFilter.blocks();
+    meta->keyFilterHashes = this->keyFilter.hashes();
+    meta->keyFilterSaved = 1;
+    hdrPage.release(true);
+}
+
+void BTreeIndex::flushBufferLocked()
+{
+    if(this->insertBuffer.empty()){
+        return;
+    }
+    this->bufferFlushes++;
+    // the whole batch is logged as one action
+    LogAction action(bufMgr->log());
+    switch(this->attributeType){
+    case INTEGER:
+        flushBufferTyped<int>();
+        break;
+    case DOUBLE:
+        flushBufferTyped<double>();
+        break;
+    case STRING:
+        flushBufferTyped<StringKey>();
+        break;
+    case COMPOSITE:
+        flushBufferTyped<CompositeKey>();
+        break;
+    }
+    this->insertBuffer.clear();
+    this->bufferedEntries = 0;
+    if(bufMgr->log() != NULL){
+        writeMetaInfo();
+    }
+    action.commit();
+}
+
+/**
+ * Insert the buffered entries in key order, those with equal keys in the order they were inserted, so
+ * that they reach the leaves one after the other and each leaf is read and dirtied once.
+ */
+template <class T>
+void BTreeIndex::flushBufferTyped()
+{
+    std::vector<std::pair<T, size_t> > order(this->insertBuffer.size());
+    for(size_t i = 0; i < order.size(); i++){
+        order[i] = std::make_pair(KeyTraits<T>::fromPtr(this->insertBuffer[i].key), i);
+    }
+    std::sort(order.begin(), order.end());
+    for(size_t i = 0; i < order.size(); i++){
+        const BufferedInsert &entry = this->insertBuffer[order[i].second];
+        insertTyped(order[i].first, entry.rid, entry.payload);
+    }
+}
+
+/**
+ * Find the buffered entries with key, in the order they were inserted.
+ *
+ * @param key      The key to look for
+ * @param outRid   Set to the first record id with key if outRids is NULL
+ * @param outRids  If not NULL, every record id with key is appended to it
+ * @return Number of entries found
+ */
+template <class T>
+size_t BTreeIndex::lookupBuffered(const T &key, RecordId *outRid, std::vector<RecordId> *outRids)
+{
+    size_t found = 0;
+    for(size_t i = 0; i < this->insertBuffer.size(); i++){
+        if(KeyTraits<T>::fromPtr(this->insertBuffer[i].key) == key){
+            if(outRids == NULL){
+                *outRid = this->insertBuffer[i].rid;
+                return 1;
+            }
+            outRids->push_back(this->insertBuffer[i].rid);
+            found++;
+        }
+    }
+    return found;
+}
+
+template <class T>
+bool BTreeIndex::removeBuffered(const T &key, const RecordId rid)
+{
+    std::lock_guard<std::mutex> guard(this->insertBufferLatch);
+    for(size_t i = 0; i < this->insertBuffer.size(); i++){
+        if(this->insertBuffer[i].rid == rid && KeyTraits<T>::fromPtr(this->insertBuffer[i].key) == key){
+            this->insertBuffer.erase(this->insertBuffer.begin() + i);
+            this->bufferedEntries--;
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Insert a key of type T, starting over whenever a concurrent change gets in the way.
+ *
+ * @param key	The key we want to insert.
+ * @param rid	The corresponding record id of the tuple in the base relation.
+ * @param payload	Payload of the entry if the index is covering
+ **/
+template <class T>
+void BTreeIndex::insertTyped(const T &key, const RecordId rid, const char *payload)
+{
+    // the key is in the filter before a lookup can find its entry
+    if(this->keyFilter.enabled()){
+        this->keyFilter.add(KeyTraits<T>::hash(key));
+    }
+    if(!tryAppend(key, rid, payload)){
+        while(!tryInsert(key, rid, payload)){
+        }
+    }
+    this->numEntries++;
+}
+
+/**
+ * Insert a key of type T into the rightmost leaf remembered by the last insert that reached it.
+ *
+ * Keys arriving in ascending order all belong to the rightmost leaf, which is latched directly
+ * instead of descending from the root. The leaf takes the key if it is still the rightmost one, the
+ * key is not less than its low fence and it has room; a full leaf is left to tryInsert() to split,
+ * since the split needs the parent.
+ *
+ * @param key	The key we want to insert.
+ * @param rid	The corresponding record id of the tuple in the base relation.
+ * @param payload	Payload of the entry if the index is covering
+ * @return False if the key was not inserted
+ **/
+template <class T>
+bool BTreeIndex::tryAppend(const T &key, const RecordId rid, const char *payload)
+{
+    const PageId pageNum = this->rightmostLeaf;
+    if(pageNum == Page::INVALID_NUMBER){
+        return false;
+    }
+    this->latches.of(pageNum).lock();
+    if(pageNum != this->rightmostLeaf){
+        this->latches.of(pageNum).unlock();
+        return false;
+    }
+    Page *page;
+    bufMgr->readPage(this->file, pageNum, page);
+    LeafNode<T> *node = (LeafNode<T>*) page;
+    const bool fits = node->rightSibPageNo == Page::INVALID_NUMBER && !(key < node->lowFence)
+                   && LeafFormat<T>::hasRoom(node, key);
+    if(fits){
+        LeafFormat<T>::insert(node, LeafFormat<T>::upperBound(node, key), key, rid, payload);
+        this->appends++;
+    }
+    bufMgr->unPinPage(this->file, pageNum, fits);
+    this->latches.of(pageNum).unlock();
+    return fits;
+}
+
+/**
+ * Insert a key of type T after an optimistic descent.
+ *
+ * Only the leaf is latched if it has room. Otherwise the ancestors are latched from the parent
+ * up to the first one that has room for any separator, validating each against the version seen
+ * on the way down, and the splits carry up through them. If the root has to split as well, a new
+ * root is grown above it while the old root is latched. Nodes above the first one that can take a
+ * separator are unpinned during the descent, and all ancestors are unpinned once the leaf is known
+ * to have room.
+ *
+ * @param key	The key we want to insert.
+ * @param rid	The corresponding record id of the tuple in the base relation.
+ * @param payload	Payload of the entry if the index is covering
+ * @return False if a latch could not be taken at the version seen on the way down
+ **/
+template <class T>
+bool BTreeIndex::tryInsert(const T &key, const RecordId rid, const char *payload)
+{
+    PathEntry path[MAX_TREE_HEIGHT];
+    const int depth = descend(key, false, path, true);
+    if(depth == 0){
+        return false;
+    }
+
+    const int leaf = depth - 1;
+    if(!this->latches.of(path[leaf].pageNum).upgrade(path[leaf].version)){
+        releasePath(path, depth);
+        return false;
+    }
+    int top = leaf;
+    if(LeafFormat<T>::hasRoom((LeafNode<T>*) path[leaf].page, key)){
+        // the leaf will not split, its ancestors are not needed
+        releasePath(path, leaf);
+    }else{
+        while(top > 0){
+            if(!this->latches.of(path[top - 1].pageNum).upgrade(path[top - 1].version)){
+                for(int k = top; k <= leaf; k++){
+                    this->latches.of(path[k].pageNum).unlock();
+                }
+                releasePath(path, depth);
+                return false;
+            }
+            top--;
+            if(NonLeafFormat<T>::hasRoomForAny((NonLeafNode<T>*) path[top].page)){
+                break;
+            }
+        }
+    }
+
+    const bool rightmost = ((LeafNode<T>*) path[leaf].page)->rightSibPageNo == Page::INVALID_NUMBER;
+    std::pair<T, PageId> split = insertToLeafNode(key, rid, payload, path[leaf].pageNum, (LeafNode<T>*) path[leaf].page);
+    if(rightmost){
+        // the next ascending key goes straight to the rightmost leaf, a new right sibling if it split
+        this->rightmostLeaf = split.second != Page::INVALID_NUMBER ? split.second : path[leaf].pageNum;
+    }
+    for(int k = leaf - 1; k >= top && split.second != Page::INVALID_NUMBER; k--){
+        split = insertToNonLeafNode(key, split, (NonLeafNode<T>*) path[k].page);
+    }
+    if (split.second != Page::INVALID_NUMBER){ // split root page
+        PageId newRootPageNum;
+        Page* newRootPage;
+        allocNode(newRootPageNum, newRootPage);
+        NonLeafNode<T>* rootNode = (NonLeafNode<T>*) newRootPage;
+        NonLeafFormat<T>::init(rootNode, 0, this->rootPageNum);
+        NonLeafFormat<T>::insert(rootNode, 0, split.first, split.second);
+        bufMgr->unPinPage(this->file, newRootPageNum, true);
+        this->rootPageNum = newRootPageNum;
+        this->numNonLeaves++;
+        this->height++;
+        // the root moved, record it on the meta page
+        writeMetaInfo();
+    }
+
+    // nodes are unpinned before they are unlatched, so that the changes a write-ahead log takes
+    // from them at unpin are this insert's alone
+    for(int k = 0; k < depth; k++){
+        if(path[k].page == NULL){
+            continue;
+        }
+        if(path[k].pinned){
+            bufMgr->unPinPage(this->file, path[k].pageNum, k >= top);
+        }else if(k >= top){
+            // a cached node holds no pin of this insert to carry the dirty bit
+            Page *page;
+            bufMgr->readPage(this->file, path[k].pageNum, page);
+            bufMgr->unPinPage(this->file, path[k].pageNum, true);
+        }
+    }
+    for(int k = top; k < depth; k++){
+        if(path[k].page != NULL){
+            this->latches.of(path[k].pageNum).unlock();
+        }
+    }
+    return true;
+}
+
+/**
+ * Allocate a page for a node. Pages released by merges are reused before the file is extended.
+ * The page is returned pinned, with undefined contents.
+ *
+ * @param pageNum  Set to the page number of the node
+ * @param page     Set to the pinned page
+ */
+void BTreeIndex::allocNode(PageId &pageNum, Page *&page)
+{
+    std::lock_guard<std::mutex> guard(this->allocLatch);
+    if(this->freePageNum == Page::INVALID_NUMBER){
+        bufMgr->allocPage(this->file, pageNum, page);
+        return;
+    }
+    pageNum = this->freePageNum;
+    bufMgr->readPage(this->file, pageNum, page);
+    // a free page starts with the number of the next free page
+    memcpy(&this->freePageNum, (const char*) page, sizeof(PageId));
+}
+
+/**
+ * Push a node that is no longer referenced onto the free list and unpin it. The caller bumps the
+ * version of its latch first, so that readers still on the node start over.
+ *
+ * @param pageNum  Page number of the node
+ * @param page     The node's pinned page
+ */
+void BTreeIndex::freeNode(PageId pageNum, Page *page)
+{
+    std::lock_guard<std::mutex> guard(this->allocLatch);
+    memcpy((char*) page, &this->freePageNum, sizeof(PageId));
+    this->freePageNum = pageNum;
+    bufMgr->unPinPage(this->file, pageNum, true);
+}
+
+/**
+ * Delete the entry with the pair <key, rid>, merging nodes that fall below MERGE_THRESHOLD of
+ * their occupancy with a neighbour.
+ *
+ * @param key	A pointer to the value (integer, double or string) of the entry.
+ * @param rid	The record id of the entry.
+ * @throws NoSuchKeyFoundException If the index has no such entry.
+ **/
+const void BTreeIndex::deleteEntry(const void *key, const RecordId rid)
+{
+    if(this->readOnly){
+        throw ReadOnlyIndexException(this->file->filename());
+    }
+    LogAction action(bufMgr->log());
+    switch(this->attributeType){
+    case INTEGER:
+        deleteTyped(KeyTraits<int>::fromPtr(key), rid);
+        break;
+    case DOUBLE:
+        deleteTyped(KeyTraits<double>::fromPtr(key), rid);
+        break;
+    case STRING:
+        deleteTyped(KeyTraits<StringKey>::fromPtr(key), rid);
+        break;
+    case COMPOSITE:
+        deleteTyped(KeyTraits<CompositeKey>::fromPtr(key), rid);
+        break;
+    }
+    if(bufMgr->log() != NULL){
+        writeMetaInfo();
+    }
+    action.commit();
+}
+
+/**
+ * Remove the entry (key, rid) and shrink the tree while the root is a non-leaf node with a single
+ * non-leaf child.
+ *
+ * Deletes latch the root for their whole run and every node below it they visit, so they do not
+ * overlap one another. Inserts only try latches and start over, and readers validate, so neither
+ * can hold up a delete.
+ *
+ * @param key  Key of the entry
+ * @param rid  Record id of the entry
+ * @throws NoSuchKeyFoundException If the index has no such entry.
+ */
+template <class T>
+void BTreeIndex::deleteTyped(const T &key, const RecordId rid)
+{
+    if(this->bufferedEntries > 0 && removeBuffered(key, rid)){
+        return;
+    }
+    // a root split may move the root before its latch is taken
+    PageId rootPageNum = this->rootPageNum;
+    this->latches.of(rootPageNum).lock();
+    while(rootPageNum != this->rootPageNum){
+        this->latches.of(rootPageNum).unlock();
+        rootPageNum = this->rootPageNum;
+        this->latches.of(rootPageNum).lock();
+    }
+
+    bool underfull;
+    if(!deleteFromNonLeafNode(key, rid, rootPageNum, underfull)){
+        this->latches.of(rootPageNum).unlock();
+        throw NoSuchKeyFoundException();
+    }
+    this->numEntries--;
+
+    bool rootChanged = false;
+    while(true){
+        Page *rootPage;
+        bufMgr->readPage(this->file, rootPageNum, rootPage);
+        NonLeafNode<T> *root = (NonLeafNode<T>*) rootPage;
+        // the root stays a non-leaf node, so a root over the leaves is kept even with one child
+        if(root->numKeys > 0 || root->level == 1){
+            bufMgr->unPinPage(this->file, rootPageNum, false);
+            break;
+        }
+        const PageId oldRootPageNum = rootPageNum;
+        rootPageNum = NonLeafFormat<T>::child(root, 0);
+        this->latches.of(rootPageNum).lock();
+        this->rootPageNum = rootPageNum;
+        this->numNonLeaves--;
+        this->height--;
+        this->latches.of(oldRootPageNum).unlock();
+        freeNode(oldRootPageNum, rootPage);
+        rootChanged = true;
+    }
+    this->latches.of(rootPageNum).unlock();
+    if(rootChanged){
+        writeMetaInfo();
+    }
+}
+
+/**
+ * Remove the entry (key, rid) from a leaf.
+ *
+ * @param key        Key of the entry
+ * @param rid        Record id of the entry
+ * @param pageNum    Page number of the leaf, latched by the caller
+ * @param underfull  Set to whether the leaf dropped below MERGE_THRESHOLD of its occupancy
+ * @return True if the entry was found
+ */
+template <class T>
+const bool BTreeIndex::deleteFromLeafNode(const T &key, const RecordId rid, PageId pageNum, bool &underfull)
+{
+    Page *page;
+    bufMgr->readPage(this->file, pageNum, page);
+    LeafNode<T> *node = (LeafNode<T>*) page;
+    // entries with equal keys are adjacent, look for the record id among them
+    for(int i = LeafFormat<T>::lowerBound(node, key); i < node->numKeys && LeafFormat<T>::key(node, i) == key; i++){
+        if(LeafFormat<T>::rid(node, i) == rid){
+            LeafFormat<T>::remove(node, i);
+            underfull = node->numKeys < this->leafOccupancy * MERGE_THRESHOLD;
+            bufMgr->unPinPage(this->file, pageNum, true);
+            return true;
+        }
+    }
+    bufMgr->unPinPage(this->file, pageNum, false);
+    return false;
+}
+
+/**
+ * Remove the entry (key, rid) from the subtree rooted at a non-leaf node, merging a child that
+ * became underfull with one of its neighbours.
+ *
+ * @param key        Key of the entry
+ * @param rid        Record id of the entry
+ * @param pageNum    Page number of the node, latched by the caller
+ * @param underfull  Set to whether the node dropped below MERGE_THRESHOLD of its occupancy
+ * @return True if the entry was found
+ */
+template <class T>
+const bool BTreeIndex::deleteFromNonLeafNode(const T &key, const RecordId rid, PageId pageNum, bool &underfull)
+{
+    Page *page;
+    bufMgr->readPage(this->file, pageNum, page, true);
+    NonLeafNode<T> *node = (NonLeafNode<T>*) page;
+    // duplicates of key may span every child from the first separator not less than key up to the
+    // child a descent would pick
+    const int last = NonLeafFormat<T>::upperBound(node, key);
+    for(int i = NonLeafFormat<T>::lowerBound(node, key); i <= last; i++){
+        const PageId childPageNum = NonLeafFormat<T>::child(node, i);
+        bool childUnderfull = false;
+        this->latches.of(childPageNum).lock();
+        const bool found = node->level == 1 ? deleteFromLeafNode(key, rid, childPageNum, childUnderfull)
+                                            : deleteFromNonLeafNode(key, rid, childPageNum, childUnderfull);
+        this->latches.of(childPageNum).unlock();
+        if(found){
+            const bool merged = childUnderfull && mergeChildren(node, i);
+            underfull = node->numKeys < this->nodeOccupancy * MERGE_THRESHOLD;
+            bufMgr->unPinPage(this->file, pageNum, merged);
+            return true;
+        }
+    }
+    bufMgr->unPinPage(this->file, pageNum, false);
+    return false;
+}
+
+/**
+ * Merge child i of node with its right neighbour, or with its left one if it is the last child.
+ * Nothing changes if the two do not fit in one node; entries are not redistributed.
+ *
+ * @param node  Pinned and latched parent of the children
+ * @param i     Index of the underfull child
+ * @return True if the children were merged, which removes a separator from node
+ */
+template <class T>
+const bool BTreeIndex::mergeChildren(NonLeafNode<T> *node, const int i)
+{
+    const int left = i < node->numKeys ? i : i - 1;
+    if(left < 0){ // only child
+        return false;
+    }
+    const PageId leftPageNum = NonLeafFormat<T>::child(node, left);
+    const PageId rightPageNum = NonLeafFormat<T>::child(node, left + 1);
+    Page *leftPage, *rightPage;
+    this->latches.of(leftPageNum).lock();
+    this->latches.of(rightPageNum).lock();
+    bufMgr->readPage(this->file, leftPageNum, leftPage);
+    bufMgr->readPage(this->file, rightPageNum, rightPage);
+
+    bool merged;
+    if(node->level == 1){
+        LeafNode<T> *leftLeaf = (LeafNode<T>*) leftPage;
+        LeafNode<T> *rightLeaf = (LeafNode<T>*) rightPage;
+        merged = LeafFormat<T>::merge(leftLeaf, rightLeaf);
+        if(merged){
+            leftLeaf->rightSibPageNo = rightLeaf->rightSibPageNo;
+            leftLeaf->highFence = rightLeaf->highFence;
+            setLeftSibling<T>(leftLeaf->rightSibPageNo, leftPageNum);
+            this->numLeaves--;
+            // a merged rightmost leaf hands the role to its left neighbour before it is freed
+            PageId rightmost = rightPageNum;
+            this->rightmostLeaf.compare_exchange_strong(rightmost, leftPageNum);
+        }
+    }else{
+        merged = NonLeafFormat<T>::merge((NonLeafNode<T>*) leftPage, NonLeafFormat<T>::key(node, left),
+                                         (NonLeafNode<T>*) rightPage);
+        if(merged){
+            this->numNonLeaves--;
+        }
+    }
+    if(merged){
+        this->merges++;
+    }
+
+    bufMgr->unPinPage(this->file, leftPageNum, merged);
+    this->latches.of(leftPageNum).unlock();
+    this->latches.of(rightPageNum).unlock();
+    if(merged){
+        freeNode(rightPageNum, rightPage);
+        NonLeafFormat<T>::remove(node, left);
+    }else{
+        bufMgr->unPinPage(this->file, rightPageNum, false);
+    }
+    return merged;
+}
+
+/**
+ * Counters of the shape of the tree, read without any latch; counters changed by a running insert or
+ * delete may or may not be included.
+ *
+ * @return Height, node and entry counts, split and merge counts and average leaf fill
+ */
+IndexStats BTreeIndex::getStats() const
+{
+    IndexStats stats;
+    stats.height = this->height;
+    stats.numEntries = this->numEntries;
+    stats.numLeaves = this->numLeaves;
+    stats.numNonLeaves = this->numNonLeaves;
+    stats.leafSplits = this->leafSplits;
+    stats.nonLeafSplits = this->nonLeafSplits;
+    stats.merges = this->merges;
+    stats.appends = this->appends;
+    stats.bufferedEntries = this->bufferedEntries;
+    stats.bufferFlushes = this->bufferFlushes;
+    stats.leafModelKnots = (int) this->leafModel.knots();
+    stats.leafModelBytes = (int) this->leafModel.bytes();
+    stats.leafFill = stats.numLeaves > 0 ? (double) stats.numEntries / ((double) stats.numLeaves * this->leafOccupancy) : 0;
+    return stats;
+}
+
+/**
+ * Walk the tree level by level from the root, reading every node once, then follow the free list.
+ *
+ * @param shape  Set to the nodes and keys of each level and the number of free pages
+ */
+void BTreeIndex::inspect(IndexShape &shape)
+{
+    switch(this->attributeType){
+    case INTEGER:
+        inspectTyped<int>(shape);
+        break;
+    case DOUBLE:
+        inspectTyped<double>(shape);
+        break;
+    case STRING:
+        inspectTyped<StringKey>(shape);
+        break;
+    case COMPOSITE:
+        inspectTyped<CompositeKey>(shape);
+        break;
+    }
+}
+
+template <class T>
+void BTreeIndex::inspectTyped(IndexShape &shape)
+{
+    shape.levels.clear();
+    shape.leafJumps = 0;
+    std::vector<PageId> nodes(1, (PageId) this->rootPageNum);
+    bool leaves = false;
+    while(!nodes.empty()){
+        IndexLevelShape level;
+        level.nodes = (int) nodes.size();
+        level.keys = 0;
+        level.minKeys = INT_MAX;
+        level.maxKeys = 0;
+        std::vector<PageId> children;
+        bool leafChildren = false;
+        for(size_t i = 0; i < nodes.size(); i++){
+            Page *page;
+            readNode(nodes[i], page);
+            int keys;
+            if(leaves){
+                const LeafNode<T> *leaf = (LeafNode<T>*) page;
+                keys = LeafFormat<T>::count(leaf);
+                shape.leafJumps += leaf->rightSibPageNo != Page::INVALID_NUMBER && leaf->rightSibPageNo != nodes[i] + 1;
+            }else{
+                const NonLeafNode<T> *node = (NonLeafNode<T>*) page;
+                keys = node->numKeys;
+                leafChildren = node->level == 1;
+                for(int j = 0; j <= keys; j++){
+                    children.push_back(NonLeafFormat<T>::child(node, j));
+                }
+            }
+            releaseNode(nodes[i]);
+            level.keys += keys;
+            level.minKeys = std::min(level.minKeys, keys);
+            level.maxKeys = std::max(level.maxKeys, keys);
+        }
+        level.fill = (double) level.keys / ((double) level.nodes * (leaves ? this->leafOccupancy : this->nodeOccupancy));
+        shape.levels.push_back(level);
+        if(leaves){
+            break;
+        }
+        nodes.swap(children);
+        leaves = leafChildren;
+    }
+
+    shape.freePages = 0;
+    std::lock_guard<std::mutex> guard(this->allocLatch);
+    for(PageId pageNum = this->freePageNum; pageNum != Page::INVALID_NUMBER; shape.freePages++){
+        Page *page;
+        readNode(pageNum, page);
+        const PageId freePageNum = pageNum;
+        memcpy(&pageNum, (const char*) page, sizeof(PageId));
+        releaseNode(freePageNum);
+    }
+}
+
+bool BTreeIndex::defragment(const double fillFactor)
+{
+    if(this->readOnly){
+        throw ReadOnlyIndexException(this->file->filename());
+    }
+    if(!(fillFactor > 0 && fillFactor <= 1)){
+        throw BadIndexInfoException("Fill factor must be in (0, 1]!");
+    }
+    if(this->payloadLen > 0){
+        return false;
+    }
+    flushInsertBuffer();
+    // the new tree, the freed old one and the meta page naming the new root are logged as one action
+    LogAction action(bufMgr->log());
+    switch(this->attributeType){
+    case INTEGER:
+        defragmentTyped<int>(fillFactor);
+        break;
+    case DOUBLE:
+        defragmentTyped<double>(fillFactor);
+        break;
+    case STRING:
+        defragmentTyped<StringKey>(fillFactor);
+        break;
+    case COMPOSITE:
+        defragmentTyped<CompositeKey>(fillFactor);
+        break;
+    }
+    writeMetaInfo();
+    action.commit();
+    return true;
+}
+
+/**
+ * Read the entries of the leaves in key order into an ExternalSort, walking the tree level by level like
+ * inspectTyped(), and note every node on the way. The new tree is loaded with the free list set aside,
+ * so that its pages are taken from the end of the file in the order bulkLoad() writes them: the leaves
+ * left to right, then each non-leaf level. Old nodes are freed last to first, so the first of them is
+ * reused first.
+ */
+template <class T>
+void BTreeIndex::defragmentTyped(const double fillFactor)
+{
+    const PageId oldRootPageNum = this->rootPageNum;
+    ExternalSort<RIDKeyPair<T> > entries(bufMgr, this->file->filename(), sortMemory);
+    std::vector<PageId> oldNodes;
+    std::vector<PageId> nodes(1, oldRootPageNum);
+    bool leaves = false;
+    while(!nodes.empty()){
+        std::vector<PageId> children;
+        bool leafChildren = false;
+        for(size_t i = 0; i < nodes.size(); i++){
+            oldNodes.push_back(nodes[i]);
+            Page *page;
+            readNode(nodes[i], page);
+            if(leaves){
+                const LeafNode<T> *leaf = (LeafNode<T>*) page;
+                const int count = LeafFormat<T>::count(leaf);
+                RIDKeyPair<T> entry;
+                for(int j = 0; j < count; j++){
+                    entry.set(LeafFormat<T>::rid(leaf, j), LeafFormat<T>::key(leaf, j));
+                    entries.add(entry);
+                }
+            }else{
+                const NonLeafNode<T> *node = (NonLeafNode<T>*) page;
+                leafChildren = node->level == 1;
+                for(int j = 0; j <= node->numKeys; j++){
+                    children.push_back(NonLeafFormat<T>::child(node, j));
+                }
+            }
+            releaseNode(nodes[i]);
+        }
+        if(leaves){
+            break;
+        }
+        nodes.swap(children);
+        leaves = leafChildren;
+    }
+
+    PageId freePageNum;
+    {
+        std::lock_guard<std::mutex> guard(this->allocLatch);
+        freePageNum = this->freePageNum;
+        this->freePageNum = Page::INVALID_NUMBER;
+    }
+    entries.finish();
+    const PageId newRootPageNum = bulkLoad(entries, fillFactor);
+    {
+        std::lock_guard<std::mutex> guard(this->allocLatch);
+        this->freePageNum = freePageNum;
+    }
+
+    // every old node is latched before any is freed: a reader that read a node's child or sibling
+    // before the latches were taken then fails to validate the node, rather than trusting a freed page
+    for(size_t i = 0; i < oldNodes.size(); i++){
+        this->latches.of(oldNodes[i]).lock();
+    }
+    this->rootPageNum = newRootPageNum;
+    this->rightmostLeaf = Page::INVALID_NUMBER;
+
+    for(size_t i = oldNodes.size(); i-- > 0;){
+        Page *page;
+        bufMgr->readPage(this->file, oldNodes[i], page);
+        freeNode(oldNodes[i], page);
+        this->latches.of(oldNodes[i]).unlock();
+    }
+}
+
+/**
+ * IndexCursor Constructor. The cursor is not positioned until BTreeIndex::startScan() is called on it.
+ */
+IndexCursor::IndexCursor()
+    : index(NULL), scanExecuting(false), descending(false), readAheadWindow(1), readAheadLeft(0), nextEntry(-1), currentPageNum(Page::INVALID_NUMBER),
+      currentPageData(NULL), leafVersion(0), resumeDups(-1), lowValInt(INT_MIN), lowValDouble(0), highValInt(INT_MAX), highValDouble(0),
+      lowOp(EMPTY), highOp(EMPTY)
+{
+}
+
+/**
+ * IndexCursor Destructor. Ends a scan that is still running, so its leaf is unpinned.
+ */
+IndexCursor::~IndexCursor()
+{
+    if(this->scanExecuting && this->index != NULL){
+        try{
+            this->index->endScan(*this);
+        }catch(...){
+        }
+    }
+}
+
+/**
+ * Bounds of the scan for INTEGER keys.
+ */
+template <>
+void IndexCursor::bounds<int>(int &low, int &high) const
+{
+    low = this->lowValInt;
+    high = this->highValInt;
+}
+
+/**
+ * Bounds of the scan for DOUBLE keys.
+ */
+template <>
+void IndexCursor::bounds<double>(double &low, double &high) const
+{
+    low = this->lowValDouble;
+    high = this->highValDouble;
+}
+
+/**
+ * Bounds of the scan for STRING keys.
+ */
+template <>
+void IndexCursor::bounds<StringKey>(StringKey &low, StringKey &high) const
+{
+    memcpy(low.data, this->lowValString.data(), STRINGSIZE);
+    memcpy(high.data, this->highValString.data(), STRINGSIZE);
+}
+
+/**
+ * Bounds of the scan for COMPOSITE keys, kept like those of STRING keys.
+ */
+template <>
+void IndexCursor::bounds<CompositeKey>(CompositeKey &low, CompositeKey &high) const
+{
+    memcpy(low.data, this->lowValString.data(), COMPOSITEKEYSIZE);
+    memcpy(high.data, this->highValString.data(), COMPOSITEKEYSIZE);
+}
+
+/**
+ * Helper function for starting the scan 
+ * 
+ * Position the cursor on the first entry of the scan and keep only its leaf pinned in the buffer pool.
+ * 
+ * @param cursor: Cursor of the scan, positioned on the leaf found
+ * @throws  NoSuchKeyFoundException If there is no key in the B+ tree that satisfies the scan criteria.
+ */
+template <class T>
+void BTreeIndex::startScanHelper(IndexCursor &cursor){
+    cursor.resumeDups = -1;
+    T lowVal, highVal;
+    cursor.bounds(lowVal, highVal);
+    while(!positionCursor<T>(cursor)){
+    }
+    while(true){
+        const LeafNode<T> *leaf = (LeafNode<T>*) cursor.currentPageData;
+        const int pos = cursor.nextEntry;
+        bool atEnd;
+        if(pos < 0 || pos >= LeafFormat<T>::count(leaf)){
+            // the bound is past the end of the leaf; the scan starts in the next one unless the fence
+            // of this leaf shows that no leaf further on holds entries of the scan
+            if(!lastLeafOfScan<T>(cursor, leaf)){
+                if(!(cursor.descending ? moveLeft<T>(cursor) : moveRight<T>(cursor))){
+                    repositionCursor<T>(cursor);
+                }
+                continue;
+            }
+            atEnd = true;
+        }else if(cursor.descending){
+            // the greatest key at or below the high bound is below the low bound
+            const T key = LeafFormat<T>::key(leaf, pos);
+            atEnd = cursor.lowOp == GT ? !(key > lowVal) : key < lowVal;
+        }else{
+            // the least key at or above the low bound is above the high bound
+            const T key = LeafFormat<T>::key(leaf, pos);
+            atEnd = cursor.highOp == LT ? !(key < highVal) : key > highVal;
+        }
+        if(this->latches.of(cursor.currentPageNum).validate(cursor.leafVersion)){
+            if(atEnd){
+                // if reach the end and not found
+                this->endScan(cursor);
+                throw NoSuchKeyFoundException();
+            }
+            return;
+        }
+        repositionCursor<T>(cursor);
+    }
+}
+
+/**
+ * Descend to the leaf the scan of cursor goes on in and find the entry it goes on at.
+ *
+ * A scan that has not returned anything yet looks for its low bound: with GTE in the leftmost leaf that
+ * can hold it, since its duplicates may span several leaves, and with GT in the rightmost one, past
+ * them all. Otherwise it looks for the first entry not less than the last key it returned, in the
+ * leftmost leaf that can hold it, and skips the duplicates of that key it returned already, following
+ * right siblings if they span several leaves.
+ *
+ * @param cursor  Cursor whose current leaf is set; its previous leaf must be unpinned
+ * @return False if a concurrent change forced a restart, with nothing pinned
+ */
+template <class T>
+bool BTreeIndex::positionCursor(IndexCursor &cursor)
+{
+    if(cursor.descending){
+        return positionCursorDescending<T>(cursor);
+    }
+    T lowVal, highVal;
+    cursor.bounds(lowVal, highVal);
+    const bool resume = cursor.resumeDups >= 0;
+    T key = lowVal;
+    if(resume){
+        memcpy(&key, cursor.resumeKey, sizeof(T));
+    }
+
+    PathEntry path[MAX_TREE_HEIGHT];
+    const int depth = descend(key, resume || cursor.lowOp != GT, path, false);
+    if(depth == 0){
+        return false;
+    }
+    cursor.currentPageNum = path[depth - 1].pageNum;
+    cursor.currentPageData = path[depth - 1].page;
+    cursor.leafVersion = path[depth - 1].version;
+
+    LeafNode<T>* leaf = (LeafNode<T>*) cursor.currentPageData;
+    // find the first entry satisfying the low bound
+    int pos = (!resume && cursor.lowOp == GT) ? LeafFormat<T>::upperBound(leaf, key)
+                                              : LeafFormat<T>::lowerBound(leaf, key);
+    int skip = resume ? cursor.resumeDups : 0;
+    while(true){
+        const int count = LeafFormat<T>::count(leaf);
+        while(skip > 0 && pos < count && LeafFormat<T>::key(leaf, pos) == key){
+            pos++;
+            skip--;
+        }
+        // with nothing left to skip, or a greater key reached, the scan goes on here; if returned
+        // duplicates were deleted meanwhile fewer are skipped
+        if(!resume || skip == 0 || pos < count || leaf->rightSibPageNo == Page::INVALID_NUMBER){
+            break;
+        }
+        if(!moveRight<T>(cursor)){
+            releaseNode(cursor.currentPageNum);
+            return false;
+        }
+        leaf = (LeafNode<T>*) cursor.currentPageData;
+        pos = 0;
+    }
+    const PageId nextLeafPageNum = lastLeafOfScan<T>(cursor, leaf) ? Page::INVALID_NUMBER : leaf->rightSibPageNo;
+    if(!this->latches.of(cursor.currentPageNum).validate(cursor.leafVersion)){
+        releaseNode(cursor.currentPageNum);
+        return false;
+    }
+    cursor.nextEntry = pos;
+    // read the next leaves in the background while this one is scanned
+    readAheadLeaves<T>(cursor, nextLeafPageNum, true);
+    return true;
+}
+
+/**
+ * Descend to the leaf a descending scan goes on in and find the entry it goes on at.
+ *
+ * A scan that has not returned anything yet looks for the last entry below its high bound. Otherwise
+ * it looks for the last entry not greater than the last key it returned, in the rightmost leaf that
+ * can hold it, and skips the duplicates of that key it returned already, following left siblings if
+ * they span several leaves. The entry found may be before the first one of its leaf; the scan then
+ * goes on in the left sibling.
+ *
+ * @param cursor  Cursor whose current leaf is set; its previous leaf must be unpinned
+ * @return False if a concurrent change forced a restart, with nothing pinned
+ */
+template <class T>
+bool BTreeIndex::positionCursorDescending(IndexCursor &cursor)
+{
+    T lowVal, highVal;
+    cursor.bounds(lowVal, highVal);
+    const bool resume = cursor.resumeDups >= 0;
+    T key = highVal;
+    if(resume){
+        memcpy(&key, cursor.resumeKey, sizeof(T));
+    }
+
+    // entries less than an LT bound end in the first leaf that can hold it, other entries not
+    // greater than key in the last one
+    const bool lower = !resume && cursor.highOp == LT;
+    PathEntry path[MAX_TREE_HEIGHT];
+    const int depth = descend(key, lower, path, false);
+    if(depth == 0){
+        return false;
+    }
+    cursor.currentPageNum = path[depth - 1].pageNum;
+    cursor.currentPageData = path[depth - 1].page;
+    cursor.leafVersion = path[depth - 1].version;
+
+    LeafNode<T>* leaf = (LeafNode<T>*) cursor.currentPageData;
+    int pos = (lower ? LeafFormat<T>::lowerBound(leaf, key) : LeafFormat<T>::upperBound(leaf, key)) - 1;
+    int skip = resume ? cursor.resumeDups : 0;
+    while(true){
+        while(skip > 0 && pos >= 0 && LeafFormat<T>::key(leaf, pos) == key){
+            pos--;
+            skip--;
+        }
+        if(!resume || skip == 0 || pos >= 0 || leaf->leftSibPageNo == Page::INVALID_NUMBER){
+            break;
+        }
+        if(!moveLeft<T>(cursor)){
+            releaseNode(cursor.currentPageNum);
+            return false;
+        }
+        leaf = (LeafNode<T>*) cursor.currentPageData;
+        pos = cursor.nextEntry;
+    }
+    const PageId nextLeafPageNum = lastLeafOfScan<T>(cursor, leaf) ? Page::INVALID_NUMBER : leaf->leftSibPageNo;
+    if(!this->latches.of(cursor.currentPageNum).validate(cursor.leafVersion)){
+        releaseNode(cursor.currentPageNum);
+        return false;
+    }
+    cursor.nextEntry = pos;
+    // read the next leaves in the background while this one is scanned
+    readAheadLeaves<T>(cursor, nextLeafPageNum, true);
+    return true;
+}
+
+/**
+ * Position cursor again after its current leaf changed under it.
+ */
+template <class T>
+void BTreeIndex::repositionCursor(IndexCursor &cursor)
+{
+    Tracer::countRestart();
+    releaseNode(cursor.currentPageNum);
+    while(!positionCursor<T>(cursor)){
+    }
+}
+
+/**
+ * Move cursor to the right sibling of its current leaf, which must have one. The sibling page
+ * number is validated against the version of the current leaf before it is followed.
+ *
+ * @return False if the current leaf changed, with the cursor left on it
+ */
+template <class T>
+bool BTreeIndex::moveRight(IndexCursor &cursor)
+{
+    const PageId siblingPageNum = ((LeafNode<T>*) cursor.currentPageData)->rightSibPageNo;
+    const std::uint64_t siblingVersion = this->latches.of(siblingPageNum).readLock();
+    if(!this->latches.of(cursor.currentPageNum).validate(cursor.leafVersion)){
+        return false;
+    }
+    Page *siblingPage;
+    readNode(siblingPageNum, siblingPage);
+    releaseNode(cursor.currentPageNum);
+    cursor.currentPageNum = siblingPageNum;
+    cursor.currentPageData = siblingPage;
+    cursor.leafVersion = siblingVersion;
+    cursor.nextEntry = 0;
+    LeafFormat<T>::prefetch((LeafNode<T>*) siblingPage, 0);
+
+    // read the leaves after it in the background, once its page number is known to be valid
+    const LeafNode<T> *sibling = (LeafNode<T>*) siblingPage;
+    const PageId nextLeafPageNum = lastLeafOfScan<T>(cursor, sibling) ? Page::INVALID_NUMBER : sibling->rightSibPageNo;
+    if(this->latches.of(siblingPageNum).validate(siblingVersion)){
+        readAheadLeaves<T>(cursor, nextLeafPageNum, false);
+    }
+    return true;
+}
+
+/**
+ * Move cursor to the left sibling of its current leaf, which must have one. The sibling page number
+ * is validated against the version of the current leaf before it is followed, and the number of
+ * entries of the sibling against its own version before the cursor is put on its last entry.
+ *
+ * @return False if either leaf changed, with the cursor left on the current one
+ */
+template <class T>
+bool BTreeIndex::moveLeft(IndexCursor &cursor)
+{
+    const PageId siblingPageNum = ((LeafNode<T>*) cursor.currentPageData)->leftSibPageNo;
+    const std::uint64_t siblingVersion = this->latches.of(siblingPageNum).readLock();
+    if(!this->latches.of(cursor.currentPageNum).validate(cursor.leafVersion)){
+        return false;
+    }
+    Page *siblingPage;
+    readNode(siblingPageNum, siblingPage);
+    const int count = LeafFormat<T>::count((LeafNode<T>*) siblingPage);
+    const LeafNode<T> *sibling = (LeafNode<T>*) siblingPage;
+    const PageId nextLeafPageNum = lastLeafOfScan<T>(cursor, sibling) ? Page::INVALID_NUMBER : sibling->leftSibPageNo;
+    if(!this->latches.of(siblingPageNum).validate(siblingVersion)){
+        releaseNode(siblingPageNum);
+        return false;
+    }
+    releaseNode(cursor.currentPageNum);
+    cursor.currentPageNum = siblingPageNum;
+    cursor.currentPageData = siblingPage;
+    cursor.leafVersion = siblingVersion;
+    cursor.nextEntry = count - 1;
+    LeafFormat<T>::prefetch((LeafNode<T>*) siblingPage, count - 1);
+
+    // read the leaves before it in the background
+    readAheadLeaves<T>(cursor, nextLeafPageNum, false);
+    return true;
+}
+
+/**
+ * Keys of the leaves right of leaf are not less than its high fence, and keys of the leaves left of
+ * it not greater than its low fence.
+ */
+template <class T>
+bool BTreeIndex::lastLeafOfScan(const IndexCursor &cursor, const LeafNode<T> *leaf)
+{
+    T lowVal, highVal;
+    cursor.bounds(lowVal, highVal);
+    if(cursor.descending){
+        return leaf->leftSibPageNo == Page::INVALID_NUMBER
+            || (cursor.lowOp == GT ? !(leaf->lowFence > lowVal) : leaf->lowFence < lowVal);
+    }
+    return leaf->rightSibPageNo == Page::INVALID_NUMBER
+        || (cursor.highOp == LT ? !(leaf->highFence < highVal) : leaf->highFence > highVal);
+}
+
+/**
+ * Ask the buffer manager to read the leaves the scan of cursor goes on to in the background,
+ * following their sibling pointers. The window of leaves read ahead starts at one leaf when the
+ * cursor is positioned and doubles up to scanReadAhead leaves as the scan moves on, so short scans
+ * do not read leaves they never reach; a new window is asked for once half of the last one was
+ * scanned.
+ *
+ * @param nextLeafPageNum  The leaf after the current one in the direction of the scan
+ * @param positioned       The cursor was just positioned from the root
+ */
+template <class T>
+void BTreeIndex::readAheadLeaves(IndexCursor &cursor, const PageId nextLeafPageNum, const bool positioned)
+{
+    if(this->mapped){
+        return;
+    }
+    if(positioned){
+        cursor.readAheadWindow = 1;
+        cursor.readAheadLeft = 0;
+    }
+    if(--cursor.readAheadLeft > 0){
+        return;
+    }
+    this->bufMgr->prefetchPages(this->file, nextLeafPageNum, cursor.readAheadWindow,
+                                cursor.descending ? leftSiblingOf<T> : rightSiblingOf<T>);
+    cursor.readAheadLeft = std::max(cursor.readAheadWindow / 2, 1);
+    cursor.readAheadWindow = std::max(std::min(2 * cursor.readAheadWindow, this->scanReadAhead.load()), 1);
+}
+
+void BTreeIndex::setScanReadAhead(const int leaves)
+{
+    this->scanReadAhead = std::max(std::min(leaves, (int) MAX_SCAN_READ_AHEAD), 1);
+}
+
+/**
+ * Find the first entry with key.
+ *
+ * @param key     Pointer to the key to look for
+ * @param outRid  Set to the record id of the entry if one is found
+ * @return True if the index holds an entry with key
+ */
+const bool BTreeIndex::lookup(const void *key, RecordId &outRid)
+{
+    TraceScope trace(TRACE_LOOKUP, this->file->filename());
+    size_t found = 0;
+    switch(this->attributeType){
+    case INTEGER:
+        found = lookupTyped(KeyTraits<int>::fromPtr(key), &outRid, NULL);
+        break;
+    case DOUBLE:
+        found = lookupTyped(KeyTraits<double>::fromPtr(key), &outRid, NULL);
+        break;
+    case STRING:
+        found = lookupTyped(KeyTraits<StringKey>::fromPtr(key), &outRid, NULL);
+        break;
+    case COMPOSITE:
+        found = lookupTyped(KeyTraits<CompositeKey>::fromPtr(key), &outRid, NULL);
+        break;
+    }
+    trace.addEntries(found);
+    return found > 0;
+}
+
 /**
- * BTreeIndex Constructor. 
- * Check to see if the corresponding index file exists. If so, open the file.
- * If not, create it and insert entries for every tuple in the base relation using FileScan class.
+ * Find every entry with key.
  *
- * @param relationName        Name of file.
- * @param outIndexName        Return the name of index file.
- * @param bufMgrIn			  Buffer Manager Instance
- * @param attrByteOffset	  Offset of attribute, over which index is to be built, in the record
- * @param attrType			  Datatype of attribute over which index is built
- * @throws  BadIndexInfoException     If the index file already exists for the corresponding attribute, 
- * but values in metapage(relationName, attribute byte offset, attribute type etc.) do not match with 
- * values received through constructor parameters.
+ * @param key      Pointer to the key to look for
+ * @param outRids  The record ids of the entries are appended to this
+ * @return Number of entries found
  */
-BTreeIndex::BTreeIndex(const std::string &relationName,
-                       std::string &outIndexName,
-                       BufMgr *bufMgrIn,
-                       const int attrByteOffset,
-                       const Datatype attrType)
+const size_t BTreeIndex::lookupAll(const void *key, std::vector<RecordId> &outRids)
 {
-    // update variables
-    this->attributeType = attrType;
-    this->attrByteOffset = attrByteOffset; 
-    this->bufMgr = bufMgrIn;
-    this->scanExecuting = false; // updated when start and end scanning
+    TraceScope trace(TRACE_LOOKUP, this->file->filename());
+    size_t found = 0;
+    switch(this->attributeType){
+    case INTEGER:
+        found = lookupTyped(KeyTraits<int>::fromPtr(key), NULL, &outRids);
+        break;
+    case DOUBLE:
+        found = lookupTyped(KeyTraits<double>::fromPtr(key), NULL, &outRids);
+        break;
+    case STRING:
+        found = lookupTyped(KeyTraits<StringKey>::fromPtr(key), NULL, &outRids);
+        break;
+    case COMPOSITE:
+        found = lookupTyped(KeyTraits<CompositeKey>::fromPtr(key), NULL, &outRids);
+        break;
+    }
+    trace.addEntries(found);
+    return found;
+}
 
-    Page *hdrPage, *rootPage, *leafPage; 
-    std::ostringstream idxStr;
-    idxStr << relationName << '.' << attrByteOffset;
-    std::string indexName = idxStr.str(); // indexName is the name of the index file 
-    outIndexName = indexName;
-    
-    // If the index file already exists, open the file 
-    try{
-        this->file = new BlobFile(indexName, false);
-        this->headerPageNum = file->getFirstPageNo();
-        // read the first metadata page 
-        bufMgr->readPage(this->file, this->headerPageNum, hdrPage);
+/**
+ * Descend to the leftmost leaf that can hold key and read its entries with key, moving right
+ * while they may continue in the next leaf. Equal keys can sit on both sides of a separator, so
+ * even a single entry may be found in a right sibling.
+ *
+ * Every leaf is validated before it is left; if one changed, the entries read from it are dropped
+ * and the lookup starts over from the root. Entries of the insert buffer come after those of the tree,
+ * which are all older; the lookup also starts over if a flush of the buffer began meanwhile, since
+ * the flush may have moved entries from the buffer to leaves already read.
+ *
+ * @param key      The key to look for
+ * @param outRid   Set to the first record id with key if outRids is NULL
+ * @param outRids  If not NULL, every record id with key is appended to it
+ * @return Number of entries found
+ */
+template <class T>
+size_t BTreeIndex::lookupTyped(const T &key, RecordId *outRid, std::vector<RecordId> *outRids)
+{
+    if(keyAbsent(key)){
+        return 0;
+    }
+    const size_t start = outRids != NULL ? outRids->size() : 0;
+    while(true){
+        const int flushes = this->bufferFlushes;
+        PathEntry path[MAX_TREE_HEIGHT];
+        const int depth = descend(key, true, path, false);
+        if(depth == 0){
+            continue;
+        }
+        PageId pageNum = path[depth - 1].pageNum;
+        Page *page = path[depth - 1].page;
+        std::uint64_t version = path[depth - 1].version;
 
-        // Metadata: throw exception if not match 
-        if(((IndexMetaInfo*) hdrPage)->attrType != attrType 
-        || ((IndexMetaInfo*) hdrPage)->attrByteOffset != attrByteOffset
-        || strcmp(((IndexMetaInfo*) hdrPage)->relationName, relationName.c_str())){
-            throw BadIndexInfoException("Values in metapage not match with values received!");
+        size_t found = 0;
+        RecordId first = INVALID_RECORD;
+        int pos = LeafFormat<T>::lowerBound((LeafNode<T>*) page, key);
+        bool valid;
+        while(true){
+            const LeafNode<T> *leaf = (LeafNode<T>*) page;
+            const int count = LeafFormat<T>::count(leaf);
+            for(; pos < count && LeafFormat<T>::key(leaf, pos) == key && (outRids != NULL || found == 0); pos++){
+                if(outRids != NULL){
+                    outRids->push_back(LeafFormat<T>::rid(leaf, pos));
+                }else{
+                    first = LeafFormat<T>::rid(leaf, pos);
+                }
+                found++;
+            }
+            // keys of the right sibling are not less than the high fence
+            const PageId siblingPageNum = leaf->rightSibPageNo;
+            if(pos < count || (outRids == NULL && found > 0) || siblingPageNum == Page::INVALID_NUMBER
+            || key < leaf->highFence){
+                valid = this->latches.of(pageNum).validate(version);
+                releaseNode(pageNum);
+                break;
+            }
+            // the entries with key may go on in the right sibling
+            const std::uint64_t siblingVersion = this->latches.of(siblingPageNum).readLock();
+            valid = this->latches.of(pageNum).validate(version);
+            if(!valid){
+                releaseNode(pageNum);
+                break;
+            }
+            Page *siblingPage;
+            readNode(siblingPageNum, siblingPage);
+            releaseNode(pageNum);
+            pageNum = siblingPageNum;
+            page = siblingPage;
+            version = siblingVersion;
+            pos = 0;
         }
-        this->rootPageNum = ((IndexMetaInfo*) hdrPage)->rootPageNo;
-        bufMgr->unPinPage(this->file, this->headerPageNum, false);;
-    }catch (FileNotFoundException){ // otherwise, create a file 
-        // create an index file with BlobFile
-        this->file = new BlobFile(indexName, true);
-        bufMgr->allocPage(this->file, this->headerPageNum, hdrPage);       
-        // metadata 
-        ((IndexMetaInfo*)(hdrPage))->attrType = attrType;
-        ((IndexMetaInfo*)(hdrPage))->attrByteOffset = attrByteOffset;  
-        strcpy(((IndexMetaInfo*)(hdrPage))->relationName, relationName.c_str());
-        
-        this->headerPageNum = file->getFirstPageNo();
-        
-        // Allocate the first leaf node page and root node(page)
-        PageId leafPageNum;
-        bufMgr->allocPage(this->file, leafPageNum, leafPage);
-        LeafNodeInt* leafNode = (LeafNodeInt*) leafPage;
-        for(int i=0;i<INTARRAYNONLEAFSIZE+1;i++){
-            leafNode->ridArray[i] = INVALID_RECORD; 
-        }    
-        leafNode->rightSibPageNo = (PageId) Page::INVALID_NUMBER;
-        bufMgr->allocPage(this->file, this->rootPageNum, rootPage);
-        ((IndexMetaInfo*)(hdrPage))->rootPageNo = this->rootPageNum;
-        NonLeafNodeInt* rootNode = (NonLeafNodeInt*) rootPage;
-        for(int i=0;i<INTARRAYNONLEAFSIZE+1;i++){
-            rootNode->pageNoArray[i] = Page::INVALID_NUMBER;    
-        }            
-        rootNode->level = 1; 
-        rootNode->pageNoArray[0] = leafPageNum;
-
-        bufMgr->unPinPage(this->file, leafPageNum, true);
-        bufMgr->unPinPage(this->file, this->rootPageNum, true);
-        bufMgr->unPinPage(this->file, this->headerPageNum, true);
-        
-        // Scan the file 
-        try{
-            FileScan fScan(relationName, bufMgr);
-            RecordId rid; 
-            while(true){
-                fScan.scanNext(rid);
-                std::string recordStr = fScan.getRecord();
-                const char *record = recordStr.c_str();
-                int key = *((int *)(record + attrByteOffset));
-                this->insertEntry(&key, rid);
+        if(valid && outRids == NULL && found > 0){
+            *outRid = first;
+            return found;
+        }
+        if(valid && (this->bufferedEntries > 0 || this->bufferFlushes != flushes)){
+            std::lock_guard<std::mutex> guard(this->insertBufferLatch);
+            valid = this->bufferFlushes == flushes;
+            if(valid){
+                found += lookupBuffered(key, outRid, outRids);
             }
-        }catch(EndOfFileException){
-            
+        }
+        if(valid){
+            return found;
+        }
+        if(outRids != NULL){
+            outRids->resize(start);
         }
     }
 }
 
 /**
- * BTreeIndex Destructor. 
- * End any initialized scan, flush index file, after unpinning any pinned pages, from the buffer manager
- * and delete file instance thereby closing the index file.
- * Destructor should not throw any exceptions. All exceptions should be caught in here itself.
- * 
- * Perform any cleanup that may be necessary, including clearing up any state variables, 
- * unpinning any B+ Tree pages that are pinned, and flushing the index ﬁle (by calling bufMgr->flushFile()).
- * Note that this method does not delete the index file! But, deletion of the file object is required, 
- * which will call the destructor of File class causing the index file to be closed.  
- * */
-BTreeIndex::~BTreeIndex()
-{     
-    if(this->scanExecuting){
-        endScan(); // cleanup if there is any initialized scan
-    }
-    this->bufMgr->flushFile(file); // flush the index file 
-    delete this->file;
-    this->file = NULL;
-}
+ * A batch of keys looked up by lookupBatch(). Record ids are collected with the index of the key
+ * they belong to, in whatever order the keys are resolved in.
+ */
+template <class T>
+struct ProbeBatch{
+    /**
+     * Keys in the order they were passed.
+     */
+    const T *keys;
+
+    /**
+     * Indexes into keys, sorted by key.
+     */
+    const size_t *order;
+
+    /**
+     * (key index, record id) of every entry found.
+     */
+    std::vector<std::pair<size_t, RecordId> > found;
+
+    /**
+     * Record ids of the key looked up by lookupTyped().
+     */
+    std::vector<RecordId> single;
+};
 
 /**
- *  Insert to leaf node
- * 
- * @param key  A pointer to the value (integer) we want to insert. 
- * @param rid  The corresponding record id of the tuple in the base relation.
- * @param newLeafNode  The leaf node to be inserted
+ * Find every entry of each of a batch of keys.
+ *
+ * @param keys     Pointers to the keys
+ * @param numKeys  Number of keys
+ * @param outRids  Set to the record ids found, grouped by key in the order of keys
+ * @param offsets  Set to where the record ids of each key start in outRids, and their end
  */
-const std::pair<int, PageId> BTreeIndex::insertToLeafNode(const void* key, const RecordId rid, PageId pageNum){
-    Page *page;
-    LeafNodeInt *node;
-
-    bufMgr->readPage(this->file, pageNum, page);
-    node = (LeafNodeInt*)page;
-    // if the current node is full
-    int insertPos = INTARRAYLEAFSIZE;
-    for(int i = 0; i < INTARRAYLEAFSIZE; ++i) {
-        if (node->ridArray[i].page_number == Page::INVALID_NUMBER || node->keyArray[i] > getint(key)) {
-            insertPos = i; 
-            break;
-        }
+const void BTreeIndex::lookupBatch(const void *const *keys, const size_t numKeys, std::vector<RecordId> &outRids,
+                                   std::vector<size_t> &offsets)
+{
+    if(this->bufferedEntries > 0){
+        flushInsertBuffer();
     }
-    // copy into cache
-    std::vector<RecordId> cacheRid;
-    std::vector<int> cacheKey;
-    for(int j=0;j<INTARRAYLEAFSIZE;j++){
-        cacheRid.push_back(node->ridArray[j]);
+    switch(this->attributeType){
+    case INTEGER:{
+        std::vector<int> typed(numKeys);
+        for(size_t i = 0; i < numKeys; i++){
+            typed[i] = KeyTraits<int>::fromPtr(keys[i]);
+        }
+        lookupBatchTyped(typed, outRids, offsets);
+        break;
     }
-    for(int j=0;j<INTARRAYLEAFSIZE;j++){
-        cacheKey.push_back(node->keyArray[j]);
+    case DOUBLE:{
+        std::vector<double> typed(numKeys);
+        for(size_t i = 0; i < numKeys; i++){
+            typed[i] = KeyTraits<double>::fromPtr(keys[i]);
+        }
+        lookupBatchTyped(typed, outRids, offsets);
+        break;
     }
-    // insert into corresponding pos
-    cacheRid.insert(cacheRid.begin() + insertPos, rid);
-    cacheKey.insert(cacheKey.begin() + insertPos, getint(key));
-    
-    if(cacheRid.rbegin()->page_number == Page::INVALID_NUMBER) {
-        // directly copy back
-        for(int j=0;j<INTARRAYLEAFSIZE;j++){
-            node->ridArray[j] = cacheRid[j];
-        }
-        for(int j=0;j<INTARRAYLEAFSIZE;j++){
-            node->keyArray[j] = cacheKey[j];
-        }
-        bufMgr->unPinPage(this->file, pageNum, true);
-        return std::make_pair(-1, (PageId)Page::INVALID_NUMBER);                 
-    } else {
-        Page* newPage;
-        PageId newPageNum;
-        bufMgr->allocPage(this->file, newPageNum, newPage);
-        LeafNodeInt* newNode = (LeafNodeInt*) newPage;
-        // Fill in with invalid record
-        std::fill(node->ridArray, node->ridArray+INTARRAYLEAFSIZE, INVALID_RECORD);
-        std::fill(newNode->ridArray, newNode->ridArray+INTARRAYLEAFSIZE, INVALID_RECORD);
-        for(int j=0;j<(int)cacheRid.size()/2;j++){
-            node->ridArray[j] = cacheRid[j];
-            node->keyArray[j] = cacheKey[j];
-        }
-        for(int j=(int)cacheRid.size()/2;j<(int)cacheRid.size();j++){
-            newNode->ridArray[j-(int)cacheRid.size()/2] = cacheRid[j];
-            newNode->keyArray[j-(int)cacheRid.size()/2] = cacheKey[j];
-        }
-        newNode->rightSibPageNo = node->rightSibPageNo;
-        node->rightSibPageNo = newPageNum;        
-        int midKey = cacheKey[cacheRid.size()/2];
-        bufMgr->unPinPage(this->file, pageNum, true);
-        bufMgr->unPinPage(this->file, newPageNum, true);
-        
-        return std::make_pair(midKey, (PageId)newPageNum);
+    case STRING:{
+        std::vector<StringKey> typed(numKeys);
+        for(size_t i = 0; i < numKeys; i++){
+            typed[i] = KeyTraits<StringKey>::fromPtr(keys[i]);
+        }
+        lookupBatchTyped(typed, outRids, offsets);
+        break;
     }
-}
-/**
- * Insert to non-leaf node
- * 
- * @param key  A pointer to the value (integer) we want to insert.
- * @param newNode The non-leaf node to be inserted
- * @return 
- */
-const std::pair<int, PageId> BTreeIndex::insertToNonLeafNode(const void *key, const RecordId rid, 
-                                                PageId pageNum){
-    Page* page; 
-    NonLeafNodeInt* node; 
-    std::pair<int, PageId> pair; 
-    
-    bufMgr->readPage(this->file, pageNum, page);
-    node = (NonLeafNodeInt*)page;
-    // Page0 | key0 | Page
-    // Page0 | key0 | Page1 | key1 | Page (last)
-    // Size of the page array is (order+1)
-    for(int i = 0; i < INTARRAYNONLEAFSIZE+1 ; ++i){
-        if (i == INTARRAYNONLEAFSIZE || node->pageNoArray[i+1] == Page::INVALID_NUMBER 
-        || node->keyArray[i] > getint(key)){
-            if(node->level == 1){ 
-                pair = insertToLeafNode((const void*)key, rid, node->pageNoArray[i]); 
-            } else{
-                pair = insertToNonLeafNode((const void*)key, rid, node->pageNoArray[i]);
-            }
-            // Check if receiving a new rhs page and key, if not, return null directly
-            if (pair.second != Page::INVALID_NUMBER){
-                
-                std::vector<PageId> cachePage;
-                std::vector<int> cacheKey;
-                for(int j=0;j<INTARRAYNONLEAFSIZE+1;j++){
-                    cachePage.push_back(node->pageNoArray[j]);
-                }
-                for(int j=0;j<INTARRAYNONLEAFSIZE;j++){
-                    cacheKey.push_back(node->keyArray[j]);
-                }
-                cachePage.insert(cachePage.begin()+i+1, pair.second);
-                cacheKey.insert(cacheKey.begin()+i, pair.first);
-                if (*cachePage.rbegin() == Page::INVALID_NUMBER){ // not full, directly copy back
-                    for(int j=0;j<INTARRAYNONLEAFSIZE+1;j++){
-                        node->pageNoArray[j] = cachePage[j];
-                    }
-                    for(int j=0;j<INTARRAYNONLEAFSIZE;j++){
-                        node->keyArray[j] = cacheKey[j];
-                    }
-                    bufMgr->unPinPage(this->file, pageNum, true);
-                    return std::make_pair(-1, (PageId)Page::INVALID_NUMBER);
-                }else{ // if full, split again
-                    
-                    Page* newPage;
-                    PageId newPageNum;
-                    bufMgr->allocPage(this->file, newPageNum, newPage);
-                    NonLeafNodeInt* newNode = (NonLeafNodeInt*) newPage;
-                    PageId invalid = Page::INVALID_NUMBER;
-                    std::fill(node->pageNoArray, node->pageNoArray + INTARRAYNONLEAFSIZE + 1, invalid);
-                    std::fill(newNode->pageNoArray, newNode->pageNoArray + INTARRAYNONLEAFSIZE + 1, invalid);
-                    for(int j=0;j<(int)cachePage.size()/2;j++){
-                        node->pageNoArray[j] = cachePage[j];
-                        if (j!=(int)cachePage.size()/2-1){ // not the last page in the node, copy key also
-                            node->keyArray[j] = cacheKey[j];
-                        }
-                    }
-                    for(int j=(int)cachePage.size()/2;j<(int)cachePage.size();j++){
-                        newNode->pageNoArray[j-(int)cachePage.size()/2] = cachePage[j];
-                        if (j!=(int)cachePage.size()-1){ // not the last page in the node, copy key also
-                            newNode->keyArray[j-(int)cachePage.size()/2] = cacheKey[j];
-                        }                        
-                    }
-                    newNode->level = node->level;
-                    int midKey = cacheKey[cachePage.size()/2-1];
-                    bufMgr->unPinPage(this->file, pageNum, true);
-                    bufMgr->unPinPage(this->file, newPageNum, true);                    
-                    return std::make_pair(midKey, newPageNum);
-                }
-            } else{
-                bufMgr->unPinPage(this->file, pageNum, false);
-                return std::make_pair(-1, (PageId)Page::INVALID_NUMBER);
-            }
+    case COMPOSITE:{
+        std::vector<CompositeKey> typed(numKeys);
+        for(size_t i = 0; i < numKeys; i++){
+            typed[i] = KeyTraits<CompositeKey>::fromPtr(keys[i]);
         }
+        lookupBatchTyped(typed, outRids, offsets);
+        break;
+    }
     }
-    // Shouldn't reach here
-    assert(false);    
-    return std::make_pair(-1, (PageId)Page::INVALID_NUMBER);
 }
 
 /**
- * Insert a new entry using the pair <key, rid>. 
- * 
- * Start from root to recursively find out the leaf to insert the entry in. The insertion may cause splitting 
- * of leaf node. This splitting will require addition of new leaf page number entry into the parent non-leaf, 
- * which may in-turn get split. This may continue all the way upto the root causing the root to get split. 
- * If root gets split, metapage needs to be changed accordingly.
- * 
- * Make sure to unpin pages as soon as you can.
- * @param key	A pointer to the value (integer) we want to insert. 
- * @param rid	The corresponding record id of the tuple in the base relation.
- **/
-const void BTreeIndex::insertEntry(const void *key, const RecordId rid)
+ * Sort the keys, probe the tree with all of them from the root down, then group the record ids
+ * found by key in the order the keys were passed.
+ */
+template <class T>
+void BTreeIndex::lookupBatchTyped(const std::vector<T> &keys, std::vector<RecordId> &outRids, std::vector<size_t> &offsets)
 {
-    std::pair<int, PageId> ret = insertToNonLeafNode(key,rid,this->rootPageNum);
-    if (ret.second != Page::INVALID_NUMBER){ // split root page
-        PageId newRootPageNum;
-        Page* newRootPage;
-        bufMgr->allocPage(this->file, newRootPageNum, newRootPage);
-        NonLeafNodeInt* rootNode = (NonLeafNodeInt*) newRootPage;
-        rootNode->keyArray[0] =  ret.first;
-        PageId invalid = Page::INVALID_NUMBER;
-        std::fill(rootNode->pageNoArray, rootNode->pageNoArray+INTARRAYNONLEAFSIZE+1, invalid);
-        rootNode->pageNoArray[0] = this->rootPageNum;
-        rootNode->pageNoArray[1] = ret.second;
-        rootNode->level = 0;
-        this->rootPageNum = newRootPageNum;
-        bufMgr->unPinPage(this->file, newRootPageNum, true);
+    const size_t numKeys = keys.size();
+    // keys the key filter rules out are not probed
+    std::vector<size_t> order;
+    order.reserve(numKeys);
+    for(size_t i = 0; i < numKeys; i++){
+        if(!keyAbsent(keys[i])){
+            order.push_back(i);
+        }
+    }
+    std::sort(order.begin(), order.end(), [&keys](const size_t a, const size_t b){ return keys[a] < keys[b]; });
+
+    ProbeBatch<T> batch;
+    batch.keys = keys.data();
+    batch.order = order.data();
+    if(!order.empty()){
+        const PageId rootPageNum = this->rootPageNum;
+        probeNode(batch, 0, order.size(), rootPageNum, this->latches.of(rootPageNum).readLock(), false);
+    }
+
+    offsets.assign(numKeys + 1, 0);
+    for(size_t i = 0; i < batch.found.size(); i++){
+        offsets[batch.found[i].first + 1]++;
+    }
+    for(size_t i = 0; i < numKeys; i++){
+        offsets[i + 1] += offsets[i];
+    }
+    outRids.resize(batch.found.size());
+    std::vector<size_t> next(offsets.begin(), offsets.end() - 1);
+    for(size_t i = 0; i < batch.found.size(); i++){
+        outRids[next[batch.found[i].first]++] = batch.found[i].second;
     }
 }
 
 /**
- * Helper function for starting the scan 
- * 
- * Unpin the page not needed, only keep the page we want to be pinned in the buffer pool
- * 
- * @param pageNum: Start from pageNum to find out the leaf page that contains the first RecordID 
- * that satisfies the scan parameters 
- * @return Index of the next entry to be scanned in current leaf being scanned
- * @throws  NoSuchKeyFoundException If there is no key in the B+ tree that satisfies the scan criteria.
+ * Probe one node with the keys first up to last of the batch.
+ *
+ * A non-leaf node splits the keys into runs going to the same child, like descend() with lower set,
+ * and notes the version of each child before it validates itself. The children are prefetched,
+ * then visited in key order with the node already unpinned. A leaf collects the entries of each
+ * key; a key whose entries reach the end of the leaf may have more in the right sibling and is
+ * looked up alone, unless it is less than the high fence of the leaf. Whenever a node fails
+ * validation, the keys of its subtree are looked up alone.
  */
-const int BTreeIndex::startScanHelper(PageId pageNum){
-    NonLeafNodeInt* node; 
-    LeafNodeInt* childNode; // used if we reach the last level above leaf node 
-    
-    // start from the page with pageId as pageNum
-    this->currentPageNum = pageNum;
-    this->bufMgr->readPage(this->file, this->currentPageNum, this->currentPageData);
-    node = (NonLeafNodeInt*)this->currentPageData; 
-
-    for(int i = 0; i < INTARRAYNONLEAFSIZE+1; ++i){
-        if(i == INTARRAYNONLEAFSIZE || node->pageNoArray[i+1] == Page::INVALID_NUMBER 
-        || node->keyArray[i] > lowValInt){
-            // if the node is right above the leaf node 
-            if(node->level == 1){ 
-                // read the child page which is leaf, update variables accordingly
-                this->currentPageNum = node->pageNoArray[i];
-                this->bufMgr->readPage(this->file, this->currentPageNum, this->currentPageData);
-                childNode = (LeafNodeInt*)this->currentPageData;
-                // scan the page  
-                // Page0 | key0 | Page
-                // Page0 | key0 | Page1 | key1 | Page (last)
-                for(int j = 0; j < INTARRAYLEAFSIZE; ++j){
-                    if (childNode->ridArray[j] == INVALID_RECORD){
-                        break;
-                    }
-                    if((this->lowOp == GT && childNode->keyArray[j] > this->lowValInt)
-                    || (this->lowOp == GTE && childNode->keyArray[j] >= this->lowValInt)){
-                        // unpin the page read at the beginning of this function 
-                        this->bufMgr->unPinPage(this->file, pageNum, false);
-                        return j;
-                    }
-                }   
-                // if reach the end and not found
-                // unPinPage throw PageNotPinnedException if the page is not already pinned 
-                this->bufMgr->unPinPage(this->file, pageNum, false); 
-                this->endScan();  
-                throw NoSuchKeyFoundException();      
-            } else{ // otherwise, recurse on non-leaf nodes
-                try{
-                    int nxt = startScanHelper(node->pageNoArray[i]);
-                    this->bufMgr->unPinPage(this->file, pageNum, false);
-                    return nxt;
-                }catch (NoSuchKeyFoundException){
-                    this->bufMgr->unPinPage(this->file, pageNum, false);
-                    throw NoSuchKeyFoundException(); 
+template <class T>
+void BTreeIndex::probeNode(ProbeBatch<T> &batch, const size_t first, const size_t last, const PageId pageNum,
+                           const std::uint64_t version, const bool leaf)
+{
+    Page *page;
+    readNode(pageNum, page, !leaf);
+    std::vector<size_t> alone;
+    bool valid;
+    if(leaf){
+        const LeafNode<T> *node = (LeafNode<T>*) page;
+        const int count = LeafFormat<T>::count(node);
+        const size_t start = batch.found.size();
+        for(size_t k = first; k < last; k++){
+            const size_t keyIndex = batch.order[k];
+            const T &key = batch.keys[keyIndex];
+            const size_t before = batch.found.size();
+            int pos = LeafFormat<T>::lowerBound(node, key);
+            for(; pos < count && LeafFormat<T>::key(node, pos) == key; pos++){
+                batch.found.push_back(std::make_pair(keyIndex, LeafFormat<T>::rid(node, pos)));
+            }
+            if(pos == count && node->rightSibPageNo != Page::INVALID_NUMBER && !(key < node->highFence)){
+                batch.found.resize(before);
+                alone.push_back(k);
+            }
+        }
+        valid = this->latches.of(pageNum).validate(version);
+        releaseNode(pageNum);
+        if(!valid){
+            batch.found.resize(start);
+        }
+    }else{
+        // runs of keys going to the same child: their first key, child and the version of its latch
+        const NonLeafNode<T> *node = (NonLeafNode<T>*) page;
+        const bool leafChildren = node->level == 1;
+        std::vector<size_t> runs;
+        std::vector<PathEntry> children;
+        for(size_t k = first; k < last; k++){
+            const PageId childPageNum = NonLeafFormat<T>::child(node, NonLeafFormat<T>::lowerBound(node, batch.keys[batch.order[k]]));
+            if(children.empty() || children.back().pageNum != childPageNum){
+                PathEntry child = {childPageNum, NULL, this->latches.of(childPageNum).readLock(), false};
+                children.push_back(child);
+                runs.push_back(k);
+            }
+        }
+        runs.push_back(last);
+        valid = this->latches.of(pageNum).validate(version);
+        releaseNode(pageNum);
+        if(valid){
+            if(!this->mapped){
+                for(size_t c = 1; c < children.size(); c++){
+                    this->bufMgr->prefetchPages(this->file, children[c].pageNum, 1);
                 }
             }
+            for(size_t c = 0; c < children.size(); c++){
+                probeNode(batch, runs[c], runs[c + 1], children[c].pageNum, children[c].version, leafChildren);
+            }
+        }
+    }
+
+    if(!valid){
+        alone.clear();
+        for(size_t k = first; k < last; k++){
+            alone.push_back(k);
+        }
+    }
+    for(size_t i = 0; i < alone.size(); i++){
+        const size_t keyIndex = batch.order[alone[i]];
+        batch.single.clear();
+        lookupTyped(batch.keys[keyIndex], NULL, &batch.single);
+        for(size_t j = 0; j < batch.single.size(); j++){
+            batch.found.push_back(std::make_pair(keyIndex, batch.single[j]));
         }
     }
-    assert(false);
-    return -1;
 }
 
 /**
@@ -398,16 +4513,16 @@ const int BTreeIndex::startScanHelper(PageId pageNum){
  * Set up all the variables for scan. Start from root to find out the leaf page that contains the 
  * first RecordID that satisfies the scan parameters. Keep that page pinned in the buffer pool.
  * 
- * @param lowVal	Low value of range, pointer to integer
+ * @param lowVal	Low value of range, pointer to integer, double or char string
  * @param lowOp		The operation to be used in testing the low range. You should only support GT 
  * and GTE here; anything else should throw BadOpcodesException. Note that the Operator enumeration 
  * is deﬁned in btree.h. 
- * @param highVal	High value of range, pointer to integer
+ * @param highVal	High value of range, pointer to integer, double or char string
  * @param highOp	The operation to be used in testing the high range. You should only support LT
  * and LTE here; anything else should throw BadOpcodesException
  * 
  * Both the high and low values are in a binary form, i.e., for integer keys, these point to the 
- * address of an integer.
+ * address of an integer. String bounds are compared on their first STRINGSIZE characters.
  * 
  * @throws  BadOpcodesException If lowOp and highOp do not contain one of their their expected values 
  * @throws  BadScanrangeException If lowVal > highval
@@ -416,33 +4531,106 @@ const int BTreeIndex::startScanHelper(PageId pageNum){
 const void BTreeIndex::startScan(const void *lowValParm,
                                  const Operator lowOpParm,
                                  const void *highValParm,
-                                 const Operator highOpParm)
+                                 const Operator highOpParm,
+                                 const ScanOrder order)
+{
+    startScan(this->scan, lowValParm, lowOpParm, highValParm, highOpParm, order);
+}
+
+/**
+ * startScan() on cursor. Only a scan already running on cursor is ended; scans on other cursors
+ * go on unaffected.
+ **/
+const void BTreeIndex::startScan(IndexCursor &cursor,
+                                 const void *lowValParm,
+                                 const Operator lowOpParm,
+                                 const void *highValParm,
+                                 const Operator highOpParm,
+                                 const ScanOrder order)
 {
-    // If another scan is already executing, that needs to be ended here.
-    if(this->scanExecuting)
-        endScan();
+    TraceScope trace(TRACE_START_SCAN, this->file->filename());
+    // If another scan is already executing on this cursor, that needs to be ended here.
+    if(cursor.scanExecuting)
+        cursor.index->endScan(cursor);
 
-    // Initialize the variables in BTreeIndex
-    this->lowValInt = getint(lowValParm);
-    this->highValInt = getint(highValParm);
-    this->lowOp = lowOpParm;
-    this->highOp = highOpParm;
+    // the scan reads the leaves only, so the entries of the insert buffer go there first
+    if(this->bufferedEntries > 0){
+        flushInsertBuffer();
+    }
+
+    // Initialize the variables in BTreeIndex; a missing bound is the least or greatest key, inclusive
+    bool badRange = false;
+    // both bounds are one key the key filter rules out
+    bool pointAbsent = false;
+    switch(this->attributeType){
+    case INTEGER:
+        cursor.lowValInt = lowValParm != NULL ? KeyTraits<int>::fromPtr(lowValParm) : KeyTraits<int>::lowest();
+        cursor.highValInt = highValParm != NULL ? KeyTraits<int>::fromPtr(highValParm) : KeyTraits<int>::highest();
+        badRange = cursor.lowValInt > cursor.highValInt;
+        pointAbsent = cursor.lowValInt == cursor.highValInt && keyAbsent(cursor.lowValInt);
+        break;
+    case DOUBLE:
+        cursor.lowValDouble = lowValParm != NULL ? KeyTraits<double>::fromPtr(lowValParm) : KeyTraits<double>::lowest();
+        cursor.highValDouble = highValParm != NULL ? KeyTraits<double>::fromPtr(highValParm) : KeyTraits<double>::highest();
+        badRange = cursor.lowValDouble > cursor.highValDouble;
+        pointAbsent = cursor.lowValDouble == cursor.highValDouble && keyAbsent(cursor.lowValDouble);
+        break;
+    case STRING:{
+        const StringKey low = lowValParm != NULL ? KeyTraits<StringKey>::fromPtr(lowValParm) : KeyTraits<StringKey>::lowest();
+        const StringKey high = highValParm != NULL ? KeyTraits<StringKey>::fromPtr(highValParm) : KeyTraits<StringKey>::highest();
+        cursor.lowValString.assign(low.data, STRINGSIZE);
+        cursor.highValString.assign(high.data, STRINGSIZE);
+        badRange = low > high;
+        pointAbsent = low == high && keyAbsent(low);
+        break;
+    }
+    case COMPOSITE:{
+        const CompositeKey low = lowValParm != NULL ? KeyTraits<CompositeKey>::fromPtr(lowValParm) : KeyTraits<CompositeKey>::lowest();
+        const CompositeKey high = highValParm != NULL ? KeyTraits<CompositeKey>::fromPtr(highValParm) : KeyTraits<CompositeKey>::highest();
+        cursor.lowValString.assign((const char*) low.data, COMPOSITEKEYSIZE);
+        cursor.highValString.assign((const char*) high.data, COMPOSITEKEYSIZE);
+        badRange = low > high;
+        pointAbsent = low == high && keyAbsent(low);
+        break;
+    }
+    }
+    cursor.lowOp = lowValParm != NULL ? lowOpParm : GTE;
+    cursor.highOp = highValParm != NULL ? highOpParm : LTE;
+    cursor.descending = order == SCAN_DESCENDING;
     
     // BadOpcodesException 
-    if((this->lowOp != GT && this->lowOp != GTE) 
-       || (this->highOp != LT && this->highOp != LTE))
+    if((cursor.lowOp != GT && cursor.lowOp != GTE) 
+       || (cursor.highOp != LT && cursor.highOp != LTE))
         throw BadOpcodesException();
 
     // BadScanrangeException 
-    if(this->lowValInt > this->highValInt)
+    if(badRange)
         throw BadScanrangeException();
 
+    // a scan for a single key the index does not hold finds nothing without descending
+    if(pointAbsent && cursor.lowOp == GTE && cursor.highOp == LTE)
+        throw NoSuchKeyFoundException();
+
     // set the scan state variable to true 
-    this->scanExecuting = true; 
+    cursor.scanExecuting = true; 
+    cursor.index = this;
 
     // nextEntry(int): Index of next entry to be scanned in current leaf being scanned.
     // currentPage & currentPageData updated in this helper function 
-    this->nextEntry = startScanHelper(this->rootPageNum);
+    switch(this->attributeType){
+    case INTEGER:
+        startScanHelper<int>(cursor);
+        break;
+    case DOUBLE:
+        startScanHelper<double>(cursor);
+        break;
+    case STRING:
+        startScanHelper<StringKey>(cursor);
+        break;
+    case COMPOSITE:
+        startScanHelper<CompositeKey>(cursor);
+        break;
+    }
 }
 
 /**
@@ -456,40 +4644,313 @@ const void BTreeIndex::startScan(const void *lowValParm,
  * @throws IndexScanCompletedException If the scan has reached the end. 
  **/
 const void BTreeIndex::scanNext(RecordId &outRid)
+{
+    scanNext(this->scan, outRid);
+}
+
+/**
+ * scanNext() on cursor.
+ **/
+const void BTreeIndex::scanNext(IndexCursor &cursor, RecordId &outRid)
 {
     // if no scan has been initialized 
-    if(this->scanExecuting == false)
+    if(cursor.scanExecuting == false)
         throw ScanNotInitializedException(); 
-    // if next entry invalid 
-    LeafNodeInt* currLeafNode = (LeafNodeInt*) this->currentPageData;
-    if(this->nextEntry == INT_MAX || currLeafNode->ridArray[this->nextEntry] == INVALID_RECORD){
-        throw IndexScanCompletedException();
+    TraceScope trace(TRACE_SCAN_BATCH, this->file->filename());
+    switch(this->attributeType){
+    case INTEGER:
+        scanNextTyped<int>(cursor, outRid);
+        break;
+    case DOUBLE:
+        scanNextTyped<double>(cursor, outRid);
+        break;
+    case STRING:
+        scanNextTyped<StringKey>(cursor, outRid);
+        break;
+    case COMPOSITE:
+        scanNextTyped<CompositeKey>(cursor, outRid);
+        break;
     }
-        
-    int i = this->nextEntry;
-    if((this->highOp == LT && (currLeafNode->keyArray[i] < this->highValInt))
-    || (this->highOp == LTE && (currLeafNode->keyArray[i] <= this->highValInt))){
-        outRid = currLeafNode->ridArray[i];
-    }else{ 
-        throw IndexScanCompletedException();
+    trace.addEntries(1);
+}
+
+/**
+ * scanNext() on leaves with keys of type T.
+ *
+ * @param outRid RecordId of next record found that satisfies the scan criteria. Return in this.
+ * @throws IndexScanCompletedException If the scan has reached the end. 
+ **/
+template <class T>
+void BTreeIndex::scanNextTyped(IndexCursor &cursor, RecordId &outRid)
+{
+    if(cursor.descending){
+        if(scanNextBatchDescendingTyped<T>(cursor, &outRid, 1, NULL) == 0){
+            throw IndexScanCompletedException();
+        }
+        return;
     }
-    
-    // advance nextEntry
-    if (this->nextEntry < INTARRAYLEAFSIZE-1 && currLeafNode->ridArray[this->nextEntry+1]!=INVALID_RECORD){
-        this->nextEntry++;
-    }else{
-        // Still has next page
-        if (currLeafNode->rightSibPageNo!=Page::INVALID_NUMBER){
-            // move to the right sibling 
-            PageId lastPageId = this->currentPageNum;
-            this->nextEntry = 0;
-            this->currentPageNum = currLeafNode->rightSibPageNo; 
-            this->bufMgr->readPage(this->file, this->currentPageNum, this->currentPageData);
-            this->bufMgr->unPinPage(this->file, lastPageId, false);
+    T lowVal, highVal;
+    cursor.bounds(lowVal, highVal);
+    while(true){
+        // if next entry invalid 
+        if(cursor.nextEntry == INT_MAX){
+            throw IndexScanCompletedException();
+        }
+        LeafNode<T>* currLeafNode = (LeafNode<T>*) cursor.currentPageData;
+        const int i = cursor.nextEntry;
+        if(i >= LeafFormat<T>::count(currLeafNode)){
+            // Still has next page with entries of the scan
+            if(!lastLeafOfScan<T>(cursor, currLeafNode)){
+                // move to the right sibling 
+                if(!moveRight<T>(cursor)){
+                    repositionCursor<T>(cursor);
+                }
+            }else if(this->latches.of(cursor.currentPageNum).validate(cursor.leafVersion)){
+                cursor.nextEntry = INT_MAX;
+            }else{
+                repositionCursor<T>(cursor);
+            }
+            continue;
+        }
+
+        const T key = LeafFormat<T>::key(currLeafNode, i);
+        const RecordId rid = LeafFormat<T>::rid(currLeafNode, i);
+        if(!this->latches.of(cursor.currentPageNum).validate(cursor.leafVersion)){
+            repositionCursor<T>(cursor);
+            continue;
+        }
+        if((cursor.highOp == LT && (key < highVal))
+        || (cursor.highOp == LTE && (key <= highVal))){
+            outRid = rid;
+        }else{ 
+            cursor.nextEntry = INT_MAX;
+            throw IndexScanCompletedException();
+        }
+
+        // remember where the scan is in case the leaf changes before the next call
+        T lastKey;
+        memcpy(&lastKey, cursor.resumeKey, sizeof(T));
+        if(cursor.resumeDups > 0 && lastKey == key){
+            cursor.resumeDups++;
         }else{
-            this->nextEntry = INT_MAX;
+            memcpy(cursor.resumeKey, &key, sizeof(T));
+            cursor.resumeDups = 1;
+        }
+        // advance nextEntry
+        cursor.nextEntry++;
+        return;
+    }
+}
+
+/**
+ * Fetch the record ids of up to maxRids next index entries that match the scan criteria.
+ *
+ * The end of the qualifying run of the current leaf is found with one search for the high bound,
+ * and the run is copied out at once. Leaves are left for their right sibling the way scanNext()
+ * does, so both can be used on the same scan.
+ *
+ * @param outRids Array the matching record ids are returned in
+ * @param maxRids Maximum number of record ids to return
+ * @return Number of record ids returned, 0 once the scan has reached the end
+ * @throws ScanNotInitializedException If no scan has been initialized.
+ **/
+const size_t BTreeIndex::scanNextBatch(RecordId *outRids, const size_t maxRids)
+{
+    return scanNextBatch(this->scan, outRids, maxRids);
+}
+
+/**
+ * scanNextBatch() on cursor.
+ **/
+const size_t BTreeIndex::scanNextBatch(IndexCursor &cursor, RecordId *outRids, const size_t maxRids)
+{
+    return scanNextBatch(cursor, outRids, maxRids, NULL);
+}
+
+/**
+ * scanNextBatch() on cursor, copying the payload of each entry of a covering index as well.
+ *
+ * @param outPayloads  Array of maxRids payloads, NULL if they are not wanted
+ **/
+const size_t BTreeIndex::scanNextBatch(IndexCursor &cursor, RecordId *outRids, const size_t maxRids, char *outPayloads)
+{
+    // if no scan has been initialized 
+    if(cursor.scanExecuting == false)
+        throw ScanNotInitializedException(); 
+    TraceScope trace(TRACE_SCAN_BATCH, this->file->filename());
+    size_t found = 0;
+    switch(this->attributeType){
+    case INTEGER:
+        found = scanNextBatchTyped<int>(cursor, outRids, maxRids, outPayloads);
+        break;
+    case DOUBLE:
+        found = scanNextBatchTyped<double>(cursor, outRids, maxRids, outPayloads);
+        break;
+    case STRING:
+        found = scanNextBatchTyped<StringKey>(cursor, outRids, maxRids, outPayloads);
+        break;
+    case COMPOSITE:
+        found = scanNextBatchTyped<CompositeKey>(cursor, outRids, maxRids, outPayloads);
+        break;
+    }
+    trace.addEntries(found);
+    return found;
+}
+
+/**
+ * scanNextBatch() on leaves with keys of type T.
+ **/
+template <class T>
+size_t BTreeIndex::scanNextBatchTyped(IndexCursor &cursor, RecordId *outRids, const size_t maxRids, char *outPayloads)
+{
+    if(cursor.descending){
+        return scanNextBatchDescendingTyped<T>(cursor, outRids, maxRids, outPayloads);
+    }
+    T lowVal, highVal;
+    cursor.bounds(lowVal, highVal);
+    size_t found = 0;
+    while(found < maxRids && cursor.nextEntry != INT_MAX){
+        LeafNode<T>* currLeafNode = (LeafNode<T>*) cursor.currentPageData;
+        const int numKeys = LeafFormat<T>::count(currLeafNode);
+        if(cursor.nextEntry >= numKeys){
+            if(!lastLeafOfScan<T>(cursor, currLeafNode)){
+                // move to the right sibling 
+                if(!moveRight<T>(cursor)){
+                    repositionCursor<T>(cursor);
+                }
+            }else if(this->latches.of(cursor.currentPageNum).validate(cursor.leafVersion)){
+                cursor.nextEntry = INT_MAX; // passed the last leaf
+            }else{
+                repositionCursor<T>(cursor);
+            }
+            continue;
+        }
+
+        // entries of this leaf up to end satisfy the high bound
+        const int first = cursor.nextEntry;
+        const int end = (cursor.highOp == LT) ? LeafFormat<T>::lowerBound(currLeafNode, highVal)
+                                             : LeafFormat<T>::upperBound(currLeafNode, highVal);
+        const int count = (int)std::min((size_t)std::max(end - first, 0), maxRids - found);
+        LeafFormat<T>::copyRids(currLeafNode, first, count, outRids + found);
+        if(outPayloads != NULL){
+            LeafFormat<T>::copyPayloads(currLeafNode, first, count, outPayloads + found * this->payloadLen);
+        }
+        // the run of the last key copied, to resume after it if the leaf changes
+        T lastKey = T();
+        int lastFirst = first;
+        if(count > 0){
+            lastKey = LeafFormat<T>::key(currLeafNode, first + count - 1);
+            lastFirst = std::max(LeafFormat<T>::lowerBound(currLeafNode, lastKey), first);
+        }
+        if(!this->latches.of(cursor.currentPageNum).validate(cursor.leafVersion)){
+            repositionCursor<T>(cursor); // the record ids copied are overwritten
+            continue;
+        }
+
+        if(count > 0){
+            T resumeKey;
+            memcpy(&resumeKey, cursor.resumeKey, sizeof(T));
+            const int dups = first + count - lastFirst;
+            if(lastFirst == first && cursor.resumeDups > 0 && resumeKey == lastKey){
+                cursor.resumeDups += dups;
+            }else{
+                memcpy(cursor.resumeKey, &lastKey, sizeof(T));
+                cursor.resumeDups = dups;
+            }
+        }
+        found += count;
+        cursor.nextEntry += count;
+
+        if(cursor.nextEntry < end){
+            break; // outRids is full
+        }
+        if(end < numKeys){
+            cursor.nextEntry = INT_MAX; // passed the high bound
+        }
+    }
+    return found;
+}
+
+/**
+ * scanNextBatch() on leaves with keys of type T for a descending scan.
+ *
+ * The start of the qualifying run of the current leaf is found with one search for the low bound,
+ * and the run is copied out at once and reversed. Leaves are left for their left sibling once the
+ * cursor passes their first entry.
+ **/
+template <class T>
+size_t BTreeIndex::scanNextBatchDescendingTyped(IndexCursor &cursor, RecordId *outRids, const size_t maxRids,
+                                                char *outPayloads)
+{
+    T lowVal, highVal;
+    cursor.bounds(lowVal, highVal);
+    size_t found = 0;
+    while(found < maxRids && cursor.nextEntry != INT_MAX){
+        LeafNode<T>* currLeafNode = (LeafNode<T>*) cursor.currentPageData;
+        if(cursor.nextEntry < 0){
+            if(!lastLeafOfScan<T>(cursor, currLeafNode)){
+                // move to the left sibling
+                if(!moveLeft<T>(cursor)){
+                    repositionCursor<T>(cursor);
+                }
+            }else if(this->latches.of(cursor.currentPageNum).validate(cursor.leafVersion)){
+                cursor.nextEntry = INT_MAX; // passed the first leaf
+            }else{
+                repositionCursor<T>(cursor);
+            }
+            continue;
+        }
+
+        // entries of this leaf from begin up to last satisfy the low bound
+        const int last = std::min(cursor.nextEntry, LeafFormat<T>::count(currLeafNode) - 1);
+        const int begin = (cursor.lowOp == GT) ? LeafFormat<T>::upperBound(currLeafNode, lowVal)
+                                               : LeafFormat<T>::lowerBound(currLeafNode, lowVal);
+        const int count = (int)std::min((size_t)std::max(last + 1 - begin, 0), maxRids - found);
+        const int first = last + 1 - count;
+        LeafFormat<T>::copyRids(currLeafNode, first, count, outRids + found);
+        if(outPayloads != NULL){
+            LeafFormat<T>::copyPayloads(currLeafNode, first, count, outPayloads + found * this->payloadLen);
+        }
+        // the run of the last key copied, the least one, to resume before it if the leaf changes
+        T lastKey = T();
+        int lastEnd = last;
+        if(count > 0){
+            lastKey = LeafFormat<T>::key(currLeafNode, first);
+            lastEnd = std::min(LeafFormat<T>::upperBound(currLeafNode, lastKey) - 1, last);
+        }
+        if(!this->latches.of(cursor.currentPageNum).validate(cursor.leafVersion)){
+            repositionCursor<T>(cursor); // the record ids copied are overwritten
+            continue;
+        }
+        std::reverse(outRids + found, outRids + found + count);
+        for(int i = 0, j = count - 1; outPayloads != NULL && i < j; i++, j--){
+            char *payloads = outPayloads + found * this->payloadLen;
+            std::swap_ranges(payloads + i * this->payloadLen, payloads + (i + 1) * this->payloadLen,
+                             payloads + j * this->payloadLen);
+        }
+
+        if(count > 0){
+            T resumeKey;
+            memcpy(&resumeKey, cursor.resumeKey, sizeof(T));
+            const int dups = lastEnd - first + 1;
+            if(lastEnd == last && cursor.resumeDups > 0 && resumeKey == lastKey){
+                cursor.resumeDups += dups;
+            }else{
+                memcpy(cursor.resumeKey, &lastKey, sizeof(T));
+                cursor.resumeDups = dups;
+            }
+        }
+        found += count;
+        cursor.nextEntry = first - 1;
+
+        if(cursor.nextEntry >= begin){
+            break; // outRids is full
+        }
+        if(begin > 0){
+            cursor.nextEntry = INT_MAX; // passed the low bound
         }
     }
+    return found;
 }
 
 /**      
@@ -499,23 +4960,32 @@ const void BTreeIndex::scanNext(RecordId &outRid)
  * successful startScan call.)
  **/
 const void BTreeIndex::endScan()
+{
+    endScan(this->scan);
+}
+
+/**
+ * endScan() on cursor.
+ **/
+const void BTreeIndex::endScan(IndexCursor &cursor)
 {
     // Throw exception when called before a successful startScan call 
-    if(this->scanExecuting == false)
+    if(cursor.scanExecuting == false)
         throw ScanNotInitializedException();
 
     // Unpin any pinned pages that have been pinned for the purpuse
     // Only one page is pinned for scanning purpose, and it's not marked dirty  
-    this->bufMgr->unPinPage(this->file, this->currentPageNum, false);
+    releaseNode(cursor.currentPageNum);
     
     // Reset scan specific varaible 
-    this->highOp = EMPTY; 
-    this->lowOp = EMPTY;
-    this->scanExecuting = false; 
-    this->currentPageData = (Page*)NULL;
-    this->currentPageNum = (PageId)NULL;
-    this->highValInt = INT_MAX;
-    this->lowValInt = INT_MIN;
-    this->nextEntry = -1; 
+    cursor.highOp = EMPTY; 
+    cursor.lowOp = EMPTY;
+    cursor.descending = false;
+    cursor.scanExecuting = false; 
+    cursor.currentPageData = (Page*)NULL;
+    cursor.currentPageNum = (PageId)NULL;
+    cursor.highValInt = INT_MAX;
+    cursor.lowValInt = INT_MIN;
+    cursor.nextEntry = -1; 
 }
 }
\ No newline at end of file
@@ -7,15 +7,23 @@
 
 #pragma once
 
+#include <atomic>
+#include <cstdint>
 #include <iostream>
+#include <limits>
+#include <mutex>
 #include <string>
+#include <thread>
 #include "string.h"
 #include <sstream>
+#include <vector>
 
 #include "types.h"
 #include "page.h"
 #include "file.h"
 #include "buffer.h"
+#include "sort.h"
+#include "trace.h"
 
 namespace badgerdb
 {
@@ -27,35 +35,411 @@ enum Datatype
 {
 	INTEGER = 0,
 	DOUBLE = 1,
-	STRING = 2
+	STRING = 2,
+	COMPOSITE = 3
 };
 
 /**
- * @brief Scan operations enumeration. Passed to BTreeIndex::startScan() method.
+ * @brief How a BTreeIndex opens its index file. Passed to the BTreeIndex constructor.
  */
-enum Operator
-{ 
-  EMPTY,
-	LT, 	/* Less Than */
-	LTE,	/* Less Than or Equal to */
-	GTE,	/* Greater Than or Equal to */
-	GT		/* Greater Than */
+enum IndexAccess
+{
+	/**
+	 * Nodes are read and written through the buffer pool. An index file that does not exist is built.
+	 */
+	INDEX_READ_WRITE,
+
+	/**
+	 * The index file must exist and is not changed. Where the node layout allows, the file is mapped
+	 * into memory and nodes are read from the mapping, without pins or copies into the buffer pool.
+	 */
+	INDEX_READ_ONLY
+};
+
+/**
+ * @brief Order in which a scan returns the entries of its range. Passed to BTreeIndex::startScan().
+ */
+enum ScanOrder
+{
+	/**
+	 * From the low bound up, following right siblings.
+	 */
+	SCAN_ASCENDING,
+
+	/**
+	 * From the high bound down, following left siblings, e.g. for the greatest N keys of a range.
+	 */
+	SCAN_DESCENDING
+};
+
+
+/**
+ * @brief Number of bytes of a STRING attribute used as the key.
+ */
+const int STRINGSIZE = 10;
+
+/**
+ * @brief Key type for STRING attributes: the first STRINGSIZE bytes of the attribute, padded with '\0'.
+ * Keys are ordered bytewise like strncmp() over STRINGSIZE characters.
+ */
+struct StringKey{
+  /**
+   * Key bytes, '\0' padded.
+   */
+	char data[ STRINGSIZE ];
+};
+
+inline bool operator<( const StringKey& a, const StringKey& b ) { return memcmp( a.data, b.data, STRINGSIZE ) < 0; }
+inline bool operator>( const StringKey& a, const StringKey& b ) { return memcmp( a.data, b.data, STRINGSIZE ) > 0; }
+inline bool operator<=( const StringKey& a, const StringKey& b ) { return memcmp( a.data, b.data, STRINGSIZE ) <= 0; }
+inline bool operator>=( const StringKey& a, const StringKey& b ) { return memcmp( a.data, b.data, STRINGSIZE ) >= 0; }
+inline bool operator==( const StringKey& a, const StringKey& b ) { return memcmp( a.data, b.data, STRINGSIZE ) == 0; }
+inline bool operator!=( const StringKey& a, const StringKey& b ) { return memcmp( a.data, b.data, STRINGSIZE ) != 0; }
+
+/**
+ * @brief An attribute of the key of an index: its offset inside the record and its type, which is
+ * INTEGER, DOUBLE or STRING. An index on a single attribute has one, a composite index several.
+ */
+struct KeyAttr{
+  /**
+   * Offset of the attribute inside the record.
+   */
+	int offset;
+
+  /**
+   * Type of the attribute.
+   */
+	Datatype type;
+};
+
+/**
+ * @brief Most attributes the key of a composite index is made of, and most bytes they take once
+ * encoded, see CompositeKey.
+ */
+const int MAX_KEY_ATTRS = 4;
+const int COMPOSITEKEYSIZE = 24;
+
+/**
+ * @brief Bytes an attribute of the given type takes in a CompositeKey: 4 for INTEGER, 8 for DOUBLE
+ * and STRINGSIZE for STRING.
+ */
+int compositeAttrSize( const Datatype type );
+
+/**
+ * @brief Encode the attribute value at value into out, taking compositeAttrSize(type) bytes, so that
+ * encoded values compare bytewise like the values themselves.
+ */
+void encodeCompositeAttr( const Datatype type, const void* value, unsigned char* out );
+
+/**
+ * @brief Key type for COMPOSITE indexes: the values of the key attributes, each encoded by
+ * encodeCompositeAttr() and following the one before, with '\0' bytes after the last. Keys are
+ * ordered bytewise, which orders them by their first attribute, then by their second and so on.
+ */
+struct CompositeKey{
+  /**
+   * Encoded attributes, '\0' padded.
+   */
+	unsigned char data[ COMPOSITEKEYSIZE ];
+};
+
+inline bool operator<( const CompositeKey& a, const CompositeKey& b ) { return memcmp( a.data, b.data, COMPOSITEKEYSIZE ) < 0; }
+inline bool operator>( const CompositeKey& a, const CompositeKey& b ) { return memcmp( a.data, b.data, COMPOSITEKEYSIZE ) > 0; }
+inline bool operator<=( const CompositeKey& a, const CompositeKey& b ) { return memcmp( a.data, b.data, COMPOSITEKEYSIZE ) <= 0; }
+inline bool operator>=( const CompositeKey& a, const CompositeKey& b ) { return memcmp( a.data, b.data, COMPOSITEKEYSIZE ) >= 0; }
+inline bool operator==( const CompositeKey& a, const CompositeKey& b ) { return memcmp( a.data, b.data, COMPOSITEKEYSIZE ) == 0; }
+inline bool operator!=( const CompositeKey& a, const CompositeKey& b ) { return memcmp( a.data, b.data, COMPOSITEKEYSIZE ) != 0; }
+
+/**
+ * @brief 64 bit hash of the bytes of a key, for the key filter of a BTreeIndex: FNV-1a, then mixed
+ * so that every bit of the result depends on every byte.
+ */
+inline std::uint64_t hashKeyBytes( const void* p, const std::size_t len )
+{
+	const unsigned char* bytes = (const unsigned char*) p;
+	std::uint64_t h = 0xcbf29ce484222325ULL;
+	for( std::size_t i = 0; i < len; i++ )
+	{
+		h ^= bytes[ i ];
+		h *= 0x100000001b3ULL;
+	}
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdULL;
+	h ^= h >> 33;
+	h *= 0xc4ceb9fe1a85ec53ULL;
+	h ^= h >> 33;
+	return h;
+}
+
+/**
+ * @brief Maps each key type to its Datatype and reads keys from records and from the untyped
+ * key pointers taken by the BTreeIndex interface.
+ */
+template <class T>
+struct KeyTraits;
+
+template <>
+struct KeyTraits<int>{
+	static const Datatype type = INTEGER;
+
+  /**
+   * Read a key from a pointer to an integer, which need not be aligned.
+   */
+	static int fromPtr( const void* p ) { int k; memcpy( &k, p, sizeof( int ) ); return k; }
+
+  /**
+   * Read the key of a record, whose key attributes are attrs.
+   */
+	static int fromRecord( const char* record, const std::vector<KeyAttr>& attrs ) { return fromPtr( record + attrs[ 0 ].offset ); }
+
+  /**
+   * Separator placed in the parent when a node is split between leftLast and rightFirst.
+   */
+	static int separator( const int& leftLast, const int& rightFirst ) { return rightFirst; }
+
+  /**
+   * Hash of a key, equal for equal keys.
+   */
+	static std::uint64_t hash( const int& k ) { return hashKeyBytes( &k, sizeof( int ) ); }
+
+  /**
+   * Least and greatest keys, which stand in for the missing bound of an open-ended scan.
+   */
+	static int lowest() { return std::numeric_limits<int>::min(); }
+	static int highest() { return std::numeric_limits<int>::max(); }
+};
+
+template <>
+struct KeyTraits<double>{
+	static const Datatype type = DOUBLE;
+
+  /**
+   * Read a key from a pointer to a double, which need not be aligned.
+   */
+	static double fromPtr( const void* p ) { double k; memcpy( &k, p, sizeof( double ) ); return k; }
+
+  /**
+   * Read the key of a record, whose key attributes are attrs.
+   */
+	static double fromRecord( const char* record, const std::vector<KeyAttr>& attrs ) { return fromPtr( record + attrs[ 0 ].offset ); }
+
+  /**
+   * Separator placed in the parent when a node is split between leftLast and rightFirst.
+   */
+	static double separator( const double& leftLast, const double& rightFirst ) { return rightFirst; }
+
+  /**
+   * Hash of a key, equal for equal keys, so -0.0 hashes like 0.0.
+   */
+	static std::uint64_t hash( const double& k ) { const double v = k == 0 ? 0.0 : k; return hashKeyBytes( &v, sizeof( double ) ); }
+
+  /**
+   * Least and greatest keys, which stand in for the missing bound of an open-ended scan.
+   */
+	static double lowest() { return -std::numeric_limits<double>::infinity(); }
+	static double highest() { return std::numeric_limits<double>::infinity(); }
+};
+
+template <>
+struct KeyTraits<StringKey>{
+	static const Datatype type = STRING;
+
+  /**
+   * Read a key from a pointer to a '\0' terminated or at least STRINGSIZE long char string.
+   */
+	static StringKey fromPtr( const void* p ) { StringKey k; strncpy( k.data, (const char*) p, STRINGSIZE ); return k; }
+
+  /**
+   * Read the key of a record, whose key attributes are attrs.
+   */
+	static StringKey fromRecord( const char* record, const std::vector<KeyAttr>& attrs ) { return fromPtr( record + attrs[ 0 ].offset ); }
+
+  /**
+   * Shortest key greater than leftLast and not greater than rightFirst: the prefix of rightFirst up
+   * to and including its first byte that differs from leftLast, padded with '\0'.
+   */
+	static StringKey separator( const StringKey& leftLast, const StringKey& rightFirst )
+	{
+		int len = 0;
+		while( len < STRINGSIZE && leftLast.data[ len ] == rightFirst.data[ len ] )
+			len++;
+		if( len == STRINGSIZE )
+			return rightFirst;
+		StringKey k;
+		memset( k.data, 0, STRINGSIZE );
+		memcpy( k.data, rightFirst.data, len + 1 );
+		return k;
+	}
+
+  /**
+   * Hash of a key, equal for equal keys.
+   */
+	static std::uint64_t hash( const StringKey& k ) { return hashKeyBytes( k.data, STRINGSIZE ); }
+
+  /**
+   * Least and greatest keys, which stand in for the missing bound of an open-ended scan.
+   */
+	static StringKey lowest() { StringKey k; memset( k.data, 0, STRINGSIZE ); return k; }
+	static StringKey highest() { StringKey k; memset( k.data, 0xff, STRINGSIZE ); return k; }
+};
+
+template <>
+struct KeyTraits<CompositeKey>{
+	static const Datatype type = COMPOSITE;
+
+  /**
+   * Read a key from a pointer to an encoded CompositeKey, see BTreeIndex::compositeKey().
+   */
+	static CompositeKey fromPtr( const void* p ) { CompositeKey k; memcpy( k.data, p, COMPOSITEKEYSIZE ); return k; }
+
+  /**
+   * Encode the key attributes attrs of a record.
+   */
+	static CompositeKey fromRecord( const char* record, const std::vector<KeyAttr>& attrs )
+	{
+		CompositeKey k;
+		memset( k.data, 0, COMPOSITEKEYSIZE );
+		unsigned char* out = k.data;
+		for( size_t i = 0; i < attrs.size(); i++ )
+		{
+			encodeCompositeAttr( attrs[ i ].type, record + attrs[ i ].offset, out );
+			out += compositeAttrSize( attrs[ i ].type );
+		}
+		return k;
+	}
+
+  /**
+   * Separator placed in the parent when a node is split between leftLast and rightFirst.
+   */
+	static CompositeKey separator( const CompositeKey& leftLast, const CompositeKey& rightFirst ) { return rightFirst; }
+
+  /**
+   * Hash of a key, equal for equal keys.
+   */
+	static std::uint64_t hash( const CompositeKey& k ) { return hashKeyBytes( k.data, COMPOSITEKEYSIZE ); }
+
+  /**
+   * Least and greatest keys, which stand in for the missing bound of an open-ended scan.
+   */
+	static CompositeKey lowest() { CompositeKey k; memset( k.data, 0, COMPOSITEKEYSIZE ); return k; }
+	static CompositeKey highest() { CompositeKey k; memset( k.data, 0xff, COMPOSITEKEYSIZE ); return k; }
 };
 
+/**
+ * @brief Number of key slots in a B+Tree leaf for keys of type T.
+ */
+//                                                                       sibling ptrs   numKeys + numGroups + payloadLen     fences           key            rid
+template <class T>
+constexpr int leafArraySize() { return ( Page::BLOB_SIZE - 2 * sizeof( PageId ) - 3 * sizeof( int ) - 2 * sizeof( T ) ) / ( sizeof( T ) + sizeof( RecordId ) ); }
+
+/**
+ * @brief Bytes of a B+Tree leaf for keys of type T taken by its key and rid arrays, which a leaf
+ * holding postings uses as one area.
+ */
+template <class T>
+constexpr int leafDataSize() { return leafArraySize<T>() * ( sizeof( T ) + sizeof( RecordId ) ); }
+
+/**
+ * @brief Number of key slots in a B+Tree non-leaf for keys of type T.
+ */
+//                                                                         level    numKeys      extra pageNo            key       pageNo
+template <class T>
+constexpr int nonLeafArraySize() { return ( Page::BLOB_SIZE - sizeof( int ) - sizeof( int ) - sizeof( PageId ) ) / ( sizeof( T ) + sizeof( PageId ) ); }
 
 /**
  * @brief Number of key slots in B+Tree leaf for INTEGER key.
  */
-//                                                  sibling ptr             key               rid
-const  int INTARRAYLEAFSIZE = ( Page::SIZE - sizeof( PageId ) ) / ( sizeof( int ) + sizeof( RecordId ) );
+const  int INTARRAYLEAFSIZE = leafArraySize<int>();
 
 /**
  * @brief Number of key slots in B+Tree non-leaf for INTEGER key.
  */
-//                                                     level     extra pageNo                  key       pageNo
-const  int INTARRAYNONLEAFSIZE = ( Page::SIZE - sizeof( int ) - sizeof( PageId ) ) / ( sizeof( int ) + sizeof( PageId ) );
+const  int INTARRAYNONLEAFSIZE = nonLeafArraySize<int>();
+
+/**
+ * @brief Number of key slots in B+Tree leaf for DOUBLE key.
+ */
+const  int DOUBLEARRAYLEAFSIZE = leafArraySize<double>();
+
+/**
+ * @brief Number of key slots in B+Tree non-leaf for DOUBLE key.
+ */
+const  int DOUBLEARRAYNONLEAFSIZE = nonLeafArraySize<double>();
+
+/**
+ * @brief Number of key slots in B+Tree leaf for COMPOSITE key.
+ */
+const  int COMPOSITEARRAYLEAFSIZE = leafArraySize<CompositeKey>();
+
+/**
+ * @brief Number of key slots in B+Tree non-leaf for COMPOSITE key.
+ */
+const  int COMPOSITEARRAYNONLEAFSIZE = nonLeafArraySize<CompositeKey>();
+
+/**
+ * @brief Bytes of a STRING node left for its entries after the node header and the common prefix.
+ */
+//                                               numKeys/level + sibling ptrs/numKeys     prefixLen + suffixLen      prefix
+const  int STRINGNODEDATASIZE = Page::BLOB_SIZE - 3 * sizeof( int ) - 2 * sizeof( unsigned char ) - STRINGSIZE;
+
+/**
+ * @brief Bytes of a STRING leaf left for its entries, which is STRINGNODEDATASIZE less the fence keys.
+ */
+const  int STRINGLEAFDATASIZE = STRINGNODEDATASIZE - 2 * STRINGSIZE;
+
+/**
+ * @brief Maximum number of entries in a B+Tree leaf for STRING key. Keys are stored without the
+ * node's common prefix, so the number that fits depends on the keys; the limit lets either half of
+ * a split hold its entries uncompressed.
+ */
+const  int STRINGARRAYLEAFSIZE = 2 * ( STRINGLEAFDATASIZE / ( STRINGSIZE + sizeof( RecordId ) ) ) - 1;
+
+/**
+ * @brief Maximum number of keys in a B+Tree non-leaf for STRING key, limited like STRINGARRAYLEAFSIZE.
+ */
+const  int STRINGARRAYNONLEAFSIZE = 2 * ( ( STRINGNODEDATASIZE - sizeof( PageId ) ) / ( STRINGSIZE + sizeof( PageId ) ) );
+
+/**
+ * @brief Default fraction of every node filled when an index is bulk loaded.
+ */
+const double DEFAULT_FILL_FACTOR = 1.0;
+
+/**
+ * @brief Default and largest number of leaves a range scan has read ahead of it, see
+ * BTreeIndex::setScanReadAhead(). Leaves are read ahead through a BufRing, so more leaves than half
+ * a ring could be recycled before the scan reaches them.
+ */
+const int DEFAULT_SCAN_READ_AHEAD = 8;
+const int MAX_SCAN_READ_AHEAD = BufRing::DEFAULT_SIZE / 2;
+
+/**
+ * @brief Default number of leaves a LeafModel may be off by, see BTreeIndex::setLeafModel().
+ */
+const int DEFAULT_LEAF_MODEL_ERROR = 1;
+
+/**
+ * @brief Most attributes a covering index stores with its entries, and most bytes they take
+ * together, see IncludedAttr.
+ */
+const int MAX_INCLUDED_ATTRS = 4;
+const int MAX_PAYLOAD_SIZE = 64;
+
+/**
+ * @brief Fraction of a node's capacity below which deleteEntry() merges the node into a sibling,
+ * if the two fit in one node.
+ */
+const double MERGE_THRESHOLD = 0.25;
+
+/**
+ * @brief Fraction of the entries a rightmost leaf keeps when an entry appended after all of its keys
+ * splits it. Ascending inserts then leave nearly full leaves behind instead of half empty ones.
+ */
+const double APPEND_SPLIT_FILL = 0.9;
 
 const RecordId INVALID_RECORD = {Page::INVALID_NUMBER,Page::INVALID_SLOT};
+template <class T>
+struct ProbeBatch;
+
 /**
  * @brief Structure to store a key-rid pair. It is used to pass the pair to functions that 
  * add to or make changes to the leaf node pages of the tree. Is templated for the key member.
@@ -72,248 +456,1755 @@ public:
 	}
 };
 
-/**
- * @brief Structure to store a key page pair which is used to pass the key and page to functions that make 
- * any modifications to the non leaf pages of the tree.
-*/
-template <class T>
-class PageKeyPair{
-public:
-	PageId pageNo;
-	T key;
-	void set( int p, T k)
-	{
-		pageNo = p;
-		key = k;
-	}
-};
+/**
+ * @brief Structure to store a key page pair which is used to pass the key and page to functions that make 
+ * any modifications to the non leaf pages of the tree.
+*/
+template <class T>
+class PageKeyPair{
+public:
+	PageId pageNo;
+	T key;
+	void set( int p, T k)
+	{
+		pageNo = p;
+		key = k;
+	}
+};
+
+/**
+ * @brief Overloaded operator to compare the key values of two rid-key pairs
+ * and if they are the same compares to see if the first pair has
+ * a smaller rid.pageNo value.
+*/
+template <class T>
+bool operator<( const RIDKeyPair<T>& r1, const RIDKeyPair<T>& r2 )
+{
+	if( r1.key != r2.key )
+		return r1.key < r2.key;
+	else
+		return r1.rid.page_number < r2.rid.page_number;
+}
+
+/**
+ * @brief An attribute a covering index copies from each record into its leaves, so that scans can
+ * return it without reading the record.
+ */
+struct IncludedAttr{
+  /**
+   * Offset of the attribute inside the record.
+   */
+	int offset;
+
+  /**
+   * Bytes of the attribute.
+   */
+	int length;
+};
+
+/**
+ * @brief The meta page, which holds metadata for Index file, is always first page of the btree index file and is cast
+ * to the following structure to store or retrieve information from it.
+ * Contains the relation name for which the index is created, the byte offset
+ * of the key value on which the index is made, the type of the key and the page no
+ * of the root page. Root page starts as page 2 but since a split can occur
+ * at the root the root page may get moved up and get a new page no.
+ * The meta page is rewritten whenever the root moves, so reopening an index never
+ * needs to look further than this page.
+*/
+struct IndexMetaInfo{
+  /**
+   * Name of base relation.
+   */
+	char relationName[20];
+
+  /**
+   * Offset of attribute, over which index is built, inside the record stored in pages.
+   */
+	int attrByteOffset;
+
+  /**
+   * Type of the attribute over which index is built.
+   */
+	Datatype attrType;
+
+  /**
+   * Page number of root page of the B+ Tree inside the file index file.
+   */
+	PageId rootPageNo;
+
+  /**
+   * Number of levels in the tree, counting the leaf level.
+   */
+	int height;
+
+  /**
+   * Number of (key, rid) entries stored in the leaves.
+   */
+	int numEntries;
+
+  /**
+   * Number of leaf pages.
+   */
+	int numLeaves;
+
+  /**
+   * First page of the list of index pages freed by merges, INVALID_NUMBER if there is none.
+   * Each free page starts with the page number of the next one.
+   */
+	PageId freePageNo;
+
+  /**
+   * Number of non-leaf pages.
+   */
+	int numNonLeaves;
+
+  /**
+   * Number of leaf and non-leaf splits since the index was built.
+   */
+	int leafSplits;
+	int nonLeafSplits;
+
+  /**
+   * Number of merges of two nodes into one since the index was built.
+   */
+	int merges;
+
+  /**
+   * Attributes stored with every entry of a covering index; numIncluded is 0 for other indexes.
+   */
+	int numIncluded;
+	IncludedAttr included[ MAX_INCLUDED_ATTRS ];
+
+  /**
+   * Attributes the key is made of; one, at attrByteOffset and of attrType, unless attrType is COMPOSITE.
+   */
+	int numKeyAttrs;
+	KeyAttr keyAttrs[ MAX_KEY_ATTRS ];
+
+  /**
+   * First page of the saved key filter, INVALID_NUMBER if none was ever saved, and its shape, see
+   * BTreeIndex::setKeyFilter(). keyFilterBlocks is 0 while the index has no key filter.
+   */
+	PageId keyFilterPageNo;
+	int keyFilterBlocks;
+	int keyFilterHashes;
+
+  /**
+   * Set when the index is closed with its key filter saved, and cleared again when it is opened for
+   * writing, so that a filter missing the keys of later inserts is never read back.
+   */
+	int keyFilterSaved;
+};
+
+/**
+ * @brief Number of 64 bit words of a key filter a page holds.
+ */
+const int KEY_FILTER_PAGE_WORDS = ( Page::BLOB_SIZE - sizeof( std::uint64_t ) ) / sizeof( std::uint64_t );
+
+/**
+ * @brief A page of the key filter saved in an index file.
+ */
+struct KeyFilterPage{
+  /**
+   * Next page of the filter, INVALID_NUMBER for the last one.
+   */
+	PageId nextPageNo;
+
+  /**
+   * Words of the filter, the first ones of the filter on its first page.
+   */
+	std::uint64_t words[ KEY_FILTER_PAGE_WORDS ];
+};
+
+/*
+Each node is a page, so once we read the page in we just cast the pointer to the page to this struct and use it to access the parts
+These structures basically are the format in which the information is stored in the pages for the index file depending on what kind of 
+node they are. They are templated on the key type, so the node layout of each Datatype is fixed at compile time. Only the first numKeys entries of a node are meaningful; the rest of the arrays is garbage. The level memeber of each non leaf structure seen below is set to 1 if the nodes 
+at this level are just above the leaf nodes. Otherwise set to 0.
+*/
+
+/**
+ * @brief Structure for all non-leaf nodes with keys of type T.
+*/
+template <class T>
+struct NonLeafNode{
+  /**
+   * Level of the node in the tree.
+   */
+	int level;
+
+  /**
+   * Number of keys in use. The node has numKeys + 1 children.
+   */
+	int numKeys;
+
+  /**
+   * Stores keys.
+   */
+	T keyArray[ nonLeafArraySize<T>() ];
+
+  /**
+   * Stores page numbers of child pages which themselves are other non-leaf/leaf nodes in the tree.
+   */
+	PageId pageNoArray[ nonLeafArraySize<T>() + 1 ];
+};
+
+
+/**
+ * @brief Structure for all leaf nodes with keys of type T.
+ *
+ * A leaf whose keys repeat may hold postings instead of the two arrays: keyArray and ridArray then
+ * form one area of leafDataSize() bytes, with each distinct key stored once at the front and the
+ * packed record ids of all entries at the back (see LeafFormat). A full INTEGER leaf may instead
+ * keep its keys at the front as bit-packed deltas from its first key. The leaves of a covering
+ * index always hold postings, with the payload of each entry after its record id.
+ *
+ * The fence keys bound the keys of the leaf and of its neighbours: every key of the leaf lies between
+ * lowFence and highFence, keys of the leaves to its left are not greater than lowFence and keys of the
+ * leaves to its right not less than highFence. They are the separators the parent levels hold for the
+ * leaf, or the least and greatest key at the ends of the leaf level.
+*/
+template <class T>
+struct LeafNode{
+  /**
+   * Number of (key, rid) entries in use.
+   */
+	int numKeys;
+
+  /**
+   * Number of distinct keys if the leaf holds postings, 0 if it holds plain key and rid arrays and
+   * -1 if it holds packed INTEGER keys.
+   */
+	int numGroups;
+
+  /**
+   * Bytes of payload packed after the record id of every entry, 0 unless the index is covering.
+   */
+	int payloadLen;
+
+  /**
+   * Fence keys of the leaf.
+   */
+	T lowFence;
+	T highFence;
+
+  /**
+   * Stores keys.
+   */
+	T keyArray[ leafArraySize<T>() ];
+
+  /**
+   * Stores RecordIds.
+   */
+	RecordId ridArray[ leafArraySize<T>() ];
+
+  /**
+   * Page number of the leaf on the right side.
+	 * This linking of leaves allows to easily move from one leaf to the next leaf during index scan.
+   */
+	PageId rightSibPageNo;
+
+  /**
+   * Page number of the leaf on the left side, followed by descending scans.
+   */
+	PageId leftSibPageNo;
+};
+
+/**
+ * @brief Structure for all non-leaf nodes when the key is of STRING type.
+ *
+ * Separators are truncated to the bytes needed to tell their children apart, and only the bytes
+ * after the prefix shared by all separators of the node are stored, each in suffixLen bytes.
+ * data holds the first child's page number followed by numKeys (suffix, right child page number)
+ * pairs, so the fan-out grows as the separators get shorter.
+*/
+template <>
+struct NonLeafNode<StringKey>{
+  /**
+   * Level of the node in the tree.
+   */
+	int level;
+
+  /**
+   * Number of keys in use. The node has numKeys + 1 children.
+   */
+	int numKeys;
+
+  /**
+   * Number of leading bytes shared by all keys of the node.
+   */
+	unsigned char prefixLen;
+
+  /**
+   * Number of bytes stored for each key after the prefix; the rest of the key is '\0'.
+   */
+	unsigned char suffixLen;
+
+  /**
+   * Bytes shared by all keys of the node.
+   */
+	char prefix[ STRINGSIZE ];
+
+  /**
+   * First child page number, then a key suffix and right child page number per key.
+   */
+	char data[ STRINGNODEDATASIZE ];
+};
+
+/**
+ * @brief Structure for all leaf nodes when the key is of STRING type.
+ *
+ * Keys are stored like the separators of NonLeafNode<StringKey>: without the prefix they share,
+ * each in suffixLen bytes followed by its RecordId.
+*/
+template <>
+struct LeafNode<StringKey>{
+  /**
+   * Number of (key, rid) entries in use.
+   */
+	int numKeys;
+
+  /**
+   * Page number of the leaf on the right side.
+   */
+	PageId rightSibPageNo;
+
+  /**
+   * Page number of the leaf on the left side.
+   */
+	PageId leftSibPageNo;
+
+  /**
+   * Number of leading bytes shared by all keys of the node.
+   */
+	unsigned char prefixLen;
+
+  /**
+   * Number of bytes stored for each key after the prefix; the rest of the key is '\0'.
+   */
+	unsigned char suffixLen;
+
+  /**
+   * Bytes shared by all keys of the node.
+   */
+	char prefix[ STRINGSIZE ];
+
+  /**
+   * Fence keys of the leaf, see LeafNode.
+   */
+	StringKey lowFence;
+	StringKey highFence;
+
+  /**
+   * (key suffix, RecordId) entries.
+   */
+	char data[ STRINGLEAFDATASIZE ];
+};
+
+/**
+ * @brief Structure for all non-leaf nodes when the key is of INTEGER type.
+*/
+typedef NonLeafNode<int> NonLeafNodeInt;
+
+/**
+ * @brief Structure for all leaf nodes when the key is of INTEGER type.
+*/
+typedef LeafNode<int> LeafNodeInt;
+
+/**
+ * @brief Structure for all non-leaf nodes when the key is of DOUBLE type.
+*/
+typedef NonLeafNode<double> NonLeafNodeDouble;
+
+/**
+ * @brief Structure for all leaf nodes when the key is of DOUBLE type.
+*/
+typedef LeafNode<double> LeafNodeDouble;
+
+/**
+ * @brief Structure for all non-leaf nodes when the key is of STRING type.
+*/
+typedef NonLeafNode<StringKey> NonLeafNodeString;
+
+/**
+ * @brief Structure for all leaf nodes when the key is of STRING type.
+*/
+typedef LeafNode<StringKey> LeafNodeString;
+
+/**
+ * @brief Structure for all non-leaf nodes when the key is COMPOSITE.
+*/
+typedef NonLeafNode<CompositeKey> NonLeafNodeComposite;
+
+/**
+ * @brief Structure for all leaf nodes when the key is COMPOSITE.
+*/
+typedef LeafNode<CompositeKey> LeafNodeComposite;
+
+static_assert(sizeof(NonLeafNodeInt) <= Page::BLOB_SIZE && sizeof(NonLeafNodeDouble) <= Page::BLOB_SIZE
+              && sizeof(NonLeafNodeString) <= Page::BLOB_SIZE && sizeof(NonLeafNodeComposite) <= Page::BLOB_SIZE,
+              "Non-leaf node must fit in a page before its trailer.");
+static_assert(sizeof(LeafNodeInt) <= Page::BLOB_SIZE && sizeof(LeafNodeDouble) <= Page::BLOB_SIZE
+              && sizeof(LeafNodeString) <= Page::BLOB_SIZE && sizeof(LeafNodeComposite) <= Page::BLOB_SIZE,
+              "Leaf node must fit in a page before its trailer.");
+
+
+class BTreeIndex;
+
+/**
+ * @brief Optimistic latch of one index node.
+ *
+ * The latch is a version counter that is odd while a writer holds it. Readers do not take it: they
+ * note the version before reading the node and check afterwards that it did not change, and start
+ * over if it did. Writers bump the version twice, on lock and on unlock.
+ */
+class NodeLatch {
+ public:
+	NodeLatch() : version(0) {}
+
+  /**
+   * Wait until no writer holds the latch and return the version a reader validates against.
+   */
+	std::uint64_t readLock() const
+	{
+		std::uint64_t v;
+		while((v = version.load(std::memory_order_acquire)) & 1){
+			std::this_thread::yield();
+		}
+		return v;
+	}
+
+  /**
+   * True if the node did not change since readLock() returned v.
+   */
+	bool validate(const std::uint64_t v) const
+	{
+		std::atomic_thread_fence(std::memory_order_acquire);
+		return version.load(std::memory_order_relaxed) == v;
+	}
+
+  /**
+   * Take the latch for writing if the node did not change since readLock() returned v.
+   *
+   * @return False if the node changed or another writer holds the latch.
+   */
+	bool upgrade(std::uint64_t v)
+	{
+		return version.compare_exchange_strong(v, v + 1, std::memory_order_acquire);
+	}
+
+  /**
+   * Take the latch for writing, waiting for other writers.
+   */
+	void lock()
+	{
+		while(!upgrade(readLock())){
+		}
+	}
+
+	void unlock()
+	{
+		version.fetch_add(1, std::memory_order_release);
+	}
+
+ private:
+	std::atomic<std::uint64_t> version;
+};
+
+/**
+ * @brief The NodeLatch of every page of an index file, kept next to the buffer pool so that the
+ * node format does not change.
+ *
+ * Latches are allocated in chunks of 2^CHUNK_BITS pages the first time a page of the chunk is
+ * latched. Files of more than NUM_CHUNKS chunks share latches between pages, which only costs
+ * spurious restarts.
+ */
+class NodeLatchTable {
+ public:
+	static const int CHUNK_BITS = 12;
+	static const int NUM_CHUNKS = 1 << 14;
+
+	NodeLatchTable() : chunks(new std::atomic<NodeLatch*>[NUM_CHUNKS])
+	{
+		for(int i = 0; i < NUM_CHUNKS; i++){
+			chunks[i] = NULL;
+		}
+	}
+
+	~NodeLatchTable()
+	{
+		for(int i = 0; i < NUM_CHUNKS; i++){
+			delete [] chunks[i].load();
+		}
+		delete [] chunks;
+	}
+
+  /**
+   * Latch of page pageNo.
+   */
+	NodeLatch &of(const PageId pageNo)
+	{
+		std::atomic<NodeLatch*> &chunk = chunks[(pageNo >> CHUNK_BITS) % NUM_CHUNKS];
+		NodeLatch *latches = chunk.load(std::memory_order_acquire);
+		if(latches == NULL){
+			NodeLatch *fresh = new NodeLatch[1 << CHUNK_BITS];
+			if(chunk.compare_exchange_strong(latches, fresh)){
+				latches = fresh;
+			}else{
+				delete [] fresh; // another thread allocated the chunk first
+			}
+		}
+		return latches[pageNo & ((1 << CHUNK_BITS) - 1)];
+	}
+
+ private:
+	NodeLatchTable(const NodeLatchTable&) = delete;
+	NodeLatchTable& operator=(const NodeLatchTable&) = delete;
+
+	std::atomic<NodeLatch*> *chunks;
+};
+
+/**
+ * @brief Frames of the upper nodes of an index, kept pinned while the index is open so that a
+ * descent reaches them without going through the buffer manager.
+ *
+ * An open addressing table that only grows. A page stays cached until the index is closed, even
+ * after a merge frees it or the tree grows above it: its frame stays valid while it is pinned.
+ * Lookups take no latch, since a slot's page is written before its page number is published.
+ */
+class NodeCache {
+ public:
+	static const int CAPACITY = 1024;
+
+  /**
+   * Most nodes cached at once, so that lookups always find an empty slot.
+   */
+	static const int MAX_NODES = CAPACITY / 2;
+
+	NodeCache() : count(0)
+	{
+		for(int i = 0; i < CAPACITY; i++){
+			pageNos[i] = Page::INVALID_NUMBER;
+			pages[i] = NULL;
+		}
+	}
+
+  /**
+   * The cached frame of page pageNo, NULL if it is not cached.
+   */
+	Page *find(const PageId pageNo) const
+	{
+		for(int i = slot(pageNo); ; i = (i + 1) & (CAPACITY - 1)){
+			const PageId cached = pageNos[i].load(std::memory_order_acquire);
+			if(cached == pageNo){
+				return pages[i];
+			}
+			if(cached == Page::INVALID_NUMBER){
+				return NULL;
+			}
+		}
+	}
+
+  /**
+   * Cache the frame of page pageNo, which the caller pins once more for the cache if this succeeds.
+   *
+   * @param limit  Most nodes to cache, at most MAX_NODES
+   * @return False if the page is already cached or limit nodes are
+   */
+	bool insert(const PageId pageNo, Page *page, const int limit)
+	{
+		std::lock_guard<std::mutex> guard(latch);
+		if(count >= limit || count >= MAX_NODES){
+			return false;
+		}
+		int i = slot(pageNo);
+		for(; pageNos[i] != Page::INVALID_NUMBER; i = (i + 1) & (CAPACITY - 1)){
+			if(pageNos[i] == pageNo){
+				return false;
+			}
+		}
+		pages[i] = page;
+		pageNos[i].store(pageNo, std::memory_order_release);
+		count++;
+		return true;
+	}
+
+  /**
+   * Page numbers of the cached nodes.
+   */
+	std::vector<PageId> pageNumbers() const
+	{
+		std::vector<PageId> cached;
+		for(int i = 0; i < CAPACITY; i++){
+			if(pageNos[i] != Page::INVALID_NUMBER){
+				cached.push_back(pageNos[i]);
+			}
+		}
+		return cached;
+	}
+
+ private:
+	NodeCache(const NodeCache&) = delete;
+	NodeCache& operator=(const NodeCache&) = delete;
+
+	static int slot(const PageId pageNo)
+	{
+		return (int) ((pageNo * 2654435761u) & (CAPACITY - 1));
+	}
+
+	std::atomic<PageId> pageNos[CAPACITY];
+	Page *pages[CAPACITY];
+	std::mutex latch;
+	int count;
+};
+
+/**
+ * @brief Blocked Bloom filter over the keys of an index, so that lookups of absent keys mostly end
+ * before reading any node.
+ *
+ * The filter is an array of 512 bit blocks, one cache line each. A key sets numHashes bits in the one
+ * block its hash picks, so a probe misses the cache at most once. Bits are set with atomic or, so keys
+ * can be added while other threads probe; deleted keys are never removed, which only costs false
+ * positives. A filter without blocks holds every key.
+ */
+class KeyFilter {
+ public:
+	static const int BLOCK_WORDS = 8;
+
+	KeyFilter() : numBlocks(0), numHashes(0) {}
+
+  /**
+   * Empty the filter and give it blocks blocks setting hashes bits per key, 0 blocks to hold every key.
+   */
+	void reset(const std::size_t blocks, const int hashes)
+	{
+		words = std::vector<std::atomic<std::uint64_t> >(blocks * BLOCK_WORDS);
+		numBlocks = blocks;
+		numHashes = hashes;
+	}
+
+	bool enabled() const { return numBlocks > 0; }
+	std::size_t blocks() const { return numBlocks; }
+	int hashes() const { return numHashes; }
+
+  /**
+   * Add the key with the given hash.
+   */
+	void add(const std::uint64_t hash)
+	{
+		if(numBlocks == 0){
+			return;
+		}
+		std::atomic<std::uint64_t> *block = &words[blockIndex(hash)];
+		std::uint32_t h = (std::uint32_t) hash;
+		const std::uint32_t delta = (h >> 17) | (h << 15);
+		for(int i = 0; i < numHashes; i++, h += delta){
+			block[(h >> 6) & (BLOCK_WORDS - 1)].fetch_or(std::uint64_t(1) << (h & 63), std::memory_order_relaxed);
+		}
+	}
+
+  /**
+   * False only if no key with the given hash was added.
+   */
+	bool mayContain(const std::uint64_t hash) const
+	{
+		if(numBlocks == 0){
+			return true;
+		}
+		const std::atomic<std::uint64_t> *block = &words[blockIndex(hash)];
+		std::uint32_t h = (std::uint32_t) hash;
+		const std::uint32_t delta = (h >> 17) | (h << 15);
+		for(int i = 0; i < numHashes; i++, h += delta){
+			if(!(block[(h >> 6) & (BLOCK_WORDS - 1)].load(std::memory_order_relaxed) & (std::uint64_t(1) << (h & 63)))){
+				return false;
+			}
+		}
+		return true;
+	}
+
+  /**
+   * Word i of the filter, for saving it, and setting it back.
+   */
+	std::uint64_t word(const std::size_t i) const { return words[i].load(std::memory_order_relaxed); }
+	void setWord(const std::size_t i, const std::uint64_t w) { words[i].store(w, std::memory_order_relaxed); }
+	std::size_t numWords() const { return words.size(); }
+
+ private:
+	KeyFilter(const KeyFilter&) = delete;
+	KeyFilter& operator=(const KeyFilter&) = delete;
+
+  /**
+   * First word of the block of a hash, picked by its high 32 bits; the low ones pick the bits inside it.
+   */
+	std::size_t blockIndex(const std::uint64_t hash) const
+	{
+		return (std::size_t) (((hash >> 32) * numBlocks) >> 32) * BLOCK_WORDS;
+	}
+
+	std::vector<std::atomic<std::uint64_t> > words;
+	std::size_t numBlocks;
+	int numHashes;
+};
+
+/**
+ * @brief Piecewise linear model of the leaf level of an immutable INTEGER index, which predicts the
+ * leaf of a key without reading the non-leaf levels, in the manner of a RadixSpline.
+ *
+ * The leaves are numbered from left to right, and leaf j holds the keys up to its high fence, the
+ * separator j. The model is a linear spline through some of the points (separator, leaf number),
+ * chosen by a greedy corridor so that it is off by at most maxError leaves at every separator. A
+ * radix table over the leading bits of the keys narrows the search for the spline segment of a key
+ * to a few knots. Leaves allocated one after the other, as by a bulk load, take no memory at all;
+ * otherwise their page numbers are kept in an array.
+ */
+class LeafModel {
+ public:
+	LeafModel() : numLeaves(0), firstLeaf(Page::INVALID_NUMBER), minKey(0), shift(0) {}
+
+	bool enabled() const { return numLeaves > 0; }
+
+  /**
+   * Fit the model to the leaves of an index.
+   *
+   * @param separators  The separators between the leaves, in order, one fewer than the leaves
+   * @param leaves      Page numbers of the leaves, from left to right
+   * @param maxError    Most leaves the prediction for a separator may be off by
+   */
+	void build(const std::vector<int> &separators, const std::vector<PageId> &leaves, const int maxError);
+
+  /**
+   * Drop the model.
+   */
+	void clear();
+
+  /**
+   * Predicted number of the leaf holding key.
+   */
+	std::size_t predict(const int key) const;
+
+  /**
+   * Page number of leaf number leaf.
+   */
+	PageId leafPage(const std::size_t leaf) const { return leafPages.empty() ? firstLeaf + (PageId) leaf : leafPages[leaf]; }
+
+  /**
+   * Number of knots of the spline, and bytes taken by the model.
+   */
+	std::size_t knots() const { return spline.size(); }
+	std::size_t bytes() const
+	{
+		return spline.size() * sizeof(Knot) + radix.size() * sizeof(std::uint32_t) + leafPages.size() * sizeof(PageId);
+	}
+
+ private:
+  /**
+   * A point the spline goes through: a separator and the number of the first leaf it bounds.
+   */
+	struct Knot{
+		int key;
+		std::uint32_t leaf;
+	};
+
+	std::vector<Knot> spline;
+
+  /**
+   * Entry b is the first knot whose key, less minKey, shifted right by shift is at least b.
+   */
+	std::vector<std::uint32_t> radix;
+
+  /**
+   * Page numbers of the leaves, empty if they follow firstLeaf one after the other.
+   */
+	std::vector<PageId> leafPages;
+
+	std::size_t numLeaves;
+	PageId firstLeaf;
+	int minKey;
+	int shift;
+};
+
+struct PathEntry;
+
+/**
+ * @brief State of one range scan over a BTreeIndex.
+ *
+ * Any number of cursors can scan the same index at once, e.g. the inner side of a nested-loop index
+ * join next to an outer scan. Each cursor keeps the leaf it is positioned on pinned until its scan
+ * ends, so cursors must be ended or destroyed before the index they scan. A started cursor may only
+ * be passed to the index it was started on.
+*/
+class IndexCursor {
+	friend class BTreeIndex;
+
+ public:
+
+  /**
+   * Create a cursor that is not scanning yet; start it with BTreeIndex::startScan().
+   */
+	IndexCursor();
+
+  /**
+   * End the scan of the cursor, if one is running. Does not throw.
+   */
+	~IndexCursor();
+
+  /**
+   * True between a successful BTreeIndex::startScan() and BTreeIndex::endScan() on this cursor.
+   */
+	bool isScanning() const { return scanExecuting; }
+
+ private:
+
+	IndexCursor(const IndexCursor&) = delete;
+	IndexCursor& operator=(const IndexCursor&) = delete;
+
+  /**
+   * Low and high bound of the scan as keys of type T.
+   */
+	template <class T>
+	void bounds(T &low, T &high) const;
+
+  /**
+   * Index being scanned.
+   */
+	BTreeIndex	*index;
+
+  /**
+   * True if an index scan has been started.
+   */
+	bool		scanExecuting;
+
+  /**
+   * True if the scan returns its entries from the high bound down.
+   */
+	bool		descending;
+
+  /**
+   * Number of leaves the next read-ahead of the scan asks for, and leaves still to be entered before
+   * it is asked for. See BTreeIndex::readAheadLeaves().
+   */
+	int			readAheadWindow;
+	int			readAheadLeft;
+
+  /**
+   * Index of next entry to be scanned in current leaf being scanned.
+   */ 
+	int			nextEntry;
+
+  /**
+   * Page number of current page being scanned.
+   */
+	PageId	currentPageNum;
+
+  /**
+   * Current Page being scanned.
+   */
+	Page		*currentPageData;
+
+  /**
+   * Version of the latch of the current page when the cursor last validated it. If the leaf
+   * changes meanwhile, the cursor is positioned again from the root.
+   */
+	std::uint64_t	leafVersion;
+
+  /**
+   * Last key returned by the scan, as the bytes of a key of the index type.
+   */
+	char		resumeKey[sizeof(CompositeKey)];
+
+  /**
+   * Number of entries with key resumeKey returned so far, or -1 before the first entry is returned.
+   */
+	int			resumeDups;
+
+  /**
+   * Low INTEGER value for scan.
+   */
+	int			lowValInt;
+
+  /**
+   * Low DOUBLE value for scan.
+   */
+	double	lowValDouble;
+
+  /**
+   * Low STRING or COMPOSITE value for scan, as the bytes of its StringKey or CompositeKey.
+   */
+	std::string	lowValString;
+
+  /**
+   * High INTEGER value for scan.
+   */
+	int			highValInt;
+
+  /**
+   * High DOUBLE value for scan.
+   */
+	double	highValDouble;
+
+  /**
+   * High STRING or COMPOSITE value for scan, as the bytes of its StringKey or CompositeKey.
+   */
+	std::string highValString;
+	
+  /**
+   * Low Operator. Can only be GT(>) or GTE(>=); GTE with the least key if the range has no low bound.
+   */
+	Operator	lowOp;
+
+  /**
+   * High Operator. Can only be LT(<) or LTE(<=); LTE with the greatest key if the range has no high bound.
+   */
+	Operator	highOp;
+};
+
+/**
+ * @brief Counters of the shape of a BTreeIndex, kept up to date by inserts and deletes and stored
+ * on the meta page. Returned by BTreeIndex::getStats().
+*/
+struct IndexStats{
+  /**
+   * Number of levels in the tree, counting the leaf level.
+   */
+	int height;
+
+  /**
+   * Number of (key, rid) entries stored in the leaves.
+   */
+	int numEntries;
+
+  /**
+   * Number of leaf and non-leaf pages.
+   */
+	int numLeaves;
+	int numNonLeaves;
+
+  /**
+   * Number of leaf and non-leaf splits since the index was built.
+   */
+	int leafSplits;
+	int nonLeafSplits;
+
+  /**
+   * Number of merges of two nodes into one since the index was built.
+   */
+	int merges;
+
+  /**
+   * Number of inserts since the index was opened that went straight to the rightmost leaf.
+   */
+	int appends;
+
+  /**
+   * Number of entries waiting in the insert buffer, not counted in numEntries yet, and number of times
+   * the buffer was flushed into the tree since the index was opened.
+   */
+	int bufferedEntries;
+	int bufferFlushes;
+
+  /**
+   * Number of knots of the leaf model and bytes it takes, 0 without one, see BTreeIndex::setLeafModel().
+   */
+	int leafModelKnots;
+	int leafModelBytes;
+
+  /**
+   * Average fraction of the capacity of a leaf in use, numEntries over numLeaves full leaves.
+   * Above 1 when leaves hold postings of repeated keys.
+   */
+	double leafFill;
+};
+
+/**
+ * @brief Nodes of one level of a BTreeIndex, counted by BTreeIndex::inspect().
+*/
+struct IndexLevelShape{
+  /**
+   * Number of nodes on the level.
+   */
+	int nodes;
+
+  /**
+   * Number of keys in the nodes of the level: entries in leaves, separators in non-leaves.
+   */
+	int keys;
+
+  /**
+   * Fewest and most keys in one node of the level.
+   */
+	int minKeys;
+	int maxKeys;
+
+  /**
+   * Average fraction of the capacity of a node of the level in use. The capacity of STRING nodes is
+   * the most keys they are allowed to hold, whatever their prefix.
+   */
+	double fill;
+};
+
+/**
+ * @brief An entry waiting in the insert buffer of a BTreeIndex, see BTreeIndex::setInsertBuffer().
+*/
+struct BufferedInsert{
+  /**
+   * Key of the entry, as the bytes of a key of the index type.
+   */
+	char key[sizeof(CompositeKey)];
+
+	RecordId rid;
+
+  /**
+   * Payload of the entry if the index is covering.
+   */
+	char payload[MAX_PAYLOAD_SIZE];
+};
+
+/**
+ * @brief Shape of a BTreeIndex found by walking every node, returned by BTreeIndex::inspect().
+*/
+struct IndexShape{
+  /**
+   * Levels of the tree, the root first and the leaves last.
+   */
+	std::vector<IndexLevelShape> levels;
+
+  /**
+   * Number of pages on the free list.
+   */
+	int freePages;
+
+  /**
+   * Number of leaves whose right sibling is not the next page of the file, each a seek for a range scan
+   * reading the leaf level in order. 0 after defragment().
+   */
+	int leafJumps;
+};
+
+/**
+ * @brief BTreeIndex class. It implements a B+ Tree index on a single INTEGER, DOUBLE or STRING
+ * attribute of a relation, or on a composite key made of several of them. Scans run on IndexCursor objects, so several can be open at a time;
+ * the overloads without a cursor share one scan owned by the index.
+ *
+ * Inserts, deletes and scans on different cursors may run in different threads when the buffer
+ * manager is in concurrent mode. Nodes carry optimistic latches (see NodeLatch): readers never
+ * latch, inserts latch the leaf and, if it splits, the nodes that take a new separator, and a
+ * reader that sees a node change under it starts over.
+ *
+ * The public interface takes untyped key pointers and dispatches on attributeType once per call;
+ * everything below it is templated on the key type.
+*/
+class BTreeIndex {
+
+ private:
+
+  /**
+   * File object for the index file.
+   */
+	File		*file;
+
+  /**
+   * Buffer Manager Instance.
+   */
+	BufMgr	*bufMgr;
+
+  /**
+   * Page number of meta page.
+   */
+	PageId	headerPageNum;
+
+  /**
+   * page number of root page of B+ tree inside index file. Only changes while the latch of the
+   * old root is held.
+   */
+	std::atomic<PageId>	rootPageNum;
+
+  /**
+   * Datatype of attribute over which index is built.
+   */
+	Datatype	attributeType;
+
+  /**
+   * Offset of attribute, over which index is built, inside records. 
+   */
+	int 		attrByteOffset;
+
+  /**
+   * Attributes the key is made of: attrByteOffset and attributeType, or those of a composite key.
+   */
+	std::vector<KeyAttr>	keyAttrs;
+
+  /**
+   * Attributes copied into the leaves of a covering index, empty for other indexes.
+   */
+	std::vector<IncludedAttr>	included;
+
+  /**
+   * Bytes of payload stored with every entry, the total length of the included attributes.
+   */
+	int			payloadLen;
+
+  /**
+   * Number of levels in the tree, counting the leaf level. Mirrors IndexMetaInfo::height.
+   */
+	std::atomic<int>	height;
+
+  /**
+   * Number of entries in the index. Mirrors IndexMetaInfo::numEntries.
+   */
+	std::atomic<int>	numEntries;
+
+  /**
+   * Number of leaf pages. Mirrors IndexMetaInfo::numLeaves.
+   */
+	std::atomic<int>	numLeaves;
+
+  /**
+   * Number of non-leaf pages. Mirrors IndexMetaInfo::numNonLeaves.
+   */
+	std::atomic<int>	numNonLeaves;
+
+  /**
+   * Number of splits and merges. Mirror IndexMetaInfo::leafSplits, nonLeafSplits and merges.
+   */
+	std::atomic<int>	leafSplits;
+	std::atomic<int>	nonLeafSplits;
+	std::atomic<int>	merges;
+
+  /**
+   * Number of inserts that went straight to the rightmost leaf, see tryAppend(). Not kept on the meta page.
+   */
+	std::atomic<int>	appends;
+
+  /**
+   * Page number of the rightmost leaf as last seen by an insert, INVALID_NUMBER if unknown. Only
+   * changed under the latch of the leaf it names, so a latched leaf it still names is the rightmost.
+   */
+	std::atomic<PageId>	rightmostLeaf;
+
+  /**
+   * Entries inserted but not in the tree yet, see setInsertBuffer(), and the most it holds before it is
+   * flushed, 0 while inserts go straight to the tree.
+   */
+	std::vector<BufferedInsert>	insertBuffer;
+	std::atomic<size_t>	insertBufferCapacity;
+
+  /**
+   * Number of entries in insertBuffer, read without insertBufferLatch.
+   */
+	std::atomic<int>	bufferedEntries;
+
+  /**
+   * Number of flushes of insertBuffer started. A lookup that finds an entry neither in the tree nor in
+   * the buffer tells by it whether a flush moved the entry in between.
+   */
+	std::atomic<int>	bufferFlushes;
+
+  /**
+   * Held while insertBuffer is changed or flushed, so that an entry is always either in the buffer or
+   * in the tree for the threads taking it.
+   */
+	std::mutex	insertBufferLatch;
+
+  /**
+   * Filter over the keys of the index, see setKeyFilter(), and the first page it is saved to,
+   * INVALID_NUMBER if it has none yet.
+   */
+	KeyFilter	keyFilter;
+	PageId	keyFilterPageNum;
+
+  /**
+   * Model of the leaf level descents of a read-only index go by instead of the non-leaf levels, see
+   * setLeafModel().
+   */
+	LeafModel	leafModel;
+
+  /**
+   * Number of keys in leaf node, depending upon the type of key.
+   */
+	int			leafOccupancy;
+
+  /**
+   * Number of keys in non-leaf node, depending upon the type of key.
+   */
+	int			nodeOccupancy;
+
+  /**
+   * First page of the list of free index pages, INVALID_NUMBER if there is none.
+   */
+	PageId	freePageNum;
+
+  /**
+   * Optimistic latch of every node.
+   */
+	NodeLatchTable	latches;
+
+  /**
+   * Guards the free list and the growth of the index file.
+   */
+	std::mutex	allocLatch;
+
+  /**
+   * Number of levels from the root whose nodes are kept in nodeCache, see cacheUpperLevels().
+   */
+	std::atomic<int>	cachedLevels;
+
+  /**
+   * Most nodes kept in nodeCache.
+   */
+	std::atomic<int>	maxCachedNodes;
+
+  /**
+   * Pinned frames of the upper levels of the tree.
+   */
+	NodeCache	nodeCache;
+
+  /**
+   * Most leaves a range scan has read ahead of it, see setScanReadAhead().
+   */
+	std::atomic<int>	scanReadAhead;
+
+  /**
+   * True if the index was opened with INDEX_READ_ONLY.
+   */
+	bool		readOnly;
+
+  /**
+   * True if nodes are read from the mapping of the index file rather than through the buffer pool,
+   * see BlobFile::map().
+   */
+	bool		mapped;
+
+  /**
+   * Open the index file, or create and build it, for the constructors.
+   */
+	void open(const std::string &relationName, std::string &outIndexName, const IndexAccess access,
+						const bool bulk, const double fillFactor);
+
+  /**
+   * Pin node page pageNum for reading, or return it from the mapping of the index file.
+   *
+   * @param hot  The page is expected to be read again soon, see BufMgr::readPage()
+   */
+	void readNode(const PageId pageNum, Page *&page, const bool hot = false);
+
+  /**
+   * Unpin node page pageNum after readNode(), leaving it clean.
+   */
+	void releaseNode(const PageId pageNum);
+
+  /**
+   * readNode() for a non-leaf node depth levels below the root. A node of the cached levels is
+   * returned from nodeCache without a pin, and is added to it if it is not cached yet.
+   *
+   * @return  True if the page was pinned for the caller, who must release it
+   */
+	bool readInnerNode(const PageId pageNum, Page *&page, const int depth);
+
+  /**
+   * Create the root and the first leaf of a new index and fill it with an entry for every tuple
+   * of the base relation, either through bulkLoad() or one insertTyped() call per tuple.
+   *
+   * @param relationName  Name of the base relation
+   * @param bulk          Build with bulkLoad() rather than insertTyped()
+   * @param fillFactor    Fraction of every node's capacity bulkLoad() fills
+   */
+	template <class T>
+	void buildIndex(const std::string &relationName, const bool bulk, const double fillFactor);
+
+  /**
+   * Build the tree bottom-up from entries sorted by key. Leaves are written left to right
+   * and chained through rightSibPageNo, then each level of non-leaf nodes is written on top
+   * of the previous one until a single root remains.
+   *
+   * @param entries       (key, rid) pairs of the base relation, sorted and finished
+   * @param fillFactor    Fraction of every node's capacity to fill, in (0, 1]
+   * @return              Page number of the new root.
+   */
+	template <class T>
+	PageId bulkLoad(ExternalSort<RIDKeyPair<T> > &entries, const double fillFactor);
+
+  /**
+   * Descend optimistically from the root to the leaf for key, recording every node with the version
+   * of its latch in path. Only the leaf and, for an insert, the nodes a split could reach stay pinned.
+   *
+   * @param lower   Follow the first child that can hold key rather than the child a new key goes to
+   * @param insert  Keep the ancestors of the leaf pinned up to the first one with room for a separator
+   * @return  Number of nodes on the path, the leaf last, or 0 if a concurrent change forced a restart; nothing is left pinned then.
+   */
+	template <class T>
+	int descend(const T &key, const bool lower, PathEntry *path, const bool insert);
 
-/**
- * @brief Overloaded operator to compare the key values of two rid-key pairs
- * and if they are the same compares to see if the first pair has
- * a smaller rid.pageNo value.
-*/
-template <class T>
-bool operator<( const RIDKeyPair<T>& r1, const RIDKeyPair<T>& r2 )
-{
-	if( r1.key != r2.key )
-		return r1.key < r2.key;
-	else
-		return r1.rid.page_number < r2.rid.page_number;
-}
+  /**
+   * descend() through leafModel: read the leaf it predicts for key, then move to the sibling the
+   * fences of the leaf point to until the leaf descend() would reach is found.
+   *
+   * @param modelKey  key as an INTEGER
+   * @return  1, the leaf being the only node on the path.
+   */
+	template <class T>
+	int descendByModel(const T &key, const int modelKey, const bool lower, PathEntry *path);
 
-/**
- * @brief The meta page, which holds metadata for Index file, is always first page of the btree index file and is cast
- * to the following structure to store or retrieve information from it.
- * Contains the relation name for which the index is created, the byte offset
- * of the key value on which the index is made, the type of the key and the page no
- * of the root page. Root page starts as page 2 but since a split can occur
- * at the root the root page may get moved up and get a new page no.
-*/
-struct IndexMetaInfo{
   /**
-   * Name of base relation.
+   * Append the separators and leaves of the subtree of the non-leaf pageNum, in key order, for setLeafModel().
    */
-	char relationName[20];
+	void collectLeaves(const PageId pageNum, std::vector<int> &separators, std::vector<PageId> &leaves);
 
   /**
-   * Offset of attribute, over which index is built, inside the record stored in pages.
+   * Unpin the nodes of the first count entries of a path that are still pinned, clearing their page.
    */
-	int attrByteOffset;
+	void releasePath(PathEntry *path, const int count);
 
   /**
-   * Type of the attribute over which index is built.
+   * Insert an entry into the pinned and latched leaf, splitting it if it is full.
+   *
+   * @return  Separator and page number of the new right sibling, or page number INVALID_NUMBER if the leaf did not split.
    */
-	Datatype attrType;
+	template <class T>
+	const std::pair<T, PageId> insertToLeafNode(const T &key, const RecordId rid, const char *payload, const PageId pageNum,
+																							LeafNode<T> *node);
 
   /**
-   * Page number of root page of the B+ Tree inside the file index file.
+   * Set the left sibling of leaf pageNum, if there is one, to leftPageNum, latching the leaf meanwhile.
    */
-	PageId rootPageNo;
-};
+	template <class T>
+	void setLeftSibling(const PageId pageNum, const PageId leftPageNum);
 
-/*
-Each node is a page, so once we read the page in we just cast the pointer to the page to this struct and use it to access the parts
-These structures basically are the format in which the information is stored in the pages for the index file depending on what kind of 
-node they are. The level memeber of each non leaf structure seen below is set to 1 if the nodes 
-at this level are just above the leaf nodes. Otherwise set to 0.
-*/
+  /**
+   * Insert the separator and page number of a split child into the pinned and latched non-leaf, splitting it if it is full.
+   *
+   * @param key    Key of the entry whose insertion split the child
+   * @return  Separator key and page number of the new right node, or page number INVALID_NUMBER if the node did not split.
+   */
+	template <class T>
+	const std::pair<T, PageId> insertToNonLeafNode(const T &key, const std::pair<T, PageId> &child, NonLeafNode<T> *node);
 
-/**
- * @brief Structure for all non-leaf nodes when the key is of INTEGER type.
-*/
-struct NonLeafNodeInt{
   /**
-   * Level of the node in the tree.
+   * One attempt at inserting an entry; latches the leaf, and the ancestors that take a separator if it splits.
+   *
+   * @return  False if a concurrent change forced a restart before anything was modified.
    */
-	int level;
+	template <class T>
+	bool tryInsert(const T &key, const RecordId rid, const char *payload);
 
   /**
-   * Stores keys.
+   * Insert an entry into the rightmost leaf without descending from the root, if it belongs there and
+   * the leaf has room for it.
+   *
+   * @return  False if nothing was inserted.
    */
-	int keyArray[ INTARRAYNONLEAFSIZE ];
+	template <class T>
+	bool tryAppend(const T &key, const RecordId rid, const char *payload);
 
   /**
-   * Stores page numbers of child pages which themselves are other non-leaf/leaf nodes in the tree.
+   * Add an entry to the insert buffer, flushing the buffer once it is full.
    */
-	PageId pageNoArray[ INTARRAYNONLEAFSIZE + 1 ];
-};
+	template <class T>
+	void bufferInsert(const T &key, const RecordId rid, const char *payload);
+
+  /**
+   * Insert the entries of the insert buffer into the tree in key order and empty it. The caller holds insertBufferLatch.
+   */
+	void flushBufferLocked();
 
+	template <class T>
+	void flushBufferTyped();
 
-/**
- * @brief Structure for all leaf nodes when the key is of INTEGER type.
-*/
-struct LeafNodeInt{
   /**
-   * Stores keys.
+   * Find the entries with key in the insert buffer, like lookupTyped(). The caller holds insertBufferLatch.
    */
-	int keyArray[ INTARRAYLEAFSIZE ];
+	template <class T>
+	size_t lookupBuffered(const T &key, RecordId *outRid, std::vector<RecordId> *outRids);
 
   /**
-   * Stores RecordIds.
+   * Remove the entry (key, rid) from the insert buffer.
+   *
+   * @return  False if the buffer does not hold it.
    */
-	RecordId ridArray[ INTARRAYLEAFSIZE ];
+	template <class T>
+	bool removeBuffered(const T &key, const RecordId rid);
 
   /**
-   * Page number of the leaf on the right side.
-	 * This linking of leaves allows to easily move from one leaf to the next leaf during index scan.
+   * insertEntry() once the key has been read as a T and the payload copied out of the record.
    */
-	PageId rightSibPageNo;
-};
+	template <class T>
+	void insertTyped(const T &key, const RecordId rid, const char *payload);
 
+  /**
+   * Copy the included attributes of record to payload, which has room for payloadLen bytes.
+   */
+	void gatherPayload(const char *record, char *payload) const;
 
-/**
- * @brief BTreeIndex class. It implements a B+ Tree index on a single attribute of a
- * relation. This index supports only one scan at a time.
-*/
-class BTreeIndex {
+  /**
+   * Position cursor on the first entry of the scan, leaving its leaf pinned as the current page.
+   *
+   * @throws  NoSuchKeyFoundException If there is no key in the B+ tree that satisfies the scan criteria.
+   */
+	template <class T>
+	void startScanHelper(IndexCursor &cursor);
 
- private:
+  /**
+   * Pin the leaf the scan of cursor goes on in and set nextEntry. Before any entry was returned the
+   * low bound is searched; afterwards the last returned key, skipping the duplicates of it that were
+   * returned already.
+   *
+   * @return  False if a concurrent change forced a restart; nothing is left pinned then.
+   */
+	template <class T>
+	bool positionCursor(IndexCursor &cursor);
 
   /**
-   * File object for the index file.
+   * positionCursor() for a descending scan: before any entry was returned the high bound is searched,
+   * afterwards the last returned key, skipping the duplicates of it that were returned already.
    */
-	File		*file;
+	template <class T>
+	bool positionCursorDescending(IndexCursor &cursor);
 
   /**
-   * Buffer Manager Instance.
+   * Unpin the current leaf of cursor and position it again after a concurrent change.
    */
-	BufMgr	*bufMgr;
+	template <class T>
+	void repositionCursor(IndexCursor &cursor);
 
   /**
-   * Page number of meta page.
+   * Move cursor to the first entry of the right sibling of its current leaf.
+   *
+   * @return  False if the current leaf changed since the cursor validated it; the cursor is left as it was then.
    */
-	PageId	headerPageNum;
+	template <class T>
+	bool moveRight(IndexCursor &cursor);
 
   /**
-   * page number of root page of B+ tree inside index file.
+   * Move cursor to the last entry of the left sibling of its current leaf.
+   *
+   * @return  False if the current leaf or its sibling changed while they were read; the cursor is left on the current leaf.
    */
-	PageId	rootPageNum;
+	template <class T>
+	bool moveLeft(IndexCursor &cursor);
 
   /**
-   * Datatype of attribute over which index is built.
+   * Whether no leaf after leaf, in the direction of the scan of cursor, can hold an entry of the scan,
+   * as told by the fence of leaf on that side; true as well if leaf is the last one that way.
+   * The leaf must be validated before the answer is relied on.
    */
-	Datatype	attributeType;
+	template <class T>
+	static bool lastLeafOfScan(const IndexCursor &cursor, const LeafNode<T> *leaf);
 
   /**
-   * Offset of attribute, over which index is built, inside records. 
+   * Read the leaves following nextLeafPageNum in the direction of the scan of cursor in the background,
+   * in windows that grow as the scan goes on.
+   *
+   * @param positioned  The cursor was just positioned, which starts over with a window of one leaf
    */
-	int 		attrByteOffset;
+	template <class T>
+	void readAheadLeaves(IndexCursor &cursor, const PageId nextLeafPageNum, const bool positioned);
 
   /**
-   * Number of keys in leaf node, depending upon the type of key.
+   * lookup() and lookupAll() once the key has been read as a T.
+   *
+   * @param outRid   Set to the record id of the first entry with key if outRids is NULL
+   * @param outRids  If not NULL, every record id with key is appended to it
+   * @return  Number of entries found, at most 1 if outRids is NULL.
    */
-	int			leafOccupancy;
+	template <class T>
+	size_t lookupTyped(const T &key, RecordId *outRid, std::vector<RecordId> *outRids);
 
   /**
-   * Number of keys in non-leaf node, depending upon the type of key.
+   * lookupBatch() once the keys have been read as T.
    */
-	int			nodeOccupancy;
+	template <class T>
+	void lookupBatchTyped(const std::vector<T> &keys, std::vector<RecordId> &outRids, std::vector<size_t> &offsets);
 
+  /**
+   * Look up the keys first up to last of a batch, in key order, in the subtree of node pageNum. Keys
+   * whose entries cannot be read from the subtree as seen, because it changed or their duplicates
+   * go on past it, are looked up one by one with lookupTyped().
+   *
+   * @param version  Version of the latch of the node, read before the node was reached
+   * @param leaf     The node is a leaf
+   */
+	template <class T>
+	void probeNode(ProbeBatch<T> &batch, const size_t first, const size_t last, const PageId pageNum,
+								 const std::uint64_t version, const bool leaf);
 
-	// MEMBERS SPECIFIC TO SCANNING
+  /**
+   * scanNext() with the scan bounds read as T.
+   */
+	template <class T>
+	void scanNextTyped(IndexCursor &cursor, RecordId& outRid);
 
   /**
-   * True if an index scan has been started.
+   * scanNextBatch() with the scan bounds read as T.
    */
-	bool		scanExecuting;
+	template <class T>
+	size_t scanNextBatchTyped(IndexCursor &cursor, RecordId* outRids, const size_t maxRids, char *outPayloads);
 
   /**
-   * Index of next entry to be scanned in current leaf being scanned.
-   */ 
-	int			nextEntry;
+   * scanNextBatchTyped() for a descending scan, which moves through each leaf from right to left.
+   */
+	template <class T>
+	size_t scanNextBatchDescendingTyped(IndexCursor &cursor, RecordId* outRids, const size_t maxRids, char *outPayloads);
 
   /**
-   * Page number of current page being scanned.
+   * Remove the entry (key, rid) from the leaf pageNum.
+   *
+   * @param underfull  Set to whether the leaf fell below MERGE_THRESHOLD of its capacity
+   * @return  True if the entry was found.
    */
-	PageId	currentPageNum;
+	template <class T>
+	const bool deleteFromLeafNode(const T &key, const RecordId rid, PageId pageNum, bool &underfull);
 
   /**
-   * Current Page being scanned.
+   * Remove the entry (key, rid) from the subtree rooted at the non-leaf pageNum, merging children that fall below MERGE_THRESHOLD on the way back up.
+   *
+   * @param underfull  Set to whether the node fell below MERGE_THRESHOLD of its capacity
+   * @return  True if the entry was found.
    */
-	Page		*currentPageData;
+	template <class T>
+	const bool deleteFromNonLeafNode(const T &key, const RecordId rid, PageId pageNum, bool &underfull);
 
   /**
-   * Low INTEGER value for scan.
+   * Merge child i of the pinned node with a neighbouring child of the same node if the two fit in one page, and free the page of the right one.
+   *
+   * @return  True if the children were merged.
    */
-	int			lowValInt;
+	template <class T>
+	const bool mergeChildren(NonLeafNode<T> *node, const int i);
 
   /**
-   * Low DOUBLE value for scan.
+   * deleteEntry() once the key has been read as a T.
    */
-	double	lowValDouble;
+	template <class T>
+	void deleteTyped(const T &key, const RecordId rid);
 
   /**
-   * Low STRING value for scan.
+   * Allocate a node page, reusing a page from the free list if there is one. The page is returned pinned.
    */
-	std::string	lowValString;
+	void allocNode(PageId &pageNum, Page *&page);
 
   /**
-   * High INTEGER value for scan.
+   * Put the pinned node page pageNum on the free list and unpin it.
    */
-	int			highValInt;
+	void freeNode(PageId pageNum, Page *page);
 
   /**
-   * High DOUBLE value for scan.
+   * inspect() with nodes read as holding keys of type T.
    */
-	double	highValDouble;
+	template <class T>
+	void inspectTyped(IndexShape &shape);
 
   /**
-   * High STRING value for scan.
+   * defragment() with nodes read as holding keys of type T.
    */
-	std::string highValString;
-	
+	template <class T>
+	void defragmentTyped(const double fillFactor);
+
   /**
-   * Low Operator. Can only be GT(>) or GTE(>=).
+   * Write the root page number and the tree metadata (height, node and entry counts, split and merge counts, free list) to the meta page.
    */
-	Operator	lowOp;
+	void writeMetaInfo();
 
   /**
-   * High Operator. Can only be LT(<) or LTE(<=).
+   * Whether the key filter shows that the index holds no entry with key.
    */
-	Operator	highOp;
+	template <class T>
+	bool keyAbsent(const T &key) const { return this->keyFilter.enabled() && !this->keyFilter.mayContain(KeyTraits<T>::hash(key)); }
+
+  /**
+   * Add the keys of every leaf and of the insert buffer to the key filter.
+   */
+	template <class T>
+	void fillKeyFilter();
+
+  /**
+   * Read the key filter back from its pages, or write it to them, reusing the pages it was saved to
+   * and adding pages as needed; writing also marks the filter saved on the meta page.
+   */
+	void readKeyFilter();
+	void writeKeyFilter();
+
+
+  /**
+   * Scan used by the startScan(), scanNext(), scanNextBatch() and endScan() overloads without a cursor.
+   */
+	IndexCursor	scan;
+
+  /**
+   * Threads scanning the base relation of a bulk loaded index, see setBuildThreads().
+   */
+	static std::uint32_t buildThreads;
+
+  /**
+   * Bytes the sort of a bulk load or a rebuild holds in memory, see setSortMemory().
+   */
+	static std::size_t sortMemory;
 
 	 
  public:
 
-  // const void BTreeIndex::allocLeafNode(PageId &newpgId);
+  /**
+   * Set the number of threads that scan and sort the base relation when an index is bulk loaded
+   * through a buffer manager in concurrent mode. The default, 0, is one thread per core.
+   *
+   * @param threads	Number of threads
+   */
+	static void setBuildThreads(const std::uint32_t threads);
+
+  /**
+   * Set the memory the entries of an index are sorted in when it is bulk loaded or rebuilt by
+   * defragment(). Sorted runs beyond it are spilled to a temporary file next to the index, named after
+   * it, through the buffer manager. The default is ExternalSort::DEFAULT_MEMORY.
+   *
+   * @param bytes	Bytes of memory
+   */
+	static void setSortMemory(const std::size_t bytes);
 
   /**
    * BTreeIndex Constructor. 
 	 * Check to see if the corresponding index file exists. If so, open the file.
 	 * If not, create it and insert entries for every tuple in the base relation using FileScan class.
+	 * By default the entries are collected, sorted and bulk loaded bottom-up instead of being inserted one by one.
    *
    * @param relationName        Name of file.
    * @param outIndexName        Return the name of index file.
    * @param bufMgrIn						Buffer Manager Instance
    * @param attrByteOffset			Offset of attribute, over which index is to be built, in the record
    * @param attrType						Datatype of attribute over which index is built
-   * @throws  BadIndexInfoException     If the index file already exists for the corresponding attribute, but values in metapage(relationName, attribute byte offset, attribute type etc.) do not match with values received through constructor parameters.
+   * @param bulk								Build a new index with bulkLoad() rather than insertEntry()
+   * @param fillFactor					Fraction of each node filled by the bulk loader, in (0, 1]
+   * @throws  BadIndexInfoException     If fillFactor is out of range, or the index file already exists for the corresponding attribute, but values in metapage(relationName, attribute byte offset, attribute type etc.) do not match with values received through constructor parameters.
+   */
+	BTreeIndex(const std::string & relationName, std::string & outIndexName,
+						BufMgr *bufMgrIn,	const int attrByteOffset,	const Datatype attrType,
+						const bool bulk = true, const double fillFactor = DEFAULT_FILL_FACTOR);
+
+  /**
+   * BTreeIndex Constructor opening the index with the given access. With INDEX_READ_ONLY the index file
+   * must exist, and must not be changed while the index is open; insertEntry() and deleteEntry() throw.
+   * The buffer manager is only used if the index file cannot be mapped, e.g. for DOUBLE keys, whose
+   * nodes need a stricter alignment than the pages of a mapped file have.
+   *
+   * @param access							How to open the index file
+   * @throws  FileNotFoundException     If access is INDEX_READ_ONLY and the index file does not exist.
+   * @throws  BadIndexInfoException     If the index file already exists for the corresponding attribute, but values in metapage do not match.
+   */
+	BTreeIndex(const std::string & relationName, std::string & outIndexName,
+						BufMgr *bufMgrIn,	const int attrByteOffset,	const Datatype attrType,
+						const IndexAccess access);
+
+  /**
+   * BTreeIndex Constructor for a covering index, which also stores the included attributes of each
+   * record in its leaves so that scanNextBatch() can return them without the record being read.
+   * A covering index is built by inserting the tuples one by one, and has its own index file, named
+   * after the included attributes as well.
+   *
+   * @param included						Attributes to store with every entry, at most MAX_INCLUDED_ATTRS of them
+   *                            taking at most MAX_PAYLOAD_SIZE bytes together
+   * @throws  BadIndexInfoException     If the key is a STRING, the included attributes take too much room, or the
+   *                                    index file exists with other values in its metapage.
+   */
+	BTreeIndex(const std::string & relationName, std::string & outIndexName,
+						BufMgr *bufMgrIn,	const int attrByteOffset,	const Datatype attrType,
+						const std::vector<IncludedAttr> &included);
+
+  /**
+   * Bytes of payload returned with each entry by scanNextBatch(), 0 unless the index is covering.
+   * The included attributes follow each other in the order they were given.
+   */
+	int payloadSize() const { return payloadLen; }
+
+  /**
+   * BTreeIndex Constructor for a composite index, whose key is made of several attributes and ordered
+   * by the first of them, then by the second and so on. The index is bulk loaded like one on a single
+   * attribute; its file is named after the offsets of all key attributes. The key pointers taken by the
+   * other methods point to a CompositeKey, built from attribute values by compositeKey().
+   *
+   * @param keyAttrs						Key attributes, INTEGER, DOUBLE or STRING, at most MAX_KEY_ATTRS of them taking
+   *                            at most COMPOSITEKEYSIZE bytes together once encoded
+   * @throws  BadIndexInfoException     If the key attributes do not fit in a CompositeKey, fillFactor is out of
+   *                                    range, or the index file exists with other values in its metapage.
    */
 	BTreeIndex(const std::string & relationName, std::string & outIndexName,
-						BufMgr *bufMgrIn,	const int attrByteOffset,	const Datatype attrType);
+						BufMgr *bufMgrIn,	const std::vector<KeyAttr> &keyAttrs,
+						const bool bulk = true, const double fillFactor = DEFAULT_FILL_FACTOR);
+
+  /**
+   * Build the key of a composite index from the values of its first numValues key attributes, each a
+   * pointer to an integer / double / char string. The attributes left out are filled with their least
+   * values, or with their greatest if upper is set, so that with a prefix of the key attributes
+   * compositeKey(values, n) and compositeKey(values, n, true) bound every key starting with it, e.g. for
+   * a range scan with GTE and LTE.
+   *
+   * @param values		Values of the leading key attributes
+   * @param numValues	Number of values, at most the number of key attributes
+   * @param upper			Fill the attributes left out with their greatest values
+   * @return The key, to be passed by address to insertEntry(), lookup(), startScan() and the like
+   */
+	CompositeKey compositeKey(const void* const* values, const size_t numValues, const bool upper = false) const;
 	
 
+  /**
+   * Keep the nodes of the top levels of the tree pinned in the buffer pool, and find them through
+   * a table of the index rather than the buffer manager. Nodes are cached as descents first reach
+   * them and stay pinned until the index is closed, so the cached nodes take frames of the pool
+   * for good. Has no effect on an index read through the mapping of its file.
+   *
+   * @param levels    Number of levels from the root to cache, 0 to stop caching further nodes
+   * @param maxNodes  Most nodes to cache, at most NodeCache::MAX_NODES
+   */
+	void cacheUpperLevels(const int levels, const int maxNodes = 64);
+
+  /**
+   * Set the most leaves a range scan asks the buffer manager to read ahead of it, following the
+   * sibling pointers of the leaves. Leaves are only read ahead once BufMgr::startReadAhead() was called.
+   *
+   * @param leaves  Number of leaves, from 1 to MAX_SCAN_READ_AHEAD; DEFAULT_SCAN_READ_AHEAD by default
+   */
+	void setScanReadAhead(const int leaves);
+
+  /**
+   * Collect inserted entries in a buffer in memory and insert them into the tree in batches, sorted by key,
+   * whenever the buffer fills up. A burst of inserts in random order then changes the leaves in key order,
+   * each one once per batch while it is in the buffer pool, rather than a leaf somewhere in the tree per
+   * insert. Lookups and deletes see the entries in the buffer; scans and lookupBatch() flush it first.
+   * Buffered entries are not in the write-ahead log until they are flushed, each batch as one action.
+   *
+   * @param entries  Most entries the buffer holds, 0 to insert straight into the tree again, which flushes
+   *                 the buffer
+   */
+	void setInsertBuffer(const size_t entries);
+
+  /**
+   * Insert every entry of the insert buffer into the tree now. Also done when the index is closed.
+   */
+	void flushInsertBuffer();
+
+  /**
+   * Keep a Bloom filter over the keys of the index in memory, so that lookup(), lookupAll(), lookupBatch()
+   * and scans for a single key (GTE and LTE the same key) skip keys the index does not hold without
+   * reading any node. The filter is built from the keys in the index and kept up to date by inserts;
+   * deletes leave their keys in it. It is saved in the index file when the index is closed and read
+   * back when it is opened again. Must not be called while other threads use the index.
+   *
+   * @param bitsPerKey    Bits of filter per key, 10 for about 1% false positives; 0 to drop the filter
+   * @param expectedKeys  Number of keys to size the filter for, if more than the index holds now; the
+   *                      false positive rate climbs once more keys than that are inserted
+   */
+	void setKeyFilter(const int bitsPerKey, const std::size_t expectedKeys = 0);
+
+  /**
+   * Let lookups and scans of an index with INTEGER keys opened with INDEX_READ_ONLY find their leaf
+   * through a LeafModel of the leaf level rather than by descending the non-leaf levels. The model is
+   * fitted to the separators of the tree, reading every non-leaf node once, and usually takes a few
+   * hundred bytes for a bulk-loaded index, where caching the non-leaf levels takes a frame per node.
+   * A lookup then reads about one leaf, plus one per leaf the model is off by. Must not be called
+   * while other threads use the index.
+   *
+   * @param maxError  Most leaves the model may be off by; fewer mean a larger model. Negative to drop the model.
+   * @return False, building no model, if the keys are not INTEGER or the index was not opened with INDEX_READ_ONLY
+   */
+	bool setLeafModel(const int maxError = DEFAULT_LEAF_MODEL_ERROR);
+
   /**
    * BTreeIndex Destructor. 
 	 * End any initialized scan, flush index file, after unpinning any pinned pages, from the buffer manager
@@ -322,9 +2213,6 @@ class BTreeIndex {
 	 * */
 	~BTreeIndex();
 
-  const std::pair<int, PageId> insertToLeafNode(const void* key, const RecordId rid, PageId pageNum);
-  const std::pair<int, PageId> insertToNonLeafNode(const void *key, const RecordId rid, PageId pageNum);
-
   /**
 	 * Insert a new entry using the pair <value,rid>. 
 	 * Start from root to recursively find out the leaf to insert the entry in. The insertion may cause splitting of leaf node.
@@ -333,11 +2221,28 @@ class BTreeIndex {
 	 * Make sure to unpin pages as soon as you can.
    * @param key			Key to insert, pointer to integer/double/char string
    * @param rid			Record ID of a record whose entry is getting inserted into the index.
+	 * @throws  ReadOnlyIndexException If the index was opened with INDEX_READ_ONLY.
 	**/
 	const void insertEntry(const void* key, const RecordId rid);
 
+  /**
+	 * insertEntry() for a covering index, which copies the included attributes of the record into the leaf.
+   * @param record	The record whose entry is inserted
+	**/
+	const void insertEntry(const void* key, const RecordId rid, const char *record);
 
-  const int startScanHelper(PageId pageNum);
+  /**
+	 * Delete the entry with the pair <value,rid>.
+	 * Start from root to find the leaf holding the entry and remove it. A node that falls below MERGE_THRESHOLD of its capacity
+	 * is merged into a neighbouring node with the same parent when both fit in one page; the emptied page goes on a free list the
+	 * index allocates from before it grows the file. If the root is left with a single non-leaf child, that child becomes the root.
+	 * Deletes latch every node from the root down, so they run one at a time; open scans position themselves again when a leaf they are on changes.
+   * @param key			Key to delete, pointer to integer/double/char string
+   * @param rid			Record ID of the record whose entry is deleted.
+	 * @throws  NoSuchKeyFoundException If the index holds no entry with this key and record id.
+	 * @throws  ReadOnlyIndexException If the index was opened with INDEX_READ_ONLY.
+	**/
+	const void deleteEntry(const void* key, const RecordId rid);
 
   /**
 	 * Begin a filtered scan of the index.  For instance, if the method is called 
@@ -346,32 +2251,131 @@ class BTreeIndex {
 	 * If another scan is already executing, that needs to be ended here.
 	 * Set up all the variables for scan. Start from root to find out the leaf page that contains the first RecordID
 	 * that satisfies the scan parameters. Keep that page pinned in the buffer pool.
-   * @param lowVal	Low value of range, pointer to integer / double / char string
+	 * A NULL bound leaves its end of the range open, and its operator is ignored. A descending scan starts at the
+	 * high bound and returns the entries in decreasing key order, so the greatest keys of a range come first.
+   * @param lowVal	Low value of range, pointer to integer / double / char string, or NULL
    * @param lowOp		Low operator (GT/GTE)
-   * @param highVal	High value of range, pointer to integer / double / char string
+   * @param highVal	High value of range, pointer to integer / double / char string, or NULL
    * @param highOp	High operator (LT/LTE)
+   * @param order		SCAN_ASCENDING or SCAN_DESCENDING
    * @throws  BadOpcodesException If lowOp and highOp do not contain one of their their expected values 
    * @throws  BadScanrangeException If lowVal > highval
 	 * @throws  NoSuchKeyFoundException If there is no key in the B+ tree that satisfies the scan criteria.
 	**/
-	const void startScan(const void* lowVal, const Operator lowOp, const void* highVal, const Operator highOp);
+	const void startScan(const void* lowVal, const Operator lowOp, const void* highVal, const Operator highOp,
+											 const ScanOrder order = SCAN_ASCENDING);
+
+  /**
+	 * startScan() on cursor instead of the scan owned by the index. A scan already running on cursor is ended first;
+	 * other cursors are not affected.
+   * @param cursor	Cursor to position on the first matching entry
+	**/
+	const void startScan(IndexCursor& cursor, const void* lowVal, const Operator lowOp, const void* highVal, const Operator highOp,
+											 const ScanOrder order = SCAN_ASCENDING);
 
 
   /**
 	 * Fetch the record id of the next index entry that matches the scan.
-	 * Return the next record from current page being scanned. If current page has been scanned to its entirety, move on to the right sibling of current page, if any exists, to start scanning that page. Make sure to unpin any pages that are no longer required.
+	 * Return the next record from current page being scanned. If current page has been scanned to its entirety, move on to the right sibling of current page (the left one in a descending scan), if any exists, to start scanning that page. Make sure to unpin any pages that are no longer required.
    * @param outRid	RecordId of next record found that satisfies the scan criteria returned in this
 	 * @throws ScanNotInitializedException If no scan has been initialized.
 	 * @throws IndexScanCompletedException If no more records, satisfying the scan criteria, are left to be scanned.
 	**/
 	const void scanNext(RecordId& outRid);  // returned record id
 
+  /**
+	 * scanNext() on cursor.
+	**/
+	const void scanNext(IndexCursor& cursor, RecordId& outRid);
+
+  /**
+	 * Fetch the record ids of up to maxRids next index entries that match the scan.
+	 * The qualifying run of each leaf is found with one search for the high bound and copied out at once, moving on to right siblings
+	 * until outRids is full or the scan is done. Can be mixed with scanNext() on the same scan.
+   * @param outRids	Array of at least maxRids record ids the matching record ids are returned in
+   * @param maxRids	Maximum number of record ids to return
+   * @return Number of record ids returned; less than maxRids only once no more records satisfy the scan criteria, 0 when none were left.
+	 * @throws ScanNotInitializedException If no scan has been initialized.
+	**/
+	const size_t scanNextBatch(RecordId* outRids, const size_t maxRids);
+
+  /**
+	 * scanNextBatch() on cursor.
+	**/
+	const size_t scanNextBatch(IndexCursor& cursor, RecordId* outRids, const size_t maxRids);
+
+  /**
+	 * scanNextBatch() on cursor that also returns the included attributes of a covering index.
+   * @param outPayloads	Array of at least maxRids * payloadSize() bytes the payload of each entry is returned in
+	**/
+	const size_t scanNextBatch(IndexCursor& cursor, RecordId* outRids, const size_t maxRids, char *outPayloads);
+
 
   /**
 	 * Terminate the current scan. Unpin any pinned pages. Reset scan specific variables.
 	 * @throws ScanNotInitializedException If no scan has been initialized.
 	**/
 	const void endScan();
+
+  /**
+	 * endScan() on cursor.
+	**/
+	const void endScan(IndexCursor& cursor);
+
+  /**
+	 * Find an entry with the given key. Descends once and leaves nothing pinned; unlike startScan() it keeps no state in the index,
+	 * so any number of threads may look up keys at once, next to scans.
+	 * @param key			Key to look for, pointer to integer/double/char string
+	 * @param outRid	Record id of an entry with key returned in this, the first one in key order
+	 * @return True if an entry was found; outRid is left unchanged otherwise.
+	**/
+	const bool lookup(const void* key, RecordId& outRid);
+
+  /**
+	 * Find every entry with the given key, like lookup(), following right siblings while the duplicates of key continue.
+	 * @param key			Key to look for, pointer to integer/double/char string
+	 * @param outRids	The record ids of the entries found are appended to this
+	 * @return Number of record ids appended.
+	**/
+	const size_t lookupAll(const void* key, std::vector<RecordId>& outRids);
+
+  /**
+	 * Find every entry of each of a batch of keys, e.g. the probes of an index nested-loop join.
+	 * The keys are sorted and the tree is descended once for all of them: every node is read once for all the keys that land in it,
+	 * and the children of a node are prefetched before they are visited. Nothing is left pinned.
+	 * @param keys		Array of numKeys pointers to keys, integer/double/char string, in any order and possibly repeated
+	 * @param numKeys	Number of keys
+	 * @param outRids	Replaced by the record ids found, those of keys[0] first
+	 * @param offsets	Replaced by numKeys + 1 positions in outRids: the record ids of keys[i] are outRids[offsets[i]] up to, but excluding, outRids[offsets[i + 1]]
+	**/
+	const void lookupBatch(const void* const* keys, const size_t numKeys, std::vector<RecordId>& outRids,
+												 std::vector<size_t>& offsets);
+
+  /**
+	 * Counters of the shape of the tree. They are kept up to date by every insert and delete, so this does not read any page.
+	 * @return Height, node and entry counts, split and merge counts and average leaf fill.
+	**/
+	IndexStats getStats() const;
+
+  /**
+	 * Walk every node of the tree level by level and count the nodes and keys of each level, and the pages on the free list.
+	 * Reads every page of the index; the counts are only consistent while no insert or delete runs.
+	 * @param shape	Shape of the tree returned in this
+	**/
+	void inspect(IndexShape& shape);
+
+  /**
+	 * Rebuild the tree with bulkLoad(), so that the leaves follow one another in key order in pages at the end of the index file,
+	 * each filled to fillFactor of its capacity, under new non-leaf levels. The new root replaces the old one while the latches of
+	 * all old nodes are held, and every old node then goes on the free list before its latch is released. Lookups and scans may run meanwhile:
+	 * those still in the old tree start over from the new root, cursors past the entries they returned. Inserts and deletes
+	 * must not run at the same time. The insert buffer is flushed first.
+	 * @param fillFactor	Fraction of every node's capacity to fill, in (0, 1]
+	 * @return False, changing nothing, for a covering index, which bulkLoad() cannot build.
+	 * @throws  ReadOnlyIndexException If the index was opened with INDEX_READ_ONLY.
+	 * @throws  BadIndexInfoException If fillFactor is out of range.
+	**/
+	bool defragment(const double fillFactor = DEFAULT_FILL_FACTOR);
 	
 };
 
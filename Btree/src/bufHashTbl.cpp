@@ -11,101 +11,146 @@
 #include "bufHashTbl.h"
 #include "exceptions/hash_already_present_exception.h"
 #include "exceptions/hash_not_found_exception.h"
-#include "exceptions/hash_table_exception.h"
 
 namespace badgerdb {
 
-int BufHashTbl::hash(const File* file, const PageId pageNo)
+std::uint64_t BufHashTbl::hash(const File* file, const PageId pageNo)
 {
-  int tmp, value;
-  tmp = (long)file;  // cast of pointer to the file object to an integer
-  value = (tmp + pageNo) % HTSIZE;
+  // finalizer of MurmurHash3 over the file pointer and the page number
+  std::uint64_t value = (std::uint64_t)(std::uintptr_t)file ^ ((std::uint64_t)pageNo * 0x9e3779b97f4a7c15ULL);
+  value ^= value >> 33;
+  value *= 0xff51afd7ed558ccdULL;
+  value ^= value >> 33;
+  value *= 0xc4ceb9fe1a85ec53ULL;
+  value ^= value >> 33;
   return value;
 }
 
 BufHashTbl::BufHashTbl(int htSize)
 	: HTSIZE(htSize)
 {
-  // allocate an array of pointers to hashBuckets
-  ht = new hashBucket* [htSize];
-  for(int i=0; i < HTSIZE; i++)
-    ht[i] = NULL;
+  // size the partitions for twice their share of the entries, so that they stay at most half full
+  const std::uint32_t share = (htSize + NUM_PARTITIONS - 1) / NUM_PARTITIONS;
+  std::uint32_t capacity = 8;
+  while (capacity < 2 * share)
+    capacity *= 2;
+
+  ht = new Partition[NUM_PARTITIONS];
+  for(int i=0; i < NUM_PARTITIONS; i++)
+  {
+    ht[i].slots = new hashBucket[capacity]();
+    ht[i].mask = capacity - 1;
+    ht[i].count = 0;
+  }
+  latches = new std::mutex[NUM_PARTITIONS];
 }
 
 BufHashTbl::~BufHashTbl()
 {
-  for(int i = 0; i < HTSIZE; i++) {
-    hashBucket* tmpBuf = ht[i];
-    while (ht[i]) {
-      tmpBuf = ht[i];
-      ht[i] = ht[i]->next;
-      delete tmpBuf;
-    }
-  }
+  for(int i = 0; i < NUM_PARTITIONS; i++)
+    delete [] ht[i].slots;
   delete [] ht;
+  delete [] latches;
 }
 
-void BufHashTbl::insert(const File* file, const PageId pageNo, const FrameId frameNo)
+void BufHashTbl::grow(Partition &part)
 {
-  int index = hash(file, pageNo);
-
-  hashBucket* tmpBuc = ht[index];
-  while (tmpBuc) {
-    if (tmpBuc->file == file && tmpBuc->pageNo == pageNo)
-  		throw HashAlreadyPresentException(tmpBuc->file->filename(), tmpBuc->pageNo, tmpBuc->frameNo);
-    tmpBuc = tmpBuc->next;
+  const std::uint32_t capacity = (part.mask + 1) * 2;
+  hashBucket* oldSlots = part.slots;
+  const std::uint32_t oldCapacity = part.mask + 1;
+
+  part.slots = new hashBucket[capacity]();
+  part.mask = capacity - 1;
+  for (std::uint32_t i = 0; i < oldCapacity; i++)
+  {
+    if (oldSlots[i].file == NULL)
+      continue;
+    std::uint32_t index = hash(oldSlots[i].file, oldSlots[i].pageNo) & part.mask;
+    while (part.slots[index].file != NULL)
+      index = (index + 1) & part.mask;
+    part.slots[index] = oldSlots[i];
   }
+  delete [] oldSlots;
+}
 
-  tmpBuc = new hashBucket;
-  if (!tmpBuc)
-  	throw HashTableException();
+void BufHashTbl::insert(const File* file, const PageId pageNo, const FrameId frameNo)
+{
+  const std::uint64_t h = hash(file, pageNo);
+  Partition &part = ht[partitionOf(h)];
+
+  // keep the partition at most three quarters full
+  if ((part.count + 1) * 4 > (part.mask + 1) * 3)
+    grow(part);
+
+  std::uint32_t index = h & part.mask;
+  while (part.slots[index].file != NULL) {
+    const hashBucket &tmpBuc = part.slots[index];
+    if (tmpBuc.file == file && tmpBuc.pageNo == pageNo)
+  		throw HashAlreadyPresentException(tmpBuc.file->filename(), tmpBuc.pageNo, tmpBuc.frameNo);
+    index = (index + 1) & part.mask;
+  }
 
-  tmpBuc->file = (File*) file;
-  tmpBuc->pageNo = pageNo;
-  tmpBuc->frameNo = frameNo;
-  tmpBuc->next = ht[index];
-  ht[index] = tmpBuc;
+  part.slots[index].file = (File*) file;
+  part.slots[index].pageNo = pageNo;
+  part.slots[index].frameNo = frameNo;
+  part.count++;
 }
 
-void BufHashTbl::lookup(const File* file, const PageId pageNo, FrameId &frameNo) 
+bool BufHashTbl::find(const File* file, const PageId pageNo, FrameId &frameNo) const
 {
-  int index = hash(file, pageNo);
-  hashBucket* tmpBuc = ht[index];
-  while (tmpBuc) {
-    if (tmpBuc->file == file && tmpBuc->pageNo == pageNo)
+  const std::uint64_t h = hash(file, pageNo);
+  const Partition &part = ht[partitionOf(h)];
+  std::uint32_t index = h & part.mask;
+  while (part.slots[index].file != NULL) {
+    const hashBucket &tmpBuc = part.slots[index];
+    if (tmpBuc.file == file && tmpBuc.pageNo == pageNo)
     {
-      frameNo = tmpBuc->frameNo; // return frameNo by reference
-      return;
+      frameNo = tmpBuc.frameNo; // return frameNo by reference
+      return true;
     }
-    tmpBuc = tmpBuc->next;
+    index = (index + 1) & part.mask;
   }
 
-  throw HashNotFoundException(file->filename(), pageNo);
+  return false;
+}
+
+void BufHashTbl::lookup(const File* file, const PageId pageNo, FrameId &frameNo) 
+{
+  if (!find(file, pageNo, frameNo))
+  {
+    throw HashNotFoundException(file->filename(), pageNo);
+  }
 }
 
 void BufHashTbl::remove(const File* file, const PageId pageNo) {
 
-  int index = hash(file, pageNo);
-  hashBucket* tmpBuc = ht[index];
-  hashBucket* prevBuc = NULL;
+  const std::uint64_t h = hash(file, pageNo);
+  Partition &part = ht[partitionOf(h)];
+  std::uint32_t index = h & part.mask;
 
-  while (tmpBuc)
+  while (part.slots[index].file != NULL)
 	{
-    if (tmpBuc->file == file && tmpBuc->pageNo == pageNo)
+    if (part.slots[index].file == file && part.slots[index].pageNo == pageNo)
 		{
-      if(prevBuc) 
-				prevBuc->next = tmpBuc->next;
-      else
-				ht[index] = tmpBuc->next;
-
-      delete tmpBuc;
+      // shift back the entries after it that would no longer be found past the emptied slot
+      std::uint32_t hole = index;
+      std::uint32_t next = (hole + 1) & part.mask;
+      while (part.slots[next].file != NULL)
+      {
+        const std::uint32_t home = hash(part.slots[next].file, part.slots[next].pageNo) & part.mask;
+        // move the entry unless its home lies cyclically in (hole, next]
+        if (((next - home) & part.mask) >= ((next - hole) & part.mask))
+        {
+          part.slots[hole] = part.slots[next];
+          hole = next;
+        }
+        next = (next + 1) & part.mask;
+      }
+      part.slots[hole].file = NULL;
+      part.count--;
       return;
     }
-		else
-		{
-      prevBuc = tmpBuc;
-      tmpBuc = tmpBuc->next;
-    }
+    index = (index + 1) & part.mask;
   }
 
   throw HashNotFoundException(file->filename(), pageNo);
@@ -8,11 +8,15 @@
 #pragma once
 
 #include "file.h"
+#include <cstdint>
+#include <mutex>
 
 namespace badgerdb {
 
 /**
 * @brief Declarations for buffer pool hash table
+*
+* A slot of the open addressing table, empty while file is NULL.
 */
 struct hashBucket {
 	/**
@@ -29,41 +33,86 @@ struct hashBucket {
 	 * frame number of page in the buffer pool
 	 */
 	FrameId frameNo;
-
-	/**
-	 * Next node in the hash table
-	 */
-	hashBucket*   next;
 };
 
 
 /**
 * @brief Hash table class to keep track of pages in the buffer pool
 *
-* @warning This class is not threadsafe.
+* The table is split into NUM_PARTITIONS partitions, each a flat array of slots searched with linear
+* probing, so a lookup touches one or two cache lines and inserts do not allocate. Partitions only grow
+* if more pages than expected hash into them. Each partition has its own latch. The table does not
+* latch itself: callers sharing it between threads hold partitionLatch(file, pageNo) around every
+* operation on (file, pageNo).
 */
 class BufHashTbl
 {
+ public:
+	/**
+	 * Number of latched partitions of the slots
+	 */
+  static const int NUM_PARTITIONS = 64;
+
  private:
 	/**
-	 *	Size of Hash Table
+	 * Slots of one partition
+	 */
+  struct Partition {
+		/**
+		 * Array of capacity slots, capacity being a power of two
+		 */
+		hashBucket *slots;
+
+		/**
+		 * capacity - 1
+		 */
+		std::uint32_t mask;
+
+		/**
+		 * Number of slots in use
+		 */
+		std::uint32_t count;
+  };
+
+	/**
+	 *	Size of Hash Table, the number of entries it is sized for
 	 */
   int HTSIZE;
+
+	/**
+	 * Actual Hash table object, NUM_PARTITIONS partitions
+	 */
+  Partition*  ht;
+
+	/**
+	 * Latch of every partition
+	 */
+  std::mutex *latches;
+
 	/**
-	 * Actual Hash table object
+	 * Partition of hash value h
 	 */
-  hashBucket**  ht;
+  static int partitionOf(const std::uint64_t h)
+  {
+		return (int)((h >> 32) % NUM_PARTITIONS);
+  }
 
 	/**
-	 * returns hash value between 0 and HTSIZE-1 computed using file and pageNo
+	 * Double the capacity of partition part and insert its entries again.
+	 */
+  void grow(Partition &part);
+
+ public:
+	/**
+	 * returns 64-bit hash value computed using file and pageNo. The high half picks the partition,
+	 * the low bits the slot within it.
 	 *
 	 * @param file   	File object
 	 * @param pageNo  Page number in the file
 	 * @return  			Hash value.
 	 */
-  int	 hash(const File* file, const PageId pageNo);
+  static std::uint64_t hash(const File* file, const PageId pageNo);
 
- public:
 	/**
    * Constructor of BufHashTbl class
 	 */
@@ -73,6 +122,17 @@ class BufHashTbl
    * Destructor of BufHashTbl class
 	 */
   ~BufHashTbl(); // destructor
+
+	/**
+   * Latch of the partition holding (file, pageNo).
+	 *
+	 * @param file   	File object
+	 * @param pageNo 	Page number in the file
+	 */
+  std::mutex &partitionLatch(const File* file, const PageId pageNo)
+  {
+		return latches[partitionOf(hash(file, pageNo))];
+  }
 	
 	/**
    * Insert entry into hash table mapping (file, pageNo) to frameNo.
@@ -81,12 +141,22 @@ class BufHashTbl
 	 * @param pageNo 	Page number in the file
 	 * @param frameNo Frame number assigned to that page of the file
    * @throws  HashAlreadyPresentException	if the corresponding page already exists in the hash table
-   * @throws  HashTableException (optional) if could not create a new bucket as running of memory
 	 */
   void insert(const File* file, const PageId pageNo, const FrameId frameNo);
 
 	/**
    * Check if (file, pageNo) is currently in the buffer pool (ie. in
+   * the hash table), without throwing if it is not.
+	 *
+	 * @param file  	File object
+	 * @param pageNo	Page number in the file
+	 * @param frameNo Frame number reference, set only if the page is found
+   * @return True if the page entry is found in the hash table
+	 */
+  bool find(const File* file, const PageId pageNo, FrameId &frameNo) const;
+
+	/**
+   * Check if (file, pageNo) is currently in the buffer pool (ie. in
    * the hash table).
 	 *
 	 * @param file  	File object
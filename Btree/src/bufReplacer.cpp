@@ -0,0 +1,537 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include "buffer.h"
+#include "bufReplacer.h"
+
+namespace badgerdb {
+
+bool BufReplacer::isValid(const FrameState &state)
+{
+  return state.isValid();
+}
+
+bool BufReplacer::isPinned(const FrameState &state)
+{
+  return state.pinCount() > 0;
+}
+
+void BufReplacer::setRefbit(FrameState &state, const bool refbit)
+{
+  state.setRefbit(refbit);
+}
+
+bool BufReplacer::clearRefbit(FrameState &state)
+{
+  return state.clearRefbit();
+}
+
+/**
+* @brief Clock algorithm, see ReplacementPolicy::CLOCK
+*/
+class ClockReplacer : public BufReplacer
+{
+ public:
+  ClockReplacer(const std::uint32_t numBufs, FrameState* frameStates)
+		: numBufs(numBufs), frameStates(frameStates), clockHand(numBufs - 1)
+  {
+  }
+
+  void referenced(const FrameId frame, const bool hot)
+  {
+		// set the referenced bit
+		setRefbit(frameStates[frame], true);
+  }
+
+  void loaded(const FrameId frame, const File* file, const PageId pageNo, const bool hot)
+  {
+		setRefbit(frameStates[frame], true);
+  }
+
+  void evicted(const FrameId frame)
+  {
+  }
+
+  void freed(const FrameId frame)
+  {
+  }
+
+  bool pickVictim(FrameId &frame, std::uint32_t &numScanned)
+  {
+		numScanned = 0;
+
+		while (numScanned < 2*numBufs)	//Need to scn twice
+		{
+			// advance the clock
+			const FrameId candidate = (clockHand.fetch_add(1) + 1) % numBufs;
+			numScanned++;
+			FrameState &state = frameStates[candidate];
+
+			// if invalid, use frame
+			// if it has been referenced, clear the bit and give it another round
+			// check to see if someone has it pinned
+			if (isValid(state) && (clearRefbit(state) || isPinned(state)))
+			{
+				continue;
+			}
+			frame = candidate;
+			return true;
+		}
+		return false;
+  }
+
+ private:
+  const std::uint32_t numBufs;
+  FrameState* frameStates;
+
+	/**
+   * Current position of clockhand in our buffer pool
+	 */
+  std::atomic<FrameId> clockHand;
+};
+
+/**
+* @brief Clock algorithm giving hot pages several rounds, see ReplacementPolicy::PRIORITY_CLOCK
+*/
+class PriorityClockReplacer : public BufReplacer
+{
+ public:
+	/**
+	 * Rounds of the clock hand a hot page survives without being read again
+	 */
+  static const std::uint8_t HOT_ROUNDS = 4;
+
+  PriorityClockReplacer(const std::uint32_t numBufs, FrameState* frameStates)
+		: numBufs(numBufs), frameStates(frameStates), clockHand(numBufs - 1),
+		  rounds(new std::atomic<std::uint8_t>[numBufs])
+  {
+		for (FrameId i = 0; i < numBufs; i++)
+			rounds[i] = 0;
+  }
+
+  ~PriorityClockReplacer()
+  {
+		delete [] rounds;
+  }
+
+  void referenced(const FrameId frame, const bool hot)
+  {
+		// a plain read does not take a hot page's extra rounds away
+		const std::uint8_t give = hot ? HOT_ROUNDS : 1;
+		if (rounds[frame] < give)
+			rounds[frame] = give;
+		setRefbit(frameStates[frame], true);
+  }
+
+  void loaded(const FrameId frame, const File* file, const PageId pageNo, const bool hot)
+  {
+		// pages get a round of their own only once they are read again, so that pages read once by
+		// a scan are the first to go
+		rounds[frame] = hot ? HOT_ROUNDS : 0;
+		setRefbit(frameStates[frame], hot);
+  }
+
+  void evicted(const FrameId frame)
+  {
+		rounds[frame] = 0;
+  }
+
+  void freed(const FrameId frame)
+  {
+		rounds[frame] = 0;
+  }
+
+  bool pickVictim(FrameId &frame, std::uint32_t &numScanned)
+  {
+		numScanned = 0;
+
+		// every page has run out of rounds after HOT_ROUNDS sweeps
+		while (numScanned < (HOT_ROUNDS + 1) * numBufs)
+		{
+			const FrameId candidate = (clockHand.fetch_add(1) + 1) % numBufs;
+			numScanned++;
+			FrameState &state = frameStates[candidate];
+
+			if (isValid(state))
+			{
+				std::uint8_t left = rounds[candidate];
+				if (left > 0)
+				{
+					// lost if the page is read meanwhile, which only gives it its rounds back
+					rounds[candidate] = left - 1;
+					setRefbit(state, left > 1);
+					continue;
+				}
+				if (isPinned(state))
+				{
+					continue;
+				}
+			}
+			frame = candidate;
+			return true;
+		}
+		return false;
+  }
+
+ private:
+  const std::uint32_t numBufs;
+  FrameState* frameStates;
+
+	/**
+   * Current position of clockhand in our buffer pool
+	 */
+  std::atomic<FrameId> clockHand;
+
+	/**
+	 * Rounds of the clock hand each frame survives
+	 */
+  std::atomic<std::uint8_t>* rounds;
+};
+
+/**
+* @brief 2Q, see ReplacementPolicy::TWO_Q
+*
+* Frames are linked into one of three queues through the prev and next arrays: free frames, the
+* FIFO queue of pages read once (A1in) and the LRU queue (Am). The pages last evicted from A1in are
+* remembered in A1out, without their frames.
+*/
+class TwoQReplacer : public BufReplacer
+{
+ public:
+  TwoQReplacer(const std::uint32_t numBufs, FrameState* frameStates, const bool &concurrent)
+		: numBufs(numBufs), frameStates(frameStates), concurrent(concurrent),
+		  maxIn(std::max(numBufs / 4, 1u)), maxOut(std::max(numBufs / 2, 1u)),
+		  queueOf(new std::uint8_t[numBufs]), prev(new FrameId[numBufs]), next(new FrameId[numBufs]),
+		  keys(new Key[numBufs])
+  {
+		for (int q = 0; q < NUM_QUEUES; q++)
+		{
+			queues[q].head = queues[q].tail = NO_FRAME;
+			queues[q].size = 0;
+		}
+		for (FrameId i = 0; i < numBufs; i++)
+		{
+			queueOf[i] = FREE;
+			pushFront(FREE, i);
+		}
+  }
+
+  ~TwoQReplacer()
+  {
+		delete [] queueOf;
+		delete [] prev;
+		delete [] next;
+		delete [] keys;
+  }
+
+  void referenced(const FrameId frame, const bool hot)
+  {
+		std::unique_lock<std::mutex> guard(latch, std::defer_lock);
+		if (concurrent) guard.lock();
+
+		// a page read again while in A1in is most likely read by the same scan, it stays there
+		if (queueOf[frame] == AM || (queueOf[frame] == IN && hot))
+		{
+			moveToFront(AM, frame);
+		}
+  }
+
+  void loaded(const FrameId frame, const File* file, const PageId pageNo, const bool hot)
+  {
+		std::unique_lock<std::mutex> guard(latch, std::defer_lock);
+		if (concurrent) guard.lock();
+
+		keys[frame] = Key(file, pageNo);
+		moveToFront((hot || ghosts.count(keys[frame]) > 0) ? AM : IN, frame);
+  }
+
+  void evicted(const FrameId frame)
+  {
+		std::unique_lock<std::mutex> guard(latch, std::defer_lock);
+		if (concurrent) guard.lock();
+
+		if (queueOf[frame] == IN)
+		{
+			// remember the page in A1out
+			ghosts[keys[frame]]++;
+			ghostOrder.push_back(keys[frame]);
+			if (ghostOrder.size() > maxOut)
+			{
+				std::unordered_map<Key, int, KeyHash>::iterator oldest = ghosts.find(ghostOrder.front());
+				if (--oldest->second == 0)
+					ghosts.erase(oldest);
+				ghostOrder.pop_front();
+			}
+		}
+		moveToFront(FREE, frame);
+  }
+
+  void freed(const FrameId frame)
+  {
+		std::unique_lock<std::mutex> guard(latch, std::defer_lock);
+		if (concurrent) guard.lock();
+
+		moveToFront(FREE, frame);
+  }
+
+  void retired(const FrameId frame)
+  {
+		std::unique_lock<std::mutex> guard(latch, std::defer_lock);
+		if (concurrent) guard.lock();
+
+		// in no queue, so that free frames are not looked at over and over
+		unlink(frame);
+		queueOf[frame] = RETIRED;
+  }
+
+  void restored(const FrameId frame)
+  {
+		std::unique_lock<std::mutex> guard(latch, std::defer_lock);
+		if (concurrent) guard.lock();
+
+		pushFront(FREE, frame);
+  }
+
+  bool pickVictim(FrameId &frame, std::uint32_t &scanned)
+  {
+		std::unique_lock<std::mutex> guard(latch, std::defer_lock);
+		if (concurrent) guard.lock();
+
+		scanned = 0;
+		// free frames first. The frame picked moves to the front of its queue, away from the end victims
+		// are taken from, so that threads racing for a frame do not all pick the same one.
+		int order[NUM_QUEUES] = {FREE, IN, AM};
+		if (queues[IN].size <= maxIn && queues[AM].size > 0)
+			std::swap(order[1], order[2]);
+
+		for (int q = 0; q < NUM_QUEUES; q++)
+		{
+			for (FrameId candidate = queues[order[q]].tail; candidate != NO_FRAME; candidate = prev[candidate])
+			{
+				scanned++;
+				if (order[q] == FREE || !isPinned(frameStates[candidate]))
+				{
+					moveToFront(order[q], candidate);
+					frame = candidate;
+					return true;
+				}
+			}
+		}
+		return false;
+  }
+
+ private:
+  enum QueueNo { FREE, IN, AM, NUM_QUEUES, RETIRED = NUM_QUEUES };
+
+  static const FrameId NO_FRAME = ~(FrameId)0;
+
+	/**
+	 * Page identity remembered in A1out
+	 */
+  typedef std::pair<const File*, PageId> Key;
+
+  struct KeyHash
+  {
+		std::size_t operator()(const Key &key) const
+		{
+			return std::hash<const File*>()(key.first) ^ ((std::size_t)key.second * 0x9e3779b9u);
+		}
+  };
+
+  struct Queue
+  {
+		FrameId head;
+		FrameId tail;
+		std::uint32_t size;
+  };
+
+  void unlink(const FrameId frame)
+  {
+		Queue &queue = queues[queueOf[frame]];
+		if (prev[frame] != NO_FRAME) next[prev[frame]] = next[frame];
+		else queue.head = next[frame];
+		if (next[frame] != NO_FRAME) prev[next[frame]] = prev[frame];
+		else queue.tail = prev[frame];
+		queue.size--;
+  }
+
+  void pushFront(const int q, const FrameId frame)
+  {
+		Queue &queue = queues[q];
+		queueOf[frame] = q;
+		prev[frame] = NO_FRAME;
+		next[frame] = queue.head;
+		if (queue.head != NO_FRAME) prev[queue.head] = frame;
+		else queue.tail = frame;
+		queue.head = frame;
+		queue.size++;
+  }
+
+  void moveToFront(const int q, const FrameId frame)
+  {
+		unlink(frame);
+		pushFront(q, frame);
+  }
+
+  const std::uint32_t numBufs;
+  FrameState* frameStates;
+  const bool &concurrent;
+
+	/**
+	 * Sizes of A1in above which it is evicted from first, and of A1out
+	 */
+  const std::uint32_t maxIn, maxOut;
+
+	/**
+	 * Latch of all the queues in concurrent mode
+	 */
+  std::mutex latch;
+
+  Queue queues[NUM_QUEUES];
+  std::uint8_t* queueOf;
+  FrameId* prev;
+  FrameId* next;
+
+	/**
+	 * Page held by every frame
+	 */
+  Key* keys;
+
+	/**
+	 * A1out, the pages in it with how often each occurs in ghostOrder, oldest first
+	 */
+  std::unordered_map<Key, int, KeyHash> ghosts;
+  std::deque<Key> ghostOrder;
+};
+
+/**
+* @brief Replacer of a pool split into partitions, passing the frames of each partition on to a
+* replacer of its own
+*/
+class PartitionedReplacer : public BufReplacer
+{
+ public:
+  PartitionedReplacer(const ReplacementPolicy policy, const std::uint32_t numBufs, FrameState* frameStates,
+			const bool &concurrent, const std::uint32_t numPartitions)
+		: numPartitions(numPartitions), starts(numPartitions + 1), parts(numPartitions)
+  {
+		for (std::uint32_t p = 0; p <= numPartitions; p++)
+			starts[p] = partitionStart(numBufs, numPartitions, p);
+		for (std::uint32_t p = 0; p < numPartitions; p++)
+			parts[p] = create(policy, starts[p + 1] - starts[p], frameStates + starts[p], concurrent);
+  }
+
+  ~PartitionedReplacer()
+  {
+		for (std::uint32_t p = 0; p < numPartitions; p++)
+			delete parts[p];
+  }
+
+  void referenced(const FrameId frame, const bool hot)
+  {
+		const std::uint32_t p = partitionOf(frame);
+		parts[p]->referenced(frame - starts[p], hot);
+  }
+
+  void loaded(const FrameId frame, const File* file, const PageId pageNo, const bool hot)
+  {
+		const std::uint32_t p = partitionOf(frame);
+		parts[p]->loaded(frame - starts[p], file, pageNo, hot);
+  }
+
+  void evicted(const FrameId frame)
+  {
+		const std::uint32_t p = partitionOf(frame);
+		parts[p]->evicted(frame - starts[p]);
+  }
+
+  void freed(const FrameId frame)
+  {
+		const std::uint32_t p = partitionOf(frame);
+		parts[p]->freed(frame - starts[p]);
+  }
+
+  void retired(const FrameId frame)
+  {
+		const std::uint32_t p = partitionOf(frame);
+		parts[p]->retired(frame - starts[p]);
+  }
+
+  void restored(const FrameId frame)
+  {
+		const std::uint32_t p = partitionOf(frame);
+		parts[p]->restored(frame - starts[p]);
+  }
+
+  bool pickVictim(FrameId &frame, std::uint32_t &scanned)
+  {
+		return pickVictimIn(frame, scanned, 0);
+  }
+
+  bool pickVictimIn(FrameId &frame, std::uint32_t &scanned, const std::uint32_t partition)
+  {
+		scanned = 0;
+		for (std::uint32_t i = 0; i < numPartitions; i++)
+		{
+			const std::uint32_t p = (partition + i) % numPartitions;
+			FrameId local;
+			std::uint32_t partScanned;
+			const bool found = parts[p]->pickVictim(local, partScanned);
+			scanned += partScanned;
+			if (found)
+			{
+				frame = starts[p] + local;
+				return true;
+			}
+		}
+		return false;
+  }
+
+ private:
+  std::uint32_t partitionOf(const FrameId frame) const
+  {
+		return std::upper_bound(starts.begin(), starts.end(), frame) - starts.begin() - 1;
+  }
+
+  const std::uint32_t numPartitions;
+
+	/**
+	 * First frame of every partition, and the number of frames last
+	 */
+  std::vector<FrameId> starts;
+
+  std::vector<BufReplacer*> parts;
+};
+
+const std::uint8_t PriorityClockReplacer::HOT_ROUNDS;
+const FrameId TwoQReplacer::NO_FRAME;
+
+BufReplacer* BufReplacer::create(const ReplacementPolicy policy, const std::uint32_t numBufs,
+		FrameState* frameStates, const bool &concurrent, const std::uint32_t numPartitions)
+{
+  if (numPartitions > 1)
+  {
+		return new PartitionedReplacer(policy, numBufs, frameStates, concurrent, numPartitions);
+  }
+  switch (policy)
+  {
+  case TWO_Q:
+		return new TwoQReplacer(numBufs, frameStates, concurrent);
+  case PRIORITY_CLOCK:
+		return new PriorityClockReplacer(numBufs, frameStates);
+  default:
+		return new ClockReplacer(numBufs, frameStates);
+  }
+}
+
+}
@@ -0,0 +1,173 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include "file.h"
+#include <cstdint>
+
+namespace badgerdb {
+
+/**
+* forward declaration of FrameState class
+*/
+class FrameState;
+
+/**
+ * @brief Replacement policies of the buffer pool. Passed to the BufMgr constructor.
+ */
+enum ReplacementPolicy
+{
+	/**
+	 * Clock algorithm with one reference bit per frame. Takes no latch in concurrent mode.
+	 */
+	CLOCK,
+
+	/**
+	 * 2Q: pages read once go through a FIFO queue, and only pages read again shortly after they left
+	 * it enter the LRU queue. Long scans therefore only evict each other. Pages read as hot go to
+	 * the LRU queue directly.
+	 */
+	TWO_Q,
+
+	/**
+	 * Clock algorithm where pages read as hot survive several sweeps of the clock hand, so that
+	 * inner index nodes stay in the pool while leaves and heap pages cycle through it. Pages not
+	 * read again since they were loaded are evicted first.
+	 */
+	PRIORITY_CLOCK
+};
+
+/**
+* @brief Chooses the frames of the buffer pool to evict.
+*
+* The buffer manager reports every page it reads or loads and every page that leaves the pool, and
+* asks for a victim whenever it needs a frame. Pinned frames are never returned as victims. In
+* concurrent mode the methods are called from several threads, with at most hash table partition
+* and frame latches held, and policies latch themselves as needed.
+*
+* A pool split into partitions gets one replacer of the policy per partition, each with its own
+* state such as a clock hand, over the consecutive frames starting at partitionStart().
+*/
+class BufReplacer
+{
+ public:
+	/**
+	 * Create the replacer of a policy.
+	 *
+	 * @param policy		Replacement policy
+	 * @param numBufs		Number of frames in the buffer pool
+	 * @param frameStates	Replacement state of the frames
+	 * @param concurrent	True if the buffer pool is shared by several threads. Policies keep a reference,
+	 *                  since the buffer manager turns it on to read ahead.
+	 * @param numPartitions	Number of partitions of the pool, at most numBufs
+	 */
+  static BufReplacer* create(const ReplacementPolicy policy, const std::uint32_t numBufs,
+			FrameState* frameStates, const bool &concurrent, const std::uint32_t numPartitions = 1);
+
+	/**
+	 * First frame of a partition of the pool. Partition numPartitions starts past the last frame.
+	 */
+  static FrameId partitionStart(const std::uint32_t numBufs, const std::uint32_t numPartitions,
+			const std::uint32_t partition)
+  {
+		return (FrameId)((std::uint64_t)numBufs * partition / numPartitions);
+  }
+
+  virtual ~BufReplacer() {}
+
+	/**
+	 * The page in frame was read again while it was in the pool.
+	 *
+	 * @param frame		Frame number
+	 * @param hot		True if the page is expected to be read again soon, as inner index nodes are
+	 */
+  virtual void referenced(const FrameId frame, const bool hot) = 0;
+
+	/**
+	 * A page was read or allocated into frame.
+	 *
+	 * @param frame		Frame number
+	 * @param file		File of the page
+	 * @param pageNo	Page number in the file
+	 * @param hot		True if the page is expected to be read again soon
+	 */
+  virtual void loaded(const FrameId frame, const File* file, const PageId pageNo, const bool hot) = 0;
+
+	/**
+	 * The page in frame was evicted to make room for another page.
+	 */
+  virtual void evicted(const FrameId frame) = 0;
+
+	/**
+	 * The page in frame was flushed or disposed of, and frame is free.
+	 */
+  virtual void freed(const FrameId frame) = 0;
+
+	/**
+	 * The frame was taken out of the pool by BufMgr::resize(). It holds no page, and looks valid and
+	 * pinned to isValid() and isPinned() until it is restored().
+	 */
+  virtual void retired(const FrameId frame)
+  {
+  }
+
+	/**
+	 * A frame retired() before is back in the pool, free.
+	 */
+  virtual void restored(const FrameId frame)
+  {
+		freed(frame);
+  }
+
+	/**
+	 * Choose the next frame to evict, preferring free frames. The frame may have been pinned by another
+	 * thread meanwhile, the buffer manager checks again before it evicts it.
+	 *
+	 * @param frame		Frame number of the victim returned via this reference
+	 * @param scanned	Number of frames looked at returned via this reference, for BufStats::sweepLengths
+	 * @return False if every frame seemed pinned
+	 */
+  virtual bool pickVictim(FrameId &frame, std::uint32_t &scanned) = 0;
+
+	/**
+	 * pickVictim() trying the frames of a partition of the pool first, then those of the following
+	 * partitions.
+	 *
+	 * @param frame		Frame number of the victim returned via this reference
+	 * @param scanned	Number of frames looked at returned via this reference
+	 * @param partition	Partition to take the frame from if it can
+	 * @return False if every frame seemed pinned
+	 */
+  virtual bool pickVictimIn(FrameId &frame, std::uint32_t &scanned, const std::uint32_t partition)
+  {
+		return pickVictim(frame, scanned);
+  }
+
+ protected:
+	/**
+	 * True if the frame holds a page
+	 */
+  static bool isValid(const FrameState &state);
+
+	/**
+	 * True if the page in the frame is pinned
+	 */
+  static bool isPinned(const FrameState &state);
+
+	/**
+	 * Set the reference bit of the frame
+	 */
+  static void setRefbit(FrameState &state, const bool refbit);
+
+	/**
+	 * Clear the reference bit of the frame and return the previous value
+	 */
+  static bool clearRefbit(FrameState &state);
+};
+
+}
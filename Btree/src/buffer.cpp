@@ -5,253 +5,1704 @@
  * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
  */
 
+#include <algorithm>
+#include <chrono>
+#include <functional>
 #include <memory>
 #include <iostream>
+#include <new>
+#include <thread>
+#include <type_traits>
+#include <cstdio>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <linux/mempolicy.h>
+#endif
 #include "buffer.h"
+#include "trace.h"
 #include "exceptions/buffer_exceeded_exception.h"
 #include "exceptions/page_not_pinned_exception.h"
 #include "exceptions/page_pinned_exception.h"
 #include "exceptions/bad_buffer_exception.h"
 #include "exceptions/hash_not_found_exception.h"
 #include "exceptions/hash_already_present_exception.h"
+#include "exceptions/badgerdb_exception.h"
+#include "exceptions/corrupt_page_exception.h"
 
 namespace badgerdb { 
 
+/**
+ * Holds a latch until the end of the scope, or until release(). Does nothing unless the buffer
+ * manager is in concurrent mode.
+ */
+class LatchGuard
+{
+ public:
+  LatchGuard(std::mutex &latch, const bool concurrent)
+		: held(concurrent ? &latch : NULL)
+  {
+		if (held) held->lock();
+  }
+
+  LatchGuard(std::mutex &latch, const bool concurrent, std::adopt_lock_t)
+		: held(concurrent ? &latch : NULL)
+  {
+  }
+
+  ~LatchGuard()
+  {
+		release();
+  }
+
+  void release()
+  {
+		if (held) held->unlock();
+		held = NULL;
+  }
+
+ private:
+  std::mutex *held;
+};
+
+/**
+ * Page of a frame to be written back. Sorts by file and page number, so that consecutive pages of a file
+ * are next to each other.
+ */
+struct FrameWrite
+{
+  const File* file;
+  PageId pageNo;
+  FrameId frameNo;
+
+  bool operator<(const FrameWrite &other) const
+  {
+		if (file != other.file)
+			return std::less<const File*>()(file, other.file);
+		return pageNo < other.pageNo;
+  }
+};
+
+/**
+ * Counters of the buffer manager kept by one thread. Only the thread itself changes them, with plain loads
+ * and stores rather than read-modify-writes that would have to own a shared cache line; snapshots read
+ * them meanwhile.
+ */
+class ThreadBufStats
+{
+ public:
+  typedef std::chrono::steady_clock Clock;
+
+  /**
+   * BufHistogram the thread adds to
+   */
+  struct Histogram
+  {
+    std::atomic<std::uint64_t> counts[BufHistogram::BUCKETS];
+
+    Histogram()
+    {
+      for (int i = 0; i < BufHistogram::BUCKETS; i++)
+        counts[i] = 0;
+    }
+
+    void add(const std::uint64_t value)
+    {
+      bump(counts[BufHistogram::bucket(value)]);
+    }
+
+    std::uint64_t addNanosSince(const Clock::time_point start)
+    {
+      const std::uint64_t nanos = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count();
+      add(nanos);
+      return nanos;
+    }
+
+    void sumInto(BufHistogram &histogram) const
+    {
+      for (int i = 0; i < BufHistogram::BUCKETS; i++)
+        histogram.counts[i] += counts[i].load(std::memory_order_relaxed);
+    }
+  };
+
+  /**
+   * FileBufStats the thread adds to
+   */
+  struct FileCounters
+  {
+    std::atomic<std::uint64_t> hits;
+    std::atomic<std::uint64_t> misses;
+
+    FileCounters() : hits(0), misses(0) {}
+  };
+
+  explicit ThreadBufStats(const std::thread::id owner)
+    : owner(owner), accesses(0), hits(0), diskreads(0), diskwrites(0), cleanEvictions(0),
+      dirtyEvictions(0), cachedEpoch(0)
+  {
+  }
+
+  /**
+   * Add to a counter of the thread
+   */
+  static void bump(std::atomic<std::uint64_t> &counter, const std::uint64_t count = 1)
+  {
+    counter.store(counter.load(std::memory_order_relaxed) + count, std::memory_order_relaxed);
+  }
+
+  /**
+   * Counters of a file. Files are looked up by name the first time the thread counts for them, and
+   * through a cache of the File objects seen afterwards, until epoch changes.
+   *
+   * @param epoch  BufMgr::filesEpoch, changed whenever a File object may have been destroyed
+   */
+  FileCounters &of(const File* file, const std::uint64_t epoch)
+  {
+    if (epoch != cachedEpoch)
+    {
+      fileCache.clear();
+      cachedEpoch = epoch;
+    }
+    std::unordered_map<const File*, FileCounters*>::const_iterator cached = fileCache.find(file);
+    if (cached != fileCache.end())
+    {
+      return *cached->second;
+    }
+    std::lock_guard<std::mutex> guard(filesLatch);
+    FileCounters *counters = &files[file->filename()];
+    fileCache[file] = counters;
+    return *counters;
+  }
+
+  /**
+   * Add the counters of the thread to stats
+   */
+  void sumInto(BufStats &stats)
+  {
+    stats.accesses += accesses.load(std::memory_order_relaxed);
+    stats.hits += hits.load(std::memory_order_relaxed);
+    stats.diskreads += diskreads.load(std::memory_order_relaxed);
+    stats.diskwrites += diskwrites.load(std::memory_order_relaxed);
+    stats.cleanEvictions += cleanEvictions.load(std::memory_order_relaxed);
+    stats.dirtyEvictions += dirtyEvictions.load(std::memory_order_relaxed);
+    frameWaitNanos.sumInto(stats.frameWaitNanos);
+    readNanos.sumInto(stats.readNanos);
+    writeNanos.sumInto(stats.writeNanos);
+    sweepLengths.sumInto(stats.sweepLengths);
+    std::lock_guard<std::mutex> guard(filesLatch);
+    for (std::map<std::string, FileCounters>::const_iterator i = files.begin(); i != files.end(); ++i)
+    {
+      FileBufStats &file = stats.files[i->first];
+      file.hits += i->second.hits.load(std::memory_order_relaxed);
+      file.misses += i->second.misses.load(std::memory_order_relaxed);
+    }
+  }
+
+  /**
+   * Thread the counters belong to
+   */
+  const std::thread::id owner;
+
+  std::atomic<std::uint64_t> accesses;
+  std::atomic<std::uint64_t> hits;
+  std::atomic<std::uint64_t> diskreads;
+  std::atomic<std::uint64_t> diskwrites;
+  std::atomic<std::uint64_t> cleanEvictions;
+  std::atomic<std::uint64_t> dirtyEvictions;
+  Histogram frameWaitNanos;
+  Histogram readNanos;
+  Histogram writeNanos;
+  Histogram sweepLengths;
+
+ private:
+  /**
+   * Counters of every file the thread counted for, by file name. Entries are only added, under
+   * filesLatch, and keep their address.
+   */
+  std::map<std::string, FileCounters> files;
+  std::mutex filesLatch;
+
+  /**
+   * Entries of files for File objects, only used by the thread itself
+   */
+  std::unordered_map<const File*, FileCounters*> fileCache;
+  std::uint64_t cachedEpoch;
+};
+
+namespace {
+
+/**
+ * Counters of the calling thread for the buffer manager whose statsId is mgrId, see BufMgr::localStats()
+ */
+struct LocalStats
+{
+  std::uint64_t mgrId;
+  ThreadBufStats *stats;
+};
+
+thread_local LocalStats localStatsCache = {0, NULL};
+
+/**
+ * Next BufMgr::statsId, 0 is never used
+ */
+std::atomic<std::uint64_t> nextStatsId(1);
+
+}
+
+std::uint64_t BufHistogram::total() const
+{
+  std::uint64_t sum = 0;
+  for (int i = 0; i < BUCKETS; i++)
+    sum += counts[i];
+  return sum;
+}
+
+std::uint64_t BufHistogram::percentile(const double fraction) const
+{
+  const std::uint64_t target = (std::uint64_t)(fraction * total() + 0.999999);
+  std::uint64_t sum = 0;
+  for (int i = 0; i < BUCKETS; i++)
+  {
+    sum += counts[i];
+    if (sum >= target && sum > 0)
+      return i == 0 ? 0 : (((std::uint64_t)1 << i) - 1);
+  }
+  return 0;
+}
+
+void BufHistogram::clear()
+{
+  for (int i = 0; i < BUCKETS; i++)
+    counts[i] = 0;
+}
+
+void BufStats::clear()
+{
+  accesses = diskreads = diskwrites = 0;
+  hits = cleanEvictions = dirtyEvictions = 0;
+  dirtyFrames = dirtyHighWater = 0;
+  frameWaitNanos.clear();
+  readNanos.clear();
+  writeNanos.clear();
+  sweepLengths.clear();
+  files.clear();
+}
+
+PageHandle::PageHandle()
+  : bufMgr(NULL), file(NULL), pageNumber(Page::INVALID_NUMBER), frameNo(0), page(NULL), dirty(false)
+{
+}
+
+PageHandle::PageHandle(BufMgr* bufMgr, File* file, const PageId pageNo, const FrameId frameNo, Page* page)
+  : bufMgr(bufMgr), file(file), pageNumber(pageNo), frameNo(frameNo), page(page), dirty(false)
+{
+}
+
+PageHandle::PageHandle(PageHandle&& other)
+  : bufMgr(other.bufMgr), file(other.file), pageNumber(other.pageNumber), frameNo(other.frameNo),
+    page(other.page), dirty(other.dirty)
+{
+  other.page = NULL;
+}
+
+PageHandle& PageHandle::operator=(PageHandle&& other)
+{
+  if (this != &other)
+  {
+    release();
+    bufMgr = other.bufMgr;
+    file = other.file;
+    pageNumber = other.pageNumber;
+    frameNo = other.frameNo;
+    page = other.page;
+    dirty = other.dirty;
+    other.page = NULL;
+  }
+  return *this;
+}
+
+PageHandle::~PageHandle()
+{
+  // the handle holds the pin, so unpinning only fails if the pool is gone
+  try
+  {
+    release();
+  }
+  catch (...)
+  {
+  }
+}
+
+void PageHandle::release(const bool dirty)
+{
+  if (page == NULL)
+  {
+    return;
+  }
+  // empty before unpinning, so that a failed unpin is not tried again
+  page = NULL;
+  bufMgr->unPinFrame(file, pageNumber, frameNo, dirty || this->dirty);
+  this->dirty = false;
+}
+
+const std::uint32_t BufMgr::WRITER_BATCH;
+const std::uint32_t BufMgr::WRITER_INTERVAL;
+const FrameId BufMgr::NO_FRAME;
+
 //----------------------------------------
 // Constructor of the class BufMgr
 //----------------------------------------
 
-BufMgr::BufMgr(std::uint32_t bufs)
-	: numBufs(bufs) {
-	bufDescTable = new BufDesc[bufs];
+/**
+ * Number of NUMA nodes of the host, 1 if it cannot be told
+ */
+static std::uint32_t hostNodes()
+{
+  std::uint32_t nodes = 0;
+  char path[64];
+  while (true)
+  {
+    snprintf(path, sizeof(path), "/sys/devices/system/node/node%u", nodes);
+    if (access(path, F_OK) != 0)
+    {
+      break;
+    }
+    nodes++;
+  }
+  return std::max(nodes, 1u);
+}
+
+BufMgr::BufMgr(std::uint32_t bufs, const bool concurrent, const ReplacementPolicy policy,
+		const FrameMemory frameMemory, const std::uint32_t partitions, const std::uint32_t maxBufs)
+	: concurrent(concurrent), readAheadThread(NULL), readAheadFile(NULL), cancelReadAhead(false),
+	  stopReadAhead(false), stopAsync(false), writerThread(NULL), stopWriter(false), writerHand(0),
+	  numBufs(std::max(bufs, maxBufs)), poolSize(numBufs) {
+  statsId = nextStatsId++;
+  dirtyFrames = 0;
+  dirtyHighWater = 0;
+  filesEpoch = 0;
+  wal = NULL;
+  loggedPages = NULL;
+  checkpointThread = NULL;
+  stopCheckpoints = false;
+  checkpointInterval = 0;
+  numNodes = hostNodes();
+  numPartitions = std::max(1u, std::min(partitions == 0 ? numNodes : partitions, numBufs));
+
+  // descriptors are constructed once their memory is placed on the nodes of their partitions
+  bufDescBytes = (std::size_t)numBufs * sizeof(BufDesc);
+  void *descArena = mmap(NULL, bufDescBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (descArena == MAP_FAILED)
+  {
+    throw std::bad_alloc();
+  }
+  bindPartitions(descArena, sizeof(BufDesc));
+	bufDescTable = static_cast<BufDesc*>(descArena);
+
+  // the states the replacement policy sweeps over are packed apart from the descriptors
+  frameStatesBytes = (std::size_t)numBufs * sizeof(FrameState);
+  void *stateArena = mmap(NULL, frameStatesBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (stateArena == MAP_FAILED)
+  {
+    munmap(descArena, bufDescBytes);
+    throw std::bad_alloc();
+  }
+  bindPartitions(stateArena, sizeof(FrameState));
+  frameStates = static_cast<FrameState*>(stateArena);
+
+  for (FrameId i = 0; i < numBufs; i++) 
+  {
+  	new (&frameStates[i]) FrameState();
+  	new (&bufDescTable[i]) BufDesc(&frameStates[i]);
+  	bufDescTable[i].frameNo = i;
+  }
+
+  mapFrames(frameMemory);
+
+  int htsize = ((((int) (numBufs * 1.2))*2)/2)+1;
+  hashTable = new BufHashTbl (htsize);  // allocate the buffer hash table
+
+  replacer = BufReplacer::create(policy, numBufs, frameStates, this->concurrent, numPartitions);
+
+  // the frames past bufs are retired until the pool grows
+  resize(bufs);
+}
+
+
+// frames are filled by copying whole pages into them, and are never constructed
+static_assert(std::is_trivially_copyable<Page>::value, "frames are not constructed");
+
+/**
+ * Size of the huge pages the arena of the frames is rounded to when they are asked for
+ */
+static const std::size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+
+void BufMgr::mapFrames(const FrameMemory frameMemory)
+{
+  bufPoolBytes = (std::size_t)numBufs * sizeof(Page);
+  if (frameMemory != FRAMES_SMALL_PAGES)
+  {
+    bufPoolBytes = (bufPoolBytes + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+  }
+
+  // anonymous memory is zeroed by the kernel on first touch
+  void *arena = MAP_FAILED;
+#ifdef MAP_HUGETLB
+  if (frameMemory == FRAMES_HUGE_PAGES)
+  {
+    arena = mmap(NULL, bufPoolBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+  }
+#endif
+  if (arena == MAP_FAILED)
+  {
+    arena = mmap(NULL, bufPoolBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (arena == MAP_FAILED)
+    {
+      throw std::bad_alloc();
+    }
+#ifdef MADV_HUGEPAGE
+    if (frameMemory != FRAMES_SMALL_PAGES)
+    {
+      madvise(arena, bufPoolBytes, MADV_HUGEPAGE);
+    }
+#endif
+  }
+  bindPartitions(arena, sizeof(Page));
+  bufPool = static_cast<Page*>(arena);
+}
+
+void BufMgr::bindPartitions(void* array, const std::size_t elementSize)
+{
+#if defined(__linux__) && defined(SYS_mbind)
+  if (numPartitions < 2 || numNodes < 2)
+  {
+    return;
+  }
+  const std::size_t pageSize = sysconf(_SC_PAGESIZE);
+  char *base = static_cast<char*>(array);
+  std::size_t begin = 0;
+  for (std::uint32_t p = 0; p < numPartitions; p++)
+  {
+    const std::size_t end = (BufReplacer::partitionStart(numBufs, numPartitions, p + 1) * elementSize
+        + pageSize - 1) / pageSize * pageSize;
+    const std::uint32_t node = p % numNodes;
+    if (end > begin && node < sizeof(unsigned long) * 8)
+    {
+      // only a preference, memory comes from other nodes once the node is full
+      unsigned long mask = 1UL << node;
+      syscall(SYS_mbind, base + begin, end - begin, MPOL_PREFERRED, &mask, sizeof(mask) * 8, 0);
+    }
+    begin = end;
+  }
+#endif
+}
+
+std::uint32_t BufMgr::ownerPartition(const File* file, const PageId pageNo) const
+{
+  if (numPartitions == 1)
+  {
+    return 0;
+  }
+  return (std::uint32_t)((BufHashTbl::hash(file, pageNo) >> 32) % numPartitions);
+}
+
+std::uint32_t BufMgr::localPartition() const
+{
+  if (numPartitions == 1)
+  {
+    return 0;
+  }
+#if defined(__linux__) && defined(SYS_getcpu)
+  unsigned cpu, node;
+  if (syscall(SYS_getcpu, &cpu, &node, NULL) == 0)
+  {
+    return node % numPartitions;
+  }
+#endif
+  return 0;
+}
+
+BufMgr::~BufMgr() {
+  for (std::map<std::string, BufMgr*>::iterator it = pools.begin(); it != pools.end(); ++it)
+  {
+    delete it->second;
+  }
+  if (checkpointThread)
+  {
+    {
+      std::lock_guard<std::mutex> guard(checkpointLatch);
+      stopCheckpoints = true;
+    }
+    checkpointSignal.notify_all();
+    checkpointThread->join();
+    delete checkpointThread;
+  }
+  if (writerThread)
+  {
+    {
+      std::lock_guard<std::mutex> guard(writerLatch);
+      stopWriter = true;
+    }
+    writerSignal.notify_all();
+    writerThread->join();
+    delete writerThread;
+  }
+  if (readAheadThread)
+  {
+    {
+      std::lock_guard<std::mutex> guard(readAheadLatch);
+      stopReadAhead = true;
+      cancelReadAhead = true;
+    }
+    readAheadSignal.notify_all();
+    readAheadThread->join();
+    delete readAheadThread;
+  }
+  if (!asyncThreads.empty())
+  {
+    // the reads still queued are served first, so that every caller hears back
+    {
+      std::lock_guard<std::mutex> guard(asyncLatch);
+      stopAsync = true;
+    }
+    asyncSignal.notify_all();
+    for (std::size_t i = 0; i < asyncThreads.size(); i++)
+    {
+      asyncThreads[i]->join();
+      delete asyncThreads[i];
+    }
+  }
+
+  //Flush out all unwritten pages, after the records of their changes
+  if (wal)
+  {
+    wal->flushAll();
+  }
+  for (std::uint32_t i = 0; i < numBufs; i++) 
+  {
+  	BufDesc* tmpbuf = &bufDescTable[i];
+  	if (frameStates[i].isValid() && tmpbuf->dirty == true)
+		{
+			tmpbuf->file->writePage(tmpbuf->pageNo, bufPool[i]);
+  	}
+  }
+
+  for (std::uint32_t i = 0; i < numBufs; i++) 
+  {
+  	bufDescTable[i].~BufDesc();
+  }
+  munmap(bufDescTable, bufDescBytes);
+  munmap(frameStates, frameStatesBytes);
+  munmap(bufPool, bufPoolBytes);
+  if (loggedPages)
+  {
+    munmap(loggedPages, (std::size_t)numBufs * sizeof(Page));
+  }
+  delete hashTable;
+  delete replacer;
+  for (std::size_t i = 0; i < threadStats.size(); i++)
+  {
+    delete threadStats[i];
+  }
+}
+
+ThreadBufStats &BufMgr::localStats()
+{
+  if (localStatsCache.mgrId == statsId)
+  {
+    return *localStatsCache.stats;
+  }
+  // a thread using several buffer managers in turn finds its counters again
+  LatchGuard guard(threadStatsLatch, true);
+  const std::thread::id self = std::this_thread::get_id();
+  ThreadBufStats *stats = NULL;
+  for (std::size_t i = 0; i < threadStats.size() && stats == NULL; i++)
+  {
+    if (threadStats[i]->owner == self)
+      stats = threadStats[i];
+  }
+  if (stats == NULL)
+  {
+    stats = new ThreadBufStats(self);
+    threadStats.push_back(stats);
+  }
+  localStatsCache.mgrId = statsId;
+  localStatsCache.stats = stats;
+  return *stats;
+}
+
+void BufMgr::sumStats(BufStats &stats)
+{
+  stats.clear();
+  for (std::size_t i = 0; i < threadStats.size(); i++)
+  {
+    threadStats[i]->sumInto(stats);
+  }
+}
+
+BufStats BufMgr::getBufStats()
+{
+  LatchGuard guard(threadStatsLatch, true);
+  BufStats stats;
+  sumStats(stats);
+  stats.accesses -= statsBaseline.accesses;
+  stats.diskreads -= statsBaseline.diskreads;
+  stats.diskwrites -= statsBaseline.diskwrites;
+  stats.hits -= statsBaseline.hits;
+  stats.cleanEvictions -= statsBaseline.cleanEvictions;
+  stats.dirtyEvictions -= statsBaseline.dirtyEvictions;
+  for (int i = 0; i < BufHistogram::BUCKETS; i++)
+  {
+    stats.frameWaitNanos.counts[i] -= statsBaseline.frameWaitNanos.counts[i];
+    stats.readNanos.counts[i] -= statsBaseline.readNanos.counts[i];
+    stats.writeNanos.counts[i] -= statsBaseline.writeNanos.counts[i];
+    stats.sweepLengths.counts[i] -= statsBaseline.sweepLengths.counts[i];
+  }
+  for (std::map<std::string, FileBufStats>::const_iterator i = statsBaseline.files.begin();
+       i != statsBaseline.files.end(); ++i)
+  {
+    FileBufStats &file = stats.files[i->first];
+    file.hits -= i->second.hits;
+    file.misses -= i->second.misses;
+    if (file.hits == 0 && file.misses == 0)
+      stats.files.erase(i->first);
+  }
+  stats.dirtyFrames = dirtyFrames;
+  stats.dirtyHighWater = dirtyHighWater;
+  return stats;
+}
+
+void BufMgr::clearBufStats()
+{
+  LatchGuard guard(threadStatsLatch, true);
+  sumStats(statsBaseline);
+  dirtyHighWater = dirtyFrames.load();
+}
+
+void BufMgr::setDirty(BufDesc &desc, const bool dirty)
+{
+  if (desc.dirty == dirty)
+  {
+    return;
+  }
+  desc.dirty = dirty;
+  if (!dirty)
+  {
+    dirtyFrames--;
+    return;
+  }
+  const int now = dirtyFrames.fetch_add(1) + 1;
+  int highest = dirtyHighWater.load();
+  while (now > highest && !dirtyHighWater.compare_exchange_weak(highest, now))
+  {
+  }
+}
+
+
+bool BufMgr::anyUnpinned() const
+{
+  for (FrameId i = 0; i < numBufs; i++)
+  {
+    if (frameStates[i].pinCount() == 0)
+    {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool BufMgr::claimBuf(const FrameId frame)
+{
+  BufDesc &desc = bufDescTable[frame];
+  const FrameState &state = frameStates[frame];
+
+  // if invalid, use frame
+  if (! state.isValid())
+  {
+    desc.Clear();
+    return true;
+  }
+
+  // check to see if someone has it pinned; pins are taken under the partition latch, so the
+  // check is repeated under it before the page leaves the hash table
+  if (state.pinCount() > 0)
+  {
+    return false;
+  }
+  File *file = desc.file;
+  const PageId pageNo = desc.pageNo;
+  LatchGuard partition(hashTable->partitionLatch(file, pageNo), concurrent);
+  if (state.pinCount() > 0)
+  {
+    return false;
+  }
+
+  // flush any existing changes to disk if necessary. The page stays in the hash table meanwhile,
+  // so that nobody reads the stale copy from disk, and is kept if it was pinned again.
+  ThreadBufStats &stats = localStats();
+  const bool wasDirty = desc.dirty;
+  if (wasDirty)
+  {
+    setDirty(desc, false);
+    partition.release();
+    flushLogFor(frame);
+    {
+      const ThreadBufStats::Clock::time_point start = ThreadBufStats::Clock::now();
+      LatchGuard io(ioLatch, concurrent);
+      ThreadBufStats::bump(stats.diskwrites);
+      file->writePage(pageNo, bufPool[frame]);
+      io.release();
+      stats.writeNanos.addNanosSince(start);
+    }
+    LatchGuard again(hashTable->partitionLatch(file, pageNo), concurrent);
+    if (state.pinCount() > 0 || desc.dirty)
+    {
+      return false;
+    }
+    hashTable->remove(file, pageNo);
+  }
+  else
+  {
+    // hasn't been referenced and is not pinned, use it
+    // remove previous entry from hash table
+    hashTable->remove(file, pageNo);
+  }
+
+	//Reset all the BufDesc entry for the frame before returning the frame
+  removeFileFrame(frame);
+  desc.Clear();
+  replacer->evicted(frame);
+  ThreadBufStats::bump(wasDirty ? stats.dirtyEvictions : stats.cleanEvictions);
+  return true;
+}
+
+
+void BufMgr::allocBuf(FrameId & frame, const std::uint32_t partition) 
+{
+  // ask the replacement policy for open buffer frames until one can be taken
+  FrameId candidate;
+  ThreadBufStats &stats = localStats();
+  while (true)
+  {
+    std::uint32_t scanned;
+    const bool found = replacer->pickVictimIn(candidate, scanned, partition);
+    stats.sweepLengths.add(scanned);
+    if (!found)
+    {
+      // other threads may have pinned frames for a moment while they were looked at; the pool is
+      // only full if every frame is pinned
+      if (concurrent && anyUnpinned())
+      {
+        std::this_thread::yield();
+        continue;
+      }
+      // full buffer pool
+      throw BufferExceededException();
+    }
+
+    // frames latched by another thread are being filled or evicted, skip them
+    if (concurrent && !bufDescTable[candidate].latch.try_lock())
+    {
+      continue;
+    }
+    if (claimBuf(candidate))
+    {
+      // return new frame number
+      frame = candidate;
+      return;
+    }
+    if (concurrent)
+    {
+      bufDescTable[candidate].latch.unlock();
+    }
+  }
+} // end allocBuf
+
+
+void BufMgr::allocRingBuf(BufRing &ring, FrameId & frame, const std::uint32_t partition)
+{
+  BufRing::Slot &slot = ring.slots[ring.next];
+  if (slot.file != NULL)
+  {
+    BufDesc &desc = bufDescTable[slot.frameNo];
+    // the frame is recycled unless another page or another thread took it over meanwhile
+    if (!concurrent || desc.latch.try_lock())
+    {
+      if ((!frameStates[slot.frameNo].isValid() || (desc.file == slot.file && desc.pageNo == slot.pageNo)) && claimBuf(slot.frameNo))
+      {
+        frame = slot.frameNo;
+        return;
+      }
+      if (concurrent)
+      {
+        desc.latch.unlock();
+      }
+    }
+  }
+  allocBuf(frame, partition);
+}
+
+void BufMgr::readPage(File* file, const PageId pageNo, Page*& page, const bool hot)
+{
+  BufMgr* pool = poolOf(file);
+  if (pool != this)
+    return pool->readPage(file, pageNo, page, hot);
+  fetchPage(file, pageNo, page, hot, NULL);
+}
+
+void BufMgr::readPage(File* file, const PageId pageNo, Page*& page, BufRing &ring)
+{
+  BufMgr* pool = poolOf(file);
+  if (pool != this)
+    return pool->readPage(file, pageNo, page, ring);
+  fetchPage(file, pageNo, page, false, &ring);
+}
+
+PageHandle BufMgr::readPage(File* file, const PageId pageNo, const bool hot)
+{
+  BufMgr* pool = poolOf(file);
+  if (pool != this)
+    return pool->readPage(file, pageNo, hot);
+  Page* page;
+  fetchPage(file, pageNo, page, hot, NULL);
+  return handleOf(file, pageNo, page);
+}
+
+PageHandle BufMgr::readPage(File* file, const PageId pageNo, BufRing &ring)
+{
+  BufMgr* pool = poolOf(file);
+  if (pool != this)
+    return pool->readPage(file, pageNo, ring);
+  Page* page;
+  fetchPage(file, pageNo, page, false, &ring);
+  return handleOf(file, pageNo, page);
+}
+
+bool BufMgr::pinResident(File* file, const PageId pageNo, Page*& page, const bool hot)
+{
+  FrameId frameNo = 0;
+	{
+		LatchGuard partition(hashTable->partitionLatch(file, pageNo), concurrent);
+  	if (!hashTable->find(file, pageNo, frameNo))
+		{
+	    return false;
+		}
+    replacer->referenced(frameNo, hot);
+    frameStates[frameNo].pin();
+    page = &bufPool[frameNo];
+  }
+  ThreadBufStats &stats = localStats();
+  ThreadBufStats::bump(stats.hits);
+  ThreadBufStats::bump(stats.of(file, filesEpoch.load(std::memory_order_relaxed)).hits);
+  return true;
+}
+
+void BufMgr::fetchPage(File* file, const PageId pageNo, Page*& page, const bool hot, BufRing* ring)
+{
+  // check to see if it is already in the buffer pool
+  // std::cout << "readPage called on file.page " << file << "." << pageNo << endl;
+  FrameId frameNo = 0;
+  ThreadBufStats &stats = localStats();
+  ThreadBufStats::bump(stats.accesses);
+  Tracer::countPin();
+  if (pinResident(file, pageNo, page, hot))
+  {
+    return;
+  }
+  //not in the buffer pool, must allocate a new page
+
+  // alloc a new frame
+  const std::uint32_t owner = ownerPartition(file, pageNo);
+  const ThreadBufStats::Clock::time_point waitStart = ThreadBufStats::Clock::now();
+  if (ring)
+    allocRingBuf(*ring, frameNo, owner);
+  else
+    allocBuf(frameNo, owner);
+  const std::uint64_t frameWaitNanos = stats.frameWaitNanos.addNanosSince(waitStart);
+  // allocBuf() returned the frame latched, the guard takes the latch over
+  LatchGuard frameLatch(bufDescTable[frameNo].latch, concurrent, std::adopt_lock);
+
+  // read the page into the new frame. The page only enters the hash table once it is read, so
+  // lookups never see a frame that is still being filled.
+  {
+    // files without a shared stream position are read in parallel
+    const ThreadBufStats::Clock::time_point readStart = ThreadBufStats::Clock::now();
+    LatchGuard io(ioLatch, concurrent && !file->concurrentReads());
+    //status = file->readPage(pageNo, &bufPool[frameNo]);
+    bufPool[frameNo] = file->readPage(pageNo);
+    io.release();
+    // a torn or damaged page is not let into the pool; the frame stays free
+    if (!file->verifyPage(bufPool[frameNo]))
+      throw CorruptPageException(pageNo, file->filename());
+    snapshotFrame(frameNo);
+    Tracer::countMiss(stats.readNanos.addNanosSince(readStart), frameWaitNanos);
+    ThreadBufStats::bump(stats.diskreads);
+    ThreadBufStats::bump(stats.of(file, filesEpoch.load(std::memory_order_relaxed)).misses);
+  }
+
+  LatchGuard partition(hashTable->partitionLatch(file, pageNo), concurrent);
+  FrameId presentFrameNo;
+  if (hashTable->find(file, pageNo, presentFrameNo))
+  {
+    // another thread may have read the same page meanwhile, use its frame
+    replacer->referenced(presentFrameNo, hot);
+    frameStates[presentFrameNo].pin();
+    page = &bufPool[presentFrameNo];
+    return;
+  }
+
+  // set up the entry properly
+  bufDescTable[frameNo].Set(file, pageNo);
+  addFileFrame(frameNo);
+  replacer->loaded(frameNo, file, pageNo, hot);
+  page = &bufPool[frameNo];
+  if (ring)
+  {
+    // the frame becomes the newest of the ring
+    BufRing::Slot &slot = ring->slots[ring->next];
+    slot.file = file;
+    slot.pageNo = pageNo;
+    slot.frameNo = frameNo;
+    ring->next = (ring->next + 1) % ring->slots.size();
+  }
+
+  // insert in the hash table
+  hashTable->insert(file, pageNo, frameNo);
+}
 
-  for (FrameId i = 0; i < bufs; i++) 
+void BufMgr::unPinAllPages()
+{
+  // retired frames keep their pin
+  for (FrameId i = 0; i < poolSize; i++) 
   {
-  	bufDescTable[i].frameNo = i;
-  	bufDescTable[i].valid = false;
+    frameStates[i].unpinAll();
   }
+}
 
-  bufPool = new Page[bufs];
+void BufMgr::unPinPage(File* file, const PageId pageNo, 
+			     const bool dirty) 
+{
+  BufMgr* pool = poolOf(file);
+  if (pool != this)
+    return pool->unPinPage(file, pageNo, dirty);
+  // lookup in hashtable
+  FrameId frameNo = 0;
+  {
+    LatchGuard partition(hashTable->partitionLatch(file, pageNo), concurrent);
+    if (!hashTable->find(file, pageNo, frameNo))
+    {
+    	throw HashNotFoundException(file->filename(), pageNo);
+    }
+  }
+  // the frame keeps the page while the caller holds its pin
+  unPinFrame(file, pageNo, frameNo, dirty);
+}
 
-  int htsize = ((((int) (bufs * 1.2))*2)/2)+1;
-  hashTable = new BufHashTbl (htsize);  // allocate the buffer hash table
+void BufMgr::unPinFrame(File* file, const PageId pageNo, const FrameId frameNo, const bool dirty)
+{
+  if (dirty == true)
+  {
+    // the partition latch orders the pins of the page that are dropped dirty at once
+    LatchGuard partition(hashTable->partitionLatch(file, pageNo), concurrent);
+    setDirty(bufDescTable[frameNo], true);
+    if (wal)
+    {
+      // the caller still holds its pin, and any latch it changed the page under
+      BufDesc &desc = bufDescTable[frameNo];
+      const Lsn before = desc.recLsn == 0 ? wal->appendedLsn() : desc.recLsn;
+      const Lsn lsn = wal->logUpdate(file->filename(), pageNo, loggedPages[frameNo], bufPool[frameNo]);
+      if (lsn != 0)
+      {
+        desc.pageLsn = lsn;
+        desc.recLsn = before;
+      }
+    }
+  }
 
-  clockHand = bufs - 1;
+  // make sure the page is actually pinned
+  if (frameStates[frameNo].pinCount() == 0)
+  {
+  	throw PageNotPinnedException(file->filename(), pageNo, frameNo);
+  }
+  else frameStates[frameNo].unpin();
 }
 
+void BufMgr::flushFile(const File* file) 
+{
+  BufMgr* pool = poolOf(file);
+  if (pool != this)
+    return pool->flushFile(file);
+  cancelReadAheads(file);
+  filesEpoch++;
 
-BufMgr::~BufMgr() {
-  //Flush out all unwritten pages
-  for (std::uint32_t i = 0; i < numBufs; i++) 
+  // the frames of the file. Frames evicted before they are latched below are skipped.
+  std::vector<FrameId> candidates;
   {
-  	BufDesc* tmpbuf = &bufDescTable[i];
-  	if (tmpbuf->valid == true && tmpbuf->dirty == true)
-		{
-			tmpbuf->file->writePage(tmpbuf->pageNo, bufPool[i]);
-  	}
+    LatchGuard guard(fileFramesLatch, concurrent);
+    std::unordered_map<const File*, FrameId>::const_iterator first = fileFrames.find(file);
+    for (FrameId i = (first == fileFrames.end() ? NO_FRAME : first->second); i != NO_FRAME; i = bufDescTable[i].fileNext)
+    {
+      candidates.push_back(i);
+    }
+  }
+  // frames are latched in frame order, like any other thread holding several frame latches
+  std::sort(candidates.begin(), candidates.end());
+
+  // latch every frame of the file, so that none is evicted or written back meanwhile
+  std::vector<FrameId> frames;
+  std::vector<FrameId> dirtyFrames;
+  try
+  {
+    for (std::size_t c = 0; c < candidates.size(); c++)
+    {
+      BufDesc* tmpbuf = &(bufDescTable[candidates[c]]);
+      if (concurrent) tmpbuf->latch.lock();
+      const FrameState &state = frameStates[candidates[c]];
+      if (state.isValid() && tmpbuf->file == file)
+      {
+        frames.push_back(candidates[c]);
+        if (state.pinCount() > 0)
+          throw PagePinnedException(file->filename(), tmpbuf->pageNo, tmpbuf->frameNo);
+
+        if (tmpbuf->dirty == true)
+          dirtyFrames.push_back(candidates[c]);
+        continue;
+      }
+      if (concurrent) tmpbuf->latch.unlock();
+      if (!state.isValid() && tmpbuf->file == file)
+        throw BadBufferException(tmpbuf->frameNo, tmpbuf->dirty, state.isValid(), state.refbit());
+    }
+
+    writeFrames(dirtyFrames);
+    LatchGuard io(ioLatch, concurrent);
+    file->checkpoint();
+  }
+  catch (...)
+  {
+    if (concurrent)
+    {
+      for (std::size_t i = 0; i < frames.size(); i++)
+        bufDescTable[frames[i]].latch.unlock();
+    }
+    throw;
+  }
+
+  for (std::size_t i = 0; i < frames.size(); i++)
+  {
+    BufDesc* tmpbuf = &(bufDescTable[frames[i]]);
+    {
+      LatchGuard partition(hashTable->partitionLatch(file, tmpbuf->pageNo), concurrent);
+      hashTable->remove(file, tmpbuf->pageNo);
+      removeFileFrame(frames[i]);
+      setDirty(*tmpbuf, false);
+      tmpbuf->Clear();
+      replacer->freed(frames[i]);
+    }
+    if (concurrent) tmpbuf->latch.unlock();
+  }
+}
+
+void BufMgr::addFileFrame(const FrameId frame)
+{
+  BufDesc &desc = bufDescTable[frame];
+  LatchGuard guard(fileFramesLatch, concurrent);
+  std::pair<std::unordered_map<const File*, FrameId>::iterator, bool> first =
+      fileFrames.insert(std::make_pair(desc.file, frame));
+  desc.filePrev = NO_FRAME;
+  desc.fileNext = NO_FRAME;
+  if (!first.second)
+  {
+    // push the frame in front of the list
+    desc.fileNext = first.first->second;
+    bufDescTable[desc.fileNext].filePrev = frame;
+    first.first->second = frame;
   }
+}
 
-  delete [] bufDescTable;
-  delete [] bufPool;
+void BufMgr::removeFileFrame(const FrameId frame)
+{
+  BufDesc &desc = bufDescTable[frame];
+  LatchGuard guard(fileFramesLatch, concurrent);
+  if (desc.filePrev != NO_FRAME)
+  {
+    bufDescTable[desc.filePrev].fileNext = desc.fileNext;
+  }
+  else if (desc.fileNext != NO_FRAME)
+  {
+    fileFrames[desc.file] = desc.fileNext;
+  }
+  else
+  {
+    fileFrames.erase(desc.file);
+  }
+  if (desc.fileNext != NO_FRAME)
+  {
+    bufDescTable[desc.fileNext].filePrev = desc.filePrev;
+  }
 }
 
+void BufMgr::writeFrames(std::vector<FrameId> &frames)
+{
+  std::vector<FrameWrite> writes(frames.size());
+  for (std::size_t i = 0; i < frames.size(); i++)
+  {
+    writes[i].file = bufDescTable[frames[i]].file;
+    writes[i].pageNo = bufDescTable[frames[i]].pageNo;
+    writes[i].frameNo = frames[i];
+  }
+  std::sort(writes.begin(), writes.end());
+  Lsn lastLsn = 0;
+  for (std::size_t i = 0; i < writes.size(); i++)
+  {
+    frames[i] = writes[i].frameNo;
+    lastLsn = std::max(lastLsn, bufDescTable[frames[i]].pageLsn);
+  }
+  // no page reaches the disk before the records of its changes
+  if (wal && lastLsn > wal->flushedLsn())
+  {
+    wal->flush(lastLsn);
+  }
+
+  // write each run of consecutive pages of a file at once
+  std::vector<const Page*> run;
+  for (std::size_t start = 0; start < writes.size(); start += run.size())
+  {
+    const FrameWrite &first = writes[start];
+    run.clear();
+    while (start + run.size() < writes.size() && writes[start + run.size()].file == first.file
+        && writes[start + run.size()].pageNo == first.pageNo + run.size())
+    {
+      run.push_back(&bufPool[writes[start + run.size()].frameNo]);
+    }
+
+    const ThreadBufStats::Clock::time_point writeStart = ThreadBufStats::Clock::now();
+    LatchGuard io(ioLatch, concurrent);
+    ThreadBufStats &stats = localStats();
+    ThreadBufStats::bump(stats.diskwrites, run.size());
+    bufDescTable[first.frameNo].file->writePages(first.pageNo, &run[0], run.size());
+    io.release();
+    stats.writeNanos.addNanosSince(writeStart);
+
+    // the pages are on disk with every logged change unless they changed again meanwhile
+    for (std::size_t i = start; i < start + run.size(); i++)
+    {
+      BufDesc &desc = bufDescTable[writes[i].frameNo];
+      LatchGuard partition(hashTable->partitionLatch(desc.file, desc.pageNo), concurrent);
+      if (!desc.dirty)
+        desc.recLsn = 0;
+    }
+  }
+}
 
-void BufMgr::allocBuf(FrameId & frame) 
+void BufMgr::startBackgroundWriter()
 {
-  // perform first part of clock algorithm to search for 
-  // open buffer frame
-  // Assumes non-concurrent access to buffer manager
-  std::uint32_t numScanned = 0;
-  bool found = 0;
+  if (writerThread)
+  {
+    return;
+  }
+  // the thread shares the pool from now on
+  concurrent = true;
+  writerThread = new std::thread(&BufMgr::writerLoop, this);
+}
 
-  while (numScanned < 2*numBufs)	//Need to scn twice
+void BufMgr::writerLoop()
+{
+  std::unique_lock<std::mutex> guard(writerLatch);
+  while (!stopWriter)
   {
-    // advance the clock
-    advanceClock();
-    numScanned++;
+    guard.unlock();
 
-    // if invalid, use frame
-    if (! bufDescTable[clockHand].valid)
+    // take up to WRITER_BATCH dirty, unpinned frames, going round the pool from where the last round stopped.
+    // Frames latched elsewhere are being filled, evicted or flushed, and are left alone.
+    std::vector<FrameId> frames;
+    for (std::uint32_t scanned = 0; scanned < numBufs && frames.size() < WRITER_BATCH; scanned++)
     {
-      break;
+      const FrameId frame = writerHand;
+      writerHand = (writerHand + 1) % numBufs;
+      BufDesc &desc = bufDescTable[frame];
+      if (!desc.latch.try_lock())
+      {
+        continue;
+      }
+      if (frameStates[frame].isValid())
+      {
+        // as in claimBuf(), the page is dirty again once written if it was pinned and changed meanwhile
+        LatchGuard partition(hashTable->partitionLatch(desc.file, desc.pageNo), concurrent);
+        if (desc.dirty && frameStates[frame].pinCount() == 0)
+        {
+          setDirty(desc, false);
+          frames.push_back(frame);
+          continue;
+        }
+      }
+      desc.latch.unlock();
     }
 
-    // is valid, check referenced bit
-    if (! bufDescTable[clockHand].refbit)
+    try
     {
-      // check to see if someone has it pinned
-      if (bufDescTable[clockHand].pinCnt == 0)
+      writeFrames(frames);
+    }
+    catch (BadgerDbException e)
+    {
+      // a page was deleted from its file behind the buffer manager's back; the pages stay dirty, and
+      // flushFile() reports the error
+      for (std::size_t i = 0; i < frames.size(); i++)
       {
-        // hasn't been referenced and is not pinned, use it
-        // remove previous entry from hash table
-        hashTable->remove(bufDescTable[clockHand].file, bufDescTable[clockHand].pageNo);
-        found = true;
-        break;
+        BufDesc &desc = bufDescTable[frames[i]];
+        LatchGuard partition(hashTable->partitionLatch(desc.file, desc.pageNo), concurrent);
+        setDirty(desc, true);
       }
     }
-    else
+    for (std::size_t i = 0; i < frames.size(); i++)
+    {
+      bufDescTable[frames[i]].latch.unlock();
+    }
+
+    guard.lock();
+    if (!stopWriter)
     {
-      // has been referenced, clear the bit
-      bufStats.accesses++;
-      bufDescTable[clockHand].refbit = false;
+      writerSignal.wait_for(guard, std::chrono::milliseconds(WRITER_INTERVAL));
     }
   }
-  
-  // check for full buffer pool
-  if (!found && numScanned >= 2*numBufs)
+}
+
+void BufMgr::startReadAhead()
+{
+  if (readAheadThread)
   {
-    throw BufferExceededException();
+    return;
   }
-  
-  // flush any existing changes to disk if necessary
-  if (bufDescTable[clockHand].dirty)
+  // the thread shares the pool from now on
+  concurrent = true;
+  readAheadThread = new std::thread(&BufMgr::readAheadLoop, this);
+}
+
+void BufMgr::prefetchPages(File* file, const PageId pageNo, const std::uint32_t count)
+{
+  prefetchPages(file, pageNo, count, NULL);
+}
+
+void BufMgr::prefetchPages(File* file, const PageId pageNo, const std::uint32_t count,
+                           PageId (*nextPage)(const Page* page))
+{
+  BufMgr* pool = poolOf(file);
+  if (pool != this)
+    return pool->prefetchPages(file, pageNo, count, nextPage);
+  if (!readAheadThread || pageNo == Page::INVALID_NUMBER || count == 0)
+  {
+    return;
+  }
+  ReadAhead request = {file, pageNo, count, nextPage};
   {
-    bufStats.diskwrites++;
-    //status = bufDescTable[clockHand].file->writePage(bufDescTable[clockHand].pageNo,
-    bufDescTable[clockHand].file->writePage(bufDescTable[clockHand].pageNo, bufPool[clockHand]);
+    std::lock_guard<std::mutex> guard(readAheadLatch);
+    readAheadQueue.push_back(request);
   }
+  readAheadSignal.notify_all();
+}
 
-	//Reset all the BufDesc entry for the frame before returning the frame
-  bufDescTable[clockHand].Clear();
+void BufMgr::readAheadLoop()
+{
+  std::unique_lock<std::mutex> guard(readAheadLatch);
+  while (true)
+  {
+    while (readAheadQueue.empty() && !stopReadAhead)
+    {
+      readAheadSignal.wait(guard);
+    }
+    if (stopReadAhead)
+    {
+      return;
+    }
+    ReadAhead request = readAheadQueue.front();
+    readAheadQueue.pop_front();
+    readAheadFile = request.file;
+    cancelReadAhead = false;
 
-  // return new frame number
-  frame = clockHand;
-} // end allocBuf
+    PageId pageNo = request.pageNo;
+    for (std::uint32_t i = 0; i < request.count && pageNo != Page::INVALID_NUMBER && !cancelReadAhead; i++)
+    {
+      guard.unlock();
+      Page* page = NULL;
+      try
+      {
+        fetchPage(request.file, pageNo, page, false, &readAheadRing);
+        const PageId nextPageNo = request.nextPage != NULL ? request.nextPage(page) : page->next_page_number();
+        unPinPage(request.file, pageNo, false);
+        pageNo = nextPageNo;
+      }
+      catch (BadgerDbException e)
+      {
+        // the page was freed, or the pool is pinned full; the reader reads it itself
+        pageNo = Page::INVALID_NUMBER;
+      }
+      guard.lock();
+    }
+    readAheadFile = NULL;
+    readAheadSignal.notify_all();
+  }
+}
 
-	
-void BufMgr::readPage(File* file, const PageId pageNo, Page*& page)
+std::uint32_t BufMgr::resize(const std::uint32_t bufs)
 {
-  // check to see if it is already in the buffer pool
-  // std::cout << "readPage called on file.page " << file << "." << pageNo << endl;
-  FrameId frameNo = 0;
-	try
-	{
-  	hashTable->lookup(file, pageNo, frameNo);
+  std::lock_guard<std::mutex> guard(resizeLatch);
+  const std::uint32_t target = std::max(1u, std::min(bufs, numBufs));
+  const std::uint32_t oldSize = poolSize;
+  std::uint32_t size = oldSize;
 
-    // set the referenced bit
-    bufDescTable[frameNo].refbit = true;
-    bufDescTable[frameNo].pinCnt++;
-    page = &bufPool[frameNo];
+  // frames come back empty, as the system zeroed their memory
+  for (; size < target; size++)
+  {
+    frameStates[size].clear();
+    replacer->restored(size);
   }
-  catch(HashNotFoundException e) //not in the buffer pool, must allocate a new page
+
+  // the frame latch keeps other threads from filling a frame between its eviction and its retirement
+  for (; size > target; size--)
   {
-    // alloc a new frame
-    allocBuf(frameNo);
+    const FrameId frame = size - 1;
+    LatchGuard frameLatch(bufDescTable[frame].latch, concurrent);
+    if (!claimBuf(frame))
+    {
+      break;
+    }
+    frameStates[frame].retire();
+    replacer->retired(frame);
+  }
+  poolSize = size;
 
-    // read the page into the new frame
-    bufStats.diskreads++;
-    //status = file->readPage(pageNo, &bufPool[frameNo]);
-    bufPool[frameNo] = file->readPage(pageNo);
+  if (size < oldSize)
+  {
+    // give the memory of the frames taken out back. Frames are a whole number of system pages; on
+    // explicit huge pages the call fails unless it spans whole huge pages, and the memory is kept.
+    const std::size_t begin = (std::size_t)size * sizeof(Page);
+    const std::size_t length = (std::size_t)(oldSize - size) * sizeof(Page);
+    madvise(reinterpret_cast<char*>(bufPool) + begin, length, MADV_DONTNEED);
+    if (loggedPages)
+    {
+      madvise(reinterpret_cast<char*>(loggedPages) + begin, length, MADV_DONTNEED);
+    }
+  }
+  return size;
+}
 
-    // set up the entry properly
-    bufDescTable[frameNo].Set(file, pageNo);
-    page = &bufPool[frameNo];
+BufMgr* BufMgr::addPool(const std::string& name, const std::uint32_t bufs, const ReplacementPolicy policy,
+                        const bool concurrent)
+{
+  BufMgr*& added = pools[name];
+  if (added == NULL)
+  {
+    added = new BufMgr(bufs, concurrent, policy);
+  }
+  return added;
+}
+
+BufMgr* BufMgr::pool(const std::string& name) const
+{
+  std::map<std::string, BufMgr*>::const_iterator it = pools.find(name);
+  return it == pools.end() ? NULL : it->second;
+}
 
-    // insert in the hash table
-    hashTable->insert(file, pageNo, frameNo);
+void BufMgr::bindFile(const std::string& filename, BufMgr* pool)
+{
+  if (pool == this || pool == NULL)
+  {
+    fileRoutes.erase(filename);
+    return;
   }
+  fileRoutes[filename] = pool;
 }
 
-void BufMgr::unPinAllPages()
+BufMgr* BufMgr::routeOf(const File* file)
 {
-  for (FrameId i = 0; i < numBufs; i++) 
+  std::unordered_map<std::string, BufMgr*>::const_iterator it = fileRoutes.find(file->filename());
+  return it == fileRoutes.end() ? this : it->second;
+}
+
+void BufMgr::startAsyncReads(const std::uint32_t threads)
+{
+  if (!asyncThreads.empty())
+  {
+    return;
+  }
+  // the threads share the pool from now on
+  concurrent = true;
+  for (std::uint32_t i = 0; i < std::max(threads, 1u); i++)
   {
-    bufDescTable[i].pinCnt = 0;
+    asyncThreads.push_back(new std::thread(&BufMgr::asyncReadLoop, this));
   }
 }
 
-void BufMgr::unPinPage(File* file, const PageId pageNo, 
-			     const bool dirty) 
+void BufMgr::readPageAsync(File* file, const PageId pageNo, std::function<void(Page*, std::exception_ptr)> done,
+                           const bool hot)
 {
-  // lookup in hashtable
-  FrameId frameNo = 0;
-  hashTable->lookup(file, pageNo, frameNo);
+  BufMgr* pool = poolOf(file);
+  if (pool != this)
+    return pool->readPageAsync(file, pageNo, done, hot);
+  Page* page = NULL;
+  if (asyncThreads.empty())
+  {
+    try
+    {
+      fetchPage(file, pageNo, page, hot, NULL);
+    }
+    catch (...)
+    {
+      done(NULL, std::current_exception());
+      return;
+    }
+    done(page, std::exception_ptr());
+    return;
+  }
+  // a hit needs no I/O thread
+  if (pinResident(file, pageNo, page, hot))
+  {
+    ThreadBufStats::bump(localStats().accesses);
+    done(page, std::exception_ptr());
+    return;
+  }
+  AsyncRead request = {file, pageNo, hot, done};
+  {
+    std::lock_guard<std::mutex> guard(asyncLatch);
+    asyncQueue.push_back(request);
+  }
+  asyncSignal.notify_one();
+}
 
-  if (dirty == true) bufDescTable[frameNo].dirty = dirty;
+std::future<Page*> BufMgr::readPageAsync(File* file, const PageId pageNo, const bool hot)
+{
+  std::shared_ptr<std::promise<Page*> > promise = std::make_shared<std::promise<Page*> >();
+  std::future<Page*> future = promise->get_future();
+  readPageAsync(file, pageNo, [promise](Page* page, std::exception_ptr error) {
+    if (error)
+      promise->set_exception(error);
+    else
+      promise->set_value(page);
+  }, hot);
+  return future;
+}
 
-  // make sure the page is actually pinned
-  if (bufDescTable[frameNo].pinCnt == 0)
+void BufMgr::asyncReadLoop()
+{
+  std::unique_lock<std::mutex> guard(asyncLatch);
+  while (true)
   {
-  	throw PageNotPinnedException(file->filename(), pageNo, frameNo);
+    while (asyncQueue.empty() && !stopAsync)
+    {
+      asyncSignal.wait(guard);
+    }
+    if (asyncQueue.empty())
+    {
+      return;
+    }
+    AsyncRead request = asyncQueue.front();
+    asyncQueue.pop_front();
+    guard.unlock();
+
+    // the page may have come in since it was asked for
+    Page* page = NULL;
+    std::exception_ptr error;
+    try
+    {
+      fetchPage(request.file, request.pageNo, page, request.hot, NULL);
+    }
+    catch (...)
+    {
+      error = std::current_exception();
+    }
+    request.done(error ? NULL : page, error);
+    guard.lock();
   }
-  else bufDescTable[frameNo].pinCnt--;
 }
 
-void BufMgr::flushFile(const File* file) 
+void BufMgr::cancelReadAheads(const File* file)
 {
-  for (std::uint32_t i = 0; i < numBufs; i++)
-	{
-  	BufDesc* tmpbuf = &(bufDescTable[i]);
-  	if(tmpbuf->valid == true && tmpbuf->file == file)
-		{
-	    if (tmpbuf->pinCnt > 0)
-  			throw PagePinnedException(file->filename(), tmpbuf->pageNo, tmpbuf->frameNo);
-
-	    if (tmpbuf->dirty == true)
-			{
-				//if ((status = tmpbuf->file->writePage(tmpbuf->pageNo, &(bufPool[i]))) != OK)
-				tmpbuf->file->writePage(tmpbuf->pageNo, bufPool[i]);
-				tmpbuf->dirty = false;
-    	}
-
-    	hashTable->remove(file,tmpbuf->pageNo);
-    	tmpbuf->Clear();
-  	}
-		else if (tmpbuf->valid == false && tmpbuf->file == file)
-  		throw BadBufferException(tmpbuf->frameNo, tmpbuf->dirty, tmpbuf->valid, tmpbuf->refbit);
+  if (!readAheadThread)
+  {
+    return;
+  }
+  std::unique_lock<std::mutex> guard(readAheadLatch);
+  for (std::deque<ReadAhead>::iterator iter = readAheadQueue.begin(); iter != readAheadQueue.end(); )
+  {
+    if (iter->file == file)
+      iter = readAheadQueue.erase(iter);
+    else
+      ++iter;
+  }
+  while (readAheadFile == file)
+  {
+    cancelReadAhead = true;
+    readAheadSignal.wait(guard);
   }
 }
 
 void BufMgr::disposePage(File* file, const PageId pageNo) 
 {
+  BufMgr* pool = poolOf(file);
+  if (pool != this)
+    return pool->disposePage(file, pageNo);
 	//Deallocate from file altogether
   //See if it is in the buffer pool
   FrameId frameNo = 0;
-  hashTable->lookup(file, pageNo, frameNo);
+  bool present;
+  {
+		// pin the frame so that it is not evicted before it is latched
+		LatchGuard partition(hashTable->partitionLatch(file, pageNo), concurrent);
+  	present = hashTable->find(file, pageNo, frameNo);
+		if (present)
+			frameStates[frameNo].pin();
+  }
+
+  if (present)
+  {
+		LatchGuard frameLatch(bufDescTable[frameNo].latch, concurrent);
+		LatchGuard partition(hashTable->partitionLatch(file, pageNo), concurrent);
 
-	// clear the page
-	bufDescTable[frameNo].Clear();
+		// clear the page
+		removeFileFrame(frameNo);
+		setDirty(bufDescTable[frameNo], false);
+		bufDescTable[frameNo].Clear();
+		replacer->freed(frameNo);
 
-	hashTable->remove(file, pageNo);
+		hashTable->remove(file, pageNo);
+  }
 
   // deallocate it in the file	
+  LatchGuard io(ioLatch, concurrent);
   file->deletePage(pageNo);
 }
 
 
 void BufMgr::allocPage(File* file, PageId &pageNo, Page*& page) 
 {
+  BufMgr* pool = poolOf(file);
+  if (pool != this)
+    return pool->allocPage(file, pageNo, page);
   FrameId frameNo;
 
-  // alloc a new frame
-  allocBuf(frameNo);
+  // alloc a new frame, on the node of the thread since the page number is not known yet
+  const ThreadBufStats::Clock::time_point waitStart = ThreadBufStats::Clock::now();
+  allocBuf(frameNo, localPartition());
+  localStats().frameWaitNanos.addNanosSince(waitStart);
+  // allocBuf() returned the frame latched, the guard takes the latch over
+  LatchGuard frameLatch(bufDescTable[frameNo].latch, concurrent, std::adopt_lock);
 
   // allocate a new page in the file
 	//std::cerr << "buffer data size:" << bufPool[frameNo].data_.length() << "\n";
-  bufPool[frameNo] = file->allocatePage(pageNo);
+  {
+    LatchGuard io(ioLatch, concurrent);
+    bufPool[frameNo] = file->allocatePage(pageNo);
+  }
+  snapshotFrame(frameNo);
   // std::cout << "Allocate Page and get page number" << pageNo << "\n";
   // std::cout.flush();
   page = &bufPool[frameNo];
 
   // set up the entry properly
   bufDescTable[frameNo].Set(file, pageNo);
+  addFileFrame(frameNo);
+  replacer->loaded(frameNo, file, pageNo, false);
 
   // insert in the hash table
+  LatchGuard partition(hashTable->partitionLatch(file, pageNo), concurrent);
   hashTable->insert(file, pageNo, frameNo);
 }
 
+PageHandle BufMgr::allocPage(File* file, PageId &pageNo)
+{
+  BufMgr* pool = poolOf(file);
+  if (pool != this)
+    return pool->allocPage(file, pageNo);
+  Page* page;
+  allocPage(file, pageNo, page);
+  return handleOf(file, pageNo, page);
+}
+
+void BufMgr::setLog(WriteAheadLog* log)
+{
+  if (log && !loggedPages)
+  {
+    const std::size_t bytes = (std::size_t)numBufs * sizeof(Page);
+    void *arena = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (arena == MAP_FAILED)
+    {
+      throw std::bad_alloc();
+    }
+    loggedPages = static_cast<Page*>(arena);
+  }
+  wal = log;
+  for (FrameId i = 0; i < numBufs; i++)
+  {
+    bufDescTable[i].pageLsn = 0;
+    if (frameStates[i].isValid())
+      snapshotFrame(i);
+  }
+}
+
+Lsn BufMgr::checkpoint()
+{
+  if (!wal)
+  {
+    return 0;
+  }
+  const Lsn begin = wal->appendedLsn();
+  std::vector<DirtyPage> dirty;
+  for (FrameId i = 0; i < numBufs; i++)
+  {
+    // the frame latch keeps the page of the frame from changing while it is looked at
+    LatchGuard frameLatch(bufDescTable[i].latch, concurrent);
+    const BufDesc &desc = bufDescTable[i];
+    if (frameStates[i].isValid() && desc.recLsn != 0)
+    {
+      DirtyPage page;
+      page.filename = desc.file->filename();
+      page.page_number = desc.pageNo;
+      page.rec_lsn = desc.recLsn;
+      dirty.push_back(page);
+    }
+  }
+  return wal->checkpoint(begin, dirty);
+}
+
+void BufMgr::startCheckpoints(const std::uint32_t intervalMillis)
+{
+  if (checkpointThread)
+  {
+    return;
+  }
+  // the thread shares the pool from now on
+  concurrent = true;
+  checkpointInterval = intervalMillis;
+  checkpointThread = new std::thread(&BufMgr::checkpointLoop, this);
+}
+
+void BufMgr::checkpointLoop()
+{
+  std::unique_lock<std::mutex> guard(checkpointLatch);
+  while (!stopCheckpoints)
+  {
+    guard.unlock();
+    checkpoint();
+    guard.lock();
+    if (!stopCheckpoints)
+    {
+      checkpointSignal.wait_for(guard, std::chrono::milliseconds(checkpointInterval));
+    }
+  }
+}
+
 void BufMgr::printSelf(void) 
 {
   BufDesc* tmpbuf;
 	int validFrames = 0;
   
-  for (std::uint32_t i = 0; i < numBufs; i++)
+  for (std::uint32_t i = 0; i < poolSize; i++)
 	{
   	tmpbuf = &(bufDescTable[i]);
 		std::cout << "FrameNo:" << i << " ";
 		tmpbuf->Print();
 
-  	if (tmpbuf->valid == true)
+  	if (frameStates[i].isValid())
     	validFrames++;
   }
 
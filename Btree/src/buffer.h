@@ -9,7 +9,22 @@
 
 #include "file.h"
 #include "bufHashTbl.h"
+#include "bufReplacer.h"
+#include "wal.h"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <future>
 #include <iostream>
+#include <map>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
 
 namespace badgerdb {
 
@@ -18,6 +33,135 @@ namespace badgerdb {
 */
 class BufMgr;
 
+/**
+ * @brief Memory the frames of the buffer pool are mapped in. Passed to the BufMgr constructor.
+ */
+enum FrameMemory
+{
+	/**
+	 * Pages of the default size of the system
+	 */
+	FRAMES_SMALL_PAGES,
+
+	/**
+	 * Pages the kernel is asked to merge into transparent huge pages
+	 */
+	FRAMES_TRANSPARENT_HUGE_PAGES,
+
+	/**
+	 * Reserved huge pages, or transparent huge pages if none are reserved
+	 */
+	FRAMES_HUGE_PAGES
+};
+
+/**
+* @brief State of a buffer pool frame that the replacement policy sweeps over: whether it holds a page,
+* its reference bit and its pin count, packed in one word. The words of all frames are kept in an array
+* of their own, so that a sweep of the clock hand reads 16 frames per cache line rather than one
+* descriptor per frame.
+*/
+class FrameState {
+
+	friend class BufDesc;
+	friend class BufMgr;
+	friend class BufReplacer;
+
+ private:
+	/**
+   * Bits of the word. The pin count takes the bits below REFBIT.
+	 */
+  static const std::uint32_t VALID = 1u << 31;
+  static const std::uint32_t REFBIT = 1u << 30;
+  static const std::uint32_t PIN_COUNT = REFBIT - 1;
+
+	/**
+   * The pin count is changed under the hash table partition latch of the page in concurrent mode, so
+   * that a page cannot be pinned while it is being evicted. The valid bit is changed only under the
+   * frame latch, but read by the replacement policy without it. The reference bit is kept by the
+   * replacement policy.
+	 */
+  std::atomic<std::uint32_t> word;
+
+  bool isValid() const
+	{
+		return (word.load() & VALID) != 0;
+  }
+
+  std::uint32_t pinCount() const
+	{
+		return word.load() & PIN_COUNT;
+  }
+
+  void pin()
+	{
+		word.fetch_add(1);
+  }
+
+  void unpin()
+	{
+		word.fetch_sub(1);
+  }
+
+  void unpinAll()
+	{
+		word.fetch_and(~PIN_COUNT);
+  }
+
+  bool refbit() const
+	{
+		return (word.load() & REFBIT) != 0;
+  }
+
+	/**
+   * The word is only written if the bit changes, so that frames read over and over do not bounce
+   * its cache line between threads
+	 */
+  void setRefbit(const bool refbit)
+	{
+		if (refbit)
+		{
+			if (!(word.load() & REFBIT)) word.fetch_or(REFBIT);
+		}
+		else if (word.load() & REFBIT)
+		{
+			word.fetch_and(~REFBIT);
+		}
+  }
+
+	/**
+   * Clear the reference bit and return the previous value
+	 */
+  bool clearRefbit()
+	{
+		return (word.load() & REFBIT) && (word.fetch_and(~REFBIT) & REFBIT);
+  }
+
+	/**
+   * Frame holding no page
+	 */
+  void clear()
+	{
+		word = 0;
+  }
+
+	/**
+   * Frame holding a page that was just pinned
+	 */
+  void set()
+	{
+		word = VALID | REFBIT | 1;
+  }
+
+	/**
+   * Frame taken out of the pool by BufMgr::resize(): it holds no page, but looks valid and pinned, so
+   * that it is never chosen to evict
+	 */
+  void retire()
+	{
+		word = VALID | 1;
+  }
+};
+
 /**
 * @brief Class for maintaining information about buffer pool frames
 */
@@ -42,36 +186,52 @@ class BufDesc {
   FrameId	frameNo;
 
 	/**
-   * Number of times this page has been pinned
+   * True if page is dirty;  false otherwise. Only read once the frame is chosen, so it stays out of the
+   * words the replacement policy sweeps over.
 	 */
-  int pinCnt;
+  bool dirty;
 
 	/**
-   * True if page is dirty;  false otherwise
+   * LSN of the last record logged for the page, which the log is written up to before the page is
+   * written back. 0 if none, or if the pool has no log.
 	 */
-  bool dirty;
+  Lsn pageLsn;
+
+	/**
+   * LSN from which the log holds every change of the page that may not be on disk, taken when the
+   * page is first logged after it was last written. 0 while the page is as on disk. Only cleared
+   * once a write back ends, so that a checkpoint taken meanwhile still counts the page as dirty.
+	 */
+  Lsn recLsn;
+
+	/**
+   * Valid bit, reference bit and pin count of the frame, in BufMgr::frameStates
+	 */
+  FrameState* state;
 
 	/**
-   * True if page is valid
+   * Held in concurrent mode while the frame is being filled, written back or reassigned, which is
+   * whenever file, pageNo or the valid bit change
 	 */
-  bool valid;
+  std::mutex latch;
 
 	/**
-   * Has this buffer frame been reference recently
+   * Neighbours of the frame in the list of frames holding pages of its file, see BufMgr::fileFrames
 	 */
-  bool refbit;
+  FrameId filePrev;
+  FrameId fileNext;
 
 	/**
    * Initialize buffer frame for a new user
 	 */
   void Clear()
 	{
-    pinCnt = 0;
+		state->clear();
 		file = NULL;
 		pageNo = Page::INVALID_NUMBER;
     dirty = false;
-    refbit = false;
-		valid = false;
+    pageLsn = 0;
+    recLsn = 0;
   };
 
 	/**
@@ -85,10 +245,10 @@ class BufDesc {
 	{ 
 		file = filePtr;
     pageNo = pageNum;
-    pinCnt = 1;
     dirty = false;
-    valid = true;
-    refbit = true;
+    pageLsn = 0;
+    recLsn = 0;
+    state->set();
   }
 
   void Print()
@@ -101,16 +261,19 @@ class BufDesc {
 		else
 			std::cout << "file:NULL ";
 
-		std::cout << "valid:" << valid << " ";
-		std::cout << "pinCnt:" << pinCnt << " ";
+		std::cout << "valid:" << state->isValid() << " ";
+		std::cout << "pinCnt:" << state->pinCount() << " ";
 		std::cout << "dirty:" << dirty << " ";
-		std::cout << "refbit:" << refbit << "\n";
+		std::cout << "refbit:" << state->refbit() << "\n";
   }
 
 	/**
    * Constructor of BufDesc class 
+   *
+   * @param frameState	State word of the frame
 	 */
-  BufDesc()
+  BufDesc(FrameState* frameState)
+		: state(frameState)
 	{
   	Clear();
   }
@@ -118,7 +281,75 @@ class BufDesc {
 
 
 /**
-* @brief Class to maintain statistics of buffer usage 
+* @brief Histogram of a quantity over powers of two. Bucket 0 counts the value 0, and bucket i > 0 the values
+* from 2^(i-1) up to, but excluding, 2^i. The last bucket also counts every larger value.
+*/
+struct BufHistogram
+{
+	/**
+   * Number of buckets
+	 */
+  static const int BUCKETS = 40;
+
+	/**
+   * Number of values counted in each bucket
+	 */
+  std::uint64_t counts[BUCKETS];
+
+	/**
+   * Bucket counting value
+	 */
+  static int bucket(const std::uint64_t value)
+  {
+		if (value == 0)
+			return 0;
+		const int bits = 64 - __builtin_clzll(value);
+		return bits < BUCKETS ? bits : BUCKETS - 1;
+  }
+
+	/**
+   * Number of values counted
+	 */
+  std::uint64_t total() const;
+
+	/**
+   * Upper bound of the values in the bucket that the given fraction of the values reaches, e.g. 0.99 for
+   * the 99th percentile. 0 if no value was counted.
+	 */
+  std::uint64_t percentile(const double fraction) const;
+
+	/**
+   * Clear all counts
+	 */
+  void clear();
+
+  BufHistogram()
+  {
+		clear();
+  }
+};
+
+/**
+* @brief Accesses of the buffer pool to the pages of one file
+*/
+struct FileBufStats
+{
+	/**
+   * Number of pages found in the buffer pool
+	 */
+  std::uint64_t hits;
+
+	/**
+   * Number of pages read from the file
+	 */
+  std::uint64_t misses;
+
+  FileBufStats() : hits(0), misses(0) {}
+};
+
+/**
+* @brief Class to maintain statistics of buffer usage. BufMgr::getBufStats() returns a snapshot: the
+* buffer manager counts in one set of counters per thread, which the snapshot adds up.
 */
 struct BufStats
 {
@@ -128,7 +359,7 @@ struct BufStats
   int accesses;
 
 	/**
-   * Number of pages read from disk (including allocs)
+   * Number of pages read from disk
 	 */
   int diskreads;
 
@@ -137,13 +368,50 @@ struct BufStats
 	 */
   int diskwrites;
 
+	/**
+   * Number of accesses that found their page in the buffer pool. The others are counted in diskreads.
+	 */
+  std::uint64_t hits;
+
+	/**
+   * Number of pages evicted to make room for another page, clean ones and dirty ones written back first
+	 */
+  std::uint64_t cleanEvictions;
+  std::uint64_t dirtyEvictions;
+
+	/**
+   * Number of dirty frames when the snapshot was taken, and the largest number of frames dirty at once
+   * since the statistics were cleared
+	 */
+  int dirtyFrames;
+  int dirtyHighWater;
+
+	/**
+   * Nanoseconds each page not in the pool waited for a frame to be freed for it, evicting a page if needed
+	 */
+  BufHistogram frameWaitNanos;
+
+	/**
+   * Nanoseconds each page read took, and each write of a page or run of pages, waits for the I/O latch
+   * included
+	 */
+  BufHistogram readNanos;
+  BufHistogram writeNanos;
+
+	/**
+   * Frames the replacement policy looked at to find each victim, e.g. the advance of the clock hand
+	 */
+  BufHistogram sweepLengths;
+
+	/**
+   * Hits and misses of each file, by file name
+	 */
+  std::map<std::string, FileBufStats> files;
+
 	/**
    * Clear all values 
 	 */
-  void clear()
-  {
-		accesses = diskreads = diskwrites = 0;
-  }
+  void clear();
       
 	/**
    * Constructor of BufStats class 
@@ -154,143 +422,909 @@ struct BufStats
   }
 };
 
+/**
+* forward declaration of the counters of one thread, see BufMgr::localStats()
+*/
+class ThreadBufStats;
+
 
 /**
-* @brief The central class which manages the buffer pool including frame allocation and deallocation to pages in the file 
+* @brief Small set of frames a sequential scan recycles, so that it does not evict the rest of the buffer pool.
+*
+* A page the scan reads that is not in the pool is read into the oldest frame of the ring, if that
+* frame is unpinned and still holds the page the ring put there. Otherwise the page gets a frame
+* as usual, which then joins the ring. Pages already in the pool are used where they are. A ring
+* belongs to one scan and is not shared between threads.
 */
-class BufMgr 
+class BufRing
 {
+	friend class BufMgr;
+
+ public:
+	/**
+	 * Default number of frames of a ring
+	 */
+  static const std::uint32_t DEFAULT_SIZE = 16;
+
+	/**
+   * Constructor of BufRing class
+	 *
+	 * @param size		Number of frames the ring recycles
+	 */
+  BufRing(const std::uint32_t size = DEFAULT_SIZE)
+		: slots(size), next(0)
+  {
+  }
+
  private:
 	/**
-   * Current position of clockhand in our buffer pool
+	 * A frame of the ring, with the page read into it
 	 */
-  FrameId clockHand;
+  struct Slot
+  {
+		Slot()
+			: file(NULL), pageNo(Page::INVALID_NUMBER), frameNo(0)
+		{
+		}
+
+		File* file;
+		PageId pageNo;
+		FrameId frameNo;
+  };
 
 	/**
-   * Number of frames in the buffer pool
+	 * Frames of the ring, unused while their file is NULL
 	 */
-  std::uint32_t numBufs;
-	
+  std::vector<Slot> slots;
+
 	/**
-   * Hash table mapping (File, page) to frame
+	 * Slot the next page goes to, holding the oldest frame
 	 */
-  BufHashTbl *hashTable;
+  std::uint32_t next;
+};
+
 
+/**
+* @brief A pin of a page in the buffer pool, held from BufMgr::readPage() or BufMgr::allocPage() until
+* release() or the end of the handle.
+*
+* The handle keeps the frame of the page, which cannot move while it is pinned, so that it is unpinned
+* without looking the page up in the hash table again, and a pin is never left behind when an exception
+* unwinds past the handle. Handles are moved, not copied, so that every pin is dropped once.
+*/
+class PageHandle
+{
+ public:
 	/**
-   * Array of BufDesc objects to hold information corresponding to every frame allocation from 'bufPool' (the buffer pool)
+	 * An empty handle, holding no page
 	 */
-  BufDesc *bufDescTable;
+  PageHandle();
+
+  PageHandle(PageHandle&& other);
+  PageHandle& operator=(PageHandle&& other);
 
 	/**
-   * Maintains Buffer pool usage statistics 
+	 * Unpins the page, dirty if markDirty() was called
 	 */
-  BufStats bufStats;
+  ~PageHandle();
 
 	/**
-	 * Allocate a free frame.  
-	 *
-	 * @param frame   	Frame reference, frame ID of allocated frame returned via this variable
-	 * @throws BufferExceededException If no such buffer is found which can be allocated
+	 * The page, NULL for an empty handle
 	 */
-  void allocBuf(FrameId & frame);
+  Page* get() const { return page; }
+  Page* operator->() const { return page; }
+  Page& operator*() const { return *page; }
+  explicit operator bool() const { return page != NULL; }
 
 	/**
-   * Advance clock to next frame in the buffer pool
+	 * Number of the page in its file
 	 */
-  void advanceClock()
-  {
-		clockHand = (clockHand + 1) % numBufs;
-  }
+  PageId pageNo() const { return pageNumber; }
 
+	/**
+	 * Have the page unpinned dirty, whenever it is released
+	 */
+  void markDirty() { dirty = true; }
 
- public:
 	/**
-   * Actual buffer pool from which frames are allocated
+	 * Unpin the page now, leaving the handle empty. Does nothing on an empty handle.
+	 *
+	 * @param dirty		True if the page was changed; it is also dirty if markDirty() was called
 	 */
-  Page* bufPool;
+  void release(const bool dirty = false);
 
+ private:
+  friend class BufMgr;
+
+  PageHandle(BufMgr* bufMgr, File* file, const PageId pageNo, const FrameId frameNo, Page* page);
+
+  PageHandle(const PageHandle&);
+  PageHandle& operator=(const PageHandle&);
+
+  BufMgr* bufMgr;
+  File* file;
+  PageId pageNumber;
+  FrameId frameNo;
+  Page* page;
+  bool dirty;
+};
+
+
+/**
+* @brief The central class which manages the buffer pool including frame allocation and deallocation to pages in the file 
+*
+* The frames to evict are chosen by a BufReplacer implementing the ReplacementPolicy the buffer manager
+* is constructed with.
+*
+* In concurrent mode one buffer manager can be shared by many threads. Lookups only take the latch of
+* the hash table partition of the page, frames are latched one at a time while they are filled,
+* written back or evicted, and the clock hand is advanced atomically. File I/O is serialised by
+* a single latch, since files opened under the same name share one stream, except for page reads
+* of files opened with IO_POSITIONAL, which run in parallel.
+*
+* After startReadAhead() a background thread reads the pages requested with prefetchPages() into the
+* pool, through a ring of its own, while the caller works on the pages it has. The buffer manager
+* switches to concurrent mode for it.
+*
+* After startAsyncReads() a pool of I/O threads serves readPageAsync(), so that a thread can have many
+* page reads in flight and go on working, e.g. resuming other coroutines, until each completes.
+*
+* After startBackgroundWriter() another thread writes dirty, unpinned pages back every few milliseconds,
+* so that allocBuf() mostly finds clean frames to evict and flushFile() has little left to write.
+* Dirty pages are written in page number order, runs of consecutive pages of a file at once.
+*
+* The frames are mapped in one arena, aligned to the page size of the system, and are not initialized:
+* the kernel zeroes the memory of a frame when it is first filled, so that large pools start at once.
+* The arena can be backed by huge pages, see FrameMemory.
+*
+* On hosts with several NUMA nodes the pool can be split into partitions of consecutive frames, whose
+* frames and descriptors are placed on one node each and which have a replacer and clock hand of their
+* own. A page is owned by the partition picked by the hash of (file, pageNo) and is read into a frame
+* of it, while new pages go to the partition of the node of the allocating thread. Either falls back
+* to the following partitions when all frames of its own are pinned.
+*/
+class BufMgr 
+{
+ private:
 	/**
-   * Constructor of BufMgr class
+   * True if the buffer manager may be used by several threads at once. Only switched on, by startReadAhead().
 	 */
-  BufMgr(std::uint32_t bufs);
-	
+  bool concurrent;
+
 	/**
-   * Destructor of BufMgr class
+	 * Most pages the background writer writes back per round
 	 */
-  ~BufMgr();
+  static const std::uint32_t WRITER_BATCH = 32;
 
 	/**
-	 * Reads the given page from the file into a frame and returns the pointer to page.
-	 * If the requested page is already present in the buffer pool pointer to that frame is returned
-	 * otherwise a new frame is allocated from the buffer pool for reading the page.
-	 *
-	 * @param file   	File object
-	 * @param PageNo  Page number in the file to be read
-	 * @param page  	Reference to page pointer. Used to fetch the Page object in which requested page from file is read in.
+	 * Milliseconds the background writer sleeps between rounds
 	 */
-  void readPage(File* file, const PageId PageNo, Page*& page);
+  static const std::uint32_t WRITER_INTERVAL = 10;
 
 	/**
-	 * Unpin a page from memory since it is no longer required for it to remain in memory.
-	 *
-	 * @param file   	File object
-	 * @param PageNo  Page number
-	 * @param dirty		True if the page to be unpinned needs to be marked dirty	
-   * @throws  PageNotPinnedException If the page is not already pinned
+	 * Pages prefetchPages() was asked for: the page and the pages after it on the page chain of the
+	 * file, or on the chain nextPage reads from each page if it is not NULL
 	 */
-  void unPinPage(File* file, const PageId PageNo, const bool dirty);
-  void unPinAllPages();
+  struct ReadAhead
+  {
+		File* file;
+		PageId pageNo;
+		std::uint32_t count;
+		PageId (*nextPage)(const Page* page);
+  };
 
 	/**
-	 * Allocates a new, empty page in the file and returns the Page object.
-	 * The newly allocated page is also assigned a frame in the buffer pool.
-	 *
-	 * @param file   	File object
-	 * @param PageNo  Page number. The number assigned to the page in the file is returned via this reference.
-	 * @param page  	Reference to page pointer. The newly allocated in-memory Page object is returned via this reference.
+	 * Background thread reading the requests of readAheadQueue, NULL until startReadAhead()
 	 */
-  void allocPage(File* file, PageId &PageNo, Page*& page); 
+  std::thread* readAheadThread;
 
 	/**
-	 * Writes out all dirty pages of the file to disk.
-	 * All the frames assigned to the file need to be unpinned from buffer pool before this function can be successfully called.
-	 * Otherwise Error returned.
-	 *
-	 * @param file   	File object
-   * @throws  PagePinnedException If any page of the file is pinned in the buffer pool 
-   * @throws BadBufferException If any frame allocated to the file is found to be invalid
+	 * Guards the read-ahead members below
 	 */
-  void flushFile(const File* file);
+  std::mutex readAheadLatch;
 
 	/**
-	 * Delete page from file and also from buffer pool if present.
-	 * Since the page is entirely deleted from file, its unnecessary to see if the page is dirty.
-	 *
-	 * @param file   	File object
-	 * @param PageNo  Page number
+	 * Signalled when requests are queued, and when the request being read ends
 	 */
-  void disposePage(File* file, const PageId PageNo);
+  std::condition_variable readAheadSignal;
 
 	/**
-   * Print member variable values. 
+	 * Requests not started yet, oldest first
 	 */
-  void  printSelf();
+  std::deque<ReadAhead> readAheadQueue;
 
 	/**
-   * Get buffer pool usage statistics
+	 * File of the request being read, NULL if none
 	 */
-  BufStats & getBufStats()
-  {
-		return bufStats;
-  }
+  const File* readAheadFile;
 
 	/**
-   * Clear buffer pool usage statistics
+	 * Set to abandon the request being read, or to stop the thread with stopReadAhead
 	 */
-  void clearBufStats() 
-  {
-		bufStats.clear();
-  }
+  bool cancelReadAhead;
+  bool stopReadAhead;
+
+	/**
+	 * Frames the read-ahead thread recycles
+	 */
+  BufRing readAheadRing;
+
+	/**
+	 * Loop of readAheadThread
+	 */
+  void readAheadLoop();
+
+	/**
+	 * Drop the queued requests for file and wait until no page of it is being read ahead.
+	 */
+  void cancelReadAheads(const File* file);
+
+	/**
+	 * A page asked for with readPageAsync() and what to call once it is pinned
+	 */
+  struct AsyncRead
+  {
+		File* file;
+		PageId pageNo;
+		bool hot;
+		std::function<void(Page*, std::exception_ptr)> done;
+  };
+
+	/**
+	 * I/O threads serving asyncQueue, empty until startAsyncReads()
+	 */
+  std::vector<std::thread*> asyncThreads;
+
+	/**
+	 * Guards asyncQueue and stopAsync, signalled when requests are queued or the threads are stopped
+	 */
+  std::mutex asyncLatch;
+  std::condition_variable asyncSignal;
+
+	/**
+	 * Reads not started yet, oldest first
+	 */
+  std::deque<AsyncRead> asyncQueue;
+  bool stopAsync;
+
+	/**
+	 * Loop of each of asyncThreads
+	 */
+  void asyncReadLoop();
+
+	/**
+	 * Unpin a page whose frame the caller knows, as unPinPage() does once it has looked the page up.
+	 */
+  void unPinFrame(File* file, const PageId pageNo, const FrameId frameNo, const bool dirty);
+
+	/**
+	 * Handle of a page pinned in its frame
+	 */
+  PageHandle handleOf(File* file, const PageId pageNo, Page* page)
+  {
+		return PageHandle(this, file, pageNo, static_cast<FrameId>(page - bufPool), page);
+  }
+
+  friend class PageHandle;
+
+	/**
+	 * Pin the page if it is in the pool, without reading it otherwise
+	 *
+	 * @return True if the page was found and pinned
+	 */
+  bool pinResident(File* file, const PageId pageNo, Page*& page, const bool hot);
+
+	/**
+	 * Background thread writing dirty pages back, NULL until startBackgroundWriter()
+	 */
+  std::thread* writerThread;
+
+	/**
+	 * Guards stopWriter, signalled to stop the background writer
+	 */
+  std::mutex writerLatch;
+  std::condition_variable writerSignal;
+  bool stopWriter;
+
+	/**
+	 * Frame the next round of the background writer starts at
+	 */
+  FrameId writerHand;
+
+	/**
+	 * Loop of writerThread
+	 */
+  void writerLoop();
+
+	/**
+	 * Write the pages in frames back to disk, sorted by file and page number so that runs of consecutive
+	 * pages are written together. The frames are latched by the caller in concurrent mode.
+	 *
+	 * @param frames	Frames to write, sorted by this call
+	 */
+  void writeFrames(std::vector<FrameId> &frames);
+
+	/**
+   * Serialises reads and writes of files in concurrent mode
+	 */
+  std::mutex ioLatch;
+
+	/**
+   * Write-ahead log of the pool, NULL if none. See setLog().
+	 */
+  WriteAheadLog* wal;
+
+	/**
+   * Image of the page of every frame as of the last time it was logged, mapped once a log is set
+	 */
+  Page* loggedPages;
+
+	/**
+   * Background thread taking checkpoints, NULL until startCheckpoints()
+	 */
+  std::thread* checkpointThread;
+
+	/**
+   * Guards stopCheckpoints, signalled to stop the checkpoint thread
+	 */
+  std::mutex checkpointLatch;
+  std::condition_variable checkpointSignal;
+  bool stopCheckpoints;
+
+	/**
+   * Milliseconds between the checkpoints of checkpointThread
+	 */
+  std::uint32_t checkpointInterval;
+
+	/**
+   * Loop of checkpointThread
+	 */
+  void checkpointLoop();
+
+	/**
+   * Write the log up to the last record of the page of a frame, before the page is written back
+	 */
+  void flushLogFor(const FrameId frame)
+  {
+		if (wal && bufDescTable[frame].pageLsn > wal->flushedLsn())
+			wal->flush(bufDescTable[frame].pageLsn);
+  }
+
+	/**
+   * Take the image of the page of a frame that later changes are logged against
+	 */
+  void snapshotFrame(const FrameId frame)
+  {
+		if (wal)
+			loggedPages[frame] = bufPool[frame];
+  }
+
+	/**
+   * Number of frames the buffer pool can grow to. The arrays of frames are mapped for all of them.
+	 */
+  std::uint32_t numBufs;
+
+	/**
+   * Number of frames in use. Frames from poolSize on are retired, see resize().
+	 */
+  std::atomic<std::uint32_t> poolSize;
+
+	/**
+   * Held by resize()
+	 */
+  std::mutex resizeLatch;
+
+	/**
+   * Pools added with addPool(), by name, owned by this buffer manager
+	 */
+  std::map<std::string, BufMgr*> pools;
+
+	/**
+   * Pools of the files bound with bindFile(), by file name
+	 */
+  std::unordered_map<std::string, BufMgr*> fileRoutes;
+
+	/**
+   * Pool the pages of a file go to: this one, unless the file was bound to another
+	 */
+  BufMgr* poolOf(const File* file)
+  {
+		return fileRoutes.empty() ? this : routeOf(file);
+  }
+
+  BufMgr* routeOf(const File* file);
+	
+	/**
+   * Hash table mapping (File, page) to frame
+	 */
+  BufHashTbl *hashTable;
+
+	/**
+   * Array of BufDesc objects to hold information corresponding to every frame allocation from 'bufPool' (the buffer pool)
+	 */
+  BufDesc *bufDescTable;
+
+	/**
+   * Array of the words the replacement policy sweeps over, one per frame, see FrameState
+	 */
+  FrameState *frameStates;
+
+	/**
+   * Counters of every thread that used the buffer manager, kept until it is destroyed
+	 */
+  std::vector<ThreadBufStats*> threadStats;
+
+	/**
+   * Guards threadStats
+	 */
+  std::mutex threadStatsLatch;
+
+	/**
+   * Number telling this buffer manager apart from others, including destroyed ones, in the cache of the
+   * counters of a thread
+	 */
+  std::uint64_t statsId;
+
+	/**
+   * Sum of the counters when clearBufStats() was last called, taken off every snapshot
+	 */
+  BufStats statsBaseline;
+
+	/**
+   * Changed by flushFile(), after which File objects of the file may be destroyed and their addresses
+   * reused, so that threads look up the counters of files by name again
+	 */
+  std::atomic<std::uint64_t> filesEpoch;
+
+	/**
+   * Number of dirty frames, and the most since clearBufStats(), changed through setDirty()
+	 */
+  std::atomic<int> dirtyFrames;
+  std::atomic<int> dirtyHighWater;
+
+	/**
+   * Counters of the calling thread, created on its first use of the buffer manager
+	 */
+  ThreadBufStats &localStats();
+
+	/**
+   * Sum of the counters of all threads, without the baseline taken off
+	 */
+  void sumStats(BufStats &stats);
+
+	/**
+   * Set the dirty bit of a frame, counting dirty frames. Called under the hash table partition latch of
+   * the page of the frame in concurrent mode, or with the frame latched once it left the hash table.
+	 */
+  void setDirty(BufDesc &desc, const bool dirty);
+
+	/**
+   * Replacement policy choosing the frames allocBuf() evicts
+	 */
+  BufReplacer *replacer;
+
+	/**
+   * Marks the end of a list of frames of a file
+	 */
+  static const FrameId NO_FRAME = ~(FrameId)0;
+
+	/**
+   * First frame of the list of frames holding pages of each file, linked through BufDesc::fileNext, so that
+   * flushFile() only visits the frames of its file. Files without pages in the pool have no entry.
+	 */
+  std::unordered_map<const File*, FrameId> fileFrames;
+
+	/**
+   * Guards fileFrames and the file lists in concurrent mode
+	 */
+  std::mutex fileFramesLatch;
+
+	/**
+	 * Add a frame that has just been set up for a page to the list of its file. The frame latch is held by
+	 * the caller in concurrent mode, as with removeFileFrame().
+	 */
+  void addFileFrame(const FrameId frame);
+
+	/**
+	 * Remove a frame that still holds its page from the list of its file, before the frame is cleared.
+	 */
+  void removeFileFrame(const FrameId frame);
+
+	/**
+	 * Allocate a free frame. In concurrent mode the frame is returned latched, and the caller releases
+	 * the latch once the frame is set up.
+	 *
+	 * @param frame   	Frame reference, frame ID of allocated frame returned via this variable
+	 * @param partition	Partition of the pool to take the frame from if it can
+	 * @throws BufferExceededException If no such buffer is found which can be allocated
+	 */
+  void allocBuf(FrameId & frame, const std::uint32_t partition);
+
+	/**
+	 * Allocate a frame for a scan reading through ring, reusing the oldest frame of the ring if possible.
+	 * The frame is returned latched in concurrent mode, as allocBuf() does.
+	 *
+	 * @param ring		Ring of the scan
+	 * @param frame   	Frame reference, frame ID of allocated frame returned via this variable
+	 * @param partition	Partition of the pool to take a new frame from if it can
+	 * @throws BufferExceededException If no such buffer is found which can be allocated
+	 */
+  void allocRingBuf(BufRing &ring, FrameId & frame, const std::uint32_t partition);
+
+	/**
+	 * Partition of the pool owning a page, whose frames the page is read into first
+	 */
+  std::uint32_t ownerPartition(const File* file, const PageId pageNo) const;
+
+	/**
+	 * Partition of the pool on the NUMA node the calling thread runs on, where new pages go first
+	 */
+  std::uint32_t localPartition() const;
+
+	/**
+	 * Ask the kernel to place the memory of every partition of an array with an element per frame
+	 * on the NUMA node of the partition.
+	 *
+	 * @param array		Array aligned to a system page
+	 * @param elementSize	Size of an element in bytes
+	 */
+  void bindPartitions(void* array, const std::size_t elementSize);
+
+	/**
+	 * readPage() and the readPage() of scans reading through a ring.
+	 *
+	 * @param ring		Ring of the scan, or NULL
+	 */
+  void fetchPage(File* file, const PageId PageNo, Page*& page, const bool hot, BufRing* ring);
+
+	/**
+	 * Try to take a frame for allocBuf(). The frame latch is held by the caller in concurrent mode.
+	 *
+	 * @param frame   	Frame number
+	 * @return True if the frame is free and cleared
+	 */
+  bool claimBuf(const FrameId frame);
+
+	/**
+	 * True if some frame is not pinned, so that a failed allocBuf() scan is worth repeating in concurrent mode.
+	 */
+  bool anyUnpinned() const;
+
+
+ public:
+	/**
+   * Actual buffer pool from which frames are allocated
+	 */
+  Page* bufPool;
+
+	/**
+   * Size of the arena mapped for bufPool, in bytes
+	 */
+  std::size_t bufPoolBytes;
+
+	/**
+   * Size of the arenas mapped for bufDescTable and frameStates, in bytes
+	 */
+  std::size_t bufDescBytes;
+  std::size_t frameStatesBytes;
+
+	/**
+   * Number of partitions of the pool, and the number of NUMA nodes of the host they are spread over
+	 */
+  std::uint32_t numPartitions;
+  std::uint32_t numNodes;
+
+	/**
+	 * Map the arena of the frames.
+	 *
+	 * @param frameMemory	Memory to use
+	 * @throws std::bad_alloc If no memory could be mapped
+	 */
+  void mapFrames(const FrameMemory frameMemory);
+
+	/**
+   * Constructor of BufMgr class
+	 *
+	 * @param bufs   	Number of frames in the buffer pool
+	 * @param concurrent	True if the buffer pool is shared by several threads
+	 * @param policy	Replacement policy of the buffer pool
+	 * @param frameMemory	Memory the frames are mapped in
+	 * @param partitions	Number of partitions of the pool, see above. 1 for none, 0 for one per NUMA node
+	 * @param maxBufs	Number of frames resize() can grow the pool to, 0 for bufs
+	 */
+  BufMgr(std::uint32_t bufs, const bool concurrent = false, const ReplacementPolicy policy = CLOCK,
+		const FrameMemory frameMemory = FRAMES_SMALL_PAGES, const std::uint32_t partitions = 1,
+		const std::uint32_t maxBufs = 0);
+	
+	/**
+   * Destructor of BufMgr class
+	 */
+  ~BufMgr();
+
+	/**
+	 * Reads the given page from the file into a frame and returns the pointer to page.
+	 * If the requested page is already present in the buffer pool pointer to that frame is returned
+	 * otherwise a new frame is allocated from the buffer pool for reading the page.
+	 *
+	 * @param file   	File object
+	 * @param PageNo  Page number in the file to be read
+	 * @param page  	Reference to page pointer. Used to fetch the Page object in which requested page from file is read in.
+	 * @param hot		True if the page is expected to be read again soon, such as an inner index node. Policies
+	 *              that protect such pages keep it in the pool longer.
+	 * @throws  CorruptPageException if the page read from the file does not match its checksum
+	 */
+  void readPage(File* file, const PageId PageNo, Page*& page, const bool hot = false);
+
+	/**
+	 * readPage() for a sequential scan, which reads the page into a frame of ring if it is not in
+	 * the buffer pool. See BufRing.
+	 *
+	 * @param file   	File object
+	 * @param PageNo  Page number in the file to be read
+	 * @param page  	Reference to page pointer
+	 * @param ring		Ring of the scan
+	 */
+  void readPage(File* file, const PageId PageNo, Page*& page, BufRing &ring);
+
+	/**
+	 * readPage() returning a handle that keeps the page pinned until it is released or destroyed.
+	 *
+	 * @param file   	File object
+	 * @param PageNo  Page number in the file to be read
+	 * @param hot		See readPage()
+	 * @return Handle of the pinned page
+	 */
+  PageHandle readPage(File* file, const PageId PageNo, const bool hot = false);
+
+	/**
+	 * readPage() through a ring, returning a handle of the pinned page.
+	 */
+  PageHandle readPage(File* file, const PageId PageNo, BufRing &ring);
+
+	/**
+	 * Start the background thread reading ahead the pages asked for with prefetchPages(). Until
+	 * then prefetchPages() does nothing. No other thread may use the buffer manager meanwhile.
+	 * Afterwards the files read ahead must only be read and written through the buffer manager,
+	 * whose thread shares their stream.
+	 */
+  void startReadAhead();
+
+	/**
+	 * Ask for pages to be read into the buffer pool in the background, ahead of the caller reading
+	 * them. Pages that cannot be read are skipped. flushFile() drops the pages of the file still
+	 * to be read.
+	 *
+	 * @param file   	File object
+	 * @param PageNo  Number of the first page to read. Nothing is read if it is Page::INVALID_NUMBER.
+	 * @param count		Number of pages to read, following the chain of used pages of the file from PageNo.
+	 *              Files without a page chain, like blob files, can only ask for single pages.
+	 */
+  void prefetchPages(File* file, const PageId PageNo, const std::uint32_t count);
+
+	/**
+	 * prefetchPages() following a chain of pages kept in the pages themselves, such as the sibling
+	 * pointers of index leaves. nextPage is called on each page read, from the read-ahead thread and
+	 * without any latch of the caller, so what it returns is only a hint; a page number that cannot
+	 * be read ends the chain.
+	 *
+	 * @param nextPage  Page number of the page after page on the chain, Page::INVALID_NUMBER at its end
+	 */
+  void prefetchPages(File* file, const PageId PageNo, const std::uint32_t count, PageId (*nextPage)(const Page* page));
+
+	/**
+	 * Start threads reading the pages asked for with readPageAsync(), each blocking on one read at a time.
+	 * Like startReadAhead(), this switches the buffer manager to concurrent mode. No other thread may use
+	 * the buffer manager meanwhile.
+	 *
+	 * @param threads	Number of I/O threads, which is the most page reads in flight at once
+	 */
+  void startAsyncReads(const std::uint32_t threads);
+
+	/**
+	 * readPage() without blocking the calling thread on the file: done is called with the pinned page
+	 * once it is in the pool, or with the exception readPage() would have thrown. A page already in the
+	 * pool is pinned and done called before this returns; otherwise done runs on an I/O thread, and the
+	 * caller goes on meanwhile. Before startAsyncReads() the page is read on the calling thread. A
+	 * coroutine scheduler resumes the coroutine waiting for the page from done. Reads of a file must have
+	 * completed before flushFile() is called on it.
+	 *
+	 * @param file   	File object
+	 * @param PageNo  Page number in the file to be read
+	 * @param done		Called once with the page, NULL if the read failed, and the exception it failed with
+	 * @param hot		See readPage()
+	 */
+  void readPageAsync(File* file, const PageId PageNo, std::function<void(Page*, std::exception_ptr)> done,
+                     const bool hot = false);
+
+	/**
+	 * readPageAsync() returning a future of the pinned page, whose get() throws what readPage() would.
+	 */
+  std::future<Page*> readPageAsync(File* file, const PageId PageNo, const bool hot = false);
+
+	/**
+	 * Start the background thread writing dirty, unpinned pages back to disk. Pages keep their frames
+	 * and are only written again once they are changed again. Like startReadAhead(), this switches
+	 * the buffer manager to concurrent mode, and the files must only be written through it afterwards.
+	 */
+  void startBackgroundWriter();
+
+	/**
+	 * Unpin a page from memory since it is no longer required for it to remain in memory.
+	 *
+	 * @param file   	File object
+	 * @param PageNo  Page number
+	 * @param dirty		True if the page to be unpinned needs to be marked dirty	
+   * @throws  PageNotPinnedException If the page is not already pinned
+	 */
+  void unPinPage(File* file, const PageId PageNo, const bool dirty);
+  void unPinAllPages();
+
+	/**
+	 * Allocates a new, empty page in the file and returns the Page object.
+	 * The newly allocated page is also assigned a frame in the buffer pool.
+	 *
+	 * @param file   	File object
+	 * @param PageNo  Page number. The number assigned to the page in the file is returned via this reference.
+	 * @param page  	Reference to page pointer. The newly allocated in-memory Page object is returned via this reference.
+	 */
+  void allocPage(File* file, PageId &PageNo, Page*& page); 
+
+	/**
+	 * allocPage() returning a handle that keeps the new page pinned until it is released or destroyed.
+	 *
+	 * @param file   	File object
+	 * @param PageNo  Page number. The number assigned to the page in the file is returned via this reference.
+	 * @return Handle of the pinned page
+	 */
+  PageHandle allocPage(File* file, PageId &PageNo);
+
+	/**
+	 * Writes out all dirty pages of the file to disk, in page number order, checkpoints the file and removes
+	 * the pages of the file from the buffer pool. All the frames assigned to the file need to be unpinned from buffer pool before this function can be successfully called.
+	 * Otherwise Error returned.
+	 *
+	 * @param file   	File object
+   * @throws  PagePinnedException If any page of the file is pinned in the buffer pool 
+   * @throws BadBufferException If any frame allocated to the file is found to be invalid
+	 */
+  void flushFile(const File* file);
+
+	/**
+	 * Delete page from file and also from buffer pool if present.
+	 * Since the page is entirely deleted from file, its unnecessary to see if the page is dirty.
+	 *
+	 * @param file   	File object
+	 * @param PageNo  Page number
+	 */
+  void disposePage(File* file, const PageId PageNo);
+
+	/**
+	 * Log the changes to pages made through the pool from now on to log, see WriteAheadLog.
+	 * unPinPage() with dirty set appends a record of the bytes of the page that changed since it was
+	 * last logged, and no page is written back before the log is written up to its last record.
+	 * Pages already in the pool are logged against their current contents, so changes made before
+	 * the log is set are not in the log. The log must outlive its use by the pool. No other
+	 * thread may use the buffer manager meanwhile.
+	 *
+	 * @param log		Log to use, NULL to stop logging
+	 */
+  void setLog(WriteAheadLog* log);
+
+	/**
+   * Write-ahead log of the pool, NULL if none
+	 */
+  WriteAheadLog* log() const
+  {
+		return wal;
+  }
+
+	/**
+	 * Take a fuzzy checkpoint of the log: record the pages dirty in the pool, with the LSN from which
+	 * the log holds their changes, so that WriteAheadLog::recover() starts reading the log at the
+	 * oldest of them rather than at its beginning. Nothing is written back, and other threads go on
+	 * using the pool meanwhile; frames being filled or written back are waited for one at a time.
+	 * Does nothing without a log.
+	 *
+	 * @return Redo point of the checkpoint, 0 without a log
+	 */
+  Lsn checkpoint();
+
+	/**
+	 * Start a background thread taking a checkpoint() right away and then every intervalMillis
+	 * milliseconds, until the buffer manager is destroyed. Like startBackgroundWriter(), this
+	 * switches the buffer manager to concurrent mode. The log must be set first.
+	 *
+	 * @param intervalMillis	Milliseconds between checkpoints
+	 */
+  void startCheckpoints(const std::uint32_t intervalMillis);
+
+	/**
+	 * Grow or shrink the pool to a number of frames while other threads go on using it. Frames are
+	 * taken out from the last one down: their pages are written back if dirty and evicted, and their
+	 * memory is given back to the system. Shrinking stops early at a frame whose page is pinned; call
+	 * again once it is unpinned. Frames taken out come back free when the pool grows again.
+	 *
+	 * The frames, their descriptors and the hash table are all sized for the most frames the pool can
+	 * grow to when it is constructed, so that frames never move and nothing is rehashed. Memory not
+	 * in use is only reserved, not touched.
+	 *
+	 * @param bufs		Number of frames wanted, between 1 and capacity()
+	 * @return Number of frames in the pool now
+	 */
+  std::uint32_t resize(const std::uint32_t bufs);
+
+	/**
+   * Number of frames in the pool
+	 */
+  std::uint32_t size() const
+  {
+		return poolSize.load();
+  }
+
+	/**
+   * Number of frames resize() can grow the pool to
+	 */
+  std::uint32_t capacity() const
+  {
+		return numBufs;
+  }
+
+	/**
+	 * Add a pool with frames and a replacement policy of its own, such as one for index pages that
+	 * scans of heap files cannot evict. Files are given to it with bindFile(); their pages are then
+	 * read, allocated, unpinned, flushed and disposed of in that pool through this buffer manager, so
+	 * that callers keep passing this one around. Everything else, such as read-ahead, logging or
+	 * statistics, is set up and asked for on each pool, which is a buffer manager of its own and is
+	 * destroyed with this one. No other thread may use the buffer manager meanwhile.
+	 *
+	 * @param name		Name of the pool, such as "index" or "temp"
+	 * @param bufs		Number of frames in the pool
+	 * @param policy	Replacement policy of the pool
+	 * @param concurrent	True if the pool is shared by several threads
+	 * @return The pool, or the one already added under the name
+	 */
+  BufMgr* addPool(const std::string& name, const std::uint32_t bufs, const ReplacementPolicy policy = CLOCK,
+                  const bool concurrent = false);
+
+	/**
+	 * Pool added under a name, NULL if there is none
+	 */
+  BufMgr* pool(const std::string& name) const;
+
+	/**
+	 * Have the pages of a file go to a pool, whichever File object they are asked for through. The
+	 * file must have no pages in the pool it used before. No other thread may use the buffer manager
+	 * meanwhile.
+	 *
+	 * @param filename	Name of the file, which need not exist yet
+	 * @param pool		Pool from addPool(), or this buffer manager to undo the binding
+	 */
+  void bindFile(const std::string& filename, BufMgr* pool);
+
+	/**
+   * True if the buffer manager may be used by several threads at once
+	 */
+  bool isConcurrent() const
+  {
+		return concurrent;
+  }
+
+	/**
+   * Print member variable values. 
+	 */
+  void  printSelf();
+
+	/**
+   * Get a snapshot of buffer pool usage statistics since they were last cleared. The threads using the
+   * pool are not stopped: they only share a latch with the snapshot the first time they use the pool, and
+   * the first time they count for each file.
+	 */
+  BufStats getBufStats();
+
+	/**
+   * Clear buffer pool usage statistics
+	 */
+  void clearBufStats();
 };
 
 }
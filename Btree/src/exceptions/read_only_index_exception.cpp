@@ -0,0 +1,22 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "read_only_index_exception.h"
+
+#include <sstream>
+#include <string>
+
+namespace badgerdb {
+
+ReadOnlyIndexException::ReadOnlyIndexException(const std::string& name)
+    : BadgerDbException(""), filename_(name) {
+  std::stringstream ss;
+  ss << "Index is open read-only: " << filename_;
+  message_.assign(ss.str());
+}
+
+}
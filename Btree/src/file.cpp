@@ -7,24 +7,227 @@
 
 #include "file.h"
 
+#include <algorithm>
 #include <fstream>
 #include <iostream>
 #include <memory>
 #include <string>
 #include <cstdio>
 #include <cassert>
+#include <vector>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include "exceptions/file_exists_exception.h"
 #include "exceptions/file_not_found_exception.h"
 #include "exceptions/file_open_exception.h"
 #include "exceptions/invalid_page_exception.h"
+#include "exceptions/insufficient_space_exception.h"
 #include "file_iterator.h"
 #include "page.h"
 
 namespace badgerdb {
 
-File::StreamMap File::open_streams_;
-File::CountMap File::open_counts_;
+namespace {
+
+/**
+ * Reads or writes the buffers at the given offset of the descriptor, going on
+ * after partial transfers and interrupted calls. Reads stop at the end of the
+ * file, leaving the rest of the buffers zeroed.
+ */
+void transferAt(const int fd, const bool write, off_t offset,
+                const struct iovec* buffers, int count) {
+  std::vector<struct iovec> left(buffers, buffers + count);
+  struct iovec* next = &left[0];
+  while (count > 0) {
+    const int batch = count < IOV_MAX ? count : IOV_MAX;
+    const ssize_t done = write ? ::pwritev(fd, next, batch, offset)
+                               : ::preadv(fd, next, batch, offset);
+    if (done < 0 && errno == EINTR) {
+      continue;
+    }
+    if (done <= 0) {
+      break;
+    }
+    offset += done;
+    std::size_t transferred = done;
+    while (count > 0 && transferred >= next->iov_len) {
+      transferred -= next->iov_len;
+      ++next;
+      --count;
+    }
+    if (count > 0) {
+      next->iov_base = static_cast<char*>(next->iov_base) + transferred;
+      next->iov_len -= transferred;
+    }
+  }
+  for (; !write && count > 0; ++next, --count) {
+    memset(next->iov_base, 0, next->iov_len);
+  }
+}
+
+const std::size_t PAGE_WORDS = Page::SIZE / sizeof(std::uint32_t);
+
+/**
+ * Most units a page takes in a compressed file: its length, then the page as
+ * it is if it does not compress.
+ */
+const std::uint64_t PAGE_UNITS =
+    (sizeof(std::uint16_t) + Page::SIZE + File::COMPRESSED_UNIT - 1) /
+    File::COMPRESSED_UNIT;
+
+std::uint64_t unitsFor(const std::uint64_t bytes) {
+  return (bytes + File::COMPRESSED_UNIT - 1) / File::COMPRESSED_UNIT;
+}
+
+/**
+ * Appends a number in groups of 7 bits, lowest first. Returns false, leaving
+ * the output unfinished, once it would go past the limit.
+ */
+inline bool putVarint(std::uint32_t value, char* out, std::size_t& length,
+                      const std::size_t limit) {
+  for (; value >= 0x80; value >>= 7) {
+    if (length >= limit) {
+      return false;
+    }
+    out[length++] = static_cast<char>(value | 0x80);
+  }
+  if (length >= limit) {
+    return false;
+  }
+  out[length++] = static_cast<char>(value);
+  return true;
+}
+
+inline bool getVarint(const unsigned char* in, const std::size_t length,
+                      std::size_t& position, std::uint32_t& value) {
+  value = 0;
+  for (int shift = 0; shift < 32; shift += 7) {
+    if (position >= length) {
+      return false;
+    }
+    const unsigned char byte = in[position++];
+    value |= static_cast<std::uint32_t>(byte & 0x7f) << shift;
+    if (byte < 0x80) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/**
+ * Encodes the 32 bit words of a page as their differences from the word
+ * stride words before them, zigzagged so that small negative ones stay small
+ * too. A run of unchanged words, such as unused space or keys repeating at
+ * the stride, is a 0 and the length of the run less one. Sorted INTEGER keys
+ * and the RecordIds after them in a leaf come out at about a byte each.
+ *
+ * @return  Length of the encoding, or limit if it would take that much.
+ */
+std::size_t encodeWords(const std::uint32_t* words, const std::size_t stride,
+                        char* out, const std::size_t limit) {
+  std::size_t length = 0;
+  out[length++] = static_cast<char>(stride);
+  for (std::size_t i = 0; i < PAGE_WORDS; ) {
+    const std::uint32_t delta = words[i] - (i >= stride ? words[i - stride] : 0);
+    if (delta == 0) {
+      std::size_t run = 1;
+      while (i + run < PAGE_WORDS &&
+             words[i + run] == (i + run >= stride ? words[i + run - stride] : 0)) {
+        ++run;
+      }
+      if (!putVarint(0, out, length, limit) ||
+          !putVarint(run - 1, out, length, limit)) {
+        return limit;
+      }
+      i += run;
+    } else {
+      const std::uint32_t zigzag =
+          (delta << 1) ^ static_cast<std::uint32_t>(static_cast<std::int32_t>(delta) >> 31);
+      if (!putVarint(zigzag, out, length, limit)) {
+        return limit;
+      }
+      ++i;
+    }
+  }
+  return length;
+}
+
+/**
+ * Compresses a page with encodeWords(), by the previous word or the one
+ * before it, whichever comes out shorter; the second suits arrays of 8 byte
+ * entries.
+ *
+ * @param page  Page::SIZE bytes of the page.
+ * @param out   Page::SIZE bytes for the result.
+ * @return  Length of the result, Page::SIZE for the page as it is if it does
+ *          not compress.
+ */
+std::size_t compressPage(const char* page, char* out) {
+  std::uint32_t words[PAGE_WORDS];
+  memcpy(words, page, Page::SIZE);
+  char other[Page::SIZE];
+  const std::size_t byWord = encodeWords(words, 1, out, Page::SIZE);
+  const std::size_t byPair = encodeWords(words, 2, other, byWord);
+  if (byPair < byWord) {
+    memcpy(out, other, byPair);
+    return byPair;
+  }
+  if (byWord < Page::SIZE) {
+    return byWord;
+  }
+  memcpy(out, page, Page::SIZE);
+  return Page::SIZE;
+}
+
+/**
+ * Undoes compressPage() for a result shorter than a page.
+ *
+ * @return  False if the input is not a whole encoding of a page.
+ */
+bool uncompressPage(const char* in, const std::size_t length, char* page) {
+  const unsigned char* bytes = reinterpret_cast<const unsigned char*>(in);
+  if (length == 0 || bytes[0] < 1 || bytes[0] > 2) {
+    return false;
+  }
+  const std::size_t stride = bytes[0];
+  std::uint32_t words[PAGE_WORDS];
+  std::size_t position = 1;
+  for (std::size_t i = 0; i < PAGE_WORDS; ) {
+    std::uint32_t value;
+    if (!getVarint(bytes, length, position, value)) {
+      return false;
+    }
+    if (value == 0) {
+      std::uint32_t run;
+      if (!getVarint(bytes, length, position, run) || run >= PAGE_WORDS - i) {
+        return false;
+      }
+      for (std::size_t end = i + run + 1; i < end; ++i) {
+        words[i] = i >= stride ? words[i - stride] : 0;
+      }
+    } else {
+      const std::uint32_t delta = (value >> 1) ^ (0 - (value & 1));
+      words[i] = delta + (i >= stride ? words[i - stride] : 0);
+      ++i;
+    }
+  }
+  memcpy(page, words, Page::SIZE);
+  return position == length;
+}
+
+}
+
+File::OpenFileMap File::open_files_;
+Durability File::durability_ = DURABILITY_CHECKPOINT;
+IoBackend File::io_backend_ = IO_STREAM;
+bool File::page_checksums_ = true;
+bool File::page_compression_ = false;
 
 void File::remove(const std::string& filename) {
   if (!exists(filename)) {
@@ -37,21 +240,91 @@ void File::remove(const std::string& filename) {
 }
 
 bool File::isOpen(const std::string& filename) {
-  if (!exists(filename)) {
+  FileId id;
+  if (!lookUpId(filename, id)) {
     return false;
   }
-  return open_counts_.find(filename) != open_counts_.end();
+  return open_files_.find(id) != open_files_.end();
 }
 
 bool File::exists(const std::string& filename) {
-	std::fstream file(filename);
-	if(file)
-	{
-		file.close();
-		return true;
-	}
+  FileId id;
+  return lookUpId(filename, id);
+}
+
+bool File::lookUpId(const std::string& filename, FileId& id) {
+  struct stat status;
+  if (::stat(filename.c_str(), &status) != 0) {
+    return false;
+  }
+  id.device = status.st_dev;
+  id.inode = status.st_ino;
+  return true;
+}
+
+void File::setDurability(const Durability durability) {
+  durability_ = durability;
+}
+
+void File::setIoBackend(const IoBackend backend) {
+  io_backend_ = backend;
+}
+
+void File::setPageChecksums(const bool enabled) {
+  page_checksums_ = enabled;
+}
+
+void File::setPageCompression(const bool enabled) {
+  page_compression_ = enabled;
+}
+
+std::uint32_t File::headerChecksum(const PageHeader& header,
+                                   const char* data) {
+  // the bytes of the header as written, padding included, with the fields
+  // left out of the checksum zeroed
+  char bytes[sizeof(PageHeader)];
+  memcpy(bytes, &header, sizeof(PageHeader));
+  memset(bytes + offsetof(PageHeader, next_page_number), 0, sizeof(PageId));
+  memset(bytes + offsetof(PageHeader, prev_page_number), 0, sizeof(PageId));
+  memset(bytes + offsetof(PageHeader, checksum), 0, sizeof(std::uint32_t));
+  const std::uint32_t crc =
+      crc32c(crc32c(0, bytes, sizeof(bytes)), data, Page::DATA_SIZE);
+  // 0 is left for pages written without checksums
+  return crc != 0 ? crc : 1;
+}
+
+std::uint32_t File::trailerChecksum(const char* page) {
+  const std::uint32_t crc = crc32c(0, page, Page::BLOB_SIZE);
+  return crc != 0 ? crc : 1;
+}
 
-	return false;
+void File::sealImage(const PageChecksum checksum, char* image) {
+  if (checksum == CHECKSUM_HEADER) {
+    PageHeader header;
+    memcpy(&header, image, sizeof(PageHeader));
+    const std::uint32_t crc =
+        headerChecksum(header, image + sizeof(PageHeader));
+    memcpy(image + offsetof(PageHeader, checksum), &crc, sizeof(crc));
+  } else if (checksum == CHECKSUM_TRAILER) {
+    const std::uint32_t crc = trailerChecksum(image);
+    memcpy(image + Page::BLOB_SIZE, &crc, sizeof(crc));
+  }
+}
+
+bool File::verifyPage(const Page& page) const {
+  switch (checksum_) {
+    case CHECKSUM_HEADER:
+      return page.header_.checksum ==
+             headerChecksum(page.header_, &page.data_[0]);
+    case CHECKSUM_TRAILER: {
+      const char* bytes = reinterpret_cast<const char*>(&page);
+      std::uint32_t crc;
+      memcpy(&crc, bytes + Page::BLOB_SIZE, sizeof(crc));
+      return crc == trailerChecksum(bytes);
+    }
+    default:
+      return true;
+  }
 }
 
 File::~File() {
@@ -60,72 +333,366 @@ File::~File() {
 
 
 PageId File::getFirstPageNo() {
-  const FileHeader& header = readHeader();
-  return header.first_used_page;
+  std::lock_guard<std::mutex> guard(header_->latch);
+  return header_->header.first_used_page;
+}
+
+PageId File::numPages() const {
+  std::lock_guard<std::mutex> guard(header_->latch);
+  return header_->header.num_pages;
 }
 
-File::File(const std::string& name, const bool create_new) : filename_(name) {
+File::File(const std::string& name, const bool create_new,
+           const PageChecksum checksum, const bool compressible)
+    : filename_(name), fd_(-1), checksum_(CHECKSUM_NONE) {
   openIfNeeded(create_new);
 
   if (create_new) {
     // File starts with 1 page (the header).
+    checksum_ = page_checksums_ ? checksum : CHECKSUM_NONE;
     FileHeader header = {1 /* num_pages */, 0 /* first_used_page */,
-                         0 /* num_free_pages */, 0 /* first_free_page */};
+                         0 /* last_used_page */, 0 /* num_free_pages */,
+                         0 /* first_free_page */,
+                         (std::uint32_t)checksum_ /* page_checksum */,
+                         page_compression_ && compressible /* compressed */,
+                         0 /* page_map_pages */, 0 /* page_map_offset */,
+                         0 /* num_columns */, {} /* column_widths */};
     writeHeader(header);
+    loadPageMap();
   }
 }
 
 void File::openIfNeeded(const bool create_new) {
-  if (open_counts_.find(filename_) != open_counts_.end()) {	//exists an entry already
-    ++open_counts_[filename_];
-    stream_ = open_streams_[filename_];
+  const bool already_exists = lookUpId(filename_, id_);
+  // Error if we try to overwrite an existing file, open or not.
+  if (create_new && already_exists) {
+    throw FileExistsException(filename_);
+  }
+  OpenFileMap::iterator open =
+      already_exists ? open_files_.find(id_) : open_files_.end();
+  if (open != open_files_.end()) {	//exists an entry already
+    ++open->second.count;
+    stream_ = open->second.stream;
+    header_ = open->second.header;
+    fd_ = open->second.fd;
   } else {
     std::ios_base::openmode mode =
         std::fstream::in | std::fstream::out | std::fstream::binary;
-    const bool already_exists = exists(filename_);
     if (create_new) {
-      // Error if we try to overwrite an existing file.
-      if (already_exists) {
-        throw FileExistsException(filename_);
-      }
       // New files have to be truncated on open.
       mode = mode | std::fstream::trunc;
-    } else {
+    } else if (!already_exists) {
       // Error if we try to open a file that doesn't exist.
-      if (!already_exists) {
+      throw FileNotFoundException(filename_);
+    }
+    if (io_backend_ == IO_POSITIONAL) {
+      fd_ = ::open(filename_.c_str(),
+                   create_new ? O_RDWR | O_CREAT | O_TRUNC : O_RDWR, 0666);
+      if (fd_ < 0) {
         throw FileNotFoundException(filename_);
       }
+    } else {
+      stream_.reset(new std::fstream(filename_, mode));
+      fd_ = -1;
     }
-    stream_.reset(new std::fstream(filename_, mode));
-    open_streams_[filename_] = stream_;
-    open_counts_[filename_] = 1;
+    // a new file only has an identity once it is created
+    if (create_new && !lookUpId(filename_, id_)) {
+      stream_.reset();
+      if (fd_ >= 0) {
+        ::close(fd_);
+        fd_ = -1;
+      }
+      throw FileNotFoundException(filename_);
+    }
+    header_.reset(new CachedHeader());
+    header_->dirty = false;
+    if (!create_new) {
+      struct iovec buffer = {&header_->header, sizeof(FileHeader)};
+      readAt(0 /* pos */, &buffer, 1);
+      loadPageMap();
+    }
+    OpenFile& entry = open_files_[id_];
+    entry.stream = stream_;
+    entry.header = header_;
+    entry.fd = fd_;
+    entry.count = 1;
   }
+  checksum_ = static_cast<PageChecksum>(readHeader().page_checksum);
 }
 
 void File::close() {
-	if(open_counts_[filename_] > 0)
-  	--open_counts_[filename_];
+  if (header_ == NULL) {
+    // closed already
+    return;
+  }
+  OpenFileMap::iterator open = open_files_.find(id_);
+  assert(open != open_files_.end() && open->second.count > 0);
+  if (open->second.count == 1) {
+    // last File object of the file, write everything out
+    checkpoint();
+  }
+  --open->second.count;
 
   stream_.reset();
-	assert(open_counts_[filename_] >= 0);
+  header_.reset();
+
+  if (open->second.count == 0) {
+    if (fd_ >= 0) {
+      ::close(fd_);
+    }
+    open_files_.erase(open);
+  }
+  fd_ = -1;
+}
+
+void File::writePages(const PageId first_page_number,
+                      const Page* const* pages, const std::size_t count) {
+  for (std::size_t i = 0; i < count; ++i) {
+    writePage(first_page_number + i, *pages[i]);
+  }
+}
+
+void File::readAt(const std::streampos position,
+                  const struct iovec* buffers, const int count) const {
+  if (fd_ >= 0) {
+    transferAt(fd_, false /* write */, position, buffers, count);
+    return;
+  }
+  stream_->seekg(position, std::ios::beg);
+  for (int i = 0; i < count; ++i) {
+    stream_->read(static_cast<char*>(buffers[i].iov_base), buffers[i].iov_len);
+  }
+}
 
-  if (open_counts_[filename_] == 0) {
-    open_streams_.erase(filename_);
-    open_counts_.erase(filename_);
+void File::writeAt(const std::streampos position,
+                   const struct iovec* buffers, const int count) const {
+  if (fd_ >= 0) {
+    transferAt(fd_, true /* write */, position, buffers, count);
+    return;
+  }
+  stream_->seekp(position, std::ios::beg);
+  for (int i = 0; i < count; ++i) {
+    stream_->write(static_cast<const char*>(buffers[i].iov_base),
+                   buffers[i].iov_len);
   }
 }
 
 FileHeader File::readHeader() const {
-  FileHeader header;
-  stream_->seekg(0 /* pos */, std::ios::beg);
-  stream_->read(reinterpret_cast<char*>(&header), sizeof(FileHeader));
-  return header;
+  std::lock_guard<std::mutex> guard(header_->latch);
+  return header_->header;
 }
 
 void File::writeHeader(const FileHeader& header) {
-  stream_->seekp(0 /* pos */, std::ios::beg);
-  stream_->write(reinterpret_cast<const char*>(&header), sizeof(FileHeader));
+  std::lock_guard<std::mutex> guard(header_->latch);
+  header_->header = header;
+  header_->dirty = true;
+}
+
+void File::checkpoint() const {
+  {
+    std::lock_guard<std::mutex> guard(header_->latch);
+    PageMap* map = header_->page_map.get();
+    if (map != NULL && map->dirty) {
+      writePageMap();
+      // the map and the pages it names are on disk before the header naming it
+      if (durability_ == DURABILITY_SYNC) {
+        syncData();
+      }
+    }
+    if (header_->dirty) {
+      struct iovec buffer = {&header_->header, sizeof(FileHeader)};
+      writeAt(0 /* pos */, &buffer, 1);
+      header_->dirty = false;
+    }
+    // the places the map on disk no longer names can be reused
+    for (std::size_t i = 0; map != NULL && i < map->retired.size(); ++i) {
+      map->release(map->retired[i].offset, map->retired[i].units);
+    }
+    if (map != NULL) {
+      map->retired.clear();
+    }
+  }
+  if (durability_ == DURABILITY_NONE) {
+    return;
+  }
+  if (fd_ >= 0) {
+    // positional writes reach the operating system right away
+    if (durability_ == DURABILITY_SYNC) {
+      ::fsync(fd_);
+    }
+    return;
+  }
   stream_->flush();
+  if (durability_ == DURABILITY_SYNC) {
+    syncData();
+  }
+}
+
+void File::syncData() const {
+  if (fd_ >= 0) {
+    ::fsync(fd_);
+    return;
+  }
+  stream_->flush();
+  // the stream does not expose its descriptor; syncing any descriptor of the
+  // file writes all of its cached pages
+  const int fd = ::open(filename_.c_str(), O_RDONLY);
+  if (fd >= 0) {
+    ::fsync(fd);
+    ::close(fd);
+  }
+}
+
+std::uint64_t File::PageMap::allocate(const std::uint64_t units) {
+  // the smallest free extent that is large enough, the rest of which stays
+  // free
+  for (std::uint64_t size = units; size < free.size(); ++size) {
+    if (!free[size].empty()) {
+      const std::uint64_t offset = free[size].back();
+      free[size].pop_back();
+      if (size > units) {
+        free[size - units].push_back(offset + units * COMPRESSED_UNIT);
+      }
+      return offset;
+    }
+  }
+  const std::uint64_t offset = end;
+  end += units * COMPRESSED_UNIT;
+  return offset;
+}
+
+void File::PageMap::release(std::uint64_t offset, std::uint64_t units) {
+  while (units > 0) {
+    const std::uint64_t piece = std::min(units, PAGE_UNITS);
+    free[piece].push_back(offset);
+    offset += piece * COMPRESSED_UNIT;
+    units -= piece;
+  }
+}
+
+void File::loadPageMap() {
+  const FileHeader& header = header_->header;
+  if (!header.compressed) {
+    return;
+  }
+  std::unique_ptr<PageMap> map(new PageMap());
+  map->free.resize(PAGE_UNITS + 1);
+  map->extents.resize(header.page_map_pages);
+  map->dirty = false;
+  std::vector<Extent> used;
+  if (header.page_map_offset != 0 && !map->extents.empty()) {
+    const std::size_t bytes = map->extents.size() * sizeof(Extent);
+    struct iovec buffer = {&map->extents[0], bytes};
+    readAt(header.page_map_offset, &buffer, 1);
+    const Extent extent = {header.page_map_offset, unitsFor(bytes)};
+    used.push_back(extent);
+  }
+  for (std::size_t i = 0; i < map->extents.size(); ++i) {
+    if (map->extents[i].offset != 0) {
+      used.push_back(map->extents[i]);
+    }
+  }
+  // the gaps between the extents in use are free; the first unit holds the
+  // file header
+  std::sort(used.begin(), used.end(),
+            [](const Extent& a, const Extent& b) { return a.offset < b.offset; });
+  std::uint64_t position = COMPRESSED_UNIT;
+  for (std::size_t i = 0; i < used.size(); ++i) {
+    if (used[i].offset > position) {
+      map->release(position, (used[i].offset - position) / COMPRESSED_UNIT);
+    }
+    position = std::max(position, used[i].offset + used[i].units * COMPRESSED_UNIT);
+  }
+  map->end = position;
+  header_->page_map.reset(map.release());
+}
+
+void File::writePageMap() const {
+  PageMap& map = *header_->page_map;
+  FileHeader& header = header_->header;
+  if (header.page_map_offset != 0) {
+    const Extent old = {header.page_map_offset,
+                        unitsFor(header.page_map_pages * sizeof(Extent))};
+    map.retired.push_back(old);
+  }
+  std::uint64_t offset = 0;
+  if (!map.extents.empty()) {
+    const std::uint64_t units = unitsFor(map.extents.size() * sizeof(Extent));
+    // written in whole units, so that reads of a stream never run past the
+    // end of the file
+    std::vector<char> bytes(units * COMPRESSED_UNIT, 0);
+    memcpy(&bytes[0], &map.extents[0], map.extents.size() * sizeof(Extent));
+    offset = map.allocate(units);
+    struct iovec buffer = {&bytes[0], bytes.size()};
+    writeAt(offset, &buffer, 1);
+  }
+  header.page_map_offset = offset;
+  header.page_map_pages = map.extents.size();
+  header_->dirty = true;
+  map.dirty = false;
+}
+
+void File::readCompressed(const PageId page_number, Page& page) const {
+  Extent extent = {0, 0};
+  {
+    std::lock_guard<std::mutex> guard(header_->latch);
+    const PageMap& map = *header_->page_map;
+    if (page_number != Page::INVALID_NUMBER &&
+        page_number <= map.extents.size()) {
+      extent = map.extents[page_number - 1];
+    }
+  }
+  char* bytes = reinterpret_cast<char*>(&page);
+  if (extent.offset == 0) {
+    memset(bytes, 0, Page::SIZE);
+    return;
+  }
+  char stored[PAGE_UNITS * COMPRESSED_UNIT];
+  struct iovec buffer = {stored, extent.units * COMPRESSED_UNIT};
+  readAt(extent.offset, &buffer, 1);
+  std::uint16_t length;
+  memcpy(&length, stored, sizeof(length));
+  if (length == Page::SIZE) {
+    memcpy(bytes, stored + sizeof(length), Page::SIZE);
+  } else if (sizeof(length) + length > extent.units * COMPRESSED_UNIT ||
+             !uncompressPage(stored + sizeof(length), length, bytes)) {
+    // torn; the checksum of the page tells
+    memset(bytes, 0, Page::SIZE);
+  }
+}
+
+void File::writeCompressed(const PageId page_number, const Page& page) {
+  char stored[PAGE_UNITS * COMPRESSED_UNIT];
+  const std::uint16_t length = compressPage(
+      reinterpret_cast<const char*>(&page), stored + sizeof(length));
+  memcpy(stored, &length, sizeof(length));
+  const std::uint64_t units = unitsFor(sizeof(length) + length);
+  memset(stored + sizeof(length) + length, 0,
+         units * COMPRESSED_UNIT - sizeof(length) - length);
+  Extent extent;
+  {
+    std::lock_guard<std::mutex> guard(header_->latch);
+    PageMap& map = *header_->page_map;
+    if (map.extents.size() < page_number) {
+      const Extent none = {0, 0};
+      map.extents.resize(page_number, none);
+      map.dirty = true;
+    }
+    Extent& place = map.extents[page_number - 1];
+    if (place.offset == 0 || place.units < units) {
+      // moved; the old place is named by the map on disk until the next
+      // checkpoint
+      if (place.offset != 0) {
+        map.retired.push_back(place);
+      }
+      place.offset = map.allocate(units);
+      place.units = units;
+      map.dirty = true;
+    }
+    extent = place;
+  }
+  struct iovec buffer = {stored, units * COMPRESSED_UNIT};
+  writeAt(extent.offset, &buffer, 1);
 }
 
 
@@ -136,12 +703,32 @@ PageFile PageFile::create(const std::string& filename) {
   return PageFile(filename, true /* create_new */);
 }
 
+PageFile PageFile::create(const std::string& filename,
+                          const std::vector<std::uint16_t>& column_widths) {
+  // the widths are checked before the file is created
+  std::size_t record_size = 0;
+  for (std::size_t c = 0; c < column_widths.size(); ++c) {
+    record_size += column_widths[c];
+  }
+  if (!column_widths.empty() &&
+      Page::columnarCapacity(&column_widths[0], column_widths.size()) == 0) {
+    throw InsufficientSpaceException(Page::INVALID_NUMBER, record_size,
+                                     Page::DATA_SIZE);
+  }
+  PageFile file(filename, true /* create_new */);
+  FileHeader header = file.readHeader();
+  header.num_columns = column_widths.size();
+  std::copy(column_widths.begin(), column_widths.end(), header.column_widths);
+  file.writeHeader(header);
+  return file;
+}
+
 PageFile PageFile::open(const std::string& filename) {
   return PageFile(filename, false /* create_new */);
 }
 
 PageFile::PageFile(const std::string& name, const bool create_new)
-: File(name, create_new)
+: File(name, create_new, CHECKSUM_HEADER, false /* compressible */)
 {
 }
 
@@ -149,7 +736,8 @@ PageFile::~PageFile() {
 }
 
 PageFile::PageFile(const PageFile& other)
-: File(other.filename_, false /* create_new */)
+: File(other.filename_, false /* create_new */, CHECKSUM_HEADER,
+       false /* compressible */)
 {
 }
 
@@ -165,80 +753,45 @@ PageFile& PageFile::operator=(const PageFile& rhs) {
 Page PageFile::allocatePage(PageId &new_page_number) {
   FileHeader header = readHeader();
   Page new_page;
-  Page existing_page;
   if (header.num_free_pages > 0) {
     new_page = readPage(header.first_free_page, true /* allow_free */);
     new_page.set_page_number(header.first_free_page);
-		new_page_number = new_page.page_number();
     header.first_free_page = new_page.next_page_number();
     --header.num_free_pages;
 
-    if (header.first_used_page == Page::INVALID_NUMBER ||
-        header.first_used_page > new_page.page_number()) {
-      // Either have no pages used or the head of the used list is a page later
-      // than the one we just allocated, so add the new page to the head.
-      if (header.first_used_page > new_page.page_number()) {
-        new_page.set_next_page_number(header.first_used_page);
-      }
-      header.first_used_page = new_page.page_number();
-    } else {
-      // New page is reused from somewhere after the beginning, so we need to
-      // find where in the used list to insert it.
-      PageId next_page_number = Page::INVALID_NUMBER;
-      for (FileIterator iter = begin(); iter != end(); ++iter) {
-        next_page_number = (*iter).next_page_number();
-        if (next_page_number > new_page.page_number() ||
-            next_page_number == Page::INVALID_NUMBER) {
-          existing_page = *iter;
-          break;
-        }
-      }
-      existing_page.set_next_page_number(new_page.page_number());
-      new_page.set_next_page_number(next_page_number);
-    }
-
     assert((header.num_free_pages == 0) ==
            (header.first_free_page == Page::INVALID_NUMBER));
   }
 	else
 	{
     new_page.set_page_number(header.num_pages);
-		new_page_number = new_page.page_number();
-
-    if (header.first_used_page == Page::INVALID_NUMBER)
-		{
-      header.first_used_page = new_page.page_number();
-    }
-		else
-		{
-      // If we have pages allocated, we need to add the new page to the tail
-      // of the linked list.
-      for (FileIterator iter = begin(); iter != end(); ++iter) {
-        if ((*iter).next_page_number() == Page::INVALID_NUMBER) {
-          existing_page = *iter;
-          break;
-        }
-      }
-      assert(existing_page.isUsed());
-      existing_page.set_next_page_number(new_page.page_number());
-    }
     ++header.num_pages;
   }
-  writePage(new_page_number, new_page.header_, new_page);
-  if (existing_page.page_number() != Page::INVALID_NUMBER) {
-    // If we updated an existing page by inserting the new page into the
-    // used list, we need to write it out.
-    writePage(existing_page.page_number(), existing_page.header_, existing_page);
+	new_page_number = new_page.page_number();
+  if (header.num_columns > 0) {
+    new_page.initializeColumns(header.column_widths, header.num_columns);
   }
+
+  // Link the new page in at the tail of the used list.
+  new_page.set_prev_page_number(header.last_used_page);
+  new_page.set_next_page_number(Page::INVALID_NUMBER);
+  if (header.last_used_page == Page::INVALID_NUMBER) {
+    header.first_used_page = new_page_number;
+  } else {
+    PageHeader last_header = readPageHeader(header.last_used_page);
+    last_header.next_page_number = new_page_number;
+    writePageHeader(header.last_used_page, last_header);
+  }
+  header.last_used_page = new_page_number;
+
+  writePage(new_page_number, new_page.header_, new_page);
   writeHeader(header);
 
   return new_page;
 }
 
 Page PageFile::readPage(const PageId page_number) const {
-  FileHeader header = readHeader();
-
-	if (page_number >= header.num_pages)
+	if (page_number >= numPages())
 	{
 		throw InvalidPageException(page_number, filename_);
 	}
@@ -247,9 +800,9 @@ Page PageFile::readPage(const PageId page_number) const {
 
 Page PageFile::readPage(const PageId page_number, const bool allow_free) const {
   Page page;
-  stream_->seekg(pagePosition(page_number), std::ios::beg);
-  stream_->read(reinterpret_cast<char*>(&page.header_), sizeof(PageHeader));
-  stream_->read(reinterpret_cast<char*>(&page.data_[0]), Page::DATA_SIZE);
+  struct iovec buffers[2] = {{&page.header_, sizeof(PageHeader)},
+                             {&page.data_[0], Page::DATA_SIZE}};
+  readAt(pagePosition(page_number), buffers, 2);
   if (!allow_free && !page.isUsed()) {
     throw InvalidPageException(page_number, filename_);
   }
@@ -264,49 +817,78 @@ void PageFile::writePage(const PageId new_page_number, const Page& new_page) {
 		// Page has been deleted since it was read.
 		throw InvalidPageException(new_page_number, filename_);
 	}
-	// Page on disk may have had its next page pointer updated since it was read;
-	// we don't modify that, but we do keep all the other modifications to the
-	// page header.
+	// Page on disk may have had its next and previous page pointers updated
+	// since it was read; we don't modify those, but we do keep all the other
+	// modifications to the page header.
 	const PageId next_page_number = header.next_page_number;
+	const PageId prev_page_number = header.prev_page_number;
 	header = new_page.header_;
 	header.next_page_number = next_page_number;
+	header.prev_page_number = prev_page_number;
 	writePage(new_page_number, header, new_page);
 }
 
+void PageFile::writePages(const PageId first_page_number,
+                          const Page* const* pages, const std::size_t count) {
+  // As in writePage(), the page pointers on disk are kept. The headers
+  // are read first, so that the pages are then written in one go.
+  std::vector<PageHeader> headers(count);
+  for (std::size_t i = 0; i < count; ++i) {
+    headers[i] = readPageHeader(first_page_number + i);
+    if (headers[i].current_page_number == Page::INVALID_NUMBER) {
+      throw InvalidPageException(first_page_number + i, filename_);
+    }
+    const PageId next_page_number = headers[i].next_page_number;
+    const PageId prev_page_number = headers[i].prev_page_number;
+    headers[i] = pages[i]->header_;
+    headers[i].next_page_number = next_page_number;
+    headers[i].prev_page_number = prev_page_number;
+    headers[i].checksum = checksum_ == CHECKSUM_HEADER
+        ? headerChecksum(headers[i], &pages[i]->data_[0]) : 0;
+  }
+  std::vector<struct iovec> buffers(2 * count);
+  for (std::size_t i = 0; i < count; ++i) {
+    buffers[2 * i].iov_base = &headers[i];
+    buffers[2 * i].iov_len = sizeof(PageHeader);
+    buffers[2 * i + 1].iov_base = const_cast<char*>(&pages[i]->data_[0]);
+    buffers[2 * i + 1].iov_len = Page::DATA_SIZE;
+  }
+  writeAt(pagePosition(first_page_number), &buffers[0], buffers.size());
+}
+
 void PageFile::deletePage(const PageId page_number) {
   FileHeader header = readHeader();
 
   Page existing_page = readPage(page_number);
-  Page previous_page;
-  // If this page is the head of the used list, update the header to point to
-  // the next page in line.
-  if (page_number == header.first_used_page) {
-    header.first_used_page = existing_page.next_page_number();
+  const PageId prev_page_number = existing_page.prev_page_number();
+  const PageId next_page_number = existing_page.next_page_number();
+  // Unlink the page from its neighbours in the used list, or from the ends of
+  // the list kept in the header.
+  if (prev_page_number == Page::INVALID_NUMBER) {
+    header.first_used_page = next_page_number;
   } else {
-    // Walk the used list so we can update the page that points to this one.
-    for (FileIterator iter = begin(); iter != end(); ++iter) {
-      previous_page = *iter;
-      if (previous_page.next_page_number() == existing_page.page_number()) {
-        previous_page.set_next_page_number(existing_page.next_page_number());
-        break;
-      }
-    }
+    PageHeader prev_header = readPageHeader(prev_page_number);
+    prev_header.next_page_number = next_page_number;
+    writePageHeader(prev_page_number, prev_header);
+  }
+  if (next_page_number == Page::INVALID_NUMBER) {
+    header.last_used_page = prev_page_number;
+  } else {
+    PageHeader next_header = readPageHeader(next_page_number);
+    next_header.prev_page_number = prev_page_number;
+    writePageHeader(next_page_number, next_header);
   }
   // Clear the page and add it to the head of the free list.
   existing_page.initialize();
   existing_page.set_next_page_number(header.first_free_page);
   header.first_free_page = page_number;
   ++header.num_free_pages;
-  if (previous_page.isUsed()) {
-    writePage(previous_page.page_number(), previous_page.header_, previous_page);
-  }
   writePage(page_number, existing_page.header_, existing_page);
   writeHeader(header);
 }
 
 FileIterator PageFile::begin() {
-  const FileHeader& header = readHeader();
-  return FileIterator(this, header.first_used_page);
+  return FileIterator(this, getFirstPageNo());
 }
 
 FileIterator PageFile::end() {
@@ -315,20 +897,28 @@ FileIterator PageFile::end() {
 
 void PageFile::writePage(const PageId page_number, const PageHeader& header,
                      const Page& new_page) {
-  stream_->seekp(pagePosition(page_number), std::ios::beg);
-  stream_->write(reinterpret_cast<const char*>(&header), sizeof(PageHeader));
-  stream_->write(reinterpret_cast<const char*>(&new_page.data_[0]),
-                 Page::DATA_SIZE);
-  stream_->flush();
+  PageHeader sealed = header;
+  sealed.checksum = checksum_ == CHECKSUM_HEADER
+      ? headerChecksum(sealed, &new_page.data_[0]) : 0;
+  struct iovec buffers[2] = {
+      {&sealed, sizeof(PageHeader)},
+      {const_cast<char*>(&new_page.data_[0]), Page::DATA_SIZE}};
+  writeAt(pagePosition(page_number), buffers, 2);
 }
 
 PageHeader PageFile::readPageHeader(PageId page_number) const {
   PageHeader header;
-  stream_->seekg(pagePosition(page_number), std::ios::beg);
-  stream_->read(reinterpret_cast<char*>(&header), sizeof(PageHeader));
+  struct iovec buffer = {&header, sizeof(PageHeader)};
+  readAt(pagePosition(page_number), &buffer, 1);
   return header;
 }
 
+void PageFile::writePageHeader(const PageId page_number,
+                               const PageHeader& header) {
+  struct iovec buffer = {const_cast<PageHeader*>(&header), sizeof(PageHeader)};
+  writeAt(pagePosition(page_number), &buffer, 1);
+}
+
 
 
 
@@ -341,20 +931,23 @@ BlobFile BlobFile::open(const std::string& filename) {
 }
 
 BlobFile::BlobFile(const std::string& name, const bool create_new)
-: File(name, create_new) {
+: File(name, create_new, CHECKSUM_TRAILER, true /* compressible */), mapping_(NULL), mapping_size_(0) {
 }
 
 BlobFile::~BlobFile() {
+  unmap();
 }
 
 BlobFile::BlobFile(const BlobFile& other)
-: File(other.filename_, false /* create_new */)
+: File(other.filename_, false /* create_new */, CHECKSUM_TRAILER,
+       true /* compressible */), mapping_(NULL), mapping_size_(0)
 {
 }
 
 BlobFile& BlobFile::operator=(const BlobFile& rhs) {
   // This accounts for self-assignment and assignment of a File object for the
   // same file.
+  unmap();
   close();	//close my file and associate me with the new one
   filename_ = rhs.filename_;
   openIfNeeded(false /* create_new */);
@@ -381,15 +974,46 @@ Page BlobFile::allocatePage(PageId &new_page_number) {
 
 Page BlobFile::readPage(const PageId page_number) const {
 	Page page;
-	stream_->seekg(pagePosition(page_number), std::ios::beg);
-	stream_->read(reinterpret_cast<char*>(&page), Page::SIZE);
+	if (compressed()) {
+		readCompressed(page_number, page);
+		return page;
+	}
+	struct iovec buffer = {&page, Page::SIZE};
+	readAt(pagePosition(page_number), &buffer, 1);
 	return page;
 }
 
 void BlobFile::writePage(const PageId new_page_number, const Page& new_page) {
-	stream_->seekp(pagePosition(new_page_number), std::ios::beg);
-	stream_->write(reinterpret_cast<const char*>(&new_page), Page::SIZE);
-	stream_->flush();
+	const Page* const pages[1] = {&new_page};
+	writePages(new_page_number, pages, 1);
+}
+
+void BlobFile::writePages(const PageId first_page_number,
+                          const Page* const* pages, const std::size_t count) {
+	// the trailers are written from here rather than from the pages, which
+	// are left as they are
+	if (compressed()) {
+		for (std::size_t i = 0; i < count; ++i) {
+			Page sealed = *pages[i];
+			char* bytes = reinterpret_cast<char*>(&sealed);
+			const std::uint32_t trailer =
+					checksum_ == CHECKSUM_TRAILER ? trailerChecksum(bytes) : 0;
+			memcpy(bytes + Page::BLOB_SIZE, &trailer, sizeof(trailer));
+			writeCompressed(first_page_number + i, sealed);
+		}
+		return;
+	}
+	std::vector<std::uint32_t> trailers(count);
+	std::vector<struct iovec> buffers(2 * count);
+	for (std::size_t i = 0; i < count; ++i) {
+		const char* bytes = reinterpret_cast<const char*>(pages[i]);
+		trailers[i] = checksum_ == CHECKSUM_TRAILER ? trailerChecksum(bytes) : 0;
+		buffers[2 * i].iov_base = const_cast<char*>(bytes);
+		buffers[2 * i].iov_len = Page::BLOB_SIZE;
+		buffers[2 * i + 1].iov_base = &trailers[i];
+		buffers[2 * i + 1].iov_len = Page::TRAILER_SIZE;
+	}
+	writeAt(pagePosition(first_page_number), &buffers[0], buffers.size());
 }
 
 //delePage should not be called for a blob_file, not supported
@@ -397,4 +1021,55 @@ void BlobFile::deletePage(const PageId page_number) {
 	throw InvalidPageException(page_number, filename_);
 }
 
+bool BlobFile::map() {
+  unmap();
+  // compressed pages have no place of their own to map
+  if (compressed()) {
+    return false;
+  }
+  // pages still in the stream buffer would be missing from the mapping
+  if (stream_) {
+    stream_->flush();
+  }
+  const int fd = ::open(filename_.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+  // only whole pages that are on disk are mapped, reading past the end of the
+  // file through a mapping faults
+  struct stat status;
+  std::size_t size = 0;
+  if (::fstat(fd, &status) == 0) {
+    size = std::min<std::size_t>(status.st_size, pagePosition(numPages()));
+  }
+  void* mapping = MAP_FAILED;
+  if (size > 0) {
+    mapping = ::mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+  }
+  // the mapping stays valid once the descriptor is closed
+  ::close(fd);
+  if (mapping == MAP_FAILED) {
+    return false;
+  }
+  mapping_ = static_cast<const char*>(mapping);
+  mapping_size_ = size;
+  return true;
+}
+
+const Page* BlobFile::mappedPage(const PageId page_number) const {
+  if (mapping_ == NULL || page_number == Page::INVALID_NUMBER ||
+      (std::size_t)pagePosition(page_number) + Page::SIZE > mapping_size_) {
+    return NULL;
+  }
+  return reinterpret_cast<const Page*>(mapping_ + pagePosition(page_number));
+}
+
+void BlobFile::unmap() {
+  if (mapping_ != NULL) {
+    ::munmap(const_cast<char*>(mapping_), mapping_size_);
+    mapping_ = NULL;
+    mapping_size_ = 0;
+  }
+}
+
 }
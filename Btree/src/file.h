@@ -7,10 +7,15 @@
 
 #pragma once
 
+#include <algorithm>
 #include <fstream>
 #include <string>
-#include <map>
 #include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include <sys/types.h>
+#include <sys/uio.h>
 
 #include "page.h"
 
@@ -18,6 +23,26 @@ namespace badgerdb {
 
 class FileIterator;
 
+/**
+ * @brief Where the pages of a file keep their checksum, if they do.
+ */
+enum PageChecksum {
+  /**
+   * Pages have no checksum.
+   */
+  CHECKSUM_NONE,
+
+  /**
+   * In PageHeader::checksum, for the pages of a PageFile.
+   */
+  CHECKSUM_HEADER,
+
+  /**
+   * In the last Page::TRAILER_SIZE bytes, for the pages of a BlobFile.
+   */
+  CHECKSUM_TRAILER
+};
+
 /**
  * @brief Header metadata for files on disk which contain pages.
  */
@@ -32,6 +57,11 @@ struct FileHeader {
    */
   PageId first_used_page;
 
+  /**
+   * Page number of the last used page in the file, where new pages are linked in.
+   */
+  PageId last_used_page;
+
   /**
    * Number of free pages (allocated but unused) in the file.
    */
@@ -42,6 +72,39 @@ struct FileHeader {
    */
   PageId first_free_page;
 
+  /**
+   * Where the pages of the file keep their checksum, a PageChecksum chosen
+   * when the file is created.
+   */
+  std::uint32_t page_checksum;
+
+  /**
+   * Non-zero if the pages of the file are stored compressed, each in as many
+   * File::COMPRESSED_UNIT byte units as it takes, where the page map says.
+   */
+  std::uint32_t compressed;
+
+  /**
+   * Number of entries of the page map of a compressed file.
+   */
+  std::uint32_t page_map_pages;
+
+  /**
+   * Position of the page map of a compressed file, 0 if none was written.
+   */
+  std::uint64_t page_map_offset;
+
+  /**
+   * Number of columns of the records of a PageFile whose pages are columnar,
+   * 0 for a file of slotted pages.
+   */
+  std::uint32_t num_columns;
+
+  /**
+   * Width in bytes of each column of the records of a columnar PageFile.
+   */
+  std::uint16_t column_widths[Page::MAX_COLUMNS];
+
   /**
    * Returns true if this file header is equal to the other.
    *
@@ -52,10 +115,56 @@ struct FileHeader {
     return num_pages == rhs.num_pages &&
         num_free_pages == rhs.num_free_pages &&
         first_used_page == rhs.first_used_page &&
-        first_free_page == rhs.first_free_page;
+        last_used_page == rhs.last_used_page &&
+        first_free_page == rhs.first_free_page &&
+        page_checksum == rhs.page_checksum &&
+        compressed == rhs.compressed &&
+        page_map_pages == rhs.page_map_pages &&
+        page_map_offset == rhs.page_map_offset &&
+        num_columns == rhs.num_columns &&
+        std::equal(column_widths, column_widths + num_columns,
+                   rhs.column_widths);
   }
 };
 
+/**
+ * @brief How far File::checkpoint() gets the pages written to a file.
+ */
+enum Durability {
+  /**
+   * Writes stay in the stream buffer until it is full or the file is closed.
+   */
+  DURABILITY_NONE,
+
+  /**
+   * checkpoint() writes the stream buffer to the operating system.
+   */
+  DURABILITY_CHECKPOINT,
+
+  /**
+   * checkpoint() also waits until the operating system has written the file
+   * to disk.
+   */
+  DURABILITY_SYNC
+};
+
+/**
+ * @brief How files read and write their pages.
+ */
+enum IoBackend {
+  /**
+   * Through a std::fstream shared by all File objects of a file, seeking
+   * before every read and write.
+   */
+  IO_STREAM,
+
+  /**
+   * Through a file descriptor with positional reads and writes, which keep no
+   * file position, so that several threads can read pages of a file at once.
+   */
+  IO_POSITIONAL
+};
+
 /**
  * @brief Class which represents a file in the filesystem containing database
  *        pages.
@@ -65,8 +174,31 @@ struct FileHeader {
  * deleted pages if possible).  If multiple File objects refer to the same
  * underlying file, they will share the stream in memory.
  * If a file that has already been opened (possibly by another query), then the File class
- * detects this (by looking in the open_streams_ map) and just returns a file object with
- * the already created stream for the file without actually opening the UNIX file again. 
+ * detects this (by looking in the open_files_ table) and just returns a file object with
+ * the already created stream for the file without actually opening the UNIX file again.
+ * Open files are told apart by their device and inode numbers, so a file opened by
+ * two names that lead to it is still opened once. 
+ *
+ * Writes are not flushed one by one: the file header is kept in memory and
+ * only written out, with the buffered pages, by checkpoint() and when the last
+ * File object of the file is closed. How far checkpoint() goes is set for all
+ * files with setDurability().
+ *
+ * Files opened while no File object of them exists use the I/O backend set
+ * with setIoBackend().
+ *
+ * Files created while setPageChecksums() is on keep a CRC32C of every page,
+ * computed as the page is written. BufMgr checks it with verifyPage() when it
+ * reads the page, which tells pages torn by a crash in the middle of a write.
+ *
+ * BlobFiles created while setPageCompression() is on store their pages
+ * compressed, in as many units of COMPRESSED_UNIT bytes as each takes. A page
+ * map in memory tells where each page lies; it is written to the file by
+ * checkpoint(), before the header naming it. A page that no longer fits where
+ * it was is written elsewhere, and its old place is only reused once the map
+ * on disk stops naming it, so that the file as of the last checkpoint stays
+ * whole. Pages are read whole into memory, so that readers never see the
+ * compressed form.
  *
  * @warning This class is not threadsafe.
  */
@@ -80,12 +212,17 @@ class File {
    *
    * @param name        Name of file.
    * @param create_new  Whether to create a new file.
+   * @param checksum    Where the pages of a new file keep their checksum, if
+   *                    page checksums are on.
+   * @param compressible  Whether the pages of a new file are stored
+   *                    compressed, if page compression is on.
    * @throws  FileExistsException     If the underlying file exists and
    *                                  create_new is true.
    * @throws  FileNotFoundException   If the underlying file doesn't exist and
    *                                  create_new is false.
    */
-  File(const std::string& name, const bool create_new);
+  File(const std::string& name, const bool create_new,
+       const PageChecksum checksum, const bool compressible);
 
   /**
    * Deletes an existing file.
@@ -105,12 +242,69 @@ class File {
 
 
   /**
-   * Returns true if the file exists and is open.
+   * Returns true if the file exists.
    *
    * @param filename  Name of the file.
    */
   static bool exists(const std::string& filename);
 
+  /**
+   * Sets what checkpoint() does for all files. The default is
+   * DURABILITY_CHECKPOINT.
+   *
+   * @param durability  Durability mode.
+   */
+  static void setDurability(const Durability durability);
+
+  /**
+   * Returns the durability mode set with setDurability().
+   */
+  static Durability durability() { return durability_; }
+
+  /**
+   * Sets the I/O backend of the files opened from now on. Files already open
+   * keep theirs. The default is IO_STREAM.
+   *
+   * @param backend  I/O backend.
+   */
+  static void setIoBackend(const IoBackend backend);
+
+  /**
+   * Returns the I/O backend set with setIoBackend().
+   */
+  static IoBackend ioBackend() { return io_backend_; }
+
+  /**
+   * Sets whether files created from now on keep page checksums. Files already
+   * created keep their choice. The default is on.
+   *
+   * @param enabled  True to keep checksums.
+   */
+  static void setPageChecksums(const bool enabled);
+
+  /**
+   * Returns what was set with setPageChecksums().
+   */
+  static bool pageChecksums() { return page_checksums_; }
+
+  /**
+   * Sets whether BlobFiles created from now on store their pages compressed.
+   * Files already created keep their choice. The default is off.
+   *
+   * @param enabled  True to compress pages.
+   */
+  static void setPageCompression(const bool enabled);
+
+  /**
+   * Returns what was set with setPageCompression().
+   */
+  static bool pageCompression() { return page_compression_; }
+
+  /**
+   * Size of the units the space of a compressed file is handed out in.
+   */
+  static const std::size_t COMPRESSED_UNIT = 512;
+
   /**
    * Destructor that automatically closes the underlying file if no other
    * File objects are using it.
@@ -143,6 +337,18 @@ class File {
    */
   virtual void writePage(const PageId page_number, const Page& new_page) = 0;
 
+  /**
+   * Writes pages with consecutive page numbers into the file, with one seek and
+   * one flush of the stream for all of them.
+   * No bounds checking is performed.
+   *
+   * @param first_page_number Number of the first page whose contents to replace.
+   * @param pages       Pages to write, for first_page_number onwards.
+   * @param count       Number of pages to write.
+   */
+  virtual void writePages(const PageId first_page_number,
+                          const Page* const* pages, const std::size_t count);
+
   /**
    * Deletes a page from the file.
    *
@@ -150,6 +356,38 @@ class File {
    */
   virtual void deletePage(const PageId page_number) = 0;
 
+  /**
+   * Checks the checksum of a page read from the file. Pages of files without
+   * checksums always pass.
+   *
+   * @param page  Page as read by readPage().
+   * @return  False if the page is not as it was written.
+   */
+  bool verifyPage(const Page& page) const;
+
+  /**
+   * Returns where the pages of the file keep their checksum.
+   */
+  PageChecksum pageChecksum() const { return checksum_; }
+
+  /**
+   * Returns true if the pages of the file are stored compressed.
+   */
+  bool compressed() const { return header_->page_map != NULL; }
+
+  /**
+   * Writes the file header if it changed, and gets the pages written so far
+   * as far as the durability mode asks for.
+   */
+  void checkpoint() const;
+
+  /**
+   * Returns true if pages of the file may be read by several threads at once,
+   * while no other thread allocates, writes or deletes pages of it. That is the
+   * case for files opened with IO_POSITIONAL.
+   */
+  bool concurrentReads() const { return fd_ >= 0; }
+
   /**
    * Returns the name of the file this object represents.
    *
@@ -164,6 +402,14 @@ class File {
    */
 	PageId getFirstPageNo();
 
+  /**
+   * Returns the number of pages allocated in the file, used and free.  Page
+   * numbers run from 1 up to, but excluding, this number.
+   *
+   * @return  Number of pages allocated in the file.
+   */
+  PageId numPages() const;
+
  protected:
   /**
    * Returns the position of the page with the given number in the file (as an
@@ -176,6 +422,118 @@ class File {
     return sizeof(FileHeader) + ((page_number - 1) * Page::SIZE);
   }
 
+  /**
+   * Returns the checksum of a page of a PageFile with the given header and
+   * data, which is never 0.
+   */
+  static std::uint32_t headerChecksum(const PageHeader& header,
+                                      const char* data);
+
+  /**
+   * Returns the checksum of the bytes of a page of a BlobFile before its
+   * trailer, which is never 0.
+   */
+  static std::uint32_t trailerChecksum(const char* page);
+
+  /**
+   * Sets the checksum of a page as it lies on disk, for files with the given
+   * kind of checksum.
+   *
+   * @param checksum  Where the page keeps its checksum.
+   * @param image     Page::SIZE bytes of the page.
+   */
+  static void sealImage(const PageChecksum checksum, char* image);
+
+  /**
+   * Place of a page in a compressed file.
+   */
+  struct Extent {
+    /**
+     * Position of the first unit, 0 for a page never written.
+     */
+    std::uint64_t offset;
+
+    /**
+     * Number of units.
+     */
+    std::uint64_t units;
+  };
+
+  /**
+   * Where the pages of a compressed file lie and which space is free, kept
+   * for all File objects of the file. Used under the latch of the header.
+   */
+  struct PageMap {
+    /**
+     * Place of each page, by page number less one.
+     */
+    std::vector<Extent> extents;
+
+    /**
+     * Positions of free extents, by their number of units.
+     */
+    std::vector<std::vector<std::uint64_t> > free;
+
+    /**
+     * Extents given up since the last checkpoint, which the page map on disk
+     * may still name.
+     */
+    std::vector<Extent> retired;
+
+    /**
+     * End of the space handed out so far.
+     */
+    std::uint64_t end;
+
+    /**
+     * True if extents changed since the map was last written.
+     */
+    bool dirty;
+
+    /**
+     * Hands out an extent of the given number of units.
+     */
+    std::uint64_t allocate(const std::uint64_t units);
+
+    /**
+     * Takes back an extent, in pieces of at most the units of a page.
+     */
+    void release(std::uint64_t offset, std::uint64_t units);
+  };
+
+  /**
+   * Reads the page map of a compressed file and works out its free space.
+   */
+  void loadPageMap();
+
+  /**
+   * Writes the page map of a compressed file if it changed, and names it in
+   * the header in memory. Called under the latch of the header.
+   */
+  void writePageMap() const;
+
+  /**
+   * Reads a page of a compressed file and uncompresses it.
+   *
+   * @param page_number   Number of page.
+   * @param page          Page to fill.
+   */
+  void readCompressed(const PageId page_number, Page& page) const;
+
+  /**
+   * Compresses a page of a compressed file and writes it, in its place if it
+   * fits there.
+   *
+   * @param page_number   Number of page.
+   * @param page          Page to write.
+   */
+  void writeCompressed(const PageId page_number, const Page& page);
+
+  /**
+   * Gets the bytes written so far to the disk.
+   */
+  void syncData() const;
+
   /**
    * Opens the underlying file named in filename_.
    * This method only opens the file if no other File objects exist that access
@@ -189,6 +547,28 @@ class File {
    */
   void openIfNeeded(const bool create_new);
 
+  /**
+   * Reads consecutive bytes of the file, from the given position on, into the
+   * buffers. Bytes past the end of the file are not read.
+   *
+   * @param position  Position in the file.
+   * @param buffers   Buffers to fill, in order.
+   * @param count     Number of buffers.
+   */
+  void readAt(const std::streampos position, const struct iovec* buffers,
+              const int count) const;
+
+  /**
+   * Writes the buffers to consecutive bytes of the file, from the given
+   * position on.
+   *
+   * @param position  Position in the file.
+   * @param buffers   Buffers to write, in order.
+   * @param count     Number of buffers.
+   */
+  void writeAt(const std::streampos position, const struct iovec* buffers,
+               const int count) const;
+
   /**
    * Closes the underlying file stream in <stream_>.
    * This method only closes the file if no other File objects exist that access
@@ -197,31 +577,119 @@ class File {
   void close();
 
   /**
-   * Reads the header for this file from disk.
+   * Returns the header for this file, as read from disk when the file was
+   * opened and changed since.
    *
    * @return  The file header.
    */
   FileHeader readHeader() const;
 
   /**
-   * Writes the given header to the disk as the header for this file.
+   * Sets the header for this file. It is written to disk by checkpoint().
    *
    * @param header  File header to write.
    */
   void writeHeader(const FileHeader& header);
 
-  typedef std::map<std::string, std::shared_ptr<std::fstream> > StreamMap;
-  typedef std::map<std::string, int> CountMap;
+  /**
+   * File header kept in memory for all File objects of a file.
+   */
+  struct CachedHeader {
+    FileHeader header;
+
+    /**
+     * True if the header changed since it was last written.
+     */
+    bool dirty;
+
+    /**
+     * Held while the header is read or changed, since reads of files with
+     * concurrentReads() are not serialised.
+     */
+    std::mutex latch;
+
+    /**
+     * Page map of a compressed file, NULL for other files.
+     */
+    std::unique_ptr<PageMap> page_map;
+  };
+
+  /**
+   * Identity of an underlying file that does not depend on the name it is
+   * opened by.
+   */
+  struct FileId {
+    dev_t device;
+    ino_t inode;
+
+    bool operator==(const FileId& rhs) const {
+      return device == rhs.device && inode == rhs.inode;
+    }
+  };
+
+  struct FileIdHash {
+    std::size_t operator()(const FileId& id) const {
+      return std::hash<std::uint64_t>()(
+          (std::uint64_t)id.inode * 0x9e3779b97f4a7c15ULL ^ id.device);
+    }
+  };
+
+  /**
+   * What all File objects of an open file share.
+   */
+  struct OpenFile {
+    /**
+     * Stream of the file, NULL for files opened with IO_POSITIONAL.
+     */
+    std::shared_ptr<std::fstream> stream;
+
+    std::shared_ptr<CachedHeader> header;
+
+    /**
+     * Descriptor of the file for files opened with IO_POSITIONAL, -1
+     * otherwise.
+     */
+    int fd;
+
+    /**
+     * Number of File objects of the file.
+     */
+    int count;
+  };
+
+  typedef std::unordered_map<FileId, OpenFile, FileIdHash> OpenFileMap;
+
+  /**
+   * Looks up the identity of the file with the given name.
+   *
+   * @return  False if there is no such file.
+   */
+  static bool lookUpId(const std::string& filename, FileId& id);
+
+  /**
+   * Durability mode of all files.
+   */
+  static Durability durability_;
+
+  /**
+   * I/O backend of files opened from now on.
+   */
+  static IoBackend io_backend_;
+
+  /**
+   * True if files created from now on keep page checksums.
+   */
+  static bool page_checksums_;
 
   /**
-   * Streams for opened files.
+   * True if BlobFiles created from now on store their pages compressed.
    */
-  static StreamMap open_streams_;
+  static bool page_compression_;
 
   /**
-   * Counts for opened files.
+   * Opened files, by identity.
    */
-  static CountMap open_counts_;
+  static OpenFileMap open_files_;
 
   /**
    * Name of the file this object represents.
@@ -229,11 +697,34 @@ class File {
   std::string filename_;
 
   /**
-   * Stream for underlying filesystem object.
+   * Identity of the file, valid while the object is open.
+   */
+  FileId id_;
+
+  /**
+   * Stream for underlying filesystem object, NULL for files opened with
+   * IO_POSITIONAL.
    */
   std::shared_ptr<std::fstream> stream_;
 
+  /**
+   * Descriptor of the underlying file for files opened with IO_POSITIONAL,
+   * -1 otherwise.
+   */
+  int fd_;
+
+  /**
+   * Header of the file, shared like the stream.
+   */
+  std::shared_ptr<CachedHeader> header_;
+
+  /**
+   * Where the pages of the file keep their checksum, as in its header.
+   */
+  PageChecksum checksum_;
+
   friend class FileIterator;
+  friend class WriteAheadLog;
 };
 
 class PageFile : public File {
@@ -247,12 +738,29 @@ class PageFile : public File {
    */
   static PageFile create(const std::string& filename);
 
+  /**
+   * Creates a new file whose pages are columnar: every record is as long as
+   * the sum of the column widths, and each column is stored apart on its
+   * page.  See Page.
+   *
+   * @param filename      Name of the file.
+   * @param column_widths Width in bytes of each column of the records, in the
+   *                      order the columns lie in the records.  No widths
+   *                      create a file of slotted pages.
+   * @throws  FileExistsException     If the requested file already exists.
+   * @throws  InsufficientSpaceException  If there are more than
+   *                                  Page::MAX_COLUMNS columns, a column is
+   *                                  empty, or a page cannot hold a record.
+   */
+  static PageFile create(const std::string& filename,
+                         const std::vector<std::uint16_t>& column_widths);
+
   /**
    * Opens the file named fileName and returns the corresponding File object.
 	 * It first checks if the file is already open. If so, then the new File object created uses the same input-output stream to read to or write fom
-	 * that already open file. Reference count (open_counts_ static variable inside the File object) is incremented whenever an already open file is
+	 * that already open file. Reference count (in the open_files_ static table of the File class) is incremented whenever an already open file is
 	 * opened again. Otherwise the UNIX file is actually opened. The fileName and the stream associated with this File object are inserted into the
-	 * open_streams_ map.
+	 * open_files_ table.
    *
    * @param filename  Name of the file.
    * @throws  FileNotFoundException   If the requested file doesn't exist.
@@ -294,7 +802,10 @@ class PageFile : public File {
   ~PageFile();
 
   /**
-   * Allocates a new page in the file.
+   * Allocates a new page in the file, reusing a deleted page if there is one.
+   * The page is linked in at the end of the list of used pages, so that
+   * iterating over the file visits pages in the order they were allocated.
+   * Pages of a file created with column widths come columnar.
    *
    * @return The new page.
    */
@@ -319,6 +830,17 @@ class PageFile : public File {
    */
   void writePage(const PageId page_number, const Page& new_page);
 
+  /**
+   * Writes pages with consecutive page numbers into the file, with one seek and
+   * one flush of the stream for all of them.
+   *
+   * @param first_page_number Number of the first page whose contents to replace.
+   * @param pages       Pages to write, for first_page_number onwards.
+   * @param count       Number of pages to write.
+   */
+  void writePages(const PageId first_page_number, const Page* const* pages,
+                  const std::size_t count);
+
   /**
    * Deletes a page from the file.
    *
@@ -379,6 +901,15 @@ class PageFile : public File {
    */
   PageHeader readPageHeader(const PageId page_number) const;
 
+  /**
+   * Writes only the header of the given page to disk, leaving its record data
+   * as it is.  No bounds checking is performed.
+   *
+   * @param page_number   Number of page whose header is to be written.
+   * @param header        Header to write.
+   */
+  void writePageHeader(const PageId page_number, const PageHeader& header);
+
   friend class FileIterator;
 };
 
@@ -396,9 +927,9 @@ class BlobFile : public File {
   /**
    * Opens the file named fileName and returns the corresponding File object.
 	 * It first checks if the file is already open. If so, then the new File object created uses the same input-output stream to read to or write fom
-	 * that already open file. Reference count (open_counts_ static variable inside the File object) is incremented whenever an already open file is
+	 * that already open file. Reference count (in the open_files_ static table of the File class) is incremented whenever an already open file is
 	 * opened again. Otherwise the UNIX file is actually opened. The fileName and the stream associated with this File object are inserted into the
-	 * open_streams_ map.
+	 * open_files_ table.
    *
    * @param filename  Name of the file.
    * @throws  FileNotFoundException   If the requested file doesn't exist.
@@ -459,7 +990,9 @@ class BlobFile : public File {
   Page readPage(const PageId page_number) const;
 
   /**
-   * Writes a page into the file at the given page number.
+   * Writes a page into the file at the given page number. Only the first
+   * Page::BLOB_SIZE bytes of the page are written; the trailer on disk gets
+   * their checksum.
    * No bounds checking is performed.
    *
    * @param page_number Number of page whose contents to replace.
@@ -467,12 +1000,60 @@ class BlobFile : public File {
    */
   void writePage(const PageId page_number, const Page& new_page);
 
+  /**
+   * Writes pages with consecutive page numbers into the file, with one seek and
+   * one flush of the stream for all of them, each as writePage() does.
+   *
+   * @param first_page_number Number of the first page whose contents to replace.
+   * @param pages       Pages to write, for first_page_number onwards.
+   * @param count       Number of pages to write.
+   */
+  void writePages(const PageId first_page_number, const Page* const* pages,
+                  const std::size_t count);
+
   /**
    * Deletes a page from the file.
    *
    * @param page_number   Number of page to delete.
    */
   void deletePage(const PageId page_number);
+
+  /**
+   * Maps the pages of the file into memory read-only, so that mappedPage()
+   * returns them in place rather than copying them out. The mapping shares the
+   * page cache of the operating system with every other process reading the
+   * file. Pages written to the file while it is mapped may or may not show in
+   * the mapping, so the file should not change meanwhile. Copies of this object
+   * do not share the mapping.
+   *
+   * @return  False if the file could not be mapped.
+   */
+  bool map();
+
+  /**
+   * Returns a page in the mapping made by map(). The page must not be written.
+   *
+   * @param page_number   Number of page.
+   * @return  The page, or NULL if the file is not mapped or the page lies past
+   *          the end of the mapping.
+   */
+  const Page* mappedPage(const PageId page_number) const;
+
+ private:
+  /**
+   * Removes the mapping made by map(), if any.
+   */
+  void unmap();
+
+  /**
+   * Start of the mapping made by map(), NULL if the file is not mapped.
+   */
+  const char* mapping_;
+
+  /**
+   * Size of the mapping in bytes.
+   */
+  std::size_t mapping_size_;
 };
 
 }
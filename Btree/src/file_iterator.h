@@ -18,7 +18,9 @@ namespace badgerdb {
  * @brief Iterator for iterating over the pages in a file.
  *
  * This class provides a forward-only iterator for iterating over all of the
- * pages in a file.
+ * pages in a file.  Advancing the iterator and page_number() only read page
+ * headers, so the page numbers of a file can be listed without reading the
+ * pages; only dereferencing reads a whole page.
  */
 class FileIterator {
  public:
@@ -39,8 +41,7 @@ class FileIterator {
   FileIterator(PageFile* file)
       : file_(file) {
     assert(file_ != NULL);
-    const FileHeader& header = file_->readHeader();
-    current_page_number_ = header.first_used_page;
+    current_page_number_ = file_->getFirstPageNo();
   }
 
   /**
@@ -85,15 +86,23 @@ class FileIterator {
    * @return    True if other iterator is equal to this one.
    */
 	inline bool operator==(const FileIterator& rhs) const {
-    return file_->filename() == rhs.file_->filename() &&
-        current_page_number_ == rhs.current_page_number_;
+    return current_page_number_ == rhs.current_page_number_ &&
+        (file_ == rhs.file_ || file_->filename() == rhs.file_->filename());
   }
 
 	inline bool operator!=(const FileIterator& rhs) const {
-    return (file_->filename() != rhs.file_->filename()) ||
-        (current_page_number_ != rhs.current_page_number_);
+    return !(*this == rhs);
   }
 
+  /**
+   * Returns the number of the page the iterator points to, without reading
+   * the page.
+   *
+   * @return  Page number, Page::INVALID_NUMBER at the end of the file.
+   */
+	inline PageId page_number() const
+  { return current_page_number_; }
+
   /**
    * Dereferences the iterator, returning a copy of the current page in the
    * file.
@@ -5,45 +5,217 @@
  * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
  */
 
+#include <algorithm>
+#include <climits>
+#include <thread>
 #include "filescan.h"
 #include "exceptions/end_of_file_exception.h"
+#include "exceptions/invalid_page_exception.h"
+#if defined(__AVX2__) || defined(__SSE4_1__)
+#include <immintrin.h>
+#endif
 
 namespace badgerdb { 
 
-FileScan::FileScan(const std::string &name, BufMgr *bufferMgr)
+namespace {
+
+/**
+ * Copy the given fields of a record of a columnar page to out, which has room for the whole record,
+ * leaving its other bytes '\0'. No fields copies the whole record.
+ */
+RecordView copyFields(const Page &page, const RecordId &rid, const std::vector<ScanField> &fields,
+    char *out, const std::size_t length)
+{
+  if (fields.empty())
+  {
+    page.copyField(rid, 0, length, out);
+  }
+  else
+  {
+    memset(out, '\0', length);
+    for (std::size_t i = 0; i < fields.size(); i++)
+    {
+      if (fields[i].offset < length)
+      {
+        page.copyField(rid, fields[i].offset, std::min(fields[i].length, length - fields[i].offset),
+            out + fields[i].offset);
+      }
+    }
+  }
+  const RecordView view = {out, length};
+  return view;
+}
+
+/**
+ * View of a record of a columnar page in which the given fields are filled, copied to buffer.
+ */
+RecordView copyFields(const Page &page, const RecordId &rid, const std::vector<ScanField> &fields,
+    std::string &buffer)
+{
+  buffer.resize(page.getRecordLength(rid));
+  return copyFields(page, rid, fields, &buffer[0], buffer.size());
+}
+
+}
+
+void ScanFilter::matchBatch(const Page &page, const RecordId *rids, const std::size_t count,
+    std::uint64_t *selection) const
+{
+  std::fill(selection, selection + (count + 63) / 64, 0);
+  std::vector<ScanField> read;
+  if (page.isColumnar() && !fields(read))
+  {
+    read.clear();
+  }
+  std::string copy;
+  for (std::size_t i = 0; i < count; i++)
+  {
+    const RecordView record = page.isColumnar() ? copyFields(page, rids[i], read, copy)
+      : page.getRecordView(rids[i]);
+    selection[i / 64] |= (std::uint64_t)matches(record) << (i % 64);
+  }
+}
+
+std::uint64_t gatherAttribute(const Page &page, const RecordId *rids, const std::size_t count,
+    const std::size_t attrByteOffset, const std::size_t attrLength, char *out)
+{
+  std::uint64_t present = 0;
+  if (page.isColumnar())
+  {
+    // records all have the same length; an attribute lying in one column is read off it directly
+    if (count == 0 || attrByteOffset + attrLength > page.getRecordLength(rids[0]))
+    {
+      memset(out, '\0', count * attrLength);
+      return 0;
+    }
+    for (std::size_t c = 0; c < page.numColumns(); c++)
+    {
+      const ColumnView column = page.getColumn(c);
+      if (attrByteOffset >= column.offset && attrByteOffset + attrLength <= column.offset + column.width)
+      {
+        const char *values = column.values + (attrByteOffset - column.offset);
+        for (std::size_t i = 0; i < count; i++)
+        {
+          memcpy(out + i * attrLength, values + (rids[i].slot_number - 1) * column.width, attrLength);
+        }
+        return count == 64 ? ~(std::uint64_t)0 : ((std::uint64_t)1 << count) - 1;
+      }
+    }
+    for (std::size_t i = 0; i < count; i++)
+    {
+      page.copyField(rids[i], attrByteOffset, attrLength, out + i * attrLength);
+    }
+    return count == 64 ? ~(std::uint64_t)0 : ((std::uint64_t)1 << count) - 1;
+  }
+
+  for (std::size_t i = 0; i < count; i++)
+  {
+    const RecordView record = page.getRecordView(rids[i]);
+    if (record.length >= attrByteOffset + attrLength)
+    {
+      memcpy(out + i * attrLength, record.data + attrByteOffset, attrLength);
+      present |= (std::uint64_t)1 << i;
+    }
+    else
+    {
+      memset(out + i * attrLength, '\0', attrLength);
+    }
+  }
+  return present;
+}
+
+std::uint64_t selectRange(const int *values, const std::size_t count, const int &lowVal, const Operator lowOp,
+    const int &highVal, const Operator highOp)
+{
+  // both bounds made exclusive, so that a value qualifies if low < value < high; a bound past the
+  // range of int drops out
+  const long long low = lowOp == GT ? lowVal : (lowOp == GTE ? (long long)lowVal - 1 : (long long)INT_MIN - 1);
+  const long long high = highOp == LT ? highVal : (highOp == LTE ? (long long)highVal + 1 : (long long)INT_MAX + 1);
+  const bool hasLow = low >= INT_MIN;
+  const bool hasHigh = high <= INT_MAX;
+  std::uint64_t selection = 0;
+  std::size_t i = 0;
+#if defined(__AVX2__)
+  const __m256i lowNeedle = _mm256_set1_epi32(hasLow ? (int)low : 0);
+  const __m256i highNeedle = _mm256_set1_epi32(hasHigh ? (int)high : 0);
+  for (; i + 8 <= count; i += 8)
+  {
+    const __m256i block = _mm256_loadu_si256((const __m256i *)(values + i));
+    __m256i keep = _mm256_set1_epi32(-1);
+    if (hasLow)
+      keep = _mm256_and_si256(keep, _mm256_cmpgt_epi32(block, lowNeedle));
+    if (hasHigh)
+      keep = _mm256_and_si256(keep, _mm256_cmpgt_epi32(highNeedle, block));
+    selection |= (std::uint64_t)_mm256_movemask_ps(_mm256_castsi256_ps(keep)) << i;
+  }
+#elif defined(__SSE4_1__)
+  const __m128i lowNeedle = _mm_set1_epi32(hasLow ? (int)low : 0);
+  const __m128i highNeedle = _mm_set1_epi32(hasHigh ? (int)high : 0);
+  for (; i + 4 <= count; i += 4)
+  {
+    const __m128i block = _mm_loadu_si128((const __m128i *)(values + i));
+    __m128i keep = _mm_set1_epi32(-1);
+    if (hasLow)
+      keep = _mm_and_si128(keep, _mm_cmpgt_epi32(block, lowNeedle));
+    if (hasHigh)
+      keep = _mm_and_si128(keep, _mm_cmpgt_epi32(highNeedle, block));
+    selection |= (std::uint64_t)_mm_movemask_ps(_mm_castsi128_ps(keep)) << i;
+  }
+#endif
+  for (; i < count; i++)
+  {
+    const bool keep = (!hasLow || values[i] > low) && (!hasHigh || values[i] < high);
+    selection |= (std::uint64_t)keep << i;
+  }
+  return selection;
+}
+
+FileScan::FileScan(const std::string &name, BufMgr *bufferMgr, const ScanFilter *scanFilter)
 {
   file = new PageFile(name, false);	//dont create new file
 	bufMgr = bufferMgr;
-	curDirtyFlag = false;
-  curPage = NULL;
+  pagesRead = 0;
+  filter = scanFilter;
+  projectionLength = 0;
+  viewRid.page_number = Page::INVALID_NUMBER;
+  if (filter != NULL && !filter->fields(filterFields))
+  {
+    filterFields.clear();
+  }
 	filePageIter = file->begin();
 }
 
 FileScan::~FileScan()
 {
   // generally must unpin last page of the scan
-  if (curPage != NULL)
-  {
-    bufMgr->unPinPage(file, (*filePageIter).page_number(), curDirtyFlag);
-    curPage = NULL;
-		curDirtyFlag = false;
-    filePageIter = file->begin();
-  }
+  curPage.release();
+  // also waits for the pages of the file being read ahead
   bufMgr->flushFile(file);
   delete file;
 }
 
 void FileScan::scanNext(RecordId& outRid)
 {
-  std::string rec;
+  // evaluate the filter on the pinned page, before anything is copied out of it
+  do
+  {
+    nextRecord();
+  } while (filter != NULL && !filter->matches(curPage->isColumnar()
+      ? copyFields(*curPage, pageRecordIter.getCurrentRecord(), filterFields, filterRecord)
+      : pageRecordIter.getRecordView()));
 
+	outRid = pageRecordIter.getCurrentRecord();
+}
+
+void FileScan::nextRecord()
+{
   if (filePageIter == file->end())
 	{
 		throw EndOfFileException();
 	}
 
   // special case of the first record of the first page of the file
-  if (curPage == NULL)
+  if (!curPage)
   {
     // need to get the first page of the file
 		filePageIter = file->begin();
@@ -53,18 +225,14 @@ void FileScan::scanNext(RecordId& outRid)
 		}
 	 
 		// read the first page of the file
-    bufMgr->readPage(file, (*filePageIter).page_number(), curPage); 
-		curDirtyFlag = false;
+    curPage = bufMgr->readPage(file, filePageIter.page_number(), ring); 
+		readAhead();
 
 		// get the first record off the page
     pageRecordIter = curPage->begin(); 
 
 		if(pageRecordIter != curPage->end()) 
 		{
-		  // get pointer to record
-		  rec = *pageRecordIter;
-
-			outRid = pageRecordIter.getCurrentRecord();
 			return;
 		}
   }
@@ -75,46 +243,277 @@ void FileScan::scanNext(RecordId& outRid)
 
   while (pageRecordIter == curPage->end())
   {
+    // follow the page chain through the buffered page, rather than reading the page header from the file
+    const PageId nextPageNo = curPage->next_page_number();
+
     // unpin the current page
-    bufMgr->unPinPage(file, (*filePageIter).page_number(), curDirtyFlag);
-    curPage = NULL;
-    curDirtyFlag = false;
+    curPage.release();
 
-    filePageIter++;
+    filePageIter = FileIterator(file, nextPageNo);
     if (filePageIter == file->end())
     {
-      curPage = NULL;
 			throw EndOfFileException();
     }
 
     // read the next page of the file
-    bufMgr->readPage(file, (*filePageIter).page_number(), curPage);
+    curPage = bufMgr->readPage(file, filePageIter.page_number(), ring);
+    readAhead();
 
     // get the first record off the page
     pageRecordIter = curPage->begin(); 
   }
 
   // curRec points at a valid record
-  // see if the record satisfies the scan's predicate 
-  // get a pointer to the record
-  rec = *pageRecordIter;
-
-	// return rid of the record
-	outRid = pageRecordIter.getCurrentRecord();
-	return;
 }
 
 // returns pointer to the current record.  page is left pinned
 // and the scan logic is required to unpin the page 
 std::string FileScan::getRecord()
 {
-  return *pageRecordIter;
+  if (projection.empty())
+  {
+    return *pageRecordIter;
+  }
+
+  // copy the projected fields straight off the page, or out of their columns
+  const RecordId rid = pageRecordIter.getCurrentRecord();
+  std::string projected(projectionLength, '\0');
+  std::size_t pos = 0;
+  for (std::size_t i = 0; i < projection.size(); i++)
+  {
+    curPage->copyField(rid, projection[i].offset, projection[i].length, &projected[pos]);
+    pos += projection[i].length;
+  }
+  return projected;
+}
+
+void FileScan::setProjection(const std::vector<ScanField> &fields)
+{
+  projection = fields;
+  projectionLength = 0;
+  for (std::size_t i = 0; i < projection.size(); i++)
+  {
+    projectionLength += projection[i].length;
+  }
+}
+
+void FileScan::setFields(const std::vector<ScanField> &fields)
+{
+  viewFields = fields;
+  viewRid.page_number = Page::INVALID_NUMBER;
+}
+
+RecordView FileScan::getRecordView()
+{
+  if (!curPage->isColumnar())
+  {
+    return pageRecordIter.getRecordView();
+  }
+  // the copy of the record is kept until the scan moves on
+  const RecordId rid = pageRecordIter.getCurrentRecord();
+  if (rid != viewRid)
+  {
+    copyFields(*curPage, rid, viewFields, viewRecord);
+    viewRid = rid;
+  }
+  const RecordView view = {viewRecord.data(), viewRecord.size()};
+  return view;
+}
+
+std::size_t FileScan::scanNextPage(std::vector<RecordId> &outRids)
+{
+  outRids.clear();
+  while (outRids.empty())
+  {
+    // the next record, then the ones after it on its page
+    nextRecord();
+    pageRids.clear();
+    for (PageIterator iter = pageRecordIter; iter != curPage->end(); iter++)
+    {
+      pageRids.push_back(iter.getCurrentRecord());
+    }
+    // the scan goes on from the last record of the page
+    pageRecordIter = PageIterator(curPage.get(), pageRids.back());
+
+    if (filter == NULL)
+    {
+      outRids.swap(pageRids);
+      continue;
+    }
+    selection.resize((pageRids.size() + 63) / 64);
+    filter->matchBatch(*curPage, &pageRids[0], pageRids.size(), &selection[0]);
+    for (std::size_t w = 0; w < selection.size(); w++)
+    {
+      for (std::uint64_t bits = selection[w]; bits != 0; bits &= bits - 1)
+      {
+        outRids.push_back(pageRids[w * 64 + __builtin_ctzll(bits)]);
+      }
+    }
+  }
+  return outRids.size();
+}
+
+// ask for the next pages to be read ahead, once per READ_AHEAD_PAGES pages
+void FileScan::readAhead()
+{
+  if (pagesRead++ % READ_AHEAD_PAGES == 0)
+  {
+    bufMgr->prefetchPages(file, curPage->next_page_number(), READ_AHEAD_PAGES);
+  }
 }
 
 // mark current page of scan dirty
 void FileScan::markDirty()
 {
-  curDirtyFlag = true;
+  curPage.markDirty();
+}
+
+const std::uint32_t ParallelFileScan::MORSEL_PAGES;
+
+ParallelFileScan::ParallelFileScan(const std::string &name, BufMgr *bufferMgr,
+    const std::uint32_t threadCount, const ScanFilter *scanFilter)
+  : bufMgr(bufferMgr), numThreads(threadCount), filter(scanFilter), nextPageNo(1), failed(false)
+{
+  file = new PageFile(name, false);	//dont create new file
+  if (numThreads == 0)
+  {
+    numThreads = std::max(std::thread::hardware_concurrency(), 1u);
+  }
+  if (!bufMgr->isConcurrent())
+  {
+    numThreads = 1;
+  }
+  endPageNo = file->numPages();
+}
+
+ParallelFileScan::~ParallelFileScan()
+{
+  bufMgr->flushFile(file);
+  delete file;
+}
+
+void ParallelFileScan::run(ScanConsumer &consumer)
+{
+  nextPageNo = 1;
+  failed = false;
+  failure = std::exception_ptr();
+
+  // the calling thread is the last worker
+  std::vector<std::thread> workers;
+  for (std::uint32_t i = 0; i + 1 < numThreads; i++)
+  {
+    workers.push_back(std::thread(&ParallelFileScan::work, this, i, &consumer));
+  }
+  work(numThreads - 1, &consumer);
+  for (std::size_t i = 0; i < workers.size(); i++)
+  {
+    workers[i].join();
+  }
+
+  if (failed)
+  {
+    std::rethrow_exception(failure);
+  }
+}
+
+void ParallelFileScan::setFields(const std::vector<ScanField> &fields)
+{
+  viewFields = fields;
+}
+
+void ParallelFileScan::work(const std::uint32_t worker, ScanConsumer *consumer)
+{
+  // each thread recycles frames of its own, and keeps its batch between pages
+  BufRing ring;
+  std::vector<RecordId> rids;
+  std::vector<RecordView> records;
+  std::vector<RecordId> pageRids;
+  std::vector<std::uint64_t> selection;
+  std::vector<char> copies;
+  try
+  {
+    while (!failed)
+    {
+      const PageId first = nextPageNo.fetch_add(MORSEL_PAGES);
+      if (first >= endPageNo)
+      {
+        break;
+      }
+      const PageId last = std::min(first + MORSEL_PAGES, endPageNo);
+      for (PageId pageNo = first; pageNo < last && !failed; pageNo++)
+      {
+        PageHandle page;
+        try
+        {
+          page = bufMgr->readPage(file, pageNo, ring);
+        }
+        catch (InvalidPageException e)
+        {
+          // free pages hold no records
+          continue;
+        }
+
+        // the filter is evaluated on all the records of the page at once
+        pageRids.clear();
+        for (PageIterator iter = page->begin(); iter != page->end(); iter++)
+        {
+          pageRids.push_back(iter.getCurrentRecord());
+        }
+        selection.assign((pageRids.size() + 63) / 64, ~(std::uint64_t)0);
+        if (filter != NULL && !pageRids.empty())
+        {
+          filter->matchBatch(*page, &pageRids[0], pageRids.size(), &selection[0]);
+        }
+        rids.clear();
+        for (std::size_t i = 0; i < pageRids.size(); i++)
+        {
+          if ((selection[i / 64] >> (i % 64)) & 1)
+          {
+            rids.push_back(pageRids[i]);
+          }
+        }
+
+        records.clear();
+        if (page->isColumnar() && !rids.empty())
+        {
+          // the records of the page are all as long; their fields are copied out of the columns one
+          // after the other, the views pointing at the copies once they are all made
+          const std::size_t length = page->getRecordLength(rids[0]);
+          copies.resize(rids.size() * length);
+          for (std::size_t i = 0; i < rids.size(); i++)
+          {
+            const RecordView record = copyFields(*page, rids[i], viewFields, &copies[i * length], length);
+            records.push_back(record);
+          }
+        }
+        else
+        {
+          for (std::size_t i = 0; i < rids.size(); i++)
+          {
+            records.push_back(page->getRecordView(rids[i]));
+          }
+        }
+        // the page stays pinned while the consumer reads the views, and is unpinned if it throws
+        if (!rids.empty())
+        {
+          consumer->consume(worker, &rids[0], &records[0], rids.size());
+        }
+      }
+    }
+    if (!failed)
+    {
+      consumer->done(worker);
+    }
+  }
+  catch (...)
+  {
+    std::lock_guard<std::mutex> guard(failureLatch);
+    if (!failed)
+    {
+      failure = std::current_exception();
+      failed = true;
+    }
+  }
 }
 
 }
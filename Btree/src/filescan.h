@@ -8,7 +8,14 @@
 
 #pragma once
 
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <exception>
+#include <mutex>
 #include <string>
+#include <vector>
+#include "string.h"
 #include "types.h"
 #include "page.h"
 #include "buffer.h"
@@ -17,6 +24,166 @@
 
 namespace badgerdb {
 
+/**
+ * @brief Bytes of the records, such as those a FileScan with a projection returns from getRecord().
+ */
+struct ScanField
+{
+  /**
+   * Byte offset of the field in the records
+   */
+  std::size_t offset;
+
+  /**
+   * Length of the field in bytes
+   */
+  std::size_t length;
+};
+
+/**
+ * @brief Predicate a FileScan evaluates on every record while the record is still on its pinned
+ * page, so that records which do not qualify are never copied.
+ */
+class ScanFilter
+{
+ public:
+  virtual ~ScanFilter() {}
+
+  /**
+   * True if the record qualifies for the scan
+   *
+   * @param record	View of the record on its page, or for a columnar page a copy of the record in
+   *              which only the fields named by fields() are filled
+   */
+  virtual bool matches(const RecordView &record) const = 0;
+
+  /**
+   * Fields of the records matches() reads, which are all a scan copies out of a columnar page to
+   * evaluate the filter.
+   *
+   * @param out	Receives the fields
+   * @return False if matches() may read any byte of the records
+   */
+  virtual bool fields(std::vector<ScanField> &out) const { return false; }
+
+  /**
+   * Evaluate the filter on the records of a pinned page at once, setting bit i % 64 of word i / 64 of
+   * the selection if record i qualifies and clearing it otherwise. Calls matches() on every record
+   * unless the filter knows better.
+   *
+   * @param page	Page of the records
+   * @param rids	Record ids of records in use on the page
+   * @param count	Number of records
+   * @param selection	Bitmap of (count + 63) / 64 words
+   */
+  virtual void matchBatch(const Page &page, const RecordId *rids, const std::size_t count,
+		std::uint64_t *selection) const;
+};
+
+/**
+ * @brief Copy a fixed-size attribute of records of a page to consecutive places of out, straight out
+ * of its column on a columnar page.
+ *
+ * @param page	Page of the records
+ * @param rids	Record ids of records in use on the page
+ * @param count	Number of records, at most 64
+ * @param attrByteOffset	Byte offset of the attribute in the records
+ * @param attrLength	Length of the attribute in bytes
+ * @param out		Receives the attributes, attrLength bytes each, '\0' for records too short to hold it
+ * @return Bitmap with bit i set if record i holds the attribute
+ */
+std::uint64_t gatherAttribute(const Page &page, const RecordId *rids, const std::size_t count,
+	const std::size_t attrByteOffset, const std::size_t attrLength, char *out);
+
+/**
+ * @brief Compare a batch of values with a range given like that of BTreeIndex::startScan().
+ *
+ * @param values	Values to compare
+ * @param count		Number of values, at most 64
+ * @return Bitmap with bit i set if value i lies in the range
+ */
+template <class T>
+std::uint64_t selectRange(const T *values, const std::size_t count, const T &lowVal, const Operator lowOp,
+	const T &highVal, const Operator highOp)
+{
+	std::uint64_t selection = 0;
+	for (std::size_t i = 0; i < count; i++)
+	{
+		const bool low = lowOp == GT ? values[i] > lowVal : (lowOp == GTE ? values[i] >= lowVal : true);
+		const bool high = highOp == LT ? values[i] < highVal : (highOp == LTE ? values[i] <= highVal : true);
+		selection |= (std::uint64_t)(low && high) << i;
+	}
+	return selection;
+}
+
+/**
+ * @brief INTEGER values are compared with a vectorized compare when the target supports AVX2 or
+ * SSE4.1, like the keys of BTreeIndex nodes.
+ */
+std::uint64_t selectRange(const int *values, const std::size_t count, const int &lowVal, const Operator lowOp,
+	const int &highVal, const Operator highOp);
+
+/**
+ * @brief Range of a fixed-size attribute at a byte offset in the records, given like the range of
+ * BTreeIndex::startScan(). Records too short to hold the attribute do not qualify.
+ */
+template <class T>
+class AttrFilter : public ScanFilter
+{
+ public:
+  /**
+   * @param attrByteOffset	Byte offset of the attribute in the records, which need not be aligned
+   * @param lowVal	Low bound of the range
+   * @param lowOp		GT or GTE, or EMPTY if the range has no low bound
+   * @param highVal	High bound of the range
+   * @param highOp	LT or LTE, or EMPTY if the range has no high bound
+   */
+  AttrFilter(const std::size_t attrByteOffset, const T &lowVal, const Operator lowOp,
+		const T &highVal, const Operator highOp)
+		: attrByteOffset(attrByteOffset), lowVal(lowVal), lowOp(lowOp), highVal(highVal), highOp(highOp)
+  {
+  }
+
+  bool matches(const RecordView &record) const
+  {
+		if (record.length < attrByteOffset + sizeof(T))
+			return false;
+		T value;
+		memcpy(&value, record.data + attrByteOffset, sizeof(T));
+		if ((lowOp == GT && !(value > lowVal)) || (lowOp == GTE && !(value >= lowVal)))
+			return false;
+		return !((highOp == LT && !(value < highVal)) || (highOp == LTE && !(value <= highVal)));
+  }
+
+  bool fields(std::vector<ScanField> &out) const
+  {
+		const ScanField field = {attrByteOffset, sizeof(T)};
+		out.assign(1, field);
+		return true;
+  }
+
+  void matchBatch(const Page &page, const RecordId *rids, const std::size_t count,
+		std::uint64_t *selection) const
+  {
+		// the attribute of 64 records at a time is gathered into a batch, compared all at once
+		T values[64];
+		for (std::size_t first = 0; first < count; first += 64)
+		{
+			const std::size_t n = std::min<std::size_t>(64, count - first);
+			const std::uint64_t present = gatherAttribute(page, rids + first, n, attrByteOffset, sizeof(T),
+				reinterpret_cast<char *>(values));
+			selection[first / 64] = present & selectRange(values, n, lowVal, lowOp, highVal, highOp);
+		}
+  }
+
+ private:
+  const std::size_t attrByteOffset;
+  const T lowVal;
+  const Operator lowOp;
+  const T highVal;
+  const Operator highOp;
+};
+
 /**
  * @brief This class is used to sequentially scan records in a relation.
  */
@@ -24,20 +191,78 @@ class FileScan
 {
  public:
 
-  FileScan(const std::string &name, BufMgr *bufMgr);
+  /**
+   * @param name		Name of the relation
+   * @param bufMgr	Buffer manager
+   * @param filter	If not NULL, scanNext() skips the records it does not match. Owned by the caller,
+   *              and must outlive the scan.
+   */
+  FileScan(const std::string &name, BufMgr *bufMgr, const ScanFilter *filter = NULL);
 
   ~FileScan();
 
   //return RecordId of next record that satisfies the scan 
   void scanNext(RecordId& outRid);
 
-  //read current record, returning pointer and length
+  //read current record, or only its projection if one is set
   std::string getRecord();
 
+  /**
+   * Make getRecord() return only the given fields of the records, one after the other. Bytes of a
+   * field past the end of a record are returned as '\0'. An empty list returns whole records again.
+   *
+   * @param fields	Fields to return
+   */
+  void setProjection(const std::vector<ScanField> &fields);
+
+  /**
+   * Fields of the records the caller reads from getRecordView(). Records of columnar pages do not
+   * lie whole on their page, and getRecordView() copies only these fields out of their columns,
+   * leaving the other bytes '\0'. An empty list, the default, copies whole records.
+   *
+   * @param fields	Fields read
+   */
+  void setFields(const std::vector<ScanField> &fields);
+
+  //view of the current record on its page, or of a copy of it for a columnar page, valid until the next scanNext()
+  RecordView getRecordView();
+
+  /**
+   * Move on to the next page of the file holding qualifying records and return the ids of all of them
+   * at once, the filter being evaluated on the whole page by ScanFilter::matchBatch(). If the scan is
+   * in the middle of a page, the records left on it are returned. The page stays pinned until the scan
+   * moves off it, and getPage() returns it; getRecord() and getRecordView() return its last record.
+   *
+   * @param outRids	Cleared, then receives the record ids in slot order
+   * @return Number of record ids returned, at least one
+   * @throws EndOfFileException If there are no more qualifying records
+   */
+  std::size_t scanNextPage(std::vector<RecordId> &outRids);
+
+  //page the scan is on, pinned until the scan moves off it
+  const Page *getPage() const { return curPage.get(); }
+
   //marks current page of scan dirty
   void markDirty();
 
+  /**
+   * Number of pages a scan asks the buffer manager to read ahead at a time, see BufMgr::prefetchPages()
+   */
+  static const std::uint32_t READ_AHEAD_PAGES = 8;
+
  private:
+  /**
+   * Ask for the pages after the current one to be read ahead.
+   */
+  void readAhead();
+
+  /**
+   * Move to the next record of the file, whether or not it matches the filter.
+   *
+   * @throws EndOfFileException If there are no more records
+   */
+  void nextRecord();
+
   /**
    * File which is being scanned.
    */
@@ -49,17 +274,176 @@ class FileScan
 	BufMgr				*bufMgr;
 
   /**
-   * Current page being scanned.
+   * Frames the scan recycles, so that it does not flush the buffer pool
+   */
+  BufRing       ring;
+
+  /**
+   * Current page being scanned, pinned until the scan moves off it, dirty once markDirty() is called.
    */
-  Page*         curPage;
+  PageHandle    curPage;
 
   FileIterator  filePageIter;
   PageIterator  pageRecordIter;
 
   /**
-   * True if page has been updated
+   * Records qualifying for the scan, NULL for all of them
+   */
+  const ScanFilter *filter;
+
+  /**
+   * Fields getRecord() returns, empty for whole records
+   */
+  std::vector<ScanField> projection;
+
+  /**
+   * Total length of the fields in projection
+   */
+  std::size_t projectionLength;
+
+  /**
+   * Fields getRecordView() copies out of columnar pages, empty for whole records, and those the
+   * filter reads, empty if it may read any byte
+   */
+  std::vector<ScanField> viewFields;
+  std::vector<ScanField> filterFields;
+
+  /**
+   * Copies of records of columnar pages the filter is evaluated on, and getRecordView() returns,
+   * with the record the latter is a copy of
+   */
+  std::string filterRecord;
+  std::string viewRecord;
+  RecordId      viewRid;
+
+  /**
+   * Records of the page scanNextPage() is on, and the bitmap of those qualifying
+   */
+  std::vector<RecordId> pageRids;
+  std::vector<std::uint64_t> selection;
+
+  /**
+   * Number of pages the scan has read
+   */
+  std::uint32_t pagesRead;
+};
+
+/**
+ * @brief Receives the records found by a ParallelFileScan, from all of its threads at once.
+ */
+class ScanConsumer
+{
+ public:
+  virtual ~ScanConsumer() {}
+
+  /**
+   * Called by one of the threads of the scan with the qualifying records of a page, which stays
+   * pinned until the call returns. Calls from the same thread never overlap.
+   *
+   * @param worker	Number of the calling thread, from 0 up to the number of threads of the scan
+   * @param rids		Record ids of the records
+   * @param records	Views of the records, valid until the call returns
+   * @param count		Number of records
+   */
+  virtual void consume(const std::uint32_t worker, const RecordId *rids, const RecordView *records,
+		const std::size_t count) = 0;
+
+  /**
+   * Called by each thread of the scan once it has no more pages to scan, unless the scan failed.
+   * Lets consumers finish their per-thread work, such as sorting, on all threads.
+   *
+   * @param worker	Number of the calling thread
+   */
+  virtual void done(const std::uint32_t worker) {}
+};
+
+/**
+ * @brief Scans the records of a relation with several threads.
+ *
+ * The pages of the file are split into morsels of MORSEL_PAGES consecutive page numbers, which the
+ * threads take on one after the other until none are left, so that threads held up by slow pages do
+ * not hold up the scan. Pages are visited in no particular order. Each thread batches the qualifying
+ * records of a page and hands them to the ScanConsumer while the page is pinned.
+ */
+class ParallelFileScan
+{
+ public:
+  /**
+   * Number of consecutive pages a thread scans at a time
+   */
+  static const std::uint32_t MORSEL_PAGES = 16;
+
+  /**
+   * @param name		Name of the relation
+   * @param bufMgr	Buffer manager, which needs to be in concurrent mode for more than one thread
+   * @param numThreads	Number of threads scanning, 0 for one per core. Only one thread scans if the
+   *                  buffer manager is not in concurrent mode.
+   * @param filter	If not NULL, only the records it matches are handed on. Owned by the caller.
+   */
+  ParallelFileScan(const std::string &name, BufMgr *bufMgr, const std::uint32_t numThreads = 0,
+		const ScanFilter *filter = NULL);
+
+  ~ParallelFileScan();
+
+  /**
+   * Scan the whole relation, returning once every thread is done. An exception thrown by a thread,
+   * the consumer included, stops the scan and is rethrown here.
+   *
+   * @param consumer	Receiver of the records
+   */
+  void run(ScanConsumer &consumer);
+
+  /**
+   * Fields of the records the consumer reads. Records of columnar pages do not lie whole on their
+   * page, and only these fields are copied out of their columns into the views handed on, the other
+   * bytes being '\0'. An empty list, the default, copies whole records.
+   *
+   * @param fields	Fields read
+   */
+  void setFields(const std::vector<ScanField> &fields);
+
+  /**
+   * Number of threads scanning, which is the number of workers the consumer sees
+   */
+  std::uint32_t threads() const { return numThreads; }
+
+ private:
+  /**
+   * Scan morsels until none are left, or until another thread fails.
+   */
+  void work(const std::uint32_t worker, ScanConsumer *consumer);
+
+  /**
+   * File which is being scanned.
+   */
+  PageFile      *file;
+
+  /**
+   * Buffer Manager instance used to read pages into the buffer pool.
+   */
+  BufMgr        *bufMgr;
+
+  std::uint32_t numThreads;
+
+  const ScanFilter *filter;
+
+  /**
+   * Fields copied out of columnar pages for the consumer, empty for whole records
+   */
+  std::vector<ScanField> viewFields;
+
+  /**
+   * First page number of the next morsel, and the number past the last page
+   */
+  std::atomic<PageId> nextPageNo;
+  PageId        endPageNo;
+
+  /**
+   * Set once a thread failed, with the exception it threw
    */
-  bool  	      curDirtyFlag;
+  std::atomic<bool> failed;
+  std::exception_ptr failure;
+  std::mutex    failureLatch;
 };
 
 }
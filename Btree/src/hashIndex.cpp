@@ -0,0 +1,433 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "hashIndex.h"
+#include "exceptions/bad_index_info_exception.h"
+#include "exceptions/end_of_file_exception.h"
+#include "exceptions/file_not_found_exception.h"
+#include "exceptions/no_such_key_found_exception.h"
+#include "filescan.h"
+#include <algorithm>
+#include <sstream>
+
+namespace badgerdb
+{
+
+/**
+ * Most bytes of a key, those of a STRING key
+ */
+static const int MAX_KEY_SIZE = STRINGSIZE > (int) sizeof(double) ? STRINGSIZE : (int) sizeof(double);
+
+/**
+ * Open the index file of the attribute, or create it and insert an entry for every tuple of the relation.
+ */
+HashIndex::HashIndex(const std::string &relationName, std::string &outIndexName,
+                     BufMgr *bufMgrIn, const int attrByteOffset, const Datatype attrType)
+    : file(NULL), bufMgr(bufMgrIn), headerPageNum(Page::INVALID_NUMBER), attributeType(attrType),
+      attrByteOffset(attrByteOffset), globalDepth(0), numEntries(0), numBuckets(0), numOverflowPages(0),
+      directoryPageNum(Page::INVALID_NUMBER)
+{
+    switch(attrType){
+    case INTEGER:
+        this->keySize = sizeof(int);
+        break;
+    case DOUBLE:
+        this->keySize = sizeof(double);
+        break;
+    case STRING:
+        this->keySize = STRINGSIZE;
+        break;
+    default:
+        throw BadIndexInfoException("Hash indexes are built over one INTEGER, DOUBLE or STRING attribute");
+    }
+    this->entrySize = this->keySize + sizeof(RecordId);
+    this->bucketCapacity = (Page::BLOB_SIZE - sizeof(HashBucketHeader)) / this->entrySize;
+
+    std::ostringstream idxStr;
+    idxStr << relationName << '.' << attrByteOffset << ".hash";
+    const std::string indexName = idxStr.str();
+    outIndexName = indexName;
+
+    // If the index file already exists, open the file
+    try{
+        this->file = new BlobFile(indexName, false);
+    }catch(FileNotFoundException){
+    }
+    if(this->file != NULL){
+        this->headerPageNum = file->getFirstPageNo();
+        PageHandle hdrPage = bufMgr->readPage(this->file, this->headerPageNum);
+        const HashMetaInfo *meta = (const HashMetaInfo*) hdrPage.get();
+        if(meta->attrType != attrType || meta->attrByteOffset != attrByteOffset
+        || strcmp(meta->relationName, relationName.c_str())){
+            // close the file again, so that it can be opened or removed after the exception
+            hdrPage.release();
+            bufMgr->flushFile(this->file);
+            delete this->file;
+            this->file = NULL;
+            throw BadIndexInfoException("Values in metapage not match with values received!");
+        }
+        this->globalDepth = meta->globalDepth;
+        this->numEntries = meta->numEntries;
+        this->numBuckets = meta->numBuckets;
+        this->numOverflowPages = meta->numOverflowPages;
+        this->directoryPageNum = meta->directoryPageNo;
+        hdrPage.release();
+        readDirectory();
+        return;
+    }
+
+    // otherwise create it, with a single bucket all keys go to
+    this->file = new BlobFile(indexName, true);
+    {
+        PageHandle hdrPage = bufMgr->allocPage(this->file, this->headerPageNum);
+        HashMetaInfo *meta = (HashMetaInfo*) hdrPage.get();
+        memset(meta, 0, sizeof(HashMetaInfo));
+        strncpy(meta->relationName, relationName.c_str(), sizeof(meta->relationName) - 1);
+        meta->attrByteOffset = attrByteOffset;
+        meta->attrType = attrType;
+        meta->directoryPageNo = Page::INVALID_NUMBER;
+        hdrPage.release(true);
+    }
+    PageId bucketPageNum;
+    allocBucket(bucketPageNum, 0);
+    this->directory.assign(1, bucketPageNum);
+    this->numBuckets = 1;
+    writeMetaInfo();
+
+    // Scan the file
+    try{
+        FileScan fScan(relationName, bufMgr);
+        const ScanField keyField = {(std::size_t)attrByteOffset, (std::size_t)keySize};
+        fScan.setFields(std::vector<ScanField>(1, keyField));
+        RecordId rid;
+        char key[MAX_KEY_SIZE];
+        while(true){
+            fScan.scanNext(rid);
+            keyBytes(fScan.getRecordView().data + attrByteOffset, key);
+            insertKey(key, rid);
+        }
+    }catch(EndOfFileException){
+
+    }
+}
+
+HashIndex::~HashIndex()
+{
+    try{
+        writeMetaInfo();
+        this->bufMgr->flushFile(this->file);
+    }catch(...){
+    }
+    delete this->file;
+    this->file = NULL;
+}
+
+void HashIndex::keyBytes(const void* key, char* out) const
+{
+    switch(this->attributeType){
+    case INTEGER:
+        memcpy(out, key, sizeof(int));
+        break;
+    case DOUBLE:{
+        double value;
+        memcpy(&value, key, sizeof(value));
+        if(value == 0){
+            value = 0;
+        }
+        memcpy(out, &value, sizeof(value));
+        break;
+    }
+    default:
+        strncpy(out, (const char*) key, STRINGSIZE);
+        break;
+    }
+}
+
+/**
+ * FNV-1a over the key bytes, then mixed so that the low bits the directory is indexed by depend on all of them.
+ */
+std::uint64_t HashIndex::hash(const char* key) const
+{
+    std::uint64_t h = 0xcbf29ce484222325ULL;
+    for(int i = 0; i < this->keySize; i++){
+        h ^= (unsigned char) key[i];
+        h *= 0x100000001b3ULL;
+    }
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+PageHandle HashIndex::allocBucket(PageId &pageNum, const int localDepth)
+{
+    PageHandle page = bufMgr->allocPage(this->file, pageNum);
+    HashBucketHeader *bucket = (HashBucketHeader*) page.get();
+    bucket->localDepth = localDepth;
+    bucket->numEntries = 0;
+    bucket->overflowPageNo = Page::INVALID_NUMBER;
+    page.markDirty();
+    return page;
+}
+
+void HashIndex::splitBucket(const std::uint64_t slot)
+{
+    const PageId oldPageNum = this->directory[slot];
+    int depth;
+    {
+        PageHandle oldPage = bufMgr->readPage(this->file, oldPageNum);
+        depth = ((const HashBucketHeader*) oldPage.get())->localDepth;
+    }
+    if(depth == this->globalDepth){
+        // the new upper half of the directory points at the same buckets as the lower half
+        const size_t size = this->directory.size();
+        this->directory.resize(2 * size);
+        std::copy(this->directory.begin(), this->directory.begin() + size, this->directory.begin() + size);
+        this->globalDepth++;
+    }
+    const std::uint64_t bit = std::uint64_t(1) << depth;
+
+    // the entries of every page of the bucket, overflow pages included, are sorted by the new bit
+    std::vector<char> sides[2];
+    std::vector<PageId> overflowPageNums;
+    for(PageId pageNum = oldPageNum; pageNum != Page::INVALID_NUMBER;){
+        PageHandle page = bufMgr->readPage(this->file, pageNum);
+        const HashBucketHeader *bucket = (const HashBucketHeader*) page.get();
+        for(int i = 0; i < bucket->numEntries; i++){
+            const char *entry = entryOf(page.get(), i);
+            std::vector<char> &side = sides[(hash(entry) & bit) != 0];
+            side.insert(side.end(), entry, entry + this->entrySize);
+        }
+        pageNum = bucket->overflowPageNo;
+        if(pageNum != Page::INVALID_NUMBER){
+            overflowPageNums.push_back(pageNum);
+        }
+    }
+
+    // the old bucket keeps the low side and the new one takes the high side, each going on in as many
+    // of the overflow pages as it needs; those left over stay empty at the end of the old bucket
+    PageId newPageNum;
+    allocBucket(newPageNum, depth + 1).release(true);
+    std::vector<PageId> chains[2];
+    chains[0].push_back(oldPageNum);
+    chains[1].push_back(newPageNum);
+    size_t spare = 0;
+    for(int s = 1; s >= 0; s--){
+        const size_t count = sides[s].size() / this->entrySize;
+        while(chains[s].size() * this->bucketCapacity < count){
+            chains[s].push_back(overflowPageNums[spare++]);
+        }
+    }
+    chains[0].insert(chains[0].end(), overflowPageNums.begin() + spare, overflowPageNums.end());
+    for(int s = 0; s < 2; s++){
+        const size_t count = sides[s].size() / this->entrySize;
+        size_t written = 0;
+        for(size_t k = 0; k < chains[s].size(); k++){
+            PageHandle page = bufMgr->readPage(this->file, chains[s][k]);
+            HashBucketHeader *bucket = (HashBucketHeader*) page.get();
+            const size_t n = std::min((size_t) this->bucketCapacity, count - written);
+            memcpy(entryOf(page.get(), 0), &sides[s][written * this->entrySize], n * this->entrySize);
+            written += n;
+            bucket->localDepth = depth + 1;
+            bucket->numEntries = n;
+            bucket->overflowPageNo = k + 1 < chains[s].size() ? chains[s][k + 1] : Page::INVALID_NUMBER;
+            page.release(true);
+        }
+    }
+
+    // the slots of the bucket share its low depth bits; those with the new bit set move
+    for(std::uint64_t j = slot & (bit - 1); j < this->directory.size(); j += bit){
+        if((j & bit) != 0){
+            this->directory[j] = newPageNum;
+        }
+    }
+    this->numBuckets++;
+}
+
+void HashIndex::readDirectory()
+{
+    this->directory.assign(size_t(1) << this->globalDepth, (PageId) Page::INVALID_NUMBER);
+    size_t read = 0;
+    for(PageId pageNum = this->directoryPageNum; pageNum != Page::INVALID_NUMBER && read < this->directory.size();){
+        PageHandle page = bufMgr->readPage(this->file, pageNum);
+        const HashDirectoryPage *dir = (const HashDirectoryPage*) page.get();
+        const size_t n = std::min((size_t) HASH_DIRECTORY_SLOTS, this->directory.size() - read);
+        memcpy(&this->directory[read], dir->buckets, n * sizeof(PageId));
+        read += n;
+        pageNum = dir->nextPageNo;
+    }
+}
+
+/**
+ * Write the directory to its pages, reusing them in order and adding pages as the directory has grown, and
+ * the counters to the meta page.
+ */
+void HashIndex::writeMetaInfo()
+{
+    PageHandle prev;
+    PageId pageNum = this->directoryPageNum;
+    for(size_t written = 0; written < this->directory.size();){
+        PageHandle page;
+        if(pageNum == Page::INVALID_NUMBER){
+            page = bufMgr->allocPage(this->file, pageNum);
+            ((HashDirectoryPage*) page.get())->nextPageNo = Page::INVALID_NUMBER;
+            if(prev){
+                ((HashDirectoryPage*) prev.get())->nextPageNo = pageNum;
+            }else{
+                this->directoryPageNum = pageNum;
+            }
+        }else{
+            page = bufMgr->readPage(this->file, pageNum);
+        }
+        HashDirectoryPage *dir = (HashDirectoryPage*) page.get();
+        const size_t n = std::min((size_t) HASH_DIRECTORY_SLOTS, this->directory.size() - written);
+        memcpy(dir->buckets, &this->directory[written], n * sizeof(PageId));
+        written += n;
+        pageNum = dir->nextPageNo;
+        page.markDirty();
+        prev = std::move(page);
+    }
+    prev.release(true);
+
+    PageHandle hdrPage = bufMgr->readPage(this->file, this->headerPageNum);
+    HashMetaInfo *meta = (HashMetaInfo*) hdrPage.get();
+    meta->globalDepth = this->globalDepth;
+    meta->numEntries = this->numEntries;
+    meta->numBuckets = this->numBuckets;
+    meta->numOverflowPages = this->numOverflowPages;
+    meta->directoryPageNo = this->directoryPageNum;
+    hdrPage.release(true);
+}
+
+const void HashIndex::insertEntry(const void* key, const RecordId rid)
+{
+    char bytes[MAX_KEY_SIZE];
+    keyBytes(key, bytes);
+    insertKey(bytes, rid);
+}
+
+void HashIndex::insertKey(const char* key, const RecordId rid)
+{
+    const std::uint64_t h = hash(key);
+    while(true){
+        const std::uint64_t slot = h & ((std::uint64_t(1) << this->globalDepth) - 1);
+        PageHandle page = bufMgr->readPage(this->file, this->directory[slot]);
+        HashBucketHeader *bucket = (HashBucketHeader*) page.get();
+        if(bucket->numEntries >= this->bucketCapacity){
+            // a full bucket is split, unless its keys all share the hash of key, which no split tells apart
+            bool oneHash = true;
+            for(int i = 0; oneHash && i < bucket->numEntries; i++){
+                oneHash = hash(entryOf(page.get(), i)) == h;
+            }
+            if(!oneHash && bucket->localDepth < MAX_HASH_DEPTH){
+                page.release();
+                splitBucket(slot);
+                continue;
+            }
+            // otherwise the entry goes to the first overflow page with room, or a new one at the end
+            while(bucket->numEntries >= this->bucketCapacity){
+                if(bucket->overflowPageNo == Page::INVALID_NUMBER){
+                    PageId overflowPageNum;
+                    PageHandle overflow = allocBucket(overflowPageNum, bucket->localDepth);
+                    bucket->overflowPageNo = overflowPageNum;
+                    page.markDirty();
+                    page = std::move(overflow);
+                    this->numOverflowPages++;
+                }else{
+                    page = bufMgr->readPage(this->file, bucket->overflowPageNo);
+                }
+                bucket = (HashBucketHeader*) page.get();
+            }
+        }
+        char *entry = entryOf(page.get(), bucket->numEntries++);
+        memcpy(entry, key, this->keySize);
+        memcpy(entry + this->keySize, &rid, sizeof(RecordId));
+        page.release(true);
+        this->numEntries++;
+        return;
+    }
+}
+
+const void HashIndex::deleteEntry(const void* key, const RecordId rid)
+{
+    char bytes[MAX_KEY_SIZE];
+    keyBytes(key, bytes);
+    const std::uint64_t slot = hash(bytes) & ((std::uint64_t(1) << this->globalDepth) - 1);
+    for(PageId pageNum = this->directory[slot]; pageNum != Page::INVALID_NUMBER;){
+        PageHandle page = bufMgr->readPage(this->file, pageNum);
+        HashBucketHeader *bucket = (HashBucketHeader*) page.get();
+        for(int i = 0; i < bucket->numEntries; i++){
+            char *entry = entryOf(page.get(), i);
+            RecordId found;
+            memcpy(&found, entry + this->keySize, sizeof(RecordId));
+            if(memcmp(entry, bytes, this->keySize) == 0 && found == rid){
+                // the last entry of the page takes its place
+                memmove(entry, entryOf(page.get(), bucket->numEntries - 1), this->entrySize);
+                bucket->numEntries--;
+                page.release(true);
+                this->numEntries--;
+                return;
+            }
+        }
+        pageNum = bucket->overflowPageNo;
+    }
+    throw NoSuchKeyFoundException();
+}
+
+size_t HashIndex::find(const char* key, RecordId *outRid, std::vector<RecordId> *outRids)
+{
+    const std::uint64_t slot = hash(key) & ((std::uint64_t(1) << this->globalDepth) - 1);
+    size_t found = 0;
+    for(PageId pageNum = this->directory[slot]; pageNum != Page::INVALID_NUMBER;){
+        PageHandle page = bufMgr->readPage(this->file, pageNum);
+        const HashBucketHeader *bucket = (const HashBucketHeader*) page.get();
+        for(int i = 0; i < bucket->numEntries; i++){
+            const char *entry = entryOf(page.get(), i);
+            if(memcmp(entry, key, this->keySize) != 0){
+                continue;
+            }
+            RecordId rid;
+            memcpy(&rid, entry + this->keySize, sizeof(RecordId));
+            if(outRids == NULL){
+                *outRid = rid;
+                return 1;
+            }
+            outRids->push_back(rid);
+            found++;
+        }
+        pageNum = bucket->overflowPageNo;
+    }
+    return found;
+}
+
+const bool HashIndex::lookup(const void* key, RecordId& outRid)
+{
+    char bytes[MAX_KEY_SIZE];
+    keyBytes(key, bytes);
+    return find(bytes, &outRid, NULL) > 0;
+}
+
+const size_t HashIndex::lookupAll(const void* key, std::vector<RecordId>& outRids)
+{
+    char bytes[MAX_KEY_SIZE];
+    keyBytes(key, bytes);
+    return find(bytes, NULL, &outRids);
+}
+
+HashIndexStats HashIndex::getStats() const
+{
+    HashIndexStats stats;
+    stats.globalDepth = this->globalDepth;
+    stats.numEntries = this->numEntries;
+    stats.numBuckets = this->numBuckets;
+    stats.numOverflowPages = this->numOverflowPages;
+    return stats;
+}
+
+}
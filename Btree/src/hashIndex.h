@@ -0,0 +1,320 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "types.h"
+#include "page.h"
+#include "file.h"
+#include "buffer.h"
+#include "btree.h"
+
+namespace badgerdb
+{
+
+/**
+ * @brief Most bits of the hash of a key the directory of a HashIndex is indexed by. Buckets whose
+ * entries still do not fit once they are told apart by this many bits go on in overflow pages.
+ */
+const int MAX_HASH_DEPTH = 24;
+
+/**
+ * @brief The meta page, which is the first page of a hash index file.
+ */
+struct HashMetaInfo{
+  /**
+   * Name of base relation.
+   */
+	char relationName[20];
+
+  /**
+   * Offset of attribute, over which index is built, inside the record stored in pages.
+   */
+	int attrByteOffset;
+
+  /**
+   * Type of the attribute over which index is built: INTEGER, DOUBLE or STRING.
+   */
+	Datatype attrType;
+
+  /**
+   * Number of bits of the hash of a key that pick its directory slot. The directory has 2^globalDepth slots.
+   */
+	int globalDepth;
+
+  /**
+   * Number of (key, rid) entries in the index.
+   */
+	int numEntries;
+
+  /**
+   * Number of buckets, not counting their overflow pages.
+   */
+	int numBuckets;
+
+  /**
+   * Number of overflow pages of all buckets.
+   */
+	int numOverflowPages;
+
+  /**
+   * First page of the directory, INVALID_NUMBER until the directory is first written.
+   */
+	PageId directoryPageNo;
+};
+
+/**
+ * @brief Number of directory slots a directory page holds.
+ */
+const int HASH_DIRECTORY_SLOTS = (Page::BLOB_SIZE - sizeof(PageId)) / sizeof(PageId);
+
+/**
+ * @brief A page of the directory of a hash index: the bucket of each of a run of directory slots.
+ */
+struct HashDirectoryPage{
+  /**
+   * Next page of the directory, INVALID_NUMBER for the last one.
+   */
+	PageId nextPageNo;
+
+  /**
+   * Page number of the bucket of each slot. Slots of buckets whose local depth is less than the global
+   * depth share their bucket.
+   */
+	PageId buckets[HASH_DIRECTORY_SLOTS];
+};
+
+/**
+ * @brief Header of a bucket page of a hash index, and of its overflow pages. The entries follow it, each
+ * the key bytes and then the record id, unaligned.
+ */
+struct HashBucketHeader{
+  /**
+   * Number of low bits of the hash that all the keys of the bucket share.
+   */
+	int localDepth;
+
+  /**
+   * Number of entries in this page.
+   */
+	int numEntries;
+
+  /**
+   * Next overflow page of the bucket, INVALID_NUMBER for the last page.
+   */
+	PageId overflowPageNo;
+};
+
+/**
+ * @brief Counters of the shape of a hash index, see HashIndex::getStats().
+ */
+struct HashIndexStats{
+  /**
+   * Number of bits of the hash the directory is indexed by.
+   */
+	int globalDepth;
+
+  /**
+   * Number of (key, rid) entries.
+   */
+	int numEntries;
+
+  /**
+   * Number of buckets, and of the overflow pages they go on in.
+   */
+	int numBuckets;
+	int numOverflowPages;
+};
+
+/**
+ * @brief Disk-based extendible hash index over an INTEGER, DOUBLE or STRING attribute of a relation, for
+ * equality lookups.
+ *
+ * The index file is a BlobFile read and written through a BufMgr, like that of a BTreeIndex. A key is hashed
+ * to 64 bits and the low globalDepth bits pick its slot in the directory, which names the bucket page
+ * holding the key. The directory is kept in memory while the index is open, so that a lookup reads one page,
+ * unless the bucket of the key has overflowed. A full bucket is split in two by one more bit of the hash,
+ * doubling the directory if the bucket was told apart by all of its bits. Buckets whose keys all share
+ * their hash, such as many duplicates of one key, cannot be split and go on in a chain of overflow pages.
+ * Deletes leave buckets as they are.
+ *
+ * Lookups may run in parallel with each other through a buffer manager in concurrent mode; inserts and
+ * deletes need the index to themselves.
+ */
+class HashIndex {
+
+ private:
+
+  /**
+   * File object for the index file.
+   */
+	File		*file;
+
+  /**
+   * Buffer Manager Instance.
+   */
+	BufMgr	*bufMgr;
+
+  /**
+   * Page number of meta page.
+   */
+	PageId	headerPageNum;
+
+  /**
+   * Type and offset of the indexed attribute, and the number of bytes of its keys.
+   */
+	Datatype	attributeType;
+	int 		attrByteOffset;
+	int			keySize;
+
+  /**
+   * Number of bytes of an entry, and the most entries a bucket page holds.
+   */
+	int			entrySize;
+	int			bucketCapacity;
+
+  /**
+   * Counters mirroring those of HashMetaInfo.
+   */
+	int			globalDepth;
+	int			numEntries;
+	int			numBuckets;
+	int			numOverflowPages;
+
+  /**
+   * Bucket page of each directory slot, written to the directory pages when the index is closed.
+   */
+	std::vector<PageId> directory;
+
+  /**
+   * First page of the directory in the file, INVALID_NUMBER before it is first written.
+   */
+	PageId	directoryPageNum;
+
+  /**
+   * Key bytes of a key given by address, or of the attribute of a record: INTEGER and DOUBLE keys are copied,
+   * with -0.0 made 0.0 so that equal keys have equal bytes, STRING keys padded with '\0' like StringKey.
+   */
+	void keyBytes(const void* key, char* out) const;
+
+  /**
+   * 64 bit hash of key bytes.
+   */
+	std::uint64_t hash(const char* key) const;
+
+  /**
+   * Address of entry i of a bucket page.
+   */
+	char* entryOf(Page* page, const int i) const
+	{
+		return reinterpret_cast<char*>(page) + sizeof(HashBucketHeader) + (std::size_t)i * entrySize;
+	}
+
+  /**
+   * Allocate an empty bucket page.
+   *
+   * @param pageNum		Page number of the new page returned via this reference
+   * @param localDepth	Local depth of the bucket
+   * @return Handle of the new page, pinned
+   */
+	PageHandle allocBucket(PageId &pageNum, const int localDepth);
+
+  /**
+   * Split the bucket of a slot by one more bit of the hash, doubling the directory first if needed.
+   * The entries of all its pages are dealt out again, and its overflow pages are shared out between
+   * the two buckets, so no page is lost.
+   *
+   * @param slot	A directory slot of the bucket
+   */
+	void splitBucket(const std::uint64_t slot);
+
+  /**
+   * Read the directory from its pages.
+   */
+	void readDirectory();
+
+  /**
+   * Write the directory to its pages, and the counters to the meta page.
+   */
+	void writeMetaInfo();
+
+  /**
+   * Insert an entry with key bytes, the work of insertEntry() and of the constructor's scan.
+   */
+	void insertKey(const char* key, const RecordId rid);
+
+  /**
+   * Find entries with key bytes, stopping after the first one if outRids is NULL.
+   */
+	size_t find(const char* key, RecordId *outRid, std::vector<RecordId> *outRids);
+
+ public:
+
+  /**
+   * HashIndex Constructor, like that of BTreeIndex.
+	 * Check to see if the corresponding index file exists. If so, open the file.
+	 * If not, create it and insert entries for every tuple in the base relation using FileScan class.
+   *
+   * @param relationName        Name of file.
+   * @param outIndexName        Return the name of index file: that of the base relation, the offset of the attribute and ".hash".
+   * @param bufMgrIn						Buffer Manager Instance
+   * @param attrByteOffset			Offset of attribute, over which index is to be built, in the record
+   * @param attrType						Datatype of attribute over which index is built: INTEGER, DOUBLE or STRING
+   * @throws  BadIndexInfoException     If the attribute type is COMPOSITE, or if the index file already exists but
+   *                                    values in its metapage do not match those received through constructor parameters.
+   */
+	HashIndex(const std::string & relationName, std::string & outIndexName,
+						BufMgr *bufMgrIn,	const int attrByteOffset,	const Datatype attrType);
+
+  /**
+   * HashIndex Destructor. Write the directory and the meta page, flush the index file from the buffer
+	 * manager and close it. Does not throw.
+	 */
+	~HashIndex();
+
+  /**
+	 * Insert a new entry using the pair <value,rid>, splitting the bucket of the key as long as it is full.
+   * @param key			Key to insert, pointer to integer/double/char string
+   * @param rid			Record ID of a record whose entry is getting inserted into the index.
+	**/
+	const void insertEntry(const void* key, const RecordId rid);
+
+  /**
+	 * Delete the entry with the pair <value,rid>.
+   * @param key			Key to delete, pointer to integer/double/char string
+   * @param rid			Record ID of the record whose entry is deleted.
+	 * @throws  NoSuchKeyFoundException If the index holds no entry with this key and record id.
+	**/
+	const void deleteEntry(const void* key, const RecordId rid);
+
+  /**
+	 * Find an entry with the given key, reading its bucket and any overflow pages, like BTreeIndex::lookup().
+	 * @param key			Key to look for, pointer to integer/double/char string
+	 * @param outRid	Record id of an entry with key returned in this
+	 * @return True if an entry was found; outRid is left unchanged otherwise.
+	**/
+	const bool lookup(const void* key, RecordId& outRid);
+
+  /**
+	 * Find every entry with the given key, like BTreeIndex::lookupAll().
+	 * @param key			Key to look for, pointer to integer/double/char string
+	 * @param outRids	The record ids of the entries found are appended to this
+	 * @return Number of record ids appended.
+	**/
+	const size_t lookupAll(const void* key, std::vector<RecordId>& outRids);
+
+  /**
+	 * Counters of the shape of the index, kept up to date by every insert, so this does not read any page.
+	**/
+	HashIndexStats getStats() const;
+};
+
+}
@@ -6,18 +6,38 @@
  */
 
 #include "btree.h"
+#include "hashIndex.h"
+#include "exceptions/bad_index_info_exception.h"
 #include "exceptions/bad_opcodes_exception.h"
 #include "exceptions/bad_scanrange_exception.h"
+#include "exceptions/buffer_exceeded_exception.h"
+#include "exceptions/corrupt_page_exception.h"
 #include "exceptions/end_of_file_exception.h"
+#include "exceptions/file_exists_exception.h"
 #include "exceptions/file_not_found_exception.h"
+#include "exceptions/file_open_exception.h"
+#include "exceptions/hash_not_found_exception.h"
 #include "exceptions/index_scan_completed_exception.h"
 #include "exceptions/insufficient_space_exception.h"
+#include "exceptions/invalid_page_exception.h"
+#include "exceptions/invalid_record_exception.h"
 #include "exceptions/no_such_key_found_exception.h"
+#include "exceptions/page_not_pinned_exception.h"
+#include "exceptions/read_only_index_exception.h"
 #include "exceptions/scan_not_initialized_exception.h"
 #include "file_iterator.h"
 #include "filescan.h"
 #include "page.h"
 #include "page_iterator.h"
+#include <algorithm>
+#include <climits>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <numeric>
+#include <thread>
+#include <sys/wait.h>
+#include <unistd.h>
 #include <vector>
 
 #define checkPassFail(a, b)                                         \
@@ -43,6 +63,8 @@ int testNum = 1;
 const std::string relationName = "relA";
 //If the relation size is changed then the second parameter 2 chechPassFail may need to be changed to number of record that are expected to be found during the scan, else tests will erroneously be reported to have failed.
 const int relationSize = 5000;
+// Number of times each key appears in the relation of test 35
+const int duplicates = 50;
 std::string intIndexName, doubleIndexName, stringIndexName;
 
 // This is the structure for tuples in the base relation
@@ -68,10 +90,76 @@ BufMgr *bufMgr = new BufMgr(100);
 void createRelationForward();
 void createRelationBackward();
 void createRelationRandom();
+void createRelationDuplicates();
+void createRelationGrid();
+void createRelationColumnar();
 void createZeroSizedRelationForward();
 void createNonConsecutiveRelation();
 void intTestsEmptyTree();
+void intBuildModeTests();
 void intTests();
+void doubleTests();
+void stringTests();
+void stringInsertTests();
+void batchScanTests();
+void cursorTests();
+void deleteTests();
+void concurrentBufferTests();
+void concurrentIndexTests();
+void replacementPolicyTests();
+void bufRingTests();
+void readAheadTests();
+void backgroundWriterTests();
+void flushFileTests();
+void durabilityTests();
+void pageListTests();
+int checkPageList(PageFile &file, PageId &lastPageNo);
+void pageCompactionTests();
+void fileScanFilterTests();
+int filteredScan(const ScanFilter *filter, const std::vector<ScanField> &projection, int &numMatching);
+void parallelScanTests();
+void frameMemoryTests();
+void partitionedPoolTests();
+void readOnlyIndexTests();
+void bufStatsTests();
+void indexStatsTests();
+void checkIndexShape(BTreeIndex &index);
+void lookupTests();
+void nodeCacheTests();
+void descendingScanTests();
+void postingLeafTests();
+void coveringIndexTests();
+void compositeIndexTests();
+void fenceKeyTests();
+void writeAheadLogTests();
+void checkpointTests();
+void checksumTests();
+void compressionTests();
+void packedLeafTests();
+void appendTests(const bool ascending);
+void insertBufferTests();
+void asyncReadTests();
+void pageHandleTests();
+void resizeTests();
+void namedPoolTests();
+void hashIndexTests();
+void keyFilterTests();
+void leafModelTests();
+void columnarPageTests();
+void batchFilterTests();
+void openFileTests();
+void defragmentTests();
+void traceTests();
+void sortTests();
+void nodeSearchTests();
+void inPlaceInsertTests();
+void duplicateScanTests();
+void bufLookupTests();
+void bufHashProbeTests();
+void frameStateTests();
+void benchSuiteTests();
+int checkBatchScan(const ScanFilter *filter);
+void checkLeafModelIndex(BTreeIndex &index, const int dups);
 void intNonintNonConTests();
 void intNonConTests();
 void indexNonConsecutiveTests();
@@ -81,6 +169,12 @@ void indexTests();
 void indexEmptyTests();
 void indexOutOfBoundTests();
 int intScan(BTreeIndex *index, int lowVal, Operator lowOp, int highVal, Operator highOp);
+int doubleScan(BTreeIndex *index, double lowVal, Operator lowOp, double highVal, Operator highOp);
+int stringScan(BTreeIndex *index, int lowVal, Operator lowOp, int highVal, Operator highOp);
+template <class T>
+void printScanRange(T lowVal, Operator lowOp, T highVal, Operator highOp);
+int countScan(BTreeIndex *index, const void *lowVal, Operator lowOp, const void *highVal, Operator highOp);
+int batchScan(BTreeIndex *index, const void *lowVal, Operator lowOp, const void *highVal, Operator highOp);
 void test1();
 void test2();
 void test3();
@@ -88,6 +182,64 @@ void test4();
 void test5();
 void test6();
 void test7();
+void test8();
+void test9();
+void test10();
+void test11();
+void test12();
+void test13();
+void test14();
+void test15();
+void test16();
+void test17();
+void test18();
+void test19();
+void test20();
+void test21();
+void test22();
+void test23();
+void test24();
+void test25();
+void test26();
+void test27();
+void test28();
+void test29();
+void test30();
+void test31();
+void test32();
+void test33();
+void test34();
+void test35();
+void test36();
+void test37();
+void test38();
+void test39();
+void test40();
+void test41();
+void test42();
+void test43();
+void test44();
+void test45();
+void test46();
+void test47();
+void test48();
+void test49();
+void test50();
+void test51();
+void test52();
+void test53();
+void test54();
+void test55();
+void test56();
+void test57();
+void test58();
+void test59();
+void test60();
+void test61();
+void test62();
+void test63();
+void test64();
+void test65();
 void errorTests();
 void intTestOutOfBounds();
 void deleteRelation();
@@ -159,8 +311,66 @@ int main(int argc, char **argv)
   test5();
   test6();
   test7();
+  test8();
+  test9();
+  test10();
+  test11();
+  test12();
+  test13();
+  test14();
+  test15();
+  test16();
+  test17();
+  test18();
+  test19();
+  test20();
+  test21();
+  test22();
+  test23();
+  test24();
+  test25();
+  test26();
+  test27();
+  test28();
+  test29();
+  test30();
+  test31();
+  test32();
+  test33();
+  test34();
+  test35();
+  test36();
+  test37();
+  test38();
+  test39();
+  test40();
+  test41();
+  test42();
+  test43();
+  test44();
+  test45();
+  test46();
+  test47();
+  test48();
+  test49();
+  test50();
+  test51();
+  test52();
+  test53();
+  test54();
+  test55();
+  test56();
+  test57();
+  test58();
+  test59();
+  test60();
+  test61();
+  test62();
+  test63();
+  test64();
+  test65();
   intErrorTests();
-  return 1;
+  return 0;
 }
 
 void test1()
@@ -246,575 +456,6220 @@ void test7(){
   std::cout << "\nTest 7 passed\n" << std::endl;
 }
 
+void test8(){
+  // Create a relation with tuples valued 0 to relationSize in random order and build the index
+  // both by bulk loading half-full nodes and by inserting entries one by one
+  std::cout << "--------------------" << std::endl;
+  std::cout << "Test bulk load fill factor and incremental build" << std::endl;
+  createRelationRandom();
+  intBuildModeTests();
+  deleteRelation();
+  std::cout << "\nTest 8 passed\n" << std::endl;
+}
+
+void test9(){
+  // Bulk load a deep index with nearly empty nodes, close it and run the index tests on the
+  // reopened file, which has to rely on the root page recorded in the meta page
+  std::cout << "--------------------" << std::endl;
+  std::cout << "Test reopening a multi-level index" << std::endl;
+  createRelationForward();
+  {
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER, true, 0.01);
+  }
+  indexTests();
+  deleteRelation();
+  std::cout << "\nTest 9 passed\n" << std::endl;
+}
+
+void test10(){
+  // Create a relation with tuples valued 0 to relationSize in random order and perform the
+  // scans of the integer tests on indexes over the double and the string attribute
+  std::cout << "--------------------" << std::endl;
+  std::cout << "Test double and string keys" << std::endl;
+  createRelationRandom();
+  doubleTests();
+  try
+  {
+    File::remove(doubleIndexName);
+  }
+  catch (FileNotFoundException e)
+  {
+  }
+  stringTests();
+  try
+  {
+    File::remove(stringIndexName);
+  }
+  catch (FileNotFoundException e)
+  {
+  }
+  stringInsertTests();
+  try
+  {
+    File::remove(stringIndexName);
+  }
+  catch (FileNotFoundException e)
+  {
+  }
+  deleteRelation();
+  std::cout << "\nTest 10 passed\n" << std::endl;
+}
+
+void test11(){
+  // Create a relation with tuples valued 0 to relationSize and fetch the results of the integer and
+  // string scans in batches
+  std::cout << "--------------------" << std::endl;
+  std::cout << "Test batched scans" << std::endl;
+  createRelationForward();
+  batchScanTests();
+  deleteRelation();
+  std::cout << "\nTest 11 passed\n" << std::endl;
+}
+
+void test12(){
+  // Create a relation with tuples valued 0 to relationSize and run several scans on one index at once
+  std::cout << "--------------------" << std::endl;
+  std::cout << "Test concurrent index cursors" << std::endl;
+  createRelationForward();
+  cursorTests();
+  deleteRelation();
+  std::cout << "\nTest 12 passed\n" << std::endl;
+}
+
+void test13(){
+  // Create a relation with tuples valued 0 to relationSize, delete entries from the integer and
+  // string indexes and insert them again
+  std::cout << "--------------------" << std::endl;
+  std::cout << "Test entry deletion" << std::endl;
+  createRelationForward();
+  deleteTests();
+  deleteRelation();
+  std::cout << "\nTest 13 passed\n" << std::endl;
+}
+
+void test14(){
+  // Create a relation with tuples valued 0 to relationSize and read its pages from several threads
+  // through one buffer pool that is much smaller than the relation
+  std::cout << "--------------------" << std::endl;
+  std::cout << "Test concurrent buffer manager" << std::endl;
+  createRelationForward();
+  concurrentBufferTests();
+  deleteRelation();
+  std::cout << "\nTest 14 passed\n" << std::endl;
+}
+
+void test15(){
+  // Create a relation with tuples valued 0 to relationSize and insert and delete entries of an
+  // integer index from several threads while other threads scan it
+  std::cout << "--------------------" << std::endl;
+  std::cout << "Test concurrent index" << std::endl;
+  createRelationForward();
+  concurrentIndexTests();
+  deleteRelation();
+  std::cout << "\nTest 15 passed\n" << std::endl;
+}
+
+void test16(){
+  // Create a relation with tuples valued 0 to relationSize and run the integer index tests with
+  // every replacement policy of the buffer manager
+  std::cout << "--------------------" << std::endl;
+  std::cout << "Test buffer replacement policies" << std::endl;
+  createRelationForward();
+  replacementPolicyTests();
+  deleteRelation();
+  std::cout << "\nTest 16 passed\n" << std::endl;
+}
+
+void test17(){
+  // Create a relation with tuples valued 0 to relationSize and scan it through a buffer pool
+  // holding another page that the scan must not evict
+  std::cout << "--------------------" << std::endl;
+  std::cout << "Test scans through buffer rings" << std::endl;
+  createRelationForward();
+  bufRingTests();
+  deleteRelation();
+  std::cout << "\nTest 17 passed\n" << std::endl;
+}
+
+void test18(){
+  // Create a relation with tuples valued 0 to relationSize and run the integer index tests through
+  // a buffer manager reading ahead
+  std::cout << "--------------------" << std::endl;
+  std::cout << "Test read-ahead" << std::endl;
+  createRelationForward();
+  readAheadTests();
+  deleteRelation();
+  std::cout << "\nTest 18 passed\n" << std::endl;
+}
+
+void test19(){
+  // Create a relation with tuples valued 0 to relationSize and run the integer index tests through
+  // a buffer manager writing dirty pages back in the background
+  std::cout << "--------------------" << std::endl;
+  std::cout << "Test background writer" << std::endl;
+  createRelationForward();
+  backgroundWriterTests();
+  deleteRelation();
+  std::cout << "\nTest 19 passed\n" << std::endl;
+}
+
+void test20(){
+  // Create a relation with tuples valued 0 to relationSize and flush it while pages of another file
+  // are in the buffer pool
+  std::cout << "--------------------" << std::endl;
+  std::cout << "Test flushing one file" << std::endl;
+  createRelationForward();
+  flushFileTests();
+  deleteRelation();
+  std::cout << "\nTest 20 passed\n" << std::endl;
+}
+
+void test21(){
+  // Write pages to a file in every durability mode and open it again
+  std::cout << "--------------------" << std::endl;
+  std::cout << "Test durability modes" << std::endl;
+  durabilityTests();
+  std::cout << "\nTest 21 passed\n" << std::endl;
+}
+
+void test22(){
+  // Run the integer index tests, the concurrent index tests and the durability tests on files
+  // opened with positional I/O
+  std::cout << "--------------------" << std::endl;
+  std::cout << "Test positional I/O" << std::endl;
+  File::setIoBackend(IO_POSITIONAL);
+  createRelationForward();
+  intTests();
+  try
+  {
+    File::remove(intIndexName);
+  }
+  catch (FileNotFoundException e)
+  {
+  }
+  concurrentIndexTests();
+  readAheadTests();
+  deleteRelation();
+  durabilityTests();
+  File::setIoBackend(IO_STREAM);
+  std::cout << "\nTest 22 passed\n" << std::endl;
+}
+
+void test23(){
+  // Allocate and delete pages at both ends and in the middle of a file
+  std::cout << "--------------------" << std::endl;
+  std::cout << "Test page list" << std::endl;
+  pageListTests();
+  std::cout << "\nTest 23 passed\n" << std::endl;
+}
+
+void test24(){
+  // Fill a page again after deleting records from the middle of its data
+  std::cout << "--------------------" << std::endl;
+  std::cout << "Test page compaction" << std::endl;
+  pageCompactionTests();
+  std::cout << "\nTest 24 passed\n" << std::endl;
+}
+
+void test25(){
+  // Create a relation with tuples valued 0 to relationSize and scan it with filters and projections
+  std::cout << "--------------------" << std::endl;
+  std::cout << "Test filtered file scans" << std::endl;
+  createRelationForward();
+  fileScanFilterTests();
+  deleteRelation();
+  std::cout << "\nTest 25 passed\n" << std::endl;
+}
+
+void test26(){
+  // Create a relation with tuples valued 0 to relationSize and scan it with several threads
+  std::cout << "--------------------" << std::endl;
+  std::cout << "Test parallel file scans" << std::endl;
+  createRelationForward();
+  parallelScanTests();
+  deleteRelation();
+  std::cout << "\nTest 26 passed\n" << std::endl;
+}
+
+void test27(){
+  // Create a relation with tuples valued 0 to relationSize and run the integer index tests through
+  // buffer pools mapped in every kind of memory
+  std::cout << "--------------------" << std::endl;
+  std::cout << "Test frame memory" << std::endl;
+  createRelationForward();
+  frameMemoryTests();
+  deleteRelation();
+  std::cout << "\nTest 27 passed\n" << std::endl;
+}
+
+void test28(){
+  // Create a relation with tuples valued 0 to relationSize and use it through buffer pools split
+  // into partitions
+  std::cout << "--------------------" << std::endl;
+  std::cout << "Test partitioned buffer pools" << std::endl;
+  createRelationForward();
+  partitionedPoolTests();
+  deleteRelation();
+  std::cout << "\nTest 28 passed\n" << std::endl;
+}
+
+void test29(){
+  // Create a relation with tuples valued 0 to relationSize and open its indexes read-only
+  std::cout << "--------------------" << std::endl;
+  std::cout << "Test read-only indexes" << std::endl;
+  createRelationForward();
+  readOnlyIndexTests();
+  deleteRelation();
+  std::cout << "\nTest 29 passed\n" << std::endl;
+}
+
+void test30(){
+  // Create a relation with tuples valued 0 to relationSize and count its accesses through the buffer
+  // pool statistics
+  std::cout << "--------------------" << std::endl;
+  std::cout << "Test buffer pool statistics" << std::endl;
+  createRelationForward();
+  bufStatsTests();
+  deleteRelation();
+  std::cout << "\nTest 30 passed\n" << std::endl;
+}
+
+void test31(){
+  // Create a relation with tuples valued 0 to relationSize and compare the statistics kept by its
+  // indexes with the shape found by walking them
+  std::cout << "--------------------" << std::endl;
+  std::cout << "Test index statistics" << std::endl;
+  createRelationForward();
+  indexStatsTests();
+  deleteRelation();
+  std::cout << "\nTest 31 passed\n" << std::endl;
+}
+
+void test32(){
+  // Create a relation with tuples valued 0 to relationSize in random order and look up single keys
+  std::cout << "--------------------" << std::endl;
+  std::cout << "Test point lookups" << std::endl;
+  createRelationRandom();
+  lookupTests();
+  deleteRelation();
+  std::cout << "\nTest 32 passed\n" << std::endl;
+}
+
+void test33(){
+  // Create a relation with tuples valued 0 to relationSize in random order and descend through
+  // the upper level node cache
+  std::cout << "--------------------" << std::endl;
+  std::cout << "Test upper level node cache" << std::endl;
+  createRelationRandom();
+  nodeCacheTests();
+  deleteRelation();
+  std::cout << "\nTest 33 passed\n" << std::endl;
+}
+
+void test34(){
+  // Create a relation with tuples valued 0 to relationSize in random order and scan ranges of its
+  // indexes from the high bound down, and with open ends
+  std::cout << "--------------------" << std::endl;
+  std::cout << "Test descending and open-ended scans" << std::endl;
+  createRelationRandom();
+  descendingScanTests();
+  deleteRelation();
+  std::cout << "\nTest 34 passed\n" << std::endl;
+}
+
+void test35(){
+  // Create a relation whose keys each appear duplicates times and index it with leaves holding
+  // postings
+  std::cout << "--------------------" << std::endl;
+  std::cout << "Test posting leaves" << std::endl;
+  createRelationDuplicates();
+  postingLeafTests();
+  deleteRelation();
+  std::cout << "\nTest 35 passed\n" << std::endl;
+}
+
+void test36(){
+  // Create a relation with tuples valued 0 to relationSize in random order and scan the included
+  // attributes of a covering index on it
+  std::cout << "--------------------" << std::endl;
+  std::cout << "Test covering index" << std::endl;
+  createRelationRandom();
+  coveringIndexTests();
+  deleteRelation();
+  std::cout << "\nTest 36 passed\n" << std::endl;
+}
+
+void test37(){
+  // Create a relation whose tuples are the points of a grid over i and d and scan prefixes of a
+  // composite index on (i, d)
+  std::cout << "--------------------" << std::endl;
+  std::cout << "Test composite index" << std::endl;
+  createRelationGrid();
+  compositeIndexTests();
+  deleteRelation();
+  std::cout << "\nTest 37 passed\n" << std::endl;
+}
+
+void test38(){
+  // Create a relation with tuples valued 0 to relationSize, delete a range of keys from its index
+  // and look for keys in the gap left behind
+  std::cout << "--------------------" << std::endl;
+  std::cout << "Test fence keys" << std::endl;
+  createRelationForward();
+  fenceKeyTests();
+  deleteRelation();
+  std::cout << "\nTest 38 passed\n" << std::endl;
+}
+
+void test39(){
+  // Create a relation with tuples valued 0 to relationSize, change its index with a write-ahead
+  // log in a process that then dies, and recover the index from the log
+  std::cout << "--------------------" << std::endl;
+  std::cout << "Test write-ahead log" << std::endl;
+  createRelationForward();
+  writeAheadLogTests();
+  deleteRelation();
+  std::cout << "\nTest 39 passed\n" << std::endl;
+}
+
+void test40(){
+  // Create a relation with tuples valued 0 to relationSize, change its index with a write-ahead
+  // log taking checkpoints in a process that then dies, and recover the index from the last one
+  std::cout << "--------------------" << std::endl;
+  std::cout << "Test checkpoints" << std::endl;
+  createRelationForward();
+  checkpointTests();
+  deleteRelation();
+  std::cout << "\nTest 40 passed\n" << std::endl;
+}
+
+void test41(){
+  // Write pages of both kinds of files through a pool, damage them on disk and read them again
+  std::cout << "--------------------" << std::endl;
+  std::cout << "Test page checksums" << std::endl;
+  checksumTests();
+  std::cout << "\nTest 41 passed\n" << std::endl;
+}
+
+void test42(){
+  // Create a relation with tuples valued 0 to relationSize and index it in a file of compressed
+  // pages, change it, reopen it and recover it from a log
+  std::cout << "--------------------" << std::endl;
+  std::cout << "Test page compression" << std::endl;
+  createRelationForward();
+  compressionTests();
+  deleteRelation();
+  std::cout << "\nTest 42 passed\n" << std::endl;
+}
+
+void test43(){
+  // Create a relation with tuples valued 0 to relationSize, whose dense keys are packed into the
+  // leaves of its index, and widen, split and shrink the packed leaves
+  std::cout << "--------------------" << std::endl;
+  std::cout << "Test packed integer leaves" << std::endl;
+  createRelationForward();
+  packedLeafTests();
+  deleteRelation();
+  std::cout << "\nTest 43 passed\n" << std::endl;
+}
+
+void test44(){
+  // Index relations inserted in ascending, descending and random order one entry at a time, which
+  // goes straight to the rightmost leaf for ascending keys
+  std::cout << "--------------------" << std::endl;
+  std::cout << "Test ascending inserts" << std::endl;
+  createRelationForward();
+  appendTests(true);
+  deleteRelation();
+  createRelationBackward();
+  appendTests(false);
+  deleteRelation();
+  createRelationRandom();
+  appendTests(false);
+  deleteRelation();
+  std::cout << "\nTest 44 passed\n" << std::endl;
+}
+
+void test45(){
+  // Create a relation with tuples valued 0 to relationSize in random order and insert a second entry
+  // for its keys in random order through an insert buffer, reading the index in between
+  std::cout << "--------------------" << std::endl;
+  std::cout << "Test insert buffer" << std::endl;
+  createRelationRandom();
+  insertBufferTests();
+  deleteRelation();
+  std::cout << "\nTest 45 passed\n" << std::endl;
+}
+
+void test46(){
+  // Read the pages of a file through a pool with many reads in flight at once
+  std::cout << "--------------------" << std::endl;
+  std::cout << "Test asynchronous page reads" << std::endl;
+  asyncReadTests();
+  std::cout << "\nTest 46 passed\n" << std::endl;
+}
+
+void test47(){
+  // Pin pages through handles that unpin them when released, moved or unwound
+  std::cout << "--------------------" << std::endl;
+  std::cout << "Test page handles" << std::endl;
+  pageHandleTests();
+  std::cout << "\nTest 47 passed\n" << std::endl;
+}
+
+void test48(){
+  // Grow and shrink pools of every replacement policy, with pages pinned, dirty, and read by other
+  // threads meanwhile
+  std::cout << "--------------------" << std::endl;
+  std::cout << "Test buffer pool resizing" << std::endl;
+  resizeTests();
+  std::cout << "\nTest 48 passed\n" << std::endl;
+}
+
+void test49(){
+  // Create a relation with tuples valued 0 to relationSize and index it through a buffer manager
+  // keeping the index pages in a pool of their own, which scans of the relation do not evict
+  std::cout << "--------------------" << std::endl;
+  std::cout << "Test named buffer pools" << std::endl;
+  createRelationForward();
+  namedPoolTests();
+  deleteRelation();
+  std::cout << "\nTest 49 passed\n" << std::endl;
+}
+
+void test50(){
+  // Create a relation with tuples valued 0 to relationSize in random order and build hash indexes over
+  // its INTEGER, DOUBLE and STRING attributes
+  std::cout << "--------------------" << std::endl;
+  std::cout << "Test extendible hash index" << std::endl;
+  createRelationRandom();
+  hashIndexTests();
+  deleteRelation();
+  std::cout << "\nTest 50 passed\n" << std::endl;
+}
+
+void test51(){
+  // Create a relation with tuples valued 0 to relationSize and probe its index for keys it does not
+  // hold through a key filter
+  std::cout << "--------------------" << std::endl;
+  std::cout << "Test key filter" << std::endl;
+  createRelationForward();
+  keyFilterTests();
+  deleteRelation();
+  std::cout << "\nTest 51 passed\n" << std::endl;
+}
+
+void test52(){
+  // Create a relation with tuples valued 0 to relationSize in random order, index it, and find the
+  // leaves of the index reopened read-only through a model of its leaf level
+  std::cout << "--------------------" << std::endl;
+  std::cout << "Test learned leaf model" << std::endl;
+  createRelationRandom();
+  leafModelTests();
+  deleteRelation();
+  std::cout << "\nTest 52 passed\n" << std::endl;
+}
+
+void test53(){
+  // Create a relation with tuples valued 0 to relationSize in random order on columnar pages, scan it
+  // and index it
+  std::cout << "--------------------" << std::endl;
+  std::cout << "Test columnar pages" << std::endl;
+  createRelationColumnar();
+  columnarPageTests();
+  deleteRelation();
+  std::cout << "\nTest 53 passed\n" << std::endl;
+}
+
+void test54(){
+  // Create a relation with tuples valued 0 to relationSize in random order, on slotted and then on
+  // columnar pages, and scan it with filters evaluated a page at a time
+  std::cout << "--------------------" << std::endl;
+  std::cout << "Test page at a time filters" << std::endl;
+  createRelationRandom();
+  batchFilterTests();
+  deleteRelation();
+  createRelationColumnar();
+  batchFilterTests();
+  deleteRelation();
+  std::cout << "\nTest 54 passed\n" << std::endl;
+}
+
+void test55(){
+  // Open files by more than one name and check that they are opened once
+  std::cout << "--------------------" << std::endl;
+  std::cout << "Test open file registry" << std::endl;
+  openFileTests();
+  std::cout << "\nTest 55 passed\n" << std::endl;
+}
+
+void test56(){
+  // Create a relation with tuples valued 0 to relationSize in random order, index it by inserts and
+  // rebuild the index while it is scanned
+  std::cout << "--------------------" << std::endl;
+  std::cout << "Test online defragmentation" << std::endl;
+  createRelationRandom();
+  defragmentTests();
+  deleteRelation();
+  std::cout << "\nTest 56 passed\n" << std::endl;
+}
+
+void test57(){
+  // Create a relation with tuples valued 0 to relationSize in random order and trace the operations
+  // on its index
+  std::cout << "--------------------" << std::endl;
+  std::cout << "Test operation tracing" << std::endl;
+  createRelationRandom();
+  traceTests();
+  deleteRelation();
+  std::cout << "\nTest 57 passed\n" << std::endl;
+}
+
+void test58(){
+  // Sort more records than the memory given to the sort, and bulk load and rebuild an index of a
+  // relation with tuples valued 0 to relationSize in random order with a sort that spills
+  std::cout << "--------------------" << std::endl;
+  std::cout << "Test external sort" << std::endl;
+  createRelationRandom();
+  sortTests();
+  deleteRelation();
+  std::cout << "\nTest 58 passed\n" << std::endl;
+}
+
+void test59(){
+  // Create a relation with tuples valued 0 to relationSize in random order, insert even keys past it
+  // and look up every key and the gaps between them
+  std::cout << "--------------------" << std::endl;
+  std::cout << "Test node occupancy counts and key search" << std::endl;
+  createRelationRandom();
+  nodeSearchTests();
+  deleteRelation();
+  std::cout << "\nTest 59 passed\n" << std::endl;
+}
+
+void test60(){
+  // Create a relation with tuples valued 0 to relationSize in random order and insert keys at the
+  // front and the end of nodes and strided over them, shifting entries and splitting nodes in place
+  std::cout << "--------------------" << std::endl;
+  std::cout << "Test in-place node inserts and splits" << std::endl;
+  createRelationRandom();
+  inPlaceInsertTests();
+  deleteRelation();
+  std::cout << "\nTest 60 passed\n" << std::endl;
+}
+
+void test61(){
+  // Create a relation with tuples valued 0 to relationSize in random order, insert three keys past it
+  // thousands of times each and scan from each of them
+  std::cout << "--------------------" << std::endl;
+  std::cout << "Test scans from keys with duplicates spanning leaves" << std::endl;
+  createRelationRandom();
+  duplicateScanTests();
+  deleteRelation();
+  std::cout << "\nTest 61 passed\n" << std::endl;
+}
+
+void test62(){
+  // Look up pages present and missing in the buffer hash table and the buffer manager without
+  // exceptions on the hit and miss paths
+  std::cout << "--------------------" << std::endl;
+  std::cout << "Test non-throwing buffer lookups" << std::endl;
+  bufLookupTests();
+  std::cout << "\nTest 62 passed\n" << std::endl;
+}
+
+void test63(){
+  // Remove entries from the middle of a probe run of the buffer hash table and find the entries
+  // after them
+  std::cout << "--------------------" << std::endl;
+  std::cout << "Test backward-shift deletion in the buffer hash table" << std::endl;
+  bufHashProbeTests();
+  std::cout << "\nTest 63 passed\n" << std::endl;
+}
+
+void test64(){
+  // Pin, unpin and evict pages of a small pool, checking that the state word of each frame keeps
+  // pin counts and lets only unpinned frames be reused
+  std::cout << "--------------------" << std::endl;
+  std::cout << "Test frame state through pinning and eviction" << std::endl;
+  frameStateTests();
+  std::cout << "\nTest 64 passed\n" << std::endl;
+}
+
+void test65(){
+  // Run the microbenchmarks on a small relation and check the lines they print, their exit status and
+  // that runs with the same seed do the same work
+  std::cout << "--------------------" << std::endl;
+  std::cout << "Test the microbenchmark suite" << std::endl;
+  benchSuiteTests();
+  std::cout << "\nTest 65 passed\n" << std::endl;
+}
+
+// -----------------------------------------------------------------------------
+// createRelationDuplicates
+// -----------------------------------------------------------------------------
+void createRelationDuplicates()
+{
+  // destroy any old copies of relation file
+  try
+  {
+    File::remove(relationName);
+  }
+  catch (FileNotFoundException e)
+  {
+  }
+
+  file1 = new PageFile(relationName, true);
+  // initialize all of record1.s to keep purify happy
+  memset(record1.s, ' ', sizeof(record1.s));
+  PageId new_page_number;
+  Page new_page = file1->allocatePage(new_page_number);
+
+  // Insert relationSize / duplicates keys, each duplicates times.
+  for (int i = 0; i < relationSize; i++)
+  {
+    const int key = i % (relationSize / duplicates);
+    sprintf(record1.s, "%05d string record", key);
+    record1.i = key;
+    record1.d = (double)key;
+    std::string new_data(reinterpret_cast<char *>(&record1), sizeof(record1));
+
+    while (1)
+    {
+      try
+      {
+        new_page.insertRecord(new_data);
+        break;
+      }
+      catch (InsufficientSpaceException e)
+      {
+        file1->writePage(new_page_number, new_page);
+        new_page = file1->allocatePage(new_page_number);
+      }
+    }
+  }
+  file1->writePage(new_page_number, new_page);
+}
+
+// -----------------------------------------------------------------------------
+// createRelationColumnar
+// -----------------------------------------------------------------------------
+void createRelationColumnar()
+{
+  // destroy any old copies of relation file
+  try
+  {
+    File::remove(relationName);
+  }
+  catch (FileNotFoundException e)
+  {
+  }
+
+  // the columns of the tuples: i, the padding before d, d and s
+  const std::uint16_t tupleWidths[] = {sizeof(int), offsetof(tuple, d) - sizeof(int), sizeof(double),
+    sizeof(((tuple*)0)->s)};
+  {
+    PageFile file = PageFile::create(relationName, std::vector<std::uint16_t>(tupleWidths, tupleWidths + 4));
+  }
+  file1 = new PageFile(relationName, false);
+  // initialize all of record1.s to keep purify happy
+  memset(record1.s, ' ', sizeof(record1.s));
+  PageId new_page_number;
+  Page new_page = file1->allocatePage(new_page_number);
+
+  // insert records in random order
+  std::vector<int> intvec(relationSize);
+  for (int i = 0; i < relationSize; i++)
+  {
+    intvec[i] = i;
+  }
+  std::random_shuffle(intvec.begin(), intvec.end());
+
+  for (int i = 0; i < relationSize; i++)
+  {
+    sprintf(record1.s, "%05d string record", intvec[i]);
+    record1.i = intvec[i];
+    record1.d = intvec[i];
+    std::string new_data(reinterpret_cast<char *>(&record1), sizeof(record1));
+    if (!new_page.hasSpaceForRecord(new_data))
+    {
+      file1->writePage(new_page_number, new_page);
+      new_page = file1->allocatePage(new_page_number);
+    }
+    new_page.insertRecord(new_data);
+  }
+  file1->writePage(new_page_number, new_page);
+}
+
+// -----------------------------------------------------------------------------
+// createRelationGrid
+// -----------------------------------------------------------------------------
+void createRelationGrid()
+{
+  // destroy any old copies of relation file
+  try
+  {
+    File::remove(relationName);
+  }
+  catch (FileNotFoundException e)
+  {
+  }
+
+  file1 = new PageFile(relationName, true);
+  // initialize all of record1.s to keep purify happy
+  memset(record1.s, ' ', sizeof(record1.s));
+  PageId new_page_number;
+  Page new_page = file1->allocatePage(new_page_number);
+
+  // Insert the tuple of key k with i = k / 100 - 25 and d = k % 100 - 49.5, backwards, so that
+  // both attributes take negative values and no attribute alone orders the tuples.
+  for (int key = relationSize - 1; key >= 0; key--)
+  {
+    sprintf(record1.s, "%05d string record", key);
+    record1.i = key / 100 - 25;
+    record1.d = key % 100 - 49.5;
+    std::string new_data(reinterpret_cast<char *>(&record1), sizeof(record1));
+
+    while (1)
+    {
+      try
+      {
+        new_page.insertRecord(new_data);
+        break;
+      }
+      catch (InsufficientSpaceException e)
+      {
+        file1->writePage(new_page_number, new_page);
+        new_page = file1->allocatePage(new_page_number);
+      }
+    }
+  }
+  file1->writePage(new_page_number, new_page);
+}
+
+// -----------------------------------------------------------------------------
+// createNonConsecutiveRelationForward
+// -----------------------------------------------------------------------------
+void createNonConsecutiveRelation()
+{
+  std::vector<RecordId> ridVec;
+  // destroy any old copies of relation file
+  try
+  {
+    File::remove(relationName);
+  }
+  catch (FileNotFoundException e)
+  {
+  }
+
+  file1 = new PageFile(relationName, true);
+  // initialize all of record1.s to keep purify happy
+  memset(record1.s, ' ', sizeof(record1.s));
+  PageId new_page_number;
+  Page new_page = file1->allocatePage(new_page_number);
+
+  // Insert a bunch of tuples into the relation.
+  for (int i = 0; i < relationSize; i++)
+  {
+    sprintf(record1.s, "%05d string record", 2*i);
+    record1.i = 2*i;
+    record1.d = 2.0*(double)i;
+    std::string new_data(reinterpret_cast<char *>(&record1), sizeof(record1));
+
+    while (1)
+    {
+      try
+      {
+        new_page.insertRecord(new_data);
+        break;
+      }
+      catch (InsufficientSpaceException e)
+      {
+        file1->writePage(new_page_number, new_page);
+        new_page = file1->allocatePage(new_page_number);
+      }
+    }
+  }
+  file1->writePage(new_page_number, new_page);
+}
+
+// -----------------------------------------------------------------------------
+// createZeroRelationForward
+// -----------------------------------------------------------------------------
+void createZeroSizedRelationForward()
+{
+  std::vector<RecordId> ridVec;
+  // destroy any old copies of relation file
+  try
+  {
+    File::remove(relationName);
+  }
+  catch (FileNotFoundException e)
+  {
+  }
+  file1 = new PageFile(relationName, true);
+
+  // initialize all of record1.s to keep purify happy
+  memset(record1.s, ' ', sizeof(record1.s));
+  PageId new_page_number;
+  Page new_page = file1->allocatePage(new_page_number);
+  file1->writePage(new_page_number, new_page);
+}
+
+// -----------------------------------------------------------------------------
+// createRelationForward
+// -----------------------------------------------------------------------------
+void createRelationForward()
+{
+  std::vector<RecordId> ridVec;
+  // destroy any old copies of relation file
+  try
+  {
+    File::remove(relationName);
+  }
+  catch (FileNotFoundException e)
+  {
+  }
+
+  file1 = new PageFile(relationName, true);
+  // initialize all of record1.s to keep purify happy
+  memset(record1.s, ' ', sizeof(record1.s));
+  PageId new_page_number;
+  Page new_page = file1->allocatePage(new_page_number);
+
+  // Insert a bunch of tuples into the relation.
+  for (int i = 0; i < relationSize; i++)
+  {
+    sprintf(record1.s, "%05d string record", i);
+    record1.i = i;
+    record1.d = (double)i;
+    std::string new_data(reinterpret_cast<char *>(&record1), sizeof(record1));
+
+    while (1)
+    {
+      try
+      {
+        new_page.insertRecord(new_data);
+        break;
+      }
+      catch (InsufficientSpaceException e)
+      {
+        file1->writePage(new_page_number, new_page);
+        new_page = file1->allocatePage(new_page_number);
+      }
+    }
+  }
+  file1->writePage(new_page_number, new_page);
+}
+
+// -----------------------------------------------------------------------------
+// createRelationBackward
+// -----------------------------------------------------------------------------
+void createRelationBackward()
+{
+  // destroy any old copies of relation file
+  try
+  {
+    File::remove(relationName);
+  }
+  catch (FileNotFoundException e)
+  {
+  }
+  file1 = new PageFile(relationName, true);
+
+  // initialize all of record1.s to keep purify happy
+  memset(record1.s, ' ', sizeof(record1.s));
+  PageId new_page_number;
+  Page new_page = file1->allocatePage(new_page_number);
+
+  // Insert a bunch of tuples into the relation.
+  for (int i = relationSize - 1; i >= 0; i--)
+  {
+    sprintf(record1.s, "%05d string record", i);
+    record1.i = i;
+    record1.d = i;
+
+    std::string new_data(reinterpret_cast<char *>(&record1), sizeof(RECORD));
+
+    while (1)
+    {
+      try
+      {
+        new_page.insertRecord(new_data);
+        break;
+      }
+      catch (InsufficientSpaceException e)
+      {
+        file1->writePage(new_page_number, new_page);
+        new_page = file1->allocatePage(new_page_number);
+      }
+    }
+  }
+  file1->writePage(new_page_number, new_page);
+}
+
+// -----------------------------------------------------------------------------
+// createRelationRandom
+// -----------------------------------------------------------------------------
+void createRelationRandom()
+{
+  // destroy any old copies of relation file
+  try
+  {
+    File::remove(relationName);
+  }
+  catch (FileNotFoundException e)
+  {
+  }
+  file1 = new PageFile(relationName, true);
+
+  // initialize all of record1.s to keep purify happy
+  memset(record1.s, ' ', sizeof(record1.s));
+  PageId new_page_number;
+  Page new_page = file1->allocatePage(new_page_number);
+
+  // insert records in random order
+
+  std::vector<int> intvec(relationSize);
+  for (int i = 0; i < relationSize; i++)
+  {
+    intvec[i] = i;
+  }
+
+  long pos;
+  int val;
+  int i = 0;
+  while (i < relationSize)
+  {
+    pos = random() % (relationSize - i);
+    val = intvec[pos];
+    sprintf(record1.s, "%05d string record", val);
+    record1.i = val;
+    record1.d = val;
+
+    std::string new_data(reinterpret_cast<char *>(&record1), sizeof(RECORD));
+
+    while (1)
+    {
+      try
+      {
+        new_page.insertRecord(new_data);
+        break;
+      }
+      catch (InsufficientSpaceException e)
+      {
+        file1->writePage(new_page_number, new_page);
+        new_page = file1->allocatePage(new_page_number);
+      }
+    }
+
+    int temp = intvec[relationSize - 1 - i];
+    intvec[relationSize - 1 - i] = intvec[pos];
+    intvec[pos] = temp;
+    i++;
+  }
+
+  file1->writePage(new_page_number, new_page);
+}
+
+// -----------------------------------------------------------------------------
+// indexTests
+// -----------------------------------------------------------------------------
+
+void indexTests()
+{
+  if (testNum == 1)
+  {
+    intTests();
+    try
+    {
+      std::cout << "try to remove: " << intIndexName << "\n";
+      File::remove(intIndexName);
+    }
+    catch (FileNotFoundException e)
+    {
+    }    
+  }
+}
+
+void indexTestsWithoutRemove()
+{
+  if (testNum == 1)
+  {
+    intTests();    
+  }
+}
+
+void indexEmptyTests(){
+  if(testNum == 1){
+    intTestsEmptyTree();
+    try
+    {
+      File::remove(intIndexName);
+    }
+    catch (FileNotFoundException e)
+    {
+    }  
+  }
+}
+
+void indexOutOfBoundTests(){
+  if(testNum == 1){
+    intTestOutOfBounds();
+    try
+    {
+      std::cout << "try to remove: " << intIndexName << "\n";
+      File::remove(intIndexName);
+    }
+    catch (FileNotFoundException e)
+    {
+    }  
+  }
+}
+
+void indexNonConsecutiveTests(){
+  if(testNum == 1){
+    intNonConTests();
+    try
+    {
+      std::cout << "try to remove: " << intIndexName << "\n";
+      File::remove(intIndexName);
+    }
+    catch (FileNotFoundException e)
+    {
+    }  
+  }
+}
+
+void intErrorTests(){
+  if(testNum == 1){
+    errorTests();
+    try
+    {
+      std::cout << "try to remove: " << intIndexName << "\n";
+      File::remove(intIndexName);
+    }
+    catch (FileNotFoundException e)
+    {
+    }  
+  }
+}
+
+
+
+void intTestOutOfBounds() {
+  std::cout << "Create a B+ Tree index on the integer field" << std::endl;
+  BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER);
+
+  checkPassFail(intScan(&index, -1000000, GT, 100000, LT), relationSize) 
+}
+
+// -----------------------------------------------------------------------------
+// intTests
+// -----------------------------------------------------------------------------
+
+void intTests()
+{
+  std::cout << "Create a B+ Tree index on the integer field" << std::endl;
+  BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER);
+
+  // run some tests
+  checkPassFail(intScan(&index, 25, GT, 40, LT), 14)
+      checkPassFail(intScan(&index, 20, GTE, 35, LTE), 16)
+          checkPassFail(intScan(&index, -3, GT, 3, LT), 3)
+              checkPassFail(intScan(&index, 996, GT, 1001, LT), 4)
+                  checkPassFail(intScan(&index, 0, GT, 1, LT), 0)
+                      checkPassFail(intScan(&index, 300, GT, 400, LT), 99)
+                          checkPassFail(intScan(&index, 3000, GTE, 4000, LT), 1000)
+}
+
+void intBuildModeTests()
+{
+  {
+    std::cout << "Bulk load a B+ Tree index on the integer field with fill factor 0.5" << std::endl;
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER, true, 0.5);
+
+    checkPassFail(intScan(&index, 25, GT, 40, LT), 14)
+        checkPassFail(intScan(&index, 3000, GTE, 4000, LT), 1000)
+            checkPassFail(intScan(&index, -1000000, GT, 100000, LT), relationSize)
+  }
+  File::remove(intIndexName);
+
+  {
+    std::cout << "Build a B+ Tree index on the integer field with insertEntry" << std::endl;
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER, false);
+
+    checkPassFail(intScan(&index, 25, GT, 40, LT), 14)
+        checkPassFail(intScan(&index, 3000, GTE, 4000, LT), 1000)
+            checkPassFail(intScan(&index, -1000000, GT, 100000, LT), relationSize)
+  }
+  File::remove(intIndexName);
+
+  {
+    // fill factors outside (0, 1] are rejected before the index file is created
+    const double badFills[] = {0, -0.5, 1.5};
+    int numRejected = 0;
+    for (int f = 0; f < 3; f++)
+    {
+      try
+      {
+        BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER, true, badFills[f]);
+      }
+      catch (BadIndexInfoException e)
+      {
+        numRejected++;
+      }
+    }
+    checkPassFail(numRejected, 3)
+    checkPassFail(File::exists(intIndexName), false)
+  }
+}
+
+// -----------------------------------------------------------------------------
+// doubleTests
+// -----------------------------------------------------------------------------
+
+void doubleTests()
+{
+  std::cout << "Create a B+ Tree index on the double field" << std::endl;
+  BTreeIndex index(relationName, doubleIndexName, bufMgr, offsetof(tuple, d), DOUBLE);
+
+  // run some tests
+  checkPassFail(doubleScan(&index, 25, GT, 40, LT), 14)
+      checkPassFail(doubleScan(&index, 20, GTE, 35, LTE), 16)
+          checkPassFail(doubleScan(&index, -3, GT, 3, LT), 3)
+              checkPassFail(doubleScan(&index, 996, GT, 1001, LT), 4)
+                  checkPassFail(doubleScan(&index, 0, GT, 1, LT), 0)
+                      checkPassFail(doubleScan(&index, 24.5, GT, 26.5, LT), 2)
+                          checkPassFail(doubleScan(&index, 3000, GTE, 4000, LT), 1000)
+}
+
+// -----------------------------------------------------------------------------
+// stringTests
+// -----------------------------------------------------------------------------
+
+void stringTests()
+{
+  std::cout << "Create a B+ Tree index on the string field" << std::endl;
+  BTreeIndex index(relationName, stringIndexName, bufMgr, offsetof(tuple, s), STRING);
+
+  // run some tests; bounds are formatted like the records, so "00025 stri" is the key of 25
+  checkPassFail(stringScan(&index, 25, GT, 40, LT), 14)
+      checkPassFail(stringScan(&index, 20, GTE, 35, LTE), 16)
+          checkPassFail(stringScan(&index, 996, GT, 1001, LT), 4)
+              checkPassFail(stringScan(&index, 0, GT, 1, LT), 0)
+                  checkPassFail(stringScan(&index, 300, GT, 400, LT), 99)
+                      checkPassFail(stringScan(&index, 3000, GTE, 4000, LT), 1000)
+}
+
+void stringInsertTests()
+{
+  std::cout << "Build a B+ Tree index on the string field with insertEntry" << std::endl;
+  BTreeIndex index(relationName, stringIndexName, bufMgr, offsetof(tuple, s), STRING, false);
+
+  checkPassFail(stringScan(&index, 25, GT, 40, LT), 14)
+      checkPassFail(stringScan(&index, 20, GTE, 35, LTE), 16)
+          checkPassFail(stringScan(&index, 3000, GTE, 4000, LT), 1000)
+}
+
+// -----------------------------------------------------------------------------
+// batchScanTests
+// -----------------------------------------------------------------------------
+
+void batchScanTests()
+{
+  {
+    std::cout << "Scan a B+ Tree index on the integer field in batches" << std::endl;
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER);
+    int lowVal = 25, highVal = 40;
+    checkPassFail(batchScan(&index, &lowVal, GT, &highVal, LT), 14)
+    lowVal = 20; highVal = 35;
+    checkPassFail(batchScan(&index, &lowVal, GTE, &highVal, LTE), 16)
+    lowVal = 3000; highVal = 4000;
+    checkPassFail(batchScan(&index, &lowVal, GTE, &highVal, LT), 1000)
+    lowVal = -1000; highVal = 100000;
+    checkPassFail(batchScan(&index, &lowVal, GT, &highVal, LT), relationSize)
+  }
+  File::remove(intIndexName);
+
+  {
+    std::cout << "Scan a B+ Tree index on the string field in batches" << std::endl;
+    BTreeIndex index(relationName, stringIndexName, bufMgr, offsetof(tuple, s), STRING);
+    char lowValStr[31] = "00300 string record";
+    char highValStr[31] = "00400 string record";
+    checkPassFail(batchScan(&index, lowValStr, GT, highValStr, LT), 99)
+    strcpy(lowValStr, "00000");
+    strcpy(highValStr, "99999");
+    checkPassFail(batchScan(&index, lowValStr, GTE, highValStr, LTE), relationSize)
+  }
+  File::remove(stringIndexName);
+}
+
+// -----------------------------------------------------------------------------
+// cursorTests
+// -----------------------------------------------------------------------------
+
+void cursorTests()
+{
+  {
+    std::cout << "Nested scans on a B+ Tree index on the integer field" << std::endl;
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER);
+    RecordId outerRid, innerRid;
+    IndexCursor outer, inner;
+    int outerLow = 0, outerHigh = 100;
+    int outerResults = 0, innerResults = 0;
+
+    // for every outer entry, scan the 10 entries starting at its key with a second cursor
+    index.startScan(outer, &outerLow, GTE, &outerHigh, LT);
+    try
+    {
+      while (1)
+      {
+        index.scanNext(outer, outerRid);
+        int innerLow = outerResults, innerHigh = outerResults + 10;
+        index.startScan(inner, &innerLow, GTE, &innerHigh, LT);
+        try
+        {
+          while (1)
+          {
+            index.scanNext(inner, innerRid);
+            innerResults++;
+          }
+        }
+        catch (IndexScanCompletedException e)
+        {
+        }
+        outerResults++;
+      }
+    }
+    catch (IndexScanCompletedException e)
+    {
+    }
+    index.endScan(outer);
+    index.endScan(inner);
+    checkPassFail(outerResults, 100)
+    checkPassFail(innerResults, 1000)
+
+    // the scan owned by the index runs next to a cursor, and a cursor left open is ended when it goes out of scope
+    int lowVal = 3000, highVal = 4000;
+    IndexCursor open;
+    index.startScan(open, &lowVal, GTE, &highVal, LT);
+    checkPassFail(intScan(&index, 25, GT, 40, LT), 14)
+    int openResults = 0;
+    while (openResults < 10 && index.scanNextBatch(open, &outerRid, 1) == 1)
+    {
+      openResults++;
+    }
+    checkPassFail(openResults, 10)
+  }
+  File::remove(intIndexName);
+}
+
+// -----------------------------------------------------------------------------
+// deleteTests
+// -----------------------------------------------------------------------------
+
+std::streamoff indexFileSize(const std::string &indexName)
+{
+  std::ifstream in(indexName.c_str(), std::ios::binary | std::ios::ate);
+  return in.tellg();
+}
+
+void deleteTests()
+{
+  // the record id of every tuple, in key order
+  std::vector<RecordId> rids;
+  {
+    FileScan fscan(relationName, bufMgr);
+    try
+    {
+      RecordId scanRid;
+      while (1)
+      {
+        fscan.scanNext(scanRid);
+        rids.push_back(scanRid);
+      }
+    }
+    catch (EndOfFileException e)
+    {
+    }
+  }
+  checkPassFail((int)rids.size(), relationSize)
+
+  for (int type = 0; type < 2; type++)
+  {
+    const bool isString = type == 1;
+    std::string &indexName = isString ? stringIndexName : intIndexName;
+    const Datatype attrType = isString ? STRING : INTEGER;
+    const int attrByteOffset = isString ? offsetof(tuple, s) : offsetof(tuple, i);
+    char keys[relationSize][31];
+    for (int i = 0; i < relationSize; i++)
+    {
+      if (isString)
+        sprintf(keys[i], "%05d string record", i);
+      else
+        memcpy(keys[i], &i, sizeof(int));
+    }
+    int (*scan)(BTreeIndex *, int, Operator, int, Operator) = isString ? stringScan : intScan;
+
+    std::cout << "Delete entries from a B+ Tree index on the " << (isString ? "string" : "integer") << " field" << std::endl;
+    {
+      BTreeIndex index(relationName, indexName, bufMgr, attrByteOffset, attrType);
+      // drop every even key, which merges the leaves back together
+      for (int i = 0; i < relationSize; i += 2)
+        index.deleteEntry(keys[i], rids[i]);
+      checkPassFail(scan(&index, 25, GT, 40, LT), 7)
+      checkPassFail(scan(&index, 0, GTE, relationSize, LT), relationSize / 2)
+
+      bool thrown = false;
+      try
+      {
+        index.deleteEntry(keys[10], rids[10]);
+      }
+      catch (NoSuchKeyFoundException e)
+      {
+        thrown = true;
+      }
+      checkPassFail(thrown, true)
+    }
+    {
+      BTreeIndex index(relationName, indexName, bufMgr, attrByteOffset, attrType);
+      checkPassFail(scan(&index, 3000, GTE, 4000, LT), 500)
+      for (int i = 1; i < relationSize; i += 2)
+        index.deleteEntry(keys[i], rids[i]);
+      checkPassFail(scan(&index, 0, GTE, relationSize, LT), 0)
+      for (int i = 0; i < relationSize; i++)
+        index.insertEntry(keys[i], rids[i]);
+      checkPassFail(scan(&index, 0, GTE, relationSize, LT), relationSize)
+    }
+    const std::streamoff size = indexFileSize(indexName);
+
+    // emptying and refilling the index again only reuses the pages freed by the merges
+    {
+      BTreeIndex index(relationName, indexName, bufMgr, attrByteOffset, attrType);
+      for (int i = relationSize - 1; i >= 0; i--)
+        index.deleteEntry(keys[i], rids[i]);
+      checkPassFail(scan(&index, 0, GTE, relationSize, LT), 0)
+      for (int i = 0; i < relationSize; i++)
+        index.insertEntry(keys[i], rids[i]);
+      checkPassFail(scan(&index, 300, GT, 400, LT), 99)
+    }
+    checkPassFail(indexFileSize(indexName), size)
+
+    try
+    {
+      File::remove(indexName);
+    }
+    catch (FileNotFoundException e)
+    {
+    }
+  }
+}
+
+// -----------------------------------------------------------------------------
+// concurrentBufferTests
+// -----------------------------------------------------------------------------
+
+void concurrentBufferTests()
+{
+  std::vector<PageId> pageNos;
+  for (FileIterator iter = file1->begin(); iter != file1->end(); ++iter)
+    pageNos.push_back(iter.page_number());
+
+  BufMgr concurrentMgr(8, true);
+  const int numThreads = 4, rounds = 20;
+  int records[numThreads];
+  std::vector<std::thread> threads;
+  for (int t = 0; t < numThreads; t++)
+  {
+    threads.push_back(std::thread([&, t]() {
+      records[t] = 0;
+      for (int round = 0; round < rounds; round++)
+      {
+        // every thread walks the pages from a different start, and half of them dirty the pages
+        for (size_t j = 0; j < pageNos.size(); j++)
+        {
+          const PageId pageNo = pageNos[(j + t * 3) % pageNos.size()];
+          Page *page;
+          concurrentMgr.readPage(file1, pageNo, page);
+          for (PageIterator iter = page->begin(); iter != page->end(); ++iter)
+          {
+            std::string record = *iter;
+            records[t] += reinterpret_cast<const RECORD *>(record.data())->i >= 0;
+          }
+          concurrentMgr.unPinPage(file1, pageNo, t % 2 == 1);
+        }
+      }
+    }));
+  }
+  for (int t = 0; t < numThreads; t++)
+    threads[t].join();
+  concurrentMgr.flushFile(file1);
+
+  for (int t = 0; t < numThreads; t++)
+    checkPassFail(records[t], rounds * relationSize)
+}
+
+// -----------------------------------------------------------------------------
+// concurrentIndexTests
+// -----------------------------------------------------------------------------
+
+void concurrentIndexTests()
+{
+  BufMgr concurrentMgr(50, true);
+  const int numWriters = 2, numReaders = 2, perWriter = 20000;
+  // the record ids of the inserted entries are made up, with a slot number no relation page has
+  const SlotId fakeSlot = 9999;
+  {
+    BTreeIndex index(relationName, intIndexName, &concurrentMgr, offsetof(tuple, i), INTEGER);
+    int badScans[numReaders];
+    for (int phase = 0; phase < 2; phase++)
+    {
+      // writer t inserts, and then deletes, the keys above the relation that are t modulo numWriters
+      std::atomic<int> writersLeft(numWriters);
+      std::vector<std::thread> threads;
+      for (int t = 0; t < numWriters; t++)
+      {
+        threads.push_back(std::thread([&, t]() {
+          for (int j = 0; j < perWriter; j++)
+          {
+            const int key = relationSize + j * numWriters + t;
+            const RecordId fakeRid = {(PageId)key, fakeSlot};
+            if (phase == 0)
+              index.insertEntry(&key, fakeRid);
+            else
+              index.deleteEntry(&key, fakeRid);
+          }
+          writersLeft--;
+        }));
+      }
+      // the readers scan the whole index until the writers are done; the keys must come out in
+      // order and the entries of the relation must all be seen
+      for (int r = 0; r < numReaders; r++)
+      {
+        threads.push_back(std::thread([&, r]() {
+          badScans[r] = 0;
+          int low = 0, high = relationSize + numWriters * perWriter;
+          do
+          {
+            IndexCursor cursor;
+            RecordId scanRid;
+            int prev = -1, relationEntries = 0;
+            index.startScan(cursor, &low, GTE, &high, LT);
+            try
+            {
+              while (1)
+              {
+                index.scanNext(cursor, scanRid);
+                const int key = scanRid.slot_number == fakeSlot ? (int)scanRid.page_number : relationSize;
+                badScans[r] += key < prev;
+                prev = key;
+                relationEntries += scanRid.slot_number != fakeSlot;
+              }
+            }
+            catch (IndexScanCompletedException e)
+            {
+            }
+            index.endScan(cursor);
+            badScans[r] += relationEntries != relationSize;
+          } while (writersLeft > 0);
+        }));
+      }
+      for (size_t t = 0; t < threads.size(); t++)
+        threads[t].join();
+
+      for (int r = 0; r < numReaders; r++)
+        checkPassFail(badScans[r], 0)
+      int low = relationSize, high = relationSize + numWriters * perWriter;
+      IndexCursor cursor;
+      RecordId scanRids[101];
+      int found = 0;
+      size_t batch;
+      try
+      {
+        index.startScan(cursor, &low, GTE, &high, LT);
+        while ((batch = index.scanNextBatch(cursor, scanRids, 101)) > 0)
+          found += batch;
+        index.endScan(cursor);
+      }
+      catch (NoSuchKeyFoundException e)
+      {
+      }
+      const int expected = phase == 0 ? numWriters * perWriter : 0;
+      checkPassFail(found, expected)
+    }
+  }
+
+  try
+  {
+    File::remove(intIndexName);
+  }
+  catch (FileNotFoundException e)
+  {
+  }
+}
+
+// -----------------------------------------------------------------------------
+// replacementPolicyTests
+// -----------------------------------------------------------------------------
+
+void replacementPolicyTests()
+{
+  std::vector<PageId> pageNos;
+  for (FileIterator iter = file1->begin(); iter != file1->end(); ++iter)
+    pageNos.push_back(iter.page_number());
+
+  const ReplacementPolicy policies[] = {CLOCK, TWO_Q, PRIORITY_CLOCK};
+  BufMgr *defaultMgr = bufMgr;
+  for (int p = 0; p < 3; p++)
+  {
+    std::cout << "Replacement policy " << policies[p] << std::endl;
+    bufMgr = new BufMgr(100, false, policies[p]);
+    intTests();
+    try
+    {
+      File::remove(intIndexName);
+    }
+    catch (FileNotFoundException e)
+    {
+    }
+    bufMgr->flushFile(file1);
+    delete bufMgr;
+    bufMgr = defaultMgr;
+
+    // read the first page as hot once every two sweeps of a small pool over the other pages, as
+    // descents read an inner node between long scans
+    BufMgr scanMgr(10, false, policies[p]);
+    Page *page;
+    int hotMisses = 0;
+    for (size_t j = 1; j < pageNos.size() * 3; j++)
+    {
+      if (j % 20 == 1)
+      {
+        const int diskReads = scanMgr.getBufStats().diskreads;
+        scanMgr.readPage(file1, pageNos[0], page, true);
+        scanMgr.unPinPage(file1, pageNos[0], false);
+        hotMisses += j > 1 && scanMgr.getBufStats().diskreads != diskReads;
+      }
+      const PageId pageNo = pageNos[1 + j % (pageNos.size() - 1)];
+      scanMgr.readPage(file1, pageNo, page);
+      scanMgr.unPinPage(file1, pageNo, false);
+    }
+    scanMgr.flushFile(file1);
+    // the clock algorithm lets scans evict the hot page
+    if (policies[p] != CLOCK)
+      checkPassFail(hotMisses, 0)
+  }
+}
+
+// -----------------------------------------------------------------------------
+// bufRingTests
+// -----------------------------------------------------------------------------
+
+void bufRingTests()
+{
+  // the pool holds a fraction of the relation, whose first page is read through file1 first
+  const PageId firstPageNo = file1->begin().page_number();
+  BufMgr scanMgr(BufRing::DEFAULT_SIZE + 4);
+  Page *page;
+  scanMgr.readPage(file1, firstPageNo, page);
+  scanMgr.unPinPage(file1, firstPageNo, false);
+
+  int numRecords = 0;
+  {
+    FileScan fscan(relationName, &scanMgr);
+    RecordId scanRid;
+    try
+    {
+      while (1)
+      {
+        fscan.scanNext(scanRid);
+        numRecords++;
+      }
+    }
+    catch (EndOfFileException e)
+    {
+    }
+  }
+  checkPassFail(numRecords, relationSize)
+
+  // the scan only recycled the frames of its ring
+  const int diskReads = scanMgr.getBufStats().diskreads;
+  scanMgr.readPage(file1, firstPageNo, page);
+  scanMgr.unPinPage(file1, firstPageNo, false);
+  checkPassFail(scanMgr.getBufStats().diskreads, diskReads)
+  scanMgr.flushFile(file1);
+}
+
+// -----------------------------------------------------------------------------
+// readAheadTests
+// -----------------------------------------------------------------------------
+
+void readAheadTests()
+{
+  BufMgr *defaultMgr = bufMgr;
+  bufMgr = new BufMgr(100);
+  bufMgr->startReadAhead();
+
+  // a scan reading ahead sees every record once, and views of the records match their copies
+  int numRecords = 0;
+  int numViews = 0;
+  {
+    FileScan fscan(relationName, bufMgr);
+    RecordId scanRid;
+    try
+    {
+      while (1)
+      {
+        fscan.scanNext(scanRid);
+        numRecords++;
+        numViews += fscan.getRecordView().str() == fscan.getRecord();
+      }
+    }
+    catch (EndOfFileException e)
+    {
+    }
+  }
+  checkPassFail(numRecords, relationSize)
+  checkPassFail(numViews, relationSize)
+
+  // index scans read the next leaves ahead, following the sibling pointers in either direction
+  intTests();
+  {
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER);
+    index.setScanReadAhead(MAX_SCAN_READ_AHEAD);
+    const int low = 0;
+    const int high = relationSize;
+    checkPassFail(countScan(&index, &low, GTE, &high, LT), relationSize)
+    RecordId rids[100];
+    int numFound = 0;
+    std::size_t n;
+    index.startScan(NULL, GT, NULL, LT, SCAN_DESCENDING);
+    while ((n = index.scanNextBatch(rids, 100)) > 0)
+      numFound += (int)n;
+    index.endScan();
+    checkPassFail(numFound, relationSize)
+  }
+  try
+  {
+    File::remove(intIndexName);
+  }
+  catch (FileNotFoundException e)
+  {
+  }
+  bufMgr->flushFile(file1);
+  delete bufMgr;
+  bufMgr = defaultMgr;
+}
+
+// -----------------------------------------------------------------------------
+// backgroundWriterTests
+// -----------------------------------------------------------------------------
+
+void backgroundWriterTests()
+{
+  const int numPages = 10;
+  std::vector<PageId> pageNos;
+  for (FileIterator iter = file1->begin(); iter != file1->end() && (int)pageNos.size() < numPages; ++iter)
+  {
+    pageNos.push_back(iter.page_number());
+  }
+
+  BufMgr *defaultMgr = bufMgr;
+  bufMgr = new BufMgr(100);
+  bufMgr->startBackgroundWriter();
+
+  // the index is built and scanned while its pages are written back
+  intTests();
+  try
+  {
+    File::remove(intIndexName);
+  }
+  catch (FileNotFoundException e)
+  {
+  }
+
+  // dirty pages are written back without being evicted or flushed
+  const int diskWrites = bufMgr->getBufStats().diskwrites;
+  for (size_t i = 0; i < pageNos.size(); i++)
+  {
+    Page *page;
+    bufMgr->readPage(file1, pageNos[i], page);
+    bufMgr->unPinPage(file1, pageNos[i], true);
+  }
+  for (int wait = 0; wait < 500 && bufMgr->getBufStats().diskwrites < diskWrites + numPages; wait++)
+  {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  checkPassFail(bufMgr->getBufStats().diskwrites - diskWrites, numPages)
+
+  // so that flushing the file has nothing left to write
+  bufMgr->flushFile(file1);
+  checkPassFail(bufMgr->getBufStats().diskwrites - diskWrites, numPages)
+  delete bufMgr;
+  bufMgr = defaultMgr;
+}
+
+// -----------------------------------------------------------------------------
+// flushFileTests
+// -----------------------------------------------------------------------------
+
+void flushFileTests()
+{
+  const std::string otherName = "flushTest.0";
+  try
+  {
+    File::remove(otherName);
+  }
+  catch (FileNotFoundException e)
+  {
+  }
+
+  const int numPages = 5;
+  BufMgr flushMgr(20);
+  {
+    PageFile other = PageFile::create(otherName);
+    std::vector<PageId> pageNos(numPages);
+    std::vector<RecordId> rids(numPages);
+    for (int i = 0; i < numPages; i++)
+    {
+      Page *page;
+      flushMgr.allocPage(&other, pageNos[i], page);
+      sprintf(record1.s, "%05d string record", i);
+      rids[i] = page->insertRecord(std::string(record1.s));
+      flushMgr.unPinPage(&other, pageNos[i], true);
+    }
+
+    // flushing the relation leaves the pages of the other file in the pool
+    Page *page;
+    const PageId firstPageNo = file1->begin().page_number();
+    flushMgr.readPage(file1, firstPageNo, page);
+    flushMgr.unPinPage(file1, firstPageNo, false);
+    flushMgr.flushFile(file1);
+    const int diskReads = flushMgr.getBufStats().diskreads;
+    for (int i = 0; i < numPages; i++)
+    {
+      flushMgr.readPage(&other, pageNos[i], page);
+      flushMgr.unPinPage(&other, pageNos[i], false);
+    }
+    checkPassFail(flushMgr.getBufStats().diskreads, diskReads)
+
+    // and flushing the other file writes them
+    flushMgr.flushFile(&other);
+    int numRecords = 0;
+    for (int i = 0; i < numPages; i++)
+    {
+      sprintf(record1.s, "%05d string record", i);
+      flushMgr.readPage(&other, pageNos[i], page);
+      numRecords += page->getRecord(rids[i]) == std::string(record1.s);
+      flushMgr.unPinPage(&other, pageNos[i], false);
+    }
+    checkPassFail(numRecords, numPages)
+    checkPassFail(flushMgr.getBufStats().diskreads, diskReads + numPages)
+    flushMgr.flushFile(&other);
+  }
+  File::remove(otherName);
+}
+
+// -----------------------------------------------------------------------------
+// durabilityTests
+// -----------------------------------------------------------------------------
+
+void durabilityTests()
+{
+  const std::string fileName = "durabilityTest.0";
+  const Durability modes[] = {DURABILITY_NONE, DURABILITY_CHECKPOINT, DURABILITY_SYNC};
+  const int numPages = 4;
+
+  for (int m = 0; m < 3; m++)
+  {
+    File::setDurability(modes[m]);
+    try
+    {
+      File::remove(fileName);
+    }
+    catch (FileNotFoundException e)
+    {
+    }
+
+    {
+      PageFile file = PageFile::create(fileName);
+      for (int i = 0; i < numPages; i++)
+      {
+        PageId pageNo;
+        Page page = file.allocatePage(pageNo);
+        sprintf(record1.s, "%05d string record", i);
+        page.insertRecord(std::string(record1.s));
+        file.writePage(pageNo, page);
+      }
+      file.checkpoint();
+
+      if (modes[m] != DURABILITY_NONE)
+      {
+        // the header on disk counts the pages once the file is checkpointed
+        FileHeader header;
+        std::ifstream disk(fileName.c_str(), std::ios::binary);
+        disk.read(reinterpret_cast<char *>(&header), sizeof(FileHeader));
+        const int expected = numPages + 1;
+        checkPassFail((int)header.num_pages, expected)
+      }
+    }
+
+    // and every page is there once the file is opened again
+    {
+      PageFile file = PageFile::open(fileName);
+      int numRecords = 0;
+      for (FileIterator iter = file.begin(); iter != file.end(); ++iter)
+      {
+        Page page = *iter;
+        for (PageIterator pageIter = page.begin(); pageIter != page.end(); ++pageIter)
+        {
+          numRecords++;
+        }
+      }
+      checkPassFail(numRecords, numPages)
+    }
+    File::remove(fileName);
+  }
+  File::setDurability(DURABILITY_CHECKPOINT);
+}
+
+// -----------------------------------------------------------------------------
+// pageListTests
+// -----------------------------------------------------------------------------
+
+void pageListTests()
+{
+  const std::string fileName = "pageListTest.0";
+  try
+  {
+    File::remove(fileName);
+  }
+  catch (FileNotFoundException e)
+  {
+  }
+
+  {
+    PageFile file = PageFile::create(fileName);
+    PageId lastPageNo;
+    const int numPages = 8;
+    std::vector<PageId> pageNos(numPages);
+    for (int i = 0; i < numPages; i++)
+    {
+      file.allocatePage(pageNos[i]);
+    }
+    checkPassFail(checkPageList(file, lastPageNo), numPages)
+
+    // the first, a middle and the last page
+    file.deletePage(pageNos[0]);
+    file.deletePage(pageNos[numPages / 2]);
+    file.deletePage(pageNos[numPages - 1]);
+    checkPassFail(checkPageList(file, lastPageNo), numPages - 3)
+
+    // deleted pages are reused, and linked in at the end
+    PageId pageNo;
+    file.allocatePage(pageNo);
+    file.allocatePage(pageNo);
+    checkPassFail(checkPageList(file, lastPageNo), numPages - 1)
+    checkPassFail(lastPageNo, pageNo)
+  }
+
+  // the list survives closing the file
+  {
+    PageFile file = PageFile::open(fileName);
+    PageId lastPageNo;
+    checkPassFail(checkPageList(file, lastPageNo), 7)
+  }
+  File::remove(fileName);
+}
+
+// -----------------------------------------------------------------------------
+// checkPageList
+// -----------------------------------------------------------------------------
+
+int checkPageList(PageFile &file, PageId &lastPageNo)
+{
+  // every page of the list points back at the one before it
+  int numPages = 0;
+  PageId prevPageNo = Page::INVALID_NUMBER;
+  for (FileIterator iter = file.begin(); iter != file.end(); ++iter)
+  {
+    Page page = *iter;
+    if (page.prev_page_number() != prevPageNo)
+    {
+      return -1;
+    }
+    prevPageNo = page.page_number();
+    numPages++;
+  }
+  lastPageNo = prevPageNo;
+  return numPages;
+}
+
+// -----------------------------------------------------------------------------
+// pageCompactionTests
+// -----------------------------------------------------------------------------
+
+void pageCompactionTests()
+{
+  Page page;
+  std::vector<RecordId> rids;
+  std::vector<std::string> records;
+  for (int i = 0; ; i++)
+  {
+    std::string data(40 + i % 7, 'a' + i % 26);
+    if (!page.hasSpaceForRecord(data))
+      break;
+    rids.push_back(page.insertRecord(data));
+    records.push_back(data);
+  }
+  const int numRecords = rids.size();
+
+  // every third record, none of them next to the free space
+  int numDeleted = 0;
+  for (int i = 1; i < numRecords - 1; i += 3)
+  {
+    page.deleteRecord(rids[i]);
+    records[i].clear();
+    numDeleted++;
+  }
+
+  // the space of the deleted records is reused, their slots first
+  int numInserted = 0;
+  int numReused = 0;
+  std::string data(40, '#');
+  while (page.hasSpaceForRecord(data))
+  {
+    RecordId rid = page.insertRecord(data);
+    if (rid.slot_number > rids.size())
+    {
+      // checked below to have come after every free slot was taken
+      rids.push_back(rid);
+      records.push_back(data);
+    }
+    else if (records[rid.slot_number - 1].empty() && numReused == numInserted)
+    {
+      records[rid.slot_number - 1] = data;
+      numReused++;
+    }
+    numInserted++;
+  }
+  checkPassFail(numReused, numDeleted)
+  checkPassFail((int)rids.size(), numRecords + numInserted - numReused)
+
+  // a record grown in place to fill the page exactly
+  records[0] = std::string(records[0].size() + page.getFreeSpace(), '*');
+  page.updateRecord(rids[0], records[0]);
+
+  int numMatching = 0;
+  for (std::size_t i = 0; i < rids.size(); i++)
+  {
+    if (page.getRecord(rids[i]) == records[i])
+      numMatching++;
+  }
+  checkPassFail(numMatching, (int)rids.size())
+}
+
+// -----------------------------------------------------------------------------
+// fileScanFilterTests
+// -----------------------------------------------------------------------------
+
+void fileScanFilterTests()
+{
+  std::vector<ScanField> projection;
+  int numMatching;
+
+  // ranges of the int and the double attribute, open at either end
+  AttrFilter<int> intFilter(offsetof(tuple, i), 100, GTE, 200, LT);
+  checkPassFail(filteredScan(&intFilter, projection, numMatching), 100)
+  checkPassFail(numMatching, 100)
+
+  AttrFilter<double> doubleFilter(offsetof(tuple, d), 0.0, EMPTY, 9.0, LTE);
+  checkPassFail(filteredScan(&doubleFilter, projection, numMatching), 10)
+  checkPassFail(numMatching, 10)
+
+  AttrFilter<int> openFilter(offsetof(tuple, i), relationSize - 5, GT, 0, EMPTY);
+  checkPassFail(filteredScan(&openFilter, projection, numMatching), 4)
+  checkPassFail(numMatching, 4)
+
+  // the int attribute followed by the number in the string attribute, out of every record
+  ScanField intField = {offsetof(tuple, i), sizeof(int)};
+  ScanField stringField = {offsetof(tuple, s), 5};
+  projection.push_back(intField);
+  projection.push_back(stringField);
+  checkPassFail(filteredScan(NULL, projection, numMatching), relationSize)
+  checkPassFail(numMatching, relationSize)
+}
+
+// -----------------------------------------------------------------------------
+// filteredScan
+// -----------------------------------------------------------------------------
+
+// Scan the relation with a filter and a projection. Returns the number of records found and, in
+// numMatching, how many of them held what the filter and the projection asked for.
+int filteredScan(const ScanFilter *filter, const std::vector<ScanField> &projection, int &numMatching)
+{
+  int numRecords = 0;
+  numMatching = 0;
+  FileScan fscan(relationName, bufMgr, filter);
+  fscan.setProjection(projection);
+  RecordId scanRid;
+  try
+  {
+    while (1)
+    {
+      fscan.scanNext(scanRid);
+      numRecords++;
+      const std::string record = fscan.getRecord();
+      if (!projection.empty())
+      {
+        int i;
+        memcpy(&i, record.data(), sizeof(int));
+        char number[6];
+        sprintf(number, "%05d", i);
+        numMatching += record.size() == sizeof(int) + 5 && record.compare(sizeof(int), 5, number) == 0;
+      }
+      else
+      {
+        numMatching += filter->matches(fscan.getRecordView()) && record.size() == sizeof(tuple);
+      }
+    }
+  }
+  catch (EndOfFileException e)
+  {
+  }
+  return numRecords;
+}
+
+// -----------------------------------------------------------------------------
+// parallelScanTests
+// -----------------------------------------------------------------------------
+
+// Counts the records and sums their int attribute, per thread of the scan
+class SumConsumer : public ScanConsumer
+{
+ public:
+  SumConsumer(const std::uint32_t numThreads)
+    : counts(numThreads), sums(numThreads)
+  {
+  }
+
+  void consume(const std::uint32_t worker, const RecordId *rids, const RecordView *records,
+      const std::size_t count)
+  {
+    for (std::size_t i = 0; i < count; i++)
+    {
+      int value;
+      memcpy(&value, records[i].data + offsetof(tuple, i), sizeof(int));
+      counts[worker]++;
+      sums[worker] += value;
+    }
+  }
+
+  long long count() const { return std::accumulate(counts.begin(), counts.end(), 0LL); }
+  long long sum() const { return std::accumulate(sums.begin(), sums.end(), 0LL); }
+
+ private:
+  std::vector<long long> counts;
+  std::vector<long long> sums;
+};
+
+void parallelScanTests()
+{
+  BufMgr scanMgr(100, true);
+  const long long total = (long long)relationSize * (relationSize - 1) / 2;
+
+  // every record is found once, whichever thread scans it
+  {
+    ParallelFileScan pScan(relationName, &scanMgr, 4);
+    checkPassFail(pScan.threads(), 4)
+    SumConsumer consumer(pScan.threads());
+    pScan.run(consumer);
+    checkPassFail(consumer.count(), relationSize)
+    checkPassFail(consumer.sum(), total)
+  }
+
+  // an index bulk loaded from the sorted runs of several threads
+  BTreeIndex::setBuildThreads(4);
+  {
+    BTreeIndex index(relationName, intIndexName, &scanMgr, offsetof(tuple, i), INTEGER);
+    checkPassFail(intScan(&index, 25, GT, 40, LT), 14)
+    checkPassFail(intScan(&index, -3, GT, relationSize, LT), relationSize)
+  }
+  BTreeIndex::setBuildThreads(0);
+  File::remove(intIndexName);
+
+  // with a filter, and with free pages in the file
+  const PageId firstPageNo = file1->begin().page_number();
+  int numDeleted = 0;
+  {
+    Page page = file1->readPage(firstPageNo);
+    for (PageIterator iter = page.begin(); iter != page.end(); iter++)
+      numDeleted++;
+  }
+  file1->deletePage(firstPageNo);
+  {
+    AttrFilter<int> filter(offsetof(tuple, i), 0, EMPTY, 1000, LT);
+    ParallelFileScan pScan(relationName, &scanMgr, 3, &filter);
+    SumConsumer consumer(pScan.threads());
+    pScan.run(consumer);
+    checkPassFail(consumer.count(), 1000 - numDeleted)
+  }
+
+  // a buffer manager not in concurrent mode is used by one thread
+  {
+    ParallelFileScan pScan(relationName, bufMgr, 4);
+    checkPassFail(pScan.threads(), 1)
+    SumConsumer consumer(pScan.threads());
+    pScan.run(consumer);
+    checkPassFail(consumer.count(), relationSize - numDeleted)
+  }
+}
+
+// -----------------------------------------------------------------------------
+// frameMemoryTests
+// -----------------------------------------------------------------------------
+
+void frameMemoryTests()
+{
+  const FrameMemory memories[] = {FRAMES_SMALL_PAGES, FRAMES_TRANSPARENT_HUGE_PAGES, FRAMES_HUGE_PAGES};
+  BufMgr *defaultMgr = bufMgr;
+  for (int m = 0; m < 3; m++)
+  {
+    std::cout << "Frame memory " << memories[m] << std::endl;
+    bufMgr = new BufMgr(100, false, CLOCK, memories[m]);
+
+    // frames start at boundaries of system pages
+    const PageId firstPageNo = file1->begin().page_number();
+    Page *page;
+    bufMgr->readPage(file1, firstPageNo, page);
+    checkPassFail((reinterpret_cast<std::uintptr_t>(page) % 4096), 0)
+    bufMgr->unPinPage(file1, firstPageNo, false);
+
+    intTests();
+    try
+    {
+      File::remove(intIndexName);
+    }
+    catch (FileNotFoundException e)
+    {
+    }
+    bufMgr->flushFile(file1);
+    delete bufMgr;
+    bufMgr = defaultMgr;
+  }
+}
+
+// -----------------------------------------------------------------------------
+// partitionedPoolTests
+// -----------------------------------------------------------------------------
+
+void partitionedPoolTests()
+{
+  std::vector<PageId> pageNos;
+  for (FileIterator iter = file1->begin(); iter != file1->end(); ++iter)
+    pageNos.push_back(iter.page_number());
+
+  // pages take frames of other partitions once those of their own are pinned
+  {
+    const int numBufs = 8;
+    BufMgr partitionedMgr(numBufs, false, CLOCK, FRAMES_SMALL_PAGES, 4);
+    Page *page;
+    for (int j = 0; j < numBufs; j++)
+      partitionedMgr.readPage(file1, pageNos[j], page);
+    int exceeded = 0;
+    try
+    {
+      partitionedMgr.readPage(file1, pageNos[numBufs], page);
+    }
+    catch (BufferExceededException e)
+    {
+      exceeded = 1;
+    }
+    checkPassFail(exceeded, 1)
+    for (int j = 0; j < numBufs; j++)
+      partitionedMgr.unPinPage(file1, pageNos[j], false);
+    partitionedMgr.flushFile(file1);
+  }
+
+  BufMgr *defaultMgr = bufMgr;
+  bufMgr = new BufMgr(100, false, TWO_Q, FRAMES_SMALL_PAGES, 4);
+  intTests();
+  try
+  {
+    File::remove(intIndexName);
+  }
+  catch (FileNotFoundException e)
+  {
+  }
+  bufMgr->flushFile(file1);
+  delete bufMgr;
+  bufMgr = defaultMgr;
+
+  // one partition per node of the host, shared by the threads of a scan
+  {
+    BufMgr partitionedMgr(64, true, CLOCK, FRAMES_SMALL_PAGES, 0);
+    ParallelFileScan pScan(relationName, &partitionedMgr, 4);
+    SumConsumer consumer(pScan.threads());
+    pScan.run(consumer);
+    checkPassFail(consumer.count(), relationSize)
+  }
+}
+
+void readOnlyIndexTests()
+{
+  {
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER);
+  }
+  {
+    BTreeIndex index(relationName, doubleIndexName, bufMgr, offsetof(tuple, d), DOUBLE);
+  }
+
+  // integer nodes are read from the mapping, so a descent pins nothing even in a pool of one frame
+  {
+    BufMgr tinyMgr(1);
+    BTreeIndex index(relationName, intIndexName, &tinyMgr, offsetof(tuple, i), INTEGER, INDEX_READ_ONLY);
+    BTreeIndex other(relationName, intIndexName, &tinyMgr, offsetof(tuple, i), INTEGER, INDEX_READ_ONLY);
+    checkPassFail(intScan(&index, 25, GT, 40, LT), 14)
+    checkPassFail(intScan(&other, 3000, GTE, 4000, LT), 1000)
+
+    IndexCursor outer, inner;
+    int low = 0, high = relationSize;
+    index.startScan(outer, &low, GTE, &high, LT);
+    other.startScan(inner, &low, GTE, &high, LT);
+    RecordId outerRid, innerRid;
+    int matching = 0;
+    try
+    {
+      while (true)
+      {
+        index.scanNext(outer, outerRid);
+        other.scanNext(inner, innerRid);
+        if (outerRid.page_number == innerRid.page_number && outerRid.slot_number == innerRid.slot_number)
+          matching++;
+      }
+    }
+    catch (IndexScanCompletedException e)
+    {
+    }
+    checkPassFail(matching, relationSize)
+
+    int thrown = 0;
+    RecordId newRid = {1, 1};
+    int key = relationSize;
+    try
+    {
+      index.insertEntry(&key, newRid);
+    }
+    catch (ReadOnlyIndexException e)
+    {
+      thrown++;
+    }
+    try
+    {
+      index.deleteEntry(&low, outerRid);
+    }
+    catch (ReadOnlyIndexException e)
+    {
+      thrown++;
+    }
+    checkPassFail(thrown, 2)
+  }
+
+  // double nodes need more alignment than mapped pages have and are read through the pool
+  {
+    BTreeIndex index(relationName, doubleIndexName, bufMgr, offsetof(tuple, d), DOUBLE, INDEX_READ_ONLY);
+    checkPassFail(doubleScan(&index, 24.5, GT, 26.5, LT), 2)
+    checkPassFail(doubleScan(&index, 3000, GTE, 4000, LT), 1000)
+  }
+  File::remove(intIndexName);
+  File::remove(doubleIndexName);
+
+  int notFound = 0;
+  try
+  {
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER, INDEX_READ_ONLY);
+  }
+  catch (FileNotFoundException e)
+  {
+    notFound = 1;
+  }
+  checkPassFail(notFound, 1)
+}
+
+// -----------------------------------------------------------------------------
+// bufStatsTests
+// -----------------------------------------------------------------------------
+
+void bufStatsTests()
+{
+  std::vector<PageId> pageNos;
+  for (FileIterator iter = file1->begin(); iter != file1->end(); ++iter)
+    pageNos.push_back(iter.page_number());
+  const int numBufs = 8;
+  const int numPages = 2 * numBufs;
+
+  // the first pass misses every page and evicts half of them, the second misses again
+  {
+    BufMgr statsMgr(numBufs);
+    Page *page;
+    for (int pass = 0; pass < 2; pass++)
+    {
+      for (int j = 0; j < numPages; j++)
+      {
+        statsMgr.readPage(file1, pageNos[j], page);
+        statsMgr.unPinPage(file1, pageNos[j], j % 2 == 0);
+      }
+    }
+    BufStats stats = statsMgr.getBufStats();
+    checkPassFail(stats.accesses, 2 * numPages)
+    checkPassFail(stats.diskreads, 2 * numPages)
+    checkPassFail((int)stats.hits, 0)
+    checkPassFail((int)(stats.cleanEvictions + stats.dirtyEvictions), 2 * numPages - numBufs)
+    checkPassFail((int)stats.dirtyEvictions, stats.diskwrites)
+    checkPassFail(stats.dirtyFrames, numBufs / 2)
+    checkPassFail(stats.dirtyHighWater, numBufs / 2)
+    checkPassFail((int)stats.readNanos.total(), 2 * numPages)
+    checkPassFail((int)stats.frameWaitNanos.total(), 2 * numPages)
+    checkPassFail((int)stats.sweepLengths.total(), 2 * numPages)
+    checkPassFail((int)stats.files[relationName].misses, 2 * numPages)
+
+    // once cleared, pages still in the pool are hits
+    statsMgr.clearBufStats();
+    for (int j = numPages - numBufs; j < numPages; j++)
+    {
+      statsMgr.readPage(file1, pageNos[j], page);
+      statsMgr.unPinPage(file1, pageNos[j], false);
+    }
+    stats = statsMgr.getBufStats();
+    checkPassFail((int)stats.hits, numBufs)
+    checkPassFail(stats.diskreads, 0)
+    checkPassFail((int)stats.files[relationName].hits, numBufs)
+    checkPassFail((int)stats.files[relationName].misses, 0)
+    checkPassFail(stats.dirtyHighWater, numBufs / 2)
+
+    statsMgr.flushFile(file1);
+    stats = statsMgr.getBufStats();
+    checkPassFail(stats.dirtyFrames, 0)
+    checkPassFail(stats.diskwrites, numBufs / 2)
+  }
+
+  // every thread counts on its own, the snapshot adds them up
+  {
+    BufMgr statsMgr(numPages, true);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; t++)
+    {
+      threads.push_back(std::thread([&]() {
+        Page *page;
+        for (int j = 0; j < numPages; j++)
+        {
+          statsMgr.readPage(file1, pageNos[j], page);
+          statsMgr.unPinPage(file1, pageNos[j], false);
+        }
+      }));
+    }
+    for (std::size_t t = 0; t < threads.size(); t++)
+      threads[t].join();
+    BufStats stats = statsMgr.getBufStats();
+    checkPassFail(stats.accesses, 4 * numPages)
+    checkPassFail((int)stats.hits + stats.diskreads, 4 * numPages)
+    checkPassFail((int)(stats.files[relationName].hits + stats.files[relationName].misses), 4 * numPages)
+    statsMgr.flushFile(file1);
+  }
+}
+
+// -----------------------------------------------------------------------------
+// indexStatsTests
+// -----------------------------------------------------------------------------
+
+void indexStatsTests()
+{
+  // the record id of every tuple, in key order
+  std::vector<RecordId> rids;
+  {
+    FileScan fscan(relationName, bufMgr);
+    try
+    {
+      RecordId scanRid;
+      while (1)
+      {
+        fscan.scanNext(scanRid);
+        rids.push_back(scanRid);
+      }
+    }
+    catch (EndOfFileException e)
+    {
+    }
+  }
+
+  // an index filled by inserts splits every leaf but the first
+  {
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER, false);
+    const IndexStats stats = index.getStats();
+    checkPassFail(stats.numEntries, relationSize)
+    checkPassFail(stats.leafSplits, stats.numLeaves - 1)
+    checkPassFail(stats.nonLeafSplits, stats.numNonLeaves - 1 - (stats.height - 2))
+    checkPassFail(stats.merges, 0)
+    checkIndexShape(index);
+  }
+
+  // the counters are read back from the meta page, and deletes merge leaves
+  {
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER);
+    checkPassFail(index.getStats().numEntries, relationSize)
+    checkPassFail(index.getStats().leafSplits, index.getStats().numLeaves - 1)
+    for (int i = 0; i < relationSize; i++)
+    {
+      if (i % 8 != 0)
+        index.deleteEntry(&i, rids[i]);
+    }
+    const IndexStats stats = index.getStats();
+    checkPassFail(stats.numEntries, relationSize / 8)
+    checkPassFail((stats.merges > 0), true)
+    checkIndexShape(index);
+    IndexShape shape;
+    index.inspect(shape);
+    checkPassFail(shape.freePages, stats.merges)
+  }
+  File::remove(intIndexName);
+
+  // a bulk loaded index is filled to the fill factor without splits
+  {
+    BTreeIndex index(relationName, doubleIndexName, bufMgr, offsetof(tuple, d), DOUBLE, true, 0.5);
+    const IndexStats stats = index.getStats();
+    checkPassFail(stats.leafSplits + stats.nonLeafSplits, 0)
+    checkPassFail((stats.leafFill > 0.4 && stats.leafFill <= 0.5), true)
+    checkIndexShape(index);
+  }
+  File::remove(doubleIndexName);
+}
+
+void checkIndexShape(BTreeIndex &index)
+{
+  const IndexStats stats = index.getStats();
+  IndexShape shape;
+  index.inspect(shape);
+  checkPassFail((int)shape.levels.size(), stats.height)
+  checkPassFail(shape.levels[0].nodes, 1)
+  checkPassFail(shape.levels.back().nodes, stats.numLeaves)
+  checkPassFail(shape.levels.back().keys, stats.numEntries)
+  int numNonLeaves = 0;
+  for (std::size_t i = 0; i + 1 < shape.levels.size(); i++)
+  {
+    numNonLeaves += shape.levels[i].nodes;
+    // the nodes of a level have one child more than they have keys
+    checkPassFail(shape.levels[i].keys + shape.levels[i].nodes, shape.levels[i + 1].nodes)
+  }
+  checkPassFail(numNonLeaves, stats.numNonLeaves)
+  checkPassFail((shape.levels.back().fill == stats.leafFill), true)
+}
+
+// -----------------------------------------------------------------------------
+// lookupTests
+// -----------------------------------------------------------------------------
+
+void lookupTests()
+{
+  // the record id of every key
+  std::vector<RecordId> rids(relationSize);
+  {
+    FileScan fscan(relationName, bufMgr);
+    try
+    {
+      RecordId scanRid;
+      while (1)
+      {
+        fscan.scanNext(scanRid);
+        rids[*(const int *)(fscan.getRecordView().data + offsetof(tuple, i))] = scanRid;
+      }
+    }
+    catch (EndOfFileException e)
+    {
+    }
+  }
+
+  {
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER);
+    int numFound = 0;
+    for (int i = 0; i < relationSize; i++)
+    {
+      RecordId lookupRid;
+      numFound += index.lookup(&i, lookupRid) && lookupRid == rids[i];
+    }
+    checkPassFail(numFound, relationSize)
+
+    RecordId lookupRid = INVALID_RECORD;
+    const int missing[] = {-1, relationSize, INT_MIN, INT_MAX};
+    for (int i = 0; i < 4; i++)
+      numFound += index.lookup(&missing[i], lookupRid);
+    checkPassFail(numFound, relationSize)
+    checkPassFail((lookupRid == INVALID_RECORD), true)
+
+    // duplicates of a key spanning several leaves are all found, and the first one by lookup()
+    const int key = relationSize / 2;
+    const int numDups = 2 * INTARRAYLEAFSIZE;
+    for (int i = 0; i < numDups; i++)
+    {
+      RecordId dupRid = {(PageId)(relationSize + i), 1};
+      index.insertEntry(&key, dupRid);
+    }
+    std::vector<RecordId> found;
+    checkPassFail((int)index.lookupAll(&key, found), numDups + 1)
+    int numMatching = 0;
+    for (std::size_t i = 0; i < found.size(); i++)
+      numMatching += found[i] == rids[key] || found[i].page_number >= (PageId)relationSize;
+    checkPassFail(numMatching, numDups + 1)
+    checkPassFail((int)index.lookupAll(&missing[0], found), 0)
+    checkPassFail((int)found.size(), numDups + 1)
+    checkPassFail(index.lookup(&key, lookupRid), true)
+    checkPassFail((lookupRid == found[0]), true)
+
+    // a batch of probes in random order, with repeated and missing keys, finds what lookupAll() finds
+    std::vector<int> probes;
+    for (int i = 0; i < 2000; i++)
+      probes.push_back(random() % (relationSize + 100) - 50);
+    probes.push_back(key);
+    probes.push_back(key);
+    std::vector<const void *> probeKeys;
+    for (std::size_t i = 0; i < probes.size(); i++)
+      probeKeys.push_back(&probes[i]);
+    std::vector<RecordId> batchRids;
+    std::vector<std::size_t> offsets;
+    index.lookupBatch(&probeKeys[0], probeKeys.size(), batchRids, offsets);
+    checkPassFail(offsets.size(), probes.size() + 1)
+    int numSame = 0;
+    for (std::size_t i = 0; i < probes.size(); i++)
+    {
+      std::vector<RecordId> expected;
+      index.lookupAll(&probes[i], expected);
+      numSame += expected.size() == offsets[i + 1] - offsets[i]
+                 && std::equal(expected.begin(), expected.end(), batchRids.begin() + offsets[i]);
+    }
+    checkPassFail(numSame, (int)probes.size())
+    checkPassFail((int)(offsets[probes.size()] - offsets[probes.size() - 1]), numDups + 1)
+    index.lookupBatch(&probeKeys[0], 0, batchRids, offsets);
+    checkPassFail(batchRids.size(), 0)
+    checkPassFail(offsets.size(), 1)
+  }
+  File::remove(intIndexName);
+
+  // string keys are compared on their first STRINGSIZE characters
+  {
+    BTreeIndex index(relationName, stringIndexName, bufMgr, offsetof(tuple, s), STRING);
+    int numFound = 0;
+    char key[STRINGSIZE + 1];
+    for (int i = 0; i < relationSize; i += 7)
+    {
+      sprintf(key, "%05d stri", i);
+      RecordId lookupRid;
+      numFound += index.lookup(key, lookupRid) && lookupRid == rids[i];
+    }
+    checkPassFail(numFound, (relationSize + 6) / 7)
+    RecordId lookupRid;
+    checkPassFail(index.lookup("99999 stri", lookupRid), false)
+  }
+  File::remove(stringIndexName);
+}
+
+// -----------------------------------------------------------------------------
+// nodeCacheTests
+// -----------------------------------------------------------------------------
+
+void nodeCacheTests()
+{
+  int uncachedAccesses;
+  {
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER);
+    const int accesses = bufMgr->getBufStats().accesses;
+    RecordId lookupRid;
+    for (int i = 0; i < relationSize; i++)
+      index.lookup(&i, lookupRid);
+    uncachedAccesses = bufMgr->getBufStats().accesses - accesses;
+  }
+
+  {
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER);
+    index.cacheUpperLevels(2);
+    RecordId lookupRid;
+    int numFound = 0;
+    for (int i = 0; i < relationSize; i++)
+      numFound += index.lookup(&i, lookupRid);
+    checkPassFail(numFound, relationSize)
+
+    // once the cache is filled, lookups only go through the buffer manager for the lower levels
+    const int accesses = bufMgr->getBufStats().accesses;
+    for (int i = 0; i < relationSize; i++)
+      index.lookup(&i, lookupRid);
+    checkPassFail((bufMgr->getBufStats().accesses - accesses < uncachedAccesses), true)
+
+    // splits reaching cached nodes are written back when the index is closed; the new entries
+    // point at an existing record so that scans can read it
+    for (int i = relationSize; i < 3 * relationSize; i++)
+      index.insertEntry(&i, lookupRid);
+    checkPassFail(intScan(&index, -1, GT, 3 * relationSize, LT), 3 * relationSize)
+  }
+
+  {
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER);
+    checkPassFail(intScan(&index, -1, GT, 3 * relationSize, LT), 3 * relationSize)
+    checkPassFail((int)index.getStats().numEntries, 3 * relationSize)
+  }
+  File::remove(intIndexName);
+}
+
+// -----------------------------------------------------------------------------
+// descendingScanTests
+// -----------------------------------------------------------------------------
+
+/**
+ * Integer keys of the records a scan returns, in the order returned, read batch entries at a time
+ * or through scanNext() if batch is 0. A NULL bound leaves the range open.
+ */
+std::vector<int> scanKeys(BTreeIndex &index, const int *lowVal, Operator lowOp, const int *highVal, Operator highOp,
+                          ScanOrder order, const std::size_t batch)
+{
+  std::vector<int> keys;
+  try
+  {
+    index.startScan(lowVal, lowOp, highVal, highOp, order);
+  }
+  catch (NoSuchKeyFoundException e)
+  {
+    return keys;
+  }
+  std::vector<RecordId> rids(std::max(batch, (std::size_t)1));
+  while (1)
+  {
+    std::size_t n = 1;
+    if (batch == 0)
+    {
+      try
+      {
+        index.scanNext(rids[0]);
+      }
+      catch (IndexScanCompletedException e)
+      {
+        break;
+      }
+    }
+    else if ((n = index.scanNextBatch(&rids[0], batch)) == 0)
+    {
+      break;
+    }
+    for (std::size_t i = 0; i < n; i++)
+    {
+      Page *page;
+      bufMgr->readPage(file1, rids[i].page_number, page);
+      keys.push_back(reinterpret_cast<const RECORD *>(page->getRecord(rids[i]).data())->i);
+      bufMgr->unPinPage(file1, rids[i].page_number, false);
+    }
+  }
+  index.endScan();
+  return keys;
+}
+
+void descendingScanTests()
+{
+  {
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER);
+
+    // every entry, greatest first, one at a time and in batches
+    for (std::size_t batch = 0; batch <= 64; batch += 64)
+    {
+      std::vector<int> keys = scanKeys(index, NULL, GT, NULL, LT, SCAN_DESCENDING, batch);
+      checkPassFail((int)keys.size(), relationSize)
+      int numInPlace = 0;
+      for (int i = 0; i < (int)keys.size(); i++)
+        numInPlace += keys[i] == relationSize - 1 - i;
+      checkPassFail(numInPlace, relationSize)
+    }
+
+    // bounded ranges
+    const int low = 25, high = 40;
+    std::vector<int> keys = scanKeys(index, &low, GT, &high, LT, SCAN_DESCENDING, 0);
+    checkPassFail((int)keys.size(), 14)
+    checkPassFail(keys.front(), 39)
+    checkPassFail(keys.back(), 26)
+    keys = scanKeys(index, &low, GTE, &high, LTE, SCAN_DESCENDING, 5);
+    checkPassFail((int)keys.size(), 16)
+    checkPassFail(keys.front(), 40)
+    checkPassFail(keys.back(), 25)
+    const int below = -10, stillBelow = -5;
+    checkPassFail((int)scanKeys(index, &below, GT, &stillBelow, LT, SCAN_DESCENDING, 0).size(), 0)
+    const int above = relationSize + 10;
+    checkPassFail((int)scanKeys(index, &above, GT, NULL, LT, SCAN_DESCENDING, 0).size(), 0)
+
+    // open ends in both directions
+    keys = scanKeys(index, NULL, GT, &high, LT, SCAN_ASCENDING, 0);
+    checkPassFail((int)keys.size(), high)
+    checkPassFail(keys.front(), 0)
+    keys = scanKeys(index, &high, GT, NULL, LT, SCAN_ASCENDING, 16);
+    checkPassFail((int)keys.size(), relationSize - high - 1)
+    checkPassFail(keys.back(), relationSize - 1)
+
+    // the greatest keys come first without reading the rest of the range
+    RecordId top[10];
+    index.startScan(NULL, GT, NULL, LT, SCAN_DESCENDING);
+    checkPassFail(index.scanNextBatch(top, 10), 10)
+    index.endScan();
+
+    // duplicates of a key spanning several leaves are all returned, and splits keep the left
+    // sibling pointers in step with the right ones
+    const int key = relationSize / 2;
+    RecordId dupRid;
+    index.lookup(&key, dupRid);
+    const int numDups = 3 * INTARRAYLEAFSIZE;
+    for (int i = 0; i < numDups; i++)
+      index.insertEntry(&key, dupRid);
+    keys = scanKeys(index, &key, GTE, &key, LTE, SCAN_DESCENDING, 7);
+    checkPassFail((int)keys.size(), numDups + 1)
+    keys = scanKeys(index, NULL, GT, NULL, LT, SCAN_DESCENDING, 0);
+    checkPassFail((int)keys.size(), relationSize + numDups)
+    checkPassFail(std::is_sorted(keys.rbegin(), keys.rend()), true)
+
+    // as do merges
+    for (int i = 0; i < numDups; i++)
+      index.deleteEntry(&key, dupRid);
+    for (int i = 0; i < relationSize; i += 2)
+    {
+      RecordId rid;
+      index.lookup(&i, rid);
+      index.deleteEntry(&i, rid);
+    }
+    keys = scanKeys(index, NULL, GT, NULL, LT, SCAN_DESCENDING, 13);
+    checkPassFail((int)keys.size(), relationSize / 2)
+    int numOdd = 0;
+    for (int i = 0; i < (int)keys.size(); i++)
+      numOdd += keys[i] == relationSize - 1 - 2 * i;
+    checkPassFail(numOdd, relationSize / 2)
+  }
+  File::remove(intIndexName);
+
+  {
+    BTreeIndex index(relationName, stringIndexName, bufMgr, offsetof(tuple, s), STRING);
+    IndexCursor cursor;
+    index.startScan(cursor, NULL, GT, "00100 string record", LT, SCAN_DESCENDING);
+    int numFound = 0;
+    RecordId rids[32];
+    std::size_t n;
+    while ((n = index.scanNextBatch(cursor, rids, 32)) > 0)
+      numFound += (int)n;
+    checkPassFail(numFound, 100)
+    index.endScan(cursor);
+  }
+  File::remove(stringIndexName);
+}
+
+// -----------------------------------------------------------------------------
+// postingLeafTests
+// -----------------------------------------------------------------------------
+
+void postingLeafTests()
+{
+  const int numKeys = relationSize / duplicates;
+  {
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER);
+
+    // bulk loaded leaves hold postings, more entries than their plain arrays have room for
+    IndexStats stats = index.getStats();
+    checkPassFail(stats.numEntries, relationSize)
+    checkPassFail((stats.leafFill > 1), true)
+    checkPassFail((stats.numLeaves * INTARRAYLEAFSIZE < relationSize), true)
+    checkIndexShape(index);
+
+    // every entry of a key, in both directions
+    for (int k = 0; k < numKeys; k += 7)
+    {
+      std::vector<int> keys = scanKeys(index, &k, GTE, &k, LTE, SCAN_ASCENDING, 0);
+      checkPassFail((int)keys.size(), duplicates)
+      checkPassFail((int)std::count(keys.begin(), keys.end(), k), duplicates)
+      keys = scanKeys(index, &k, GTE, &k, LTE, SCAN_DESCENDING, 16);
+      checkPassFail((int)keys.size(), duplicates)
+    }
+    std::vector<int> keys = scanKeys(index, NULL, GT, NULL, LT, SCAN_ASCENDING, 64);
+    checkPassFail((int)keys.size(), relationSize)
+    checkPassFail(std::is_sorted(keys.begin(), keys.end()), true)
+    const int low = 10, high = 20;
+    checkPassFail((int)scanKeys(index, &low, GT, &high, LT, SCAN_ASCENDING, 0).size(), 9 * duplicates)
+
+    // inserts add entries to a run and new keys between, and split posting leaves
+    std::vector<RecordId> found;
+    const int key = numKeys / 2;
+    checkPassFail((int)index.lookupAll(&key, found), duplicates)
+    const RecordId rid = found[0];
+    const int numInserts = 2000;
+    for (int i = 0; i < numInserts; i++)
+    {
+      const int k = i % 2 == 0 ? key : -1 - i % 5;
+      index.insertEntry(&k, rid);
+    }
+    checkPassFail((int)index.lookupAll(&key, found), duplicates + numInserts / 2)
+    const int newKey = -3;
+    checkPassFail((int)index.lookupAll(&newKey, found), numInserts / 10)
+    checkPassFail(index.getStats().numEntries, relationSize + numInserts)
+    checkIndexShape(index);
+
+    // deletes take entries out of runs and drop the keys left without one
+    for (int i = 0; i < numInserts; i++)
+    {
+      const int k = i % 2 == 0 ? key : -1 - i % 5;
+      index.deleteEntry(&k, rid);
+    }
+    checkPassFail((int)index.lookupAll(&key, found), duplicates)
+    checkPassFail((int)index.lookupAll(&newKey, found), 0)
+    for (int even = 0; even < numKeys; even += 2)
+    {
+      found.clear();
+      index.lookupAll(&even, found);
+      for (std::size_t i = 0; i < found.size(); i++)
+        index.deleteEntry(&even, found[i]);
+    }
+    checkPassFail(index.getStats().numEntries, relationSize / 2)
+    checkIndexShape(index);
+    keys = scanKeys(index, NULL, GT, NULL, LT, SCAN_DESCENDING, 0);
+    checkPassFail((int)keys.size(), relationSize / 2)
+    checkPassFail(std::is_sorted(keys.rbegin(), keys.rend()), true)
+    int numOdd = 0;
+    for (std::size_t i = 0; i < keys.size(); i++)
+      numOdd += keys[i] % 2;
+    checkPassFail(numOdd, relationSize / 2)
+  }
+  {
+    // postings are written to disk as they are
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER);
+    std::vector<RecordId> found;
+    const int odd = 1, even = 2;
+    checkPassFail((int)index.lookupAll(&odd, found), duplicates)
+    checkPassFail((int)index.lookupAll(&even, found), 0)
+  }
+  File::remove(intIndexName);
+
+  {
+    BTreeIndex index(relationName, doubleIndexName, bufMgr, offsetof(tuple, d), DOUBLE);
+    checkPassFail((index.getStats().leafFill > 1), true)
+    checkIndexShape(index);
+    std::vector<RecordId> found;
+    const double key = 12;
+    checkPassFail((int)index.lookupAll(&key, found), duplicates)
+    for (std::size_t i = 0; i < found.size(); i++)
+      index.deleteEntry(&key, found[i]);
+    checkPassFail((int)index.lookupAll(&key, found), 0)
+    checkPassFail(index.getStats().numEntries, relationSize - duplicates)
+  }
+  File::remove(doubleIndexName);
+}
+
+// -----------------------------------------------------------------------------
+// coveringIndexTests
+// -----------------------------------------------------------------------------
+
+// Included attributes of the covering index of coveringIndexTests, as its scans return them
+struct CoveredTuple
+{
+  double d;
+  char s[8];
+};
+
+std::vector<CoveredTuple> scanCovered(BTreeIndex &index, const int *lowVal, Operator lowOp, const int *highVal,
+                                      Operator highOp, ScanOrder order, const std::size_t batch)
+{
+  std::vector<CoveredTuple> tuples;
+  IndexCursor cursor;
+  try
+  {
+    index.startScan(cursor, lowVal, lowOp, highVal, highOp, order);
+  }
+  catch (NoSuchKeyFoundException e)
+  {
+    return tuples;
+  }
+  std::vector<RecordId> rids(batch);
+  std::vector<char> payloads(batch * index.payloadSize());
+  std::size_t n;
+  while ((n = index.scanNextBatch(cursor, &rids[0], batch, &payloads[0])) > 0)
+  {
+    for (std::size_t i = 0; i < n; i++)
+    {
+      CoveredTuple tuple;
+      memcpy(&tuple, &payloads[i * index.payloadSize()], sizeof(tuple));
+      tuples.push_back(tuple);
+    }
+  }
+  index.endScan(cursor);
+  return tuples;
+}
+
+void coveringIndexTests()
+{
+  std::vector<IncludedAttr> included(2);
+  included[0].offset = offsetof(tuple, d);
+  included[0].length = sizeof(double);
+  included[1].offset = offsetof(tuple, s);
+  included[1].length = 8;
+  std::string coveringIndexName;
+  {
+    BTreeIndex index(relationName, coveringIndexName, bufMgr, offsetof(tuple, i), INTEGER, included);
+    checkPassFail(index.payloadSize(), (int)sizeof(CoveredTuple))
+    checkPassFail((coveringIndexName != relationName + ".0"), true)
+
+    // the included attributes of every entry come in key order, in both directions
+    const int low = 100, high = 200;
+    std::vector<CoveredTuple> tuples = scanCovered(index, &low, GTE, &high, LTE, SCAN_ASCENDING, 7);
+    checkPassFail((int)tuples.size(), high - low + 1)
+    int numMatching = 0;
+    for (int i = 0; i < (int)tuples.size(); i++)
+    {
+      char s[16];
+      sprintf(s, "%05d st", low + i);
+      numMatching += tuples[i].d == low + i && memcmp(tuples[i].s, s, 8) == 0;
+    }
+    checkPassFail(numMatching, high - low + 1)
+    tuples = scanCovered(index, &low, GT, &high, LT, SCAN_DESCENDING, 16);
+    checkPassFail((int)tuples.size(), high - low - 1)
+    numMatching = 0;
+    for (int i = 0; i < (int)tuples.size(); i++)
+      numMatching += tuples[i].d == high - 1 - i;
+    checkPassFail(numMatching, high - low - 1)
+
+    // inserts need the record
+    const int key = relationSize + 5;
+    RecordId newRid = {1, 1};
+    int thrown = 0;
+    try
+    {
+      index.insertEntry(&key, newRid);
+    }
+    catch (BadIndexInfoException e)
+    {
+      thrown++;
+    }
+    checkPassFail(thrown, 1)
+    RECORD record;
+    memset(&record, 0, sizeof(record));
+    record.i = key;
+    record.d = -1;
+    strcpy(record.s, "covered");
+    index.insertEntry(&key, newRid, reinterpret_cast<const char *>(&record));
+    tuples = scanCovered(index, &key, GTE, NULL, LT, SCAN_ASCENDING, 4);
+    checkPassFail((int)tuples.size(), 1)
+    checkPassFail((tuples[0].d == -1), true)
+    checkPassFail(strcmp(tuples[0].s, "covered"), 0)
+    index.deleteEntry(&key, newRid);
+
+    // payloads move with their entries through splits and merges
+    for (int i = 0; i < relationSize; i += 2)
+    {
+      RecordId rid;
+      index.lookup(&i, rid);
+      index.deleteEntry(&i, rid);
+    }
+    checkIndexShape(index);
+    tuples = scanCovered(index, NULL, GT, NULL, LT, SCAN_ASCENDING, 64);
+    checkPassFail((int)tuples.size(), relationSize / 2)
+    numMatching = 0;
+    for (int i = 0; i < (int)tuples.size(); i++)
+      numMatching += tuples[i].d == 2 * i + 1;
+    checkPassFail(numMatching, relationSize / 2)
+  }
+  {
+    // the included attributes are part of the metapage
+    BTreeIndex index(relationName, coveringIndexName, bufMgr, offsetof(tuple, i), INTEGER, included);
+    const int odd = 301;
+    std::vector<CoveredTuple> tuples = scanCovered(index, &odd, GTE, &odd, LTE, SCAN_ASCENDING, 1);
+    checkPassFail((int)tuples.size(), 1)
+    checkPassFail((tuples[0].d == odd), true)
+
+    int thrown = 0;
+    std::vector<IncludedAttr> other = included;
+    other[1].length = 4;
+    try
+    {
+      BTreeIndex wrong(relationName, coveringIndexName, bufMgr, offsetof(tuple, i), INTEGER, other);
+    }
+    catch (BadIndexInfoException e)
+    {
+      thrown++;
+    }
+    try
+    {
+      BTreeIndex wrong(relationName, stringIndexName, bufMgr, offsetof(tuple, s), STRING, included);
+    }
+    catch (BadIndexInfoException e)
+    {
+      thrown++;
+    }
+    other[1].length = MAX_PAYLOAD_SIZE;
+    try
+    {
+      BTreeIndex wrong(relationName, stringIndexName, bufMgr, offsetof(tuple, i), INTEGER, other);
+    }
+    catch (BadIndexInfoException e)
+    {
+      thrown++;
+    }
+    checkPassFail(thrown, 3)
+  }
+  File::remove(coveringIndexName);
+}
+
+// -----------------------------------------------------------------------------
+// compositeIndexTests
+// -----------------------------------------------------------------------------
+
+std::vector<RECORD> scanComposite(BTreeIndex &index, const CompositeKey *lowVal, const CompositeKey *highVal,
+                                  ScanOrder order)
+{
+  std::vector<RECORD> records;
+  IndexCursor cursor;
+  try
+  {
+    index.startScan(cursor, lowVal, GTE, highVal, LTE, order);
+  }
+  catch (NoSuchKeyFoundException e)
+  {
+    return records;
+  }
+  std::vector<RecordId> rids(32);
+  std::size_t n;
+  while ((n = index.scanNextBatch(cursor, &rids[0], rids.size())) > 0)
+  {
+    for (std::size_t i = 0; i < n; i++)
+    {
+      Page *page;
+      bufMgr->readPage(file1, rids[i].page_number, page);
+      records.push_back(*reinterpret_cast<const RECORD *>(page->getRecord(rids[i]).data()));
+      bufMgr->unPinPage(file1, rids[i].page_number, false);
+    }
+  }
+  index.endScan(cursor);
+  return records;
+}
+
+void compositeIndexTests()
+{
+  std::vector<KeyAttr> keyAttrs(2);
+  keyAttrs[0].offset = offsetof(tuple, i);
+  keyAttrs[0].type = INTEGER;
+  keyAttrs[1].offset = offsetof(tuple, d);
+  keyAttrs[1].type = DOUBLE;
+  std::string compositeIndexName;
+  for (int bulk = 1; bulk >= 0; bulk--)
+  {
+    {
+      BTreeIndex index(relationName, compositeIndexName, bufMgr, keyAttrs, bulk == 1);
+      checkPassFail((compositeIndexName == relationName + ".0,8"), true)
+      checkIndexShape(index);
+
+      // every entry, ordered by i and then by d
+      std::vector<RECORD> records = scanComposite(index, NULL, NULL, SCAN_ASCENDING);
+      checkPassFail((int)records.size(), relationSize)
+      int numInPlace = 0;
+      for (int k = 0; k < (int)records.size(); k++)
+        numInPlace += records[k].i == k / 100 - 25 && records[k].d == k % 100 - 49.5;
+      checkPassFail(numInPlace, relationSize)
+
+      // the entries of one value of i, greatest d first
+      const int group = -3;
+      const void *prefix[] = {&group};
+      CompositeKey low = index.compositeKey(prefix, 1);
+      CompositeKey high = index.compositeKey(prefix, 1, true);
+      records = scanComposite(index, &low, &high, SCAN_DESCENDING);
+      checkPassFail((int)records.size(), 100)
+      numInPlace = 0;
+      for (int j = 0; j < (int)records.size(); j++)
+        numInPlace += records[j].i == group && records[j].d == 49.5 - j;
+      checkPassFail(numInPlace, 100)
+
+      // a range of i
+      const int from = -5, to = 4;
+      const void *fromPrefix[] = {&from};
+      const void *toPrefix[] = {&to};
+      low = index.compositeKey(fromPrefix, 1);
+      high = index.compositeKey(toPrefix, 1, true);
+      checkPassFail((int)scanComposite(index, &low, &high, SCAN_ASCENDING).size(), 1000)
+
+      // one value of i and a range of d
+      const int zero = 0;
+      const double dLow = -10, dHigh = 10;
+      const void *lowValues[] = {&zero, &dLow};
+      const void *highValues[] = {&zero, &dHigh};
+      low = index.compositeKey(lowValues, 2);
+      high = index.compositeKey(highValues, 2);
+      records = scanComposite(index, &low, &high, SCAN_ASCENDING);
+      checkPassFail((int)records.size(), 20)
+      checkPassFail((records.front().d == -9.5 && records.back().d == 9.5), true)
+
+      // whole keys
+      const int seven = 7;
+      const double half = -0.5, quarter = 0.25;
+      const void *found[] = {&seven, &half};
+      const void *missing[] = {&seven, &quarter};
+      RecordId rid;
+      CompositeKey key = index.compositeKey(found, 2);
+      checkPassFail(index.lookup(&key, rid), true)
+      Page *page;
+      bufMgr->readPage(file1, rid.page_number, page);
+      const RECORD record = *reinterpret_cast<const RECORD *>(page->getRecord(rid).data());
+      bufMgr->unPinPage(file1, rid.page_number, false);
+      checkPassFail((record.i == seven && record.d == half), true)
+      key = index.compositeKey(missing, 2);
+      checkPassFail(index.lookup(&key, rid), false)
+
+      index.insertEntry(&key, rid);
+      checkPassFail(index.lookup(&key, rid), true)
+      index.deleteEntry(&key, rid);
+      checkPassFail(index.lookup(&key, rid), false)
+    }
+    File::remove(compositeIndexName);
+  }
+  {
+    BTreeIndex index(relationName, compositeIndexName, bufMgr, keyAttrs);
+    int thrown = 0;
+    const int values[3] = {0, 0, 0};
+    const void *tooMany[] = {&values[0], &values[1], &values[2]};
+    try
+    {
+      index.compositeKey(tooMany, 3);
+    }
+    catch (BadIndexInfoException e)
+    {
+      thrown++;
+    }
+
+    // the key attributes are part of the metapage
+    std::vector<KeyAttr> other = keyAttrs;
+    other[1].type = INTEGER;
+    try
+    {
+      BTreeIndex wrong(relationName, compositeIndexName, bufMgr, other);
+    }
+    catch (BadIndexInfoException e)
+    {
+      thrown++;
+    }
+    other.assign(3, keyAttrs[0]);
+    other[0].offset = other[1].offset = other[2].offset = offsetof(tuple, s);
+    other[0].type = other[1].type = other[2].type = STRING;
+    try
+    {
+      BTreeIndex wrong(relationName, compositeIndexName, bufMgr, other);
+    }
+    catch (BadIndexInfoException e)
+    {
+      thrown++;
+    }
+    checkPassFail(thrown, 3)
+  }
+  File::remove(compositeIndexName);
+}
+
+// -----------------------------------------------------------------------------
+// fenceKeyTests
+// -----------------------------------------------------------------------------
+
+void fenceKeyTests()
+{
+  {
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER);
+
+    // empty a range of keys spanning several leaves
+    const int gapLow = 1000, gapHigh = 1999;
+    for (int i = gapLow; i <= gapHigh; i++)
+    {
+      RecordId rid;
+      index.lookup(&i, rid);
+      index.deleteEntry(&i, rid);
+    }
+    checkIndexShape(index);
+
+    // a range inside the gap holds nothing, whichever leaf its bounds lead to
+    const int step = 37;
+    for (int order = 0; order < 2; order++)
+    {
+      int thrown = 0;
+      for (int low = gapLow - 1; low < gapHigh; low += step)
+      {
+        const int high = std::min(low + 100, gapHigh + 1);
+        IndexCursor cursor;
+        try
+        {
+          index.startScan(cursor, &low, GT, &high, LT, order == 0 ? SCAN_ASCENDING : SCAN_DESCENDING);
+        }
+        catch (NoSuchKeyFoundException e)
+        {
+          thrown++;
+        }
+      }
+      checkPassFail(thrown, (gapHigh - gapLow + step) / step)
+    }
+
+    // ranges reaching out of the gap find the keys around it
+    const int before = gapLow - 1, after = gapHigh + 1, middle = (gapLow + gapHigh) / 2;
+    checkPassFail(batchScan(&index, &middle, GTE, &after, LTE), 1)
+    checkPassFail(batchScan(&index, &before, GTE, &middle, LTE), 1)
+    checkPassFail(batchScan(&index, &before, GTE, &after, LTE), 2)
+
+    // lookups of keys in the gap stop at the leaf they descend to
+    std::vector<int> probes;
+    for (int i = gapLow - 10; i <= gapHigh + 10; i++)
+      probes.push_back(i);
+    std::vector<const void *> probeKeys;
+    for (std::size_t i = 0; i < probes.size(); i++)
+      probeKeys.push_back(&probes[i]);
+    std::vector<RecordId> batchRids;
+    std::vector<std::size_t> offsets;
+    index.lookupBatch(&probeKeys[0], probeKeys.size(), batchRids, offsets);
+    checkPassFail(batchRids.size(), 20)
+    int numFound = 0;
+    for (std::size_t i = 0; i < probes.size(); i++)
+    {
+      RecordId rid;
+      numFound += index.lookup(&probes[i], rid);
+    }
+    checkPassFail(numFound, 20)
+  }
+  File::remove(intIndexName);
+}
+
+// -----------------------------------------------------------------------------
+// writeAheadLogTests
+// -----------------------------------------------------------------------------
+
+void writeAheadLogTests()
+{
+  const std::string logName = "relA.log";
+  try
+  {
+    File::remove(logName);
+  }
+  catch (FileNotFoundException e)
+  {
+  }
+
+  // the child builds and changes the index in a pool too small to hold it, and exits without
+  // writing anything back: the log has every change, the index file only some
+  std::cout.flush();
+  const pid_t child = fork();
+  if (child == 0)
+  {
+    BufMgr pool(8);
+    WriteAheadLog log(logName);
+    pool.setLog(&log);
+    BTreeIndex index(relationName, intIndexName, &pool, offsetof(tuple, i), INTEGER);
+    for (int i = 0; i < 1000; i++)
+    {
+      RecordId rid;
+      index.lookup(&i, rid);
+      index.deleteEntry(&i, rid);
+    }
+    // a second entry for each of 1000 keys, splitting leaves
+    for (int i = 2000; i < 3000; i++)
+    {
+      RecordId rid;
+      index.lookup(&i, rid);
+      index.insertEntry(&i, rid);
+    }
+    // an action that never commits
+    log.beginAction();
+    for (int i = 4000; i < 4500; i++)
+    {
+      RecordId rid;
+      index.lookup(&i, rid);
+      index.insertEntry(&i, rid);
+    }
+    log.flushAll();
+    _exit(0);
+  }
+  int status;
+  waitpid(child, &status, 0);
+  checkPassFail(WIFEXITED(status), true)
+
+  WalRecovery recovery = WriteAheadLog::recover(logName);
+  checkPassFail((recovery.redone > 0), true)
+  checkPassFail((recovery.undone > 0), true)
+  checkPassFail((recovery.redone == recovery.records), true)
+  {
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER);
+    checkIndexShape(index);
+    int low = 0, high = 999;
+    checkPassFail(countScan(&index, &low, GTE, &high, LTE), 0)
+    low = 2000, high = 2999;
+    checkPassFail(countScan(&index, &low, GTE, &high, LTE), 2000)
+    low = 4000, high = 4499;
+    checkPassFail(countScan(&index, &low, GTE, &high, LTE), 500)
+    low = 0, high = relationSize;
+    checkPassFail(countScan(&index, &low, GTE, &high, LTE), relationSize)
+  }
+  // the log was emptied, recovering again changes nothing
+  recovery = WriteAheadLog::recover(logName);
+  checkPassFail(recovery.records, 0)
+
+  // commits of threads inserting together share writes of the log
+  {
+    BufMgr pool(50, true);
+    WriteAheadLog log(logName);
+    pool.setLog(&log);
+    const int numThreads = 4, perThread = 250;
+    {
+      BTreeIndex index(relationName, intIndexName, &pool, offsetof(tuple, i), INTEGER);
+      std::vector<std::thread> threads;
+      for (int t = 0; t < numThreads; t++)
+      {
+        threads.push_back(std::thread([&, t]() {
+          for (int i = 1000 + t * perThread; i < 1000 + (t + 1) * perThread; i++)
+          {
+            RecordId rid;
+            index.lookup(&i, rid);
+            index.insertEntry(&i, rid);
+          }
+        }));
+      }
+      for (int t = 0; t < numThreads; t++)
+        threads[t].join();
+      checkIndexShape(index);
+    }
+    WalStats stats = log.stats();
+    checkPassFail((int)stats.commits, numThreads * perThread)
+    checkPassFail((stats.flushes <= stats.commits), true)
+    checkPassFail((log.flushedLsn() == log.appendedLsn()), true)
+    pool.setLog(NULL);
+  }
+  {
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER);
+    int low = 1000, high = 1999;
+    checkPassFail(countScan(&index, &low, GTE, &high, LTE), 2000)
+  }
+  File::remove(intIndexName);
+  File::remove(logName);
+}
+
+// -----------------------------------------------------------------------------
+// checkpointTests
+// -----------------------------------------------------------------------------
+
+void checkpointTests()
+{
+  const std::string logName = "relA.log";
+  try
+  {
+    File::remove(logName);
+  }
+  catch (FileNotFoundException e)
+  {
+  }
+
+  // as in writeAheadLogTests(), with checkpoints between the changes and one in the middle of the
+  // action that never commits
+  std::cout.flush();
+  const pid_t child = fork();
+  if (child == 0)
+  {
+    WriteAheadLog log(logName);
+    BufMgr pool(8);
+    pool.setLog(&log);
+    BTreeIndex index(relationName, intIndexName, &pool, offsetof(tuple, i), INTEGER);
+    for (int i = 0; i < 1000; i++)
+    {
+      RecordId rid;
+      index.lookup(&i, rid);
+      index.deleteEntry(&i, rid);
+    }
+    pool.checkpoint();
+    for (int i = 2000; i < 3000; i++)
+    {
+      RecordId rid;
+      index.lookup(&i, rid);
+      index.insertEntry(&i, rid);
+    }
+    pool.checkpoint();
+    log.beginAction();
+    for (int i = 4000; i < 4500; i++)
+    {
+      RecordId rid;
+      index.lookup(&i, rid);
+      index.insertEntry(&i, rid);
+      if (i == 4250)
+        pool.checkpoint();
+    }
+    log.flushAll();
+    _exit(0);
+  }
+  int status;
+  waitpid(child, &status, 0);
+  checkPassFail(WIFEXITED(status), true)
+
+  WalRecovery recovery = WriteAheadLog::recover(logName, 4);
+  // the log is read from the redo point of the last checkpoint, which is before the first update
+  // of the action it interrupted
+  checkPassFail((recovery.redo_lsn > 0), true)
+  checkPassFail((recovery.undone > 0), true)
+  checkPassFail((recovery.skipped > 0), true)
+  checkPassFail((recovery.redone + recovery.skipped == recovery.records), true)
+  checkPassFail((recovery.threads >= 1 && recovery.threads <= 4), true)
+  checkPassFail(File::exists(logName + ".checkpoint"), false)
+  {
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER);
+    checkIndexShape(index);
+    int low = 0, high = 999;
+    checkPassFail(countScan(&index, &low, GTE, &high, LTE), 0)
+    low = 2000, high = 2999;
+    checkPassFail(countScan(&index, &low, GTE, &high, LTE), 2000)
+    low = 4000, high = 4499;
+    checkPassFail(countScan(&index, &low, GTE, &high, LTE), 500)
+    low = 0, high = relationSize;
+    checkPassFail(countScan(&index, &low, GTE, &high, LTE), relationSize)
+  }
+
+  // checkpoints taken in the background while threads insert
+  {
+    WriteAheadLog log(logName);
+    const int numThreads = 4, perThread = 250;
+    {
+      BufMgr pool(50, true);
+      pool.setLog(&log);
+      pool.startCheckpoints(1);
+      BTreeIndex index(relationName, intIndexName, &pool, offsetof(tuple, i), INTEGER);
+      std::vector<std::thread> threads;
+      for (int t = 0; t < numThreads; t++)
+      {
+        threads.push_back(std::thread([&, t]() {
+          for (int i = 1000 + t * perThread; i < 1000 + (t + 1) * perThread; i++)
+          {
+            RecordId rid;
+            index.lookup(&i, rid);
+            index.insertEntry(&i, rid);
+          }
+        }));
+      }
+      for (int t = 0; t < numThreads; t++)
+        threads[t].join();
+    }
+    checkPassFail((log.stats().checkpoints > 0), true)
+  }
+  // the pool wrote every page back, recovering changes nothing
+  WriteAheadLog::recover(logName);
+  {
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER);
+    checkIndexShape(index);
+    int low = 1000, high = 1999;
+    checkPassFail(countScan(&index, &low, GTE, &high, LTE), 2000)
+  }
+  File::remove(intIndexName);
+  File::remove(logName);
+}
+
+void intTestsEmptyTree()
+{
+  std::cout << "Create a B+ Tree index on the  integer field" << std::endl;
+  BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple,i), INTEGER);
+
+  // run some tests
+  checkPassFail(intScan(&index, 25, GT, 40, LT), 0)
+      checkPassFail(intScan(&index, 20, GTE, 35, LTE), 0)
+          checkPassFail(intScan(&index, -3, GT, 3, LT), 0)
+              checkPassFail(intScan(&index, 996, GT, 1001, LT), 0)
+                  checkPassFail(intScan(&index, 0, GT, 1, LT), 0)
+                        checkPassFail(intScan(&index, 300, GT, 400, LT), 0)
+                            checkPassFail(intScan(&index, 3000, GTE, 4000, LT), 0)
+   
+}
+
+void intNonConTests()
+{
+  std::cout << "Create a B+ Tree index on the integer field" << std::endl;
+  BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER);
+
+  // run some tests
+  checkPassFail(intScan(&index, 50, GT, 80, LT), 14)
+      checkPassFail(intScan(&index, 40, GTE, 70, LTE), 16)
+          checkPassFail(intScan(&index, -6, GT, 6, LT), 3)
+              checkPassFail(intScan(&index, 1992, GT, 2002, LT), 4)
+                  checkPassFail(intScan(&index, 0, GT, 2, LT), 0)
+                      checkPassFail(intScan(&index, 600, GT, 800, LT), 99)
+                          checkPassFail(intScan(&index, 6000, GTE, 8000, LT), 1000)
+}
+
+int intScan(BTreeIndex *index, int lowVal, Operator lowOp, int highVal, Operator highOp)
+{
+  printScanRange(lowVal, lowOp, highVal, highOp);
+  return countScan(index, &lowVal, lowOp, &highVal, highOp);
+}
+
+int doubleScan(BTreeIndex *index, double lowVal, Operator lowOp, double highVal, Operator highOp)
+{
+  printScanRange(lowVal, lowOp, highVal, highOp);
+  return countScan(index, &lowVal, lowOp, &highVal, highOp);
+}
+
+int stringScan(BTreeIndex *index, int lowVal, Operator lowOp, int highVal, Operator highOp)
+{
+  char lowValStr[31];
+  char highValStr[31];
+  sprintf(lowValStr, "%05d string record", lowVal);
+  sprintf(highValStr, "%05d string record", highVal);
+
+  printScanRange(lowVal, lowOp, highVal, highOp);
+  return countScan(index, lowValStr, lowOp, highValStr, highOp);
+}
+
+template <class T>
+void printScanRange(T lowVal, Operator lowOp, T highVal, Operator highOp)
+{
+  std::cout << "Scan for ";
+  if (lowOp == GT)
+  {
+    std::cout << "(";
+  }
+  else
+  {
+    std::cout << "[";
+  }
+  std::cout << lowVal << "," << highVal;
+  if (highOp == LT)
+  {
+    std::cout << ")";
+  }
+  else
+  {
+    std::cout << "]";
+  }
+  std::cout << std::endl;
+}
+
+int countScan(BTreeIndex *index, const void *lowVal, Operator lowOp, const void *highVal, Operator highOp)
+{
+  RecordId scanRid;
+  Page *curPage;
+
+  int numResults = 0;
+
+  try
+  {
+    index->startScan(lowVal, lowOp, highVal, highOp);
+  }
+  catch (NoSuchKeyFoundException e)
+  {
+    std::cout << "No Key Found satisfying the scan criteria." << std::endl;
+    return 0;
+  }
+
+  while (1)
+  {
+    try
+    {
+      index->scanNext(scanRid);
+      bufMgr->readPage(file1, scanRid.page_number, curPage);
+      RECORD myRec = *(reinterpret_cast<const RECORD *>(curPage->getRecord(scanRid).data()));
+      bufMgr->unPinPage(file1, scanRid.page_number, false);
+
+      if (numResults < 5)
+      {
+        std::cout << "at:" << scanRid.page_number << "," << scanRid.slot_number;
+        std::cout << " -->:" << myRec.i << ":" << myRec.d << ":" << myRec.s << ":" << std::endl;
+      }
+      else if (numResults == 5)
+      {
+        std::cout << "..." << std::endl;
+      }
+    }
+    catch (IndexScanCompletedException e)
+    {
+      break;
+    }
+    numResults++;
+  }
+
+  if (numResults >= 5)
+  {
+    std::cout << "Number of results: " << numResults << std::endl;
+  }
+  index->endScan();
+  std::cout << std::endl;
+
+  return numResults;
+}
+
+int batchScan(BTreeIndex *index, const void *lowVal, Operator lowOp, const void *highVal, Operator highOp)
+{
+  // an odd batch size, so batches end in the middle of leaves
+  const size_t batchSize = 97;
+  RecordId scanRids[batchSize];
+  int numResults = 0;
+
+  try
+  {
+    index->startScan(lowVal, lowOp, highVal, highOp);
+  }
+  catch (NoSuchKeyFoundException e)
+  {
+    std::cout << "No Key Found satisfying the scan criteria." << std::endl;
+    return 0;
+  }
+
+  size_t found;
+  while ((found = index->scanNextBatch(scanRids, batchSize)) > 0)
+  {
+    numResults += found;
+  }
+
+  // the scan stays completed for scanNext as well
+  try
+  {
+    index->scanNext(scanRids[0]);
+    std::cout << "scanNext returned an entry after scanNextBatch completed" << std::endl;
+    numResults = -1;
+  }
+  catch (IndexScanCompletedException e)
+  {
+  }
+  index->endScan();
+
+  std::cout << "Number of results: " << numResults << std::endl;
+  return numResults;
+}
+
+// -----------------------------------------------------------------------------
+// errorTests
+// -----------------------------------------------------------------------------
+
+void errorTests()
+{
+  std::cout << "Error handling tests" << std::endl;
+  std::cout << "--------------------" << std::endl;
+  // Given error test
+
+  // clear stashed file
+  try
+  {
+    File::remove(relationName);
+  }
+  catch (FileNotFoundException e)
+  {
+  }
+
+  file1 = new PageFile(relationName, true);
+
+  // initialize all of record1.s to keep purify happy
+  memset(record1.s, ' ', sizeof(record1.s));
+  PageId new_page_number;
+  Page new_page = file1->allocatePage(new_page_number);
+
+  // Insert a bunch of tuples into the relation.
+  for (int i = 0; i < 10; i++)
+  {
+    sprintf(record1.s, "%05d string record", i);
+    record1.i = i;
+    record1.d = (double)i;
+    std::string new_data(reinterpret_cast<char *>(&record1), sizeof(record1));
+
+    while (1)
+    {
+      try
+      {
+        new_page.insertRecord(new_data);
+        break;
+      }
+      catch (InsufficientSpaceException e)
+      {
+        file1->writePage(new_page_number, new_page);
+        new_page = file1->allocatePage(new_page_number);
+      }
+    }
+  }
+
+  file1->writePage(new_page_number, new_page);
+
+  BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER);
+
+  int int2 = 2;
+  int int5 = 5;
+
+  // Scan Tests
+  std::cout << "Call endScan before startScan" << std::endl;
+  try
+  {
+    index.endScan();
+    std::cout << "ScanNotInitialized Test 1 Failed." << std::endl;
+  }
+  catch (ScanNotInitializedException e)
+  {
+    std::cout << "ScanNotInitialized Test 1 Passed." << std::endl;
+  }
+
+  std::cout << "Call scanNext before startScan" << std::endl;
+  try
+  {
+    RecordId foo;
+    index.scanNext(foo);
+    std::cout << "ScanNotInitialized Test 2 Failed." << std::endl;
+  }
+  catch (ScanNotInitializedException e)
+  {
+    std::cout << "ScanNotInitialized Test 2 Passed." << std::endl;
+  }
+
+  std::cout << "Scan with bad lowOp" << std::endl;
+  try
+  {
+    index.startScan(&int2, LTE, &int5, LTE);
+    std::cout << "BadOpcodesException Test 1 Failed." << std::endl;
+  }
+  catch (BadOpcodesException e)
+  {
+    std::cout << "BadOpcodesException Test 1 Passed." << std::endl;
+  }
+
+  std::cout << "Scan with bad highOp" << std::endl;
+  try
+  {
+    index.startScan(&int2, GTE, &int5, GTE);
+    std::cout << "BadOpcodesException Test 2 Failed." << std::endl;
+  }
+  catch (BadOpcodesException e)
+  {
+    std::cout << "BadOpcodesException Test 2 Passed." << std::endl;
+  }
+
+  std::cout << "Scan with bad range" << std::endl;
+  try
+  {
+    index.startScan(&int5, GTE, &int2, LTE);
+    std::cout << "BadScanrangeException Test 1 Failed." << std::endl;
+  }
+  catch (BadScanrangeException e)
+  {
+    std::cout << "BadScanrangeException Test 1 Passed." << std::endl;
+  }
+
+  deleteRelation();
+}
+
+void deleteRelation()
+{
+  if (file1)
+  {
+    bufMgr->flushFile(file1);
+    delete file1;
+    file1 = NULL;
+  }
+  try
+  {
+    File::remove(relationName);
+  }
+  catch (FileNotFoundException e)
+  {
+  }
+}
+
 // -----------------------------------------------------------------------------
-// createNonConsecutiveRelationForward
+// checksumTests
 // -----------------------------------------------------------------------------
-void createNonConsecutiveRelation()
+
+/**
+ * Flips a byte of a page on disk.
+ */
+void damagePage(const std::string &fileName, const PageId pageNo, const std::size_t offset)
+{
+  std::fstream disk(fileName.c_str(), std::ios::in | std::ios::out | std::ios::binary);
+  const std::streampos position = sizeof(FileHeader) + (pageNo - 1) * Page::SIZE + offset;
+  disk.seekg(position);
+  char byte = disk.get();
+  byte ^= 0x5a;
+  disk.seekp(position);
+  disk.put(byte);
+}
+
+/**
+ * Reads a page through the pool, returning false if it does not match its checksum.
+ */
+bool readsWhole(BufMgr &pool, File &file, const PageId pageNo)
 {
-  std::vector<RecordId> ridVec;
-  // destroy any old copies of relation file
   try
   {
-    File::remove(relationName);
+    Page *page;
+    pool.readPage(&file, pageNo, page);
+    pool.unPinPage(&file, pageNo, false);
+    return true;
+  }
+  catch (CorruptPageException e)
+  {
+    return false;
+  }
+}
+
+void checksumTests()
+{
+  const std::string fileName = "checksumTest.0";
+  const int numPages = 3;
+  PageId pageNos[numPages];
+  for (int checksums = 1; checksums >= 0; checksums--)
+  {
+    File::setPageChecksums(checksums);
+    try
+    {
+      File::remove(fileName);
+    }
+    catch (FileNotFoundException e)
+    {
+    }
+
+    {
+      PageFile file = PageFile::create(fileName);
+      checkPassFail(file.pageChecksum(), (checksums ? CHECKSUM_HEADER : CHECKSUM_NONE))
+      BufMgr pool(8);
+      for (int i = 0; i < numPages; i++)
+      {
+        Page *page;
+        pool.allocPage(&file, pageNos[i], page);
+        sprintf(record1.s, "%05d string record", i);
+        page->insertRecord(std::string(record1.s));
+        pool.unPinPage(&file, pageNos[i], true);
+      }
+      pool.flushFile(&file);
+      // deleting the middle page rewrites the links of its neighbours on disk, which the checksum
+      // leaves out
+      pool.disposePage(&file, pageNos[1]);
+      checkPassFail(readsWhole(pool, file, pageNos[0]), true)
+      checkPassFail(readsWhole(pool, file, pageNos[2]), true)
+      pool.flushFile(&file);
+    }
+    // a record at the end of the last page
+    damagePage(fileName, pageNos[2], Page::SIZE - 1);
+    {
+      PageFile file = PageFile::open(fileName);
+      BufMgr pool(8);
+      checkPassFail(readsWhole(pool, file, pageNos[0]), true)
+      checkPassFail(readsWhole(pool, file, pageNos[2]), !checksums)
+      // the frame was given back
+      checkPassFail(readsWhole(pool, file, pageNos[0]), true)
+    }
+    File::remove(fileName);
+
+    {
+      BlobFile file = BlobFile::create(fileName);
+      checkPassFail(file.pageChecksum(), (checksums ? CHECKSUM_TRAILER : CHECKSUM_NONE))
+      BufMgr pool(8);
+      for (int i = 0; i < numPages; i++)
+      {
+        Page *page;
+        pool.allocPage(&file, pageNos[i], page);
+        memset(reinterpret_cast<char*>(page), 'a' + i, Page::BLOB_SIZE);
+        pool.unPinPage(&file, pageNos[i], true);
+      }
+      pool.flushFile(&file);
+    }
+    damagePage(fileName, pageNos[1], 100);
+    {
+      BlobFile file = BlobFile::open(fileName);
+      BufMgr pool(8);
+      checkPassFail(readsWhole(pool, file, pageNos[0]), true)
+      checkPassFail(readsWhole(pool, file, pageNos[1]), !checksums)
+      checkPassFail(readsWhole(pool, file, pageNos[2]), true)
+      Page *page;
+      pool.readPage(&file, pageNos[2], page);
+      checkPassFail(reinterpret_cast<char *>(page)[Page::BLOB_SIZE - 1], 'c')
+      pool.unPinPage(&file, pageNos[2], false);
+    }
+    File::remove(fileName);
+  }
+  File::setPageChecksums(true);
+}
+
+// -----------------------------------------------------------------------------
+// compressionTests
+// -----------------------------------------------------------------------------
+
+/**
+ * Size of a file on disk in bytes.
+ */
+long fileSize(const std::string &fileName)
+{
+  std::ifstream disk(fileName.c_str(), std::ios::binary | std::ios::ate);
+  return (long)disk.tellg();
+}
+
+void compressionTests()
+{
+  const std::string logName = "relA.log";
+  long plainSize;
+  {
+    BTreeIndex index(relationName, doubleIndexName, bufMgr, offsetof(tuple, d), DOUBLE);
+  }
+  plainSize = fileSize(doubleIndexName);
+  File::remove(doubleIndexName);
+
+  File::setPageCompression(true);
+  {
+    BTreeIndex index(relationName, doubleIndexName, bufMgr, offsetof(tuple, d), DOUBLE);
+  }
+  // keys and rids that follow each other take about a byte each; INTEGER leaves pack theirs already
+  const long compressedSize = fileSize(doubleIndexName);
+  checkPassFail((compressedSize * 2 < plainSize), true)
+  File::remove(doubleIndexName);
+  {
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER);
+    checkIndexShape(index);
+    int low = 0, high = relationSize;
+    checkPassFail(countScan(&index, &low, GTE, &high, LTE), relationSize)
+  }
+
+  // pages that grow are moved, and found where they went once the file is opened again
+  {
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER);
+    for (int i = 0; i < relationSize; i += 3)
+    {
+      RecordId rid;
+      index.lookup(&i, rid);
+      index.insertEntry(&i, rid);
+    }
+    for (int i = 0; i < 1000; i++)
+    {
+      RecordId rid;
+      index.lookup(&i, rid);
+      index.deleteEntry(&i, rid);
+    }
+  }
+  {
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER);
+    checkIndexShape(index);
+    int low = 0, high = relationSize;
+    const int expected = relationSize + (relationSize + 2) / 3 - 1000;
+    checkPassFail(countScan(&index, &low, GTE, &high, LTE), expected)
+    // one entry of each key was deleted, the second entries of every third key are left
+    low = 0, high = 999;
+    checkPassFail(countScan(&index, &low, GTE, &high, LTE), 334)
+  }
+  File::remove(intIndexName);
+
+  // recovery reads and writes the pages of a compressed file through its page map
+  try
+  {
+    File::remove(logName);
+  }
+  catch (FileNotFoundException e)
+  {
+  }
+  {
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER);
+  }
+  std::cout.flush();
+  const pid_t child = fork();
+  if (child == 0)
+  {
+    WriteAheadLog log(logName);
+    BufMgr pool(8);
+    pool.setLog(&log);
+    BTreeIndex index(relationName, intIndexName, &pool, offsetof(tuple, i), INTEGER);
+    for (int i = 0; i < 1000; i++)
+    {
+      RecordId rid;
+      index.lookup(&i, rid);
+      index.deleteEntry(&i, rid);
+    }
+    log.flushAll();
+    _exit(0);
+  }
+  int status;
+  waitpid(child, &status, 0);
+  checkPassFail(WIFEXITED(status), true)
+  WriteAheadLog::recover(logName);
+  {
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER);
+    checkIndexShape(index);
+    int low = 0, high = relationSize;
+    checkPassFail(countScan(&index, &low, GTE, &high, LTE), relationSize - 1000)
+  }
+  File::setPageCompression(false);
+  File::remove(intIndexName);
+  File::remove(logName);
+}
+
+// -----------------------------------------------------------------------------
+// packedLeafTests
+// -----------------------------------------------------------------------------
+
+void packedLeafTests()
+{
+  {
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER);
+
+    // bulk loaded leaves hold more distinct keys than their plain arrays have room for
+    IndexStats stats = index.getStats();
+    checkPassFail(stats.numEntries, relationSize)
+    checkPassFail((stats.numLeaves * INTARRAYLEAFSIZE < relationSize), true)
+    checkIndexShape(index);
+    int numFound = 0;
+    for (int i = -1; i <= relationSize; i++)
+    {
+      RecordId rid;
+      numFound += index.lookup(&i, rid);
+    }
+    checkPassFail(numFound, relationSize)
+    std::vector<int> keys = scanKeys(index, NULL, GT, NULL, LT, SCAN_DESCENDING, 0);
+    checkPassFail((int)keys.size(), relationSize)
+    checkPassFail(std::is_sorted(keys.rbegin(), keys.rend()), true)
+    const int low = 1234, high = 3456;
+    checkPassFail(countScan(&index, &low, GTE, &high, LT), high - low)
+    checkPassFail(countScan(&index, &low, GT, &high, LTE), high - low)
+
+    // keys far from the others widen the deltas of their leaves or split them
+    const int far[] = {INT_MIN, -1000000, relationSize * 1000, INT_MAX};
+    for (int i = 0; i < 4; i++)
+    {
+      RecordId rid = {(PageId)(relationSize + i), 1};
+      index.insertEntry(&far[i], rid);
+    }
+    checkIndexShape(index);
+    checkPassFail(index.getStats().numEntries, relationSize + 4)
+    int numFar = 0;
+    for (int i = 0; i < 4; i++)
+    {
+      RecordId rid;
+      numFar += index.lookup(&far[i], rid) && rid.page_number == (PageId)(relationSize + i);
+    }
+    checkPassFail(numFar, 4)
+    const int first = 0;
+    keys = scanKeys(index, &first, GTE, &relationSize, LT, SCAN_ASCENDING, 0);
+    checkPassFail((int)keys.size(), relationSize)
+    checkPassFail(std::is_sorted(keys.begin(), keys.end()), true)
+    numFound = 0;
+    for (int i = 0; i < relationSize; i++)
+    {
+      RecordId rid;
+      numFound += index.lookup(&i, rid);
+    }
+    checkPassFail(numFound, relationSize)
+
+    // and leaves shrinking back into their plain arrays keep every key left
+    for (int i = 0; i < 4; i++)
+    {
+      RecordId rid = {(PageId)(relationSize + i), 1};
+      index.deleteEntry(&far[i], rid);
+    }
+    for (int i = 0; i < relationSize; i++)
+    {
+      if (i % 5 != 0)
+      {
+        RecordId rid;
+        index.lookup(&i, rid);
+        index.deleteEntry(&i, rid);
+      }
+    }
+    checkIndexShape(index);
+    keys = scanKeys(index, NULL, GT, NULL, LT, SCAN_ASCENDING, 0);
+    checkPassFail((int)keys.size(), relationSize / 5)
+    int numKept = 0;
+    for (int i = 0; i < relationSize; i += 5)
+    {
+      RecordId rid;
+      numKept += index.lookup(&i, rid);
+    }
+    checkPassFail(numKept, relationSize / 5)
+  }
+  File::remove(intIndexName);
+
+  {
+    // leaves of long runs of duplicates built by inserts hold postings, and are packed once the
+    // postings outgrow them
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER, false);
+    const int numDistinct = 300, numInserts = 20000;
+    for (int i = 0; i < numInserts; i++)
+    {
+      const int key = i % numDistinct;
+      RecordId rid = {(PageId)(relationSize + i), 1};
+      index.insertEntry(&key, rid);
+    }
+    checkIndexShape(index);
+    checkPassFail(index.getStats().numEntries, relationSize + numInserts)
+    int numMatching = 0;
+    for (int k = 0; k < numDistinct; k++)
+    {
+      std::vector<RecordId> found;
+      numMatching += (int)index.lookupAll(&k, found) == 1 + numInserts / numDistinct + (k < numInserts % numDistinct);
+    }
+    checkPassFail(numMatching, numDistinct)
+    const int low = 0, high = numDistinct;
+    checkPassFail(batchScan(&index, &low, GTE, &high, LT), numDistinct + numInserts)
+  }
+  File::remove(intIndexName);
+}
+
+// -----------------------------------------------------------------------------
+// appendTests
+// -----------------------------------------------------------------------------
+
+void appendTests(const bool ascending)
+{
+  {
+    BTreeIndex index(relationName, doubleIndexName, bufMgr, offsetof(tuple, d), DOUBLE, false);
+    const IndexStats stats = index.getStats();
+    checkPassFail(stats.numEntries, relationSize)
+    checkIndexShape(index);
+    const double low = 0, high = relationSize;
+    checkPassFail(countScan(&index, &low, GTE, &high, LT), relationSize)
+    if (ascending)
+    {
+      // only the first insert and those splitting the rightmost leaf descend from the root, and
+      // the split leaves are left nine tenths full
+      checkPassFail(stats.appends, relationSize - 1 - stats.leafSplits)
+      checkPassFail((stats.leafFill > 0.75), true)
+    }
+    else
+    {
+      checkPassFail((stats.appends < relationSize / 2), true)
+    }
+
+    // keys belonging further left are not taken by the rightmost leaf
+    RecordId middleRid, lastRid;
+    const double middle = relationSize / 2;
+    index.lookup(&middle, middleRid);
+    index.insertEntry(&middle, middleRid);
+    const double last = relationSize - 1;
+    index.lookup(&last, lastRid);
+    index.insertEntry(&last, lastRid);
+    checkIndexShape(index);
+    checkPassFail(countScan(&index, &middle, GTE, &middle, LTE), 2)
+    checkPassFail(countScan(&index, &last, GTE, &last, LTE), 2)
+
+    // the rightmost leaf stays known as deletes merge it into its neighbours, and ascending inserts
+    // filling the tree up again go to it
+    index.deleteEntry(&middle, middleRid);
+    index.deleteEntry(&last, lastRid);
+    std::vector<RecordId> rids(relationSize);
+    for (int i = relationSize - 1; i >= relationSize / 4; i--)
+    {
+      const double key = i;
+      index.lookup(&key, rids[i]);
+      index.deleteEntry(&key, rids[i]);
+    }
+    checkPassFail((index.getStats().merges > 0), true)
+    const int appends = index.getStats().appends;
+    for (int i = relationSize / 4; i < relationSize; i++)
+    {
+      const double key = i;
+      index.insertEntry(&key, rids[i]);
+    }
+    checkPassFail((index.getStats().appends > appends), true)
+    checkIndexShape(index);
+    checkPassFail(countScan(&index, &low, GTE, &high, LT), relationSize)
+  }
+  File::remove(doubleIndexName);
+}
+
+// -----------------------------------------------------------------------------
+// insertBufferTests
+// -----------------------------------------------------------------------------
+
+void insertBufferTests()
+{
+  std::vector<int> keys(relationSize);
+  for (int i = 0; i < relationSize; i++)
+    keys[i] = i;
+  std::random_shuffle(keys.begin(), keys.end());
+  std::vector<RecordId> rids(relationSize);
+  const int numBuffered = relationSize / 2;
+  {
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER);
+    for (int i = 0; i < relationSize; i++)
+      index.lookup(&i, rids[i]);
+    index.setInsertBuffer(1000);
+
+    // buffered entries are found by lookups before they reach the tree, after those of the tree
+    for (int i = 0; i < 500; i++)
+      index.insertEntry(&keys[i], rids[keys[i]]);
+    IndexStats stats = index.getStats();
+    checkPassFail(stats.bufferedEntries, 500)
+    checkPassFail(stats.bufferFlushes, 0)
+    checkPassFail(stats.numEntries, relationSize)
+    int numFound = 0;
+    for (int i = 0; i < relationSize; i++)
+    {
+      std::vector<RecordId> found;
+      numFound += (int)index.lookupAll(&keys[i], found);
+    }
+    checkPassFail(numFound, relationSize + 500)
+    RecordId rid;
+    checkPassFail(index.lookup(&keys[0], rid), true)
+    checkPassFail((rid == rids[keys[0]]), true)
+
+    // and deleted from the buffer
+    index.deleteEntry(&keys[0], rids[keys[0]]);
+    checkPassFail(index.getStats().bufferedEntries, 499)
+    checkPassFail(index.getStats().numEntries, relationSize)
+    index.insertEntry(&keys[0], rids[keys[0]]);
+
+    // a full buffer goes to the tree in one batch
+    for (int i = 500; i < numBuffered; i++)
+      index.insertEntry(&keys[i], rids[keys[i]]);
+    stats = index.getStats();
+    checkPassFail(stats.bufferFlushes, numBuffered / 1000)
+    checkPassFail(stats.bufferedEntries, numBuffered % 1000)
+    checkPassFail(stats.numEntries, relationSize + numBuffered - numBuffered % 1000)
+    checkIndexShape(index);
+
+    // scans see every entry
+    const std::vector<int> scanned = scanKeys(index, NULL, GT, NULL, LT, SCAN_ASCENDING, 0);
+    checkPassFail((int)scanned.size(), relationSize + numBuffered)
+    checkPassFail(std::is_sorted(scanned.begin(), scanned.end()), true)
+    checkPassFail(index.getStats().bufferedEntries, 0)
+
+    // entries still buffered when the index is closed are flushed
+    index.insertEntry(&keys[numBuffered], rids[keys[numBuffered]]);
+    checkPassFail(index.getStats().bufferedEntries, 1)
+  }
+  {
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER);
+    checkPassFail(index.getStats().numEntries, relationSize + numBuffered + 1)
+    checkIndexShape(index);
+    int numFound = 0;
+    for (int i = 0; i < relationSize; i++)
+    {
+      std::vector<RecordId> found;
+      numFound += (int)index.lookupAll(&keys[i], found);
+    }
+    checkPassFail(numFound, relationSize + numBuffered + 1)
+
+    // without a buffer inserts go straight to the tree
+    index.setInsertBuffer(0);
+    index.insertEntry(&keys[numBuffered + 1], rids[keys[numBuffered + 1]]);
+    checkPassFail(index.getStats().bufferedEntries, 0)
+    checkPassFail(index.getStats().numEntries, relationSize + numBuffered + 2)
+  }
+  File::remove(intIndexName);
+}
+
+// -----------------------------------------------------------------------------
+// asyncReadTests
+// -----------------------------------------------------------------------------
+
+void asyncReadTests()
+{
+  const std::string fileName = "asyncTest.0";
+  const int numPages = 64;
+  try
+  {
+    File::remove(fileName);
+  }
+  catch (FileNotFoundException e)
+  {
+  }
+  std::vector<PageId> pageNos(numPages);
+  {
+    BlobFile file = BlobFile::create(fileName);
+    BufMgr pool(8);
+    for (int i = 0; i < numPages; i++)
+    {
+      Page *page;
+      pool.allocPage(&file, pageNos[i], page);
+      memset(reinterpret_cast<char*>(page), 'a' + i % 26, Page::BLOB_SIZE);
+      pool.unPinPage(&file, pageNos[i], true);
+    }
+    pool.flushFile(&file);
+  }
+
+  for (int threads = 0; threads <= 4; threads += 4)
+  {
+    BlobFile file = BlobFile::open(fileName);
+    BufMgr pool(numPages + 8);
+    if (threads > 0)
+      pool.startAsyncReads(threads);
+
+    // every page is pinned once its future is ready, with what was written to it
+    std::vector<std::future<Page *> > reads;
+    for (int i = 0; i < numPages; i++)
+      reads.push_back(pool.readPageAsync(&file, pageNos[i]));
+    std::vector<Page *> pages(numPages);
+    int numRead = 0;
+    for (int i = 0; i < numPages; i++)
+    {
+      pages[i] = reads[i].get();
+      const char *bytes = reinterpret_cast<const char *>(pages[i]);
+      numRead += bytes[0] == 'a' + i % 26 && bytes[Page::BLOB_SIZE - 1] == 'a' + i % 26;
+    }
+    checkPassFail(numRead, numPages)
+
+    // a page in the pool is pinned again before the call returns
+    std::future<Page *> resident = pool.readPageAsync(&file, pageNos[0]);
+    checkPassFail((resident.wait_for(std::chrono::seconds(0)) == std::future_status::ready), true)
+    checkPassFail((resident.get() == pages[0]), true)
+    for (int i = 0; i < numPages; i++)
+      pool.unPinPage(&file, pageNos[i], false);
+    pool.unPinPage(&file, pageNos[0], false);
+
+    // a page past the end of the file fails the future with what readPage() throws
+    std::future<Page *> invalid = pool.readPageAsync(&file, pageNos[numPages - 1] + 1);
+    bool thrown = false;
+    try
+    {
+      invalid.get();
+    }
+    catch (BadgerDbException &e)
+    {
+      thrown = true;
+    }
+    checkPassFail(thrown, true)
+
+    // callbacks hear back about every read, whichever thread runs them
+    std::mutex latch;
+    std::condition_variable signal;
+    int numDone = 0;
+    int numFailed = 0;
+    for (int i = 0; i <= numPages; i++)
+    {
+      const PageId pageNo = i < numPages ? pageNos[i] : pageNos[numPages - 1] + 1;
+      pool.readPageAsync(&file, pageNo, [&, pageNo](Page *page, std::exception_ptr error) {
+        if (page != NULL)
+          pool.unPinPage(&file, pageNo, false);
+        std::lock_guard<std::mutex> guard(latch);
+        numDone++;
+        numFailed += error != NULL;
+        signal.notify_all();
+      });
+    }
+    {
+      std::unique_lock<std::mutex> guard(latch);
+      while (numDone <= numPages)
+        signal.wait(guard);
+    }
+    checkPassFail(numFailed, 1)
+    pool.flushFile(&file);
+  }
+  File::remove(fileName);
+}
+
+// -----------------------------------------------------------------------------
+// pageHandleTests
+// -----------------------------------------------------------------------------
+
+void pageHandleTests()
+{
+  const std::string fileName = "handleTest.0";
+  try
+  {
+    File::remove(fileName);
   }
   catch (FileNotFoundException e)
   {
   }
+  PageId pageNos[2];
+  {
+    BlobFile file = BlobFile::create(fileName);
+    BufMgr pool(4);
+    {
+      // a page marked dirty is written back once its handle ends
+      PageHandle page = pool.allocPage(&file, pageNos[0]);
+      memset(reinterpret_cast<char*>(page.get()), 'a', Page::BLOB_SIZE);
+      page.markDirty();
+      PageHandle second = pool.allocPage(&file, pageNos[1]);
+      memset(reinterpret_cast<char*>(second.get()), 'b', Page::BLOB_SIZE);
+      second.release(true);
+      checkPassFail((bool)second, false)
+      // releasing an empty handle does nothing
+      second.release();
+    }
+    {
+      // moving a handle moves the pin with it
+      PageHandle page = pool.readPage(&file, pageNos[0]);
+      PageHandle moved(std::move(page));
+      checkPassFail((bool)page, false)
+      checkPassFail(moved.pageNo(), pageNos[0])
+      checkPassFail(reinterpret_cast<const char *>(moved.get())[0], 'a')
+      // assigning over a handle unpins the page it held
+      moved = pool.readPage(&file, pageNos[1]);
+      checkPassFail(reinterpret_cast<const char *>(moved.get())[0], 'b')
+      Page *unpinned;
+      pool.readPage(&file, pageNos[0], unpinned);
+      pool.unPinPage(&file, pageNos[0], false);
+      bool thrown = false;
+      try
+      {
+        pool.unPinPage(&file, pageNos[0], false);
+      }
+      catch (PageNotPinnedException &e)
+      {
+        thrown = true;
+      }
+      checkPassFail(thrown, true)
+    }
+    // a pin is dropped when an exception unwinds past its handle
+    try
+    {
+      PageHandle page = pool.readPage(&file, pageNos[0]);
+      throw NoSuchKeyFoundException();
+    }
+    catch (NoSuchKeyFoundException &e)
+    {
+    }
+    // every handle is gone, so no page of the file is pinned
+    pool.flushFile(&file);
+  }
+  {
+    BlobFile file = BlobFile::open(fileName);
+    BufMgr pool(4);
+    for (int i = 0; i < 2; i++)
+    {
+      PageHandle page = pool.readPage(&file, pageNos[i]);
+      checkPassFail(reinterpret_cast<const char *>(page.get())[Page::BLOB_SIZE - 1], 'a' + i)
+    }
+  }
+  File::remove(fileName);
+}
+
+// -----------------------------------------------------------------------------
+// resizeTests
+// -----------------------------------------------------------------------------
+
+void resizeTests()
+{
+  const std::string fileName = "resizeTest.0";
+  const int numPages = 32;
+  const ReplacementPolicy policies[] = {CLOCK, TWO_Q, PRIORITY_CLOCK, TWO_Q};
+  for (int p = 0; p < 4; p++)
+  {
+    try
+    {
+      File::remove(fileName);
+    }
+    catch (FileNotFoundException e)
+    {
+    }
+    std::vector<PageId> pageNos(numPages);
+    {
+      BlobFile file = BlobFile::create(fileName);
+      BufMgr pool(8, false, policies[p], FRAMES_SMALL_PAGES, p == 3 ? 4 : 1, numPages);
+      checkPassFail(pool.size(), 8u)
+      checkPassFail(pool.capacity(), (std::uint32_t)numPages)
+
+      // the pool holds only as many pages as it has frames
+      std::vector<PageHandle> pinned;
+      for (int i = 0; i < 8; i++)
+      {
+        pinned.push_back(pool.allocPage(&file, pageNos[i]));
+        memset(reinterpret_cast<char*>(pinned.back().get()), 'a' + i, Page::BLOB_SIZE);
+        pinned.back().markDirty();
+      }
+      bool exceeded = false;
+      try
+      {
+        pool.allocPage(&file, pageNos[8]);
+      }
+      catch (BufferExceededException &e)
+      {
+        exceeded = true;
+      }
+      checkPassFail(exceeded, true)
+
+      // once grown it holds them all
+      checkPassFail(pool.resize(numPages + 10), (std::uint32_t)numPages)
+      for (int i = 8; i < numPages; i++)
+      {
+        pinned.push_back(pool.allocPage(&file, pageNos[i]));
+        memset(reinterpret_cast<char*>(pinned.back().get()), 'a' + i % 26, Page::BLOB_SIZE);
+        pinned.back().markDirty();
+      }
+
+      // frames of pinned pages are not taken out
+      checkPassFail(pool.resize(4), (std::uint32_t)numPages)
+      pinned.clear();
+      // dirty pages taken out are written back first
+      checkPassFail(pool.resize(4), 4u)
+      checkPassFail(pool.resize(0), 1u)
+      int numRead = 0;
+      for (int i = 0; i < numPages; i++)
+      {
+        PageHandle page = pool.readPage(&file, pageNos[i]);
+        numRead += reinterpret_cast<const char *>(page.get())[Page::BLOB_SIZE - 1] == 'a' + i % 26;
+      }
+      checkPassFail(numRead, numPages)
+      checkPassFail(pool.resize(12), 12u)
+      pool.flushFile(&file);
+    }
+
+    // other threads go on reading while the pool is resized
+    {
+      BlobFile file = BlobFile::open(fileName);
+      BufMgr pool(16, true, policies[p], FRAMES_SMALL_PAGES, p == 3 ? 4 : 1, 64);
+      std::atomic<bool> stop(false);
+      std::atomic<int> numWrong(0);
+      std::vector<std::thread> readers;
+      for (int t = 0; t < 3; t++)
+      {
+        readers.push_back(std::thread([&, t]() {
+          for (int i = t; !stop; i = (i + 7) % numPages)
+          {
+            PageHandle page = pool.readPage(&file, pageNos[i]);
+            numWrong += reinterpret_cast<const char *>(page.get())[0] != 'a' + i % 26;
+          }
+        }));
+      }
+      for (int round = 0; round < 200; round++)
+      {
+        pool.resize(round % 2 ? 64 : 4 + round % 8);
+      }
+      stop = true;
+      for (std::size_t t = 0; t < readers.size(); t++)
+        readers[t].join();
+      checkPassFail(numWrong.load(), 0)
+      pool.flushFile(&file);
+    }
+    File::remove(fileName);
+  }
+}
 
-  file1 = new PageFile(relationName, true);
-  // initialize all of record1.s to keep purify happy
-  memset(record1.s, ' ', sizeof(record1.s));
-  PageId new_page_number;
-  Page new_page = file1->allocatePage(new_page_number);
+// -----------------------------------------------------------------------------
+// namedPoolTests
+// -----------------------------------------------------------------------------
 
-  // Insert a bunch of tuples into the relation.
-  for (int i = 0; i < relationSize; i++)
+void namedPoolTests()
+{
+  BufMgr *defaultMgr = bufMgr;
+  bufMgr = new BufMgr(20);
+  BufMgr *indexPool = bufMgr->addPool("index", 200, PRIORITY_CLOCK);
+  checkPassFail((bufMgr->addPool("index", 10) == indexPool), true)
+  checkPassFail((bufMgr->pool("index") == indexPool), true)
+  checkPassFail((bufMgr->pool("temp") == NULL), true)
+  bufMgr->bindFile(relationName + "." + std::to_string(offsetof(tuple, i)), indexPool);
   {
-    sprintf(record1.s, "%05d string record", 2*i);
-    record1.i = 2*i;
-    record1.d = 2.0*(double)i;
-    std::string new_data(reinterpret_cast<char *>(&record1), sizeof(record1));
+    // the index pages go to the index pool, through the buffer manager the index was given
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER);
+    checkPassFail((indexPool->getBufStats().accesses > 0), true)
+    const int low = 0;
+    const int high = relationSize;
+    checkPassFail(countScan(&index, &low, GTE, &high, LT), relationSize)
+    int numFound = 0;
+    for (int i = 0; i < relationSize; i += 7)
+    {
+      std::vector<RecordId> found;
+      numFound += (int)index.lookupAll(&i, found);
+    }
+    checkPassFail(numFound, (relationSize + 6) / 7)
 
-    while (1)
+    // a scan of the relation cycles through the small default pool only
+    indexPool->clearBufStats();
+    bufMgr->clearBufStats();
+    int numRecords = 0;
     {
+      FileScan fscan(relationName, bufMgr);
+      RecordId scanRid;
       try
       {
-        new_page.insertRecord(new_data);
-        break;
+        while (1)
+        {
+          fscan.scanNext(scanRid);
+          numRecords++;
+        }
       }
-      catch (InsufficientSpaceException e)
+      catch (EndOfFileException e)
       {
-        file1->writePage(new_page_number, new_page);
-        new_page = file1->allocatePage(new_page_number);
       }
     }
+    checkPassFail(numRecords, relationSize)
+    checkPassFail((bufMgr->getBufStats().diskreads > 0), true)
+    checkPassFail(indexPool->getBufStats().accesses, 0)
+
+    // and the index stays in its pool
+    numFound = 0;
+    for (int i = 0; i < relationSize; i += 7)
+    {
+      std::vector<RecordId> found;
+      numFound += (int)index.lookupAll(&i, found);
+    }
+    checkPassFail(numFound, (relationSize + 6) / 7)
+    checkPassFail(indexPool->getBufStats().diskreads, 0)
   }
-  file1->writePage(new_page_number, new_page);
+  File::remove(intIndexName);
+  bufMgr->flushFile(file1);
+  delete bufMgr;
+  bufMgr = defaultMgr;
 }
 
 // -----------------------------------------------------------------------------
-// createZeroRelationForward
+// hashIndexTests
 // -----------------------------------------------------------------------------
-void createZeroSizedRelationForward()
+
+void hashIndexTests()
 {
-  std::vector<RecordId> ridVec;
-  // destroy any old copies of relation file
+  std::string hashIndexName;
+  {
+    HashIndex index(relationName, hashIndexName, bufMgr, offsetof(tuple, i), INTEGER);
+    checkPassFail((hashIndexName == relationName + "." + std::to_string(offsetof(tuple, i)) + ".hash"), true)
+    HashIndexStats stats = index.getStats();
+    checkPassFail(stats.numEntries, relationSize)
+    checkPassFail((stats.globalDepth > 0), true)
+    checkPassFail((stats.numBuckets > 1), true)
+    checkPassFail(stats.numOverflowPages, 0)
+
+    // every key is found, and agrees with the B+Tree
+    BTreeIndex btree(relationName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER);
+    int numFound = 0;
+    int numAgree = 0;
+    for (int i = 0; i < relationSize; i++)
+    {
+      std::vector<RecordId> found;
+      std::vector<RecordId> expected;
+      numFound += (int)index.lookupAll(&i, found);
+      btree.lookupAll(&i, expected);
+      numAgree += (found == expected);
+    }
+    checkPassFail(numFound, relationSize)
+    checkPassFail(numAgree, relationSize)
+    RecordId outRid;
+    const int missing = relationSize;
+    checkPassFail(index.lookup(&missing, outRid), false)
+    const int negative = -1;
+    checkPassFail(index.lookup(&negative, outRid), false)
+
+    // a lookup reads the one bucket page of its key
+    bufMgr->clearBufStats();
+    const int key = relationSize / 2;
+    checkPassFail(index.lookup(&key, outRid), true)
+    checkPassFail(bufMgr->getBufStats().accesses, 1)
+
+    // many duplicates of one key cannot be split apart and go on in overflow pages
+    const int dupKey = relationSize + 1;
+    const int numDups = 2000;
+    for (int i = 0; i < numDups; i++)
+    {
+      RecordId dupRid;
+      dupRid.page_number = 1 + i / 100;
+      dupRid.slot_number = i % 100;
+      index.insertEntry(&dupKey, dupRid);
+    }
+    stats = index.getStats();
+    checkPassFail(stats.numEntries, relationSize + numDups)
+    checkPassFail((stats.numOverflowPages > 0), true)
+    std::vector<RecordId> dups;
+    checkPassFail((int)index.lookupAll(&dupKey, dups), numDups)
+    numFound = 0;
+    for (int i = 0; i < relationSize; i += 13)
+    {
+      numFound += index.lookup(&i, outRid);
+    }
+    checkPassFail(numFound, (relationSize + 12) / 13)
+
+    // delete the duplicates and the even keys
+    for (size_t i = 0; i < dups.size(); i++)
+    {
+      index.deleteEntry(&dupKey, dups[i]);
+    }
+    for (int i = 0; i < relationSize; i += 2)
+    {
+      std::vector<RecordId> found;
+      btree.lookupAll(&i, found);
+      index.deleteEntry(&i, found[0]);
+    }
+    bool thrown = false;
+    try
+    {
+      index.deleteEntry(&dupKey, dups[0]);
+    }
+    catch (NoSuchKeyFoundException e)
+    {
+      thrown = true;
+    }
+    checkPassFail(thrown, true)
+    checkPassFail(index.getStats().numEntries, relationSize / 2)
+  }
+
+  // reopen the index and check that it kept its entries
+  {
+    HashIndex index(relationName, hashIndexName, bufMgr, offsetof(tuple, i), INTEGER);
+    checkPassFail(index.getStats().numEntries, relationSize / 2)
+    int numFound = 0;
+    RecordId outRid;
+    for (int i = 0; i < relationSize; i++)
+    {
+      numFound += (index.lookup(&i, outRid) == (i % 2 == 1));
+    }
+    checkPassFail(numFound, relationSize)
+    const int dupKey = relationSize + 1;
+    checkPassFail(index.lookup(&dupKey, outRid), false)
+  }
+
+  // an index file is not opened for another type of key
+  bool thrown = false;
   try
   {
-    File::remove(relationName);
+    HashIndex index(relationName, hashIndexName, bufMgr, offsetof(tuple, i), DOUBLE);
   }
-  catch (FileNotFoundException e)
+  catch (BadIndexInfoException e)
   {
+    thrown = true;
   }
-  file1 = new PageFile(relationName, true);
+  checkPassFail(thrown, true)
+  File::remove(hashIndexName);
+  File::remove(intIndexName);
 
-  // initialize all of record1.s to keep purify happy
-  memset(record1.s, ' ', sizeof(record1.s));
-  PageId new_page_number;
-  Page new_page = file1->allocatePage(new_page_number);
-  file1->writePage(new_page_number, new_page);
+  // DOUBLE keys, -0.0 being found as 0.0
+  {
+    HashIndex index(relationName, hashIndexName, bufMgr, offsetof(tuple, d), DOUBLE);
+    int numFound = 0;
+    for (int i = 0; i < relationSize; i += 3)
+    {
+      std::vector<RecordId> found;
+      const double d = i;
+      numFound += (int)index.lookupAll(&d, found);
+    }
+    checkPassFail(numFound, (relationSize + 2) / 3)
+    RecordId outRid;
+    const double negZero = -0.0;
+    checkPassFail(index.lookup(&negZero, outRid), true)
+    const double half = 0.5;
+    checkPassFail(index.lookup(&half, outRid), false)
+  }
+  File::remove(hashIndexName);
+
+  // STRING keys, compared over their first STRINGSIZE bytes
+  {
+    HashIndex index(relationName, hashIndexName, bufMgr, offsetof(tuple, s), STRING);
+    int numFound = 0;
+    RecordId outRid;
+    for (int i = 0; i < relationSize; i += 5)
+    {
+      char s[32];
+      snprintf(s, sizeof(s), "%05d string record", i);
+      numFound += index.lookup(s, outRid);
+    }
+    checkPassFail(numFound, (relationSize + 4) / 5)
+    checkPassFail(index.lookup("99999 string record", outRid), false)
+  }
+  File::remove(hashIndexName);
+
+  // duplicates left in overflow pages by deletes are dealt out with the rest of their bucket when
+  // inserts of other keys split it; the relation is empty, so that the bucket starts at depth 0
+  const std::string emptyName = relationName + "Empty";
+  {
+    PageFile empty = PageFile::create(emptyName);
+  }
+  {
+    HashIndex index(emptyName, hashIndexName, bufMgr, offsetof(tuple, i), INTEGER);
+    checkPassFail(index.getStats().numEntries, 0)
+    const int dupKey = 7;
+    const int numDups = 1000, numDeleted = 700, numOthers = 2000;
+    std::vector<RecordId> dups;
+    for (int i = 0; i < numDups; i++)
+    {
+      RecordId dupRid;
+      dupRid.page_number = 1 + i / 100;
+      dupRid.slot_number = i % 100;
+      dups.push_back(dupRid);
+      index.insertEntry(&dupKey, dupRid);
+    }
+    checkPassFail((index.getStats().numOverflowPages > 0), true)
+    for (int i = 0; i < numDeleted; i++)
+    {
+      index.deleteEntry(&dupKey, dups[i]);
+    }
+    for (int i = 0; i < numOthers; i++)
+    {
+      const int other = 1000 + i;
+      index.insertEntry(&other, dups[i % numDups]);
+    }
+    checkPassFail((index.getStats().numBuckets > 1), true)
+    std::vector<RecordId> found;
+    checkPassFail((int)index.lookupAll(&dupKey, found), numDups - numDeleted)
+    int numKept = 0;
+    for (int i = numDeleted; i < numDups; i++)
+    {
+      numKept += (int)std::count(found.begin(), found.end(), dups[i]);
+    }
+    checkPassFail(numKept, numDups - numDeleted)
+    int numFound = 0;
+    RecordId outRid;
+    for (int i = 0; i < numOthers; i++)
+    {
+      const int other = 1000 + i;
+      numFound += index.lookup(&other, outRid);
+    }
+    checkPassFail(numFound, numOthers)
+    checkPassFail(index.getStats().numEntries, numDups - numDeleted + numOthers)
+  }
+  File::remove(hashIndexName);
+  File::remove(emptyName);
+
+  // the attribute type must have fixed size keys
+  thrown = false;
+  try
+  {
+    std::string otherName;
+    HashIndex index(relationName, otherName, bufMgr, offsetof(tuple, i), COMPOSITE);
+  }
+  catch (BadIndexInfoException e)
+  {
+    thrown = true;
+  }
+  checkPassFail(thrown, true)
+}
+
+// -----------------------------------------------------------------------------
+// keyFilterTests
+// -----------------------------------------------------------------------------
+
+void keyFilterTests()
+{
+  const int numProbes = 1000;
+  {
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER);
+    index.setKeyFilter(10);
+
+    // every key of the index passes the filter
+    int numFound = 0;
+    RecordId outRid;
+    for (int i = 0; i < relationSize; i++)
+    {
+      numFound += index.lookup(&i, outRid);
+    }
+    checkPassFail(numFound, relationSize)
+
+    // absent keys mostly end at the filter, without reading a node
+    bufMgr->clearBufStats();
+    numFound = 0;
+    for (int i = relationSize; i < relationSize + numProbes; i++)
+    {
+      std::vector<RecordId> found;
+      numFound += index.lookup(&i, outRid);
+      numFound += (int)index.lookupAll(&i, found);
+    }
+    checkPassFail(numFound, 0)
+    checkPassFail((bufMgr->getBufStats().accesses < numProbes / 5), true)
+
+    // a batch probes the keys that pass the filter only
+    std::vector<int> keys;
+    for (int i = 0; i < numProbes; i++)
+    {
+      keys.push_back(i % 2 == 0 ? i : relationSize + i);
+    }
+    std::vector<const void *> keyPtrs;
+    for (size_t i = 0; i < keys.size(); i++)
+    {
+      keyPtrs.push_back(&keys[i]);
+    }
+    std::vector<RecordId> rids;
+    std::vector<size_t> offsets;
+    index.lookupBatch(keyPtrs.data(), keyPtrs.size(), rids, offsets);
+    checkPassFail((int)rids.size(), numProbes / 2)
+    checkPassFail((offsets[1] - offsets[0]), 1)
+    checkPassFail((offsets[2] - offsets[1]), 0)
+
+    // so does a scan for one key
+    bool thrown = false;
+    const int absent = relationSize + 7;
+    try
+    {
+      index.startScan(&absent, GTE, &absent, LTE);
+    }
+    catch (NoSuchKeyFoundException e)
+    {
+      thrown = true;
+    }
+    checkPassFail(thrown, true)
+    const int present = relationSize / 2;
+    checkPassFail(countScan(&index, &present, GTE, &present, LTE), 1)
+
+    // inserted keys are added to the filter, also through the insert buffer
+    RecordId newRid;
+    newRid.page_number = 1;
+    newRid.slot_number = 1;
+    const int inserted = relationSize + 1;
+    index.insertEntry(&inserted, newRid);
+    checkPassFail(index.lookup(&inserted, outRid), true)
+    index.setInsertBuffer(16);
+    const int buffered = relationSize + 2;
+    index.insertEntry(&buffered, newRid);
+    checkPassFail(index.lookup(&buffered, outRid), true)
+    index.setInsertBuffer(0);
+    checkPassFail(index.lookup(&buffered, outRid), true)
+  }
+
+  // the filter is saved with the index and read back when it is opened
+  {
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER);
+    RecordId outRid;
+    const int inserted = relationSize + 1;
+    checkPassFail(index.lookup(&inserted, outRid), true)
+    bufMgr->clearBufStats();
+    int numFound = 0;
+    for (int i = relationSize + 3; i < relationSize + 3 + numProbes; i++)
+    {
+      numFound += index.lookup(&i, outRid);
+    }
+    checkPassFail(numFound, 0)
+    checkPassFail((bufMgr->getBufStats().accesses < numProbes / 5), true)
+
+    // without it every probe descends
+    index.setKeyFilter(0);
+    bufMgr->clearBufStats();
+    for (int i = relationSize + 3; i < relationSize + 3 + numProbes; i++)
+    {
+      numFound += index.lookup(&i, outRid);
+    }
+    checkPassFail(numFound, 0)
+    checkPassFail((bufMgr->getBufStats().accesses >= numProbes), true)
+  }
+
+  // and not read back once it was dropped
+  {
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER);
+    bufMgr->clearBufStats();
+    RecordId outRid;
+    const int absent = relationSize + 3;
+    checkPassFail(index.lookup(&absent, outRid), false)
+    checkPassFail((bufMgr->getBufStats().accesses > 0), true)
+  }
+  File::remove(intIndexName);
+
+  // STRING keys
+  {
+    BTreeIndex index(relationName, stringIndexName, bufMgr, offsetof(tuple, s), STRING);
+    index.setKeyFilter(10);
+    int numFound = 0;
+    RecordId outRid;
+    for (int i = 0; i < relationSize; i += 3)
+    {
+      char s[32];
+      snprintf(s, sizeof(s), "%05d string record", i);
+      numFound += index.lookup(s, outRid);
+    }
+    checkPassFail(numFound, (relationSize + 2) / 3)
+    checkPassFail(index.lookup("99999 string record", outRid), false)
+  }
+  File::remove(stringIndexName);
+}
+
+// -----------------------------------------------------------------------------
+// leafModelTests
+// -----------------------------------------------------------------------------
+
+/**
+ * Look up every key of a relation with keys 0 to relationSize, each duplicates times, and a few
+ * absent ones, and scan some ranges, through index.
+ */
+void checkLeafModelIndex(BTreeIndex &index, const int dups)
+{
+  const int numKeys = relationSize / dups;
+  int numFound = 0;
+  RecordId outRid;
+  for (int i = 0; i < numKeys; i++)
+  {
+    std::vector<RecordId> found;
+    numFound += ((int)index.lookupAll(&i, found) == dups && index.lookup(&i, outRid));
+  }
+  checkPassFail(numFound, numKeys)
+  const int below = -1;
+  checkPassFail(index.lookup(&below, outRid), false)
+  checkPassFail(index.lookup(&numKeys, outRid), false)
+
+  const int low = numKeys / 4;
+  const int high = numKeys / 2;
+  checkPassFail(countScan(&index, &low, GTE, &high, LTE), (high - low + 1) * dups)
+  checkPassFail(countScan(&index, &low, GT, &high, LT), (high - low - 1) * dups)
+  checkPassFail(countScan(&index, &below, GT, &numKeys, LT), relationSize)
+  checkPassFail(countScan(&index, &high, GTE, &high, LTE), dups)
+}
+
+void leafModelTests()
+{
+  // a bulk loaded index: leaves in a row, separators evenly spaced
+  {
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER);
+    checkPassFail(index.setLeafModel(), false)
+  }
+  {
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER, INDEX_READ_ONLY);
+    checkPassFail(index.setLeafModel(), true)
+    IndexStats stats = index.getStats();
+    checkPassFail((stats.leafModelKnots > 0 && stats.leafModelKnots <= 4), true)
+    checkPassFail((stats.leafModelBytes < 1024), true)
+    checkLeafModelIndex(index, 1);
+    checkPassFail(index.setLeafModel(0), true)
+    checkLeafModelIndex(index, 1);
+    checkPassFail(index.setLeafModel(-1), true)
+    checkPassFail(index.getStats().leafModelKnots, 0)
+    checkLeafModelIndex(index, 1);
+  }
+  File::remove(intIndexName);
+
+  // an index built by inserts in random order: split leaves all over the file
+  {
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER, false);
+  }
+  {
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER, INDEX_READ_ONLY);
+    checkPassFail(index.setLeafModel(), true)
+    checkLeafModelIndex(index, 1);
+    checkPassFail(index.setLeafModel(4), true)
+    checkLeafModelIndex(index, 1);
+  }
+  File::remove(intIndexName);
+
+  // other key types keep descending the tree
+  {
+    BTreeIndex index(relationName, doubleIndexName, bufMgr, offsetof(tuple, d), DOUBLE);
+  }
+  {
+    BTreeIndex index(relationName, doubleIndexName, bufMgr, offsetof(tuple, d), DOUBLE, INDEX_READ_ONLY);
+    checkPassFail(index.setLeafModel(), false)
+  }
+  File::remove(doubleIndexName);
+
+  // duplicates spanning leaves, whose separators repeat
+  deleteRelation();
+  createRelationDuplicates();
+  {
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER, false);
+  }
+  {
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER, INDEX_READ_ONLY);
+    checkPassFail(index.setLeafModel(), true)
+    checkLeafModelIndex(index, duplicates);
+  }
+  File::remove(intIndexName);
+}
+
+// -----------------------------------------------------------------------------
+// columnarPageTests
+// -----------------------------------------------------------------------------
+
+void columnarPageTests()
+{
+  // a page: the values of a column side by side, records put back together from their columns
+  {
+    PageFile file = PageFile::open(relationName);
+    Page page = file.readPage(file.getFirstPageNo());
+    const ColumnView ints = page.getColumn(0);
+    const ColumnView strings = page.getColumn(3);
+    checkPassFail((int)ints.width, (int)sizeof(int))
+    checkPassFail((int)strings.offset, (int)offsetof(tuple, s))
+    int numRecords = 0;
+    int numMatching = 0;
+    for (PageIterator iter = page.begin(); iter != page.end(); iter++)
+    {
+      const RecordId rid = iter.getCurrentRecord();
+      const std::string record = *iter;
+      int value;
+      memcpy(&value, ints.values + (rid.slot_number - 1) * ints.width, sizeof(int));
+      char field[sizeof(double) + 4];
+      page.copyField(rid, offsetof(tuple, d), sizeof(field), field);
+      numMatching += record.size() == sizeof(tuple) && value == ((const tuple *)record.data())->i
+        && memcmp(field, record.data() + offsetof(tuple, d), sizeof(field)) == 0
+        && memcmp(strings.values + (rid.slot_number - 1) * strings.width, record.data() + offsetof(tuple, s),
+          strings.width) == 0;
+      numRecords++;
+    }
+    checkPassFail((numRecords > 1), true)
+    checkPassFail(numMatching, numRecords)
+
+    // records have the length of the columns, and do not lie whole on the page
+    const RecordId first = page.begin().getCurrentRecord();
+    checkPassFail(page.hasSpaceForRecord(std::string(sizeof(tuple) - 1, 'x')), false)
+    int numThrown = 0;
+    try
+    {
+      page.insertRecord(std::string(sizeof(tuple) + 1, 'x'));
+    }
+    catch (InsufficientSpaceException e)
+    {
+      numThrown++;
+    }
+    try
+    {
+      page.getRecordView(first);
+    }
+    catch (InvalidRecordException e)
+    {
+      numThrown++;
+    }
+    checkPassFail(numThrown, 2)
+
+    // slots freed and filled again
+    const std::uint16_t freeSpace = page.getFreeSpace();
+    const std::string updated(sizeof(tuple), 'u');
+    page.updateRecord(first, updated);
+    checkPassFail((page.getRecord(first) == updated), true)
+    page.deleteRecord(first);
+    checkPassFail(page.getFreeSpace(), freeSpace + sizeof(tuple))
+    checkPassFail((page.insertRecord(updated) == first), true)
+    checkPassFail((page.getRecord(first) == updated), true)
+  }
+
+  // a filtered scan, which reads the column of the filter
+  {
+    AttrFilter<int> filter(offsetof(tuple, i), 100, GTE, 200, LT);
+    FileScan fscan(relationName, bufMgr, &filter);
+    const ScanField keyField = {offsetof(tuple, i), sizeof(int)};
+    fscan.setFields(std::vector<ScanField>(1, keyField));
+    int numFound = 0;
+    int numMatching = 0;
+    try
+    {
+      RecordId rid;
+      while (true)
+      {
+        fscan.scanNext(rid);
+        const RecordView view = fscan.getRecordView();
+        const int value = *(const int *)(view.data + offsetof(tuple, i));
+        numMatching += value >= 100 && value < 200 && view.length == sizeof(tuple)
+          && view.data[offsetof(tuple, s)] == '\0' && fscan.getRecord().substr(offsetof(tuple, s), 5)
+          == std::string(((const tuple *)fscan.getRecord().data())->s, 5);
+        numFound++;
+      }
+    }
+    catch (EndOfFileException e)
+    {
+    }
+    checkPassFail(numFound, 100)
+    checkPassFail(numMatching, 100)
+  }
+
+  // a parallel scan, and indexes built from the column of their key
+  {
+    BufMgr scanMgr(100, true);
+    ParallelFileScan pScan(relationName, &scanMgr, 4);
+    SumConsumer consumer(pScan.threads());
+    pScan.run(consumer);
+    checkPassFail(consumer.count(), relationSize)
+    checkPassFail(consumer.sum(), (long long)relationSize * (relationSize - 1) / 2)
+  }
+  {
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER);
+    checkPassFail(intScan(&index, 25, GT, 40, LT), 14)
+    checkPassFail(intScan(&index, -3, GT, relationSize, LT), relationSize)
+  }
+  File::remove(intIndexName);
+  std::string hashIndexName;
+  {
+    HashIndex index(relationName, hashIndexName, bufMgr, offsetof(tuple, d), DOUBLE);
+    int numFound = 0;
+    RecordId rid;
+    for (int i = 0; i < relationSize; i += 7)
+    {
+      const double key = i;
+      numFound += index.lookup(&key, rid);
+    }
+    checkPassFail(numFound, (relationSize + 6) / 7)
+  }
+  File::remove(hashIndexName);
+
+  // widths a page cannot hold records of
+  const std::string otherName = relationName + ".columnar";
+  int numRejected = 0;
+  try
+  {
+    PageFile::create(otherName, std::vector<std::uint16_t>(1, Page::DATA_SIZE));
+  }
+  catch (InsufficientSpaceException e)
+  {
+    numRejected++;
+  }
+  try
+  {
+    PageFile::create(otherName, std::vector<std::uint16_t>(Page::MAX_COLUMNS + 1, 1));
+  }
+  catch (InsufficientSpaceException e)
+  {
+    numRejected++;
+  }
+  checkPassFail(numRejected, 2)
+  checkPassFail(File::exists(otherName), false)
 }
 
 // -----------------------------------------------------------------------------
-// createRelationForward
+// batchFilterTests
 // -----------------------------------------------------------------------------
-void createRelationForward()
+
+// Matches the records whose string attribute ends in a given digit, through matches() alone
+class DigitFilter : public ScanFilter
 {
-  std::vector<RecordId> ridVec;
-  // destroy any old copies of relation file
-  try
+ public:
+  DigitFilter(const char digit)
+    : digit(digit)
   {
-    File::remove(relationName);
   }
-  catch (FileNotFoundException e)
+
+  bool matches(const RecordView &record) const
   {
+    return record.length > offsetof(tuple, s) + 4 && record.data[offsetof(tuple, s) + 4] == digit;
   }
 
-  file1 = new PageFile(relationName, true);
-  // initialize all of record1.s to keep purify happy
-  memset(record1.s, ' ', sizeof(record1.s));
-  PageId new_page_number;
-  Page new_page = file1->allocatePage(new_page_number);
+ private:
+  const char digit;
+};
 
-  // Insert a bunch of tuples into the relation.
-  for (int i = 0; i < relationSize; i++)
+/**
+ * Scans the relation with a filter a record at a time and a page at a time, and returns the number of
+ * records found if both scans find the same ones, -1 otherwise.
+ */
+int checkBatchScan(const ScanFilter *filter)
+{
+  std::vector<RecordId> single;
+  std::vector<RecordId> batched;
   {
-    sprintf(record1.s, "%05d string record", i);
-    record1.i = i;
-    record1.d = (double)i;
-    std::string new_data(reinterpret_cast<char *>(&record1), sizeof(record1));
-
-    while (1)
+    FileScan fscan(relationName, bufMgr, filter);
+    try
     {
-      try
+      RecordId rid;
+      while (true)
       {
-        new_page.insertRecord(new_data);
-        break;
+        fscan.scanNext(rid);
+        single.push_back(rid);
       }
-      catch (InsufficientSpaceException e)
+    }
+    catch (EndOfFileException e)
+    {
+    }
+  }
+  {
+    FileScan fscan(relationName, bufMgr, filter);
+    std::vector<RecordId> pageRids;
+    try
+    {
+      while (true)
       {
-        file1->writePage(new_page_number, new_page);
-        new_page = file1->allocatePage(new_page_number);
+        fscan.scanNextPage(pageRids);
+        for (std::size_t i = 0; i < pageRids.size(); i++)
+        {
+          if (pageRids[i].page_number != fscan.getPage()->page_number())
+            return -1;
+        }
+        batched.insert(batched.end(), pageRids.begin(), pageRids.end());
       }
     }
+    catch (EndOfFileException e)
+    {
+    }
   }
-  file1->writePage(new_page_number, new_page);
+  return single == batched ? (int)single.size() : -1;
 }
 
-// -----------------------------------------------------------------------------
-// createRelationBackward
-// -----------------------------------------------------------------------------
-void createRelationBackward()
+void batchFilterTests()
 {
-  // destroy any old copies of relation file
-  try
-  {
-    File::remove(relationName);
-  }
-  catch (FileNotFoundException e)
-  {
-  }
-  file1 = new PageFile(relationName, true);
-
-  // initialize all of record1.s to keep purify happy
-  memset(record1.s, ' ', sizeof(record1.s));
-  PageId new_page_number;
-  Page new_page = file1->allocatePage(new_page_number);
+  // bounds of every kind, those at the ends of int among them
+  AttrFilter<int> closed(offsetof(tuple, i), 100, GTE, 199, LTE);
+  AttrFilter<int> open(offsetof(tuple, i), 100, GT, 200, LT);
+  AttrFilter<int> lowOnly(offsetof(tuple, i), relationSize - 10, GTE, 0, EMPTY);
+  AttrFilter<int> all(offsetof(tuple, i), INT_MIN, GTE, INT_MAX, LTE);
+  AttrFilter<int> none(offsetof(tuple, i), INT_MAX, GT, 0, EMPTY);
+  AttrFilter<double> doubles(offsetof(tuple, d), 0.0, EMPTY, 9.5, LT);
+  DigitFilter digit('7');
+  checkPassFail(checkBatchScan(NULL), relationSize)
+  checkPassFail(checkBatchScan(&closed), 100)
+  checkPassFail(checkBatchScan(&open), 99)
+  checkPassFail(checkBatchScan(&lowOnly), 10)
+  checkPassFail(checkBatchScan(&all), relationSize)
+  checkPassFail(checkBatchScan(&none), 0)
+  checkPassFail(checkBatchScan(&doubles), 10)
+  checkPassFail(checkBatchScan(&digit), relationSize / 10)
 
-  // Insert a bunch of tuples into the relation.
-  for (int i = relationSize - 1; i >= 0; i--)
+  // a scan going on record at a time in the middle of a page, then a page at a time
   {
-    sprintf(record1.s, "%05d string record", i);
-    record1.i = i;
-    record1.d = i;
-
-    std::string new_data(reinterpret_cast<char *>(&record1), sizeof(RECORD));
-
-    while (1)
+    FileScan fscan(relationName, bufMgr, &closed);
+    RecordId rid;
+    fscan.scanNext(rid);
+    std::vector<RecordId> pageRids;
+    int numFound = 1;
+    int numPages = 0;
+    int numAfter = 0;
+    try
     {
-      try
-      {
-        new_page.insertRecord(new_data);
-        break;
-      }
-      catch (InsufficientSpaceException e)
+      while (true)
       {
-        file1->writePage(new_page_number, new_page);
-        new_page = file1->allocatePage(new_page_number);
+        numFound += fscan.scanNextPage(pageRids);
+        numAfter += pageRids[0].page_number != rid.page_number || pageRids[0].slot_number > rid.slot_number;
+        numPages++;
       }
     }
+    catch (EndOfFileException e)
+    {
+    }
+    checkPassFail(numFound, 100)
+    checkPassFail(numAfter, numPages)
   }
-  file1->writePage(new_page_number, new_page);
+
+  // the vectorized compare of ints against the plain one, for every kind of bound
+  int values[64];
+  for (int i = 0; i < 64; i++)
+  {
+    values[i] = (int)(random() % 41) - 20;
+  }
+  values[3] = INT_MIN;
+  values[60] = INT_MAX;
+  const Operator lowOps[] = {EMPTY, GT, GTE};
+  const Operator highOps[] = {EMPTY, LT, LTE};
+  const int bounds[] = {INT_MIN, -5, 0, 7, INT_MAX};
+  int numCompared = 0;
+  int numAgreeing = 0;
+  for (std::size_t count = 37; count <= 64; count += 27)
+    for (int lo = 0; lo < 3; lo++)
+      for (int hi = 0; hi < 3; hi++)
+        for (int l = 0; l < 5; l++)
+          for (int h = 0; h < 5; h++)
+          {
+            numAgreeing += selectRange(values, count, bounds[l], lowOps[lo], bounds[h], highOps[hi])
+              == selectRange<int>(values, count, bounds[l], lowOps[lo], bounds[h], highOps[hi]);
+            numCompared++;
+          }
+  checkPassFail(numAgreeing, numCompared)
 }
 
 // -----------------------------------------------------------------------------
-// createRelationRandom
+// openFileTests
 // -----------------------------------------------------------------------------
-void createRelationRandom()
+
+void openFileTests()
 {
-  // destroy any old copies of relation file
+  const std::string fileName = relationName + ".open";
+  const std::string otherName = "./" + fileName;
   try
   {
-    File::remove(relationName);
+    File::remove(fileName);
   }
   catch (FileNotFoundException e)
   {
   }
-  file1 = new PageFile(relationName, true);
-
-  // initialize all of record1.s to keep purify happy
-  memset(record1.s, ' ', sizeof(record1.s));
-  PageId new_page_number;
-  Page new_page = file1->allocatePage(new_page_number);
+  checkPassFail(File::exists(fileName), false)
+  checkPassFail(File::isOpen(fileName), false)
 
-  // insert records in random order
-
-  std::vector<int> intvec(relationSize);
-  for (int i = 0; i < relationSize; i++)
   {
-    intvec[i] = i;
-  }
+    PageFile file = PageFile::create(fileName);
+    checkPassFail(File::exists(otherName), true)
+    checkPassFail(File::isOpen(otherName), true)
 
-  long pos;
-  int val;
-  int i = 0;
-  while (i < relationSize)
-  {
-    pos = random() % (relationSize - i);
-    val = intvec[pos];
-    sprintf(record1.s, "%05d string record", val);
-    record1.i = val;
-    record1.d = val;
+    // a page allocated through one name is seen through the other, as the header is shared
+    PageId pageNo;
+    Page page = file.allocatePage(pageNo);
+    const RecordId rid = page.insertRecord("open file");
+    file.writePage(pageNo, page);
+    PageId otherPageNo;
+    {
+      PageFile other = PageFile::open(otherName);
+      checkPassFail(other.getFirstPageNo(), pageNo)
+      checkPassFail((other.readPage(pageNo).getRecord(rid) == "open file"), true)
 
-    std::string new_data(reinterpret_cast<char *>(&record1), sizeof(RECORD));
+      other.allocatePage(otherPageNo);
+      checkPassFail((otherPageNo != pageNo), true)
+      checkPassFail((file.readPage(otherPageNo).page_number() == otherPageNo), true)
 
-    while (1)
-    {
+      int numRejected = 0;
       try
       {
-        new_page.insertRecord(new_data);
-        break;
+        File::remove(otherName);
       }
-      catch (InsufficientSpaceException e)
+      catch (FileOpenException e)
       {
-        file1->writePage(new_page_number, new_page);
-        new_page = file1->allocatePage(new_page_number);
+        numRejected++;
+      }
+      try
+      {
+        PageFile::create(otherName);
       }
+      catch (FileExistsException e)
+      {
+        numRejected++;
+      }
+      checkPassFail(numRejected, 2)
     }
-
-    int temp = intvec[relationSize - 1 - i];
-    intvec[relationSize - 1 - i] = intvec[pos];
-    intvec[pos] = temp;
-    i++;
+    // closing one of them leaves the file open for the other
+    checkPassFail(File::isOpen(fileName), true)
+    checkPassFail(file.readPage(otherPageNo).page_number(), otherPageNo)
   }
+  checkPassFail(File::isOpen(fileName), false)
 
-  file1->writePage(new_page_number, new_page);
-}
-
-// -----------------------------------------------------------------------------
-// indexTests
-// -----------------------------------------------------------------------------
-
-void indexTests()
-{
-  if (testNum == 1)
+  // the header written back when the last object closed is read on open
   {
-    intTests();
-    try
+    PageFile file = PageFile::open(otherName);
+    int numPages = 0;
+    for (FileIterator iter = file.begin(); iter != file.end(); ++iter)
     {
-      std::cout << "try to remove: " << intIndexName << "\n";
-      File::remove(intIndexName);
+      numPages++;
     }
-    catch (FileNotFoundException e)
-    {
-    }    
+    checkPassFail(numPages, 2)
   }
+  File::remove(fileName);
+  checkPassFail(File::exists(otherName), false)
 }
 
-void indexTestsWithoutRemove()
+// -----------------------------------------------------------------------------
+// defragmentTests
+// -----------------------------------------------------------------------------
+
+void defragmentTests()
 {
-  if (testNum == 1)
   {
-    intTests();    
-  }
-}
+    // leaves split off by random inserts come in the order they were split
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER, false);
+    IndexShape shape;
+    index.inspect(shape);
+    checkPassFail((shape.leafJumps > 0), true)
+    const IndexStats before = index.getStats();
 
-void indexEmptyTests(){
-  if(testNum == 1){
-    intTestsEmptyTree();
-    try
-    {
-      File::remove(intIndexName);
-    }
-    catch (FileNotFoundException e)
-    {
-    }  
-  }
-}
+    // a scan started before the rebuild goes on in the new leaves without losing or repeating entries
+    int low = 0, high = relationSize;
+    IndexCursor cursor;
+    index.startScan(cursor, &low, GTE, &high, LT);
+    RecordId scanRids[100];
+    int found = 0;
+    size_t batch;
+    while (found < 1000 && (batch = index.scanNextBatch(cursor, scanRids, 100)) > 0)
+      found += batch;
+    checkPassFail(index.defragment(0.9), true)
+    while ((batch = index.scanNextBatch(cursor, scanRids, 100)) > 0)
+      found += batch;
+    index.endScan(cursor);
+    checkPassFail(found, relationSize)
 
-void indexOutOfBoundTests(){
-  if(testNum == 1){
-    intTestOutOfBounds();
-    try
+    const IndexStats after = index.getStats();
+    index.inspect(shape);
+    checkPassFail(shape.leafJumps, 0)
+    checkPassFail(shape.freePages, before.numLeaves + before.numNonLeaves)
+    checkPassFail(after.numEntries, relationSize)
+    checkPassFail((after.numLeaves < before.numLeaves), true)
+    checkPassFail((after.leafFill > before.leafFill), true)
+    checkIndexShape(index);
+    checkPassFail(intScan(&index, 25, GT, 40, LT), 14)
+    checkPassFail(intScan(&index, 3000, GTE, 4000, LT), 1000)
+
+    // the old pages are reused by inserts, and a second rebuild leaves the leaves in order again
+    for (int i = relationSize; i < relationSize + 2000; i++)
     {
-      std::cout << "try to remove: " << intIndexName << "\n";
-      File::remove(intIndexName);
+      const RecordId fakeRid = {(PageId)i, 9999};
+      index.insertEntry(&i, fakeRid);
     }
-    catch (FileNotFoundException e)
+    index.inspect(shape);
+    checkPassFail((shape.freePages < before.numLeaves + before.numNonLeaves), true)
+    checkPassFail(index.defragment(), true)
+    index.inspect(shape);
+    checkPassFail(shape.leafJumps, 0)
+    checkPassFail(index.getStats().numEntries, relationSize + 2000)
+    checkIndexShape(index);
+    for (int i = relationSize; i < relationSize + 2000; i++)
     {
-    }  
+      const RecordId fakeRid = {(PageId)i, 9999};
+      index.deleteEntry(&i, fakeRid);
+    }
+    checkPassFail(intScan(&index, 0, GTE, relationSize, LT), relationSize)
   }
-}
 
-void indexNonConsecutiveTests(){
-  if(testNum == 1){
-    intNonConTests();
-    try
+  {
+    // scans in other threads keep going while the index is rebuilt under them
+    BufMgr concurrentMgr(50, true);
+    BTreeIndex index(relationName, intIndexName, &concurrentMgr, offsetof(tuple, i), INTEGER);
+    const int numReaders = 2;
+    int badScans[numReaders];
+    std::atomic<bool> rebuilding(true);
+    std::vector<std::thread> threads;
+    for (int r = 0; r < numReaders; r++)
     {
-      std::cout << "try to remove: " << intIndexName << "\n";
-      File::remove(intIndexName);
+      threads.push_back(std::thread([&, r]() {
+        badScans[r] = 0;
+        int low = 0, high = relationSize;
+        do
+        {
+          IndexCursor cursor;
+          RecordId scanRids[64];
+          int found = 0;
+          size_t batch;
+          index.startScan(cursor, &low, GTE, &high, LT);
+          while ((batch = index.scanNextBatch(cursor, scanRids, 64)) > 0)
+            found += batch;
+          index.endScan(cursor);
+          badScans[r] += found != relationSize;
+        } while (rebuilding);
+      }));
     }
-    catch (FileNotFoundException e)
-    {
-    }  
+    int numRebuilt = 0;
+    for (int k = 0; k < 20; k++)
+      numRebuilt += index.defragment(k % 2 == 0 ? 0.5 : 1.0);
+    rebuilding = false;
+    for (size_t t = 0; t < threads.size(); t++)
+      threads[t].join();
+    for (int r = 0; r < numReaders; r++)
+      checkPassFail(badScans[r], 0)
+    checkPassFail(numRebuilt, 20)
+    checkIndexShape(index);
   }
-}
 
-void intErrorTests(){
-  if(testNum == 1){
-    errorTests();
+  {
+    int numRejected = 0;
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER, INDEX_READ_ONLY);
     try
     {
-      std::cout << "try to remove: " << intIndexName << "\n";
-      File::remove(intIndexName);
+      index.defragment();
     }
-    catch (FileNotFoundException e)
+    catch (ReadOnlyIndexException e)
     {
-    }  
+      numRejected++;
+    }
+    checkPassFail(numRejected, 1)
   }
-}
-
-
-
-void intTestOutOfBounds() {
-  std::cout << "Create a B+ Tree index on the integer field" << std::endl;
-  BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER);
-
-  checkPassFail(intScan(&index, -1000000, GT, 100000, LT), relationSize) 
+  File::remove(intIndexName);
 }
 
 // -----------------------------------------------------------------------------
-// intTests
+// traceTests
 // -----------------------------------------------------------------------------
 
-void intTests()
+class CountingSink : public TraceSink
 {
-  std::cout << "Create a B+ Tree index on the integer field" << std::endl;
-  BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER);
+public:
+  std::vector<OpTrace> traces;
 
-  // run some tests
-  checkPassFail(intScan(&index, 25, GT, 40, LT), 14)
-      checkPassFail(intScan(&index, 20, GTE, 35, LTE), 16)
-          checkPassFail(intScan(&index, -3, GT, 3, LT), 3)
-              checkPassFail(intScan(&index, 996, GT, 1001, LT), 4)
-                  checkPassFail(intScan(&index, 0, GT, 1, LT), 0)
-                      checkPassFail(intScan(&index, 300, GT, 400, LT), 99)
-                          checkPassFail(intScan(&index, 3000, GTE, 4000, LT), 1000)
-}
+  void record(const OpTrace &trace)
+  {
+    traces.push_back(trace);
+  }
 
-void intTestsEmptyTree()
+  int count(const TraceOp op) const
+  {
+    int n = 0;
+    for (size_t t = 0; t < traces.size(); t++)
+      n += traces[t].op == op;
+    return n;
+  }
+};
+
+void traceTests()
 {
-  std::cout << "Create a B+ Tree index on the  integer field" << std::endl;
-  BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple,i), INTEGER);
+  {
+    CountingSink sink;
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER, false);
+    const IndexStats before = index.getStats();
 
-  // run some tests
-  checkPassFail(intScan(&index, 25, GT, 40, LT), 0)
-      checkPassFail(intScan(&index, 20, GTE, 35, LTE), 0)
-          checkPassFail(intScan(&index, -3, GT, 3, LT), 0)
-              checkPassFail(intScan(&index, 996, GT, 1001, LT), 0)
-                  checkPassFail(intScan(&index, 0, GT, 1, LT), 0)
-                        checkPassFail(intScan(&index, 300, GT, 400, LT), 0)
-                            checkPassFail(intScan(&index, 3000, GTE, 4000, LT), 0)
-   
-}
+    // every insert pins the nodes on its path, and the splits of the inserts are all counted
+    Tracer::setSink(&sink);
+    const int numInserts = 2000;
+    for (int i = relationSize; i < relationSize + numInserts; i++)
+    {
+      const RecordId fakeRid = {(PageId)i, 9999};
+      index.insertEntry(&i, fakeRid);
+    }
+    checkPassFail(sink.count(TRACE_INSERT), numInserts)
+    std::uint64_t pins = 0, splits = 0;
+    for (size_t t = 0; t < sink.traces.size(); t++)
+    {
+      pins += sink.traces[t].pins;
+      splits += sink.traces[t].splits;
+      checkPassFail((sink.traces[t].nanos > 0), true)
+    }
+    const IndexStats after = index.getStats();
+    const int height = after.height;
+    checkPassFail((pins >= (std::uint64_t)numInserts), true)
+    checkPassFail((splits > 0), true)
+    checkPassFail(splits, (std::uint64_t)(after.leafSplits + after.nonLeafSplits - before.leafSplits - before.nonLeafSplits))
 
-void intNonConTests()
-{
-  std::cout << "Create a B+ Tree index on the integer field" << std::endl;
-  BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER);
+    // a lookup descends the whole height of the tree
+    sink.traces.clear();
+    RecordId rid;
+    const int key = 1234;
+    checkPassFail(index.lookup(&key, rid), true)
+    checkPassFail(sink.traces.size(), 1)
+    checkPassFail(sink.traces[0].op, TRACE_LOOKUP)
+    checkPassFail(sink.traces[0].depth, (std::uint32_t)height)
+    checkPassFail(sink.traces[0].entries, 1)
+    checkPassFail((sink.traces[0].pins >= (std::uint32_t)height), true)
+    checkPassFail(std::string(sink.traces[0].indexName), intIndexName)
+
+    // a scan traces its positioning and then each batch, with the entries the batch returned
+    sink.traces.clear();
+    int low = 100, high = 400;
+    IndexCursor cursor;
+    index.startScan(cursor, &low, GTE, &high, LT);
+    RecordId scanRids[100];
+    size_t batch;
+    while ((batch = index.scanNextBatch(cursor, scanRids, 100)) > 0)
+      ;
+    index.endScan(cursor);
+    checkPassFail(sink.count(TRACE_START_SCAN), 1)
+    checkPassFail(sink.traces[0].depth, (std::uint32_t)height)
+    std::uint64_t entries = 0;
+    for (size_t t = 1; t < sink.traces.size(); t++)
+    {
+      checkPassFail(sink.traces[t].op, TRACE_SCAN_BATCH)
+      entries += sink.traces[t].entries;
+    }
+    checkPassFail(entries, 300)
+
+    // sampling traces one lookup in every sampleEvery, starting with the first
+    sink.traces.clear();
+    Tracer::setSink(&sink, 10);
+    for (int i = 0; i < 95; i++)
+      index.lookup(&i, rid);
+    checkPassFail(sink.traces.size(), 10)
 
-  // run some tests
-  checkPassFail(intScan(&index, 50, GT, 80, LT), 14)
-      checkPassFail(intScan(&index, 40, GTE, 70, LTE), 16)
-          checkPassFail(intScan(&index, -6, GT, 6, LT), 3)
-              checkPassFail(intScan(&index, 1992, GT, 2002, LT), 4)
-                  checkPassFail(intScan(&index, 0, GT, 2, LT), 0)
-                      checkPassFail(intScan(&index, 600, GT, 800, LT), 99)
-                          checkPassFail(intScan(&index, 6000, GTE, 8000, LT), 1000)
+    // nothing is traced once the sink is removed
+    sink.traces.clear();
+    Tracer::setSink(NULL);
+    for (int i = 0; i < 10; i++)
+      index.lookup(&i, rid);
+    checkPassFail(sink.traces.size(), 0)
+  }
+  File::remove(intIndexName);
 }
 
-int intScan(BTreeIndex *index, int lowVal, Operator lowOp, int highVal, Operator highOp)
-{
-  RecordId scanRid;
-  Page *curPage;
+// -----------------------------------------------------------------------------
+// sortTests
+// -----------------------------------------------------------------------------
 
-  std::cout << "Scan for ";
-  if (lowOp == GT)
+void sortTests()
+{
   {
-    std::cout << "(";
+    // runs beyond the budget are spilled, and more of them than the merge can read at once are merged
+    // in passes first; the pool is small, so that the spilled pages are evicted and read back
+    const int count = 100000;
+    std::vector<int> values(count);
+    for (int i = 0; i < count; i++)
+      values[i] = i / 2;
+    std::random_shuffle(values.begin(), values.end());
+    BufMgr sortMgr(40);
+    ExternalSort<int> sorter(&sortMgr, "sortTest", 4 * Page::SIZE);
+    for (int i = 0; i < count; i++)
+      sorter.add(values[i]);
+    sorter.finish();
+    checkPassFail(sorter.size(), (size_t)count)
+    checkPassFail((sorter.spilledRuns() > 0), true)
+    checkPassFail((sorter.mergePasses() > 0), true)
+    std::vector<int> sorted(count + 1);
+    int read = 0, batch;
+    while ((batch = sorter.read(&sorted[read], 1000)) > 0)
+      read += batch;
+    checkPassFail(read, count)
+    int misplaced = 0;
+    for (int i = 0; i < count; i++)
+      misplaced += sorted[i] != i / 2;
+    checkPassFail(misplaced, 0)
   }
-  else
+
   {
-    std::cout << "[";
+    // a sort that fits in memory writes nothing
+    ExternalSort<int> sorter(bufMgr, "sortTest");
+    std::vector<int> run;
+    for (int i = 0; i < 1000; i++)
+      run.push_back(2 * i);
+    sorter.addRun(run);
+    checkPassFail(run.empty(), true)
+    for (int i = 999; i >= 0; i--)
+      sorter.add(2 * i + 1);
+    sorter.finish();
+    int next[2000];
+    checkPassFail(sorter.read(next, 2000), 2000)
+    checkPassFail(sorter.pagesWritten(), 0)
+    int misplaced = 0;
+    for (int i = 0; i < 2000; i++)
+      misplaced += next[i] != i;
+    checkPassFail(misplaced, 0)
   }
-  std::cout << lowVal << "," << highVal;
-  if (highOp == LT)
+
+  BTreeIndex::setSortMemory(4 * Page::SIZE);
   {
-    std::cout << ")";
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER);
+    checkPassFail(index.getStats().numEntries, relationSize)
+    checkIndexShape(index);
+    checkPassFail(intScan(&index, 25, GT, 40, LT), 14)
+    checkPassFail(intScan(&index, 0, GTE, relationSize, LT), relationSize)
+    checkPassFail(index.defragment(), true)
+    checkIndexShape(index);
+    checkPassFail(intScan(&index, 0, GTE, relationSize, LT), relationSize)
   }
-  else
+  File::remove(intIndexName);
+
   {
-    std::cout << "]";
+    // threads of a parallel build hand their runs to the sort as they fill their share of it
+    BufMgr concurrentMgr(100, true);
+    BTreeIndex index(relationName, intIndexName, &concurrentMgr, offsetof(tuple, i), INTEGER);
+    checkPassFail(index.getStats().numEntries, relationSize)
+    checkIndexShape(index);
+    checkPassFail(intScan(&index, 3000, GTE, 4000, LT), 1000)
   }
-  std::cout << std::endl;
+  File::remove(intIndexName);
+  BTreeIndex::setSortMemory(ExternalSort<int>::DEFAULT_MEMORY);
+}
 
-  int numResults = 0;
+// -----------------------------------------------------------------------------
+// nodeSearchTests
+// -----------------------------------------------------------------------------
 
-  try
-  {
-    index->startScan(&lowVal, lowOp, &highVal, highOp);
-  }
-  catch (NoSuchKeyFoundException e)
+void nodeSearchTests()
+{
   {
-    std::cout << "No Key Found satisfying the scan criteria." << std::endl;
-    return 0;
+    // even keys past the relation, inserted one by one, so that nodes end at every count of keys
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER, false);
+    const int numEven = 3000;
+    for (int j = 0; j < numEven; j++)
+    {
+      const int key = relationSize + 2 * j;
+      const RecordId fakeRid = {(PageId)key, 9999};
+      index.insertEntry(&key, fakeRid);
+    }
+    checkIndexShape(index);
+    IndexShape shape;
+    index.inspect(shape);
+    for (std::size_t l = 0; l < shape.levels.size(); l++)
+      checkPassFail((shape.levels[l].minKeys > 0 || shape.levels[l].nodes == 1), true)
+
+    // every key is found at its own position and no key is found between two of them
+    int misses = 0;
+    RecordId rid;
+    for (int key = -1; key < relationSize + 2 * numEven + 1; key++)
+    {
+      const bool present = key >= 0 && (key < relationSize || (key - relationSize) % 2 == 0)
+                           && key < relationSize + 2 * numEven;
+      misses += index.lookup(&key, rid) != present;
+      if (present && key >= relationSize)
+        misses += rid.page_number != (PageId)key;
+    }
+    checkPassFail(misses, 0)
+
+    // scan bounds between keys and on keys
+    int low = relationSize + 11, high = relationSize + 21;
+    checkPassFail(batchScan(&index, &low, GT, &high, LT), 5)
+    low = relationSize + 10;
+    high = relationSize + 20;
+    checkPassFail(batchScan(&index, &low, GT, &high, LTE), 5)
+    checkPassFail(batchScan(&index, &low, GTE, &high, LT), 5)
+    low = relationSize - 5;
+    checkPassFail(batchScan(&index, &low, GTE, &high, LTE), 16)
   }
+  File::remove(intIndexName);
+}
 
-  while (1)
+// -----------------------------------------------------------------------------
+// inPlaceInsertTests
+// -----------------------------------------------------------------------------
+
+void inPlaceInsertTests()
+{
   {
-    try
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER, false);
+
+    // descending keys always go to the front of the first leaf, ascending ones to the end of the last
+    const int numEach = 3000;
+    for (int j = 1; j <= numEach; j++)
     {
-      index->scanNext(scanRid);
-      bufMgr->readPage(file1, scanRid.page_number, curPage);
-      RECORD myRec = *(reinterpret_cast<const RECORD *>(curPage->getRecord(scanRid).data()));
-      bufMgr->unPinPage(file1, scanRid.page_number, false);
+      const int low = -j, high = relationSize + j;
+      const RecordId lowRid = {(PageId)(numEach + low), 1}, highRid = {(PageId)high, 1};
+      index.insertEntry(&low, lowRid);
+      index.insertEntry(&high, highRid);
+    }
+    // keys strided over a range, so that splits put the new entry in either half of the node
+    const int strideBase = relationSize + 2 * numEach, numStrided = 4001;
+    for (int j = 0; j < numStrided; j++)
+    {
+      const int key = strideBase + (int)(((long)j * 1543) % numStrided);
+      const RecordId rid = {(PageId)key, 2};
+      index.insertEntry(&key, rid);
+    }
+    checkIndexShape(index);
+    checkPassFail(index.getStats().numEntries, relationSize + 2 * numEach + numStrided)
 
-      if (numResults < 5)
-      {
-        std::cout << "at:" << scanRid.page_number << "," << scanRid.slot_number;
-        std::cout << " -->:" << myRec.i << ":" << myRec.d << ":" << myRec.s << ":" << std::endl;
-      }
-      else if (numResults == 5)
-      {
-        std::cout << "..." << std::endl;
-      }
+    // every entry kept its record id through the shifts and splits
+    int misplaced = 0;
+    RecordId rid;
+    for (int j = 1; j <= numEach; j++)
+    {
+      const int low = -j;
+      misplaced += !index.lookup(&low, rid) || rid.page_number != (PageId)(numEach + low);
     }
-    catch (IndexScanCompletedException e)
+    for (int key = relationSize + 1; key < strideBase + numStrided; key++)
     {
-      break;
+      if (key == relationSize + numEach + 1)
+        key = strideBase;
+      misplaced += !index.lookup(&key, rid) || rid.page_number != (PageId)key;
     }
-    numResults++;
+    checkPassFail(misplaced, 0)
+
+    int low = -numEach, high = strideBase + numStrided;
+    checkPassFail(batchScan(&index, &low, GTE, &high, LT), relationSize + 2 * numEach + numStrided)
+    low = strideBase + 1000;
+    high = strideBase + 2000;
+    checkPassFail(batchScan(&index, &low, GTE, &high, LT), 1000)
   }
+  File::remove(intIndexName);
+}
 
-  if (numResults >= 5)
+// -----------------------------------------------------------------------------
+// duplicateScanTests
+// -----------------------------------------------------------------------------
+
+void duplicateScanTests()
+{
   {
-    std::cout << "Number of results: " << numResults << std::endl;
-  }
-  index->endScan();
-  std::cout << std::endl;
+    // a few keys repeated thousands of times, so that each spans several leaves
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER, false);
+    const int numDups = 20000, base = relationSize;
+    srand(7);
+    for (int j = 0; j < numDups; j++)
+    {
+      const int key = base + rand() % 3;
+      const RecordId fakeRid = {(PageId)(j + 1), 1};
+      index.insertEntry(&key, fakeRid);
+    }
+    checkIndexShape(index);
 
-  return numResults;
+    std::vector<RecordId> rids;
+    int counts[3];
+    for (int k = 0; k < 3; k++)
+    {
+      const int key = base + k;
+      rids.clear();
+      counts[k] = index.lookupAll(&key, rids);
+    }
+    checkPassFail((counts[0] > 2 * INTARRAYLEAFSIZE), true)
+
+    // a scan from a repeated key starts at its first duplicate, one past it after its last
+    int low = base, high = base + 2;
+    checkPassFail(batchScan(&index, &low, GTE, &high, LTE), counts[0] + counts[1] + counts[2])
+    checkPassFail(batchScan(&index, &low, GTE, &low, LTE), counts[0])
+    checkPassFail(batchScan(&index, &low, GT, &high, LT), counts[1])
+    low = base + 1;
+    checkPassFail(batchScan(&index, &low, GTE, &low, LTE), counts[1])
+    checkPassFail(batchScan(&index, &low, GT, &high, LTE), counts[2])
+    low = base - 1;
+    checkPassFail(batchScan(&index, &low, GT, &high, LT), counts[0] + counts[1])
+
+    // the same through a cursor
+    low = base;
+    IndexCursor cursor;
+    index.startScan(cursor, &low, GTE, &low, LTE);
+    RecordId scanRids[64];
+    int found = 0;
+    size_t batch;
+    while ((batch = index.scanNextBatch(cursor, scanRids, 64)) > 0)
+      found += batch;
+    index.endScan(cursor);
+    checkPassFail(found, counts[0])
+  }
+  File::remove(intIndexName);
 }
 
 // -----------------------------------------------------------------------------
-// errorTests
+// bufLookupTests
 // -----------------------------------------------------------------------------
 
-void errorTests()
+void bufLookupTests()
 {
-  std::cout << "Error handling tests" << std::endl;
-  std::cout << "--------------------" << std::endl;
-  // Given error test
-
-  // clear stashed file
+  const std::string fileName = "bufLookupTest.0";
   try
   {
-    File::remove(relationName);
+    File::remove(fileName);
   }
   catch (FileNotFoundException e)
   {
   }
 
-  file1 = new PageFile(relationName, true);
-
-  // initialize all of record1.s to keep purify happy
-  memset(record1.s, ' ', sizeof(record1.s));
-  PageId new_page_number;
-  Page new_page = file1->allocatePage(new_page_number);
-
-  // Insert a bunch of tuples into the relation.
-  for (int i = 0; i < 10; i++)
   {
-    sprintf(record1.s, "%05d string record", i);
-    record1.i = i;
-    record1.d = (double)i;
-    std::string new_data(reinterpret_cast<char *>(&record1), sizeof(record1));
+    PageFile file = PageFile::create(fileName);
 
-    while (1)
+    // find() reports a missing page without throwing, lookup() still throws for it
+    BufHashTbl table(10);
+    FrameId frameNo = 99;
+    checkPassFail(table.find(&file, 1, frameNo), false)
+    checkPassFail(frameNo, 99)
+    table.insert(&file, 1, 7);
+    checkPassFail(table.find(&file, 1, frameNo), true)
+    checkPassFail(frameNo, 7)
+    int numThrown = 0;
+    try
     {
-      try
-      {
-        new_page.insertRecord(new_data);
-        break;
-      }
-      catch (InsufficientSpaceException e)
-      {
-        file1->writePage(new_page_number, new_page);
-        new_page = file1->allocatePage(new_page_number);
-      }
+      table.lookup(&file, 2, frameNo);
     }
-  }
+    catch (HashNotFoundException e)
+    {
+      numThrown++;
+    }
+    checkPassFail(numThrown, 1)
 
-  file1->writePage(new_page_number, new_page);
+    // a miss reads the page, the next read of it is a hit
+    BufMgr mgr(10);
+    PageId pageNos[3];
+    Page *page;
+    for (int i = 0; i < 3; i++)
+    {
+      mgr.allocPage(&file, pageNos[i], page);
+      mgr.unPinPage(&file, pageNos[i], true);
+    }
+    mgr.flushFile(&file);
+    const BufStats before = mgr.getBufStats();
+    mgr.readPage(&file, pageNos[0], page);
+    mgr.unPinPage(&file, pageNos[0], false);
+    mgr.readPage(&file, pageNos[0], page);
+    mgr.unPinPage(&file, pageNos[0], false);
+    const BufStats after = mgr.getBufStats();
+    checkPassFail(after.diskreads - before.diskreads, 1)
+    checkPassFail(after.hits - before.hits, 1)
 
-  BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER);
+    // unpinning a page that is not buffered throws, disposing of one only deletes it from the file
+    try
+    {
+      mgr.unPinPage(&file, pageNos[1], false);
+    }
+    catch (HashNotFoundException e)
+    {
+      numThrown++;
+    }
+    checkPassFail(numThrown, 2)
+    mgr.disposePage(&file, pageNos[1]);
+    mgr.disposePage(&file, pageNos[0]);
+    try
+    {
+      mgr.readPage(&file, pageNos[1], page);
+    }
+    catch (InvalidPageException e)
+    {
+      numThrown++;
+    }
+    checkPassFail(numThrown, 3)
+    mgr.readPage(&file, pageNos[2], page);
+    mgr.unPinPage(&file, pageNos[2], false);
+    mgr.flushFile(&file);
+  }
+  File::remove(fileName);
+}
 
-  int int2 = 2;
-  int int5 = 5;
+// -----------------------------------------------------------------------------
+// bufHashProbeTests
+// -----------------------------------------------------------------------------
 
-  // Scan Tests
-  std::cout << "Call endScan before startScan" << std::endl;
+void bufHashProbeTests()
+{
+  const std::string fileName = "bufHashTest.0";
   try
   {
-    index.endScan();
-    std::cout << "ScanNotInitialized Test 1 Failed." << std::endl;
+    File::remove(fileName);
   }
-  catch (ScanNotInitializedException e)
+  catch (FileNotFoundException e)
   {
-    std::cout << "ScanNotInitialized Test 1 Passed." << std::endl;
   }
 
-  std::cout << "Call scanNext before startScan" << std::endl;
-  try
   {
-    RecordId foo;
-    index.scanNext(foo);
-    std::cout << "ScanNotInitialized Test 2 Failed." << std::endl;
-  }
-  catch (ScanNotInitializedException e)
-  {
-    std::cout << "ScanNotInitialized Test 2 Passed." << std::endl;
-  }
+    PageFile file = PageFile::create(fileName);
 
-  std::cout << "Scan with bad lowOp" << std::endl;
-  try
-  {
-    index.startScan(&int2, LTE, &int5, LTE);
-    std::cout << "BadOpcodesException Test 1 Failed." << std::endl;
-  }
-  catch (BadOpcodesException e)
-  {
-    std::cout << "BadOpcodesException Test 1 Passed." << std::endl;
+    // pick page numbers hashing into partition 0 of a table with 8 slots per partition, two each with
+    // home slots 7 and 0 and one with home slot 1, so that their probe run wraps around the end
+    const int homes[5] = {7, 7, 0, 0, 1};
+    PageId pageNos[5];
+    int numPicked = 0;
+    for (PageId pageNo = 1; numPicked < 5; pageNo++)
+    {
+      const std::uint64_t h = BufHashTbl::hash(&file, pageNo);
+      if ((h >> 32) % BufHashTbl::NUM_PARTITIONS == 0 && (int)(h & 7) == homes[numPicked])
+        pageNos[numPicked++] = pageNo;
+    }
+
+    // five entries stay below the three quarters that make a partition grow
+    BufHashTbl table(1);
+    for (int i = 0; i < 5; i++)
+      table.insert(&file, pageNos[i], i);
+
+    // removing from the middle of the run shifts the later entries back, so they are still found
+    table.remove(&file, pageNos[1]);
+    FrameId frameNo;
+    checkPassFail(table.find(&file, pageNos[1], frameNo), false)
+    for (int i = 0; i < 5; i++)
+    {
+      if (i == 1)
+        continue;
+      checkPassFail(table.find(&file, pageNos[i], frameNo), true)
+      checkPassFail(frameNo, (FrameId)i)
+    }
+    int numThrown = 0;
+    try
+    {
+      table.remove(&file, pageNos[1]);
+    }
+    catch (HashNotFoundException e)
+    {
+      numThrown++;
+    }
+    checkPassFail(numThrown, 1)
+
+    // no entry after the head of the run belongs before it, so removing it moves nothing; freed slots are reused
+    table.remove(&file, pageNos[0]);
+    for (int i = 2; i < 5; i++)
+    {
+      checkPassFail(table.find(&file, pageNos[i], frameNo), true)
+      checkPassFail(frameNo, (FrameId)i)
+    }
+    table.insert(&file, pageNos[1], 11);
+    table.insert(&file, pageNos[0], 10);
+    checkPassFail(table.find(&file, pageNos[0], frameNo), true)
+    checkPassFail(frameNo, (FrameId)10)
+    checkPassFail(table.find(&file, pageNos[1], frameNo), true)
+    checkPassFail(frameNo, (FrameId)11)
   }
+  File::remove(fileName);
+}
 
-  std::cout << "Scan with bad highOp" << std::endl;
+// -----------------------------------------------------------------------------
+// frameStateTests
+// -----------------------------------------------------------------------------
+
+void frameStateTests()
+{
+  const std::string fileName = "frameStateTest.0";
   try
   {
-    index.startScan(&int2, GTE, &int5, GTE);
-    std::cout << "BadOpcodesException Test 2 Failed." << std::endl;
+    File::remove(fileName);
   }
-  catch (BadOpcodesException e)
+  catch (FileNotFoundException e)
   {
-    std::cout << "BadOpcodesException Test 2 Passed." << std::endl;
   }
 
-  std::cout << "Scan with bad range" << std::endl;
-  try
-  {
-    index.startScan(&int5, GTE, &int2, LTE);
-    std::cout << "BadScanrangeException Test 1 Failed." << std::endl;
-  }
-  catch (BadScanrangeException e)
   {
-    std::cout << "BadScanrangeException Test 1 Passed." << std::endl;
+    PageFile file = PageFile::create(fileName);
+    BufMgr mgr(3);
+    PageId pageNos[5];
+    Page *page;
+    for (int i = 0; i < 5; i++)
+    {
+      mgr.allocPage(&file, pageNos[i], page);
+      mgr.unPinPage(&file, pageNos[i], true);
+    }
+    mgr.flushFile(&file);
+
+    // a page pinned twice stays pinned until it is unpinned twice, and a frame is never taken
+    // from a pinned page
+    Page *pages[3];
+    mgr.readPage(&file, pageNos[0], pages[0]);
+    mgr.readPage(&file, pageNos[0], pages[0]);
+    mgr.readPage(&file, pageNos[1], pages[1]);
+    mgr.readPage(&file, pageNos[2], pages[2]);
+    mgr.unPinPage(&file, pageNos[0], false);
+    int numExceeded = 0;
+    try
+    {
+      mgr.readPage(&file, pageNos[3], page);
+    }
+    catch (BufferExceededException e)
+    {
+      numExceeded++;
+    }
+    checkPassFail(numExceeded, 1)
+
+    // a frame unpinned once is reused, unpinning it again throws
+    mgr.unPinPage(&file, pageNos[0], false);
+    int numNotPinned = 0;
+    try
+    {
+      mgr.unPinPage(&file, pageNos[0], false);
+    }
+    catch (PageNotPinnedException e)
+    {
+      numNotPinned++;
+    }
+    checkPassFail(numNotPinned, 1)
+    BufStats before = mgr.getBufStats();
+    mgr.readPage(&file, pageNos[3], page);
+    mgr.unPinPage(&file, pageNos[3], false);
+    mgr.readPage(&file, pageNos[1], page);
+    mgr.unPinPage(&file, pageNos[1], false);
+    mgr.readPage(&file, pageNos[2], page);
+    mgr.unPinPage(&file, pageNos[2], false);
+    BufStats after = mgr.getBufStats();
+    checkPassFail(after.diskreads - before.diskreads, 1)
+    checkPassFail(after.hits - before.hits, 2)
+    checkPassFail((int)(after.cleanEvictions - before.cleanEvictions), 1)
+    mgr.unPinPage(&file, pageNos[1], false);
+    mgr.unPinPage(&file, pageNos[2], false);
+
+    // a dirty page is written back when the other pages take its frame, and read back as it was written
+    mgr.readPage(&file, pageNos[1], page);
+    const std::string record = "frame state record";
+    const RecordId rid = page->insertRecord(record);
+    mgr.unPinPage(&file, pageNos[1], true);
+    before = mgr.getBufStats();
+    for (int i = 0; i < 10; i++)
+    {
+      if (i % 5 == 1)
+        continue;
+      mgr.readPage(&file, pageNos[i % 5], page);
+      mgr.unPinPage(&file, pageNos[i % 5], false);
+    }
+    after = mgr.getBufStats();
+    checkPassFail((int)(after.dirtyEvictions - before.dirtyEvictions), 1)
+    checkPassFail(after.diskwrites - before.diskwrites, 1)
+    mgr.readPage(&file, pageNos[1], page);
+    checkPassFail((page->getRecord(rid) == record), true)
+    mgr.unPinPage(&file, pageNos[1], false);
+    mgr.flushFile(&file);
   }
+  File::remove(fileName);
+}
 
-  deleteRelation();
+// -----------------------------------------------------------------------------
+// benchSuiteTests
+// -----------------------------------------------------------------------------
+
+/**
+ * Run the benchmark program built next to this one with args, keeping the lines it prints.
+ *
+ * @return Its exit status, or -1 if it could not be run
+ */
+int runBench(const std::string &args, std::vector<std::string> &lines)
+{
+  lines.clear();
+  FILE *out = popen(("./badgerdb_bench " + args + " 2>/dev/null").c_str(), "r");
+  if (out == NULL)
+    return -1;
+  char line[256];
+  while (fgets(line, sizeof(line), out) != NULL)
+    lines.push_back(std::string(line, strcspn(line, "\n")));
+  const int status = pclose(out);
+  return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
 }
 
-void deleteRelation()
+/**
+ * Split a CSV line of the benchmarks into its fields.
+ */
+std::vector<std::string> benchFields(const std::string &line)
 {
-  if (file1)
-  {
-    bufMgr->flushFile(file1);
-    delete file1;
-    file1 = NULL;
-  }
-  try
+  std::vector<std::string> fields;
+  size_t start = 0;
+  for (size_t comma; (comma = line.find(',', start)) != std::string::npos; start = comma + 1)
+    fields.push_back(line.substr(start, comma - start));
+  fields.push_back(line.substr(start));
+  return fields;
+}
+
+void benchSuiteTests()
+{
+  std::vector<std::string> lines;
+
+  // a bad option is refused before anything runs
+  checkPassFail(runBench("--bogus=1", lines), 2)
+  checkPassFail(lines.size(), 0u)
+
+  // every benchmark prints a complete line for the relation size it was given, and every lookup finds
+  // its key, or the exit status says otherwise
+  checkPassFail(runBench("--records=2000 --pool=50 --lookups=200 --scans=5 --seed=3", lines), 0)
+  checkPassFail((lines.size() > 20), true)
+  checkPassFail((lines[0] == "benchmark,param,records,pool,ops,seconds,ops_per_sec,hits,diskreads"), true)
+  int numLookupLines = 0;
+  for (size_t l = 1; l < lines.size(); l++)
   {
-    File::remove(relationName);
+    const std::vector<std::string> fields = benchFields(lines[l]);
+    checkPassFail(fields.size(), 9u)
+    checkPassFail(atoi(fields[2].c_str()), 2000)
+    checkPassFail((atol(fields[4].c_str()) > 0), true)
+    if (fields[0] == "point_lookup" || fields[0] == "batch_lookup" || fields[0] == "point_scan")
+    {
+      checkPassFail(atoi(fields[4].c_str()), 200)
+      numLookupLines++;
+    }
   }
-  catch (FileNotFoundException e)
+  checkPassFail(numLookupLines, 3)
+
+  // runs with the same seed do the same work: the same operations, hits and disk reads
+  std::vector<std::string> again;
+  checkPassFail(runBench("--records=2000 --seed=3 --only=hit_ratio", lines), 0)
+  checkPassFail(runBench("--records=2000 --seed=3 --only=hit_ratio", again), 0)
+  checkPassFail(lines.size(), 6u)
+  checkPassFail(again.size(), lines.size())
+  for (size_t l = 1; l < lines.size() && l < again.size(); l++)
   {
+    const std::vector<std::string> fields = benchFields(lines[l]);
+    const std::vector<std::string> againFields = benchFields(again[l]);
+    checkPassFail((fields[0] == "hit_ratio"), true)
+    checkPassFail((fields[4] == againFields[4]), true)
+    checkPassFail((fields[7] == againFields[7] && fields[8] == againFields[8]), true)
   }
 }
@@ -5,9 +5,11 @@
  * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
  */
 
+#include <algorithm>
 #include <cassert>
 
 #include <iostream>
+#include <vector>
 #include "exceptions/insufficient_space_exception.h"
 #include "exceptions/invalid_record_exception.h"
 #include "exceptions/invalid_slot_exception.h"
@@ -15,9 +17,79 @@
 #include "page_iterator.h"
 #include "page.h"
 #include "string.h"
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <nmmintrin.h>
+#endif
 
 namespace badgerdb {
 
+namespace {
+
+/**
+ * Table of the CRC32C of every byte, for processors without the crc32
+ * instruction.
+ */
+struct Crc32cTable {
+  std::uint32_t entries[256];
+
+  Crc32cTable() {
+    for (std::uint32_t i = 0; i < 256; ++i) {
+      std::uint32_t crc = i;
+      for (int bit = 0; bit < 8; ++bit) {
+        crc = (crc >> 1) ^ (0x82f63b78 & (0 - (crc & 1)));
+      }
+      entries[i] = crc;
+    }
+  }
+};
+
+std::uint32_t crc32cSoftware(std::uint32_t state, const unsigned char* data,
+                             std::size_t length) {
+  static const Crc32cTable table;
+  for (; length > 0; ++data, --length) {
+    state = table.entries[(state ^ *data) & 0xff] ^ (state >> 8);
+  }
+  return state;
+}
+
+#if defined(__x86_64__) && defined(__GNUC__)
+/**
+ * Eight bytes at a time with the SSE4.2 crc32 instruction. Compiled for
+ * SSE4.2 whatever the target of the build, and only called once the
+ * processor is known to have it.
+ */
+__attribute__((target("sse4.2")))
+std::uint32_t crc32cHardware(std::uint32_t state, const unsigned char* data,
+                             std::size_t length) {
+  std::uint64_t wide = state;
+  for (; length >= sizeof(std::uint64_t);
+       data += sizeof(std::uint64_t), length -= sizeof(std::uint64_t)) {
+    std::uint64_t word;
+    memcpy(&word, data, sizeof(word));
+    wide = _mm_crc32_u64(wide, word);
+  }
+  state = (std::uint32_t)wide;
+  for (; length > 0; ++data, --length) {
+    state = _mm_crc32_u8(state, *data);
+  }
+  return state;
+}
+#endif
+
+}
+
+std::uint32_t crc32c(const std::uint32_t crc, const void* data,
+                     const std::size_t length) {
+  const unsigned char* bytes = static_cast<const unsigned char*>(data);
+#if defined(__x86_64__) && defined(__GNUC__)
+  static const bool hardware = __builtin_cpu_supports("sse4.2");
+  if (hardware) {
+    return ~crc32cHardware(~crc, bytes, length);
+  }
+#endif
+  return ~crc32cSoftware(~crc, bytes, length);
+}
+
 Page::Page() {
   initialize();
 }
@@ -25,10 +97,14 @@ Page::Page() {
 void Page::initialize() {
   header_.free_space_lower_bound = 0;
   header_.free_space_upper_bound = DATA_SIZE;
+  header_.fragmented_space = 0;
   header_.num_slots = 0;
   header_.num_free_slots = 0;
+  header_.num_columns = 0;
   header_.current_page_number = INVALID_NUMBER;
   header_.next_page_number = INVALID_NUMBER;
+  header_.prev_page_number = INVALID_NUMBER;
+  header_.checksum = 0;
   //data_.assign(DATA_SIZE, char());
 	memset(data_, '\0', DATA_SIZE);
 }
@@ -38,6 +114,11 @@ RecordId Page::insertRecord(const std::string& record_data) {
     throw InsufficientSpaceException(
         page_number(), record_data.length(), getFreeSpace());
   }
+  // Room for a new slot has to be made before the slot is allocated.
+  if (!isColumnar() && header_.num_free_slots == 0 &&
+      record_data.length() + sizeof(PageSlot) > getContiguousFreeSpace()) {
+    compact();
+  }
   const SlotId slot_number = getAvailableSlot();
   insertRecordInSlot(slot_number, record_data);
   return {page_number(), slot_number};
@@ -45,15 +126,59 @@ RecordId Page::insertRecord(const std::string& record_data) {
 
 std::string Page::getRecord(const RecordId& record_id) const {
   validateRecordId(record_id);
+  if (isColumnar()) {
+    std::string record(columnarLayout().record_size, '\0');
+    gatherColumns(record_id.slot_number, 0, record.size(), &record[0]);
+    return record;
+  }
   const PageSlot& slot = getSlot(record_id.slot_number);
-	std::string retStr = std::string(data_, DATA_SIZE).substr(slot.item_offset, slot.item_length);
+	return std::string(&data_[slot.item_offset], slot.item_length);
+}
 
-	return retStr;
+RecordView Page::getRecordView(const RecordId& record_id) const {
+  validateRecordId(record_id);
+  if (isColumnar()) {
+    throw InvalidRecordException(record_id, page_number());
+  }
+  const PageSlot& slot = getSlot(record_id.slot_number);
+  const RecordView view = {&data_[slot.item_offset], slot.item_length};
+  return view;
+}
+
+std::size_t Page::getRecordLength(const RecordId& record_id) const {
+  validateRecordId(record_id);
+  return isColumnar() ? columnarLayout().record_size
+                      : getSlot(record_id.slot_number).item_length;
+}
+
+void Page::copyField(const RecordId& record_id, const std::size_t offset,
+                     const std::size_t length, char* out) const {
+  validateRecordId(record_id);
+  if (isColumnar()) {
+    gatherColumns(record_id.slot_number, offset, length, out);
+    return;
+  }
+  const PageSlot& slot = getSlot(record_id.slot_number);
+  const std::size_t present =
+      offset < slot.item_length ? std::min(length, slot.item_length - offset)
+                                : 0;
+  memcpy(out, &data_[slot.item_offset + offset], present);
+  memset(out + present, '\0', length - present);
 }
 
 void Page::updateRecord(const RecordId& record_id,
                         const std::string& record_data) {
   validateRecordId(record_id);
+  if (isColumnar()) {
+    // the record keeps its slot, and its values are overwritten in place
+    if (record_data.length() != columnarLayout().record_size) {
+      throw InsufficientSpaceException(
+          page_number(), record_data.length(), columnarLayout().record_size);
+    }
+    deleteRecord(record_id, false /* allow_slot_compaction */);
+    insertRecordInSlot(record_id.slot_number, record_data);
+    return;
+  }
   const PageSlot* slot = getSlot(record_id.slot_number);
   const std::size_t free_space_after_delete =
       getFreeSpace() + slot->item_length;
@@ -75,43 +200,31 @@ void Page::deleteRecord(const RecordId& record_id) {
 void Page::deleteRecord(const RecordId& record_id,
                         const bool allow_slot_compaction) {
   validateRecordId(record_id);
-  PageSlot* slot = getSlot(record_id.slot_number);
-
-	for(int i = 0; i < slot->item_length; i++)
-		data_[i + slot->item_offset] = '\0';
-
-  //data_.replace(slot->item_offset, slot->item_length, slot->item_length, '\0');
-
-  // Compact the data by removing the hole left by this record (if necessary).
-  std::uint16_t move_offset = slot->item_offset; 
-  std::size_t move_bytes = 0;
-  for (SlotId i = 1; i <= header_.num_slots; ++i) {
-    PageSlot* other_slot = getSlot(i);
-    if (other_slot->used && other_slot->item_offset < slot->item_offset) {
-      if (other_slot->item_offset < move_offset) {
-        move_offset = other_slot->item_offset;
-      }
-      move_bytes += other_slot->item_length;
-      // Update the slot for the other data to reflect the soon-to-be-new
-      // location.
-      other_slot->item_offset += slot->item_length;
+  if (isColumnar()) {
+    // clear the values of the slot in every column
+    const ColumnarLayout& layout = columnarLayout();
+    for (std::size_t c = 0; c < header_.num_columns; ++c) {
+      memset(&data_[layout.offsets[c] +
+                    (record_id.slot_number - 1) * layout.widths[c]],
+             '\0', layout.widths[c]);
     }
-  }
-  // If we have data to move, shift it to the right.
-  if (move_bytes > 0) {
-    const std::string& data_to_move = std::string(data_, DATA_SIZE).substr(move_offset, move_bytes);
+    setColumnarSlotUsed(record_id.slot_number, false);
+  } else {
+    PageSlot* slot = getSlot(record_id.slot_number);
 
-		for(std::uint16_t i = 0; i < move_bytes; i++)
-			data_[i + move_offset + slot->item_length] = data_to_move[i];
+    memset(&data_[slot->item_offset], '\0', slot->item_length);
+    if (slot->item_offset == header_.free_space_upper_bound) {
+      // The record borders the free space, which simply grows.
+      header_.free_space_upper_bound += slot->item_length;
+    } else {
+      header_.fragmented_space += slot->item_length;
+    }
 
-    //data_.replace(move_offset + slot->item_length, move_bytes, data_to_move);
+    // Mark slot as unused.
+    slot->used = false;
+    slot->item_offset = 0;
+    slot->item_length = 0;
   }
-  header_.free_space_upper_bound += slot->item_length;
-
-  // Mark slot as unused.
-  slot->used = false;
-  slot->item_offset = 0;
-  slot->item_length = 0;
   ++header_.num_free_slots;
 
   if (allow_slot_compaction && record_id.slot_number == header_.num_slots) {
@@ -120,8 +233,7 @@ void Page::deleteRecord(const RecordId& record_id,
     int num_slots_to_delete = 1;
     for (SlotId i = 1; i < header_.num_slots; ++i) {
       // Traverse list backwards, looking for unused slots.
-      const PageSlot* other_slot = getSlot(header_.num_slots - i);
-      if (!other_slot->used) {
+      if (!isSlotUsed(header_.num_slots - i)) {
         ++num_slots_to_delete;
       } else {
         // Stop at the first used slot we find, since we can't move used slots
@@ -131,11 +243,46 @@ void Page::deleteRecord(const RecordId& record_id,
     }
     header_.num_slots -= num_slots_to_delete;
     header_.num_free_slots -= num_slots_to_delete;
-    header_.free_space_lower_bound -= sizeof(PageSlot) * num_slots_to_delete;
+    if (!isColumnar()) {
+      header_.free_space_lower_bound -= sizeof(PageSlot) * num_slots_to_delete;
+    }
   }
 }
 
+void Page::compact() {
+  // Move records in order of decreasing offset, so that each one only moves
+  // over space that is free or was occupied by the records already moved.
+  std::vector<std::pair<std::uint16_t, SlotId> > records;
+  for (SlotId i = 1; i <= header_.num_slots; ++i) {
+    const PageSlot* slot = getSlot(i);
+    if (slot->used) {
+      records.push_back(std::make_pair(slot->item_offset, i));
+    }
+  }
+  std::sort(records.begin(), records.end());
+
+  std::uint16_t upper_bound = DATA_SIZE;
+  for (std::size_t i = records.size(); i-- > 0;) {
+    PageSlot* slot = getSlot(records[i].second);
+    upper_bound -= slot->item_length;
+    if (upper_bound != slot->item_offset) {
+      memmove(&data_[upper_bound], &data_[slot->item_offset],
+              slot->item_length);
+      slot->item_offset = upper_bound;
+    }
+  }
+  memset(&data_[header_.free_space_upper_bound], '\0',
+         upper_bound - header_.free_space_upper_bound);
+  header_.free_space_upper_bound = upper_bound;
+  header_.fragmented_space = 0;
+}
+
 bool Page::hasSpaceForRecord(const std::string& record_data) const {
+  if (isColumnar()) {
+    return record_data.length() == columnarLayout().record_size &&
+           (header_.num_free_slots > 0 ||
+            header_.num_slots < columnarLayout().capacity);
+  }
   std::size_t record_size = record_data.length();
   if (header_.num_free_slots == 0) {
     record_size += sizeof(PageSlot);
@@ -156,8 +303,7 @@ SlotId Page::getAvailableSlot() {
   if (header_.num_free_slots > 0) {
     // Have an allocated but unused slot that we can reuse.
     for (SlotId i = 1; i <= header_.num_slots; ++i) {
-      const PageSlot* slot = getSlot(i);
-      if (!slot->used) {
+      if (!isSlotUsed(i)) {
         // We don't decrement the number of free slots until someone actually
         // puts data in the slot.
         slot_number = i;
@@ -169,7 +315,9 @@ SlotId Page::getAvailableSlot() {
     slot_number = header_.num_slots + 1;
     ++header_.num_slots;
     ++header_.num_free_slots;
-    header_.free_space_lower_bound = sizeof(PageSlot) * header_.num_slots;
+    if (!isColumnar()) {
+      header_.free_space_lower_bound = sizeof(PageSlot) * header_.num_slots;
+    }
   }
   assert(slot_number != INVALID_SLOT);
   return static_cast<SlotId>(slot_number);
@@ -181,19 +329,37 @@ void Page::insertRecordInSlot(const SlotId slot_number,
       slot_number == INVALID_SLOT) {
     throw InvalidSlotException(page_number(), slot_number);
   }
+  if (isColumnar()) {
+    if (isSlotUsed(slot_number)) {
+      throw SlotInUseException(page_number(), slot_number);
+    }
+    // scatter the record over the columns
+    const ColumnarLayout& layout = columnarLayout();
+    std::size_t column_start = 0;
+    for (std::size_t c = 0; c < header_.num_columns; ++c) {
+      memcpy(&data_[layout.offsets[c] + (slot_number - 1) * layout.widths[c]],
+             record_data.data() + column_start, layout.widths[c]);
+      column_start += layout.widths[c];
+    }
+    setColumnarSlotUsed(slot_number, true);
+    --header_.num_free_slots;
+    return;
+  }
   PageSlot* slot = getSlot(slot_number);
   if (slot->used) {
     throw SlotInUseException(page_number(), slot_number);
   }
   const int record_length = record_data.length();
+  if (record_length > getContiguousFreeSpace()) {
+    compact();
+  }
   slot->used = true;
   slot->item_length = record_length;
   slot->item_offset = header_.free_space_upper_bound - record_length;
   header_.free_space_upper_bound = slot->item_offset;
   --header_.num_free_slots;
 
-	for(int i = 0; i < slot->item_length; i++)
-		data_[i + slot->item_offset] = record_data[i];
+  memcpy(&data_[slot->item_offset], record_data.data(), record_length);
 
   //data_.replace(slot->item_offset, slot->item_length, record_data);
 }
@@ -202,12 +368,132 @@ void Page::validateRecordId(const RecordId& record_id) const {
   if (record_id.page_number != page_number()) {
     throw InvalidRecordException(record_id, page_number());
   }
-  const PageSlot& slot = getSlot(record_id.slot_number);
-  if (!slot.used) {
+  if (!isSlotUsed(record_id.slot_number)) {
     throw InvalidRecordException(record_id, page_number());
   }
 }
 
+std::size_t Page::layOutColumns(const std::uint16_t* widths,
+                                const std::size_t num_columns,
+                                const std::size_t capacity,
+                                std::uint16_t* offsets) {
+  // minipages start on 8 byte boundaries of the page, which follows the
+  // header
+  std::size_t end = sizeof(ColumnarLayout) + (capacity + 7) / 8;
+  for (std::size_t c = 0; c < num_columns; ++c) {
+    end = (sizeof(PageHeader) + end + 7) / 8 * 8 - sizeof(PageHeader);
+    if (offsets != NULL) {
+      offsets[c] = end;
+    }
+    end += capacity * widths[c];
+  }
+  return end;
+}
+
+std::size_t Page::columnarCapacity(const std::uint16_t* widths,
+                                   const std::size_t num_columns) {
+  std::size_t record_size = 0;
+  for (std::size_t c = 0; c < num_columns; ++c) {
+    if (widths[c] == 0) {
+      return 0;
+    }
+    record_size += widths[c];
+  }
+  if (num_columns == 0 || num_columns > MAX_COLUMNS ||
+      sizeof(ColumnarLayout) >= DATA_SIZE) {
+    return 0;
+  }
+  // every slot takes its record and a bit of the bitmap; the padding of the
+  // minipages takes the last few off
+  std::size_t capacity =
+      (DATA_SIZE - sizeof(ColumnarLayout)) * 8 / (record_size * 8 + 1);
+  while (capacity > 0 &&
+         layOutColumns(widths, num_columns, capacity, NULL) > DATA_SIZE) {
+    --capacity;
+  }
+  return capacity;
+}
+
+void Page::initializeColumns(const std::uint16_t* widths,
+                             const std::size_t num_columns) {
+  ColumnarLayout* layout = reinterpret_cast<ColumnarLayout*>(data_);
+  layout->capacity = columnarCapacity(widths, num_columns);
+  layout->record_size = 0;
+  for (std::size_t c = 0; c < num_columns; ++c) {
+    layout->widths[c] = widths[c];
+    layout->record_size += widths[c];
+  }
+  layOutColumns(widths, num_columns, layout->capacity, layout->offsets);
+  header_.num_columns = num_columns;
+  header_.num_slots = 0;
+  header_.num_free_slots = 0;
+  // the free space bounds of slotted pages are not used
+  header_.free_space_lower_bound = 0;
+  header_.free_space_upper_bound = 0;
+  header_.fragmented_space = 0;
+}
+
+ColumnView Page::getColumn(const std::size_t column) const {
+  const ColumnarLayout& layout = columnarLayout();
+  std::size_t column_start = 0;
+  for (std::size_t c = 0; c < column; ++c) {
+    column_start += layout.widths[c];
+  }
+  const ColumnView view = {&data_[layout.offsets[column]], column_start,
+                           layout.widths[column]};
+  return view;
+}
+
+std::uint16_t Page::getColumnarFreeSpace() const {
+  const ColumnarLayout& layout = columnarLayout();
+  const std::size_t used = header_.num_slots - header_.num_free_slots;
+  return (layout.capacity - used) * layout.record_size;
+}
+
+bool Page::isSlotUsed(const SlotId slot_number) const {
+  if (!isColumnar()) {
+    return getSlot(slot_number).used;
+  }
+  if (slot_number == INVALID_SLOT || slot_number > header_.num_slots) {
+    return false;
+  }
+  const unsigned char* bitmap = reinterpret_cast<const unsigned char*>(
+      &data_[sizeof(ColumnarLayout)]);
+  return (bitmap[(slot_number - 1) / 8] >> ((slot_number - 1) % 8)) & 1;
+}
+
+void Page::setColumnarSlotUsed(const SlotId slot_number, const bool used) {
+  unsigned char* bitmap =
+      reinterpret_cast<unsigned char*>(&data_[sizeof(ColumnarLayout)]);
+  const unsigned char bit = 1 << ((slot_number - 1) % 8);
+  if (used) {
+    bitmap[(slot_number - 1) / 8] |= bit;
+  } else {
+    bitmap[(slot_number - 1) / 8] &= ~bit;
+  }
+}
+
+void Page::gatherColumns(const SlotId slot_number, std::size_t offset,
+                         std::size_t length, char* out) const {
+  const ColumnarLayout& layout = columnarLayout();
+  std::size_t column_start = 0;
+  for (std::size_t c = 0; c < header_.num_columns && length > 0; ++c) {
+    const std::size_t column_end = column_start + layout.widths[c];
+    if (offset < column_end) {
+      const std::size_t count = std::min(column_end - offset, length);
+      memcpy(out, &data_[layout.offsets[c] +
+                         (slot_number - 1) * layout.widths[c] +
+                         (offset - column_start)], count);
+      out += count;
+      offset += count;
+      length -= count;
+    }
+    column_start = column_end;
+  }
+  // past the end of the record
+  memset(out, '\0', length);
+}
+
 PageIterator Page::begin() {
   return PageIterator(this);
 }
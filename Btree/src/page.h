@@ -21,7 +21,7 @@ namespace badgerdb {
  * @brief Header metadata in a page.
  *
  * Header metadata in each page which tracks where space has been used and
- * contains a pointer to the next page in the file.
+ * contains pointers to the previous and next pages in the file.
  */
 struct PageHeader {
   /**
@@ -36,6 +36,13 @@ struct PageHeader {
    */
   std::uint16_t free_space_upper_bound;
 
+  /**
+   * Bytes of deleted records left between the free space upper bound and the
+   * end of the data, which are reclaimed by compacting the page once a record
+   * does not fit otherwise.
+   */
+  std::uint16_t fragmented_space;
+
   /**
    * Number of slots currently allocated.  This number may include slots which
    * are unused but are in the middle of the slot array (due to record
@@ -48,6 +55,12 @@ struct PageHeader {
    */
   SlotId num_free_slots;
 
+  /**
+   * Number of columns of a columnar page, whose records are stored column by
+   * column, 0 for a slotted page.
+   */
+  std::uint16_t num_columns;
+
   /**
    * Number of the page within the file.
    */
@@ -58,6 +71,18 @@ struct PageHeader {
    */
   PageId next_page_number;
 
+  /**
+   * Number of the previous used page in the file.
+   */
+  PageId prev_page_number;
+
+  /**
+   * CRC32C of the page as last written by a PageFile that keeps checksums,
+   * taken with this field and the next and previous page numbers zeroed, since
+   * those are rewritten on their own when neighbouring pages come and go.
+   */
+  std::uint32_t checksum;
+
   /**
    * Returns true if this page header is equal to the other.
    *
@@ -68,7 +93,8 @@ struct PageHeader {
     return num_slots == rhs.num_slots &&
         num_free_slots == rhs.num_free_slots &&
         current_page_number == rhs.current_page_number &&
-        next_page_number == rhs.next_page_number;
+        next_page_number == rhs.next_page_number &&
+        prev_page_number == rhs.prev_page_number;
   }
 };
 
@@ -95,6 +121,53 @@ struct PageSlot {
 
 class PageIterator;
 
+/**
+ * @brief A record pointed at on its page rather than copied out of it.
+ *
+ * The view stays valid while the page is not changed and, for a page in the
+ * buffer pool, while it stays pinned.
+ */
+struct RecordView {
+  /**
+   * First byte of the record.
+   */
+  const char* data;
+
+  /**
+   * Length of the record in bytes.
+   */
+  std::size_t length;
+
+  /**
+   * Returns a copy of the record.
+   */
+  std::string str() const { return std::string(data, length); }
+};
+
+/**
+ * @brief The values of one column of a columnar page, one after the other.
+ *
+ * The value of the record in slot s lies at values + (s - 1) * width.  Slots
+ * not in use hold '\0' bytes.  Like a RecordView, the view stays valid while
+ * the page is not changed.
+ */
+struct ColumnView {
+  /**
+   * Value of the record in slot 1.
+   */
+  const char* values;
+
+  /**
+   * Byte offset of the column in the records.
+   */
+  std::size_t offset;
+
+  /**
+   * Width of the values in bytes.
+   */
+  std::size_t width;
+};
+
 /**
  * @brief Class which represents a fixed-size database page containing records.
  *
@@ -103,6 +176,14 @@ class PageIterator;
  * slots and identified by a RecordId.  Although a record's actual contents may
  * be moved on the page, accessing a record by its slot is consistent.
  *
+ * The pages of a PageFile created with column widths are columnar (PAX): all
+ * their records have the same length, and each column of the records is
+ * stored apart, in a minipage holding the values of that column of every
+ * slot.  A scan reading one attribute then reads consecutive bytes, through
+ * getColumn() or copyField(), rather than a few bytes of every record.
+ * Records of a columnar page do not lie whole on it, so getRecordView() is
+ * left to slotted pages.
+ *
  * @warning This class is not threadsafe.
  */
 class Page {
@@ -118,6 +199,18 @@ class Page {
    */
   static const std::size_t DATA_SIZE = SIZE - sizeof(PageHeader);
 
+  /**
+   * Size of the trailer at the end of the pages of a BlobFile, which holds
+   * the checksum of the bytes before it.
+   */
+  static const std::size_t TRAILER_SIZE = sizeof(std::uint32_t);
+
+  /**
+   * Bytes of a page of a BlobFile its user may fill, the bytes before the
+   * trailer.
+   */
+  static const std::size_t BLOB_SIZE = SIZE - TRAILER_SIZE;
+
   /**
    * Number of page indicating that it's invalid.
    */
@@ -128,6 +221,11 @@ class Page {
    */
   static const SlotId INVALID_SLOT = 0;
 
+  /**
+   * Most columns the records of a columnar page have.
+   */
+  static const std::size_t MAX_COLUMNS = 16;
+
   /**
    * Constructs a new, uninitialized page.
    */
@@ -151,6 +249,38 @@ class Page {
    */
   std::string getRecord(const RecordId& record_id) const;
 
+  /**
+   * Returns the record with the given ID without copying it.
+   *
+   * @see RecordView
+   * @param record_id  ID of the record to return.
+   * @return  View of the record on the page.
+   * @throws  InvalidRecordException  Thrown for records of a columnar page,
+   *                                  which do not lie whole on the page.
+   */
+  RecordView getRecordView(const RecordId& record_id) const;
+
+  /**
+   * Returns the length of the record with the given ID.
+   *
+   * @param record_id  ID of the record.
+   * @return  Length of the record in bytes.
+   */
+  std::size_t getRecordLength(const RecordId& record_id) const;
+
+  /**
+   * Copies bytes of the record with the given ID, from the given offset on.
+   * Bytes past the end of the record are copied as '\0'.  On a columnar page,
+   * only the columns holding the bytes are read.
+   *
+   * @param record_id  ID of the record.
+   * @param offset     Offset of the first byte to copy in the record.
+   * @param length     Number of bytes to copy.
+   * @param out        Where to copy the bytes to.
+   */
+  void copyField(const RecordId& record_id, const std::size_t offset,
+                 const std::size_t length, char* out) const;
+
   /**
    * Updates the record with the given ID, replacing its data with a new
    * version.  This is equivalent to deleting the old record and inserting a
@@ -162,9 +292,9 @@ class Page {
   void updateRecord(const RecordId& record_id, const std::string& record_data);
 
   /**
-   * Deletes the record with the given ID.  Page is compacted upon delete to
-   * ensure that data of all records is contiguous.  Slot array is compacted if
-   * the slot deleted is at the end of the slot array.
+   * Deletes the record with the given ID.  The space of the record is only
+   * reclaimed once an insertion needs it, by compacting the page.  Slot array
+   * is compacted if the slot deleted is at the end of the slot array.
    *
    * @param record_id   ID of the record to delete.
    */
@@ -172,6 +302,8 @@ class Page {
 
   /**
    * Returns true if the page has enough free space to hold the given data.
+   * A columnar page only holds records as long as the sum of its column
+   * widths.
    *
    * @param record_data Bytes that compose the record.
    * @return  Whether the page can hold the data.
@@ -179,12 +311,33 @@ class Page {
   bool hasSpaceForRecord(const std::string& record_data) const;
 
   /**
-   * Returns this page's free space in bytes.
+   * Returns this page's free space in bytes, including the space of deleted
+   * records that is reclaimed by compaction.
    *
    * @return  Free space in bytes.
    */
-  std::uint16_t getFreeSpace() const { return header_.free_space_upper_bound -
-                                              header_.free_space_lower_bound; }
+  std::uint16_t getFreeSpace() const {
+    return isColumnar() ? getColumnarFreeSpace()
+                        : getContiguousFreeSpace() + header_.fragmented_space;
+  }
+
+  /**
+   * Returns true if the records of this page are stored column by column.
+   */
+  bool isColumnar() const { return header_.num_columns != 0; }
+
+  /**
+   * Returns the number of columns of a columnar page, 0 for a slotted page.
+   */
+  std::size_t numColumns() const { return header_.num_columns; }
+
+  /**
+   * Returns the values of a column of a columnar page.
+   *
+   * @param column  Number of the column, from 0 up to numColumns().
+   * @return  View of the values of the column.
+   */
+  ColumnView getColumn(const std::size_t column) const;
 
   /**
    * Returns this page's number in its file.
@@ -200,6 +353,13 @@ class Page {
    */
   PageId next_page_number() const { return header_.next_page_number; }
 
+  /**
+   * Returns the number of the previous used page before this page in its file.
+   *
+   * @return  Page number of previous used page in file.
+   */
+  PageId prev_page_number() const { return header_.prev_page_number; }
+
   /**
    * Returns an iterator at the first record in the page.
    *
@@ -221,6 +381,106 @@ class Page {
    */
   void initialize();
 
+  /**
+   * Where the columns of a columnar page lie, kept at the start of its data.
+   * The bitmap of the slots in use follows, then the minipage of every column,
+   * each aligned to 8 bytes within the page.
+   */
+  struct ColumnarLayout {
+    /**
+     * Number of slots the page has room for.
+     */
+    std::uint16_t capacity;
+
+    /**
+     * Length of the records, the sum of the column widths.
+     */
+    std::uint16_t record_size;
+
+    /**
+     * Width of each column in bytes.
+     */
+    std::uint16_t widths[MAX_COLUMNS];
+
+    /**
+     * Offset of the minipage of each column in the data.
+     */
+    std::uint16_t offsets[MAX_COLUMNS];
+  };
+
+  /**
+   * Lays out the minipages of the given number of slots of records with the
+   * given column widths.
+   *
+   * @param widths        Width of each column.
+   * @param num_columns   Number of columns.
+   * @param capacity      Number of slots.
+   * @param offsets       Offset of each minipage, set if not NULL.
+   * @return  Number of bytes of the data the layout takes.
+   */
+  static std::size_t layOutColumns(const std::uint16_t* widths,
+                                   const std::size_t num_columns,
+                                   const std::size_t capacity,
+                                   std::uint16_t* offsets);
+
+  /**
+   * Returns the number of records with the given column widths a columnar
+   * page holds, 0 if it cannot hold any.
+   *
+   * @param widths        Width of each column.
+   * @param num_columns   Number of columns.
+   * @return  Number of slots.
+   */
+  static std::size_t columnarCapacity(const std::uint16_t* widths,
+                                      const std::size_t num_columns);
+
+  /**
+   * Makes this empty page a columnar page for records with the given column
+   * widths, which a columnar page must be able to hold.
+   *
+   * @param widths        Width of each column.
+   * @param num_columns   Number of columns, at most MAX_COLUMNS.
+   */
+  void initializeColumns(const std::uint16_t* widths,
+                         const std::size_t num_columns);
+
+  /**
+   * Returns the layout of a columnar page.
+   */
+  const ColumnarLayout& columnarLayout() const {
+    return *reinterpret_cast<const ColumnarLayout*>(data_);
+  }
+
+  /**
+   * Returns the free space of a columnar page, that of the slots not in use.
+   *
+   * @return  Free space in bytes.
+   */
+  std::uint16_t getColumnarFreeSpace() const;
+
+  /**
+   * Returns true if the slot with the given number holds a record, on pages of
+   * either kind.  Unallocated slots of a slotted page must not be asked for.
+   *
+   * @param slot_number   Number of slot.
+   */
+  bool isSlotUsed(const SlotId slot_number) const;
+
+  /**
+   * Marks a slot of a columnar page as in use or not.
+   *
+   * @param slot_number   Number of slot.
+   * @param used          Whether the slot holds a record.
+   */
+  void setColumnarSlotUsed(const SlotId slot_number, const bool used);
+
+  /**
+   * Copies bytes of the record in a slot of a columnar page out of its
+   * columns, as copyField() does.
+   */
+  void gatherColumns(const SlotId slot_number, std::size_t offset,
+                     std::size_t length, char* out) const;
+
   /**
    * Sets this page's number in its file.
    *
@@ -240,10 +500,18 @@ class Page {
   }
 
   /**
-   * Deletes the record with the given ID.  Page is compacted upon delete to
-   * ensure that data of all records is contiguous.  Slot array is compacted if
-   * the slot deleted is at the end of the slot array and
-   * <allow_slot_compaction> is set.
+   * Sets the number of the previous used page before this page in its file.
+   *
+   * @param new_prev_page_number  Page number of previous used page in file.
+   */
+  void set_prev_page_number(const PageId new_prev_page_number) {
+    header_.prev_page_number = new_prev_page_number;
+  }
+
+  /**
+   * Deletes the record with the given ID, leaving its space to be reclaimed
+   * by compact().  Slot array is compacted if the slot deleted is at the end of
+   * the slot array and <allow_slot_compaction> is set.
    *
    * @param record_id             ID of the record to delete.
    * @param allow_slot_compaction If true, the slot array will be compacted if
@@ -252,6 +520,22 @@ class Page {
   void deleteRecord(const RecordId& record_id,
                     const bool allow_slot_compaction);
 
+  /**
+   * Returns the free space between the slot array and the record data.
+   *
+   * @return  Free space in bytes.
+   */
+  std::uint16_t getContiguousFreeSpace() const {
+    return header_.free_space_upper_bound - header_.free_space_lower_bound;
+  }
+
+  /**
+   * Moves the data of all records to the end of the page, so that the space of
+   * deleted records joins the contiguous free space.  Slot numbers, and thus
+   * record IDs, do not change.
+   */
+  void compact();
+
   /**
    * Returns the slot with the given number.  This method will return
    * unallocated slots if requested; it is up to the caller to ensure they
@@ -339,6 +623,18 @@ class Page {
   friend class PageIterator;
 };
 
+/**
+ * Returns the CRC32C of the bytes, going on from the CRC32C of the bytes
+ * before them. Uses the SSE4.2 crc32 instruction where the processor has it.
+ *
+ * @param crc     CRC32C of the bytes before, 0 for none.
+ * @param data    Bytes to add.
+ * @param length  Number of bytes.
+ * @return  CRC32C of all the bytes.
+ */
+std::uint32_t crc32c(const std::uint32_t crc, const void* data,
+                     const std::size_t length);
+
 static_assert(Page::SIZE > sizeof(PageHeader),
               "Page size must be large enough to hold header and data.");
 static_assert(Page::DATA_SIZE > 0,
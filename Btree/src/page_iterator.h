@@ -101,6 +101,15 @@ class PageIterator {
 		return page_->getRecord(current_record_); 
 	}
 
+  /**
+   * Returns the current record in the page without copying it.
+   *
+   * @return  View of the record on the page.
+   */
+	inline RecordView getRecordView() const {
+		return page_->getRecordView(current_record_);
+	}
+
   /**
    * Returns the next used slot in the page after the given slot or
    * Page::INVALID_SLOT if no slots are used after the given slot.
@@ -111,8 +120,7 @@ class PageIterator {
   SlotId getNextUsedSlot(const SlotId start) const {
     SlotId slot_number = Page::INVALID_SLOT;
     for (SlotId i = start + 1; i <= page_->header_.num_slots; ++i) {
-      const PageSlot* slot = page_->getSlot(i);
-      if (slot->used) {
+      if (page_->isSlotUsed(i)) {
         slot_number = i;
         break;
       }
@@ -0,0 +1,429 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "buffer.h"
+#include "file.h"
+
+namespace badgerdb {
+
+/**
+ * @brief Sorts more records than fit in memory: sorted runs are kept in memory up to a budget and
+ * spilled to a temporary BlobFile through the buffer manager beyond it, then read back as one sorted
+ * stream by a k-way merge over a heap of the heads of the runs.
+ *
+ * Records are copied into pages byte by byte, so R must be trivially copyable and ordered by
+ * operator<. Records are added with add() or addRun(), finish() is called once, and the stream is
+ * read with read(). The temporary file is removed when the sort is destroyed.
+ *
+ * Half of the budget holds the runs kept in memory, the other half the records add() collects into
+ * the next run; callers collecting runs of their own for addRun() should keep them within that half
+ * too. The merge pins one page of every spilled run it reads, so it merges at most as many runs at
+ * once as a quarter of the buffer pool and the budget have pages for; more runs are merged in passes
+ * that write longer runs first. Pages of a run are asked for with BufMgr::prefetchPages() ahead of
+ * the merge reading them.
+ */
+template <class R>
+class ExternalSort {
+ public:
+  /**
+   * Budget used when none is given, in bytes.
+   */
+  static const std::size_t DEFAULT_MEMORY = 64 << 20;
+
+  /**
+   * Pages of a spilled run asked for ahead of the one the merge reads.
+   */
+  static const std::uint32_t READ_AHEAD = 2;
+
+  /**
+   * @param bufMgr        Buffer manager spilled runs are written and read through
+   * @param tempPrefix    Start of the name of the temporary file, such as the name of the file sorted for
+   * @param memoryBudget  Bytes the sort holds in memory, at least two pages
+   */
+  ExternalSort(BufMgr* bufMgr, const std::string& tempPrefix,
+               const std::size_t memoryBudget = DEFAULT_MEMORY)
+      : bufMgr_(bufMgr),
+        tempPrefix_(tempPrefix),
+        memoryBudget_(std::max(memoryBudget, (std::size_t)2 * Page::SIZE)),
+        file_(NULL),
+        memoryBytes_(0),
+        total_(0),
+        numSpilled_(0),
+        pagesWritten_(0),
+        mergePasses_(0) {}
+
+  ~ExternalSort() {
+    try {
+      for (std::size_t i = 0; i < heads_.size(); i++) {
+        if (heads_[i].pages != MEMORY_RUN) {
+          bufMgr_->unPinPage(file_, heads_[i].pageNo, false);
+        }
+      }
+      if (file_ != NULL) {
+        const std::string name = file_->filename();
+        bufMgr_->flushFile(file_);
+        delete file_;
+        File::remove(name);
+      }
+    } catch (...) {
+    }
+  }
+
+  /**
+   * Add a record, sorted into a run with the records added before it once half of the budget is
+   * collected. Not to be called by several threads at once.
+   */
+  void add(const R& record) {
+    if (pending_.empty()) {
+      pending_.reserve(pendingCapacity());
+    }
+    pending_.push_back(record);
+    if (pending_.size() >= pendingCapacity()) {
+      std::sort(pending_.begin(), pending_.end());
+      addRun(pending_);
+    }
+  }
+
+  /**
+   * Add a run of records already sorted, such as one sorted by a thread of a parallel scan. The run is
+   * kept in memory if it fits in the half of the budget left for runs, and spilled otherwise. May be
+   * called by several threads at once.
+   *
+   * @param run   Sorted records, taken by the sort: the vector is left empty
+   */
+  void addRun(std::vector<R>& run) {
+    if (run.empty()) {
+      return;
+    }
+    std::lock_guard<std::mutex> guard(latch_);
+    total_ += run.size();
+    const std::size_t bytes = run.size() * sizeof(R);
+    if (memoryBytes_ + bytes <= memoryBudget_ / 2) {
+      memoryBytes_ += bytes;
+      memoryRuns_.push_back(std::vector<R>());
+      memoryRuns_.back().swap(run);
+      return;
+    }
+    spill(&run[0], run.size());
+    std::vector<R>().swap(run);
+  }
+
+  /**
+   * Sort the records add() collected last and merge spilled runs until the rest can be merged at
+   * once. Called once, after the last record is added and before the first read().
+   */
+  void finish() {
+    if (!pending_.empty()) {
+      std::sort(pending_.begin(), pending_.end());
+      addRun(pending_);
+    }
+    const std::size_t fanIn = maxFanIn();
+    while (spilled_.size() > fanIn) {
+      // merge the oldest runs into one written at the end of the file
+      std::vector<Head> heads;
+      std::size_t count = 0;
+      for (std::size_t i = 0; i < fanIn; i++) {
+        count += spilled_[i].count;
+        openSpilled(spilled_[i], heads);
+      }
+      std::make_heap(heads.begin(), heads.end(), HeadAfter());
+      RunWriter writer(*this, count);
+      while (!heads.empty()) {
+        writer.put(*heads.front().next);
+        advance(heads);
+      }
+      writer.close();
+      spilled_.erase(spilled_.begin(), spilled_.begin() + fanIn);
+      mergePasses_++;
+    }
+    for (std::size_t i = 0; i < memoryRuns_.size(); i++) {
+      Head head = {&memoryRuns_[i][0], &memoryRuns_[i][0] + memoryRuns_[i].size(), MEMORY_RUN,
+                   Page::INVALID_NUMBER, 0};
+      heads_.push_back(head);
+    }
+    for (std::size_t i = 0; i < spilled_.size(); i++) {
+      openSpilled(spilled_[i], heads_);
+    }
+    std::make_heap(heads_.begin(), heads_.end(), HeadAfter());
+  }
+
+  /**
+   * Number of records added
+   */
+  std::size_t size() const { return total_; }
+
+  /**
+   * Copy the next records of the stream to out.
+   *
+   * @param out		Buffer for count records
+   * @param count	Number of records to read
+   * @return Number of records read, less than count only at the end of the stream
+   */
+  int read(R* out, const int count) {
+    int n = 0;
+    while (n < count && !heads_.empty()) {
+      out[n++] = *heads_.front().next;
+      advance(heads_);
+    }
+    return n;
+  }
+
+  /**
+   * Number of runs spilled to the temporary file, counting those written by merge passes
+   */
+  std::size_t spilledRuns() const { return numSpilled_; }
+
+  /**
+   * Number of pages written to the temporary file
+   */
+  std::size_t pagesWritten() const { return pagesWritten_; }
+
+  /**
+   * Number of merge passes finish() needed before the final merge
+   */
+  std::size_t mergePasses() const { return mergePasses_; }
+
+ private:
+  ExternalSort(const ExternalSort&);
+  ExternalSort& operator=(const ExternalSort&);
+
+  /**
+   * Records that fit in a page of the run file, whose pages keep Page::BLOB_SIZE bytes ahead of their
+   * checksum
+   */
+  static const std::size_t PER_PAGE = Page::BLOB_SIZE / sizeof(R);
+
+  /**
+   * Head::pages of a run kept in memory
+   */
+  static const std::size_t MEMORY_RUN = (std::size_t)-1;
+
+  /**
+   * A run in the temporary file, on consecutive pages from firstPage
+   */
+  struct SpilledRun {
+    PageId firstPage;
+    std::size_t count;
+  };
+
+  /**
+   * Records of a run not read yet. For a spilled run, next and end are in the pinned page pageNo, pages
+   * counts the pages of the run from pageNo on, and left the records of the run after end.
+   */
+  struct Head {
+    const R* next;
+    const R* end;
+    std::size_t pages;
+    PageId pageNo;
+    std::size_t left;
+  };
+
+  /**
+   * Orders the heap so that the run with the smallest next record is on top
+   */
+  struct HeadAfter {
+    bool operator()(const Head& a, const Head& b) const { return *b.next < *a.next; }
+  };
+
+  /**
+   * Writes a run to consecutive pages of the temporary file, pinning one page at a time.
+   */
+  class RunWriter {
+   public:
+    RunWriter(ExternalSort& sort, const std::size_t count)
+        : sort_(sort), page_(NULL), used_(PER_PAGE) {
+      run_.firstPage = Page::INVALID_NUMBER;
+      run_.count = count;
+      sort_.openFile();
+    }
+
+    void put(const R& record) {
+      if (used_ == PER_PAGE) {
+        release();
+        sort_.bufMgr_->allocPage(sort_.file_, pageNo_, page_);
+        if (run_.firstPage == Page::INVALID_NUMBER) {
+          run_.firstPage = pageNo_;
+        }
+        used_ = 0;
+      }
+      std::memcpy(reinterpret_cast<char*>(page_) + used_ * sizeof(R), &record, sizeof(R));
+      used_++;
+    }
+
+    void close() {
+      release();
+      sort_.spilled_.push_back(run_);
+      sort_.numSpilled_++;
+    }
+
+   private:
+    void release() {
+      if (page_ != NULL) {
+        sort_.bufMgr_->unPinPage(sort_.file_, pageNo_, true);
+        sort_.pagesWritten_++;
+        page_ = NULL;
+      }
+    }
+
+    ExternalSort& sort_;
+    SpilledRun run_;
+    Page* page_;
+    PageId pageNo_;
+    std::size_t used_;
+  };
+
+  std::size_t pendingCapacity() const {
+    return std::max((std::size_t)1, memoryBudget_ / 2 / sizeof(R));
+  }
+
+  /**
+   * Most spilled runs merged at once: each pins a page, and so does the run a merge pass writes
+   */
+  std::size_t maxFanIn() const {
+    const std::size_t pages = std::min((std::size_t)(memoryBudget_ / Page::SIZE),
+                                       (std::size_t)(bufMgr_->size() / 4));
+    return pages > 2 ? pages - 1 : 2;
+  }
+
+  /**
+   * Create the temporary file on the first spill. The caller holds latch_.
+   */
+  void openFile() {
+    if (file_ != NULL) {
+      return;
+    }
+    static std::atomic<std::uint32_t> numFiles(0);
+    std::ostringstream name;
+    name << tempPrefix_ << ".sort" << numFiles++;
+    if (File::exists(name.str())) {
+      File::remove(name.str());
+    }
+    file_ = new BlobFile(name.str(), true);
+  }
+
+  /**
+   * Write count sorted records to a new run in the temporary file. The caller holds latch_.
+   */
+  void spill(const R* records, const std::size_t count) {
+    RunWriter writer(*this, count);
+    for (std::size_t i = 0; i < count; i++) {
+      writer.put(records[i]);
+    }
+    writer.close();
+  }
+
+  /**
+   * Pin the first page of a spilled run, ask for the pages after it and add its head to heads.
+   */
+  void openSpilled(const SpilledRun& run, std::vector<Head>& heads) {
+    const std::size_t pages = (run.count + PER_PAGE - 1) / PER_PAGE;
+    // readPage() asks for the page READ_AHEAD pages on, those before it are asked for here
+    for (std::size_t p = 1; p < READ_AHEAD && p < pages; p++) {
+      bufMgr_->prefetchPages(file_, run.firstPage + p, 1);
+    }
+    Head head;
+    head.pages = pages + 1;
+    head.left = run.count;
+    readPage(head, run.firstPage);
+    heads.push_back(head);
+  }
+
+  /**
+   * Pin page pageNo of the spilled run of head, the page after the one head was on, and point head at
+   * its records.
+   */
+  void readPage(Head& head, const PageId pageNo) {
+    Page* page;
+    bufMgr_->readPage(file_, pageNo, page);
+    const std::size_t count = std::min(head.left, PER_PAGE);
+    head.pageNo = pageNo;
+    head.next = reinterpret_cast<const R*>(page);
+    head.end = head.next + count;
+    head.left -= count;
+    head.pages--;
+    if (head.pages > READ_AHEAD) {
+      bufMgr_->prefetchPages(file_, pageNo + READ_AHEAD, 1);
+    }
+  }
+
+  /**
+   * Move past the record on top of the heap, going to the next page of its run at the end of a page,
+   * and dropping the run at its end.
+   */
+  void advance(std::vector<Head>& heads) {
+    std::pop_heap(heads.begin(), heads.end(), HeadAfter());
+    Head& head = heads.back();
+    if (++head.next == head.end) {
+      if (head.pages == MEMORY_RUN) {
+        heads.pop_back();
+        return;
+      }
+      bufMgr_->unPinPage(file_, head.pageNo, false);
+      if (head.left == 0) {
+        heads.pop_back();
+        return;
+      }
+      readPage(head, head.pageNo + 1);
+    }
+    std::push_heap(heads.begin(), heads.end(), HeadAfter());
+  }
+
+  BufMgr* bufMgr_;
+  const std::string tempPrefix_;
+  const std::size_t memoryBudget_;
+
+  /**
+   * Temporary file, NULL until the first spill
+   */
+  BlobFile* file_;
+
+  /**
+   * Held while a run is added
+   */
+  std::mutex latch_;
+
+  /**
+   * Records add() collected since the last run
+   */
+  std::vector<R> pending_;
+
+  std::vector<std::vector<R> > memoryRuns_;
+  std::size_t memoryBytes_;
+  std::vector<SpilledRun> spilled_;
+
+  /**
+   * Heads of the runs of the final merge, set up by finish()
+   */
+  std::vector<Head> heads_;
+
+  std::size_t total_;
+  std::size_t numSpilled_;
+  std::size_t pagesWritten_;
+  std::size_t mergePasses_;
+};
+
+template <class R>
+const std::size_t ExternalSort<R>::DEFAULT_MEMORY;
+template <class R>
+const std::uint32_t ExternalSort<R>::READ_AHEAD;
+template <class R>
+const std::size_t ExternalSort<R>::PER_PAGE;
+template <class R>
+const std::size_t ExternalSort<R>::MEMORY_RUN;
+
+}
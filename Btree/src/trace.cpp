@@ -0,0 +1,61 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "trace.h"
+
+namespace badgerdb {
+
+std::atomic<TraceSink*> Tracer::sink_(NULL);
+std::atomic<std::uint32_t> Tracer::sampleEvery_(1);
+thread_local OpTrace* Tracer::current_ = NULL;
+thread_local std::uint32_t Tracer::skip_ = 0;
+
+void Tracer::setSink(TraceSink* sink, const std::uint32_t sampleEvery) {
+  sampleEvery_.store(sampleEvery > 0 ? sampleEvery : 1,
+                     std::memory_order_relaxed);
+  sink_.store(sink, std::memory_order_release);
+}
+
+#ifndef BADGERDB_NO_TRACE
+
+void TraceScope::start(const TraceOp op, const std::string& indexName) {
+  if (Tracer::skip_ > 0) {
+    Tracer::skip_--;
+    return;
+  }
+  // a new interval starts with the operation traced, so the first one is
+  Tracer::skip_ =
+      Tracer::sampleEvery_.load(std::memory_order_relaxed) - 1;
+  sink_ = Tracer::sink_.load(std::memory_order_acquire);
+  if (sink_ == NULL) {
+    return;
+  }
+  trace_.op = op;
+  trace_.indexName = indexName.c_str();
+  trace_.depth = 0;
+  trace_.restarts = 0;
+  trace_.pins = 0;
+  trace_.misses = 0;
+  trace_.splits = 0;
+  trace_.entries = 0;
+  trace_.readNanos = 0;
+  trace_.frameWaitNanos = 0;
+  trace_.nanos = 0;
+  Tracer::current_ = &trace_;
+  start_ = std::chrono::steady_clock::now();
+}
+
+void TraceScope::finish() {
+  trace_.nanos = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                     std::chrono::steady_clock::now() - start_).count();
+  Tracer::current_ = NULL;
+  sink_->record(trace_);
+}
+
+#endif
+
+}
@@ -0,0 +1,278 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+namespace badgerdb {
+
+/**
+ * @brief Operations of BTreeIndex that are traced.
+ */
+enum TraceOp {
+  /**
+   * insertEntry(), including the splits it causes.
+   */
+  TRACE_INSERT,
+
+  /**
+   * lookup() and lookupAll().
+   */
+  TRACE_LOOKUP,
+
+  /**
+   * startScan(), which positions the cursor on the first leaf of the range.
+   */
+  TRACE_START_SCAN,
+
+  /**
+   * One scanNext() or scanNextBatch() call.
+   */
+  TRACE_SCAN_BATCH
+};
+
+/**
+ * @brief What one operation did, counted by the index and the buffer manager while it ran in the
+ * calling thread.
+ */
+struct OpTrace {
+  TraceOp op;
+
+  /**
+   * Name of the index file, valid during TraceSink::record().
+   */
+  const char* indexName;
+
+  /**
+   * Number of nodes from the root to the leaf on the last descent of the operation, 0 if it did not
+   * descend, such as a scan batch that stayed in the leaves.
+   */
+  std::uint32_t depth;
+
+  /**
+   * Number of descents and cursor positionings started over because a node changed under them.
+   */
+  std::uint32_t restarts;
+
+  /**
+   * Number of pages pinned through BufMgr::readPage(), and of those that had to be read from disk.
+   */
+  std::uint32_t pins;
+  std::uint32_t misses;
+
+  /**
+   * Number of leaf and non-leaf splits.
+   */
+  std::uint32_t splits;
+
+  /**
+   * Number of entries returned by a lookup or a scan batch.
+   */
+  std::uint64_t entries;
+
+  /**
+   * Nanoseconds spent reading pages from disk, and waiting for a frame to read them into, which
+   * includes writing back dirty pages evicted for them.
+   */
+  std::uint64_t readNanos;
+  std::uint64_t frameWaitNanos;
+
+  /**
+   * Nanoseconds the whole operation took.
+   */
+  std::uint64_t nanos;
+};
+
+/**
+ * @brief Receiver of the traces of sampled operations, see Tracer::setSink().
+ */
+class TraceSink {
+ public:
+  virtual ~TraceSink() {}
+
+  /**
+   * Called in the thread that ran the operation, once it returns or throws. Called by several
+   * threads at once if operations run in several threads. Must not throw.
+   */
+  virtual void record(const OpTrace& trace) = 0;
+};
+
+/**
+ * @brief Sampled traces of single operations of BTreeIndex and the buffer manager reads they cause,
+ * for finding out what the slowest operations did where the counters of BufStats and IndexStats
+ * only give totals.
+ *
+ * An operation is traced by the TraceScope it starts in, and the index and BufMgr add to the trace
+ * of the calling thread through the hooks below. Without a sink, an operation costs one load of the
+ * sink and each hook one load of the trace of the thread. Building with BADGERDB_NO_TRACE defined
+ * compiles the scopes and hooks to nothing.
+ */
+class Tracer {
+ public:
+  /**
+   * Pass the trace of every sampleEvery-th operation of each thread to sink, or stop tracing if sink
+   * is NULL. Operations already running are not traced.
+   *
+   * @param sink          Receiver of the traces, which must outlive the tracing
+   * @param sampleEvery   Trace one operation in this many, per thread; 1 traces them all
+   */
+  static void setSink(TraceSink* sink, const std::uint32_t sampleEvery = 1);
+
+  /**
+   * A page was pinned.
+   */
+  static void countPin();
+
+  /**
+   * A pinned page had to be read from disk, which took readNanos, after waiting frameWaitNanos for
+   * a frame.
+   */
+  static void countMiss(const std::uint64_t readNanos, const std::uint64_t frameWaitNanos);
+
+  /**
+   * A descent reached a leaf through nodes nodes, counting the leaf.
+   */
+  static void countDescent(const int nodes);
+
+  /**
+   * A descent or a cursor was started over.
+   */
+  static void countRestart();
+
+  /**
+   * A node split.
+   */
+  static void countSplit();
+
+ private:
+  friend class TraceScope;
+
+  /**
+   * Current sink, NULL while tracing is off, and the sampling interval.
+   */
+  static std::atomic<TraceSink*> sink_;
+  static std::atomic<std::uint32_t> sampleEvery_;
+
+  /**
+   * Trace of the operation the thread is running, NULL if it is not traced.
+   */
+  static thread_local OpTrace* current_;
+
+  /**
+   * Operations the thread still skips before it traces one.
+   */
+  static thread_local std::uint32_t skip_;
+};
+
+/**
+ * @brief Traces the operation running in its scope, if tracing is on and the operation is sampled.
+ * An operation started within a traced one, such as the scanNext() that scanNextBatch() is built on,
+ * is counted in the outer trace.
+ */
+class TraceScope {
+ public:
+  TraceScope(const TraceOp op, const std::string& indexName);
+
+  /**
+   * Passes the trace to the sink.
+   */
+  ~TraceScope();
+
+  /**
+   * Count entries the operation returns.
+   */
+  void addEntries(const std::uint64_t entries);
+
+ private:
+  TraceScope(const TraceScope&);
+  TraceScope& operator=(const TraceScope&);
+
+#ifndef BADGERDB_NO_TRACE
+  void start(const TraceOp op, const std::string& indexName);
+  void finish();
+
+  OpTrace trace_;
+  TraceSink* sink_;
+  std::chrono::steady_clock::time_point start_;
+#endif
+};
+
+#ifndef BADGERDB_NO_TRACE
+
+inline void Tracer::countPin() {
+  if (current_ != NULL) {
+    current_->pins++;
+  }
+}
+
+inline void Tracer::countMiss(const std::uint64_t readNanos,
+                              const std::uint64_t frameWaitNanos) {
+  if (current_ != NULL) {
+    current_->misses++;
+    current_->readNanos += readNanos;
+    current_->frameWaitNanos += frameWaitNanos;
+  }
+}
+
+inline void Tracer::countDescent(const int nodes) {
+  if (current_ != NULL) {
+    current_->depth = nodes;
+  }
+}
+
+inline void Tracer::countRestart() {
+  if (current_ != NULL) {
+    current_->restarts++;
+  }
+}
+
+inline void Tracer::countSplit() {
+  if (current_ != NULL) {
+    current_->splits++;
+  }
+}
+
+inline TraceScope::TraceScope(const TraceOp op, const std::string& indexName)
+    : sink_(NULL) {
+  if (Tracer::sink_.load(std::memory_order_relaxed) != NULL &&
+      Tracer::current_ == NULL) {
+    start(op, indexName);
+  }
+}
+
+inline TraceScope::~TraceScope() {
+  if (sink_ != NULL) {
+    finish();
+  }
+}
+
+inline void TraceScope::addEntries(const std::uint64_t entries) {
+  if (sink_ != NULL) {
+    trace_.entries += entries;
+  }
+}
+
+#else
+
+inline void Tracer::countPin() {}
+inline void Tracer::countMiss(const std::uint64_t readNanos,
+                              const std::uint64_t frameWaitNanos) {}
+inline void Tracer::countDescent(const int nodes) {}
+inline void Tracer::countRestart() {}
+inline void Tracer::countSplit() {}
+
+inline TraceScope::TraceScope(const TraceOp op, const std::string& indexName) {}
+inline TraceScope::~TraceScope() {}
+inline void TraceScope::addEntries(const std::uint64_t entries) {}
+
+#endif
+
+}
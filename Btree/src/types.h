@@ -24,6 +24,19 @@ typedef std::uint16_t SlotId;
  */
 typedef std::uint32_t FrameId;
 
+/**
+ * @brief Scan operations enumeration. Passed to BTreeIndex::startScan() method and to the
+ * filters of a FileScan.
+ */
+enum Operator
+{ 
+  EMPTY,
+	LT, 	/* Less Than */
+	LTE,	/* Less Than or Equal to */
+	GTE,	/* Greater Than or Equal to */
+	GT		/* Greater Than */
+};
+
 /**
  * @brief Identifier for a record in a page.
  */
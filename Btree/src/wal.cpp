@@ -0,0 +1,679 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "wal.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <set>
+#include <thread>
+#include <utility>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "file.h"
+#include "exceptions/file_not_found_exception.h"
+#include "exceptions/file_open_exception.h"
+
+namespace badgerdb {
+
+namespace {
+
+/**
+ * Action of a thread on a log.
+ */
+struct ThreadAction {
+  const WriteAheadLog* log;
+  std::uint64_t action;
+  Lsn last_commit;
+};
+
+thread_local ThreadAction threadAction = {NULL, 0, 0};
+
+/**
+ * Reads or writes length bytes at the given offset of the descriptor, going
+ * on after partial transfers and interrupted calls. Reads stop at the end of
+ * the file, leaving the rest of the buffer zeroed.
+ */
+void transferAt(const int fd, const bool write, off_t offset, char* buffer,
+                std::size_t length) {
+  while (length > 0) {
+    const ssize_t done = write ? ::pwrite(fd, buffer, length, offset)
+                               : ::pread(fd, buffer, length, offset);
+    if (done < 0 && errno == EINTR) {
+      continue;
+    }
+    if (done <= 0) {
+      break;
+    }
+    offset += done;
+    buffer += done;
+    length -= done;
+  }
+  if (!write) {
+    memset(buffer, 0, length);
+  }
+}
+
+/**
+ * A run of bytes of a page changed by an update.
+ */
+struct Run {
+  std::uint16_t offset;
+  std::uint16_t length;
+};
+
+}
+
+WriteAheadLog::WriteAheadLog(const std::string& name)
+    : filename_(name), flushing_(false), last_action_(0) {
+  fd_ = ::open(name.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0666);
+  if (fd_ < 0) {
+    throw FileNotFoundException(name);
+  }
+  struct stat status;
+  appended_lsn_ = ::fstat(fd_, &status) == 0 ? status.st_size : 0;
+  flushed_lsn_ = appended_lsn_;
+  memset(&stats_, 0, sizeof(stats_));
+}
+
+WriteAheadLog::~WriteAheadLog() {
+  flushAll();
+  ::close(fd_);
+}
+
+Lsn WriteAheadLog::logUpdate(const std::string& filename,
+                             const PageId page_number, Page& logged,
+                             const Page& current) {
+  char* before = reinterpret_cast<char*>(&logged);
+  const char* after = reinterpret_cast<const char*>(&current);
+  if (memcmp(before, after, Page::SIZE) == 0) {
+    return 0;
+  }
+
+  // runs of differing words, trimmed to the bytes that differ at their ends
+  std::vector<Run> runs;
+  std::size_t payload = 0;
+  const std::size_t WORD = sizeof(std::uint64_t);
+  for (std::size_t i = 0; i < Page::SIZE; ) {
+    if (memcmp(before + i, after + i, WORD) == 0) {
+      i += WORD;
+      continue;
+    }
+    std::size_t start = i;
+    while (i < Page::SIZE && memcmp(before + i, after + i, WORD) != 0) {
+      i += WORD;
+    }
+    std::size_t end = i;
+    while (before[start] == after[start]) {
+      ++start;
+    }
+    while (before[end - 1] == after[end - 1]) {
+      --end;
+    }
+    Run run = {static_cast<std::uint16_t>(start),
+               static_cast<std::uint16_t>(end - start)};
+    runs.push_back(run);
+    payload += run.length;
+  }
+
+  RecordHeader header;
+  memset(&header, 0, sizeof(header));
+  header.length = sizeof(RecordHeader) + filename.size() +
+                  runs.size() * sizeof(Run) + 2 * payload;
+  header.type = RECORD_UPDATE;
+  header.page_number = page_number;
+  header.name_length = filename.size();
+  header.num_runs = runs.size();
+  header.action = threadAction.log == this ? threadAction.action : 0;
+
+  std::vector<char> record(header.length);
+  char* next = &record[0];
+  memcpy(next, &header, sizeof(header));
+  next += sizeof(header);
+  memcpy(next, filename.data(), filename.size());
+  next += filename.size();
+  memcpy(next, &runs[0], runs.size() * sizeof(Run));
+  next += runs.size() * sizeof(Run);
+  for (std::size_t r = 0; r < runs.size(); ++r) {
+    memcpy(next, before + runs[r].offset, runs[r].length);
+    next += runs[r].length;
+  }
+  for (std::size_t r = 0; r < runs.size(); ++r) {
+    memcpy(next, after + runs[r].offset, runs[r].length);
+    next += runs[r].length;
+    // the logged image catches up with the page
+    memcpy(before + runs[r].offset, after + runs[r].offset, runs[r].length);
+  }
+  return append(record);
+}
+
+bool WriteAheadLog::beginAction() {
+  if (threadAction.log == this && threadAction.action != 0) {
+    return false;
+  }
+  if (threadAction.log != this) {
+    threadAction.log = this;
+    threadAction.last_commit = 0;
+  }
+  std::lock_guard<std::mutex> guard(latch_);
+  threadAction.action = ++last_action_;
+  return true;
+}
+
+Lsn WriteAheadLog::commitAction() {
+  if (threadAction.log != this) {
+    return 0;
+  }
+  if (threadAction.action != 0) {
+    RecordHeader header;
+    memset(&header, 0, sizeof(header));
+    header.length = sizeof(RecordHeader);
+    header.type = RECORD_COMMIT;
+    header.action = threadAction.action;
+    std::vector<char> record(reinterpret_cast<const char*>(&header),
+                             reinterpret_cast<const char*>(&header + 1));
+    threadAction.last_commit = append(record);
+    threadAction.action = 0;
+  }
+  return threadAction.last_commit;
+}
+
+void WriteAheadLog::abandonAction() {
+  if (threadAction.log == this) {
+    threadAction.action = 0;
+  }
+}
+
+bool WriteAheadLog::inAction() const {
+  return threadAction.log == this && threadAction.action != 0;
+}
+
+Lsn WriteAheadLog::append(std::vector<char>& record) {
+  RecordHeader* header = reinterpret_cast<RecordHeader*>(&record[0]);
+  header->checksum = checksum(&record[0], record.size());
+  std::lock_guard<std::mutex> guard(latch_);
+  if (header->type == RECORD_UPDATE) {
+    ++stats_.updates;
+    if (header->action != 0) {
+      // no-op if the action has updates already
+      open_actions_.insert(std::make_pair(header->action, appended_lsn_));
+    }
+  } else if (header->type == RECORD_COMMIT) {
+    ++stats_.commits;
+    open_actions_.erase(header->action);
+  } else {
+    ++stats_.checkpoints;
+  }
+  pending_.insert(pending_.end(), record.begin(), record.end());
+  appended_lsn_ += record.size();
+  stats_.bytes += record.size();
+  return appended_lsn_;
+}
+
+void WriteAheadLog::flush(Lsn lsn) {
+  std::unique_lock<std::mutex> guard(latch_);
+  lsn = std::min(lsn, appended_lsn_);
+  while (flushed_lsn_.load() < lsn) {
+    if (flushing_) {
+      // the write under way may take the record already, wait and see
+      flushed_.wait(guard);
+      continue;
+    }
+    // lead a group: take everything appended so far
+    flushing_ = true;
+    std::vector<char> batch;
+    batch.swap(pending_);
+    const Lsn end = appended_lsn_;
+    guard.unlock();
+
+    const char* next = batch.data();
+    std::size_t left = batch.size();
+    while (left > 0) {
+      const ssize_t done = ::write(fd_, next, left);
+      if (done < 0 && errno == EINTR) {
+        continue;
+      }
+      if (done <= 0) {
+        break;
+      }
+      next += done;
+      left -= done;
+    }
+    if (File::durability() == DURABILITY_SYNC) {
+      ::fdatasync(fd_);
+    }
+
+    guard.lock();
+    flushed_lsn_ = end;
+    flushing_ = false;
+    ++stats_.flushes;
+    flushed_.notify_all();
+  }
+}
+
+void WriteAheadLog::flushAll() {
+  flush(appendedLsn());
+}
+
+Lsn WriteAheadLog::appendedLsn() const {
+  std::lock_guard<std::mutex> guard(latch_);
+  return appended_lsn_;
+}
+
+WalStats WriteAheadLog::stats() const {
+  std::lock_guard<std::mutex> guard(latch_);
+  return stats_;
+}
+
+std::uint32_t WriteAheadLog::checksum(const char* record,
+                                      const std::size_t length) {
+  // FNV-1a
+  std::uint32_t hash = 2166136261u;
+  for (std::size_t i = offsetof(RecordHeader, action); i < length; ++i) {
+    hash = (hash ^ static_cast<unsigned char>(record[i])) * 16777619u;
+  }
+  return hash;
+}
+
+Lsn WriteAheadLog::checkpoint(const Lsn begin,
+                              const std::vector<DirtyPage>& dirty) {
+  // the redo point: no change missing from disk is older
+  Lsn redo = begin;
+  std::size_t length = sizeof(RecordHeader) + 2 * sizeof(Lsn) +
+                       sizeof(std::uint32_t);
+  for (std::size_t i = 0; i < dirty.size(); ++i) {
+    redo = std::min(redo, dirty[i].rec_lsn);
+    length += sizeof(Lsn) + sizeof(PageId) + sizeof(std::uint16_t) +
+              dirty[i].filename.size();
+  }
+  {
+    std::lock_guard<std::mutex> guard(latch_);
+    for (std::map<std::uint64_t, Lsn>::const_iterator open =
+             open_actions_.begin(); open != open_actions_.end(); ++open) {
+      redo = std::min(redo, open->second);
+    }
+  }
+
+  RecordHeader header;
+  memset(&header, 0, sizeof(header));
+  header.length = length;
+  header.type = RECORD_CHECKPOINT;
+  std::vector<char> record(length);
+  char* next = &record[0];
+  memcpy(next, &header, sizeof(header));
+  next += sizeof(header);
+  memcpy(next, &redo, sizeof(Lsn));
+  next += sizeof(Lsn);
+  memcpy(next, &begin, sizeof(Lsn));
+  next += sizeof(Lsn);
+  const std::uint32_t count = dirty.size();
+  memcpy(next, &count, sizeof(count));
+  next += sizeof(count);
+  for (std::size_t i = 0; i < dirty.size(); ++i) {
+    const std::uint16_t name_length = dirty[i].filename.size();
+    memcpy(next, &dirty[i].rec_lsn, sizeof(Lsn));
+    next += sizeof(Lsn);
+    memcpy(next, &dirty[i].page_number, sizeof(PageId));
+    next += sizeof(PageId);
+    memcpy(next, &name_length, sizeof(name_length));
+    next += sizeof(name_length);
+    memcpy(next, dirty[i].filename.data(), name_length);
+    next += name_length;
+  }
+  const Lsn end = append(record);
+  flush(end);
+
+  // name the checkpoint in a file of its own, replaced in one step
+  const Lsn start = end - length;
+  const std::string master = checkpointName(filename_);
+  const std::string temporary = master + ".new";
+  const int fd = ::open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+  if (fd >= 0) {
+    transferAt(fd, true /* write */, 0,
+               const_cast<char*>(reinterpret_cast<const char*>(&start)),
+               sizeof(start));
+    if (File::durability() == DURABILITY_SYNC) {
+      ::fsync(fd);
+    }
+    ::close(fd);
+    ::rename(temporary.c_str(), master.c_str());
+  }
+  return redo;
+}
+
+namespace {
+
+/**
+ * A file named in the log, as recover() opened it.
+ */
+struct RecoveredFile {
+  int fd;
+
+  /**
+   * Where the pages of the file keep their checksum, which is set again once
+   * a page is recovered
+   */
+  PageChecksum checksum;
+
+  /**
+   * The file opened as a BlobFile if its pages are stored compressed, and so
+   * have no place of their own; NULL for other files
+   */
+  std::shared_ptr<BlobFile> compressed;
+
+  /**
+   * Held while a page of a compressed file is read or written through it
+   */
+  std::shared_ptr<std::mutex> latch;
+};
+
+/**
+ * A page to recover and the records to apply to it, by their offsets in the
+ * log.
+ */
+struct PageWork {
+  std::string filename;
+  PageId page_number;
+  RecoveredFile* file;
+  std::vector<std::size_t> redo;
+
+  /**
+   * Records to take back, oldest first
+   */
+  std::vector<std::size_t> undo;
+};
+
+}
+
+WalRecovery WriteAheadLog::recover(const std::string& name,
+                                   const std::uint32_t threads) {
+  WalRecovery result;
+  memset(&result, 0, sizeof(result));
+
+  const int log = ::open(name.c_str(), O_RDWR);
+  if (log < 0) {
+    throw FileNotFoundException(name);
+  }
+  struct stat status;
+  std::vector<char> bytes(::fstat(log, &status) == 0 ? status.st_size : 0);
+  if (!bytes.empty()) {
+    transferAt(log, false /* write */, 0, &bytes[0], bytes.size());
+  }
+  // whether a record is whole and undamaged
+  const auto whole = [&bytes](const std::size_t offset, RecordHeader& header) {
+    if (offset + sizeof(RecordHeader) > bytes.size()) {
+      return false;
+    }
+    memcpy(&header, &bytes[offset], sizeof(header));
+    return header.length >= sizeof(RecordHeader) &&
+           offset + header.length <= bytes.size() &&
+           checksum(&bytes[offset], header.length) == header.checksum;
+  };
+
+  // the last checkpoint: where to start, and the pages then dirty
+  typedef std::pair<std::string, PageId> PageKey;
+  std::map<PageKey, Lsn> dirty;
+  Lsn begin = 0;
+  {
+    Lsn start = 0;
+    RecordHeader header;
+    const int master = ::open(checkpointName(name).c_str(), O_RDONLY);
+    if (master >= 0) {
+      transferAt(master, false /* write */, 0, reinterpret_cast<char*>(&start),
+                 sizeof(start));
+      ::close(master);
+      if (start < bytes.size() && whole(start, header) &&
+          header.type == RECORD_CHECKPOINT) {
+        const char* next = &bytes[start + sizeof(header)];
+        memcpy(&result.redo_lsn, next, sizeof(Lsn));
+        next += sizeof(Lsn);
+        memcpy(&begin, next, sizeof(Lsn));
+        next += sizeof(Lsn);
+        std::uint32_t count;
+        memcpy(&count, next, sizeof(count));
+        next += sizeof(count);
+        for (std::uint32_t i = 0; i < count; ++i) {
+          Lsn rec_lsn;
+          PageId page_number;
+          std::uint16_t name_length;
+          memcpy(&rec_lsn, next, sizeof(Lsn));
+          next += sizeof(Lsn);
+          memcpy(&page_number, next, sizeof(PageId));
+          next += sizeof(PageId);
+          memcpy(&name_length, next, sizeof(name_length));
+          next += sizeof(name_length);
+          dirty[PageKey(std::string(next, name_length), page_number)] = rec_lsn;
+          next += name_length;
+        }
+      }
+    }
+  }
+
+  // the whole records from the redo point on, and the actions that committed
+  std::vector<std::size_t> updates;
+  std::set<std::uint64_t> committed;
+  for (std::size_t offset = result.redo_lsn; ; ) {
+    RecordHeader header;
+    if (!whole(offset, header)) {
+      break;
+    }
+    if (header.type == RECORD_COMMIT) {
+      committed.insert(header.action);
+    } else if (header.type == RECORD_UPDATE) {
+      updates.push_back(offset);
+    }
+    offset += header.length;
+  }
+  result.records = updates.size();
+
+  // the records of every page. Records from before the checkpoint began are
+  // on disk unless their page was dirty then, and changed since rec_lsn.
+  std::vector<PageWork> work;
+  std::map<PageKey, std::size_t> pageWork;
+  for (std::size_t u = 0; u < updates.size(); ++u) {
+    RecordHeader header;
+    memcpy(&header, &bytes[updates[u]], sizeof(header));
+    const PageKey key(std::string(&bytes[updates[u] + sizeof(header)],
+                                  header.name_length),
+                      header.page_number);
+    std::map<PageKey, std::size_t>::iterator page = pageWork.find(key);
+    if (page == pageWork.end()) {
+      page = pageWork.insert(std::make_pair(key, work.size())).first;
+      work.push_back(PageWork());
+      work.back().filename = key.first;
+      work.back().page_number = key.second;
+    }
+    bool redo = true;
+    if (updates[u] + header.length <= begin) {
+      std::map<PageKey, Lsn>::const_iterator entry = dirty.find(key);
+      redo = entry != dirty.end() && updates[u] >= entry->second;
+    }
+    if (redo) {
+      work[page->second].redo.push_back(updates[u]);
+      ++result.redone;
+    } else {
+      ++result.skipped;
+    }
+    if (header.action != 0 && committed.find(header.action) == committed.end()) {
+      work[page->second].undo.push_back(updates[u]);
+      ++result.undone;
+    }
+  }
+
+  std::map<std::string, RecoveredFile> files;
+  try {
+    for (std::size_t w = 0; w < work.size(); ++w) {
+      std::map<std::string, RecoveredFile>::iterator file =
+          files.find(work[w].filename);
+      if (file == files.end()) {
+        if (File::isOpen(work[w].filename)) {
+          throw FileOpenException(work[w].filename);
+        }
+        RecoveredFile opened;
+        opened.fd = ::open(work[w].filename.c_str(), O_RDWR);
+        if (opened.fd < 0) {
+          throw FileNotFoundException(work[w].filename);
+        }
+        file = files.insert(std::make_pair(work[w].filename, opened)).first;
+        FileHeader header;
+        transferAt(opened.fd, false /* write */, 0,
+                   reinterpret_cast<char*>(&header), sizeof(header));
+        file->second.checksum = static_cast<PageChecksum>(header.page_checksum);
+        if (header.compressed) {
+          file->second.compressed.reset(new BlobFile(work[w].filename, false));
+          file->second.latch.reset(new std::mutex());
+        }
+      }
+      work[w].file = &file->second;
+    }
+
+    // every page is read, brought up to date and written back by one thread:
+    // its updates again in log order, then those of unfinished actions taken
+    // back newest first
+    std::uint32_t numThreads = threads;
+    if (numThreads == 0) {
+      numThreads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    numThreads = std::max<std::size_t>(1, std::min<std::size_t>(numThreads, work.size()));
+    result.threads = numThreads;
+    std::atomic<std::size_t> nextPage(0);
+    const auto recoverPages = [&]() {
+      std::vector<char> page(Page::SIZE);
+      for (std::size_t w = nextPage++; w < work.size(); w = nextPage++) {
+        const PageWork& todo = work[w];
+        if (todo.redo.empty() && todo.undo.empty()) {
+          continue;
+        }
+        BlobFile* compressed = todo.file->compressed.get();
+        std::unique_lock<std::mutex> latch;
+        if (compressed != NULL) {
+          latch = std::unique_lock<std::mutex>(*todo.file->latch);
+          const Page read = compressed->readPage(todo.page_number);
+          memcpy(&page[0], &read, Page::SIZE);
+        } else {
+          transferAt(todo.file->fd, false /* write */,
+                     File::pagePosition(todo.page_number), &page[0], Page::SIZE);
+        }
+        for (std::size_t r = 0; r < todo.redo.size(); ++r) {
+          applyRecord(&bytes[todo.redo[r]], false /* undo */, &page[0]);
+        }
+        for (std::size_t r = todo.undo.size(); r-- > 0; ) {
+          applyRecord(&bytes[todo.undo[r]], true /* undo */, &page[0]);
+        }
+        if (compressed != NULL) {
+          Page written;
+          memcpy(&written, &page[0], Page::SIZE);
+          compressed->writePage(todo.page_number, written);
+          continue;
+        }
+        File::sealImage(todo.file->checksum, &page[0]);
+        transferAt(todo.file->fd, true /* write */,
+                   File::pagePosition(todo.page_number), &page[0], Page::SIZE);
+      }
+    };
+    std::vector<std::thread> workers;
+    for (std::uint32_t t = 1; t < numThreads; ++t) {
+      workers.push_back(std::thread(recoverPages));
+    }
+    recoverPages();
+    for (std::size_t t = 0; t < workers.size(); ++t) {
+      workers[t].join();
+    }
+
+    // count the pages past the end of their file into its header
+    std::map<std::string, PageId> lowest, highest;
+    for (std::size_t w = 0; w < work.size(); ++w) {
+      if (work[w].redo.empty() && work[w].undo.empty()) {
+        continue;
+      }
+      ++result.pages;
+      const std::string& filename = work[w].filename;
+      if (lowest.find(filename) == lowest.end() ||
+          work[w].page_number < lowest[filename]) {
+        lowest[filename] = work[w].page_number;
+      }
+      highest[filename] = std::max(highest[filename], work[w].page_number);
+    }
+    for (std::map<std::string, RecoveredFile>::iterator file = files.begin();
+         file != files.end(); ++file) {
+      // a compressed file writes its header, with its page map, when closed
+      BlobFile* compressed = file->second.compressed.get();
+      FileHeader header;
+      if (compressed != NULL) {
+        header = compressed->readHeader();
+      } else {
+        transferAt(file->second.fd, false /* write */, 0,
+                   reinterpret_cast<char*>(&header), sizeof(header));
+      }
+      if (highest.find(file->first) != highest.end() &&
+          header.num_pages <= highest[file->first]) {
+        header.num_pages = highest[file->first] + 1;
+        if (header.first_used_page == Page::INVALID_NUMBER) {
+          header.first_used_page = lowest[file->first];
+        }
+        if (compressed != NULL) {
+          compressed->writeHeader(header);
+        } else {
+          transferAt(file->second.fd, true /* write */, 0,
+                     reinterpret_cast<char*>(&header), sizeof(header));
+        }
+      }
+      file->second.compressed.reset();
+      ::fsync(file->second.fd);
+    }
+  } catch (...) {
+    for (std::map<std::string, RecoveredFile>::iterator file = files.begin();
+         file != files.end(); ++file) {
+      file->second.compressed.reset();
+      ::close(file->second.fd);
+    }
+    ::close(log);
+    throw;
+  }
+
+  for (std::map<std::string, RecoveredFile>::iterator file = files.begin();
+       file != files.end(); ++file) {
+    ::close(file->second.fd);
+  }
+  // every change of the log is in the files now
+  if (::ftruncate(log, 0) == 0) {
+    ::fsync(log);
+  }
+  ::close(log);
+  ::unlink(checkpointName(name).c_str());
+  return result;
+}
+
+void WriteAheadLog::applyRecord(const char* record, const bool undo,
+                                char* page) {
+  RecordHeader header;
+  memcpy(&header, record, sizeof(header));
+  const char* runs = record + sizeof(header) + header.name_length;
+  const char* data = runs + header.num_runs * sizeof(Run);
+  std::size_t payload = 0;
+  for (std::uint16_t r = 0; r < header.num_runs; ++r) {
+    Run run;
+    memcpy(&run, runs + r * sizeof(Run), sizeof(Run));
+    payload += run.length;
+  }
+  // before images first, after images behind them
+  const char* image = undo ? data : data + payload;
+  for (std::uint16_t r = 0; r < header.num_runs; ++r) {
+    Run run;
+    memcpy(&run, runs + r * sizeof(Run), sizeof(Run));
+    memcpy(page + run.offset, image, run.length);
+    image += run.length;
+  }
+}
+
+}
@@ -0,0 +1,431 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "page.h"
+
+namespace badgerdb {
+
+/**
+ * @brief Log sequence number: the offset in the log just past the end of a
+ *        record. Zero is before every record.
+ */
+typedef std::uint64_t Lsn;
+
+/**
+ * @brief Counters of a WriteAheadLog.
+ */
+struct WalStats {
+  /**
+   * Page update records appended.
+   */
+  std::uint64_t updates;
+
+  /**
+   * Actions committed.
+   */
+  std::uint64_t commits;
+
+  /**
+   * Writes of the log to the operating system, each taking every record
+   * appended before it started.
+   */
+  std::uint64_t flushes;
+
+  /**
+   * Bytes appended to the log.
+   */
+  std::uint64_t bytes;
+
+  /**
+   * Checkpoints taken.
+   */
+  std::uint64_t checkpoints;
+};
+
+/**
+ * @brief A page that was dirty in the buffer pool when a checkpoint was
+ *        taken.
+ */
+struct DirtyPage {
+  std::string filename;
+  PageId page_number;
+
+  /**
+   * LSN from which the log holds every change of the page not on disk yet.
+   */
+  Lsn rec_lsn;
+};
+
+/**
+ * @brief What WriteAheadLog::recover() did.
+ */
+struct WalRecovery {
+  /**
+   * LSN the log was read from: the redo point of the last checkpoint, 0 if
+   * there was none.
+   */
+  Lsn redo_lsn;
+
+  /**
+   * Update records found in the log from the redo point on, up to the first
+   * torn or damaged one.
+   */
+  std::uint64_t records;
+
+  /**
+   * Update records applied again.
+   */
+  std::uint64_t redone;
+
+  /**
+   * Update records passed over because the last checkpoint shows their page
+   * was on disk with them.
+   */
+  std::uint64_t skipped;
+
+  /**
+   * Update records of actions without a commit record, whose changes were
+   * taken back.
+   */
+  std::uint64_t undone;
+
+  /**
+   * Pages written back to their files.
+   */
+  std::uint64_t pages;
+
+  /**
+   * Threads the pages were recovered by.
+   */
+  std::uint32_t threads;
+};
+
+/**
+ * @brief Write-ahead log of the pages of a buffer pool.
+ *
+ * Once attached to a BufMgr with BufMgr::setLog(), every page unpinned dirty
+ * is compared with its image as of the last time it was logged, and an update
+ * record with the runs of bytes that changed, as they were before and after,
+ * is appended. The record names the page by file name and page number, and
+ * its offsets are positions in the page, so that it is applied without
+ * knowing what the page holds. The buffer manager writes no page before the
+ * log is written up to the last record of the page.
+ *
+ * Updates are grouped into actions, such as one insert into an index with
+ * all the nodes its splits change. The updates of a thread between
+ * beginAction() and commitAction() belong to its action; updates made outside
+ * of any action count as committed on their own. After a crash, recover()
+ * applies every update of the log again and then takes back, newest first,
+ * those of actions that have no commit record, so that an action changes
+ * either all of its pages or none.
+ *
+ * A checkpoint, taken by BufMgr::checkpoint() while the pool is in use,
+ * records the pages then dirty in the pool with the LSN from which the log
+ * has their changes, and names it in a small file next to the log, the log
+ * name with ".checkpoint" appended. recover() then starts reading at the
+ * redo point of the last checkpoint: the oldest of those LSNs and of the
+ * first updates of the actions running at the time. Records older than the
+ * checkpoint are only applied to pages it lists as dirty. The pages are
+ * recovered in parallel, each by one thread applying its own records in log
+ * order.
+ *
+ * Records are appended to a buffer in memory. flush() is a group commit: the
+ * first thread to ask for the log to be written writes everything appended
+ * so far, and threads that ask meanwhile wait for it rather than writing
+ * themselves, so that commits arriving together share one write. The log is
+ * also synced to disk if File::durability() is DURABILITY_SYNC.
+ *
+ * All methods are threadsafe.
+ */
+class WriteAheadLog {
+ public:
+  /**
+   * Opens a log, creating it if it does not exist. Records are appended after
+   * those already in it, which should have been applied by recover() first.
+   *
+   * @param name  Name of the log file.
+   * @throws  FileNotFoundException   If the file cannot be opened.
+   */
+  explicit WriteAheadLog(const std::string& name);
+
+  /**
+   * Writes out the records appended so far and closes the log.
+   */
+  ~WriteAheadLog();
+
+  /**
+   * Appends an update record with the runs of bytes that differ between the
+   * two images of a page, for the action of the calling thread, and brings
+   * the old image up to date with the new one.
+   *
+   * @param filename  Name of the file of the page.
+   * @param page_number  Number of the page.
+   * @param logged    Image of the page when it was last logged, updated.
+   * @param current   Image of the page now.
+   * @return  LSN of the record, or 0 if the page did not change.
+   */
+  Lsn logUpdate(const std::string& filename, const PageId page_number,
+                Page& logged, const Page& current);
+
+  /**
+   * Starts an action for the calling thread, unless it is in one already.
+   *
+   * @return  True if an action was started.
+   */
+  bool beginAction();
+
+  /**
+   * Appends the commit record of the action of the calling thread and ends
+   * it. The record is not written yet; flush() up to the returned LSN makes
+   * the action durable.
+   *
+   * @return  LSN of the commit record of the last action the thread
+   *          committed, 0 if it has committed none.
+   */
+  Lsn commitAction();
+
+  /**
+   * Ends the action of the calling thread without committing it. Its updates
+   * are taken back by recover() if the log is not truncated in between.
+   */
+  void abandonAction();
+
+  /**
+   * Returns true if the calling thread is in an action.
+   */
+  bool inAction() const;
+
+  /**
+   * Writes the log up to at least the given LSN, together with every record
+   * appended before the write starts.
+   *
+   * @param lsn   LSN to write up to.
+   */
+  void flush(const Lsn lsn);
+
+  /**
+   * Writes every record appended so far.
+   */
+  void flushAll();
+
+  /**
+   * Returns the LSN of the last record appended.
+   */
+  Lsn appendedLsn() const;
+
+  /**
+   * Returns the LSN up to which the log has been written.
+   */
+  Lsn flushedLsn() const { return flushed_lsn_.load(); }
+
+  /**
+   * Returns the counters of the log.
+   */
+  WalStats stats() const;
+
+  /**
+   * Returns the name of the log file.
+   */
+  const std::string& filename() const { return filename_; }
+
+  /**
+   * Appends a checkpoint record, writes the log up to it and makes it the
+   * checkpoint recover() starts from. Called by BufMgr::checkpoint().
+   *
+   * @param begin   LSN appended before the pages were looked at. Records up
+   *                to it only need applying to the dirty pages.
+   * @param dirty   Pages dirty in the pool.
+   * @return  Redo point of the checkpoint.
+   */
+  Lsn checkpoint(const Lsn begin, const std::vector<DirtyPage>& dirty);
+
+  /**
+   * Brings the files named in a log up to date after a crash: applies every
+   * update record again, takes back those of actions without a commit record,
+   * writes the pages back, counts pages past the end of a file into its
+   * header and syncs the files. The log is then emptied and its checkpoint
+   * dropped. Stops at the first record that was not written whole.
+   *
+   * @param name  Name of the log file.
+   * @param threads  Number of threads recovering pages, 0 for one per core.
+   * @return  What was recovered.
+   * @throws  FileNotFoundException   If the log or a file it names does not
+   *                                  exist.
+   * @throws  FileOpenException       If a file the log names is open.
+   */
+  static WalRecovery recover(const std::string& name,
+                             const std::uint32_t threads = 0);
+
+ private:
+  /**
+   * Kinds of records.
+   */
+  enum RecordType {
+    RECORD_UPDATE = 1,
+    RECORD_COMMIT = 2,
+
+    /**
+     * Goes on with the redo point and the begin LSN of the checkpoint, the
+     * number of dirty pages, and for each its rec_lsn, page number, the
+     * length of its file name and the name.
+     */
+    RECORD_CHECKPOINT = 3
+  };
+
+  /**
+   * Header at the start of every record. An update record goes on with the
+   * file name, then a (offset, length) pair of 16 bit numbers for each run,
+   * then the bytes of the runs before the update and after it, in the same
+   * order.
+   */
+  struct RecordHeader {
+    /**
+     * Length of the whole record.
+     */
+    std::uint32_t length;
+
+    /**
+     * Checksum of the record from the field after this one on, telling torn
+     * records at the end of the log.
+     */
+    std::uint32_t checksum;
+
+    /**
+     * Action the record belongs to, 0 for none.
+     */
+    std::uint64_t action;
+
+    std::uint32_t type;
+    PageId page_number;
+    std::uint16_t name_length;
+    std::uint16_t num_runs;
+  };
+
+  /**
+   * Appends a record whose checksum is not filled in yet, under latch_.
+   *
+   * @return  LSN of the record.
+   */
+  Lsn append(std::vector<char>& record);
+
+  /**
+   * Checksum of a record from after the checksum field on.
+   */
+  static std::uint32_t checksum(const char* record, const std::size_t length);
+
+  /**
+   * Applies the after images of an update record to a page, or its before
+   * images if undo is set.
+   */
+  static void applyRecord(const char* record, const bool undo, char* page);
+
+  /**
+   * Name of the file naming the last checkpoint of a log.
+   */
+  static std::string checkpointName(const std::string& name) {
+    return name + ".checkpoint";
+  }
+
+  std::string filename_;
+
+  /**
+   * Descriptor of the log file, opened for appending.
+   */
+  int fd_;
+
+  /**
+   * Held while records are appended and while flushes are handed over.
+   */
+  mutable std::mutex latch_;
+
+  /**
+   * Signalled when a flush ends.
+   */
+  std::condition_variable flushed_;
+
+  /**
+   * Records appended and not taken by a flush yet.
+   */
+  std::vector<char> pending_;
+
+  /**
+   * LSN of the last record appended.
+   */
+  Lsn appended_lsn_;
+
+  /**
+   * LSN up to which the log has been written.
+   */
+  std::atomic<Lsn> flushed_lsn_;
+
+  /**
+   * True while a thread writes the log.
+   */
+  bool flushing_;
+
+  /**
+   * Last action number handed out.
+   */
+  std::uint64_t last_action_;
+
+  /**
+   * LSN before the first update of each action that has updates and is not
+   * committed. Abandoned actions stay, since recover() takes back all of
+   * their updates.
+   */
+  std::map<std::uint64_t, Lsn> open_actions_;
+
+  WalStats stats_;
+};
+
+/**
+ * @brief An action of the calling thread on a log, for the scope of the
+ *        object. Does nothing without a log, or if the thread is in an action
+ *        already, which then takes in this one.
+ */
+class LogAction {
+ public:
+  explicit LogAction(WriteAheadLog* log)
+      : log_(log != NULL && log->beginAction() ? log : NULL) {}
+
+  /**
+   * Ends the action without committing it if commit() was not called.
+   */
+  ~LogAction() {
+    if (log_ != NULL) {
+      log_->abandonAction();
+    }
+  }
+
+  /**
+   * Commits the action and waits until its commit record is written.
+   */
+  void commit() {
+    if (log_ != NULL) {
+      log_->flush(log_->commitAction());
+      log_ = NULL;
+    }
+  }
+
+ private:
+  LogAction(const LogAction&);
+  LogAction& operator=(const LogAction&);
+
+  WriteAheadLog* log_;
+};
+
+}